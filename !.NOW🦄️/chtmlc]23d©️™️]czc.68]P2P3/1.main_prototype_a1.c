@@ -7,6 +7,7 @@
 // Forward declarations for functions in other files
 void init_controller();
 void init_view(const char* filename);
+int update_view();
 void init_model(const char* module_path);
 int update_model();
 
@@ -29,6 +30,11 @@ void idle_func() {
         update_ui_with_model_variables();  // Update UI with new model data
         glutPostRedisplay();
     }
+
+    // Pick up edits to the markup file
+    if (update_view()) {
+        glutPostRedisplay();
+    }
     
     // Limit to ~60 FPS by sleeping about 16ms between cycles
     usleep(16000); // Sleep for approximately 16 milliseconds
@@ -5,40 +5,8 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <sys/stat.h>
-
-// Enhanced shape structure with more properties
-typedef struct {
-    int id;
-    char type[32]; // Increased size for more descriptive types
-    float x, y, z; // 3D coordinates
-    float width, height, depth; // Separate dimensions instead of single size
-    float color[4]; // RGBA
-    char label[64]; // Label for identification
-    int active;     // Whether this shape is currently active
-} Shape;
-
-// For storing additional variables from modules
-typedef struct {
-    char label[64];
-    int type;  // 1=int, 2=float, 3=string
-    union {
-        int int_val;
-        float float_val;
-        char string_val[256];
-    } value;
-    int active;  // Whether this variable is currently active
-} ModelVariable;
-
-typedef struct {
-    char label[64];
-    int type;  // 1=int array, 2=float array
-    int count;
-    union {
-        int* int_array;
-        float* float_array;
-    } data;
-    int active;  // Whether this array is currently active
-} ModelArray;
+#include "chtml_ipc.h"
+#include "model_store.h"
 
 // --- Forward Declarations ---
 void init_model(const char* module_path);
@@ -53,11 +21,18 @@ int update_model();
 int parse_enhanced_format(const char* line);
 int parse_variable_format(const char* line);
 int parse_array_format(const char* line);
+size_t model_apply_bytes(unsigned char* data, size_t len);
 
 pid_t child_pid = -1;
 int parent_to_child_pipe[2];
 int child_to_parent_pipe[2];
 
+// Module output not yet applied: the tail of a line or frame that
+// straddles a read, plus whatever arrived in the same update
+unsigned char* ipc_buffer = NULL;
+size_t ipc_length = 0, ipc_capacity = 0;
+int ipc_protocol = 0; // 0 until the module's first bytes, then 1=text, 2=binary
+
 void init_model(const char* module_path) {
     _model_load_dir_contents(); // Load initial directory
 
@@ -66,6 +41,10 @@ void init_model(const char* module_path) {
         return;
     }
 
+    // A new module negotiates its protocol again
+    ipc_length = 0;
+    ipc_protocol = 0;
+
     // Create pipes for two-way communication
     if (pipe(parent_to_child_pipe) == -1 || pipe(child_to_parent_pipe) == -1) {
         perror("pipe");
@@ -94,6 +73,9 @@ void init_model(const char* module_path) {
         close(child_to_parent_pipe[0]);
         close(child_to_parent_pipe[1]);
 
+        // Offer the binary protocol (chtml_ipc.h); CHTML_IPC=text keeps text
+        setenv(CHTML_IPC_ENV, "binary", 0);
+
         // Execute the game module
         char *argv[] = {(char*)module_path, NULL};
         execv(argv[0], argv);
@@ -112,16 +94,10 @@ void init_model(const char* module_path) {
     }
 }
 
-#define MAX_SHAPES 100
-Shape shapes[MAX_SHAPES];
-int num_shapes = 0;
-
-// Maximum number of variables and arrays
-#define MAX_VARIABLES 50
-#define MAX_ARRAYS 20
-
-ModelVariable variables[MAX_VARIABLES];
-ModelArray arrays[MAX_ARRAYS];
+// Hash-indexed by label, dense and unbounded (model_store.h)
+ShapeStore shapes;
+VariableStore variables;
+ArrayStore arrays;
 
 // State for the Directory Lister widget
 char dir_path[1024] = ".";
@@ -216,8 +192,8 @@ char (*model_get_dir_entries(int* count))[256] {
 
 // Function for the view to get the current list of shapes to render.
 Shape* model_get_shapes(int* count) {
-    *count = num_shapes;
-    return shapes;
+    *count = shapes.count;
+    return shapes.items;
 }
 
 // Function for the controller to send input to the game module.
@@ -230,65 +206,71 @@ void model_send_input(const char* input) {
 
 
 
+// Clear all shapes (CLEAR_SHAPES)
+void model_clear_shapes() {
+    shape_store_clear(&shapes);
+}
+
+// Update the shape with this label, or create it
+void model_set_shape(const char* type, const char* label, const float* v) {
+    Shape* shape = shape_store_upsert(&shapes, label);
+    if (!shape) return;
+
+    strcpy(shape->type, type);
+    shape->x = v[0];
+    shape->y = v[1];
+    shape->z = v[2];
+    shape->width = v[3];
+    shape->height = v[4];
+    shape->depth = v[5];
+    shape->color[0] = v[6];
+    shape->color[1] = v[7];
+    shape->color[2] = v[8];
+    shape->color[3] = v[9];
+}
+
+// The variable with this label, or a new one for it
+ModelVariable* _model_variable_slot(const char* label) {
+    return variable_store_upsert(&variables, label);
+}
+
+// The array with this label, or a new one for it, with any old data freed
+ModelArray* _model_array_slot(const char* label) {
+    return array_store_upsert(&arrays, label);
+}
+
 // Helper function to parse the old CSV format (for backward compatibility)
 int parse_csv_message(const char* line) {
-    if (num_shapes < MAX_SHAPES) {
-        float size;  // Temp variable for the old size parameter
-        // Parse old format: "TYPE,x,y,size,r,g,b,a"
-        sscanf(line, "%31[^,],%f,%f,%f,%f,%f,%f,%f",
-               shapes[num_shapes].type,
-               &shapes[num_shapes].x,
-               &shapes[num_shapes].y,
-               &size,  // Read the old size parameter
-               &shapes[num_shapes].color[0],
-               &shapes[num_shapes].color[1],
-               &shapes[num_shapes].color[2],
-               &shapes[num_shapes].color[3]);
-        shapes[num_shapes].z = 0.0f; // Set default Z
-        shapes[num_shapes].width = size;   // Map old size to width
-        shapes[num_shapes].height = size;  // Map old size to height
-        shapes[num_shapes].depth = size;   // Map old size to depth
-        shapes[num_shapes].id = num_shapes; // Assign a simple ID
-        strcpy(shapes[num_shapes].label, ""); // Default empty label
-        shapes[num_shapes].active = 1;
-        num_shapes++;
-        return 1;
-    }
-    return 0;
+    // Unlabelled, so always a new shape
+    Shape* shape = shape_store_upsert(&shapes, "");
+    if (!shape) return 0;
+    float size;  // Temp variable for the old size parameter
+    // Parse old format: "TYPE,x,y,size,r,g,b,a"
+    sscanf(line, "%31[^,],%f,%f,%f,%f,%f,%f,%f",
+           shape->type,
+           &shape->x,
+           &shape->y,
+           &size,  // Read the old size parameter
+           &shape->color[0],
+           &shape->color[1],
+           &shape->color[2],
+           &shape->color[3]);
+    shape->z = 0.0f; // Set default Z
+    shape->width = size;   // Map old size to width
+    shape->height = size;  // Map old size to height
+    shape->depth = size;   // Map old size to depth
+    return 1;
 }
 
-// Helper function to parse enhanced shape format: "SHAPE:type:label:x:y:z:width:height:depth:r:g:b:a"
+// Helper function to parse enhanced shape format: "SHAPE;type;label;x;y;z;width;height;depth;r;g;b;a"
 int parse_enhanced_format(const char* line) {
-    if (num_shapes >= MAX_SHAPES) return 0;
-    
     char type[32], label[64];
-    float x, y, z, width, height, depth, r, g, b, a;
-    
-    // Parse: "SHAPE;type;label;x;y;z;width;height;depth;r;g;b;a"
+    float v[10];
     int items = sscanf(line, "SHAPE;%31[^;];%63[^;];%f;%f;%f;%f;%f;%f;%f;%f;%f;%f",
-                      type, label, &x, &y, &z, &width, &height, &depth, &r, &g, &b, &a);
-    
-    if (items == 12) {
-        strcpy(shapes[num_shapes].type, type);
-        strcpy(shapes[num_shapes].label, label);
-        shapes[num_shapes].x = x;
-        shapes[num_shapes].y = y;
-        shapes[num_shapes].z = z;
-        shapes[num_shapes].width = width;
-        shapes[num_shapes].height = height;
-        shapes[num_shapes].depth = depth;
-
-        shapes[num_shapes].color[0] = r;
-        shapes[num_shapes].color[1] = g;
-        shapes[num_shapes].color[2] = b;
-        shapes[num_shapes].color[3] = a;
-        shapes[num_shapes].id = num_shapes;
-        shapes[num_shapes].active = 1;
-        num_shapes++;
-        return 1;
-    }
-    
-    return 0;
+                      type, label, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8], &v[9]);
+    if (items != 12) return 0;
+    model_set_shape(type, label, v);
+    return 1;
 }
 
 // Helper function to parse variable format: "VAR;label;type;value"
@@ -296,24 +278,19 @@ int parse_variable_format(const char* line) {
     char label[64], type_str[16], value_str[256];
     if (sscanf(line, "VAR;%63[^;];%15[^;];%255[^\r\n]", label, type_str, value_str) == 3) {
         // Find an available slot or update existing variable
-        for (int i = 0; i < MAX_VARIABLES; i++) {
-            if (strcmp(variables[i].label, label) == 0 || !variables[i].active) {
-                strcpy(variables[i].label, label);
-                
-                if (strcmp(type_str, "int") == 0) {
-                    variables[i].type = 1;
-                    variables[i].value.int_val = atoi(value_str);
-                } else if (strcmp(type_str, "float") == 0) {
-                    variables[i].type = 2;
-                    variables[i].value.float_val = atof(value_str);
-                } else if (strcmp(type_str, "string") == 0) {
-                    variables[i].type = 3;
-                    strcpy(variables[i].value.string_val, value_str);
-                }
-                
-                variables[i].active = 1;
-                return 1;
+        ModelVariable* var = _model_variable_slot(label);
+        if (var) {
+            if (strcmp(type_str, "int") == 0) {
+                var->type = 1;
+                var->value.int_val = atoi(value_str);
+            } else if (strcmp(type_str, "float") == 0) {
+                var->type = 2;
+                var->value.float_val = atof(value_str);
+            } else if (strcmp(type_str, "string") == 0) {
+                var->type = 3;
+                strcpy(var->value.string_val, value_str);
             }
+            return 1;
         }
     }
     return 0;
@@ -333,61 +310,164 @@ int parse_array_format(const char* line) {
         else return 0;
         
         // Find an available slot or update existing array
-        for (int i = 0; i < MAX_ARRAYS; i++) {
-            if (strcmp(arrays[i].label, label) == 0 || !arrays[i].active) {
-                // Clean up any existing array data
-                if (arrays[i].data.int_array) {
-                    free(arrays[i].data.int_array);
-                    arrays[i].data.int_array = NULL;
-                }
-                
-                strcpy(arrays[i].label, label);
-                if (strcmp(type_str, "int") == 0) {
-                    arrays[i].type = 1;
-                    arrays[i].data.int_array = (int*)malloc(count * sizeof(int));
-                    if (arrays[i].data.int_array) {
-                        // Parse the integer values
-                        char *values_copy = strdup(values_start);
-                        if (values_copy) {
-                            char *token = strtok(values_copy, ",");
-                            int parsed_count = 0;
-                            while (token && parsed_count < count) {
-                                arrays[i].data.int_array[parsed_count] = atoi(token);
-                                token = strtok(NULL, ",");
-                                parsed_count++;
-                            }
-                            arrays[i].count = parsed_count;
-                            free(values_copy);
+        ModelArray* arr = _model_array_slot(label);
+        if (arr) {
+            if (strcmp(type_str, "int") == 0) {
+                arr->type = 1;
+                arr->data.int_array = (int*)malloc(count * sizeof(int));
+                if (arr->data.int_array) {
+                    // Parse the integer values
+                    char *values_copy = strdup(values_start);
+                    if (values_copy) {
+                        char *token = strtok(values_copy, ",");
+                        int parsed_count = 0;
+                        while (token && parsed_count < count) {
+                            arr->data.int_array[parsed_count] = atoi(token);
+                            token = strtok(NULL, ",");
+                            parsed_count++;
                         }
+                        arr->count = parsed_count;
+                        free(values_copy);
                     }
-                } else if (strcmp(type_str, "float") == 0) {
-                    arrays[i].type = 2;
-                    arrays[i].data.float_array = (float*)malloc(count * sizeof(float));
-                    if (arrays[i].data.float_array) {
-                        // Parse the float values
-                        char *values_copy = strdup(values_start);
-                        if (values_copy) {
-                            char *token = strtok(values_copy, ",");
-                            int parsed_count = 0;
-                            while (token && parsed_count < count) {
-                                arrays[i].data.float_array[parsed_count] = atof(token);
-                                token = strtok(NULL, ",");
-                                parsed_count++;
-                            }
-                            arrays[i].count = parsed_count;
-                            free(values_copy);
+                }
+            } else if (strcmp(type_str, "float") == 0) {
+                arr->type = 2;
+                arr->data.float_array = (float*)malloc(count * sizeof(float));
+                if (arr->data.float_array) {
+                    // Parse the float values
+                    char *values_copy = strdup(values_start);
+                    if (values_copy) {
+                        char *token = strtok(values_copy, ",");
+                        int parsed_count = 0;
+                        while (token && parsed_count < count) {
+                            arr->data.float_array[parsed_count] = atof(token);
+                            token = strtok(NULL, ",");
+                            parsed_count++;
                         }
+                        arr->count = parsed_count;
+                        free(values_copy);
                     }
                 }
-                
-                arrays[i].active = 1;
-                return 1;
             }
+            return 1;
         }
     }
     return 0;
 }
 
+// Apply one text-protocol record
+void model_apply_line(const char* line) {
+    // Determine the format based on the prefix
+    if (strncmp(line, "CLEAR_SHAPES", 12) == 0) {
+        // Special command to clear all shapes
+        model_clear_shapes();
+    } else if (strncmp(line, "SHAPE;", 6) == 0) {
+        // Update the shape with this label or create a new one
+        parse_enhanced_format(line);
+    } else if (strncmp(line, "VAR;", 4) == 0) {
+        parse_variable_format(line);
+    } else if (strncmp(line, "ARRAY;", 6) == 0) {
+        parse_array_format(line);
+    } else {
+        // Treat as old format for backward compatibility
+        parse_csv_message(line);
+    }
+}
+
+// Apply one binary frame (chtml_ipc.h)
+void model_apply_frame(int kind, const unsigned char* p, uint32_t n) {
+    char type[32], label[64], str[256];
+    float v[10], f = 0;
+    int t, i = 0;
+    uint32_t count;
+    const unsigned char* values;
+
+    if (kind == CHTML_MSG_CLEAR) {
+        model_clear_shapes();
+    } else if (kind == CHTML_MSG_SHAPE) {
+        if (chtml_ipc_get_shape(p, n, type, label, v)) model_set_shape(type, label, v);
+    } else if (kind == CHTML_MSG_VAR) {
+        if (!chtml_ipc_get_var(p, n, label, &t, &i, &f, str)) return;
+        ModelVariable* var = _model_variable_slot(label);
+        if (!var) return;
+        var->type = t;
+        if (t == CHTML_VAL_INT) var->value.int_val = i;
+        else if (t == CHTML_VAL_FLOAT) var->value.float_val = f;
+        else strcpy(var->value.string_val, str);
+    } else if (kind == CHTML_MSG_ARRAY) {
+        if (!chtml_ipc_get_array(p, n, label, &t, &count, &values)) return;
+        ModelArray* arr = _model_array_slot(label);
+        if (!arr) return;
+        arr->type = t;
+        arr->data.int_array = (int*)malloc(count ? (size_t)count * 4 : 1);
+        if (arr->data.int_array) {
+            chtml_ipc_get_values(values, t, count, arr->data.int_array);
+            arr->count = count;
+        }
+    } else if (kind == CHTML_MSG_TEXT) {
+        char line[1024];
+        size_t k = n < sizeof(line) - 1 ? n : sizeof(line) - 1;
+        memcpy(line, p, k);
+        line[k] = '\0';
+        model_apply_line(line);
+    }
+}
+
+#define IPC_READ_CHUNK 65536
+// Bytes read per update_model() call, so a module that never pauses
+// can't stall the UI
+#define IPC_MAX_READ_PER_UPDATE (4 << 20)
+
+// Apply every whole message at the start of data[0..len). Returns the
+// bytes used; the rest is an incomplete message.
+size_t model_apply_bytes(unsigned char* data, size_t len) {
+    size_t used = 0;
+    if (ipc_protocol == 0 && len > 0) {
+        if (data[0] != '\0') {
+            ipc_protocol = 1;
+        } else if (len < CHTML_IPC_MAGIC_LEN) {
+            return 0;
+        } else if (memcmp(data, CHTML_IPC_MAGIC, CHTML_IPC_MAGIC_LEN) == 0) {
+            ipc_protocol = 2;
+            used = CHTML_IPC_MAGIC_LEN;
+        } else {
+            ipc_protocol = 1;
+        }
+    }
+
+    if (ipc_protocol == 2) {
+        for (;;) {
+            int kind;
+            const unsigned char* payload;
+            uint32_t n;
+            long size = chtml_ipc_frame(data + used, len - used, &kind, &payload, &n);
+            if (size == 0) break;
+            if (size < 0) {
+                // A corrupt length leaves no way to find the next frame
+                fprintf(stderr, "Bad frame from module, dropping %zu bytes\n", len - used);
+                used = len;
+                break;
+            }
+            model_apply_frame(kind, payload, n);
+            used += size;
+        }
+    } else if (ipc_protocol == 1) {
+        for (;;) {
+            unsigned char* end = memchr(data + used, '\n', len - used);
+            if (!end) break;
+            *end = '\0';
+            if (end > data + used) model_apply_line((const char*)data + used);
+            used = end - data + 1;
+        }
+        // A line can't be longer than a frame
+        if (len - used > CHTML_IPC_MAX_FRAME) {
+            fprintf(stderr, "Line from module too long, dropping %zu bytes\n", len - used);
+            used = len;
+        }
+    }
+    return used;
+}
+
 // Function to be called continuously to update the model state from the game module.
 // Returns 1 if the model was updated, 0 otherwise.
 int update_model() {
@@ -395,139 +475,49 @@ int update_model() {
     if (child_pid == -1) {
         return 0; // No module to update from
     }
-    
-    char buffer[1024];
-    int bytes_read = read(child_to_parent_pipe[0], buffer, sizeof(buffer) - 1);
-
-    if (bytes_read > 0) {
-        buffer[bytes_read] = '\0';
-
-        char* line = strtok(buffer, "\n");
-        while (line != NULL) {
-            // Determine the format based on the prefix
-            if (strncmp(line, "CLEAR_SHAPES", 12) == 0) {
-                // Special command to clear all shapes
-                for (int i = 0; i < MAX_SHAPES; i++) {
-                    shapes[i].active = 0;
-                }
-                num_shapes = 0;
-            } else if (strncmp(line, "SHAPE;", 6) == 0) {
-                // Look for the shape by label to update existing shape or create new one
-                char type[32], label[64];
-                float x, y, z, width, height, depth, r, g, b, a;
-                
-                int items = sscanf(line, "SHAPE;%31[^;];%63[^;];%f;%f;%f;%f;%f;%f;%f;%f;%f;%f",
-                                  type, label, &x, &y, &z, &width, &height, &depth, &r, &g, &b, &a);
-                
-                if (items == 12) {
-                    // Look for an existing shape with the same label to update it
-                    int found = 0;
-                    for (int i = 0; i < MAX_SHAPES; i++) {
-                        if (shapes[i].active && strcmp(shapes[i].label, label) == 0) {
-                            // Update existing shape
-                            strcpy(shapes[i].type, type);
-                            shapes[i].x = x;
-                            shapes[i].y = y;
-                            shapes[i].z = z;
-                            shapes[i].width = width;
-                            shapes[i].height = height;
-                            shapes[i].depth = depth;
-                            shapes[i].color[0] = r;
-                            shapes[i].color[1] = g;
-                            shapes[i].color[2] = b;
-                            shapes[i].color[3] = a;
-                            found = 1;
-                            break;
-                        }
-                    }
-                    
-                    // If we didn't find an existing shape with this label, create a new one
-                    if (!found) {
-                        // Find an empty slot to create a new shape
-                        for (int i = 0; i < MAX_SHAPES; i++) {
-                            if (!shapes[i].active) {
-                                // Use this slot
-                                strcpy(shapes[i].type, type);
-                                strcpy(shapes[i].label, label);
-                                shapes[i].x = x;
-                                shapes[i].y = y;
-                                shapes[i].z = z;
-                                shapes[i].width = width;
-                                shapes[i].height = height;
-                                shapes[i].depth = depth;
-                                shapes[i].color[0] = r;
-                                shapes[i].color[1] = g;
-                                shapes[i].color[2] = b;
-                                shapes[i].color[3] = a;
-                                shapes[i].id = i;
-                                shapes[i].active = 1;
-                                break;
-                            }
-                        }
-                    }
-                }
-            } else if (strncmp(line, "VAR;", 4) == 0) {
-                parse_variable_format(line);
-            } else if (strncmp(line, "ARRAY;", 6) == 0) {
-                parse_array_format(line);
-            } else {
-                // Treat as old format for backward compatibility
-                parse_csv_message(line);
-            }
-            line = strtok(NULL, "\n");
-        }
-        
-        // Count only active shapes
-        num_shapes = 0;
-        for (int i = 0; i < MAX_SHAPES; i++) {
-            if (shapes[i].active) {
-                num_shapes++;
-            }
+
+    // Drain the pipe into the reassembly buffer
+    size_t got = 0;
+    while (got < IPC_MAX_READ_PER_UPDATE) {
+        if (ipc_capacity - ipc_length < IPC_READ_CHUNK) {
+            size_t capacity = ipc_capacity ? ipc_capacity * 2 : 4 * IPC_READ_CHUNK;
+            unsigned char* grown = realloc(ipc_buffer, capacity);
+            if (!grown) break;
+            ipc_buffer = grown;
+            ipc_capacity = capacity;
         }
-        
-        return 1; // Model was updated
+        ssize_t bytes_read = read(child_to_parent_pipe[0], ipc_buffer + ipc_length, ipc_capacity - ipc_length);
+        if (bytes_read <= 0) break;
+        ipc_length += bytes_read;
+        got += bytes_read;
     }
-    return 0; // No update
+    if (got == 0) return 0; // No update
+
+    size_t used = model_apply_bytes(ipc_buffer, ipc_length);
+    memmove(ipc_buffer, ipc_buffer + used, ipc_length - used);
+    ipc_length -= used;
+
+    return used > 0; // Model was updated if a whole message arrived
 }
 
 // Get a specific variable by label
 ModelVariable* model_get_variable(const char* label) {
-    for (int i = 0; i < MAX_VARIABLES; i++) {
-        if (variables[i].active && strcmp(variables[i].label, label) == 0) {
-            return &variables[i];
-        }
-    }
-    return NULL;
+    return variable_store_find(&variables, label);
 }
 
-// Get a specific array by label  
+// Get a specific array by label
 ModelArray* model_get_array(const char* label) {
-    for (int i = 0; i < MAX_ARRAYS; i++) {
-        if (arrays[i].active && strcmp(arrays[i].label, label) == 0) {
-            return &arrays[i];
-        }
-    }
-    return NULL;
+    return array_store_find(&arrays, label);
 }
 
-// Get all active variables
+// Get all variables, dense: every one of vars[0..count) is active
 ModelVariable* model_get_variables(int* count) {
-    *count = 0;
-    for (int i = 0; i < MAX_VARIABLES; i++) {
-        if (variables[i].active) {
-            (*count)++;
-        }
-    }
-    return variables;
+    *count = variables.count;
+    return variables.items;
 }
 
-// Get all active arrays
+// Get all arrays, dense like the variables
 ModelArray* model_get_arrays(int* count) {
-    *count = 0;
-    for (int i = 0; i < MAX_ARRAYS; i++) {
-        if (arrays[i].active) {
-            (*count)++;
-        }
-    }
-    return arrays;
+    *count = arrays.count;
+    return arrays.items;
 }
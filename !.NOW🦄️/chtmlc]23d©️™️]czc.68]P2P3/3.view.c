@@ -8,19 +8,17 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <math.h>
+#include "ui_element.h"
+#include "render_list.h"
+#include "glyph_atlas.h"
+#include "chtml_parser.h"
 
 // For this prototype, we'll define a simple structure for UI elements
-// and a hardcoded array to represent the parsed C-HTML file.
-
-#define MAX_ELEMENTS 50
-#define MAX_TEXT_LINES 1000
-#define MAX_LINE_LENGTH 512
+// and a growable array to represent the parsed C-HTML file.
 
 // Forward declaration for canvas render function
 void canvas_render_sample(int x, int y, int width, int height);
 
-#define CLIPBOARD_SIZE 10000
-
 // Definition for the renderable shape object provided by the model
 typedef struct {
     int id;
@@ -37,75 +35,20 @@ Shape* model_get_shapes(int* count);
 char (*model_get_dir_entries(int* count))[256];
 
 
-typedef struct {
-    char type[20];
-    int x, y, width, height;
-    char id[50]; // Unique identifier for UI elements
-    char label[50]; // Used for button label, text element value, and checkbox label
-    // Multi-line text support - replace simple text_content with array of lines
-    char text_content[MAX_TEXT_LINES][MAX_LINE_LENGTH];
-    int num_lines; // Number of lines in the text
-    int cursor_x; // X position of cursor (column)
-    int cursor_y; // Y position of cursor (line number)
-    int is_active; // For textfield active state
-    int is_checked; // For checkbox checked state
-    int slider_value; // For slider current value
-    int slider_min; // For slider minimum value
-    int slider_max; // For slider maximum value
-    int slider_step; // For slider step increment
-    float color[3];
-    int parent;
-    // Canvas-specific properties
-    int canvas_initialized; // Flag to track if canvas has been initialized
-    void (*canvas_render_func)(int x, int y, int width, int height); // Render function for canvas
-    char view_mode[10]; // View mode: "2d" or "3d"
-    // Camera properties for 3D view
-    float camera_pos[3]; // Camera position (x, y, z)
-    float camera_target[3]; // Camera target (x, y, z)
-    float camera_up[3]; // Camera up vector (x, y, z)
-    float fov; // Field of view for 3D perspective
-    // Event handling
-    char onClick[50]; // Store the onClick handler function name
-    // Menu-specific properties
-    int menu_items_count; // Number of submenu items
-    int is_open; // For menus - whether they are currently open
-    // Text selection properties
-    int selection_start_x; // X position of selection start
-    int selection_start_y; // Y position of selection start
-    int selection_end_x;   // X position of selection end
-    int selection_end_y;   // Y position of selection end
-    int has_selection;     // Whether there is an active selection
-    // Clipboard for this element
-    char clipboard[CLIPBOARD_SIZE];
-    // Directory listing properties
-    char dir_path[512]; // Directory path for directory listing elements
-    char dir_entries[100][256]; // Store up to 100 directory entries
-    int dir_entry_count; // Number of directory entries
-    int dir_entry_selected; // Index of selected entry
-} UIElement;
-
-
-
-UIElement elements[MAX_ELEMENTS];
+UIElement* elements = NULL;
 int num_elements = 0;
+int element_capacity = 0;
 
 // Global variables to store window dimensions
 int window_width = 800;
 int window_height = 600;
 
-// Emoji texture cache system
-#define MAX_CACHED_EMOJIS 256
-typedef struct {
-    unsigned int codepoint;
-    GLuint texture_id;
-    int width;
-    int height;
-    int advance_x;  // For proper text flow
-    int loaded;     // Whether this cache entry is populated
-} EmojiCacheEntry;
-
-EmojiCacheEntry emoji_cache[MAX_CACHED_EMOJIS];
-int emoji_cache_size = 0;
+// Emoji glyph atlas: pages of EMOJI_ATLAS_SIZE pixels square, or smaller
+// if GL can't make textures that large
+#define EMOJI_ATLAS_SIZE 2048
+#define EMOJI_ATLAS_PAGES 2
+GlyphAtlas emoji_atlas;
+GLuint emoji_pages[EMOJI_ATLAS_PAGES];
 
 // FreeType variables for emoji rendering
 FT_Library ft;
@@ -167,119 +110,54 @@ void init_freetype() {
     printf("Emoji font loaded, size: %d, scale: %f\n", loaded_emoji_size, emoji_scale);
 }
 
-// Initialize the emoji cache
-void init_emoji_cache() {
-    for (int i = 0; i < MAX_CACHED_EMOJIS; i++) {
-        emoji_cache[i].loaded = 0;
-        emoji_cache[i].texture_id = 0;
-        emoji_cache[i].codepoint = 0;
-        emoji_cache[i].width = 0;
-        emoji_cache[i].height = 0;
-        emoji_cache[i].advance_x = 0;
+// Initialize the emoji atlas; its pages are created as glyphs need them
+void init_emoji_atlas() {
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    int size = max_size > 0 && max_size < EMOJI_ATLAS_SIZE ? max_size : EMOJI_ATLAS_SIZE;
+    if (!glyph_atlas_init(&emoji_atlas, size, size, EMOJI_ATLAS_PAGES)) {
+        fprintf(stderr, "Warning: Could not allocate the emoji atlas, emoji rendering will be disabled\n");
+        glyph_atlas_free(&emoji_atlas);
     }
-    emoji_cache_size = 0;
 }
 
-// Find an emoji in the cache
-int find_emoji_in_cache(unsigned int codepoint) {
-    for (int i = 0; i < emoji_cache_size && i < MAX_CACHED_EMOJIS; i++) {
-        if (emoji_cache[i].codepoint == codepoint && emoji_cache[i].loaded) {
-            return i;
-        }
+// An atlas page's texture, created transparent on first use so the
+// padding around each glyph stays clear
+GLuint emoji_atlas_page(int page) {
+    if (emoji_pages[page] == 0) {
+        unsigned char* clear = calloc((size_t)emoji_atlas.page_width * emoji_atlas.page_height, 4);
+        glGenTextures(1, &emoji_pages[page]);
+        glBindTexture(GL_TEXTURE_2D, emoji_pages[page]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, emoji_atlas.page_width, emoji_atlas.page_height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, clear);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        free(clear);
     }
-    return -1; // Not found
+    return emoji_pages[page];
 }
 
-// Add an emoji to the cache - only creates the texture ID, doesn't upload data yet
-int add_emoji_to_cache(unsigned int codepoint) {
-    // Check if emoji is already in cache
-    int existing_index = find_emoji_in_cache(codepoint);
-    if (existing_index != -1) {
-        return existing_index;
-    }
-    
-    // If cache is full, we could implement a replacement strategy
-    // For now, just return if cache is full
-    if (emoji_cache_size >= MAX_CACHED_EMOJIS) {
-        // Optional: Implement LRU or other cache replacement strategy
-        return -1;
-    }
-    
-    // Generate a texture ID for this emoji
-    GLuint texture_id;
-    glGenTextures(1, &texture_id);
-    
-    // Add to cache
-    emoji_cache[emoji_cache_size].codepoint = codepoint;
-    emoji_cache[emoji_cache_size].texture_id = texture_id;
-    emoji_cache[emoji_cache_size].width = 0;
-    emoji_cache[emoji_cache_size].height = 0;
-    emoji_cache[emoji_cache_size].advance_x = 0;
-    emoji_cache[emoji_cache_size].loaded = 0; // Will be set to 1 when texture data is uploaded
-    
-    int index = emoji_cache_size;
-    emoji_cache_size++;
-    
-    return index;
-}
+// The render list's glyph source: the emoji's rect in the atlas, loaded
+// and uploaded on first use, evicting the least recently used emoji if
+// the atlas is full. Returns 0 if it can't be loaded; an emoji too large
+// for a page only advances the text.
+int emoji_glyph(unsigned int codepoint, RlGlyph* out) {
+    if (!emoji_face || !emoji_atlas.slots) return 0; // Skip if emoji font not loaded
 
-// Function to decode UTF-8 character to Unicode codepoint
-int decode_utf8(const unsigned char* str, unsigned int* codepoint) {
-    if (str[0] < 0x80) {
-        *codepoint = str[0];
-        return 1;
-    }
-    if ((str[0] & 0xE0) == 0xC0) {
-        if ((str[1] & 0xC0) == 0x80) {
-            *codepoint = ((str[0] & 0x1F) << 6) | (str[1] & 0x3F);
-            return 2;
-        }
-    }
-    if ((str[0] & 0xF0) == 0xE0) {
-        if ((str[1] & 0xC0) == 0x80 && (str[2] & 0xC0) == 0x80) {
-            *codepoint = ((str[0] & 0x0F) << 12) | ((str[1] & 0x3F) << 6) | (str[2] & 0x3F);
-            return 3;
-        }
-    }
-    if ((str[0] & 0xF8) == 0xF0) {
-        if ((str[1] & 0xC0) == 0x80 && (str[2] & 0xC0) == 0x80 && (str[3] & 0xC0) == 0x80) {
-            *codepoint = ((str[0] & 0x07) << 18) | ((str[1] & 0x3F) << 12) | ((str[2] & 0x3F) << 6) | (str[3] & 0x3F);
-            return 4;
-        }
-    }
-    *codepoint = '?';
-    return 1;
-}
-
-// Function to render a single emoji character at given position using cache
-// Returns the advance width for proper text flow
-int render_emoji(unsigned int codepoint, float x, float y) {
-    if (!emoji_face) return 0; // Skip if emoji font not loaded, return 0 for advance width
-    
-    // Check if emoji is already in cache
-    int cache_index = find_emoji_in_cache(codepoint);
-    GLuint texture_id = 0;
-    int width = 0, height = 0;
-    int advance_x = 0;
-
-    if (cache_index != -1) {
-        // Emoji is in cache, use it
-        texture_id = emoji_cache[cache_index].texture_id;
-        width = emoji_cache[cache_index].width;
-        height = emoji_cache[cache_index].height;
-        advance_x = emoji_cache[cache_index].advance_x;
-    } else {
-        // Emoji not in cache, need to load and add to cache
+    const AtlasGlyph* glyph = glyph_atlas_find(&emoji_atlas, codepoint);
+    if (!glyph) {
+        // Emoji not in the atlas, need to load and pack it
         FT_Error err = FT_Load_Char(emoji_face, codepoint, FT_LOAD_RENDER | FT_LOAD_COLOR);
         if (err) {
             fprintf(stderr, "Warning: Could not load glyph for codepoint U+%04X\n", codepoint);
-            return 0; // Return 0 for advance width on error
+            return 0;
         }
 
         FT_GlyphSlot slot = emoji_face->glyph;
         if (!slot->bitmap.buffer) {
             fprintf(stderr, "Warning: No bitmap for glyph U+%04X\n", codepoint);
-            return 0; // Return 0 for advance width on error
+            return 0;
         }
 
         // Handle different pixel modes
@@ -290,821 +168,440 @@ int render_emoji(unsigned int codepoint, float x, float y) {
             format = GL_LUMINANCE_ALPHA;
         }
 
-        // Add emoji to cache to get a texture ID
-        cache_index = add_emoji_to_cache(codepoint);
-        if (cache_index == -1) {
-            // Cache is full, just load and render without caching
-            GLuint temp_texture;
-            glGenTextures(1, &temp_texture);
-            glBindTexture(GL_TEXTURE_2D, temp_texture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, slot->bitmap.width, slot->bitmap.rows, 0, 
-                         format, GL_UNSIGNED_BYTE, slot->bitmap.buffer);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            glEnable(GL_TEXTURE_2D);
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-            float scale_factor = emoji_scale;
-            float w = slot->bitmap.width * scale_factor;
-            float h = slot->bitmap.rows * scale_factor;
-            
-            // Calculate position so that emoji aligns with text baseline
-            float x2 = x;
-            float y2 = y;  // Position the emoji at the same baseline as regular text
-
-            glBegin(GL_QUADS);
-            glTexCoord2f(0.0, 1.0); glVertex2f(x2, y2);
-            glTexCoord2f(1.0, 1.0); glVertex2f(x2 + w, y2);
-            glTexCoord2f(1.0, 0.0); glVertex2f(x2 + w, y2 + h);
-            glTexCoord2f(0.0, 0.0); glVertex2f(x2, y2 + h);
-            glEnd();
-
-            glDisable(GL_TEXTURE_2D);
-            glDisable(GL_BLEND);
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glDeleteTextures(1, &temp_texture);
-            glColor3f(1.0f, 1.0f, 1.0f);
-            // Calculate rough advance width for uncached emoji
-            if (FT_Load_Char(emoji_face, codepoint, FT_LOAD_RENDER | FT_LOAD_COLOR) == 0) {
-                return emoji_face->glyph->advance.x >> 6; // advance is in 1/64th pixels
-            } else {
-                return 0; // fallback if loading fails
-            }
+        int advance = slot->advance.x >> 6; // advance is in 1/64th pixels
+        glyph = glyph_atlas_insert(&emoji_atlas, codepoint, slot->bitmap.width, slot->bitmap.rows, advance);
+        if (!glyph) {
+            out->texture = 0;
+            out->width = out->height = 0;
+            out->advance = advance;
+            return 1;
         }
 
-        // Get the texture ID from the cache
-        texture_id = emoji_cache[cache_index].texture_id;
-        width = slot->bitmap.width;
-        height = slot->bitmap.rows;
-        advance_x = slot->advance.x >> 6; // advance is in 1/64th pixels
-
-        // Upload texture data to the cached texture
-        glBindTexture(GL_TEXTURE_2D, texture_id);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, 
-                     format, GL_UNSIGNED_BYTE, slot->bitmap.buffer);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        // Update cache entry with dimensions and advance
-        emoji_cache[cache_index].width = width;
-        emoji_cache[cache_index].height = height;
-        emoji_cache[cache_index].advance_x = slot->advance.x >> 6; // advance is in 1/64th pixels
-        emoji_cache[cache_index].loaded = 1; // Mark as fully loaded
+        if (glyph->width > 0) {
+            glBindTexture(GL_TEXTURE_2D, emoji_atlas_page(glyph->page));
+            if (glyph->slot_width > glyph->width + GLYPH_ATLAS_PADDING || glyph->slot_height > glyph->height + GLYPH_ATLAS_PADDING) {
+                // A larger glyph's hole: clear what this one won't cover
+                unsigned char* clear = calloc((size_t)glyph->slot_width * glyph->slot_height, 4);
+                if (clear) {
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, glyph->x, glyph->y, glyph->slot_width, glyph->slot_height,
+                                    GL_RGBA, GL_UNSIGNED_BYTE, clear);
+                    free(clear);
+                }
+            }
+            glTexSubImage2D(GL_TEXTURE_2D, 0, glyph->x, glyph->y, glyph->width, glyph->height,
+                            format, GL_UNSIGNED_BYTE, slot->bitmap.buffer);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
     }
 
-    // Render using the texture
-    glEnable(GL_TEXTURE_2D);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    out->texture = glyph->width > 0 ? emoji_pages[glyph->page] : 0;
+    out->u0 = (float)glyph->x / emoji_atlas.page_width;
+    out->v0 = (float)glyph->y / emoji_atlas.page_height;
+    out->u1 = (float)(glyph->x + glyph->width) / emoji_atlas.page_width;
+    out->v1 = (float)(glyph->y + glyph->height) / emoji_atlas.page_height;
+    out->width = glyph->width * emoji_scale;
+    out->height = glyph->height * emoji_scale;
+    out->advance = glyph->advance;
+    return 1;
+}
 
-    glBindTexture(GL_TEXTURE_2D, texture_id);
+extern int active_slider_index;
+
+// The document as last loaded, and its file
+ChtmlParser view_doc;
+char view_path[512];
+time_t view_mtime;
+off_t view_size;
+
+// Makes room for need elements, doubling the store and zeroing the new
+// tail. Returns 0 when out of memory, leaving the store as it was.
+int reserve_elements(int need) {
+    if (need <= element_capacity) return 1;
+    int cap = element_capacity ? element_capacity : 64;
+    while (cap < need) cap *= 2;
+    UIElement* grown = realloc(elements, (size_t)cap * sizeof(UIElement));
+    if (!grown) return 0;
+    memset(grown + element_capacity, 0, (size_t)(cap - element_capacity) * sizeof(UIElement));
+    elements = grown;
+    element_capacity = cap;
+    return 1;
+}
 
-    float scale_factor = emoji_scale;
-    float w = width * scale_factor;
-    float h = height * scale_factor;
-    
-    // Calculate position so that emoji aligns with text baseline
-    float x2 = x;
-    float y2 = y;  // Position the emoji at the same baseline as regular text
-
-    glBegin(GL_QUADS);
-    glTexCoord2f(0.0, 1.0); glVertex2f(x2, y2);
-    glTexCoord2f(1.0, 1.0); glVertex2f(x2 + w, y2);
-    glTexCoord2f(1.0, 0.0); glVertex2f(x2 + w, y2 + h);
-    glTexCoord2f(0.0, 0.0); glVertex2f(x2, y2 + h);
-    glEnd();
-
-    glDisable(GL_TEXTURE_2D);
-    glDisable(GL_BLEND);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glColor3f(1.0f, 1.0f, 1.0f);
-    return advance_x;
+int is_container(const char* type) {
+    return strcmp(type, "panel") == 0 || strcmp(type, "canvas") == 0 || strcmp(type, "menu") == 0;
 }
 
-// Function to check if a string contains emoji characters
-int contains_emoji(const char* str) {
-    const unsigned char* s = (const unsigned char*)str;
-    while (*s) {
-        // Check for high Unicode values that are likely emojis
-        unsigned int codepoint;
-        int bytes = decode_utf8(s, &codepoint);
-        if (codepoint >= 0x1F000) {  // Emoji range typically starts around U+1F000
-            return 1;
-        }
-        // Also check for other emoji ranges
-        if ((codepoint >= 0x2600 && codepoint <= 0x26FF) ||  // Misc symbols
-            (codepoint >= 0x2700 && codepoint <= 0x27BF) ||  // Dingbats
-            (codepoint >= 0x1F100 && codepoint <= 0x1F64F) ||  // Emoticons, etc.
-            (codepoint >= 0x1F680 && codepoint <= 0x1F6FF) ||  // Transport & map symbols
-            (codepoint >= 0x1F700 && codepoint <= 0x1F77F)) {  // Alchemical symbols
-            return 1;
+// Sets up an element from its node: the defaults, then its attributes
+void apply_chtml_node(UIElement* el, const ChtmlParser* doc, int node) {
+    ui_element_clear(el);
+    strncpy(el->type, chtml_node_name(doc, node), sizeof(el->type) - 1);
+    // Text elements always hold at least their one empty line
+    if ((strcmp(el->type, "textfield") == 0 || strcmp(el->type, "textarea") == 0) && !ui_element_reserve_lines(el, 1)) {
+        fprintf(stderr, "Error: Out of memory for the text of element %d\n", node);
+        el->type[0] = '\0';
+        return;
+    }
+    el->num_lines = 1;
+    el->slider_max = 100;
+    el->slider_step = 1;
+    strcpy(el->view_mode, "2d"); // Default to 2D view
+    // Camera for 3D: in front of the scene, looking at the origin, Y up
+    el->camera_pos[2] = 5.0f;
+    el->camera_up[1] = 1.0f;
+    el->fov = 45.0f; // Default field of view
+    strcpy(el->dir_path, ".");
+    el->dir_entry_selected = -1;
+
+    const ChtmlNode* n = &doc->nodes[node];
+    for (int a = n->first_attr; a < n->first_attr + n->attr_count; a++) {
+        const char* attr_name = chtml_string(doc, doc->attrs[a].name);
+        const char* attr_value = chtml_string(doc, doc->attrs[a].value);
+
+        if (strcmp(attr_name, "x") == 0) el->x = atoi(attr_value);
+        else if (strcmp(attr_name, "y") == 0) el->y = atoi(attr_value);
+        else if (strcmp(attr_name, "width") == 0) el->width = atoi(attr_value);
+        else if (strcmp(attr_name, "height") == 0) el->height = atoi(attr_value);
+        else if (strcmp(attr_name, "id") == 0) strncpy(el->id, attr_value, 49);
+        else if (strcmp(attr_name, "label") == 0) strncpy(el->label, attr_value, 49);
+        else if (strcmp(attr_name, "value") == 0) {
+            if (strcmp(el->type, "textfield") == 0 || strcmp(el->type, "textarea") == 0) {
+                // One line per newline; &#10; in the markup is decoded to one
+                int line_idx = 0;
+                const char* line = attr_value;
+                while (ui_element_reserve_lines(el, line_idx + 1)) {
+                    const char* end = strchr(line, '\n');
+                    size_t len = end ? (size_t)(end - line) : strlen(line);
+                    if (len > MAX_LINE_LENGTH - 1) len = MAX_LINE_LENGTH - 1;
+                    memcpy(el->text_content[line_idx], line, len);
+                    el->text_content[line_idx][len] = '\0';
+                    line_idx++;
+                    if (!end) break;
+                    line = end + 1;
+                }
+                el->num_lines = line_idx;
+                // Set cursor to end of first line
+                el->cursor_x = strlen(el->text_content[0]);
+                el->cursor_y = 0;
+            } else if (strcmp(el->type, "slider") == 0) {
+                el->slider_value = atoi(attr_value);
+            } else if (strcmp(el->type, "text") == 0) {
+                // For text elements, store the value in the label field
+                strncpy(el->label, attr_value, 49);
+            }
+        }
+        else if (strcmp(attr_name, "checked") == 0) el->is_checked = strcmp(attr_value, "true") == 0;
+        else if (strcmp(attr_name, "min") == 0) el->slider_min = atoi(attr_value);
+        else if (strcmp(attr_name, "max") == 0) el->slider_max = atoi(attr_value);
+        else if (strcmp(attr_name, "step") == 0) el->slider_step = atoi(attr_value);
+        else if (strcmp(attr_name, "color") == 0) {
+            long color = strtol(attr_value[0] == '#' ? attr_value + 1 : attr_value, NULL, 16);
+            el->color[0] = ((color >> 16) & 0xFF) / 255.0f;
+            el->color[1] = ((color >> 8) & 0xFF) / 255.0f;
+            el->color[2] = (color & 0xFF) / 255.0f;
+        }
+        else if (strcmp(attr_name, "onClick") == 0) strncpy(el->onClick, attr_value, 49);
+        else if (strcmp(attr_name, "view_mode") == 0 || strcmp(attr_name, "viewMode") == 0) {
+            // Support both view_mode and viewMode for consistency
+            strncpy(el->view_mode, attr_value, 9);
+        }
+        else if (strcmp(attr_name, "path") == 0) {
+            // For dirlist elements, set the directory path
+            if (strcmp(el->type, "dirlist") == 0) strncpy(el->dir_path, attr_value, 511);
         }
-        s += bytes;
     }
-    return 0;
+
+    // Ensure slider_value is within min/max bounds after parsing all attributes
+    if (strcmp(el->type, "slider") == 0) {
+        if (el->slider_value < el->slider_min) el->slider_value = el->slider_min;
+        if (el->slider_value > el->slider_max) el->slider_value = el->slider_max;
+    }
+    if (strcmp(el->type, "canvas") == 0) {
+        // Assign a default render function to canvas elements
+        el->canvas_render_func = canvas_render_sample;
+    }
 }
 
-// Function to render text with emoji support
-void render_text_with_emojis(const char* str, float x, float y, float color[3]) {
-    glColor3fv(color);
-    
-    const unsigned char* s = (const unsigned char*)str;
-    float current_x = x;
-    float current_y = y;
-    
-    // Process the string character by character
-    while (*s) {
-        unsigned int codepoint;
-        int bytes = decode_utf8(s, &codepoint);
-        
-        // Check if this character is an emoji
-        int is_emoji = 0;
-        if (codepoint >= 0x1F000 || 
-            (codepoint >= 0x2600 && codepoint <= 0x26FF) ||  
-            (codepoint >= 0x2700 && codepoint <= 0x27BF) ||  
-            (codepoint >= 0x1F100 && codepoint <= 0x1F64F) ||  
-            (codepoint >= 0x1F680 && codepoint <= 0x1F6FF) ||  
-            (codepoint >= 0x1F700 && codepoint <= 0x1F77F)) {
-            is_emoji = 1;
+// Rearranges the elements so the one at from[i] ends up at i, for i <
+// count. Slots with from[i] == -1 get whatever is left over. An element
+// moves with its text and clipboard. Returns 0 if out of memory.
+int move_elements(const int* from, int count) {
+    int slots = count > num_elements ? count : num_elements;
+    int* src = malloc(slots * sizeof(int));
+    char* done = calloc(slots, 1);
+    int ok = src && done;
+    if (ok) {
+        // Complete from into a permutation of the slots
+        char* taken = done;
+        for (int i = 0; i < slots; i++) {
+            src[i] = i < count ? from[i] : -1;
+            if (src[i] >= 0) taken[src[i]] = 1;
+        }
+        for (int i = 0, spare = 0; i < slots; i++) {
+            if (src[i] >= 0) continue;
+            while (taken[spare]) spare++;
+            src[i] = spare;
+            taken[spare] = 1;
+        }
+        memset(done, 0, slots);
+
+        // Follow each cycle, holding its first element aside
+        for (int i = 0; i < slots && ok; i++) {
+            if (done[i] || src[i] == i) continue;
+            UIElement held = elements[i];
+            int j = i;
+            for (; src[j] != i; j = src[j]) {
+                elements[j] = elements[src[j]];
+                done[j] = 1;
+            }
+            elements[j] = held;
+            done[j] = 1;
         }
-        
-        if (is_emoji) {
-            // Render emoji using FreeType
-            // Adjust the y position to align with text baseline - emojis might need vertical adjustment
-            int advance_width = render_emoji(codepoint, current_x, current_y);  // Using same y as text baseline
-            
-            // Move position forward based on emoji advance width
-            current_x += advance_width;
-        } else {
-            // For regular ASCII characters, we need to render with GLUT but properly spaced
-            // Find the next emoji or end of string
-            const unsigned char* next_ptr = s + bytes;
-            while (*next_ptr) {
-                unsigned int next_codepoint;
-                int next_bytes = decode_utf8(next_ptr, &next_codepoint);
-                
-                if (next_codepoint >= 0x1F000 || 
-                    (next_codepoint >= 0x2600 && next_codepoint <= 0x26FF) ||  
-                    (next_codepoint >= 0x2700 && next_codepoint <= 0x27BF) ||  
-                    (next_codepoint >= 0x1F100 && next_codepoint <= 0x1F64F) ||  
-                    (next_codepoint >= 0x1F680 && next_codepoint <= 0x1F6FF) ||  
-                    (next_codepoint >= 0x1F700 && next_codepoint <= 0x1F77F)) {
-                    break; // Found next emoji
-                }
-                next_ptr += next_bytes;
-            }
-            
-            // Create substring from s to next_ptr
-            int segment_len = next_ptr - s;
-            char* segment = malloc(segment_len + 1);
-            strncpy(segment, (const char*)s, segment_len);
-            segment[segment_len] = '\0';
-            
-            // Render this ASCII segment with GLUT at current position
-            glRasterPos2f(current_x, current_y);
-            for (char* c = segment; *c != '\0'; c++) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
-            }
-            
-            // Calculate the width of the rendered segment
-            float segment_width = 0;
-            for (char* c = segment; *c != '\0'; c++) {
-                segment_width += glutBitmapWidth(GLUT_BITMAP_HELVETICA_18, *c);
-            }
-            current_x += segment_width;
-            
-            free(segment);
-            
-            // Update s to continue after the ASCII segment
-            s = next_ptr;
-            continue; // Continue the main loop without incrementing s again
-        }
-        
-        s += bytes;
     }
-    
-    glColor3f(1.0f, 1.0f, 1.0f);
+    free(src);
+    free(done);
+    return ok;
 }
 
-// Simple parser for our C-HTML format
-void parse_chtml(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
+// Loads the document, or reloads it after an edit. The new tree is
+// diffed against the last one: elements whose node is unchanged keep
+// their state (typed text, checkbox, slider, open menu), and only changed
+// and new nodes are set up again. Returns how many elements changed,
+// were added or were removed.
+int load_chtml(const char* filename) {
+    ChtmlParser doc;
+    chtml_parser_init(&doc);
+    if (!chtml_parse_file(&doc, filename)) {
         perror("Error opening CHTML file");
-        return;
+        chtml_parser_free(&doc);
+        return 0;
     }
+    for (int i = 0; i < doc.error_count; i++) {
+        fprintf(stderr, "%s:%d:%d: %s\n", filename, doc.errors[i].at.line, doc.errors[i].at.column, doc.errors[i].message);
+    }
+    if (doc.errors_dropped) fprintf(stderr, "%s: %d more errors\n", filename, doc.errors_dropped);
 
-    char line[512]; // Increased buffer size for longer lines
-    num_elements = 0;
-    int parent_stack[MAX_ELEMENTS];
-    int stack_top = -1;
-
-    while (fgets(line, sizeof(line), file)) {
-        // Trim leading/trailing whitespace
-        char* trimmed_line = line;
-        while (*trimmed_line == ' ' || *trimmed_line == '\t') trimmed_line++;
-        size_t len = strlen(trimmed_line);
-        while (len > 0 && (trimmed_line[len-1] == '\n' || trimmed_line[len-1] == '\r' || trimmed_line[len-1] == ' ' || trimmed_line[len-1] == '\t')) {
-            trimmed_line[--len] = '\0';
-        }
-
-        if (len == 0) continue; // Skip empty lines
-
-        // Check for closing tag
-        if (trimmed_line[0] == '<' && trimmed_line[1] == '/') {
-            if (stack_top > -1) {
-                stack_top--;
-            }
-            continue;
-        }
-
-        // Check for opening tag
-        if (trimmed_line[0] != '<') continue;
-
-        // Extract tag name
-        char* tag_start = trimmed_line + 1;
-        char* tag_end = strchr(tag_start, ' ');
-        if (!tag_end) tag_end = strchr(tag_start, '>');
-        if (!tag_end) continue; // Malformed tag
-
-        char tag_name[50];
-        strncpy(tag_name, tag_start, tag_end - tag_start);
-        tag_name[tag_end - tag_start] = '\0';
-
-        if (num_elements >= MAX_ELEMENTS) {
-            fprintf(stderr, "Error: Max elements reached!\n");
-            break;
-        }
-
-        elements[num_elements].parent = (stack_top > -1) ? parent_stack[stack_top] : -1;
-        strcpy(elements[num_elements].type, tag_name);
-        elements[num_elements].id[0] = '\0'; // Initialize ID to empty string
-        elements[num_elements].is_active = 0;
-        elements[num_elements].cursor_x = 0;
-        elements[num_elements].cursor_y = 0;
-        elements[num_elements].num_lines = 1;
-        // Initialize all lines to empty
-        for (int line_idx = 0; line_idx < MAX_TEXT_LINES; line_idx++) {
-            elements[num_elements].text_content[line_idx][0] = '\0';
-        }
-        // For textfield and textarea, set first line to the value attribute
-        if (strcmp(tag_name, "textfield") == 0 || strcmp(tag_name, "textarea") == 0) {
-            // Find the value attribute and set the first line
-            char* attr_start = tag_end;
-            while (attr_start && (attr_start = strstr(attr_start, " ")) != NULL) {
-                attr_start++; // Move past space
-                char* eq_sign = strchr(attr_start, '=');
-                if (!eq_sign) break; // No more attributes
-
-                char attr_name[50];
-                strncpy(attr_name, attr_start, eq_sign - attr_start);
-                attr_name[eq_sign - attr_start] = '\0';
-
-                char* value_start = eq_sign + 1;
-                if (*value_start != '"') break; // Value not quoted
-                value_start++; // Move past opening quote
-
-                char* value_end = strchr(value_start, '"');
-                if (!value_end) break; // No closing quote
-
-                char attr_value[256];
-                strncpy(attr_value, value_start, value_end - value_start);
-                attr_value[value_end - value_start] = '\0';
-
-                if (strcmp(attr_name, "value") == 0) {
-                    // Handle multi-line value by splitting on &#10; (HTML newline entity)
-                    int line_idx = 0;
-                    char* token = strtok(attr_value, "&#10;");
-                    while (token != NULL && line_idx < MAX_TEXT_LINES) {
-                        strncpy(elements[num_elements].text_content[line_idx], token, MAX_LINE_LENGTH - 1);
-                        elements[num_elements].text_content[line_idx][MAX_LINE_LENGTH - 1] = '\0';
-                        token = strtok(NULL, "&#10;");
-                        line_idx++;
-                    }
-                    elements[num_elements].num_lines = line_idx > 0 ? line_idx : 1;
-                    break;
-                }
-                attr_start = value_end + 1;
-            }
-        }
-        elements[num_elements].selection_start_x = 0;
-        elements[num_elements].selection_start_y = 0;
-        elements[num_elements].selection_end_x = 0;
-        elements[num_elements].selection_end_y = 0;
-        elements[num_elements].has_selection = 0;
-        elements[num_elements].clipboard[0] = '\0'; // Initialize clipboard to empty
-        elements[num_elements].is_checked = 0;
-        elements[num_elements].slider_value = 0;
-        elements[num_elements].slider_min = 0;
-        elements[num_elements].slider_max = 100;
-        elements[num_elements].slider_step = 1;
-        elements[num_elements].canvas_initialized = 0;
-        elements[num_elements].canvas_render_func = NULL;
-        strcpy(elements[num_elements].view_mode, "2d"); // Default to 2D view
-        // Initialize camera properties for 3D
-        elements[num_elements].camera_pos[0] = 0.0f;
-        elements[num_elements].camera_pos[1] = 0.0f;
-        elements[num_elements].camera_pos[2] = 5.0f; // Position camera in front of scene
-        elements[num_elements].camera_target[0] = 0.0f;
-        elements[num_elements].camera_target[1] = 0.0f;
-        elements[num_elements].camera_target[2] = 0.0f; // Look at origin
-        elements[num_elements].camera_up[0] = 0.0f;
-        elements[num_elements].camera_up[1] = 1.0f;
-        elements[num_elements].camera_up[2] = 0.0f; // Y is up
-        elements[num_elements].fov = 45.0f; // Default field of view
-        elements[num_elements].onClick[0] = '\0'; // Initialize onClick to empty string
-        elements[num_elements].menu_items_count = 0;
-        elements[num_elements].is_open = 0;
-        strcpy(elements[num_elements].dir_path, ".");
-        elements[num_elements].dir_entry_count = 0;
-        elements[num_elements].dir_entry_selected = -1;
-
-        // Parse attributes
-        char* attr_start = tag_end;
-        while (attr_start && (attr_start = strstr(attr_start, " ")) != NULL) {
-            attr_start++; // Move past space
-            char* eq_sign = strchr(attr_start, '=');
-            if (!eq_sign) break; // No more attributes
-
-            char attr_name[50];
-            strncpy(attr_name, attr_start, eq_sign - attr_start);
-            attr_name[eq_sign - attr_start] = '\0';
-
-            char* value_start = eq_sign + 1;
-            if (*value_start != '\"') break; // Value not quoted
-            value_start++; // Move past opening quote
-
-            char* value_end = strchr(value_start, '\"');
-            if (!value_end) break; // No closing quote
-
-            char attr_value[256];
-            strncpy(attr_value, value_start, value_end - value_start);
-            attr_value[value_end - value_start] = '\0';
-
-            if (strcmp(attr_name, "x") == 0) elements[num_elements].x = atoi(attr_value);
-            else if (strcmp(attr_name, "y") == 0) elements[num_elements].y = atoi(attr_value);
-            else if (strcmp(attr_name, "width") == 0) elements[num_elements].width = atoi(attr_value);
-            else if (strcmp(attr_name, "height") == 0) elements[num_elements].height = atoi(attr_value);
-            else if (strcmp(attr_name, "id") == 0) strncpy(elements[num_elements].id, attr_value, 49);
-            else if (strcmp(attr_name, "label") == 0) strncpy(elements[num_elements].label, attr_value, 49);
-            else if (strcmp(attr_name, "value") == 0) {
-                if (strcmp(elements[num_elements].type, "textfield") == 0 || strcmp(elements[num_elements].type, "textarea") == 0) {
-                    // For textfield and textarea, set first line to the value attribute
-                    // Handle multi-line value by splitting on &#10; (HTML newline entity)
-                    int line_idx = 0;
-                    char* temp_value = malloc(strlen(attr_value) + 1);
-                    strcpy(temp_value, attr_value);
-                    char* token = strtok(temp_value, "&#10;");
-                    while (token != NULL && line_idx < MAX_TEXT_LINES) {
-                        strncpy(elements[num_elements].text_content[line_idx], token, MAX_LINE_LENGTH - 1);
-                        elements[num_elements].text_content[line_idx][MAX_LINE_LENGTH - 1] = '\0';
-                        token = strtok(NULL, "&#10;");
-                        line_idx++;
-                    }
-                    elements[num_elements].num_lines = line_idx > 0 ? line_idx : 1;
-                    // Set cursor to end of first line
-                    elements[num_elements].cursor_x = (line_idx > 0) ? strlen(elements[num_elements].text_content[0]) : 0;
-                    elements[num_elements].cursor_y = 0;
-                    free(temp_value);
-                } else if (strcmp(elements[num_elements].type, "slider") == 0) {
-                    elements[num_elements].slider_value = atoi(attr_value);
-                } else if (strcmp(elements[num_elements].type, "text") == 0) {
-                    // For text elements, store the value in the label field
-                    strncpy(elements[num_elements].label, attr_value, 49);
-                }
-            }
-            else if (strcmp(attr_name, "checked") == 0) {
-                if (strcmp(attr_value, "true") == 0) {
-                    elements[num_elements].is_checked = 1;
-                }
-            }
-            else if (strcmp(attr_name, "min") == 0) elements[num_elements].slider_min = atoi(attr_value);
-            else if (strcmp(attr_name, "max") == 0) elements[num_elements].slider_max = atoi(attr_value);
-            else if (strcmp(attr_name, "step") == 0) elements[num_elements].slider_step = atoi(attr_value);
-            else if (strcmp(attr_name, "color") == 0) {
-                long color = strtol(attr_value + 1, NULL, 16);
-                elements[num_elements].color[0] = ((color >> 16) & 0xFF) / 255.0f;
-                elements[num_elements].color[1] = ((color >> 8) & 0xFF) / 255.0f;
-                elements[num_elements].color[2] = (color & 0xFF) / 255.0f;
-            }
-            else if (strcmp(attr_name, "onClick") == 0) {
-                strncpy(elements[num_elements].onClick, attr_value, 49);
-                elements[num_elements].onClick[49] = '\0'; // Ensure null termination
-            }
-            else if (strcmp(attr_name, "view_mode") == 0 || strcmp(attr_name, "viewMode") == 0) {
-                // Support both view_mode and viewMode for consistency
-                strncpy(elements[num_elements].view_mode, attr_value, 9);
-                elements[num_elements].view_mode[9] = '\0'; // Ensure null termination
-            }
-            else if (strcmp(attr_name, "path") == 0) {
-                // For dirlist elements, set the directory path
-                if (strcmp(elements[num_elements].type, "dirlist") == 0) {
-                    strncpy(elements[num_elements].dir_path, attr_value, 511);
-                    elements[num_elements].dir_path[511] = '\0'; // Ensure null termination
-                }
-            }
-            attr_start = value_end + 1;
-        }
-
-        // Ensure slider_value is within min/max bounds after parsing all attributes
-        if (strcmp(elements[num_elements].type, "slider") == 0) {
-            if (elements[num_elements].slider_value < elements[num_elements].slider_min) {
-                elements[num_elements].slider_value = elements[num_elements].slider_min;
-            }
-            if (elements[num_elements].slider_value > elements[num_elements].slider_max) {
-                elements[num_elements].slider_value = elements[num_elements].slider_max;
-            }
-        }
-
-        if (strcmp(tag_name, "panel") == 0) {
-            stack_top++;
-            parent_stack[stack_top] = num_elements;
-        }
-        else if (strcmp(tag_name, "canvas") == 0) {
-            // Assign a default render function to canvas elements
-            elements[num_elements].canvas_render_func = canvas_render_sample;
-            stack_top++;
-            parent_stack[stack_top] = num_elements;
-        }
-        else if (strcmp(tag_name, "menu") == 0) {
-            elements[num_elements].menu_items_count = 0; // Initialize to 0, will be updated during parsing
-            stack_top++;
-            parent_stack[stack_top] = num_elements;
+    int count = doc.node_count;
+    if (!reserve_elements(count)) {
+        fprintf(stderr, "%s: Error: Out of memory for %d elements, keeping the first %d\n", filename, count, element_capacity);
+        count = element_capacity;
+    }
+    int* match = calloc(count + 1, sizeof(int));
+    int* status = calloc(count + 1, sizeof(int));
+    if (!match || !status) {
+        fprintf(stderr, "Error: Out of memory loading %s\n", filename);
+        free(match);
+        free(status);
+        chtml_parser_free(&doc);
+        return 0;
+    }
+    doc.node_count = count; // Only diff what has an element
+    chtml_diff(&view_doc, &doc, match, status);
+    int kept = 0, changed = 0;
+    for (int i = 0; i < count; i++) {
+        // Old nodes past a full store never had an element
+        if (match[i] >= num_elements) match[i] = -1;
+        if (match[i] == -1) status[i] = CHTML_ADDED;
+        else kept++;
+    }
+    if (!move_elements(match, count)) {
+        fprintf(stderr, "Error: Out of memory reloading %s, rebuilding every element\n", filename);
+        for (int i = 0; i < count; i++) status[i] = CHTML_ADDED;
+        kept = 0;
+    }
+    // A slider being dragged stays dragged if it is still there
+    if (active_slider_index >= 0) {
+        int follow = -1;
+        for (int i = 0; i < count; i++) {
+            if (match[i] == active_slider_index && status[i] == CHTML_SAME) follow = i;
         }
-        else if (strcmp(tag_name, "menuitem") == 0) {
-            // menuitem elements don't change the stack (they don't contain other elements)
-            // but need to increment the parent's menu_items_count
-            if (stack_top >= 0) {
-                int parent_index = parent_stack[stack_top];
-                if (strcmp(elements[parent_index].type, "menu") == 0) {
-                    elements[parent_index].menu_items_count++;
-                }
-            }
+        active_slider_index = follow;
+    }
+    for (int i = 0; i < count; i++) {
+        if (status[i] == CHTML_SAME) continue;
+        apply_chtml_node(&elements[i], &doc, i);
+        changed++;
+    }
+    for (int i = count; i < num_elements; i++) ui_element_clear(&elements[i]);
+
+    // Indices may have moved, so parents and menu item counts are redone
+    // for every element. An element's parent is the panel, canvas or menu
+    // it is in.
+    for (int i = 0; i < count; i++) {
+        int parent = doc.nodes[i].parent;
+        while (parent != -1 && !is_container(chtml_node_name(&doc, parent))) parent = doc.nodes[parent].parent;
+        elements[i].parent = parent;
+        if (strcmp(elements[i].type, "menu") == 0) elements[i].menu_items_count = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        int p = elements[i].parent;
+        if (strcmp(elements[i].type, "menuitem") == 0 && p != -1 && strcmp(elements[p].type, "menu") == 0) {
+            elements[p].menu_items_count++;
         }
+    }
 
-        num_elements++;
+    int removed = num_elements - kept;
+    if (view_doc.node_count > 0) {
+        printf("Reloaded %s: %d of %d elements updated, %d removed\n", filename, changed, count, removed);
     }
+    num_elements = count;
+    free(match);
+    free(status);
+    chtml_parser_free(&view_doc);
+    view_doc = doc;
+    return changed + removed;
+}
 
-    fclose(file);
+// Reloads the document when its file changes, checked every 30 idle
+// ticks (about half a second). Returns 1 if any element changed.
+int update_view() {
+    static int ticks = 0;
+    if (++ticks < 30) return 0;
+    ticks = 0;
+
+    struct stat st;
+    if (stat(view_path, &st) != 0 || (st.st_mtime == view_mtime && st.st_size == view_size)) return 0;
+    view_mtime = st.st_mtime;
+    view_size = st.st_size;
+    return load_chtml(view_path) > 0;
 }
 
 void init_view(const char* filename) {
     init_freetype();  // Initialize FreeType for emoji rendering
-    init_emoji_cache();  // Initialize emoji texture cache
-    parse_chtml(filename);
-}
-
-void draw_element(UIElement* el) {
-    int parent_x = 0;
-    int parent_y = 0;
-
-    if (el->parent != -1) {
-        parent_x = elements[el->parent].x;
-        parent_y = elements[el->parent].y;
+    init_emoji_atlas();  // Initialize the emoji glyph atlas
+    chtml_parser_init(&view_doc);
+    snprintf(view_path, sizeof(view_path), "%s", filename);
+    struct stat st;
+    if (stat(filename, &st) == 0) {
+        view_mtime = st.st_mtime;
+        view_size = st.st_size;
     }
+    load_chtml(filename);
+}
 
-    int abs_x = parent_x + el->x;
-    int abs_y = calculate_absolute_y(parent_y, el->y, el->height); // Convert from real-world to OpenGL coordinates (y=0 at top becomes y=window_height at bottom)
-
-    if (strcmp(el->type, "canvas") == 0) {
-        // Draw a border for the canvas
-        glColor3f(0.5f, 0.5f, 0.5f); // Gray border
-        glBegin(GL_LINE_LOOP);
-        glVertex2i(abs_x, abs_y);
-        glVertex2i(abs_x + el->width, abs_y);
-        glVertex2i(abs_x + el->width, abs_y + el->height);
-        glVertex2i(abs_x, abs_y + el->height);
-        glEnd();
+// Draws a canvas's content at its origin; the render list draws its border
+void draw_canvas(UIElement* el, int abs_x, int abs_y) {
+    // Draw canvas content without changing global OpenGL state
+    if (el->canvas_render_func != NULL) {
+        // Save the current modelview matrix
+        glPushMatrix();
         
-        // Draw canvas content without changing global OpenGL state
-        if (el->canvas_render_func != NULL) {
-            // Save the current modelview matrix
-            glPushMatrix();
+        // Check view mode and set up appropriate projection
+        if (strcmp(el->view_mode, "3d") == 0) {
+            // Switch to projection matrix to set up 3D view
+            glMatrixMode(GL_PROJECTION);
+            glPushMatrix(); // Save current projection matrix
+            glLoadIdentity();
             
-            // Check view mode and set up appropriate projection
-            if (strcmp(el->view_mode, "3d") == 0) {
-                // Switch to projection matrix to set up 3D view
-                glMatrixMode(GL_PROJECTION);
-                glPushMatrix(); // Save current projection matrix
-                glLoadIdentity();
-                
-                // Set up perspective projection for 3D
-                gluPerspective(el->fov, (double)el->width/(double)el->height, 0.1, 100.0);
-                
-                // Switch back to modelview matrix for drawing
-                glMatrixMode(GL_MODELVIEW);
-                
-                // Set up camera view
-                gluLookAt(
-                    el->camera_pos[0], el->camera_pos[1], el->camera_pos[2],  // Camera position
-                    el->camera_target[0], el->camera_target[1], el->camera_target[2],  // Look at point
-                    el->camera_up[0], el->camera_up[1], el->camera_up[2]  // Up vector
-                );
-            }
+            // Set up perspective projection for 3D
+            gluPerspective(el->fov, (double)el->width/(double)el->height, 0.1, 100.0);
             
-            // Apply transformation to move to canvas position (only in 2D mode)
-            if (strcmp(el->view_mode, "3d") == 0) {
-                // In 3D mode, we've already set up the camera, so no translation needed
-                // The canvas position will be handled in the render function if needed
-            } else {
-                // In 2D mode, apply translation to canvas position
-                glTranslatef(abs_x, abs_y, 0.0f);
-            }
-            
-            // Call the canvas render function, adjusting the coordinates it receives
-            // The function will draw in the local coordinate system
-            el->canvas_render_func(0, 0, el->width, el->height);
-            
-            // Restore projection matrix if we were in 3D mode
-            if (strcmp(el->view_mode, "3d") == 0) {
-                glMatrixMode(GL_PROJECTION);
-                glPopMatrix(); // Restore previous projection matrix
-                glMatrixMode(GL_MODELVIEW);
-            }
+            // Switch back to modelview matrix for drawing
+            glMatrixMode(GL_MODELVIEW);
             
-            // Restore the modelview matrix
-            glPopMatrix();
+            // Set up camera view
+            gluLookAt(
+                el->camera_pos[0], el->camera_pos[1], el->camera_pos[2],  // Camera position
+                el->camera_target[0], el->camera_target[1], el->camera_target[2],  // Look at point
+                el->camera_up[0], el->camera_up[1], el->camera_up[2]  // Up vector
+            );
         }
-    } else if (strcmp(el->type, "menu") == 0) {
-        // For context menus (like "Generic Context Menu"), only draw the menu bar when open
-        // For permanent menu bars, always draw the menu bar
-        int should_draw_menu_bar = 1; // By default, draw for permanent menu bars
         
-        // Check if this is likely a context menu (by label or other heuristics)
-        if (strcmp(el->label, "Generic Context Menu") == 0) {
-            // This is a context menu - only draw if it's open
-            should_draw_menu_bar = el->is_open;
-        }
-        
-        if (should_draw_menu_bar) {
-            // Draw menu bar background
-            glColor3fv(el->color);
-            glBegin(GL_QUADS);
-            glVertex2i(abs_x, abs_y);
-            glVertex2i(abs_x + el->width, abs_y);
-            glVertex2i(abs_x + el->width, abs_y + el->height);
-            glVertex2i(abs_x, abs_y + el->height);
-            glEnd();
-            
-            // Draw menu text - center it vertically in the menu bar
-            glColor3f(1.0f, 1.0f, 1.0f);
-            int text_offset_x = 5;
-            // Center the text vertically: start from the bottom of the menu and add centered offset
-            int text_offset_y = (el->height / 2) - 6;  // Adjusted to position text properly in menu
-            glRasterPos2i(abs_x + text_offset_x, abs_y + text_offset_y);
-            for (char* c = el->label; *c != '\0'; c++) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
-            }
+        // Apply transformation to move to canvas position (only in 2D mode)
+        if (strcmp(el->view_mode, "3d") == 0) {
+            // In 3D mode, we've already set up the camera, so no translation needed
+            // The canvas position will be handled in the render function if needed
+        } else {
+            // In 2D mode, apply translation to canvas position
+            glTranslatef(abs_x, abs_y, 0.0f);
         }
         
-
-    } else if (strcmp(el->type, "menuitem") == 0) {
-        // Draw menu item - only if it's not part of an open menu (since those are drawn in the menu section)
-        int parent_menu_index = el->parent;
+        // Call the canvas render function, adjusting the coordinates it receives
+        // The function will draw in the local coordinate system
+        el->canvas_render_func(0, 0, el->width, el->height);
         
-        if (!(parent_menu_index != -1 && 
-              strcmp(elements[parent_menu_index].type, "menu") == 0 && 
-              elements[parent_menu_index].is_open)) {
-            // Draw menu item in its original position only if its parent menu is not open
-            // Draw menu item
-            glColor3fv(el->color);
-            glBegin(GL_QUADS);
-            glVertex2i(abs_x, abs_y);
-            glVertex2i(abs_x + el->width, abs_y);
-            glVertex2i(abs_x + el->width, abs_y + el->height);
-            glVertex2i(abs_x, abs_y + el->height);
-            glEnd();
-            
-            // Draw menu item text
-            glColor3f(0.0f, 0.0f, 0.0f); // Black text for menu items
-            glRasterPos2i(abs_x + 5, abs_y + 15);
-            for (char* c = el->label; *c != '\0'; c++) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
-            }
-        }
-        // If the parent menu IS open, menuitems are drawn in the menu section instead
-    } else if (strcmp(el->type, "dirlist") == 0) {
-        // Draw directory listing background
-        glColor3f(0.2f, 0.2f, 0.2f); // Dark gray background
-        glBegin(GL_QUADS);
-        glVertex2i(abs_x, abs_y);
-        glVertex2i(abs_x + el->width, abs_y);
-        glVertex2i(abs_x + el->width, abs_y + el->height);
-        glVertex2i(abs_x, abs_y + el->height);
-        glEnd();
-
-        // Get directory contents from the model
-        int entry_count = 0;
-        char (*entries)[256] = model_get_dir_entries(&entry_count);
-
-        // Draw "dir element list:" header
-        glColor3f(1.0f, 1.0f, 0.0f); // Yellow text for header
-        glRasterPos2i(abs_x + 5, abs_y + 15);
-        const char* header_text = "dir element list:";
-        for (const char* c = header_text; *c != '\0'; c++) {
-            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
-        }
-
-        // Draw directory entries
-        glColor3f(1.0f, 1.0f, 1.0f); // White text for entries
-        int line_height = 20;
-        for (int i = 0; i < entry_count; i++) {
-            int text_y = abs_y + 40 + (i * line_height); // Start below header
-            if (text_y + line_height < abs_y + el->height) { // Make sure we don't draw outside bounds
-                // TODO: Add back selection highlighting if needed
-                glRasterPos2i(abs_x + 10, text_y);
-                for (const char* c = entries[i]; *c != '\0'; c++) {
-                    glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
-                }
-            }
-        }
-    } else if (strcmp(el->type, "textfield") == 0 || strcmp(el->type, "textarea") == 0) {
-        // Background
-        glColor3f(0.1f, 0.1f, 0.1f);
-        glBegin(GL_QUADS);
-        glVertex2i(abs_x, abs_y);
-        glVertex2i(abs_x + el->width, abs_y);
-        glVertex2i(abs_x + el->width, abs_y + el->height);
-        glVertex2i(abs_x, abs_y + el->height);
-        glEnd();
-        // Border
-        glColor3f(0.8f, 0.8f, 0.8f); // Light grey border
-        glBegin(GL_LINE_LOOP);
-        glVertex2i(abs_x, abs_y);
-        glVertex2i(abs_x + el->width, abs_y);
-        glVertex2i(abs_x + el->width, abs_y + el->height);
-        glVertex2i(abs_x, abs_y + el->height);
-        glEnd();
-    } else if (strcmp(el->type, "header") == 0 || strcmp(el->type, "button") == 0 || strcmp(el->type, "panel") == 0 || strcmp(el->type, "checkbox") == 0 || strcmp(el->type, "slider") == 0) {
-        if (strcmp(el->type, "checkbox") == 0) {
-            glColor3f(0.8f, 0.8f, 0.8f); // Light background for checkbox square
-        } else if (strcmp(el->type, "slider") == 0) {
-            glColor3f(0.3f, 0.3f, 0.3f); // Dark background for slider track
-        } else {
-            glColor3fv(el->color);
+        // Restore projection matrix if we were in 3D mode
+        if (strcmp(el->view_mode, "3d") == 0) {
+            glMatrixMode(GL_PROJECTION);
+            glPopMatrix(); // Restore previous projection matrix
+            glMatrixMode(GL_MODELVIEW);
         }
-        glBegin(GL_QUADS);
-        glVertex2i(abs_x, abs_y);
-        glVertex2i(abs_x + el->width, abs_y);
-        glVertex2i(abs_x + el->width, abs_y + el->height);
-        glVertex2i(abs_x, abs_y + el->height);
-        glEnd();
+        
+        // Restore the modelview matrix
+        glPopMatrix();
+    }
+}
 
-        if (strcmp(el->type, "checkbox") == 0 && el->is_checked) {
-            // Draw a simple checkmark (upright V shape, adjusted for inverted Y)
-            glColor3f(0.0f, 0.0f, 0.0f); // Black checkmark
-            glLineWidth(2.0f);
-            glBegin(GL_LINES);
-            // First segment: bottom-left to top-middle
-            glVertex2i(abs_x + el->width * 0.2, abs_y + el->height * 0.8); // Visually lower
-            glVertex2i(abs_x + el->width * 0.4, abs_y + el->height * 0.2); // Visually higher
-            // Second segment: top-middle to bottom-right
-            glVertex2i(abs_x + el->width * 0.4, abs_y + el->height * 0.2); // Visually higher
-            glVertex2i(abs_x + el->width * 0.8, abs_y + el->height * 0.8); // Visually lower
-            glEnd();
-            glLineWidth(1.0f);
-        } else if (strcmp(el->type, "slider") == 0) {
-            // Check if this is a vertical slider by looking at the aspect ratio
-            int is_vertical = (el->height > el->width);  // If height is greater than width, consider it vertical
-            
-            if (is_vertical) {
-                // Draw vertical slider track (background)
-                glColor3f(0.3f, 0.3f, 0.3f); // Dark background for slider track
-                glBegin(GL_QUADS);
-                glVertex2i(abs_x + el->width/2 - 3, abs_y); // Centered track
-                glVertex2i(abs_x + el->width/2 + 3, abs_y);
-                glVertex2i(abs_x + el->width/2 + 3, abs_y + el->height);
-                glVertex2i(abs_x + el->width/2 - 3, abs_y + el->height);
-                glEnd();
-            
-                // Draw vertical slider thumb
-                float normalized_pos = (float)(el->slider_value - el->slider_min) / (el->slider_max - el->slider_min);
-                float thumb_pos_y = abs_y + normalized_pos * (el->height - 10); // Position based on normalized value
-                glColor3f(0.8f, 0.8f, 0.8f); // Light grey for thumb
-                glBegin(GL_QUADS);
-                glVertex2i(abs_x, thumb_pos_y); // Thumb wider than track
-                glVertex2i(abs_x + el->width, thumb_pos_y);
-                glVertex2i(abs_x + el->width, thumb_pos_y + 10); // Thumb height of 10
-                glVertex2i(abs_x, thumb_pos_y + 10);
-                glEnd();
+// The retained element geometry and text (render_list.h)
+RenderList view_render_list;
 
-                // Draw slider value as text
-                char value_str[10];
-                sprintf(value_str, "%d", el->slider_value);
-                glColor3f(1.0f, 1.0f, 1.0f);
-                glRasterPos2i(abs_x + el->width + 5, abs_y + el->height / 2 - 5);
-                for (char* c = value_str; *c != '\0'; c++) {
-                    glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
-                }
-            } else {
-                // Original horizontal slider implementation
-                float thumb_pos_x = abs_x + (float)(el->slider_value - el->slider_min) / (el->slider_max - el->slider_min) * (el->width - 10); // 10 is thumb width
-                glColor3f(0.8f, 0.8f, 0.8f); // Light grey for thumb
-                glBegin(GL_QUADS);
-                glVertex2i(thumb_pos_x, abs_y);
-                glVertex2i(thumb_pos_x + 10, abs_y);
-                glVertex2i(thumb_pos_x + 10, abs_y + el->height);
-                glVertex2i(thumb_pos_x, abs_y + el->height);
-                glEnd();
+static void* view_fonts[] = { GLUT_BITMAP_HELVETICA_18, GLUT_BITMAP_HELVETICA_12 };
 
-                // Draw slider value as text
-                char value_str[10];
-                sprintf(value_str, "%d", el->slider_value);
-                glColor3f(1.0f, 1.0f, 1.0f);
-                glRasterPos2i(abs_x + el->width + 5, abs_y + el->height / 2 - 5);
-                for (char* c = value_str; *c != '\0'; c++) {
-                    glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
-                }
-            }
-        }
+// The render list's text measure
+int view_text_width(int font, const char* s, int n) {
+    int width = 0;
+    for (int i = 0; i < n; i++) {
+        width += glutBitmapWidth(view_fonts[font], (unsigned char)s[i]);
     }
+    return width;
+}
 
-    if (strcmp(el->type, "text") == 0 || strcmp(el->type, "button") == 0 || strcmp(el->type, "checkbox") == 0) {
-        // Check if the text contains emojis
-        if (contains_emoji(el->label)) {
-            // Use emoji-aware text rendering
-            int text_offset_x = 5;
-            int text_offset_y = 15;
-            if (strcmp(el->type, "checkbox") == 0) {
-                text_offset_x = el->width + 5; // Label next to checkbox
-                text_offset_y = el->height / 2 - 5; // Center label vertically
+// One pass over the draw list: a glDrawArrays per batch, canvases and
+// bitmap text in between
+void draw_render_list(RenderList* rl) {
+    static const GLenum modes[] = { GL_QUADS, GL_LINES, GL_LINES, 0, GL_QUADS, 0 };
+    for (int i = 0; i < rl->item_count; i++) {
+        RlCommand* c = &rl->items[i];
+        if (c->kind == RL_CANVAS) {
+            draw_canvas(&elements[c->element], (int)c->x, (int)c->y);
+        } else if (c->kind == RL_TEXT) {
+            glColor3fv(c->color);
+            glRasterPos2f(c->x, c->y);
+            for (const char* t = render_list_text(rl, c); *t != '\0'; t++) {
+                glutBitmapCharacter(view_fonts[c->font], *t);
             }
-            
-            float text_color[3] = {1.0f, 1.0f, 1.0f}; // Default white
-            float text_pos_x = abs_x + text_offset_x;
-            float text_pos_y = abs_y + text_offset_y + 15; // Use slightly adjusted Y to align with text baseline
-            
-            render_text_with_emojis(el->label, text_pos_x, text_pos_y, text_color); // Use original approach
         } else {
-            // Use original GLUT rendering for non-emoji text
-            glColor3f(1.0f, 1.0f, 1.0f);
-            int text_offset_x = 5;
-            int text_offset_y = 15;
-            if (strcmp(el->type, "checkbox") == 0) {
-                text_offset_x = el->width + 5; // Label next to checkbox
-                text_offset_y = el->height / 2 - 5; // Center label vertically
-            }
-            glRasterPos2i(abs_x + text_offset_x, abs_y + text_offset_y);
-            for (char* c = el->label; *c != '\0'; c++) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
-            }
-        }
-    } else if (strcmp(el->type, "textfield") == 0 || strcmp(el->type, "textarea") == 0) {
-        // Draw multi-line text, with emoji support when needed
-        int line_height = 20; // Approximate height for each line
-        int start_y = abs_y + 15; // Starting y position for first line
-        
-        for (int line = 0; line < el->num_lines; line++) {
-            if (start_y + (line * line_height) >= abs_y + el->height) break; // Don't draw outside bounds
-            
-            if (contains_emoji(el->text_content[line])) {
-                // Use emoji-aware text rendering
-                float text_color[3] = {1.0f, 1.0f, 1.0f}; // White color for textfield
-                float text_pos_x = abs_x + 5;
-                float text_pos_y = start_y + (line * line_height) + 15; // Use slightly adjusted Y to align with text baseline
-                
-                render_text_with_emojis(el->text_content[line], text_pos_x, text_pos_y, text_color); // Use original approach
-            } else {
-                // Use original GLUT rendering for non-emoji text
-                glRasterPos2i(abs_x + 5, start_y + (line * line_height));
-                for (char* c = el->text_content[line]; *c != '\0'; c++) {
-                    glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
-                }
-            }
-        }
-
-        // Draw cursor if active
-        if (el->is_active) {
-            // Simple blinking cursor (toggle every 500ms)
-            if ((glutGet(GLUT_ELAPSED_TIME) / 500) % 2) {
-                int text_width = 0;
-                for (int i = 0; i < el->cursor_x && i < (int)strlen(el->text_content[el->cursor_y]); i++) {
-                    text_width += glutBitmapWidth(GLUT_BITMAP_HELVETICA_18, el->text_content[el->cursor_y][i]);
-                }
-                glColor3f(1.0f, 1.0f, 1.0f);
-                glBegin(GL_QUADS);
-                glVertex2i(abs_x + 5 + text_width, start_y + (el->cursor_y * line_height) - 15);
-                glVertex2i(abs_x + 5 + text_width + 2, start_y + (el->cursor_y * line_height) - 15);
-                glVertex2i(abs_x + 5 + text_width + 2, start_y + (el->cursor_y * line_height) + 5);
-                glVertex2i(abs_x + 5 + text_width, start_y + (el->cursor_y * line_height) + 5);
-                glEnd();
-            }
+            glEnableClientState(GL_VERTEX_ARRAY);
+            glEnableClientState(GL_COLOR_ARRAY);
+            glVertexPointer(2, GL_FLOAT, sizeof(RlVertex), &rl->verts[0].x);
+            glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(RlVertex), rl->verts[0].rgba);
+            if (c->kind == RL_GLYPHS) {
+                glEnable(GL_TEXTURE_2D);
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                glBindTexture(GL_TEXTURE_2D, c->texture);
+                glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+                glTexCoordPointer(2, GL_FLOAT, sizeof(RlVertex), &rl->verts[0].u);
+            }
+            if (c->kind == RL_WIDE_LINES) glLineWidth(2.0f);
+
+            glDrawArrays(modes[c->kind], c->first, c->count);
+
+            if (c->kind == RL_WIDE_LINES) glLineWidth(1.0f);
+            if (c->kind == RL_GLYPHS) {
+                glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                glDisable(GL_BLEND);
+                glDisable(GL_TEXTURE_2D);
+            }
+            glDisableClientState(GL_COLOR_ARRAY);
+            glDisableClientState(GL_VERTEX_ARRAY);
         }
     }
+    glColor3f(1.0f, 1.0f, 1.0f);
 }
 
 // Function to cleanup FreeType resources
 
 
 void cleanup_freetype() {
-    // Clean up cached emoji textures
-    for (int i = 0; i < emoji_cache_size && i < MAX_CACHED_EMOJIS; i++) {
-        if (emoji_cache[i].loaded) {
-            glDeleteTextures(1, &emoji_cache[i].texture_id);
+    // Clean up the emoji atlas and its pages
+    for (int i = 0; i < EMOJI_ATLAS_PAGES; i++) {
+        if (emoji_pages[i]) {
+            glDeleteTextures(1, &emoji_pages[i]);
+            emoji_pages[i] = 0;
         }
     }
+    glyph_atlas_free(&emoji_atlas);
     
     if (emoji_face) {
         FT_Done_Face(emoji_face);
@@ -1130,96 +627,17 @@ void display() {
     glClearColor(bg_r, bg_g, bg_b, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    // Draw all regular elements first
-    for (int i = 0; i < num_elements; i++) {
-        // Draw the element but don't draw submenu items here
-        // (they'll be drawn separately to ensure they appear on top)
-        if (strcmp(elements[i].type, "menuitem") == 0 && 
-            elements[i].parent != -1 && 
-            strcmp(elements[elements[i].parent].type, "menu") == 0 &&
-            elements[elements[i].parent].is_open) {
-            // Skip drawing menuitems that are part of an open menu here
-            // They will be drawn with the menu in the next step
-        } else {
-            draw_element(&elements[i]);
-        }
-    }
-
-    // Draw submenu items separately to ensure they appear on top of everything else
-    for (int i = 0; i < num_elements; i++) {
-        if (strcmp(elements[i].type, "menu") == 0 && elements[i].is_open) {
-            // Draw this open menu's submenu items
-            // Calculate absolute position of menu using same transformation as draw_element
-            int parent_x = 0;
-            int parent_y = 0;
-            int current_parent = elements[i].parent;
-            while (current_parent != -1) {
-                parent_x += elements[current_parent].x;
-                parent_y += elements[current_parent].y;
-                current_parent = elements[current_parent].parent;
-            }
-
-            int abs_x = parent_x + elements[i].x;
-            int abs_y = calculate_absolute_y(parent_y, elements[i].y, elements[i].height); // Same transformation as draw_element
-            
-            // Calculate submenu position - need to check if it would go outside window bounds
-            int submenu_start_y = abs_y + elements[i].height;
-            int submenu_end_y = abs_y + elements[i].height + 20 * elements[i].menu_items_count;
-            
-            // If submenu would go outside window bounds, draw it above the menu instead
-            if (submenu_end_y > window_height) {
-                submenu_start_y = abs_y - 20 * elements[i].menu_items_count;
-                if (submenu_start_y < 0) {
-                    submenu_start_y = 0; // Ensure it doesn't go above the window
-                }
-            }
-            
-            // Draw submenu background
-            glColor3f(1.0f, 1.0f, 0.0f); // Bright yellow for submenu background to make it visible
-            glBegin(GL_QUADS);
-            glVertex2i(abs_x, submenu_start_y); // Position submenu appropriately
-            glVertex2i(abs_x + elements[i].width, submenu_start_y);
-            glVertex2i(abs_x + elements[i].width, submenu_start_y + 20 * elements[i].menu_items_count); // Each item is ~20px high
-            glVertex2i(abs_x, submenu_start_y + 20 * elements[i].menu_items_count);
-            glEnd();
-            
-            // Draw submenu items
-            for (int j = 0; j < num_elements; j++) {
-                if (elements[j].parent == i && strcmp(elements[j].type, "menuitem") == 0) {
-                    // Calculate position of this item in the submenu
-                    int item_position = 0;
-                    for (int k = 0; k < num_elements; k++) {
-                        if (elements[k].parent == i && 
-                            strcmp(elements[k].type, "menuitem") == 0) {
-                            if (k == j) { // If this is our element
-                                break;
-                            }
-                            item_position++;
-                        }
-                    }
-                    
-                    // Calculate the y position for this specific menu item
-                    int item_y = submenu_start_y + item_position * 20;
-                    
-                    // Draw the submenu item
-                    glColor3f(0.7f, 0.7f, 0.9f); // Light blue for menu items
-                    glBegin(GL_QUADS);
-                    glVertex2i(abs_x, item_y);
-                    glVertex2i(abs_x + elements[j].width, item_y);
-                    glVertex2i(abs_x + elements[j].width, item_y + 20);
-                    glVertex2i(abs_x, item_y + 20);
-                    glEnd();
-                    
-                    // Draw menu item text
-                    glColor3f(0.0f, 0.0f, 0.0f); // Black text for menu items
-                    glRasterPos2i(abs_x + 5, item_y + 15);
-                    for (char* c = elements[j].label; *c != '\0'; c++) {
-                        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
-                    }
-                }
-            }
-        }
-    }
+    // Rebuild only the elements that changed, then draw every batch; open
+    // menus' items are on the list's top layer
+    RlContext ctx;
+    ctx.window_height = window_height;
+    ctx.blink_on = (glutGet(GLUT_ELAPSED_TIME) / 500) % 2; // Blinking cursor, toggled every 500ms
+    ctx.dir_entries = model_get_dir_entries(&ctx.dir_entry_count);
+    ctx.text_width = view_text_width;
+    ctx.glyph = emoji_glyph;
+    ctx.glyph_generation = &emoji_atlas.generation;
+    render_list_update(&view_render_list, elements, num_elements, &ctx);
+    draw_render_list(&view_render_list);
 
     glutSwapBuffers();
 }
@@ -4,16 +4,8 @@
 #include <GL/glut.h>
 #include <GL/glut.h> // Required for glutPostRedisplay and glutGet
 
-// We need the UIElement definition and the elements array from view.c
-// In a real C application, you'd have a .h file for this.
-#define MAX_TEXT_LINES 1000
-#define MAX_LINE_LENGTH 512
-
-#define CLIPBOARD_SIZE 10000
-
-// Definitions for model variables (for UI updates)
-#define MAX_VARIABLES 50
-#define MAX_ARRAYS 20
+// The UIElement definition; the elements array lives in view.c
+#include "ui_element.h"
 
 // Forward declarations for functions defined later in this file
 void handle_ctrl_keys(unsigned char key, int element_index);
@@ -44,54 +36,8 @@ ModelVariable* model_get_variables(int* count);
 extern int window_width;
 extern int window_height;
 
-typedef struct {
-    char type[20];
-    int x, y, width, height;
-    char id[50]; // Unique identifier for UI elements
-    char label[50]; // Used for button label, text element value, and checkbox label
-    // Multi-line text support - replace simple text_content with array of lines
-    char text_content[MAX_TEXT_LINES][MAX_LINE_LENGTH];
-    int num_lines; // Number of lines in the text
-    int cursor_x; // X position of cursor (column)
-    int cursor_y; // Y position of cursor (line number)
-    int is_active; // For textfield active state
-    int is_checked; // For checkbox checked state
-    int slider_value; // For slider current value
-    int slider_min; // For slider minimum value
-    int slider_max; // For slider maximum value
-    int slider_step; // For slider step increment
-    float color[3];
-    int parent;
-    // Canvas-specific properties
-    int canvas_initialized; // Flag to track if canvas has been initialized
-    void (*canvas_render_func)(int x, int y, int width, int height); // Render function for canvas
-    char view_mode[10]; // View mode: "2d" or "3d"
-    // Camera properties for 3D view
-    float camera_pos[3]; // Camera position (x, y, z)
-    float camera_target[3]; // Camera target (x, y, z)
-    float camera_up[3]; // Camera up vector (x, y, z)
-    float fov; // Field of view for 3D perspective
-    // Event handling
-    char onClick[50]; // Store the onClick handler function name
-    // Menu-specific properties
-    int menu_items_count; // Number of submenu items
-    int is_open; // For menus - whether they are currently open
-    // Text selection properties
-    int selection_start_x; // X position of selection start
-    int selection_start_y; // Y position of selection start
-    int selection_end_x;   // X position of selection end
-    int selection_end_y;   // Y position of selection end
-    int has_selection;     // Whether there is an active selection
-    // Clipboard for this element
-    char clipboard[CLIPBOARD_SIZE];
-    // Directory listing properties
-    char dir_path[512]; // Directory path for directory listing elements
-    char dir_entries[100][256]; // Store up to 100 directory entries
-    int dir_entry_count; // Number of directory entries
-    int dir_entry_selected; // Index of selected entry
-} UIElement;
-
-extern UIElement elements[];
+
+extern UIElement* elements;
 extern int num_elements;
 
 void run_module_handler(); // Forward declaration
@@ -587,7 +533,7 @@ void keyboard(unsigned char key, int x, int y) {
                     }
                 }
             } else if (key == 13) { // Enter - create new line
-                if (elements[i].num_lines < MAX_TEXT_LINES - 1) {
+                if (elements[i].num_lines < MAX_TEXT_LINES - 1 && ui_element_reserve_lines(&elements[i], elements[i].num_lines + 1)) {
                     // Shift lines down from the current position
                     for (int j = elements[i].num_lines; j > elements[i].cursor_y; j--) {
                         strcpy(elements[i].text_content[j], elements[i].text_content[j-1]);
@@ -691,6 +637,7 @@ void special_keys(int key, int x, int y) {
 // Function to copy selected text to clipboard
 void copy_text(int element_index) {
     UIElement* el = &elements[element_index];
+    if (!ui_element_clipboard(el)) return;
     if (!el->has_selection) {
         // If no selection, copy the entire line
         strcpy(el->clipboard, el->text_content[el->cursor_y]);
@@ -786,7 +733,7 @@ void delete_selection(int element_index) {
         
         // Shift lines up to remove the deleted lines
         for (int line = start_y + 1; line <= end_y; line++) {
-            strcpy(el->text_content[line - (end_y - start_y)], el->text_content[line]);
+            memmove(el->text_content[line - (end_y - start_y)], el->text_content[line], MAX_LINE_LENGTH);
         }
         
         // Update line count
@@ -810,7 +757,7 @@ void paste_text(int element_index) {
         delete_selection(element_index);
     }
     
-    int clipboard_len = strlen(el->clipboard);
+    int clipboard_len = el->clipboard ? strlen(el->clipboard) : 0;
     if (clipboard_len == 0) {
         return; // Nothing to paste
     }
@@ -866,10 +813,10 @@ void paste_text(int element_index) {
                 first_line = 0;
             } else {
                 // Create new line after current line
-                if (el->num_lines < MAX_TEXT_LINES - 1) {
+                if (el->num_lines < MAX_TEXT_LINES - 1 && ui_element_reserve_lines(el, el->num_lines + 1)) {
                     // Shift lines down
                     for (int j = el->num_lines; j > el->cursor_y + 1; j--) {
-                        strcpy(el->text_content[j], el->text_content[j-1]);
+                        memmove(el->text_content[j], el->text_content[j-1], MAX_LINE_LENGTH);
                     }
                     el->num_lines++;
                     
@@ -903,7 +850,8 @@ void update_ui_with_model_variables() {
     int var_count;
     ModelVariable* vars = model_get_variables(&var_count);
     
-    for (int i = 0; i < MAX_VARIABLES; i++) {
+    // The model's variables are dense: vars[0..var_count)
+    for (int i = 0; i < var_count; i++) {
         if (vars[i].active) {
             // Look for UI elements with IDs that match variable labels
             for (int j = 0; j < num_elements; j++) {
@@ -0,0 +1,292 @@
+#ifndef CHTML_IPC_H
+#define CHTML_IPC_H
+
+// Binary framing for messages from a module to the C-HTML host.
+//
+// The host offers the binary protocol by setting CHTML_IPC=binary in the
+// module's environment (unless CHTML_IPC is already set, so CHTML_IPC=text
+// forces the text protocol). A module that speaks it starts its output
+// with the 4 magic bytes "\0CH1"; anything else is read as the text
+// protocol of chtml_legend.md, one record per line. Both are read through
+// a reassembly buffer in 2.model.c, so a line or frame split across pipe
+// reads arrives whole.
+//
+// A frame is
+//
+//   u32 length   payload bytes, little-endian
+//   u8  kind     CHTML_MSG_*
+//   payload
+//
+// with strings as u8 length + bytes and numbers as little-endian 32-bit
+// int/float (IEEE 754 bits), encoded byte by byte whatever the host order:
+//
+//   CLEAR   (empty)
+//   SHAPE   type, label, 10 x f32: x y z width height depth r g b a
+//   VAR     label, u8 CHTML_VAL_*, then i32 | f32 | the string's bytes
+//   ARRAY   label, u8 CHTML_VAL_INT | CHTML_VAL_FLOAT, u32 count, values
+//   TEXT    one text-protocol line, without the newline
+//
+// Modules write through a ChtmlIpcWriter, which picks the protocol at
+// chtml_ipc_open() and buffers output, so one set of calls serves both.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define CHTML_IPC_ENV "CHTML_IPC"
+#define CHTML_IPC_MAGIC "\0CH1"
+#define CHTML_IPC_MAGIC_LEN 4
+#define CHTML_IPC_HEADER 5
+#define CHTML_IPC_MAX_FRAME (16 << 20)
+
+enum { CHTML_MSG_CLEAR = 1, CHTML_MSG_SHAPE, CHTML_MSG_VAR, CHTML_MSG_ARRAY, CHTML_MSG_TEXT };
+// Same codes as ModelVariable.type and ModelArray.type
+enum { CHTML_VAL_INT = 1, CHTML_VAL_FLOAT = 2, CHTML_VAL_STRING = 3 };
+
+static inline uint32_t chtml_ipc_u32(const unsigned char *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+
+static inline int32_t chtml_ipc_i32(const unsigned char *p) { uint32_t u = chtml_ipc_u32(p); int32_t v; memcpy(&v, &u, 4); return v; }
+
+static inline float chtml_ipc_f32(const unsigned char *p) { uint32_t u = chtml_ipc_u32(p); float v; memcpy(&v, &u, 4); return v; }
+
+static inline void chtml_ipc_le32(unsigned char *b, uint32_t v) { b[0] = v & 0xff; b[1] = v >> 8 & 0xff; b[2] = v >> 16 & 0xff; b[3] = v >> 24; }
+
+// --- Decoding (host) ---
+
+// Looks for a whole frame at the start of buf. Returns its size with the
+// header, 0 if more bytes are needed, -1 if the length is impossible.
+static inline long chtml_ipc_frame(const unsigned char *buf, size_t len, int *kind, const unsigned char **payload, uint32_t *plen) {
+    if (len < CHTML_IPC_HEADER) return 0;
+    uint32_t n = chtml_ipc_u32(buf);
+    if (n > CHTML_IPC_MAX_FRAME) return -1;
+    if (len < CHTML_IPC_HEADER + (size_t)n) return 0;
+    *kind = buf[4];
+    *payload = buf + CHTML_IPC_HEADER;
+    *plen = n;
+    return CHTML_IPC_HEADER + (long)n;
+}
+
+// Reads a u8-length string into out (truncated to cap - 1). Returns 0 if it
+// runs past end.
+static inline int chtml_ipc_get_str(const unsigned char **p, const unsigned char *end, char *out, size_t cap) {
+    if (*p >= end) return 0;
+    size_t n = **p;
+    if ((size_t)(end - *p) < 1 + n) return 0;
+    size_t k = n < cap - 1 ? n : cap - 1;
+    memcpy(out, *p + 1, k);
+    out[k] = '\0';
+    *p += 1 + n;
+    return 1;
+}
+
+// type[32], label[64], v[10]
+static inline int chtml_ipc_get_shape(const unsigned char *p, uint32_t n, char *type, char *label, float *v) {
+    const unsigned char *end = p + n;
+    if (!chtml_ipc_get_str(&p, end, type, 32) || !chtml_ipc_get_str(&p, end, label, 64) || end - p != 10 * 4) return 0;
+    for (int k = 0; k < 10; k++) v[k] = chtml_ipc_f32(p + 4 * k);
+    return 1;
+}
+
+// label[64], str[256]; sets *type and the matching value
+static inline int chtml_ipc_get_var(const unsigned char *p, uint32_t n, char *label, int *type, int *i, float *f, char *str) {
+    const unsigned char *end = p + n;
+    if (!chtml_ipc_get_str(&p, end, label, 64) || p >= end) return 0;
+    *type = *p++;
+    if (*type == CHTML_VAL_INT || *type == CHTML_VAL_FLOAT) {
+        if (end - p != 4) return 0;
+        if (*type == CHTML_VAL_INT) *i = chtml_ipc_i32(p);
+        else *f = chtml_ipc_f32(p);
+        return 1;
+    }
+    if (*type != CHTML_VAL_STRING) return 0;
+    size_t k = (size_t)(end - p) < 255 ? (size_t)(end - p) : 255;
+    memcpy(str, p, k);
+    str[k] = '\0';
+    return 1;
+}
+
+// label[64]; *values points at count 4-byte values in the payload
+static inline int chtml_ipc_get_array(const unsigned char *p, uint32_t n, char *label, int *type, uint32_t *count, const unsigned char **values) {
+    const unsigned char *end = p + n;
+    if (!chtml_ipc_get_str(&p, end, label, 64) || end - p < 5) return 0;
+    *type = *p++;
+    *count = chtml_ipc_u32(p);
+    p += 4;
+    if ((*type != CHTML_VAL_INT && *type != CHTML_VAL_FLOAT) || (size_t)(end - p) != (size_t)*count * 4) return 0;
+    *values = p;
+    return 1;
+}
+
+// Decodes count values from chtml_ipc_get_array() into ints or floats
+static inline void chtml_ipc_get_values(const unsigned char *values, int type, uint32_t count, void *out) {
+    for (uint32_t k = 0; k < count; k++) {
+        if (type == CHTML_VAL_INT) ((int *)out)[k] = chtml_ipc_i32(values + 4 * k);
+        else ((float *)out)[k] = chtml_ipc_f32(values + 4 * k);
+    }
+}
+
+// --- Encoding (modules) ---
+
+typedef struct {
+    int fd;
+    int binary;              // negotiated at open
+    size_t len;
+    size_t limit;            // flush threshold, sizeof(buf) unless lowered
+    unsigned char buf[1 << 16];
+} ChtmlIpcWriter;
+
+static inline int chtml_ipc_write_all(int fd, const unsigned char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return 0;
+        p += w;
+        n -= (size_t)w;
+    }
+    return 1;
+}
+
+static inline int chtml_ipc_flush(ChtmlIpcWriter *w) {
+    int ok = chtml_ipc_write_all(w->fd, w->buf, w->len);
+    w->len = 0;
+    return ok;
+}
+
+static inline void chtml_ipc_put(ChtmlIpcWriter *w, const void *data, size_t n) {
+    const unsigned char *p = data;
+    while (n > 0) {
+        if (w->len == w->limit) chtml_ipc_flush(w);
+        size_t k = w->limit - w->len < n ? w->limit - w->len : n;
+        memcpy(w->buf + w->len, p, k);
+        w->len += k; p += k; n -= k;
+    }
+}
+
+static inline void chtml_ipc_put_u32(ChtmlIpcWriter *w, uint32_t v) {
+    unsigned char b[4];
+    chtml_ipc_le32(b, v);
+    chtml_ipc_put(w, b, 4);
+}
+
+static inline void chtml_ipc_put_i32(ChtmlIpcWriter *w, int32_t v) { uint32_t u; memcpy(&u, &v, 4); chtml_ipc_put_u32(w, u); }
+
+static inline void chtml_ipc_put_f32(ChtmlIpcWriter *w, float v) { uint32_t u; memcpy(&u, &v, 4); chtml_ipc_put_u32(w, u); }
+
+static inline void chtml_ipc_put_str(ChtmlIpcWriter *w, const char *s) {
+    size_t n = strlen(s);
+    unsigned char k = n > 255 ? 255 : (unsigned char)n;
+    chtml_ipc_put(w, &k, 1);
+    chtml_ipc_put(w, s, k);
+}
+
+static inline size_t chtml_ipc_str_size(const char *s) { size_t n = strlen(s); return 1 + (n > 255 ? 255 : n); }
+
+static inline void chtml_ipc_header(ChtmlIpcWriter *w, int kind, size_t n) {
+    chtml_ipc_put_u32(w, (uint32_t)n);
+    unsigned char k = (unsigned char)kind;
+    chtml_ipc_put(w, &k, 1);
+}
+
+__attribute__((format(printf, 2, 3)))
+static inline void chtml_ipc_printf(ChtmlIpcWriter *w, const char *fmt, ...) {
+    char line[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    chtml_ipc_put(w, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+}
+
+// Picks the protocol the host offered and, for binary, writes the magic.
+// fd is normally STDOUT_FILENO; don't mix with stdio on the same fd.
+static inline void chtml_ipc_open(ChtmlIpcWriter *w, int fd) {
+    const char *offer = getenv(CHTML_IPC_ENV);
+    w->fd = fd;
+    w->len = 0;
+    w->limit = sizeof(w->buf);
+    w->binary = offer && strcmp(offer, "binary") == 0;
+    if (w->binary) chtml_ipc_put(w, CHTML_IPC_MAGIC, CHTML_IPC_MAGIC_LEN);
+}
+
+static inline void chtml_ipc_clear(ChtmlIpcWriter *w) {
+    if (w->binary) chtml_ipc_header(w, CHTML_MSG_CLEAR, 0);
+    else chtml_ipc_put(w, "CLEAR_SHAPES\n", 13);
+}
+
+static inline void chtml_ipc_shape(ChtmlIpcWriter *w, const char *type, const char *label, float x, float y, float z,
+                                   float width, float height, float depth, float r, float g, float b, float a) {
+    if (!w->binary) {
+        chtml_ipc_printf(w, "SHAPE;%s;%s;%g;%g;%g;%g;%g;%g;%g;%g;%g;%g\n", type, label, x, y, z, width, height, depth, r, g, b, a);
+        return;
+    }
+    float v[10] = { x, y, z, width, height, depth, r, g, b, a };
+    chtml_ipc_header(w, CHTML_MSG_SHAPE, chtml_ipc_str_size(type) + chtml_ipc_str_size(label) + sizeof(v));
+    chtml_ipc_put_str(w, type);
+    chtml_ipc_put_str(w, label);
+    for (int k = 0; k < 10; k++) chtml_ipc_put_f32(w, v[k]);
+}
+
+static inline void chtml_ipc_var_int(ChtmlIpcWriter *w, const char *label, int value) {
+    if (!w->binary) { chtml_ipc_printf(w, "VAR;%s;int;%d\n", label, value); return; }
+    chtml_ipc_header(w, CHTML_MSG_VAR, chtml_ipc_str_size(label) + 5);
+    chtml_ipc_put_str(w, label);
+    unsigned char t = CHTML_VAL_INT;
+    chtml_ipc_put(w, &t, 1);
+    chtml_ipc_put_i32(w, value);
+}
+
+static inline void chtml_ipc_var_float(ChtmlIpcWriter *w, const char *label, float value) {
+    if (!w->binary) { chtml_ipc_printf(w, "VAR;%s;float;%g\n", label, value); return; }
+    chtml_ipc_header(w, CHTML_MSG_VAR, chtml_ipc_str_size(label) + 5);
+    chtml_ipc_put_str(w, label);
+    unsigned char t = CHTML_VAL_FLOAT;
+    chtml_ipc_put(w, &t, 1);
+    chtml_ipc_put_f32(w, value);
+}
+
+static inline void chtml_ipc_var_string(ChtmlIpcWriter *w, const char *label, const char *value) {
+    size_t n = strlen(value) < 255 ? strlen(value) : 255;
+    if (!w->binary) { chtml_ipc_printf(w, "VAR;%s;string;%.*s\n", label, (int)n, value); return; }
+    chtml_ipc_header(w, CHTML_MSG_VAR, chtml_ipc_str_size(label) + 1 + n);
+    chtml_ipc_put_str(w, label);
+    unsigned char t = CHTML_VAL_STRING;
+    chtml_ipc_put(w, &t, 1);
+    chtml_ipc_put(w, value, n);
+}
+
+// type is CHTML_VAL_INT (values are ints) or CHTML_VAL_FLOAT (floats)
+static inline void chtml_ipc_array(ChtmlIpcWriter *w, const char *label, int type, const void *values, uint32_t count) {
+    if (!w->binary) {
+        chtml_ipc_printf(w, "ARRAY;%s;%s;%u;", label, type == CHTML_VAL_INT ? "int" : "float", count);
+        for (uint32_t i = 0; i < count; i++) {
+            if (type == CHTML_VAL_INT) chtml_ipc_printf(w, i ? ",%d" : "%d", ((const int *)values)[i]);
+            else chtml_ipc_printf(w, i ? ",%g" : "%g", ((const float *)values)[i]);
+        }
+        chtml_ipc_put(w, "\n", 1);
+        return;
+    }
+    chtml_ipc_header(w, CHTML_MSG_ARRAY, chtml_ipc_str_size(label) + 5 + (size_t)count * 4);
+    chtml_ipc_put_str(w, label);
+    unsigned char t = (unsigned char)type;
+    chtml_ipc_put(w, &t, 1);
+    chtml_ipc_put_u32(w, count);
+    for (uint32_t k = 0; k < count; k++) {
+        if (type == CHTML_VAL_INT) chtml_ipc_put_i32(w, ((const int *)values)[k]);
+        else chtml_ipc_put_f32(w, ((const float *)values)[k]);
+    }
+}
+
+// Any other text-protocol record (e.g. the old "TYPE,x,y,size,r,g,b,a")
+static inline void chtml_ipc_text(ChtmlIpcWriter *w, const char *line) {
+    size_t n = strlen(line);
+    if (w->binary) chtml_ipc_header(w, CHTML_MSG_TEXT, n);
+    chtml_ipc_put(w, line, n);
+    if (!w->binary) chtml_ipc_put(w, "\n", 1);
+}
+
+#endif
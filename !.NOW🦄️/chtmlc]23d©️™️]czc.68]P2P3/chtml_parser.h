@@ -0,0 +1,608 @@
+#ifndef CHTML_PARSER_H
+#define CHTML_PARSER_H
+
+// Streaming parser for C-HTML documents (3.view.c).
+//
+// The tokenizer takes the document in chunks of any size, so a tag may be
+// split across reads. It keeps only the tag it is in the middle of, and
+// tracks the line and column (in characters) of every byte. Each complete
+// tag goes straight to the tree builder, which keeps a stack of open
+// elements. Nodes land in a flat array in document order, each with its
+// parent, depth, attributes and the location of its '<'. Comments and
+// declarations (<!...>, <?...?>) are skipped. Attribute values have their
+// entities decoded, so "&#10;" is a newline.
+//
+// Malformed input never stops the parse; it is reported as an error at
+// the exact line and column, and the parse carries on:
+//  - an end tag with no open element of its name is ignored
+//  - an end tag that skips open elements closes them too
+//  - an unquoted attribute value runs to the next space
+//  - an unterminated tag or comment, or elements left open, are reported
+//    at the end
+//
+// Each node has a key, its ID across edits: the hash of its id attribute
+// if it has a unique one, else its parent's key, its tag name and how many
+// earlier siblings share that name. Editing an element's attributes keeps
+// its key, and so does inserting or removing siblings of another kind, or
+// moving an element that has an id. chtml_diff matches a new tree against
+// the old by key and says which nodes are unchanged, changed or new, so
+// the view rebuilds only those.
+//
+// No GL and no UIElement here; test/parser_check.c drives it headlessly.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHTML_MAX_ERRORS 100
+#define CHTML_MAP_MIN_SLOTS 64
+
+typedef struct {
+    int line, column;  // from 1
+} ChtmlLocation;
+
+typedef struct {
+    int name, value;  // offsets into the string pool
+} ChtmlAttr;
+
+typedef struct {
+    int name;                    // the tag name, an offset into the string pool
+    int parent, depth;           // the enclosing node, -1 at the top
+    int first_attr, attr_count;
+    ChtmlLocation at;            // its '<'
+    uint64_t key;                // its ID across edits
+    uint64_t content;            // hash of its name and attributes
+    int closed;                  // by its end tag, or by itself with "/>"
+} ChtmlNode;
+
+typedef struct {
+    ChtmlLocation at;
+    char message[128];
+} ChtmlError;
+
+// uint64_t keys to ints, open addressing; key 0 marks an empty slot
+typedef struct {
+    uint64_t* keys;
+    int* values;
+    uint32_t mask;
+    int used;
+} ChtmlKeyMap;
+
+enum { CHTML_IN_TEXT, CHTML_IN_TAG, CHTML_IN_COMMENT };
+enum { CHTML_SAME, CHTML_CHANGED, CHTML_ADDED };
+
+typedef struct {
+    // The tree
+    ChtmlNode* nodes;
+    int node_count, node_cap;
+    ChtmlAttr* attrs;
+    int attr_count, attr_cap;
+    char* strings;
+    int strings_len, strings_cap;
+    ChtmlError* errors;
+    int error_count, error_cap;
+    int errors_dropped;          // past CHTML_MAX_ERRORS
+    ChtmlKeyMap by_key;          // node key -> node
+    ChtmlKeyMap names;           // (parent key, name) -> siblings so far; id -> node
+
+    // The tokenizer, between feeds
+    int state;
+    char quote;                  // inside a quoted value if not 0
+    int dashes;                  // '-'s just seen in a comment
+    char* token;                 // the tag being read, without '<' and '>'
+    int token_len, token_cap;
+    ChtmlLocation token_at;      // its '<'
+    ChtmlLocation here;          // the next byte
+    int* open;                   // the open elements, innermost last
+    int open_count, open_cap;
+} ChtmlParser;
+
+typedef struct {
+    int same, changed, added, removed;
+} ChtmlDiff;
+
+static inline int chtml_reserve(void** p, int* cap, size_t size, int need) {
+    if (need <= *cap) return 1;
+    int n = *cap ? *cap : 16;
+    while (n < need) n *= 2;
+    void* grown = realloc(*p, (size_t)n * size);
+    if (!grown) return 0;
+    *p = grown;
+    *cap = n;
+    return 1;
+}
+
+// --- Hashing and the key maps ---
+
+static inline uint64_t chtml_hash(uint64_t h, const char* s, size_t n) {
+    for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)s[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+static inline uint64_t chtml_mix(uint64_t h, uint64_t v) {
+    h = (h ^ v) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 31);
+}
+
+static inline int* chtml_map_find(const ChtmlKeyMap* m, uint64_t key) {
+    if (!m->keys) return NULL;
+    for (uint32_t i = (uint32_t)(key ^ (key >> 32)) & m->mask;; i = (i + 1) & m->mask) {
+        if (m->keys[i] == key) return &m->values[i];
+        if (m->keys[i] == 0) return NULL;
+    }
+}
+
+// The value for key, added as value if absent; NULL if out of memory
+static inline int* chtml_map_put(ChtmlKeyMap* m, uint64_t key, int value) {
+    int* found = chtml_map_find(m, key);
+    if (found) return found;
+    if (!m->keys || (uint32_t)(m->used + 1) * 2 > m->mask + 1) {
+        uint32_t n = m->keys ? (m->mask + 1) * 2 : CHTML_MAP_MIN_SLOTS;
+        uint64_t* keys = calloc(n, sizeof(uint64_t));
+        int* values = malloc(n * sizeof(int));
+        if (!keys || !values) {
+            free(keys);
+            free(values);
+            return NULL;
+        }
+        for (uint32_t i = 0; m->keys && i <= m->mask; i++) {
+            if (!m->keys[i]) continue;
+            uint32_t j = (uint32_t)(m->keys[i] ^ (m->keys[i] >> 32)) & (n - 1);
+            while (keys[j]) j = (j + 1) & (n - 1);
+            keys[j] = m->keys[i];
+            values[j] = m->values[i];
+        }
+        free(m->keys);
+        free(m->values);
+        m->keys = keys;
+        m->values = values;
+        m->mask = n - 1;
+    }
+    uint32_t i = (uint32_t)(key ^ (key >> 32)) & m->mask;
+    while (m->keys[i]) i = (i + 1) & m->mask;
+    m->keys[i] = key;
+    m->values[i] = value;
+    m->used++;
+    return &m->values[i];
+}
+
+static inline void chtml_map_clear(ChtmlKeyMap* m) {
+    if (m->keys) memset(m->keys, 0, (size_t)(m->mask + 1) * sizeof(uint64_t));
+    m->used = 0;
+}
+
+static inline void chtml_map_free(ChtmlKeyMap* m) {
+    free(m->keys);
+    free(m->values);
+    memset(m, 0, sizeof(*m));
+}
+
+// --- The parser ---
+
+static inline void chtml_parser_init(ChtmlParser* p) {
+    memset(p, 0, sizeof(*p));
+    p->here.line = p->here.column = 1;
+}
+
+// Empties the parser for another document, keeping its memory
+static inline void chtml_parser_reset(ChtmlParser* p) {
+    p->node_count = p->attr_count = p->strings_len = p->error_count = p->errors_dropped = 0;
+    chtml_map_clear(&p->by_key);
+    chtml_map_clear(&p->names);
+    p->state = CHTML_IN_TEXT;
+    p->quote = 0;
+    p->dashes = 0;
+    p->token_len = 0;
+    p->open_count = 0;
+    p->here.line = p->here.column = 1;
+}
+
+static inline void chtml_parser_free(ChtmlParser* p) {
+    free(p->nodes);
+    free(p->attrs);
+    free(p->strings);
+    free(p->errors);
+    free(p->token);
+    free(p->open);
+    chtml_map_free(&p->by_key);
+    chtml_map_free(&p->names);
+    chtml_parser_init(p);
+}
+
+static inline const char* chtml_string(const ChtmlParser* p, int offset) { return p->strings + offset; }
+
+static inline const char* chtml_node_name(const ChtmlParser* p, int node) { return p->strings + p->nodes[node].name; }
+
+// The value of the node's attribute, the last if it is repeated; NULL if
+// absent
+static inline const char* chtml_attr(const ChtmlParser* p, int node, const char* name) {
+    const ChtmlNode* n = &p->nodes[node];
+    for (int i = n->first_attr + n->attr_count - 1; i >= n->first_attr; i--) {
+        if (strcmp(p->strings + p->attrs[i].name, name) == 0) return p->strings + p->attrs[i].value;
+    }
+    return NULL;
+}
+
+static inline void chtml_error(ChtmlParser* p, ChtmlLocation at, const char* format, ...) __attribute__((format(printf, 3, 4)));
+static inline void chtml_error(ChtmlParser* p, ChtmlLocation at, const char* format, ...) {
+    if (p->error_count == CHTML_MAX_ERRORS ||
+        !chtml_reserve((void**)&p->errors, &p->error_cap, sizeof(ChtmlError), p->error_count + 1)) {
+        p->errors_dropped++;
+        return;
+    }
+    ChtmlError* e = &p->errors[p->error_count++];
+    e->at = at;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(e->message, sizeof(e->message), format, args);
+    va_end(args);
+}
+
+// Appends s[0..n) and a terminator to the string pool; -1 if out of memory
+static inline int chtml_intern(ChtmlParser* p, const char* s, int n) {
+    if (!chtml_reserve((void**)&p->strings, &p->strings_cap, 1, p->strings_len + n + 1)) return -1;
+    int at = p->strings_len;
+    memcpy(p->strings + at, s, n);
+    p->strings[at + n] = '\0';
+    p->strings_len += n + 1;
+    return at;
+}
+
+// Where byte offset of the current token is; the token starts after the
+// '<' at token_at
+static inline ChtmlLocation chtml_where(const ChtmlParser* p, int offset) {
+    ChtmlLocation at = { p->token_at.line, p->token_at.column + 1 };
+    for (int i = 0; i < offset && i < p->token_len; i++) {
+        unsigned char c = p->token[i];
+        if (c == '\n') {
+            at.line++;
+            at.column = 1;
+        } else if ((c & 0xC0) != 0x80) {
+            at.column++;
+        }
+    }
+    return at;
+}
+
+static inline int chtml_is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'; }
+
+// A byte as it can go in an error message
+static inline char chtml_shown(char c) { return c >= ' ' && c <= '~' ? c : '?'; }
+
+static inline int chtml_is_name(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == ':' || c == '.';
+}
+
+// Interns s[0..n) with its entities decoded: &#10; &#x41; &amp; &lt;
+// &gt; &quot; &apos;. Anything else stays as written.
+static inline int chtml_intern_value(ChtmlParser* p, const char* s, int n) {
+    int at = chtml_intern(p, s, n);
+    if (at < 0 || !memchr(s, '&', n)) return at;
+    char* out = p->strings + at;
+    int len = 0;
+    for (int i = 0; i < n;) {
+        const char* semi = s[i] == '&' ? memchr(s + i, ';', n - i < 12 ? n - i : 12) : NULL;
+        if (!semi) {
+            out[len++] = s[i++];
+            continue;
+        }
+        const char* e = s + i + 1;
+        int elen = (int)(semi - e);
+        unsigned long code = 0;
+        int ok = 1;
+        if (elen >= 2 && e[0] == '#') {
+            char* end;
+            code = (e[1] == 'x' || e[1] == 'X') ? strtoul(e + 2, &end, 16) : strtoul(e + 1, &end, 10);
+            ok = end == semi && end > e + 1 && code > 0 && code <= 0x10FFFF;
+        } else if (elen == 3 && memcmp(e, "amp", 3) == 0) code = '&';
+        else if (elen == 2 && memcmp(e, "lt", 2) == 0) code = '<';
+        else if (elen == 2 && memcmp(e, "gt", 2) == 0) code = '>';
+        else if (elen == 4 && memcmp(e, "quot", 4) == 0) code = '"';
+        else if (elen == 4 && memcmp(e, "apos", 4) == 0) code = '\'';
+        else ok = 0;
+        if (!ok) {
+            out[len++] = s[i++];
+            continue;
+        }
+        // As UTF-8, never longer than the entity it replaces
+        if (code < 0x80) {
+            out[len++] = (char)code;
+        } else if (code < 0x800) {
+            out[len++] = (char)(0xC0 | (code >> 6));
+            out[len++] = (char)(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out[len++] = (char)(0xE0 | (code >> 12));
+            out[len++] = (char)(0x80 | ((code >> 6) & 0x3F));
+            out[len++] = (char)(0x80 | (code & 0x3F));
+        } else {
+            out[len++] = (char)(0xF0 | (code >> 18));
+            out[len++] = (char)(0x80 | ((code >> 12) & 0x3F));
+            out[len++] = (char)(0x80 | ((code >> 6) & 0x3F));
+            out[len++] = (char)(0x80 | (code & 0x3F));
+        }
+        i = (int)(semi - s) + 1;
+    }
+    out[len] = '\0';
+    p->strings_len = at + len + 1;
+    return at;
+}
+
+// --- The tree builder ---
+
+static inline void chtml_end_tag(ChtmlParser* p) {
+    const char* t = p->token;
+    int n = p->token_len, i = 1;
+    while (i < n && chtml_is_space(t[i])) i++;
+    int start = i;
+    while (i < n && chtml_is_name(t[i])) i++;
+    int name_len = i - start;
+    while (i < n && chtml_is_space(t[i])) i++;
+    if (name_len == 0) {
+        chtml_error(p, chtml_where(p, start), "expected a tag name after '</'");
+        return;
+    }
+    if (i < n) chtml_error(p, chtml_where(p, i), "unexpected '%c' in end tag </%.*s>", chtml_shown(t[i]), name_len, t + start);
+
+    int match = p->open_count - 1;
+    while (match >= 0) {
+        const char* open_name = chtml_node_name(p, p->open[match]);
+        if ((int)strlen(open_name) == name_len && memcmp(open_name, t + start, name_len) == 0) break;
+        match--;
+    }
+    if (match < 0) {
+        chtml_error(p, p->token_at, "</%.*s> does not close any open element", name_len, t + start);
+        return;
+    }
+    for (int k = p->open_count - 1; k > match; k--) {
+        const ChtmlNode* skipped = &p->nodes[p->open[k]];
+        chtml_error(p, p->token_at, "<%s> opened at %d:%d is not closed before </%.*s>", chtml_string(p, skipped->name),
+                    skipped->at.line, skipped->at.column, name_len, t + start);
+    }
+    p->nodes[p->open[match]].closed = 1;
+    p->open_count = match;
+}
+
+static inline void chtml_start_tag(ChtmlParser* p) {
+    const char* t = p->token;
+    int n = p->token_len, i = 0;
+    while (i < n && chtml_is_name(t[i])) i++;
+    int name_len = i;
+    if (name_len == 0) {
+        chtml_error(p, chtml_where(p, 0), n > 0 ? "expected a tag name after '<'" : "empty tag '<>'");
+        return;
+    }
+    if (!chtml_reserve((void**)&p->nodes, &p->node_cap, sizeof(ChtmlNode), p->node_count + 1) ||
+        !chtml_reserve((void**)&p->open, &p->open_cap, sizeof(int), p->open_count + 1)) {
+        chtml_error(p, p->token_at, "out of memory");
+        return;
+    }
+    int name = chtml_intern(p, t, name_len);
+    if (name < 0) return;
+    int index = p->node_count;
+    ChtmlNode* node = &p->nodes[index];
+    memset(node, 0, sizeof(*node));
+    node->name = name;
+    node->parent = p->open_count ? p->open[p->open_count - 1] : -1;
+    node->depth = p->open_count;
+    node->first_attr = p->attr_count;
+    node->at = p->token_at;
+    uint64_t content = chtml_hash(0xcbf29ce484222325ULL, chtml_string(p, name), name_len + 1);
+
+    int self_closing = 0;
+    while (i < n) {
+        if (chtml_is_space(t[i])) {
+            i++;
+            continue;
+        }
+        if (t[i] == '/') {
+            int j = i + 1;
+            while (j < n && chtml_is_space(t[j])) j++;
+            if (j == n) {
+                self_closing = 1;
+                break;
+            }
+            chtml_error(p, chtml_where(p, i), "unexpected '/' in <%s>", chtml_string(p, name));
+            i++;
+            continue;
+        }
+        int attr_start = i;
+        while (i < n && !chtml_is_space(t[i]) && t[i] != '=' && t[i] != '/' && t[i] != '"' && t[i] != '\'') i++;
+        if (i == attr_start) {
+            chtml_error(p, chtml_where(p, i), "unexpected '%c' in <%s>", chtml_shown(t[i]), chtml_string(p, name));
+            // Skip a stray quoted string whole
+            char q = t[i++];
+            if (q == '"' || q == '\'') {
+                while (i < n && t[i] != q) i++;
+                i++;
+            }
+            continue;
+        }
+        int attr_len = i - attr_start;
+        while (i < n && chtml_is_space(t[i])) i++;
+        int value_start = i, value_len = 0;
+        if (i < n && t[i] == '=') {
+            i++;
+            while (i < n && chtml_is_space(t[i])) i++;
+            if (i < n && (t[i] == '"' || t[i] == '\'')) {
+                char q = t[i];
+                value_start = ++i;
+                while (i < n && t[i] != q) i++;
+                value_len = i - value_start;
+                if (i < n) i++;
+            } else {
+                value_start = i;
+                while (i < n && !chtml_is_space(t[i]) && !(t[i] == '/' && i + 1 == n)) i++;
+                value_len = i - value_start;
+                if (value_len == 0) {
+                    chtml_error(p, chtml_where(p, value_start), "attribute '%.*s' has no value after '='", attr_len, t + attr_start);
+                } else {
+                    chtml_error(p, chtml_where(p, value_start), "value of attribute '%.*s' should be quoted", attr_len, t + attr_start);
+                }
+            }
+        }
+        for (int a = node->first_attr; a < p->attr_count; a++) {
+            const char* seen = chtml_string(p, p->attrs[a].name);
+            if ((int)strlen(seen) == attr_len && memcmp(seen, t + attr_start, attr_len) == 0) {
+                chtml_error(p, chtml_where(p, attr_start), "attribute '%.*s' repeated in <%s>", attr_len, t + attr_start,
+                            chtml_string(p, name));
+                break;
+            }
+        }
+        if (!chtml_reserve((void**)&p->attrs, &p->attr_cap, sizeof(ChtmlAttr), p->attr_count + 1)) break;
+        ChtmlAttr* attr = &p->attrs[p->attr_count];
+        attr->name = chtml_intern(p, t + attr_start, attr_len);
+        attr->value = chtml_intern_value(p, t + value_start, value_len);
+        if (attr->name < 0 || attr->value < 0) break;
+        p->attr_count++;
+        content = chtml_hash(content, chtml_string(p, attr->name), attr_len + 1);
+        content = chtml_hash(content, chtml_string(p, attr->value), strlen(chtml_string(p, attr->value)) + 1);
+    }
+    node = &p->nodes[index];
+    node->attr_count = p->attr_count - node->first_attr;
+    node->content = content;
+    node->closed = self_closing;
+
+    // The key: a unique id, else the position among same-named siblings
+    uint64_t parent_key = node->parent >= 0 ? p->nodes[node->parent].key : 0x5bd1e995ULL;
+    const char* id = chtml_attr(p, index, "id");
+    uint64_t key = 0;
+    if (id && *id) {
+        uint64_t id_key = chtml_mix(chtml_hash(0x84222325cbf29ce4ULL, id, strlen(id)), 1);
+        int* first = chtml_map_put(&p->names, id_key ? id_key : 1, index);
+        if (first && *first != index) {
+            const ChtmlNode* other = &p->nodes[*first];
+            chtml_error(p, node->at, "id \"%s\" is already used at %d:%d", id, other->at.line, other->at.column);
+        } else {
+            key = id_key;
+        }
+    }
+    if (!key) {
+        uint64_t sibling_key = chtml_mix(chtml_hash(parent_key, chtml_string(p, name), name_len), 2);
+        int* seen = chtml_map_put(&p->names, sibling_key ? sibling_key : 1, 0);
+        int ordinal = seen ? (*seen)++ : 0;
+        key = chtml_mix(sibling_key, (uint64_t)ordinal + 3);
+    }
+    // Keys are unique but for hash collisions, which get a fresh one
+    while (!key || chtml_map_find(&p->by_key, key)) key = chtml_mix(key, 4);
+    node->key = key;
+    chtml_map_put(&p->by_key, key, index);
+
+    p->node_count++;
+    if (!self_closing) p->open[p->open_count++] = index;
+}
+
+// The tag just read, without its '<' and '>'
+static inline void chtml_tag(ChtmlParser* p) {
+    if (p->token_len > 0 && (p->token[0] == '!' || p->token[0] == '?')) return; // <!DOCTYPE ...>, <?xml ...?>
+    if (p->token_len > 0 && p->token[0] == '/') chtml_end_tag(p);
+    else chtml_start_tag(p);
+}
+
+// --- The tokenizer ---
+
+// Parses the next n bytes of the document
+static inline void chtml_parser_feed(ChtmlParser* p, const char* data, size_t n) {
+    for (size_t k = 0; k < n; k++) {
+        char c = data[k];
+        switch (p->state) {
+        case CHTML_IN_TEXT:
+            if (c == '<') {
+                p->state = CHTML_IN_TAG;
+                p->token_len = 0;
+                p->quote = 0;
+                p->token_at = p->here;
+            }
+            break;
+        case CHTML_IN_TAG:
+            if (p->quote) {
+                if (c == p->quote) p->quote = 0;
+            } else if (c == '>') {
+                chtml_tag(p);
+                p->state = CHTML_IN_TEXT;
+                break;
+            } else if ((c == '"' || c == '\'') && p->token_len > 0 && p->token[0] != '!') {
+                p->quote = c;
+            }
+            if (p->token_len == p->token_cap && !chtml_reserve((void**)&p->token, &p->token_cap, 1, p->token_len + 1)) break;
+            p->token[p->token_len++] = c;
+            if (p->token_len == 3 && memcmp(p->token, "!--", 3) == 0) {
+                p->state = CHTML_IN_COMMENT;
+                p->dashes = 0;
+            }
+            break;
+        case CHTML_IN_COMMENT:
+            if (c == '>' && p->dashes >= 2) p->state = CHTML_IN_TEXT;
+            p->dashes = c == '-' ? p->dashes + 1 : 0;
+            break;
+        }
+        if (c == '\n') {
+            p->here.line++;
+            p->here.column = 1;
+        } else if ((c & 0xC0) != 0x80) {
+            p->here.column++;
+        }
+    }
+}
+
+// Ends the document, reporting whatever is left unfinished
+static inline void chtml_parser_finish(ChtmlParser* p) {
+    if (p->state == CHTML_IN_TAG) {
+        chtml_error(p, p->token_at, p->quote ? "tag is never closed with '>' (a quote is left open)" : "tag is never closed with '>'");
+    }
+    if (p->state == CHTML_IN_COMMENT) chtml_error(p, p->token_at, "comment is never closed with '-->'");
+    p->state = CHTML_IN_TEXT;
+    for (int k = p->open_count - 1; k >= 0; k--) {
+        const ChtmlNode* n = &p->nodes[p->open[k]];
+        chtml_error(p, p->here, "<%s> opened at %d:%d is never closed", chtml_string(p, n->name), n->at.line, n->at.column);
+    }
+    p->open_count = 0;
+}
+
+// Parses a whole file, streaming it in blocks. Returns 0 if it can't be
+// read.
+static inline int chtml_parse_file(ChtmlParser* p, const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (!file) return 0;
+    char block[8192];
+    size_t got;
+    while ((got = fread(block, 1, sizeof(block), file)) > 0) chtml_parser_feed(p, block, got);
+    fclose(file);
+    chtml_parser_finish(p);
+    return 1;
+}
+
+// --- Diffing ---
+
+// Matches each node of now with the node of before that has its key.
+// status[i] is CHTML_SAME if that node has the same name, attributes and
+// parent, CHTML_CHANGED if not, and CHTML_ADDED if there is none; match[i]
+// is the node of before, or -1.
+static inline ChtmlDiff chtml_diff(const ChtmlParser* before, const ChtmlParser* now, int* match, int* status) {
+    ChtmlDiff d = { 0, 0, 0, 0 };
+    for (int i = 0; i < now->node_count; i++) {
+        const ChtmlNode* n = &now->nodes[i];
+        const int* old = chtml_map_find(&before->by_key, n->key);
+        match[i] = old ? *old : -1;
+        if (!old) {
+            status[i] = CHTML_ADDED;
+            d.added++;
+            continue;
+        }
+        const ChtmlNode* o = &before->nodes[*old];
+        uint64_t parent_key = n->parent >= 0 ? now->nodes[n->parent].key : 0;
+        uint64_t old_parent_key = o->parent >= 0 ? before->nodes[o->parent].key : 0;
+        if (o->content == n->content && parent_key == old_parent_key) {
+            status[i] = CHTML_SAME;
+            d.same++;
+        } else {
+            status[i] = CHTML_CHANGED;
+            d.changed++;
+        }
+    }
+    d.removed = before->node_count - d.same - d.changed;
+    return d;
+}
+
+#endif
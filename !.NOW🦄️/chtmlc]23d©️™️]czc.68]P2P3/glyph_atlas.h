@@ -0,0 +1,320 @@
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+
+// Emoji glyphs packed into a few large textures (3.view.c).
+//
+// Each page is one texture. Glyphs sit on shelves: rows as tall as the
+// first glyph that opened them, filled left to right. A glyph goes on the
+// shelf with room that wastes the least height, or a new shelf under the
+// last one, or a new page. Each glyph keeps a pixel of padding right and below so linear
+// filtering never picks up a neighbour.
+//
+// An open-addressing hash maps a codepoint to its glyph, so a lookup is
+// O(1) however many glyphs are loaded. The glyphs also form a list in
+// order of use. When nothing fits, the least recently used glyph is
+// evicted: its rect becomes a hole the next glyph of that size or smaller
+// takes whole. When a page's last glyph goes, the page starts over with
+// no shelves. Every eviction bumps the generation, so the render list
+// rebuilds the quads that may point at a reused rect.
+//
+// No GL here: the view uploads each new glyph's pixels to its page at
+// (x, y), so test/atlas_check.c checks packing and eviction headlessly.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GLYPH_ATLAS_PADDING 1
+#define GLYPH_ATLAS_MIN_SLOTS 64
+
+typedef struct {
+    unsigned int codepoint;
+    int page;
+    int x, y, width, height;  // the glyph's pixels in its page
+    int slot_width, slot_height;  // the space it holds, padding included
+    int advance;
+    int prev, next;  // the use list, most recent first; next links free entries
+} AtlasGlyph;
+
+typedef struct {
+    int page, y, height;
+    int x;  // where the next glyph goes
+} AtlasShelf;
+
+typedef struct {
+    int page, x, y, width, height;
+} AtlasHole;
+
+typedef struct {
+    int page_width, page_height;
+    int max_pages, page_count;
+    int* page_bottom;  // below the page's last shelf
+    int* page_glyphs;  // glyphs living on the page
+
+    AtlasShelf* shelves;
+    int shelf_count, shelf_cap;
+    AtlasHole* holes;
+    int hole_count, hole_cap;
+
+    AtlasGlyph* glyphs;
+    int glyph_count, glyph_cap;  // entries ever used, live or free
+    int free_glyph;              // first free entry, -1 if none
+    int live;
+    int* slots;                  // entry + 1 by codepoint hash; 0 is empty
+    uint32_t mask;               // slot count - 1, a power of two
+    int used_first, used_last;   // the use list's ends
+
+    unsigned int generation;
+    long evictions;
+} GlyphAtlas;
+
+static inline int atlas_reserve(void** p, int* cap, size_t size, int need) {
+    if (need <= *cap) return 1;
+    int n = *cap ? *cap : 16;
+    while (n < need) n *= 2;
+    void* grown = realloc(*p, (size_t)n * size);
+    if (!grown) return 0;
+    *p = grown;
+    *cap = n;
+    return 1;
+}
+
+static inline uint32_t atlas_hash(unsigned int codepoint) {
+    uint32_t h = codepoint * 2654435761u;
+    return h ^ (h >> 16);
+}
+
+// Pages of page_width x page_height pixels, at most max_pages of them.
+// Returns 0 if out of memory.
+static inline int glyph_atlas_init(GlyphAtlas* a, int page_width, int page_height, int max_pages) {
+    memset(a, 0, sizeof(*a));
+    a->page_width = page_width;
+    a->page_height = page_height;
+    a->max_pages = max_pages;
+    a->page_bottom = calloc(max_pages, sizeof(int));
+    a->page_glyphs = calloc(max_pages, sizeof(int));
+    a->slots = calloc(GLYPH_ATLAS_MIN_SLOTS, sizeof(int));
+    a->mask = GLYPH_ATLAS_MIN_SLOTS - 1;
+    a->free_glyph = a->used_first = a->used_last = -1;
+    return a->page_bottom && a->page_glyphs && a->slots;
+}
+
+static inline void glyph_atlas_free(GlyphAtlas* a) {
+    free(a->page_bottom);
+    free(a->page_glyphs);
+    free(a->shelves);
+    free(a->holes);
+    free(a->glyphs);
+    free(a->slots);
+    memset(a, 0, sizeof(*a));
+}
+
+// --- The use list ---
+
+static inline void atlas_unlink(GlyphAtlas* a, int g) {
+    AtlasGlyph* e = &a->glyphs[g];
+    if (e->prev != -1) a->glyphs[e->prev].next = e->next;
+    else a->used_first = e->next;
+    if (e->next != -1) a->glyphs[e->next].prev = e->prev;
+    else a->used_last = e->prev;
+}
+
+static inline void atlas_push_front(GlyphAtlas* a, int g) {
+    a->glyphs[g].prev = -1;
+    a->glyphs[g].next = a->used_first;
+    if (a->used_first != -1) a->glyphs[a->used_first].prev = g;
+    else a->used_last = g;
+    a->used_first = g;
+}
+
+// --- The codepoint index ---
+
+static inline uint32_t atlas_slot_of(const GlyphAtlas* a, unsigned int codepoint) {
+    uint32_t i = atlas_hash(codepoint) & a->mask;
+    while (a->slots[i] && a->glyphs[a->slots[i] - 1].codepoint != codepoint) i = (i + 1) & a->mask;
+    return i;
+}
+
+// Grows the index to take one more glyph and stay at most half full.
+// Returns 0 if out of memory.
+static inline int atlas_index_reserve(GlyphAtlas* a) {
+    if ((uint32_t)(a->live + 1) * 2 <= a->mask + 1) return 1;
+    uint32_t n = (a->mask + 1) * 2;
+    int* slots = calloc(n, sizeof(int));
+    if (!slots) return 0;
+    for (uint32_t i = 0; i <= a->mask; i++) {
+        if (!a->slots[i]) continue;
+        uint32_t j = atlas_hash(a->glyphs[a->slots[i] - 1].codepoint) & (n - 1);
+        while (slots[j]) j = (j + 1) & (n - 1);
+        slots[j] = a->slots[i];
+    }
+    free(a->slots);
+    a->slots = slots;
+    a->mask = n - 1;
+    return 1;
+}
+
+// Removes a codepoint by shifting back the probe run after it, so lookups
+// never meet a tombstone
+static inline void atlas_index_remove(GlyphAtlas* a, unsigned int codepoint) {
+    uint32_t hole = atlas_slot_of(a, codepoint);
+    if (!a->slots[hole]) return;
+    a->slots[hole] = 0;
+    for (uint32_t i = (hole + 1) & a->mask; a->slots[i]; i = (i + 1) & a->mask) {
+        uint32_t home = atlas_hash(a->glyphs[a->slots[i] - 1].codepoint) & a->mask;
+        // Move it into the hole unless its home lies after the hole
+        if (((i - home) & a->mask) >= ((i - hole) & a->mask)) {
+            a->slots[hole] = a->slots[i];
+            a->slots[i] = 0;
+            hole = i;
+        }
+    }
+}
+
+// --- Packing ---
+
+// Finds room for a width x height slot. Returns 0 if nothing fits without
+// evicting.
+static inline int atlas_place(GlyphAtlas* a, int width, int height, AtlasGlyph* g) {
+    // The smallest hole it fits in, taken whole
+    int best = -1;
+    for (int i = 0; i < a->hole_count; i++) {
+        AtlasHole* h = &a->holes[i];
+        if (h->width < width || h->height < height) continue;
+        if (best == -1 || (long)h->width * h->height < (long)a->holes[best].width * a->holes[best].height) best = i;
+    }
+    if (best != -1) {
+        AtlasHole h = a->holes[best];
+        a->holes[best] = a->holes[--a->hole_count];
+        g->page = h.page;
+        g->x = h.x;
+        g->y = h.y;
+        g->slot_width = h.width;
+        g->slot_height = h.height;
+        return 1;
+    }
+
+    // The shelf with room that wastes the least height
+    best = -1;
+    for (int i = 0; i < a->shelf_count; i++) {
+        AtlasShelf* s = &a->shelves[i];
+        if (s->height < height || s->x + width > a->page_width) continue;
+        if (best == -1 || s->height < a->shelves[best].height) best = i;
+    }
+    if (best == -1) {
+        // A new shelf under the last one on some page, or on a new page
+        if (!atlas_reserve((void**)&a->shelves, &a->shelf_cap, sizeof(AtlasShelf), a->shelf_count + 1)) return 0;
+        int page = 0;
+        while (page < a->page_count && a->page_bottom[page] + height > a->page_height) page++;
+        if (page == a->page_count) {
+            if (a->page_count == a->max_pages) return 0;
+            a->page_count++;
+        }
+        best = a->shelf_count++;
+        a->shelves[best].page = page;
+        a->shelves[best].y = a->page_bottom[page];
+        a->shelves[best].height = height;
+        a->shelves[best].x = 0;
+        a->page_bottom[page] += height;
+    }
+    AtlasShelf* s = &a->shelves[best];
+    g->page = s->page;
+    g->x = s->x;
+    g->y = s->y;
+    g->slot_width = width;
+    g->slot_height = s->height;
+    s->x += width;
+    return 1;
+}
+
+// Drops the least recently used glyph and frees its rect
+static inline void atlas_evict(GlyphAtlas* a) {
+    int victim = a->used_last;
+    AtlasGlyph* e = &a->glyphs[victim];
+    atlas_unlink(a, victim);
+    atlas_index_remove(a, e->codepoint);
+    a->live--;
+    a->generation++;
+    a->evictions++;
+
+    int page = e->page;
+    if (e->slot_width == 0) {
+        // An empty glyph held no room
+    } else if (--a->page_glyphs[page] == 0) {
+        // The page is empty: forget its shelves and holes
+        int n = 0;
+        for (int i = 0; i < a->shelf_count; i++) {
+            if (a->shelves[i].page != page) a->shelves[n++] = a->shelves[i];
+        }
+        a->shelf_count = n;
+        n = 0;
+        for (int i = 0; i < a->hole_count; i++) {
+            if (a->holes[i].page != page) a->holes[n++] = a->holes[i];
+        }
+        a->hole_count = n;
+        a->page_bottom[page] = 0;
+    } else if (atlas_reserve((void**)&a->holes, &a->hole_cap, sizeof(AtlasHole), a->hole_count + 1)) {
+        AtlasHole* h = &a->holes[a->hole_count++];
+        h->page = page;
+        h->x = e->x;
+        h->y = e->y;
+        h->width = e->slot_width;
+        h->height = e->slot_height;
+    }
+
+    e->next = a->free_glyph;
+    a->free_glyph = victim;
+}
+
+// --- Lookups ---
+
+// The codepoint's glyph, now the most recently used; NULL if not loaded
+static inline const AtlasGlyph* glyph_atlas_find(GlyphAtlas* a, unsigned int codepoint) {
+    int g = a->slots[atlas_slot_of(a, codepoint)] - 1;
+    if (g < 0) return NULL;
+    if (a->used_first != g) {
+        atlas_unlink(a, g);
+        atlas_push_front(a, g);
+    }
+    return &a->glyphs[g];
+}
+
+// Makes room for a new width x height glyph, evicting the least recently
+// used ones until it fits. An empty glyph takes no room. Returns NULL if
+// it is larger than a page or out of memory. The pointer is valid until
+// the next insert.
+static inline const AtlasGlyph* glyph_atlas_insert(GlyphAtlas* a, unsigned int codepoint, int width, int height, int advance) {
+    int slot_width = width + GLYPH_ATLAS_PADDING, slot_height = height + GLYPH_ATLAS_PADDING;
+    if (slot_width > a->page_width || slot_height > a->page_height) return NULL;
+    if (glyph_atlas_find(a, codepoint)) return NULL;
+
+    // Everything that can fail to allocate comes before taking any room
+    if (!atlas_index_reserve(a)) return NULL;
+    if (a->free_glyph == -1 && !atlas_reserve((void**)&a->glyphs, &a->glyph_cap, sizeof(AtlasGlyph), a->glyph_count + 1)) return NULL;
+
+    AtlasGlyph placed = { 0 };
+    int empty = width <= 0 || height <= 0;
+    if (!empty) {
+        while (!atlas_place(a, slot_width, slot_height, &placed)) {
+            if (a->used_last == -1) return NULL;
+            atlas_evict(a);
+        }
+        a->page_glyphs[placed.page]++;
+    }
+
+    int g = a->free_glyph;
+    if (g != -1) a->free_glyph = a->glyphs[g].next;
+    else g = a->glyph_count++;
+    AtlasGlyph* e = &a->glyphs[g];
+    *e = placed;
+    e->codepoint = codepoint;
+    e->width = empty ? 0 : width;
+    e->height = empty ? 0 : height;
+    e->advance = advance;
+    a->slots[atlas_slot_of(a, codepoint)] = g + 1;
+    a->live++;
+    atlas_push_front(a, g);
+    return e;
+}
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef MODEL_STORE_H
+#define MODEL_STORE_H
+
+// The model's shapes, variables and arrays, keyed by label (2.model.c).
+//
+// Each kind lives in a dense array that grows by doubling, so the view
+// walks shapes[0..count) with no gaps, and an open-addressing hash index
+// maps a label to its position, so applying a message costs O(1) instead
+// of a scan. Pointers into a store are valid until the next insert, which
+// may move the array.
+//
+// CLEAR_SHAPES empties a store in O(1) and keeps its memory: the count
+// drops to zero and the index moves on to a new generation, which leaves
+// every slot stamped with the old one empty. Entries are never removed one
+// at a time, so the index needs no tombstones.
+//
+// No GL and no I/O, so test/store_check.c drives it headlessly.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Enhanced shape structure with more properties
+typedef struct {
+    int id;
+    char type[32]; // Increased size for more descriptive types
+    float x, y, z; // 3D coordinates
+    float width, height, depth; // Separate dimensions instead of single size
+    float color[4]; // RGBA
+    char label[64]; // Label for identification
+    int active;     // Whether this shape is currently active
+} Shape;
+
+// For storing additional variables from modules
+typedef struct {
+    char label[64];
+    int type;  // 1=int, 2=float, 3=string
+    union {
+        int int_val;
+        float float_val;
+        char string_val[256];
+    } value;
+    int active;  // Whether this variable is currently active
+} ModelVariable;
+
+typedef struct {
+    char label[64];
+    int type;  // 1=int array, 2=float array
+    int count;
+    union {
+        int* int_array;
+        float* float_array;
+    } data;
+    int active;  // Whether this array is currently active
+} ModelArray;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t generation; // taken only if it matches the index's
+    int at;              // position in the dense array
+} LabelSlot;
+
+typedef struct {
+    LabelSlot* slots;
+    uint32_t mask;       // slot count - 1, a power of two
+    uint32_t generation; // starts at 1; calloc'd slots are 0, so empty
+    int used;
+} LabelIndex;
+
+typedef struct { Shape* items; int count, capacity; LabelIndex index; } ShapeStore;
+typedef struct { ModelVariable* items; int count, capacity; LabelIndex index; } VariableStore;
+typedef struct { ModelArray* items; int count, capacity; LabelIndex index; } ArrayStore;
+
+#define LABEL_INDEX_MIN_SLOTS 64
+#define STORE_MIN_CAPACITY 64
+
+// FNV-1a
+static inline uint32_t label_hash(const char* s) {
+    uint32_t h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+// Position of label in the dense array whose first label is at labels,
+// stride bytes apart; -1 if absent
+static inline int label_index_find(const LabelIndex* ix, const char* label, uint32_t h, const char* labels, size_t stride) {
+    if (!ix->slots) return -1;
+    for (uint32_t i = h & ix->mask;; i = (i + 1) & ix->mask) {
+        const LabelSlot* s = &ix->slots[i];
+        if (s->generation != ix->generation) return -1;
+        if (s->hash == h && strcmp(labels + (size_t)s->at * stride, label) == 0) return s->at;
+    }
+}
+
+static inline void label_index_put(LabelSlot* slots, uint32_t mask, uint32_t generation, uint32_t h, int at) {
+    uint32_t i = h & mask;
+    while (slots[i].generation == generation) i = (i + 1) & mask;
+    slots[i].hash = h;
+    slots[i].generation = generation;
+    slots[i].at = at;
+}
+
+// Records a label known to be absent, growing to stay at most half full.
+// Returns 0 if out of memory.
+static inline int label_index_add(LabelIndex* ix, uint32_t h, int at) {
+    if (!ix->slots || (uint32_t)(ix->used + 1) * 2 > ix->mask + 1) {
+        uint32_t n = ix->slots ? (ix->mask + 1) * 2 : LABEL_INDEX_MIN_SLOTS;
+        LabelSlot* slots = calloc(n, sizeof(LabelSlot));
+        if (!slots) return 0;
+        if (ix->slots) {
+            for (uint32_t i = 0; i <= ix->mask; i++) {
+                if (ix->slots[i].generation == ix->generation) label_index_put(slots, n - 1, 1, ix->slots[i].hash, ix->slots[i].at);
+            }
+            free(ix->slots);
+        }
+        ix->slots = slots;
+        ix->mask = n - 1;
+        ix->generation = 1;
+    }
+    label_index_put(ix->slots, ix->mask, ix->generation, h, at);
+    ix->used++;
+    return 1;
+}
+
+static inline void label_index_clear(LabelIndex* ix) {
+    ix->used = 0;
+    if (!ix->slots) return;
+    // Only after 2^32 clears does a stale stamp come round again
+    if (++ix->generation == 0) {
+        memset(ix->slots, 0, (size_t)(ix->mask + 1) * sizeof(LabelSlot));
+        ix->generation = 1;
+    }
+}
+
+static inline void label_index_free(LabelIndex* ix) {
+    free(ix->slots);
+    memset(ix, 0, sizeof(*ix));
+}
+
+// The shared part of the typed stores below: the element with this label,
+// or a new zeroed one at the end with the label copied in. An empty label
+// is never indexed, so every "" is a new element. NULL if out of memory.
+static inline void* store_upsert(void** items, int* count, int* capacity, LabelIndex* ix, size_t size, size_t label_offset,
+                                 const char* label, int* created) {
+    char* base = *items;
+    uint32_t h = 0;
+    if (label[0]) {
+        h = label_hash(label);
+        int at = label_index_find(ix, label, h, base + label_offset, size);
+        if (at >= 0) {
+            *created = 0;
+            return base + (size_t)at * size;
+        }
+    }
+    if (*count == *capacity) {
+        int n = *capacity ? *capacity * 2 : STORE_MIN_CAPACITY;
+        char* grown = realloc(base, (size_t)n * size);
+        if (!grown) return NULL;
+        *items = base = grown;
+        *capacity = n;
+    }
+    if (label[0] && !label_index_add(ix, h, *count)) return NULL;
+    char* item = base + (size_t)(*count)++ * size;
+    memset(item, 0, size);
+    strcpy(item + label_offset, label);
+    *created = 1;
+    return item;
+}
+
+static inline void* store_find(const void* items, const LabelIndex* ix, size_t size, size_t label_offset, const char* label) {
+    if (!label[0]) return NULL;
+    int at = label_index_find(ix, label, label_hash(label), (const char*)items + label_offset, size);
+    return at < 0 ? NULL : (char*)items + (size_t)at * size;
+}
+
+// --- Shapes ---
+
+// The shape with this label, or a new one with only label, id and active
+// set; id is its position
+static inline Shape* shape_store_upsert(ShapeStore* s, const char* label) {
+    int created;
+    Shape* shape = store_upsert((void**)&s->items, &s->count, &s->capacity, &s->index, sizeof(Shape), offsetof(Shape, label), label, &created);
+    if (shape && created) {
+        shape->id = s->count - 1;
+        shape->active = 1;
+    }
+    return shape;
+}
+
+static inline Shape* shape_store_find(const ShapeStore* s, const char* label) {
+    return store_find(s->items, &s->index, sizeof(Shape), offsetof(Shape, label), label);
+}
+
+// CLEAR_SHAPES: every shape goes, the memory stays
+static inline void shape_store_clear(ShapeStore* s) {
+    s->count = 0;
+    label_index_clear(&s->index);
+}
+
+static inline void shape_store_free(ShapeStore* s) {
+    free(s->items);
+    label_index_free(&s->index);
+    memset(s, 0, sizeof(*s));
+}
+
+// --- Variables ---
+
+// The variable with this label, keeping its value, or a new active one
+static inline ModelVariable* variable_store_upsert(VariableStore* s, const char* label) {
+    int created;
+    ModelVariable* var = store_upsert((void**)&s->items, &s->count, &s->capacity, &s->index, sizeof(ModelVariable),
+                                      offsetof(ModelVariable, label), label, &created);
+    if (var) var->active = 1;
+    return var;
+}
+
+static inline ModelVariable* variable_store_find(const VariableStore* s, const char* label) {
+    return store_find(s->items, &s->index, sizeof(ModelVariable), offsetof(ModelVariable, label), label);
+}
+
+static inline void variable_store_free(VariableStore* s) {
+    free(s->items);
+    label_index_free(&s->index);
+    memset(s, 0, sizeof(*s));
+}
+
+// --- Arrays ---
+
+// The array with this label with its old data freed, or a new one; either
+// way active and empty
+static inline ModelArray* array_store_upsert(ArrayStore* s, const char* label) {
+    int created;
+    ModelArray* arr = store_upsert((void**)&s->items, &s->count, &s->capacity, &s->index, sizeof(ModelArray),
+                                   offsetof(ModelArray, label), label, &created);
+    if (!arr) return NULL;
+    free(arr->data.int_array);
+    arr->data.int_array = NULL;
+    arr->count = 0;
+    arr->active = 1;
+    return arr;
+}
+
+static inline ModelArray* array_store_find(const ArrayStore* s, const char* label) {
+    return store_find(s->items, &s->index, sizeof(ModelArray), offsetof(ModelArray, label), label);
+}
+
+static inline void array_store_free(ArrayStore* s) {
+    for (int i = 0; i < s->count; i++) free(s->items[i].data.int_array);
+    free(s->items);
+    label_index_free(&s->index);
+    memset(s, 0, sizeof(*s));
+}
+
+#endif
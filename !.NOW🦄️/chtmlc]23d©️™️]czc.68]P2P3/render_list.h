@@ -0,0 +1,610 @@
+#ifndef RENDER_LIST_H
+#define RENDER_LIST_H
+
+// Retained render list for the C-HTML view (3.view.c).
+//
+// Each element compiles into commands: runs of vertices (plain quads,
+// border lines, the checkbox tick's wide lines, textured emoji quads),
+// bitmap text runs and a slot for canvas content. The element keeps them
+// until its signature changes. The signature is a hash of everything it
+// draws from: its own fields, the lines it shows, its parents, the window
+// height and the cursor blink phase. So a frame where nothing changed
+// rebuilds nothing, and a keystroke rebuilds one element.
+//
+// After a rebuild, every element's commands merge into one vertex array
+// and a short list of draw items. Commands sort by (layer, kind, texture),
+// and consecutive vertex runs with the same key become one glDrawArrays
+// call. The layer is the element's depth in the tree, so parents draw
+// before children; an open menu's items are on a layer above everything.
+// Within a layer, quads draw first, then lines, canvases, emoji and text.
+// Where siblings overlap, a later sibling's quad no longer covers an
+// earlier sibling's text as it did when every element drew in turn.
+//
+// Emoji come from the view's glyph atlas. When it evicts a glyph, its
+// generation moves on, and every element showing emoji is rebuilt in case
+// a quad points at a rect that now holds another glyph.
+//
+// No GL here: the view supplies text widths and emoji glyphs through
+// RlContext, so test/render_check.c checks the vertex streams headlessly.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ui_element.h"
+
+// Command kinds, in their draw order within a layer
+enum { RL_QUADS, RL_LINES, RL_WIDE_LINES, RL_CANVAS, RL_GLYPHS, RL_TEXT };
+// GLUT_BITMAP_HELVETICA_18 and _12
+enum { RL_FONT_18, RL_FONT_12 };
+
+#define RL_LAYER_OVERLAY 1000000
+
+typedef struct {
+    float x, y;
+    float u, v;
+    unsigned char rgba[4];
+} RlVertex;
+
+typedef struct {
+    int layer, kind;
+    unsigned int texture;  // RL_GLYPHS
+    int first, count;      // vertices: the element's own, then the list's once merged
+    int element;           // owner; an RL_CANVAS draws it
+    int font;              // RL_TEXT
+    float x, y;            // RL_TEXT raster position, RL_CANVAS origin
+    float color[3];        // RL_TEXT
+    int text;              // RL_TEXT: offset of the string in the owner's text pool
+    int order;             // position before the merge sort, which must be stable
+} RlCommand;
+
+typedef struct {
+    uint64_t signature;
+    int built;
+    RlVertex* verts;
+    int vert_count, vert_cap;
+    RlCommand* cmds;
+    int cmd_count, cmd_cap;
+    char* text;
+    int text_len, text_cap;
+    int glyphs;                     // emoji quads among the vertices
+    unsigned int glyph_generation;  // the atlas's when built
+} RlElement;
+
+typedef struct {
+    unsigned int texture;  // 0: nothing to draw, only the advance
+    float u0, v0, u1, v1;  // its rect in the texture, top row at v0
+    float width, height;   // on screen
+    int advance;
+} RlGlyph;
+
+typedef struct {
+    int window_height;
+    int blink_on;  // the text cursor's phase
+    char (*dir_entries)[256];
+    int dir_entry_count;
+    // Pixel width of s[0..n) in a font
+    int (*text_width)(int font, const char* s, int n);
+    // The emoji's glyph; 0 if it can't be loaded
+    int (*glyph)(unsigned int codepoint, RlGlyph* out);
+    // Moves on when a glyph is evicted; NULL if glyphs never move
+    const unsigned int* glyph_generation;
+} RlContext;
+
+typedef struct {
+    RlElement* elements;
+    int element_count, element_cap;
+    RlVertex* verts;
+    int vert_count, vert_cap;
+    RlCommand* items;  // the merged draw list
+    int item_count, item_cap;
+    RlCommand* scratch;
+    int scratch_cap;
+    int rebuilt;       // elements rebuilt by the last update
+} RenderList;
+
+static inline int rl_reserve(void** p, int* cap, size_t size, int need) {
+    if (need <= *cap) return 1;
+    int n = *cap ? *cap : 16;
+    while (n < need) n *= 2;
+    void* grown = realloc(*p, (size_t)n * size);
+    if (!grown) return 0;
+    *p = grown;
+    *cap = n;
+    return 1;
+}
+
+// --- Text helpers, shared with the view ---
+
+// Function to decode UTF-8 character to Unicode codepoint
+static inline int decode_utf8(const unsigned char* str, unsigned int* codepoint) {
+    if (str[0] < 0x80) {
+        *codepoint = str[0];
+        return 1;
+    }
+    if ((str[0] & 0xE0) == 0xC0) {
+        if ((str[1] & 0xC0) == 0x80) {
+            *codepoint = ((str[0] & 0x1F) << 6) | (str[1] & 0x3F);
+            return 2;
+        }
+    }
+    if ((str[0] & 0xF0) == 0xE0) {
+        if ((str[1] & 0xC0) == 0x80 && (str[2] & 0xC0) == 0x80) {
+            *codepoint = ((str[0] & 0x0F) << 12) | ((str[1] & 0x3F) << 6) | (str[2] & 0x3F);
+            return 3;
+        }
+    }
+    if ((str[0] & 0xF8) == 0xF0) {
+        if ((str[1] & 0xC0) == 0x80 && (str[2] & 0xC0) == 0x80 && (str[3] & 0xC0) == 0x80) {
+            *codepoint = ((str[0] & 0x07) << 18) | ((str[1] & 0x3F) << 12) | ((str[2] & 0x3F) << 6) | (str[3] & 0x3F);
+            return 4;
+        }
+    }
+    *codepoint = '?';
+    return 1;
+}
+
+static inline int is_emoji_codepoint(unsigned int codepoint) {
+    return codepoint >= 0x1F000 ||                          // Emoji range typically starts around U+1F000
+           (codepoint >= 0x2600 && codepoint <= 0x26FF) ||  // Misc symbols
+           (codepoint >= 0x2700 && codepoint <= 0x27BF);    // Dingbats
+}
+
+// Function to check if a string contains emoji characters
+static inline int contains_emoji(const char* str) {
+    const unsigned char* s = (const unsigned char*)str;
+    while (*s) {
+        unsigned int codepoint;
+        int bytes = decode_utf8(s, &codepoint);
+        if (is_emoji_codepoint(codepoint)) return 1;
+        s += bytes;
+    }
+    return 0;
+}
+
+// --- Building one element ---
+
+// n new vertices for a run, continuing the element's last run if it has
+// the same key
+static inline RlVertex* rl_vertices(RlElement* e, int layer, int kind, unsigned int texture, int n) {
+    if (!rl_reserve((void**)&e->verts, &e->vert_cap, sizeof(RlVertex), e->vert_count + n)) return NULL;
+    RlCommand* last = e->cmd_count ? &e->cmds[e->cmd_count - 1] : NULL;
+    if (!last || last->layer != layer || last->kind != kind || last->texture != texture) {
+        if (!rl_reserve((void**)&e->cmds, &e->cmd_cap, sizeof(RlCommand), e->cmd_count + 1)) return NULL;
+        last = &e->cmds[e->cmd_count++];
+        memset(last, 0, sizeof(*last));
+        last->layer = layer;
+        last->kind = kind;
+        last->texture = texture;
+        last->first = e->vert_count;
+    }
+    last->count += n;
+    RlVertex* v = e->verts + e->vert_count;
+    e->vert_count += n;
+    return v;
+}
+
+static inline void rl_vertex(RlVertex* v, float x, float y, float u, float t, const float color[3]) {
+    v->x = x;
+    v->y = y;
+    v->u = u;
+    v->v = t;
+    for (int i = 0; i < 3; i++) v->rgba[i] = (unsigned char)(color[i] * 255.0f + 0.5f);
+    v->rgba[3] = 255;
+}
+
+// A quad from (x0, y0) to (x1, y1), corners in the order draw_element used
+static inline void rl_box(RlElement* e, int layer, int x0, int y0, int x1, int y1, const float color[3]) {
+    RlVertex* v = rl_vertices(e, layer, RL_QUADS, 0, 4);
+    if (!v) return;
+    rl_vertex(v++, x0, y0, 0, 0, color);
+    rl_vertex(v++, x1, y0, 0, 0, color);
+    rl_vertex(v++, x1, y1, 0, 0, color);
+    rl_vertex(v, x0, y1, 0, 0, color);
+}
+
+// A GL_LINE_LOOP rectangle as four GL_LINES segments, so borders batch
+static inline void rl_outline(RlElement* e, int layer, int x0, int y0, int x1, int y1, const float color[3]) {
+    const int corners[5][2] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 }, { x0, y0 } };
+    RlVertex* v = rl_vertices(e, layer, RL_LINES, 0, 8);
+    if (!v) return;
+    for (int i = 0; i < 4; i++) {
+        rl_vertex(v++, corners[i][0], corners[i][1], 0, 0, color);
+        rl_vertex(v++, corners[i + 1][0], corners[i + 1][1], 0, 0, color);
+    }
+}
+
+static inline RlCommand* rl_command(RlElement* e, int layer, int kind) {
+    if (!rl_reserve((void**)&e->cmds, &e->cmd_cap, sizeof(RlCommand), e->cmd_count + 1)) return NULL;
+    RlCommand* c = &e->cmds[e->cmd_count++];
+    memset(c, 0, sizeof(*c));
+    c->layer = layer;
+    c->kind = kind;
+    return c;
+}
+
+// Bitmap text s[0..n) at a raster position
+static inline void rl_text(RlElement* e, int layer, int font, float x, float y, const float color[3], const char* s, int n) {
+    if (!rl_reserve((void**)&e->text, &e->text_cap, 1, e->text_len + n + 1)) return;
+    RlCommand* c = rl_command(e, layer, RL_TEXT);
+    if (!c) return;
+    c->font = font;
+    c->x = x;
+    c->y = y;
+    memcpy(c->color, color, sizeof(c->color));
+    c->text = e->text_len;
+    memcpy(e->text + e->text_len, s, n);
+    e->text[e->text_len + n] = '\0';
+    e->text_len += n + 1;
+}
+
+// Emoji as textured quads and the runs between them as bitmap text, laid
+// out left to right from (x, y) like render_text_with_emojis did
+static inline void rl_text_with_emojis(RlElement* e, const RlContext* ctx, int layer, const char* str, float x, float y, const float color[3]) {
+    const unsigned char* s = (const unsigned char*)str;
+    float current_x = x;
+    while (*s) {
+        unsigned int codepoint;
+        int bytes = decode_utf8(s, &codepoint);
+        if (is_emoji_codepoint(codepoint)) {
+            RlGlyph g;
+            if (ctx->glyph && ctx->glyph(codepoint, &g)) {
+                if (g.texture) {
+                    RlVertex* v = rl_vertices(e, layer, RL_GLYPHS, g.texture, 4);
+                    if (v) {
+                        rl_vertex(v++, current_x, y, g.u0, g.v1, color);
+                        rl_vertex(v++, current_x + g.width, y, g.u1, g.v1, color);
+                        rl_vertex(v++, current_x + g.width, y + g.height, g.u1, g.v0, color);
+                        rl_vertex(v, current_x, y + g.height, g.u0, g.v0, color);
+                        e->glyphs++;
+                    }
+                }
+                current_x += g.advance;
+            }
+            s += bytes;
+        } else {
+            // Everything up to the next emoji is one run
+            const unsigned char* next = s + bytes;
+            while (*next) {
+                unsigned int next_codepoint;
+                int next_bytes = decode_utf8(next, &next_codepoint);
+                if (is_emoji_codepoint(next_codepoint)) break;
+                next += next_bytes;
+            }
+            rl_text(e, layer, RL_FONT_18, current_x, y, color, (const char*)s, next - s);
+            current_x += ctx->text_width(RL_FONT_18, (const char*)s, next - s);
+            s = next;
+        }
+    }
+}
+
+// The submenu of an open menu, on top of everything: a background and a
+// row per menuitem child, placed below the menu or above it if it would
+// leave the window
+static inline void rl_build_submenu(RlElement* e, const UIElement* elements, int count, int i, const RlContext* ctx) {
+    static const float yellow[3] = { 1.0f, 1.0f, 0.0f }, item_blue[3] = { 0.7f, 0.7f, 0.9f }, black[3] = { 0.0f, 0.0f, 0.0f };
+    const UIElement* menu = &elements[i];
+    int parent_x = 0, parent_y = 0;
+    for (int p = menu->parent, hops = 0; p != -1 && hops < count; p = elements[p].parent, hops++) {
+        parent_x += elements[p].x;
+        parent_y += elements[p].y;
+    }
+    int abs_x = parent_x + menu->x;
+    int abs_y = ctx->window_height - (parent_y + menu->y + menu->height);
+
+    int submenu_start_y = abs_y + menu->height;
+    int submenu_end_y = abs_y + menu->height + 20 * menu->menu_items_count;
+    if (submenu_end_y > ctx->window_height) {
+        submenu_start_y = abs_y - 20 * menu->menu_items_count;
+        if (submenu_start_y < 0) submenu_start_y = 0;
+    }
+    rl_box(e, RL_LAYER_OVERLAY, abs_x, submenu_start_y, abs_x + menu->width, submenu_start_y + 20 * menu->menu_items_count, yellow);
+
+    int item_position = 0;
+    for (int j = 0; j < count; j++) {
+        if (elements[j].parent != i || strcmp(elements[j].type, "menuitem") != 0) continue;
+        int item_y = submenu_start_y + item_position++ * 20;
+        rl_box(e, RL_LAYER_OVERLAY, abs_x, item_y, abs_x + elements[j].width, item_y + 20, item_blue);
+        rl_text(e, RL_LAYER_OVERLAY, RL_FONT_12, abs_x + 5, item_y + 15, black, elements[j].label, strlen(elements[j].label));
+    }
+}
+
+// Compiles element i into e, replacing what it held
+static inline void rl_build_element(RlElement* e, const UIElement* elements, int count, int i, int layer, const RlContext* ctx) {
+    static const float white[3] = { 1.0f, 1.0f, 1.0f }, black[3] = { 0.0f, 0.0f, 0.0f }, yellow[3] = { 1.0f, 1.0f, 0.0f };
+    static const float border_gray[3] = { 0.5f, 0.5f, 0.5f }, light_gray[3] = { 0.8f, 0.8f, 0.8f };
+    static const float dark_gray[3] = { 0.2f, 0.2f, 0.2f }, field_gray[3] = { 0.1f, 0.1f, 0.1f }, track_gray[3] = { 0.3f, 0.3f, 0.3f };
+    const UIElement* el = &elements[i];
+    e->vert_count = e->cmd_count = e->text_len = e->glyphs = 0;
+
+    int parent_x = 0;
+    int parent_y = 0;
+    if (el->parent != -1) {
+        parent_x = elements[el->parent].x;
+        parent_y = elements[el->parent].y;
+    }
+    // Real-world y (0 at the top) to OpenGL y (0 at the bottom)
+    int abs_x = parent_x + el->x;
+    int abs_y = ctx->window_height - (parent_y + el->y + el->height);
+    int x1 = abs_x + el->width, y1 = abs_y + el->height;
+
+    if (strcmp(el->type, "canvas") == 0) {
+        rl_outline(e, layer, abs_x, abs_y, x1, y1, border_gray);
+        RlCommand* c = rl_command(e, layer, RL_CANVAS);
+        if (c) {
+            c->element = i;
+            c->x = abs_x;
+            c->y = abs_y;
+        }
+    } else if (strcmp(el->type, "menu") == 0) {
+        // A context menu's bar only shows while it is open
+        if (strcmp(el->label, "Generic Context Menu") != 0 || el->is_open) {
+            rl_box(e, layer, abs_x, abs_y, x1, y1, el->color);
+            rl_text(e, layer, RL_FONT_18, abs_x + 5, abs_y + (el->height / 2) - 6, white, el->label, strlen(el->label));
+        }
+        if (el->is_open) rl_build_submenu(e, elements, count, i, ctx);
+    } else if (strcmp(el->type, "menuitem") == 0) {
+        // Items of an open menu are part of its submenu instead
+        int p = el->parent;
+        if (!(p != -1 && strcmp(elements[p].type, "menu") == 0 && elements[p].is_open)) {
+            rl_box(e, layer, abs_x, abs_y, x1, y1, el->color);
+            rl_text(e, layer, RL_FONT_12, abs_x + 5, abs_y + 15, black, el->label, strlen(el->label));
+        }
+    } else if (strcmp(el->type, "dirlist") == 0) {
+        rl_box(e, layer, abs_x, abs_y, x1, y1, dark_gray);
+        const char* header_text = "dir element list:";
+        rl_text(e, layer, RL_FONT_18, abs_x + 5, abs_y + 15, yellow, header_text, strlen(header_text));
+        for (int k = 0; k < ctx->dir_entry_count; k++) {
+            int text_y = abs_y + 40 + (k * 20);
+            if (text_y + 20 < abs_y + el->height) {
+                rl_text(e, layer, RL_FONT_18, abs_x + 10, text_y, white, ctx->dir_entries[k], strlen(ctx->dir_entries[k]));
+            }
+        }
+    } else if (strcmp(el->type, "textfield") == 0 || strcmp(el->type, "textarea") == 0) {
+        rl_box(e, layer, abs_x, abs_y, x1, y1, field_gray);
+        rl_outline(e, layer, abs_x, abs_y, x1, y1, light_gray);
+    } else if (strcmp(el->type, "header") == 0 || strcmp(el->type, "button") == 0 || strcmp(el->type, "panel") == 0 ||
+               strcmp(el->type, "checkbox") == 0 || strcmp(el->type, "slider") == 0) {
+        const float* fill = el->color;
+        if (strcmp(el->type, "checkbox") == 0) fill = light_gray;
+        else if (strcmp(el->type, "slider") == 0) fill = track_gray;
+        rl_box(e, layer, abs_x, abs_y, x1, y1, fill);
+
+        if (strcmp(el->type, "checkbox") == 0 && el->is_checked) {
+            // An upright V, two segments drawn 2 pixels wide
+            RlVertex* v = rl_vertices(e, layer, RL_WIDE_LINES, 0, 4);
+            if (v) {
+                rl_vertex(v++, (int)(abs_x + el->width * 0.2), (int)(abs_y + el->height * 0.8), 0, 0, black);
+                rl_vertex(v++, (int)(abs_x + el->width * 0.4), (int)(abs_y + el->height * 0.2), 0, 0, black);
+                rl_vertex(v++, (int)(abs_x + el->width * 0.4), (int)(abs_y + el->height * 0.2), 0, 0, black);
+                rl_vertex(v, (int)(abs_x + el->width * 0.8), (int)(abs_y + el->height * 0.8), 0, 0, black);
+            }
+        } else if (strcmp(el->type, "slider") == 0) {
+            int range = el->slider_max - el->slider_min;
+            float normalized = range ? (float)(el->slider_value - el->slider_min) / range : 0.0f;
+            if (el->height > el->width) {
+                // Vertical: a centered track and a thumb as wide as the slider
+                rl_box(e, layer, abs_x + el->width / 2 - 3, abs_y, abs_x + el->width / 2 + 3, y1, track_gray);
+                float thumb_pos_y = abs_y + normalized * (el->height - 10);
+                rl_box(e, layer, abs_x, (int)thumb_pos_y, x1, (int)(thumb_pos_y + 10), light_gray);
+            } else {
+                float thumb_pos_x = abs_x + normalized * (el->width - 10);
+                rl_box(e, layer, (int)thumb_pos_x, abs_y, (int)(thumb_pos_x + 10), y1, light_gray);
+            }
+            char value_str[16];
+            int n = snprintf(value_str, sizeof(value_str), "%d", el->slider_value);
+            rl_text(e, layer, RL_FONT_12, abs_x + el->width + 5, abs_y + el->height / 2 - 5, white, value_str, n);
+        }
+    }
+
+    if (strcmp(el->type, "text") == 0 || strcmp(el->type, "button") == 0 || strcmp(el->type, "checkbox") == 0) {
+        int text_offset_x = 5;
+        int text_offset_y = 15;
+        if (strcmp(el->type, "checkbox") == 0) {
+            text_offset_x = el->width + 5; // Label next to checkbox
+            text_offset_y = el->height / 2 - 5; // Center label vertically
+        }
+        if (contains_emoji(el->label)) {
+            // Emoji sit on the baseline, a little lower than bitmap text
+            rl_text_with_emojis(e, ctx, layer, el->label, abs_x + text_offset_x, abs_y + text_offset_y + 15, white);
+        } else {
+            rl_text(e, layer, RL_FONT_18, abs_x + text_offset_x, abs_y + text_offset_y, white, el->label, strlen(el->label));
+        }
+    } else if (strcmp(el->type, "textfield") == 0 || strcmp(el->type, "textarea") == 0) {
+        int start_y = abs_y + 15;
+        // Plain lines took the border's gray as their raster color, until
+        // an emoji line left the color white
+        float line_color[3] = { 0.8f, 0.8f, 0.8f };
+        for (int line = 0; line < el->num_lines && line < el->text_lines; line++) {
+            if (start_y + (line * 20) >= abs_y + el->height) break; // Don't draw outside bounds
+            const char* text = el->text_content[line];
+            if (contains_emoji(text)) {
+                rl_text_with_emojis(e, ctx, layer, text, abs_x + 5, start_y + (line * 20) + 15, white);
+                memcpy(line_color, white, sizeof(line_color));
+            } else {
+                rl_text(e, layer, RL_FONT_18, abs_x + 5, start_y + (line * 20), line_color, text, strlen(text));
+            }
+        }
+
+        if (el->is_active && ctx->blink_on && el->cursor_y >= 0 && el->cursor_y < el->text_lines) {
+            const char* text = el->text_content[el->cursor_y];
+            int n = (int)strlen(text);
+            int text_width = ctx->text_width(RL_FONT_18, text, el->cursor_x < n ? el->cursor_x : n);
+            int cy = start_y + (el->cursor_y * 20);
+            rl_box(e, layer, abs_x + 5 + text_width, cy - 15, abs_x + 5 + text_width + 2, cy + 5, white);
+        }
+    }
+}
+
+// --- Signatures ---
+
+static inline uint64_t rl_mix(uint64_t h, const void* data, size_t n) {
+    const unsigned char* p = data;
+    while (n >= 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        h = (h ^ k) * 0x100000001b3ULL;
+        h ^= h >> 29;
+        p += 8;
+        n -= 8;
+    }
+    while (n--) h = (h ^ *p++) * 0x100000001b3ULL;
+    return h;
+}
+
+static inline uint64_t rl_mix_int(uint64_t h, int v) { return rl_mix(h, &v, sizeof(v)); }
+
+// Everything element i's commands depend on
+static inline uint64_t rl_signature(const UIElement* elements, int count, int i, int layer, const RlContext* ctx) {
+    const UIElement* el = &elements[i];
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = rl_mix_int(h, layer);
+    h = rl_mix_int(h, ctx->window_height);
+    // The fixed fields either side of the text line pointer; not the
+    // clipboard or the directory fields, which the element never draws
+    h = rl_mix(h, el, offsetof(UIElement, text_content));
+    h = rl_mix(h, &el->num_lines, offsetof(UIElement, clipboard) - offsetof(UIElement, num_lines));
+
+    int is_text = strcmp(el->type, "textfield") == 0 || strcmp(el->type, "textarea") == 0;
+    if (is_text) {
+        for (int line = 0; line < el->num_lines && line < el->text_lines && 15 + line * 20 < el->height; line++) {
+            h = rl_mix(h, el->text_content[line], strlen(el->text_content[line]) + 1);
+        }
+        if (el->is_active) {
+            h = rl_mix_int(h, ctx->blink_on);
+            if (el->cursor_y >= 0 && el->cursor_y < el->text_lines) h = rl_mix(h, el->text_content[el->cursor_y], strlen(el->text_content[el->cursor_y]) + 1);
+        }
+    }
+    for (int p = el->parent, hops = 0; p != -1 && hops < count; p = elements[p].parent, hops++) {
+        h = rl_mix_int(h, elements[p].x);
+        h = rl_mix_int(h, elements[p].y);
+        h = rl_mix_int(h, elements[p].is_open);
+    }
+    if (strcmp(el->type, "dirlist") == 0) {
+        h = rl_mix_int(h, ctx->dir_entry_count);
+        for (int k = 0; k < ctx->dir_entry_count; k++) h = rl_mix(h, ctx->dir_entries[k], strlen(ctx->dir_entries[k]) + 1);
+    }
+    if (strcmp(el->type, "menu") == 0 && el->is_open) {
+        for (int j = 0; j < count; j++) {
+            if (elements[j].parent != i) continue;
+            h = rl_mix(h, elements[j].type, sizeof(elements[j].type));
+            h = rl_mix(h, elements[j].label, sizeof(elements[j].label));
+            h = rl_mix_int(h, elements[j].width);
+        }
+    }
+    return h;
+}
+
+// --- The list ---
+
+static inline int rl_compare(const void* a, const void* b) {
+    const RlCommand *x = a, *y = b;
+    if (x->layer != y->layer) return x->layer < y->layer ? -1 : 1;
+    if (x->kind != y->kind) return x->kind < y->kind ? -1 : 1;
+    if (x->texture != y->texture) return x->texture < y->texture ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+// Rebuilds the draw list from every element's commands
+static inline int rl_merge(RenderList* rl) {
+    int total = 0, verts = 0;
+    for (int i = 0; i < rl->element_count; i++) {
+        total += rl->elements[i].cmd_count;
+        verts += rl->elements[i].vert_count;
+    }
+    if (!rl_reserve((void**)&rl->scratch, &rl->scratch_cap, sizeof(RlCommand), total) ||
+        !rl_reserve((void**)&rl->items, &rl->item_cap, sizeof(RlCommand), total) ||
+        !rl_reserve((void**)&rl->verts, &rl->vert_cap, sizeof(RlVertex), verts)) {
+        rl->item_count = rl->vert_count = 0;
+        return 0;
+    }
+
+    int n = 0;
+    for (int i = 0; i < rl->element_count; i++) {
+        for (int j = 0; j < rl->elements[i].cmd_count; j++) {
+            rl->scratch[n] = rl->elements[i].cmds[j];
+            rl->scratch[n].element = i;
+            rl->scratch[n].order = n;
+            n++;
+        }
+    }
+    qsort(rl->scratch, n, sizeof(RlCommand), rl_compare);
+
+    rl->item_count = rl->vert_count = 0;
+    for (int k = 0; k < n; k++) {
+        const RlCommand* c = &rl->scratch[k];
+        int has_vertices = c->kind == RL_QUADS || c->kind == RL_LINES || c->kind == RL_WIDE_LINES || c->kind == RL_GLYPHS;
+        if (!has_vertices) {
+            rl->items[rl->item_count++] = *c;
+            continue;
+        }
+        RlCommand* last = rl->item_count ? &rl->items[rl->item_count - 1] : NULL;
+        if (!last || last->layer != c->layer || last->kind != c->kind || last->texture != c->texture) {
+            last = &rl->items[rl->item_count++];
+            *last = *c;
+            last->first = rl->vert_count;
+            last->count = 0;
+        }
+        memcpy(rl->verts + rl->vert_count, rl->elements[c->element].verts + c->first, (size_t)c->count * sizeof(RlVertex));
+        rl->vert_count += c->count;
+        last->count += c->count;
+    }
+    return 1;
+}
+
+// Rebuilds the elements whose signature changed and, if any did, the draw
+// list. Returns how many were rebuilt.
+static inline int render_list_update(RenderList* rl, const UIElement* elements, int count, const RlContext* ctx) {
+    int resized = count != rl->element_count;
+    if (count > rl->element_cap) {
+        int old = rl->element_cap;
+        if (!rl_reserve((void**)&rl->elements, &rl->element_cap, sizeof(RlElement), count)) return 0;
+        memset(rl->elements + old, 0, (size_t)(rl->element_cap - old) * sizeof(RlElement));
+    }
+    for (int i = count; i < rl->element_count; i++) rl->elements[i].built = 0;
+    rl->element_count = count;
+
+    int rebuilt = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        unsigned int generation = ctx->glyph_generation ? *ctx->glyph_generation : 0;
+        for (int i = 0; i < count; i++) {
+            int layer = 0;
+            for (int p = elements[i].parent; p != -1 && layer < count; p = elements[p].parent) layer++;
+            uint64_t signature = rl_signature(elements, count, i, layer, ctx);
+            RlElement* e = &rl->elements[i];
+            int glyphs_moved = e->glyphs && ctx->glyph_generation && e->glyph_generation != *ctx->glyph_generation;
+            if (e->built && e->signature == signature && !glyphs_moved) continue;
+            if (ctx->glyph_generation) e->glyph_generation = *ctx->glyph_generation;
+            rl_build_element(e, elements, count, i, layer, ctx);
+            e->signature = signature;
+            e->built = 1;
+            rebuilt++;
+        }
+        // Loading a glyph may have evicted one that an element built
+        // earlier in this pass shows; a second pass rebuilds those
+        if (!ctx->glyph_generation || *ctx->glyph_generation == generation) break;
+    }
+    if (rebuilt || resized) rl_merge(rl);
+    rl->rebuilt = rebuilt;
+    return rebuilt;
+}
+
+// The string an RL_TEXT item draws
+static inline const char* render_list_text(const RenderList* rl, const RlCommand* c) {
+    return rl->elements[c->element].text + c->text;
+}
+
+static inline void render_list_free(RenderList* rl) {
+    for (int i = 0; i < rl->element_cap; i++) {
+        free(rl->elements[i].verts);
+        free(rl->elements[i].cmds);
+        free(rl->elements[i].text);
+    }
+    free(rl->elements);
+    free(rl->verts);
+    free(rl->items);
+    free(rl->scratch);
+    memset(rl, 0, sizeof(*rl));
+}
+
+#endif
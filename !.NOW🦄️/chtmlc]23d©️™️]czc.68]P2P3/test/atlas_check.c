@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../glyph_atlas.h"
+
+// Checks and times glyph_atlas.h, the emoji atlas behind 3.view.c,
+// without a GL context.
+//
+//   atlas_check test    shelf packing, pages, lookups, least-recently-used
+//                       eviction, holes and page resets, then a long random
+//                       workload checked against a reference model
+//   atlas_check bench   glyph lookups/sec in the atlas and in the old
+//                       linear emoji cache, and with more emoji than fit
+
+static int failures = 0;
+static void check(int ok, const char* what) {
+    printf("%s %s\n", ok ? "✓" : "✗", what);
+    if (!ok) failures++;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Whether a codepoint is loaded, without making it the most recently used
+static int loaded(const GlyphAtlas* a, unsigned int codepoint) {
+    return a->slots[atlas_slot_of(a, codepoint)] != 0;
+}
+
+static int at(const AtlasGlyph* g, int page, int x, int y) {
+    return g && g->page == page && g->x == x && g->y == y;
+}
+
+// Every live glyph inside its page, no two slots overlapping, and the
+// index and the use list both holding exactly the live glyphs
+static int consistent(const GlyphAtlas* a) {
+    int listed = 0, indexed = 0;
+    for (int g = a->used_first, prev = -1; g != -1; prev = g, g = a->glyphs[g].next) {
+        const AtlasGlyph* e = &a->glyphs[g];
+        if (e->prev != prev || !loaded(a, e->codepoint) || a->slots[atlas_slot_of(a, e->codepoint)] - 1 != g) return 0;
+        if (e->page < 0 || e->page >= a->page_count || e->x < 0 || e->y < 0 ||
+            e->x + e->slot_width > a->page_width || e->y + e->slot_height > a->page_height) return 0;
+        if (e->width >= e->slot_width && e->width > 0) return 0;
+        if (++listed > a->live) return 0;
+    }
+    for (uint32_t i = 0; i <= a->mask; i++) indexed += a->slots[i] != 0;
+    if (listed != a->live || indexed != a->live) return 0;
+
+    for (int g = a->used_first; g != -1; g = a->glyphs[g].next) {
+        const AtlasGlyph* p = &a->glyphs[g];
+        if (p->slot_width == 0) continue;
+        for (int h = a->glyphs[g].next; h != -1; h = a->glyphs[h].next) {
+            const AtlasGlyph* q = &a->glyphs[h];
+            if (q->slot_width == 0 || q->page != p->page) continue;
+            if (p->x < q->x + q->slot_width && q->x < p->x + p->slot_width && p->y < q->y + q->slot_height &&
+                q->y < p->y + p->slot_height) return 0;
+        }
+    }
+    return 1;
+}
+
+static int run_test(void) {
+    GlyphAtlas a;
+
+    // 15x15 glyphs take 16x16 with padding: 4 to a shelf, 16 to a page
+    glyph_atlas_init(&a, 64, 64, 2);
+    int ok = 1;
+    for (unsigned int cp = 0; cp < 32; cp++) {
+        const AtlasGlyph* g = glyph_atlas_insert(&a, 0x1F600 + cp, 15, 15, 18);
+        ok &= at(g, cp / 16, cp % 4 * 16, cp % 16 / 4 * 16);
+    }
+    check(ok && a.page_count == 2 && a.live == 32 && a.generation == 0, "shelf packing: rows of 4, then a second page");
+    const AtlasGlyph* g = glyph_atlas_find(&a, 0x1F600 + 21);
+    check(at(g, 1, 16, 16) && g->width == 15 && g->advance == 18 && !glyph_atlas_find(&a, 0x2600), "lookups by codepoint");
+    check(consistent(&a), "no overlaps, and the index and use list agree");
+
+    // Everything but 0x1F601 is used after it, so it goes first
+    for (unsigned int cp = 0; cp < 32; cp++) {
+        if (cp != 1) glyph_atlas_find(&a, 0x1F600 + cp);
+    }
+    g = glyph_atlas_insert(&a, 0x2705, 15, 15, 18);
+    check(at(g, 0, 16, 0) && !loaded(&a, 0x1F601) && a.live == 32 && a.generation == 1 && a.evictions == 1,
+          "a full atlas evicts the least recently used glyph, and the new one takes its place");
+    g = glyph_atlas_insert(&a, 0x2764, 8, 8, 10);
+    check(at(g, 0, 0, 0) && !loaded(&a, 0x1F600) && g->slot_width == 16 && g->width == 8,
+          "a smaller glyph takes an evicted slot whole");
+    check(glyph_atlas_insert(&a, 0x1F680, 64, 10, 18) == NULL && a.live == 32 && a.generation == 2,
+          "a glyph wider than a page is refused without evicting anything");
+    g = glyph_atlas_insert(&a, 0x20, 0, 0, 7);
+    check(g && g->slot_width == 0 && g->advance == 7 && a.live == 33 && a.generation == 2 && glyph_atlas_find(&a, 0x20),
+          "an empty glyph is kept for its advance and takes no room");
+    check(consistent(&a), "still consistent after evictions");
+    glyph_atlas_free(&a);
+
+    // Shelves as tall as the glyph that opened them
+    glyph_atlas_init(&a, 64, 64, 1);
+    const AtlasGlyph *small = glyph_atlas_insert(&a, 1, 10, 10, 0);
+    ok = at(small, 0, 0, 0);
+    ok &= at(glyph_atlas_insert(&a, 2, 20, 20, 0), 0, 0, 11);
+    ok &= at(glyph_atlas_insert(&a, 3, 5, 5, 0), 0, 11, 0);
+    ok &= at(glyph_atlas_insert(&a, 4, 10, 15, 0), 0, 21, 11);
+    ok &= a.shelf_count == 2 && a.page_bottom[0] == 32;
+    check(ok, "each glyph goes on the shelf that wastes the least height");
+
+    // Nothing fits a 40x40 until the whole page is free, which resets it
+    for (unsigned int cp = 10; cp < 22; cp++) glyph_atlas_insert(&a, cp, 10, 10, 0);
+    g = glyph_atlas_insert(&a, 99, 40, 40, 0);
+    check(at(g, 0, 0, 0) && a.live == 1 && a.shelf_count == 1 && a.hole_count == 0 && a.evictions == 16,
+          "an emptied page starts over");
+    glyph_atlas_free(&a);
+
+    // A long random run against a model that stamps each use with a time.
+    // After an insert, the glyphs that went must be the oldest ones.
+    enum { CODEPOINTS = 3000, OPS = 300000 };
+    static long last_use[CODEPOINTS];
+    static int was_loaded[CODEPOINTS];
+    glyph_atlas_init(&a, 128, 128, 3);
+    srand(12345);
+    long clock = 0, evicted = 0;
+    int lru_ok = 1, lookup_ok = 1, layout_ok = 1;
+    for (int op = 0; op < OPS; op++) {
+        // Mostly a small hot set, sometimes anything
+        unsigned int cp = rand() % 4 ? rand() % 60 : rand() % CODEPOINTS;
+        int w = 3 + cp * 7 % 30, h = 3 + cp * 13 % 30;
+        const AtlasGlyph* found = glyph_atlas_find(&a, cp);
+        if (found) {
+            lookup_ok &= was_loaded[cp] && found->codepoint == cp && found->width == w && found->height == h;
+        } else {
+            lookup_ok &= !was_loaded[cp];
+            found = glyph_atlas_insert(&a, cp, w, h, w + 1);
+            lookup_ok &= found && found->width == w;
+            long newest_gone = -1, oldest_kept = -1;
+            for (unsigned int c = 0; c < CODEPOINTS; c++) {
+                if (!was_loaded[c] || c == cp) continue;
+                if (loaded(&a, c)) {
+                    if (oldest_kept == -1 || last_use[c] < oldest_kept) oldest_kept = last_use[c];
+                } else {
+                    was_loaded[c] = 0;
+                    evicted++;
+                    if (last_use[c] > newest_gone) newest_gone = last_use[c];
+                }
+            }
+            lru_ok &= newest_gone == -1 || oldest_kept == -1 || newest_gone < oldest_kept;
+            was_loaded[cp] = 1;
+        }
+        last_use[cp] = ++clock;
+        if (op % 5000 == 0) layout_ok &= consistent(&a);
+    }
+    check(lookup_ok, "300k random lookups and inserts find exactly what the model holds");
+    check(lru_ok && evicted == a.evictions && evicted > 1000, "every eviction took the least recently used glyphs");
+    check(layout_ok && consistent(&a), "no overlaps or lost glyphs along the way");
+    glyph_atlas_free(&a);
+
+    return failures != 0;
+}
+
+// The cache 3.view.c had: a scan over up to 256 entries
+#define MAX_CACHED_EMOJIS 256
+typedef struct {
+    unsigned int codepoint;
+    unsigned int texture_id;
+    int width, height, advance_x, loaded;
+} EmojiCacheEntry;
+static EmojiCacheEntry emoji_cache[MAX_CACHED_EMOJIS];
+static int emoji_cache_size = 0;
+
+static int find_emoji_in_cache(unsigned int codepoint) {
+    for (int i = 0; i < emoji_cache_size && i < MAX_CACHED_EMOJIS; i++) {
+        if (emoji_cache[i].codepoint == codepoint && emoji_cache[i].loaded) return i;
+    }
+    return -1;
+}
+
+static volatile long sink;
+
+static void run_bench(void) {
+    enum { LOOKUPS = 4000000, TEXT = 1 << 16 };
+    // Noto Color Emoji bitmaps are 136x128; 2 pages of 2048 hold 420
+    static unsigned int text[TEXT];
+    srand(7);
+
+    printf("%-28s %16s\n", "", "lookups/sec");
+    for (int loaded_count = 64; loaded_count <= 256; loaded_count *= 4) {
+        for (int i = 0; i < TEXT; i++) text[i] = 0x1F300 + rand() % loaded_count;
+
+        emoji_cache_size = 0;
+        for (int i = 0; i < loaded_count; i++) {
+            emoji_cache[emoji_cache_size++] = (EmojiCacheEntry){ 0x1F300 + i, i + 1, 136, 128, 136, 1 };
+        }
+        long sum = 0;
+        double t0 = now();
+        for (int i = 0; i < LOOKUPS; i++) sum += find_emoji_in_cache(text[i & (TEXT - 1)]);
+        double linear = now() - t0;
+
+        GlyphAtlas a;
+        glyph_atlas_init(&a, 2048, 2048, 2);
+        for (int i = 0; i < loaded_count; i++) glyph_atlas_insert(&a, 0x1F300 + i, 136, 128, 136);
+        t0 = now();
+        for (int i = 0; i < LOOKUPS; i++) sum += glyph_atlas_find(&a, text[i & (TEXT - 1)])->x;
+        double atlas = now() - t0;
+        glyph_atlas_free(&a);
+
+        char label[64];
+        snprintf(label, sizeof(label), "linear cache, %d emoji", loaded_count);
+        printf("%-28s %16.0f\n", label, LOOKUPS / linear);
+        snprintf(label, sizeof(label), "atlas, %d emoji", loaded_count);
+        printf("%-28s %16.0f   (%.1fx)\n", label, LOOKUPS / atlas, linear / atlas);
+        sink = sum;
+    }
+
+    // More distinct emoji than fit: every miss evicts
+    for (int working_set = 600; working_set <= 2000; working_set *= 3) {
+        GlyphAtlas a;
+        glyph_atlas_init(&a, 2048, 2048, 2);
+        long misses = 0;
+        double t0 = now();
+        for (int i = 0; i < LOOKUPS / 4; i++) {
+            unsigned int cp = 0x1F300 + rand() % working_set;
+            if (!glyph_atlas_find(&a, cp)) {
+                glyph_atlas_insert(&a, cp, 136, 128, 136);
+                misses++;
+            }
+        }
+        double t = now() - t0;
+        printf("atlas, %d emoji in 420 slots: %.0f lookups/sec, %.0f%% misses, %ld evictions\n", working_set, LOOKUPS / 4 / t,
+               100.0 * misses / (LOOKUPS / 4), a.evictions);
+        glyph_atlas_free(&a);
+    }
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) { run_bench(); return 0; }
+    return run_test();
+}
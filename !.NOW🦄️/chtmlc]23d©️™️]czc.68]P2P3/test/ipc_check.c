@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../chtml_ipc.h"
+#include "../model_store.h"
+
+// Headless checks of the host side of the module protocol: links
+// 2.model.c without GL, spawns test/ipc_pump through init_model() and
+// polls update_model() the way idle_func does, minus the 16 ms sleep.
+//
+//   ipc_check <pump> test    every record arrives whole in the binary
+//                            protocol, the text fallback and a module that
+//                            ignores the offer, through the pipe with small
+//                            writes and replayed in pieces of 1 to 4096
+//                            bytes so every record straddles reads
+//   ipc_check <pump> bench   messages/sec and MB/s through the pipe for
+//                            both protocols
+
+void init_model(const char* module_path);
+int update_model();
+Shape* model_get_shapes(int* count);
+ModelVariable* model_get_variable(const char* label);
+ModelArray* model_get_array(const char* label);
+extern pid_t child_pid;
+extern size_t ipc_length;
+extern int ipc_protocol;
+size_t model_apply_bytes(unsigned char* data, size_t len);
+
+float pump_value(int frame, int shape, int field) { return (float)((frame * 7 + shape * 13 + field * 3) % 4000) / 4.0f; }
+
+int failures = 0;
+void check(int ok, const char* what) {
+    printf("%s %s\n", ok ? "✓" : "✗", what);
+    if (!ok) failures++;
+}
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Runs the pump until it reports done. Returns the seconds taken, and how
+// many updates ended with part of a record left in the buffer.
+void pump_env(int frames, int shapes, int write_size, int legacy, const char* offer) {
+    char s[32];
+    snprintf(s, sizeof(s), "%d", frames); setenv("PUMP_FRAMES", s, 1);
+    snprintf(s, sizeof(s), "%d", shapes); setenv("PUMP_SHAPES", s, 1);
+    snprintf(s, sizeof(s), "%d", write_size); setenv("PUMP_WRITE", s, 1);
+    setenv("PUMP_LEGACY", legacy ? "1" : "0", 1);
+    if (offer) setenv("CHTML_IPC", offer, 1);
+    else unsetenv("CHTML_IPC");
+}
+
+double pump(const char* path, int frames, int shapes, int write_size, int legacy, const char* offer, int* straddled) {
+    pump_env(frames, shapes, write_size, legacy, offer);
+
+    // init_model() prints to stdout; the fork must not repeat it
+    fflush(stdout);
+    ModelVariable* done = model_get_variable("done");
+    if (done) done->value.int_val = 0;
+    double t0 = now();
+    init_model(path);
+    *straddled = 0;
+    while (1) {
+        if (update_model() && ipc_length > 0) (*straddled)++;
+        done = model_get_variable("done");
+        if (done && done->value.int_val == 1) break;
+    }
+    double t = now() - t0;
+    waitpid(child_pid, NULL, 0);
+    return t;
+}
+
+// The pump's whole output, as the host would read it; offer NULL means
+// binary (what init_model() offers)
+unsigned char* capture(const char* path, int frames, int shapes, const char* offer, size_t* len) {
+    pump_env(frames, shapes, 0, 0, offer ? offer : "binary");
+    FILE* f = popen(path, "r");
+    size_t cap = 1 << 20;
+    unsigned char* out = malloc(cap);
+    *len = 0;
+    size_t n;
+    while (f && out && (n = fread(out + *len, 1, cap - *len, f)) > 0) {
+        *len += n;
+        if (*len == cap) out = realloc(out, cap *= 2);
+    }
+    if (f) pclose(f);
+    return out;
+}
+
+// Feeds data to the model piece bytes at a time through a reassembly
+// buffer like update_model()'s. Returns how many pieces ended mid-record.
+int replay(const unsigned char* data, size_t len, size_t piece) {
+    unsigned char* buf = malloc(len + 1);
+    size_t have = 0;
+    int straddled = 0;
+    ipc_protocol = 0;
+    for (size_t at = 0; at < len; at += piece) {
+        size_t n = len - at < piece ? len - at : piece;
+        memcpy(buf + have, data + at, n);
+        have += n;
+        size_t used = model_apply_bytes(buf, have);
+        memmove(buf, buf + used, have - used);
+        have -= used;
+        straddled += have > 0;
+    }
+    free(buf);
+    return have == 0 ? straddled : -1;
+}
+
+// Every record of the last frame, exactly
+int final_state_ok(int frames, int shapes) {
+    int count, ok = 1, f = frames - 1;
+    Shape* s = model_get_shapes(&count);
+    ok &= count == shapes + 1;
+    int seen = 0, csv = 0;
+    for (int i = 0; i < count; i++) {
+        if (!s[i].active) { ok = 0; continue; }
+        if (s[i].label[0] == '\0') {
+            csv += strcmp(s[i].type, "CIRCLE") == 0 && s[i].x == 10 && s[i].y == 20 && s[i].width == 5 && s[i].color[0] == 1;
+            continue;
+        }
+        int k = atoi(s[i].label + 1);
+        float want[10];
+        for (int j = 0; j < 10; j++) want[j] = pump_value(f, k, j);
+        float got[10] = { s[i].x, s[i].y, s[i].z, s[i].width, s[i].height, s[i].depth, s[i].color[0], s[i].color[1], s[i].color[2], s[i].color[3] };
+        ok &= memcmp(want, got, sizeof(want)) == 0 && strcmp(s[i].type, k % 2 ? "CIRCLE" : "RECT") == 0;
+        seen++;
+    }
+    ok &= seen == shapes && csv == 1;
+
+    char name[32];
+    snprintf(name, sizeof(name), "frame %d", f);
+    ModelVariable *frame = model_get_variable("frame"), *speed = model_get_variable("speed"), *n = model_get_variable("name");
+    ok &= frame && frame->type == 1 && frame->value.int_val == f;
+    ok &= speed && speed->type == 2 && speed->value.float_val == f * 0.5f;
+    ok &= n && n->type == 3 && strcmp(n->value.string_val, name) == 0;
+    ModelArray *hist = model_get_array("hist"), *wave = model_get_array("wave");
+    ok &= hist && hist->type == 1 && hist->count == 8 && wave && wave->type == 2 && wave->count == 5;
+    for (int k = 0; ok && k < 8; k++) ok &= hist->data.int_array[k] == f * k - 3;
+    for (int k = 0; ok && k < 5; k++) ok &= wave->data.float_array[k] == pump_value(f, k, 0);
+    return ok;
+}
+
+int run_test(const char* path) {
+    static const struct { const char* name; const char* offer; int legacy, protocol; } modes[] = {
+        { "binary", NULL, 0, 2 },
+        { "text (CHTML_IPC=text)", "text", 0, 1 },
+        { "a module that ignores the offer", NULL, 1, 1 },
+    };
+    static const int writes[] = { 0, 7, 61 };
+    char what[200];
+    for (int m = 0; m < 3; m++) {
+        for (int w = 0; w < 3; w++) {
+            if (modes[m].legacy && w) continue;
+            int straddled;
+            pump(path, 200, 40, writes[w], modes[m].legacy, modes[m].offer, &straddled);
+            int ok = final_state_ok(200, 40) && ipc_protocol == modes[m].protocol && ipc_length == 0;
+            if (writes[w]) snprintf(what, sizeof(what), "%s through the pipe in %d-byte writes: every record arrives whole", modes[m].name, writes[w]);
+            else snprintf(what, sizeof(what), "%s through the pipe: 200 frames of 40 shapes, variables and arrays arrive whole", modes[m].name);
+            check(ok, what);
+        }
+    }
+
+    static const size_t pieces[] = { 1, 2, 3, 5, 13, 64, 1000, 4096 };
+    for (int p = 0; p < 2; p++) {
+        size_t len;
+        unsigned char* data = capture(path, 30, 40, p ? "text" : NULL, &len);
+        int ok = data && len > 0, straddled = 0;
+        for (int i = 0; ok && i < 8; i++) {
+            int s = replay(data, len, pieces[i]);
+            ok = s >= 0 && final_state_ok(30, 40) && ipc_protocol == (p ? 1 : 2);
+            straddled += s;
+        }
+        snprintf(what, sizeof(what), "%s replayed in pieces of 1 to 4096 bytes: %d pieces end mid-record, every record arrives whole",
+                 p ? "text" : "binary", straddled);
+        check(ok && straddled > 0, what);
+        free(data);
+    }
+
+    // A length no frame can have drops the stream instead of reading past it
+    unsigned char bad[] = { 0, 'C', 'H', '1', 0xff, 0xff, 0xff, 0xff, CHTML_MSG_SHAPE, 1, 2, 3 };
+    ipc_protocol = 0;
+    check(model_apply_bytes(bad, sizeof(bad)) == sizeof(bad), "a corrupt frame length drops the buffered bytes");
+
+    // Numbers go on the wire little-endian whatever the host order: -2,
+    // 1.5f (0x3fc00000) and the int array {1, 256}
+    static const unsigned char wire[] = {
+        0, 'C', 'H', '1',
+        7, 0, 0, 0, CHTML_MSG_VAR, 1, 'n', CHTML_VAL_INT, 0xfe, 0xff, 0xff, 0xff,
+        7, 0, 0, 0, CHTML_MSG_VAR, 1, 'f', CHTML_VAL_FLOAT, 0x00, 0x00, 0xc0, 0x3f,
+        15, 0, 0, 0, CHTML_MSG_ARRAY, 1, 'a', CHTML_VAL_INT, 2, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0,
+    };
+    int fds[2];
+    unsigned char out[sizeof(wire) + 1];
+    ssize_t got = -1;
+    if (pipe(fds) == 0) {
+        ChtmlIpcWriter w;
+        const int a[2] = { 1, 256 };
+        setenv(CHTML_IPC_ENV, "binary", 1);
+        chtml_ipc_open(&w, fds[1]);
+        chtml_ipc_var_int(&w, "n", -2);
+        chtml_ipc_var_float(&w, "f", 1.5f);
+        chtml_ipc_array(&w, "a", CHTML_VAL_INT, a, 2);
+        chtml_ipc_flush(&w);
+        close(fds[1]);
+        got = read(fds[0], out, sizeof(out));
+        close(fds[0]);
+    }
+    check(got == (ssize_t)sizeof(wire) && memcmp(out, wire, sizeof(wire)) == 0, "the writer encodes ints, floats and arrays little-endian");
+    ipc_protocol = 0;
+    model_apply_bytes((unsigned char*)wire, sizeof(wire));
+    ModelVariable *n = model_get_variable("n"), *f = model_get_variable("f");
+    ModelArray* arr = model_get_array("a");
+    check(n && n->type == CHTML_VAL_INT && n->value.int_val == -2 && f && f->type == CHTML_VAL_FLOAT && f->value.float_val == 1.5f &&
+          arr && arr->count == 2 && arr->data.int_array[0] == 1 && arr->data.int_array[1] == 256,
+          "the host decodes little-endian ints, floats and arrays");
+    return failures != 0;
+}
+
+void run_bench(const char* path) {
+    const int shapes = 95;
+    printf("%-8s %-8s %12s %12s %10s\n", "protocol", "frames", "messages", "msgs/sec", "MB/s");
+    for (int p = 0; p < 2; p++) {
+        for (int frames = 1000; frames <= 4000; frames *= 2) {
+            size_t bytes;
+            free(capture(path, frames, shapes, p ? NULL : "text", &bytes));
+            int straddled;
+            double t = pump(path, frames, shapes, 0, 0, p ? NULL : "text", &straddled);
+            // CLEAR, the shapes, 3 VARs and 2 ARRAYs per frame
+            double messages = (double)frames * (shapes + 6);
+            printf("%-8s %-8d %12.0f %12.0f %10.1f\n", p ? "binary" : "text", frames, messages, messages / t, bytes / t / 1e6);
+        }
+    }
+    printf("(one module streaming %d shapes per frame as fast as the host reads)\n", shapes);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <ipc_pump> [test|bench]\n", argv[0]);
+        return 1;
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    // A host that never sees "done" fails instead of hanging
+    alarm(120);
+    if (argc > 2 && strcmp(argv[2], "bench") == 0) { run_bench(argv[1]); return 0; }
+    return run_test(argv[1]);
+}
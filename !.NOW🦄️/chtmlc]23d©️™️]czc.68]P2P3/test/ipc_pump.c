@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../chtml_ipc.h"
+
+// A module for the IPC tests: streams frames of shape updates to the host
+// through chtml_ipc.h, in whichever protocol the host offered.
+//
+// The host runs modules without arguments, so the settings come from the
+// environment:
+//
+//   PUMP_FRAMES   frames to send (default 100)
+//   PUMP_SHAPES   SHAPE records per frame, labelled s0.. (default 50)
+//   PUMP_WRITE    the writer's flush size, so small ones make records
+//                 straddle writes (default 64 KiB)
+//   PUMP_LEGACY   1 ignores the offer and printf()s text lines like the
+//                 modules written before the binary protocol
+//
+// Every frame is CLEAR_SHAPES, the shapes, VAR frame/speed/name and ARRAY
+// hist/wave; then comes an old CSV shape and VAR done.
+
+// The values the host must end up with; multiples of 1/4 print exactly
+// with %g
+float pump_value(int frame, int shape, int field) { return (float)((frame * 7 + shape * 13 + field * 3) % 4000) / 4.0f; }
+
+int env_int(const char* name, int fallback) {
+    const char* s = getenv(name);
+    return s && *s ? atoi(s) : fallback;
+}
+
+int main() {
+    int frames = env_int("PUMP_FRAMES", 100), count = env_int("PUMP_SHAPES", 50);
+    int write_size = env_int("PUMP_WRITE", 0), legacy = env_int("PUMP_LEGACY", 0);
+    static ChtmlIpcWriter w;
+    if (legacy) unsetenv(CHTML_IPC_ENV);
+    chtml_ipc_open(&w, STDOUT_FILENO);
+    if (write_size > 0 && (size_t)write_size < sizeof(w.buf)) w.limit = write_size;
+
+    char label[32], name[32];
+    int hist[8];
+    float wave[5];
+    for (int f = 0; f < frames; f++) {
+        if (legacy) printf("CLEAR_SHAPES\n");
+        else chtml_ipc_clear(&w);
+        for (int i = 0; i < count; i++) {
+            float v[10];
+            for (int k = 0; k < 10; k++) v[k] = pump_value(f, i, k);
+            snprintf(label, sizeof(label), "s%d", i);
+            if (legacy) printf("SHAPE;%s;%s;%g;%g;%g;%g;%g;%g;%g;%g;%g;%g\n", i % 2 ? "CIRCLE" : "RECT", label, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9]);
+            else chtml_ipc_shape(&w, i % 2 ? "CIRCLE" : "RECT", label, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9]);
+        }
+        snprintf(name, sizeof(name), "frame %d", f);
+        for (int k = 0; k < 8; k++) hist[k] = f * k - 3;
+        for (int k = 0; k < 5; k++) wave[k] = pump_value(f, k, 0);
+        if (legacy) {
+            printf("VAR;frame;int;%d\nVAR;speed;float;%g\nVAR;name;string;%s\n", f, f * 0.5f, name);
+            printf("ARRAY;hist;int;8;%d,%d,%d,%d,%d,%d,%d,%d\n", hist[0], hist[1], hist[2], hist[3], hist[4], hist[5], hist[6], hist[7]);
+            printf("ARRAY;wave;float;5;%g,%g,%g,%g,%g\n", wave[0], wave[1], wave[2], wave[3], wave[4]);
+        } else {
+            chtml_ipc_var_int(&w, "frame", f);
+            chtml_ipc_var_float(&w, "speed", f * 0.5f);
+            chtml_ipc_var_string(&w, "name", name);
+            chtml_ipc_array(&w, "hist", CHTML_VAL_INT, hist, 8);
+            chtml_ipc_array(&w, "wave", CHTML_VAL_FLOAT, wave, 5);
+        }
+    }
+    if (legacy) {
+        printf("CIRCLE,10,20,5,1,0,0,1\nVAR;done;int;1\n");
+        fflush(stdout);
+    } else {
+        chtml_ipc_text(&w, "CIRCLE,10,20,5,1,0,0,1");
+        chtml_ipc_var_int(&w, "done", 1);
+        chtml_ipc_flush(&w);
+    }
+    return 0;
+}
@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../chtml_parser.h"
+
+// Checks and times chtml_parser.h, the streaming C-HTML parser behind
+// 3.view.c, without a GL context.
+//
+//   parser_check test    tree shape, attributes and entities, errors at
+//                        exact lines and columns, the same tree however the
+//                        input is split, keys across edits and diffs, then
+//                        thousands of mutated documents fed in random chunks
+//   parser_check bench   parse speed on a 10k-element document, in big and
+//                        small chunks, and a one-attribute edit re-parsed
+//                        and diffed
+
+static int failures = 0;
+static void check(int ok, const char* what) {
+    printf("%s %s\n", ok ? "✓" : "✗", what);
+    if (!ok) failures++;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void parse(ChtmlParser* p, const char* doc) {
+    chtml_parser_init(p);
+    chtml_parser_feed(p, doc, strlen(doc));
+    chtml_parser_finish(p);
+}
+
+// Whether there is an error at line:column whose message has the text
+static int has_error(const ChtmlParser* p, int line, int column, const char* text) {
+    for (int i = 0; i < p->error_count; i++) {
+        const ChtmlError* e = &p->errors[i];
+        if (e->at.line == line && e->at.column == column && strstr(e->message, text)) return 1;
+    }
+    return 0;
+}
+
+static int is_node(const ChtmlParser* p, int node, const char* name, int parent) {
+    return node < p->node_count && strcmp(chtml_node_name(p, node), name) == 0 && p->nodes[node].parent == parent;
+}
+
+// The same nodes, attributes and errors
+static int same_parse(const ChtmlParser* a, const ChtmlParser* b) {
+    if (a->node_count != b->node_count || a->error_count != b->error_count || a->errors_dropped != b->errors_dropped) return 0;
+    for (int i = 0; i < a->node_count; i++) {
+        const ChtmlNode *x = &a->nodes[i], *y = &b->nodes[i];
+        if (strcmp(chtml_node_name(a, i), chtml_node_name(b, i)) != 0 || x->parent != y->parent || x->depth != y->depth ||
+            x->at.line != y->at.line || x->at.column != y->at.column || x->key != y->key || x->content != y->content ||
+            x->closed != y->closed || x->attr_count != y->attr_count) return 0;
+        for (int k = 0; k < x->attr_count; k++) {
+            const ChtmlAttr *s = &a->attrs[x->first_attr + k], *t = &b->attrs[y->first_attr + k];
+            if (strcmp(chtml_string(a, s->name), chtml_string(b, t->name)) != 0 ||
+                strcmp(chtml_string(a, s->value), chtml_string(b, t->value)) != 0) return 0;
+        }
+    }
+    for (int i = 0; i < a->error_count; i++) {
+        const ChtmlError *x = &a->errors[i], *y = &b->errors[i];
+        if (x->at.line != y->at.line || x->at.column != y->at.column || strcmp(x->message, y->message) != 0) return 0;
+    }
+    return 1;
+}
+
+// What any parse must hold: parents before children, depths that follow,
+// unique keys found by the index, and locations inside the document
+static int well_formed(const ChtmlParser* p, int lines) {
+    for (int i = 0; i < p->node_count; i++) {
+        const ChtmlNode* n = &p->nodes[i];
+        if (n->parent < -1 || n->parent >= i) return 0;
+        if (n->depth != (n->parent == -1 ? 0 : p->nodes[n->parent].depth + 1)) return 0;
+        if (n->at.line < 1 || n->at.line > lines || n->at.column < 1) return 0;
+        if (n->first_attr < 0 || n->first_attr + n->attr_count > p->attr_count) return 0;
+        const int* found = chtml_map_find(&p->by_key, n->key);
+        if (!found || *found != i) return 0;
+    }
+    if (p->error_count > CHTML_MAX_ERRORS) return 0;
+    for (int i = 0; i < p->error_count; i++) {
+        const ChtmlError* e = &p->errors[i];
+        if (e->at.line < 1 || e->at.line > lines || e->at.column < 1 || !memchr(e->message, '\0', sizeof(e->message))) return 0;
+    }
+    return p->open_count == 0 && p->state == CHTML_IN_TEXT;
+}
+
+static ChtmlDiff diff_of(const char* before, const char* after, int* match, int* status) {
+    ChtmlParser a, b;
+    parse(&a, before);
+    parse(&b, after);
+    ChtmlDiff d = chtml_diff(&a, &b, match, status);
+    chtml_parser_free(&a);
+    chtml_parser_free(&b);
+    return d;
+}
+
+static const char* sample =
+    "<?xml version=\"1.0\"?>\n"
+    "<window title=\"Demo\" width=\"800\" height=\"600\">\n"
+    "  <!-- a comment with <tags> and \"quotes -->\n"
+    "  <header y=\"0\" width=\"800\" height=\"40\" color=\"#333333\"></header>\n"
+    "  <panel id=\"left\" x=\"0\" y=\"40\">\n"
+    "    <button id=\"ok\" x=\"10\" y=\"10\" label=\"OK &amp; go\" onClick='ok_handler'/>\n"
+    "    <canvas id=\"scene\" width=\"200\" height=\"200\" />\n"
+    "    <textfield id=\"name\" value=\"one&#10;two&lt;3&gt;&#x1F600;&bogus;\"></textfield>\n"
+    "  </panel>\n"
+    "  <menu id=\"file\" label=\"File\">\n"
+    "    <menuitem label=\"Open\"/><menuitem label=\"Quit\"/>\n"
+    "  </menu>\n"
+    "  <checkbox id=\"c\" checked>\n"
+    "</window>\n";
+
+static void test_tree(void) {
+    ChtmlParser p;
+    parse(&p, sample);
+    int ok = p.node_count == 10;
+    ok &= is_node(&p, 0, "window", -1) && is_node(&p, 1, "header", 0) && is_node(&p, 2, "panel", 0);
+    ok &= is_node(&p, 3, "button", 2) && is_node(&p, 4, "canvas", 2) && is_node(&p, 5, "textfield", 2);
+    ok &= is_node(&p, 6, "menu", 0) && is_node(&p, 7, "menuitem", 6) && is_node(&p, 8, "menuitem", 6);
+    ok &= is_node(&p, 9, "checkbox", 0) && p.nodes[5].depth == 2;
+    check(ok, "nesting, with comments and declarations skipped and self-closed elements left empty");
+    check(p.nodes[3].at.line == 6 && p.nodes[3].at.column == 5 && p.nodes[8].at.line == 11 && p.nodes[8].at.column == 29,
+          "each node knows where its '<' is");
+    check(strcmp(chtml_attr(&p, 3, "label"), "OK & go") == 0 && strcmp(chtml_attr(&p, 3, "onClick"), "ok_handler") == 0 &&
+              strcmp(chtml_attr(&p, 9, "checked"), "") == 0 && chtml_attr(&p, 9, "value") == NULL,
+          "attributes in either quote, and boolean ones");
+    check(strcmp(chtml_attr(&p, 5, "value"), "one\ntwo<3>\xF0\x9F\x98\x80&bogus;") == 0, "entities decoded, unknown ones kept");
+    // Only the unclosed checkbox is wrong here
+    check(p.error_count == 1 && has_error(&p, 14, 1, "<checkbox> opened at 13:3 is not closed before </window>"),
+          "nothing else reported in a well-formed document");
+    chtml_parser_free(&p);
+}
+
+static void test_errors(void) {
+    ChtmlParser p;
+    parse(&p, "<window>\n  <button x=10 label=\"a\" label=\"b\"/>\n</window>");
+    check(has_error(&p, 2, 13, "value of attribute 'x' should be quoted") && strcmp(chtml_attr(&p, 1, "x"), "10") == 0,
+          "an unquoted value at its first character, and still read");
+    check(has_error(&p, 2, 26, "attribute 'label' repeated in <button>") && strcmp(chtml_attr(&p, 1, "label"), "b") == 0,
+          "a repeated attribute, the last one winning");
+    chtml_parser_free(&p);
+
+    parse(&p, "<window>\n</panel>\n<panel>\n  <text>\n</panel>\n</window>");
+    check(has_error(&p, 2, 1, "</panel> does not close any open element"), "a stray end tag");
+    check(has_error(&p, 5, 1, "<text> opened at 4:3 is not closed before </panel>") && p.node_count == 3 &&
+              p.error_count == 2,
+          "an end tag that skips an open element closes both");
+    chtml_parser_free(&p);
+
+    parse(&p, "<window>\n<panel>\n  <text/>");
+    check(has_error(&p, 3, 10, "<panel> opened at 2:1 is never closed") &&
+              has_error(&p, 3, 10, "<window> opened at 1:1 is never closed"),
+          "elements left open, reported at the end of the document");
+    chtml_parser_free(&p);
+
+    parse(&p, "<window>\n  <button label=\"unfinished/>\n  <text/>\n</window>\n");
+    check(has_error(&p, 2, 3, "tag is never closed with '>' (a quote is left open)"), "an unterminated tag at its '<'");
+    chtml_parser_free(&p);
+
+    parse(&p, "<window>\n<!-- never ends <text/>\n</window>");
+    check(has_error(&p, 2, 1, "comment is never closed with '-->'") && p.node_count == 1, "an unterminated comment");
+    chtml_parser_free(&p);
+
+    parse(&p, "<window>\n  <text id=\"a\"/>\n  <button id=\"a\"/>\n</window>");
+    check(has_error(&p, 3, 3, "id \"a\" is already used at 2:3") && p.nodes[1].key != p.nodes[2].key,
+          "a duplicate id, which still gets its own key");
+    chtml_parser_free(&p);
+
+    parse(&p, "<window>\n  <😀 x=\"1\"> <>\n</window>");
+    check(has_error(&p, 2, 4, "expected a tag name after '<'") && has_error(&p, 2, 14, "empty tag '<>'"),
+          "tags with no name");
+    chtml_parser_free(&p);
+
+    // Columns count characters, not bytes
+    parse(&p, "<text value=\"日本語\" x=1/>");
+    check(has_error(&p, 1, 21, "value of attribute 'x' should be quoted"), "columns in characters after UTF-8 text");
+    chtml_parser_free(&p);
+
+    // Errors are capped, the rest counted
+    char many[4000] = "<window>";
+    for (int i = 0; i < 150; i++) strcat(many, "</x>");
+    parse(&p, many);
+    check(p.error_count == CHTML_MAX_ERRORS && p.errors_dropped == 51, "at most 100 errors are kept");
+    chtml_parser_free(&p);
+}
+
+static void test_streaming(void) {
+    ChtmlParser whole, split;
+    parse(&whole, sample);
+    size_t n = strlen(sample);
+    int ok = 1;
+    for (size_t cut = 0; cut <= n; cut++) {
+        chtml_parser_init(&split);
+        chtml_parser_feed(&split, sample, cut);
+        chtml_parser_feed(&split, sample + cut, n - cut);
+        chtml_parser_finish(&split);
+        ok &= same_parse(&whole, &split);
+        chtml_parser_free(&split);
+    }
+    check(ok, "the same tree and errors wherever the input is split");
+
+    chtml_parser_init(&split);
+    for (size_t i = 0; i < n; i++) chtml_parser_feed(&split, sample + i, 1);
+    chtml_parser_finish(&split);
+    check(same_parse(&whole, &split), "and when fed a byte at a time");
+
+    // Reset reuses the memory for another document
+    chtml_parser_reset(&split);
+    chtml_parser_feed(&split, sample, n);
+    chtml_parser_finish(&split);
+    check(same_parse(&whole, &split), "a reset parser parses the same again");
+    chtml_parser_free(&split);
+    chtml_parser_free(&whole);
+}
+
+static void test_diff(void) {
+    const char* base =
+        "<window>\n"
+        "  <panel id=\"left\">\n"
+        "    <button label=\"A\"/>\n"
+        "    <button label=\"B\"/>\n"
+        "    <slider id=\"volume\" value=\"10\"/>\n"
+        "  </panel>\n"
+        "  <panel id=\"right\">\n"
+        "    <text value=\"hello\"/>\n"
+        "  </panel>\n"
+        "</window>\n";
+    int match[16], status[16];
+
+    ChtmlDiff d = diff_of(base, base, match, status);
+    check(d.same == 7 && d.changed == 0 && d.added == 0 && d.removed == 0 && match[4] == 4, "an unchanged document is all the same");
+
+    d = diff_of(base,
+                "<window>\n  <panel id=\"left\">\n    <button label=\"A\"/>\n    <button label=\"Bee\"/>\n"
+                "    <slider id=\"volume\" value=\"10\"/>\n  </panel>\n  <panel id=\"right\">\n"
+                "    <text value=\"hello\"/>\n  </panel>\n</window>\n",
+                match, status);
+    check(d.same == 6 && d.changed == 1 && status[3] == CHTML_CHANGED && match[3] == 3, "editing an attribute changes just that node");
+
+    d = diff_of(base,
+                "<window>\n  <!-- new -->\n  <panel id=\"left\">\n    <text value=\"new\"/>\n    <button label=\"A\"/>\n"
+                "    <button label=\"B\"/>\n    <slider id=\"volume\" value=\"10\"/>\n  </panel>\n  <panel id=\"right\">\n"
+                "    <text value=\"hello\"/>\n  </panel>\n</window>\n",
+                match, status);
+    check(d.same == 7 && d.added == 1 && status[2] == CHTML_ADDED && match[3] == 2 && match[5] == 4,
+          "inserting an element of another kind adds one and moves the rest");
+
+    d = diff_of(base,
+                "<window>\n  <panel id=\"left\">\n    <button label=\"A\"/>\n    <button label=\"B\"/>\n  </panel>\n"
+                "  <panel id=\"right\">\n    <text value=\"hello\"/>\n  </panel>\n</window>\n",
+                match, status);
+    check(d.same == 6 && d.removed == 1 && d.changed == 0 && d.added == 0, "deleting an element removes one");
+
+    d = diff_of(base,
+                "<window>\n  <panel id=\"left\">\n    <button label=\"A\"/>\n    <button label=\"B\"/>\n  </panel>\n"
+                "  <panel id=\"right\">\n    <slider id=\"volume\" value=\"10\"/>\n    <text value=\"hello\"/>\n  </panel>\n"
+                "</window>\n",
+                match, status);
+    check(d.same == 6 && d.changed == 1 && status[5] == CHTML_CHANGED && match[5] == 4 && d.removed == 0,
+          "an element with an id moved to another parent keeps its key, changed");
+
+    d = diff_of(base,
+                "<window>\n  <panel id=\"left\">\n    <button label=\"Z\"/>\n    <button label=\"A\"/>\n    <button label=\"B\"/>\n"
+                "    <slider id=\"volume\" value=\"10\"/>\n  </panel>\n  <panel id=\"right\">\n"
+                "    <text value=\"hello\"/>\n  </panel>\n</window>\n",
+                match, status);
+    check(d.same == 5 && d.changed == 2 && d.added == 1 && status[4] == CHTML_ADDED,
+          "inserting a sibling of the same kind without ids shifts those after it");
+}
+
+// Random edits biased toward the bytes that matter to the tokenizer
+static int mutate(char* doc, int len, int cap) {
+    static const char bytes[] = "<<>>//==\"\"''!!--  \n\n&;#xab\xC3\xA9";
+    int edits = 1 + rand() % 8;
+    for (int e = 0; e < edits; e++) {
+        int at = len ? rand() % (len + 1) : 0;
+        switch (rand() % 4) {
+        case 0:  // insert a byte
+            if (len + 1 >= cap) break;
+            memmove(doc + at + 1, doc + at, len - at);
+            doc[at] = bytes[rand() % (sizeof(bytes) - 1)];
+            len++;
+            break;
+        case 1:  // delete a run
+            if (at < len) {
+                int n = 1 + rand() % 16;
+                if (n > len - at) n = len - at;
+                memmove(doc + at, doc + at + n, len - at - n);
+                len -= n;
+            }
+            break;
+        case 2:  // duplicate a run somewhere else
+            if (at < len) {
+                int n = 1 + rand() % 40;
+                if (n > len - at) n = len - at;
+                if (len + n >= cap) break;
+                char run[64];
+                memcpy(run, doc + at, n);
+                int to = rand() % (len + 1);
+                memmove(doc + to + n, doc + to, len - to);
+                memcpy(doc + to, run, n);
+                len += n;
+            }
+            break;
+        case 3:  // overwrite with any byte at all
+            if (at < len) doc[at] = (char)(rand() % 256);
+            break;
+        }
+    }
+    return len;
+}
+
+static void test_fuzz(void) {
+    enum { DOCS = 4000, CAP = 8192 };
+    static char doc[CAP];
+    srand(4242);
+    int tree_ok = 1, stream_ok = 1, reparse_ok = 1;
+    long errors = 0, nodes = 0;
+    for (int round = 0; round < DOCS; round++) {
+        int len = (int)strlen(sample);
+        memcpy(doc, sample, len);
+        // Mutations pile up over a few rounds, then start again
+        for (int k = 0; k <= round % 6; k++) len = mutate(doc, len, CAP);
+        if (round % 10 == 0) {
+            len = rand() % 300;
+            for (int i = 0; i < len; i++) doc[i] = (char)(rand() % 256);
+        }
+        int lines = 1;
+        for (int i = 0; i < len; i++) lines += doc[i] == '\n';
+
+        ChtmlParser whole, chunked;
+        chtml_parser_init(&whole);
+        chtml_parser_feed(&whole, doc, len);
+        chtml_parser_finish(&whole);
+        tree_ok &= well_formed(&whole, lines);
+
+        chtml_parser_init(&chunked);
+        for (int at = 0; at < len;) {
+            int n = 1 + rand() % 64;
+            if (n > len - at) n = len - at;
+            chtml_parser_feed(&chunked, doc + at, n);
+            at += n;
+        }
+        chtml_parser_finish(&chunked);
+        stream_ok &= same_parse(&whole, &chunked);
+
+        // Diffing a document against itself matches every node to itself
+        int* match = malloc((whole.node_count + 1) * sizeof(int));
+        int* status = malloc((whole.node_count + 1) * sizeof(int));
+        ChtmlDiff d = chtml_diff(&whole, &chunked, match, status);
+        reparse_ok &= d.same == whole.node_count && d.removed == 0;
+        for (int i = 0; i < whole.node_count; i++) reparse_ok &= match[i] == i;
+        free(match);
+        free(status);
+
+        errors += whole.error_count;
+        nodes += whole.node_count;
+        chtml_parser_free(&whole);
+        chtml_parser_free(&chunked);
+    }
+    char what[160];
+    snprintf(what, sizeof(what), "%d mutated documents (%ld nodes, %ld errors): trees always well formed", DOCS, nodes, errors);
+    check(tree_ok && errors > DOCS, what);
+    check(stream_ok, "and the same when fed in random chunks");
+    check(reparse_ok, "and diff against themselves as unchanged");
+}
+
+static int run_test(void) {
+    test_tree();
+    test_errors();
+    test_streaming();
+    test_diff();
+    test_fuzz();
+    return failures != 0;
+}
+
+// A window of 100 panels with 100 elements each, and the window: 10101
+// elements. edit changes one button's label.
+static char* make_document(int edit, size_t* len) {
+    size_t cap = 4 << 20, n = 0;
+    char* doc = malloc(cap);
+    n += sprintf(doc + n, "<window title=\"Bench\" width=\"1600\" height=\"1200\">\n");
+    for (int p = 0; p < 100; p++) {
+        n += sprintf(doc + n, "  <panel id=\"panel%d\" x=\"%d\" y=\"%d\" width=\"160\" height=\"1000\" color=\"#444444\">\n", p,
+                     p % 10 * 160, p / 10 * 100);
+        for (int e = 0; e < 100; e++) {
+            int y = e * 10;
+            switch (e % 4) {
+            case 0:
+                n += sprintf(doc + n, "    <button id=\"b%d_%d\" x=\"5\" y=\"%d\" width=\"80\" height=\"9\" label=\"%s%d\" onClick=\"click\"/>\n",
+                             p, e, y, edit && p == 50 && e == 40 ? "Edited " : "Button ", e);
+                break;
+            case 1:
+                n += sprintf(doc + n, "    <text x=\"5\" y=\"%d\" value=\"Item %d &amp; more\" color=\"#FFFFFF\"/>\n", y, e);
+                break;
+            case 2:
+                n += sprintf(doc + n, "    <textfield id=\"t%d_%d\" x=\"5\" y=\"%d\" width=\"150\" height=\"9\" value=\"line&#10;two\"></textfield>\n",
+                             p, e, y);
+                break;
+            case 3:
+                n += sprintf(doc + n, "    <slider x=\"5\" y=\"%d\" width=\"150\" height=\"9\" min=\"0\" max=\"100\" value=\"50\" step=\"1\"/>\n", y);
+                break;
+            }
+        }
+        n += sprintf(doc + n, "  </panel>\n");
+    }
+    n += sprintf(doc + n, "</window>\n");
+    *len = n;
+    return doc;
+}
+
+// Best of a few runs, feeding the document in chunk-byte pieces
+static double time_parse(ChtmlParser* p, const char* doc, size_t len, size_t chunk) {
+    double best = 1e9;
+    for (int run = 0; run < 7; run++) {
+        double t0 = now();
+        chtml_parser_reset(p);
+        for (size_t at = 0; at < len; at += chunk) chtml_parser_feed(p, doc + at, len - at < chunk ? len - at : chunk);
+        chtml_parser_finish(p);
+        double t = now() - t0;
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+static void run_bench(void) {
+    size_t len, edited_len;
+    char* doc = make_document(0, &len);
+    char* edited = make_document(1, &edited_len);
+    ChtmlParser before, after;
+    chtml_parser_init(&before);
+    chtml_parser_init(&after);
+
+    printf("document: %d elements, %.0f KB\n", 10101, len / 1024.0);
+    printf("%-28s %10s %10s %14s\n", "", "ms", "MB/sec", "elements/sec");
+    static const size_t chunks[] = { 8192, 64, 1 };
+    for (int c = 0; c < 3; c++) {
+        double t = time_parse(&before, doc, len, chunks[c]);
+        char label[64];
+        snprintf(label, sizeof(label), "parse, %zu-byte chunks", chunks[c]);
+        printf("%-28s %10.2f %10.1f %14.0f\n", label, t * 1e3, len / t / 1e6, before.node_count / t);
+    }
+
+    // The reload after an edit: parse the new file, diff against the old
+    time_parse(&before, doc, len, 8192);
+    double t_parse = time_parse(&after, edited, edited_len, 8192);
+    int* match = malloc(after.node_count * sizeof(int));
+    int* status = malloc(after.node_count * sizeof(int));
+    ChtmlDiff d = { 0, 0, 0, 0 };
+    double t_diff = 1e9;
+    for (int run = 0; run < 7; run++) {
+        double t0 = now();
+        d = chtml_diff(&before, &after, match, status);
+        double t = now() - t0;
+        if (t < t_diff) t_diff = t;
+    }
+    printf("one label edited: re-parse %.2f ms + diff %.2f ms, %d of %d elements to rebuild (%d same)\n", t_parse * 1e3,
+           t_diff * 1e3, d.changed + d.added + d.removed, after.node_count, d.same);
+
+    free(match);
+    free(status);
+    chtml_parser_free(&before);
+    chtml_parser_free(&after);
+    free(doc);
+    free(edited);
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) { run_bench(); return 0; }
+    return run_test();
+}
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../render_list.h"
+
+// Checks and times render_list.h, the retained render list behind
+// display() in 3.view.c, without a GPU: the vertex streams it builds are
+// compared with the coordinates draw_element used to pass to glVertex.
+//
+//   render_check test    each element type's quads, lines, text and
+//                        emoji, batching by layer/kind/texture, and
+//                        rebuilding only what changed
+//   render_check bench   build and per-frame update cost and draw calls
+//                        per frame for 250 to 4000 elements
+
+static int failures = 0;
+static void check(int ok, const char* what) {
+    printf("%s %s\n", ok ? "✓" : "✗", what);
+    if (!ok) failures++;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Stand-ins for glutBitmapWidth and the emoji cache
+static int stub_width(int font, const char* s, int n) { return n * (font == RL_FONT_18 ? 10 : 7); }
+static int stub_glyph(unsigned int codepoint, RlGlyph* out) {
+    out->texture = codepoint == 0x1F600 ? 7 : 8;
+    out->u0 = out->v0 = 0;
+    out->u1 = out->v1 = 1;
+    out->width = out->height = 16;
+    out->advance = 18;
+    return 1;
+}
+
+static char dir_entries[3][256] = { "../", "a.txt", "src/" };
+
+static RlContext context(int window_height, int blink_on) {
+    RlContext ctx = { window_height, blink_on, dir_entries, 3, stub_width, stub_glyph };
+    return ctx;
+}
+
+static UIElement* add(UIElement* els, int* n, const char* type, int x, int y, int w, int h, int parent) {
+    UIElement* el = &els[(*n)++];
+    strcpy(el->type, type);
+    el->x = x;
+    el->y = y;
+    el->width = w;
+    el->height = h;
+    el->parent = parent;
+    el->num_lines = 1;
+    el->slider_max = 100;
+    el->slider_step = 1;
+    if (strcmp(type, "textfield") == 0 || strcmp(type, "textarea") == 0) ui_element_reserve_lines(el, 1);
+    return el;
+}
+
+// The element's command k is of this kind and layer with these vertices
+// (x, y pairs) in one color
+static int run_is(const RlElement* e, int k, int kind, int layer, const int* xy, int n, const unsigned char rgb[3]) {
+    if (k >= e->cmd_count) return 0;
+    const RlCommand* c = &e->cmds[k];
+    if (c->kind != kind || c->layer != layer || c->count != n) return 0;
+    for (int i = 0; i < n; i++) {
+        const RlVertex* v = &e->verts[c->first + i];
+        if (v->x != xy[2 * i] || v->y != xy[2 * i + 1] || memcmp(v->rgba, rgb, 3) != 0 || v->rgba[3] != 255) return 0;
+    }
+    return 1;
+}
+
+static int text_is(const RlElement* e, int k, int font, float x, float y, const float rgb[3], const char* s) {
+    if (k >= e->cmd_count) return 0;
+    const RlCommand* c = &e->cmds[k];
+    return c->kind == RL_TEXT && c->font == font && c->x == x && c->y == y && memcmp(c->color, rgb, sizeof(c->color)) == 0 &&
+           strcmp(e->text + c->text, s) == 0;
+}
+
+// Vertices [first, first + n) of the element are at these x, y pairs
+static int verts_at(const RlElement* e, int first, const int* xy, int n) {
+    if (first + n > e->vert_count) return 0;
+    for (int i = 0; i < n; i++) {
+        if (e->verts[first + i].x != xy[2 * i] || e->verts[first + i].y != xy[2 * i + 1]) return 0;
+    }
+    return 1;
+}
+
+static const unsigned char WHITE[3] = { 255, 255, 255 }, BLACK[3] = { 0, 0, 0 }, LIGHT[3] = { 204, 204, 204 };
+static const float white[3] = { 1.0f, 1.0f, 1.0f }, black[3] = { 0.0f, 0.0f, 0.0f }, yellow[3] = { 1.0f, 1.0f, 0.0f };
+static const float light_gray[3] = { 0.8f, 0.8f, 0.8f };
+
+static int run_test(void) {
+    static UIElement els[16];
+    int n = 0;
+    RenderList rl = { 0 };
+    RlContext ctx = context(600, 1);
+
+    UIElement* button = add(els, &n, "button", 10, 20, 100, 30, -1);
+    strcpy(button->label, "Go");
+    button->color[0] = 1.0f;
+    UIElement* panel = add(els, &n, "panel", 100, 100, 300, 300, -1);
+    panel->color[2] = 1.0f;
+    UIElement* field = add(els, &n, "textfield", 0, 0, 200, 50, 1);
+    ui_element_reserve_lines(field, 2);
+    strcpy(field->text_content[0], "hello");
+    strcpy(field->text_content[1], "world");
+    field->num_lines = 2;
+    field->is_active = 1;
+    field->cursor_x = 3;
+    UIElement* box = add(els, &n, "checkbox", 0, 0, 20, 20, -1);
+    box->is_checked = 1;
+    strcpy(box->label, "ok");
+    UIElement* hslider = add(els, &n, "slider", 0, 0, 100, 10, -1);
+    hslider->slider_value = 50;
+    UIElement* vslider = add(els, &n, "slider", 0, 0, 10, 100, -1);
+    vslider->slider_value = 25;
+    add(els, &n, "dirlist", 0, 0, 200, 100, -1);
+    UIElement* menu = add(els, &n, "menu", 0, 0, 80, 20, -1);
+    strcpy(menu->label, "File");
+    menu->menu_items_count = 2;
+    strcpy(add(els, &n, "menuitem", 0, 20, 80, 20, 7)->label, "Open");
+    strcpy(add(els, &n, "menuitem", 0, 40, 80, 20, 7)->label, "Quit");
+    UIElement* text = add(els, &n, "text", 300, 0, 100, 20, -1);
+    strcpy(text->label, "A\xF0\x9F\x98\x80" "B");
+    add(els, &n, "canvas", 0, 0, 50, 50, 1);
+
+    check(render_list_update(&rl, els, n, &ctx) == n, "the first update builds every element");
+
+    const unsigned char red[3] = { 255, 0, 0 };
+    const int button_quad[] = { 10, 550, 110, 550, 110, 580, 10, 580 };
+    check(rl.elements[0].cmd_count == 2 && run_is(&rl.elements[0], 0, RL_QUADS, 0, button_quad, 4, red) &&
+          text_is(&rl.elements[0], 1, RL_FONT_18, 15, 565, white, "Go"),
+          "button: its quad where draw_element put it, then its label");
+
+    // Child of the panel: offset by it, on layer 1, text in the border's gray
+    const unsigned char dark[3] = { 26, 26, 26 };
+    const int field_quad[] = { 100, 450, 300, 450, 300, 500, 100, 500 };
+    const int field_loop[] = { 100, 450, 300, 450, 300, 450, 300, 500, 300, 500, 100, 500, 100, 500, 100, 450 };
+    const int cursor[] = { 135, 450, 137, 450, 137, 470, 135, 470 };
+    const RlElement* f = &rl.elements[2];
+    check(f->cmd_count == 5 && run_is(f, 0, RL_QUADS, 1, field_quad, 4, dark) && run_is(f, 1, RL_LINES, 1, field_loop, 8, LIGHT) &&
+          text_is(f, 2, RL_FONT_18, 105, 465, light_gray, "hello") && text_is(f, 3, RL_FONT_18, 105, 485, light_gray, "world") &&
+          run_is(f, 4, RL_QUADS, 1, cursor, 4, WHITE),
+          "textfield: background, the border loop as 4 segments, a run per line and the cursor after 3 characters");
+
+    const int tick[] = { 4, 596, 8, 584, 8, 584, 16, 596 };
+    check(run_is(&rl.elements[3], 1, RL_WIDE_LINES, 0, tick, 4, BLACK) && text_is(&rl.elements[3], 2, RL_FONT_18, 25, 585, white, "ok"),
+          "checkbox: the tick as 2-pixel lines and the label beside it");
+
+    const int hthumb[] = { 45, 590, 55, 590, 55, 600, 45, 600 };
+    const int vtrack[] = { 2, 500, 8, 500, 8, 600, 2, 600 };
+    const int vthumb[] = { 0, 522, 10, 522, 10, 532, 0, 532 };
+    const RlElement *hs = &rl.elements[4], *vs = &rl.elements[5];
+    check(hs->cmds[0].count == 8 && verts_at(hs, 4, hthumb, 4) && text_is(hs, 1, RL_FONT_12, 105, 590, white, "50") &&
+          vs->cmds[0].count == 12 && verts_at(vs, 4, vtrack, 4) && verts_at(vs, 8, vthumb, 4) && text_is(vs, 1, RL_FONT_12, 15, 545, white, "25"),
+          "sliders: track and thumb in one run, the thumb at 50% across or 25% up in whole pixels, the value beside it");
+
+    const RlElement* d = &rl.elements[6];
+    check(d->cmd_count == 4 && text_is(d, 1, RL_FONT_18, 5, 515, yellow, "dir element list:") && text_is(d, 2, RL_FONT_18, 10, 540, white, "../") &&
+          text_is(d, 3, RL_FONT_18, 10, 560, white, "a.txt"),
+          "dirlist: the model's entries that fit, the third one clipped");
+
+    const int smile[] = { 315, 610, 331, 610, 331, 626, 315, 626 };
+    const RlElement* t = &rl.elements[10];
+    check(t->cmd_count == 3 && text_is(t, 0, RL_FONT_18, 305, 610, white, "A") && t->cmds[1].kind == RL_GLYPHS && t->cmds[1].texture == 7 &&
+          run_is(t, 1, RL_GLYPHS, 0, smile, 4, WHITE) && t->verts[0].v == 1 && t->verts[2].u == 1 && t->verts[2].v == 0 &&
+          text_is(t, 2, RL_FONT_18, 333, 610, white, "B"),
+          "text with an emoji: a textured quad between two runs, each advanced past the last");
+
+    // Closed, the items draw themselves below the menu; open, the menu
+    // draws them on top. 580 + 20 + 40 leaves the window, so the submenu
+    // goes above the bar.
+    check(rl.elements[8].cmd_count == 2 && rl.elements[8].cmds[0].layer == 1, "closed menu: its items draw in place");
+    menu->is_open = 1;
+    int rebuilt = render_list_update(&rl, els, n, &ctx);
+    const unsigned char item_blue[3] = { 179, 179, 230 };
+    const int sub[] = { 0, 540, 80, 540, 80, 580, 0, 580 };
+    const int first_row[] = { 0, 540, 80, 540, 80, 560, 0, 560 };
+    const int second_row[] = { 0, 560, 80, 560, 80, 580, 0, 580 };
+    const RlElement* m = &rl.elements[7];
+    int ok = rebuilt == 3 && rl.elements[8].cmd_count == 0 && rl.elements[9].cmd_count == 0 && m->cmd_count == 6;
+    ok &= text_is(m, 1, RL_FONT_18, 5, 584, white, "File");
+    ok &= m->cmds[2].layer == RL_LAYER_OVERLAY && m->cmds[2].count == 8 && verts_at(m, m->cmds[2].first, sub, 4) &&
+          verts_at(m, m->cmds[2].first + 4, first_row, 4) && memcmp(m->verts[m->cmds[2].first + 4].rgba, item_blue, 3) == 0;
+    ok &= text_is(m, 3, RL_FONT_12, 5, 555, black, "Open") && run_is(m, 4, RL_QUADS, RL_LAYER_OVERLAY, second_row, 4, item_blue) &&
+          text_is(m, 5, RL_FONT_12, 5, 575, black, "Quit");
+    check(ok, "opening a menu rebuilds it and its items, which move to the overlay layer above the bar");
+    check(rl.items[rl.item_count - 1].layer == RL_LAYER_OVERLAY && rl.items[rl.item_count - 1].kind == RL_TEXT,
+          "the overlay draws last");
+
+    // Merged list: sorted by layer then kind, so parents before children
+    ok = 1;
+    for (int i = 1; i < rl.item_count; i++) {
+        const RlCommand *a = &rl.items[i - 1], *b = &rl.items[i];
+        ok &= a->layer < b->layer || (a->layer == b->layer && a->kind <= b->kind);
+        if (a->layer == b->layer && a->kind == b->kind && a->texture == b->texture) ok &= a->kind == RL_TEXT || a->kind == RL_CANVAS;
+    }
+    int layer0_quads = 0;
+    for (int i = 0; i < rl.item_count; i++) layer0_quads += rl.items[i].layer == 0 && rl.items[i].kind == RL_QUADS;
+    ok &= layer0_quads == 1 && rl.items[0].kind == RL_QUADS && memcmp(&rl.verts[rl.items[0].first], rl.elements[0].verts, 4 * sizeof(RlVertex)) == 0;
+    ok &= strcmp(render_list_text(&rl, &rl.items[rl.item_count - 1]), "Quit") == 0;
+    check(ok, "each layer's quads merge into one batch, in element order, before its lines, canvases, emoji and text");
+
+    check(render_list_update(&rl, els, n, &ctx) == 0, "an unchanged frame rebuilds nothing");
+    strcpy(button->label, "Stop");
+    ok = render_list_update(&rl, els, n, &ctx) == 1 && text_is(&rl.elements[0], 1, RL_FONT_18, 15, 565, white, "Stop");
+    check(ok, "a new label rebuilds only that element");
+    ctx.blink_on = 0;
+    ok = render_list_update(&rl, els, n, &ctx) == 1 && rl.elements[2].cmd_count == 4;
+    check(ok, "the cursor blinking off rebuilds only the active field");
+    strcpy(field->text_content[1], "there");
+    ok = render_list_update(&rl, els, n, &ctx) == 1 && text_is(&rl.elements[2], 3, RL_FONT_18, 105, 485, light_gray, "there");
+    check(ok, "typing in the second line rebuilds the field");
+    panel->x = 120;
+    ok = render_list_update(&rl, els, n, &ctx) == 3 && rl.elements[2].verts[0].x == 120;
+    check(ok, "moving a panel rebuilds it and its children");
+    unsigned int generation = 0;
+    ctx.glyph_generation = &generation;
+    render_list_update(&rl, els, n, &ctx);
+    generation++;
+    check(render_list_update(&rl, els, n, &ctx) == 1 && rl.elements[10].cmds[1].kind == RL_GLYPHS,
+          "an atlas eviction rebuilds only the elements showing emoji");
+    ctx = context(700, 0);
+    check(render_list_update(&rl, els, n, &ctx) == n, "resizing the window rebuilds everything");
+    check(render_list_update(&rl, els, n - 1, &ctx) == 0 && rl.element_count == n - 1, "dropping an element just re-merges");
+
+    render_list_free(&rl);
+    return failures != 0;
+}
+
+// A document of panels, each with a row of typical widgets
+static int make_scene(UIElement* els, int count) {
+    int n = 0;
+    while (n + 8 <= count) {
+        int p = n, row = n / 8;
+        UIElement* panel = add(els, &n, "panel", (row % 8) * 100, (row / 8) % 6 * 100, 100, 100, -1);
+        panel->color[1] = 0.5f;
+        snprintf(add(els, &n, "button", 5, 5, 40, 20, p)->label, 50, "b%d", row);
+        strcpy(add(els, &n, "checkbox", 50, 5, 12, 12, p)->label, "on");
+        add(els, &n, "slider", 5, 30, 60, 8, p)->slider_value = row % 100;
+        UIElement* f = add(els, &n, "textfield", 5, 45, 90, 25, p);
+        snprintf(f->text_content[0], MAX_LINE_LENGTH, "field %d", row);
+        snprintf(add(els, &n, "text", 5, 75, 40, 20, p)->label, 50, "t%d", row);
+        strcpy(add(els, &n, "header", 0, 90, 100, 10, p)->label, "h");
+        add(els, &n, "button", 50, 75, 40, 20, p);
+    }
+    return n;
+}
+
+static void run_bench(void) {
+    printf("%-9s %10s %12s %14s %12s %14s\n", "elements", "build ms", "idle us", "1 change us", "draw calls", "old glBegins");
+    for (int count = 256; count <= 4096; count *= 4) {
+        UIElement* els = calloc(count, sizeof(UIElement));
+        if (!els) { printf("%-9d (no memory)\n", count); continue; }
+        int n = make_scene(els, count);
+        RenderList rl = { 0 };
+        RlContext ctx = context(600, 0);
+
+        double t0 = now();
+        render_list_update(&rl, els, n, &ctx);
+        double build = now() - t0;
+
+        const int frames = 200;
+        t0 = now();
+        for (int f = 0; f < frames; f++) render_list_update(&rl, els, n, &ctx);
+        double idle = (now() - t0) / frames;
+
+        t0 = now();
+        for (int f = 0; f < frames; f++) {
+            els[2].is_checked = !els[2].is_checked;
+            render_list_update(&rl, els, n, &ctx);
+        }
+        double change = (now() - t0) / frames;
+
+        // What immediate mode issued: a glBegin per quad, border loop,
+        // tick and emoji, and a glRasterPos per text run
+        long begins = 0;
+        for (int i = 0; i < n; i++) {
+            for (int k = 0; k < rl.elements[i].cmd_count; k++) {
+                const RlCommand* c = &rl.elements[i].cmds[k];
+                begins += c->kind == RL_QUADS || c->kind == RL_GLYPHS ? c->count / 4 : c->kind == RL_LINES ? c->count / 8 : 1;
+            }
+        }
+        int batches = 0, texts = 0;
+        for (int i = 0; i < rl.item_count; i++) {
+            if (rl.items[i].kind == RL_TEXT) texts++;
+            else batches++;
+        }
+        char calls[32];
+        snprintf(calls, sizeof(calls), "%d+%d", batches, texts);
+        printf("%-9d %10.2f %12.1f %14.1f %12s %14ld\n", n, build * 1e3, idle * 1e6, change * 1e6, calls, begins);
+        render_list_free(&rl);
+        for (int i = 0; i < n; i++) ui_element_clear(&els[i]);
+        free(els);
+    }
+    printf("(draw calls: glDrawArrays batches + bitmap text runs; 1 change: a checkbox toggled every frame)\n");
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) { run_bench(); return 0; }
+    return run_test();
+}
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../model_store.h"
+
+// Checks and times model_store.h, the label-indexed shapes, variables and
+// arrays behind 2.model.c, without a window or a module.
+//
+//   store_check test    100k shapes land densely and are found by label,
+//                       updates stay in place, CLEAR_SHAPES keeps the
+//                       memory, a random mix of updates and clears matches
+//                       a linear-scan store, and 2.model.c applies scenes
+//                       far past the old 100 shape / 50 variable / 20 array
+//                       caps
+//   store_check bench   shape updates/sec of the hash store and of a
+//                       linear scan, and model_apply_bytes() messages/sec,
+//                       for 1k to 100k shapes
+
+extern int ipc_protocol;
+size_t model_apply_bytes(unsigned char* data, size_t len);
+Shape* model_get_shapes(int* count);
+ModelVariable* model_get_variable(const char* label);
+ModelArray* model_get_array(const char* label);
+
+static int failures = 0;
+static void check(int ok, const char* what) {
+    printf("%s %s\n", ok ? "✓" : "✗", what);
+    if (!ok) failures++;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned int rng = 11;
+static int rand_below(int n) {
+    rng = rng * 1103515245 + 12345;
+    return (int)((rng >> 8) % (unsigned)n);
+}
+
+// The store as it was: a linear scan for the label, new shapes appended
+typedef struct { Shape* items; int count, capacity; } LinearStore;
+
+static Shape* linear_upsert(LinearStore* s, const char* label) {
+    for (int i = 0; i < s->count; i++) {
+        if (strcmp(s->items[i].label, label) == 0) return &s->items[i];
+    }
+    if (s->count == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 64;
+        s->items = realloc(s->items, (size_t)s->capacity * sizeof(Shape));
+    }
+    Shape* shape = &s->items[s->count];
+    memset(shape, 0, sizeof(*shape));
+    strcpy(shape->label, label);
+    shape->id = s->count++;
+    shape->active = 1;
+    return shape;
+}
+
+static void set_shape(Shape* shape, int k, int frame) {
+    strcpy(shape->type, k % 2 ? "CIRCLE" : "RECT");
+    shape->x = (float)k;
+    shape->y = (float)frame;
+    shape->width = (float)(k % 97);
+}
+
+static int run_test(void) {
+    const int n = 100000;
+    char label[64], what[200];
+    ShapeStore s = { 0 };
+
+    int ok = 1;
+    for (int k = 0; k < n; k++) {
+        snprintf(label, sizeof(label), "s%d", k);
+        Shape* shape = shape_store_upsert(&s, label);
+        if (!shape) { ok = 0; break; }
+        set_shape(shape, k, 0);
+    }
+    ok &= s.count == n;
+    for (int k = 0; ok && k < n; k++) {
+        snprintf(label, sizeof(label), "s%d", k);
+        Shape* shape = shape_store_find(&s, label);
+        ok &= shape == &s.items[k] && shape->id == k && shape->active && shape->x == k;
+    }
+    ok &= shape_store_find(&s, "s100000") == NULL && shape_store_find(&s, "") == NULL;
+    snprintf(what, sizeof(what), "%d labelled shapes sit densely in insert order and are each found by label", n);
+    check(ok, what);
+
+    ok = 1;
+    Shape* items = s.items;
+    for (int k = 0; k < n; k += 7) {
+        snprintf(label, sizeof(label), "s%d", k);
+        Shape* shape = shape_store_upsert(&s, label);
+        ok &= shape == &s.items[k];
+        set_shape(shape, k, 1);
+    }
+    ok &= s.count == n && s.items == items && s.items[49].y == 1 && s.items[48].y == 0;
+    check(ok, "re-sending a label updates that shape in place");
+
+    int capacity = s.capacity, slots = s.index.mask + 1;
+    shape_store_clear(&s);
+    ok = s.count == 0 && s.capacity == capacity && s.items == items && shape_store_find(&s, "s0") == NULL;
+    for (int k = 0; k < n; k++) {
+        snprintf(label, sizeof(label), "t%d", k);
+        set_shape(shape_store_upsert(&s, label), k, 2);
+    }
+    ok &= s.count == n && s.items == items && (int)s.index.mask + 1 == slots && shape_store_find(&s, "s5") == NULL;
+    ok &= shape_store_find(&s, "t99999") == &s.items[n - 1];
+    check(ok, "CLEAR_SHAPES drops every shape and the refill reuses the same array and index");
+
+    // The stamp wrapping round must not revive the shapes stamped 1
+    s.index.generation = UINT32_MAX;
+    shape_store_clear(&s);
+    ok = s.index.generation == 1 && shape_store_find(&s, "t0") == NULL;
+    set_shape(shape_store_upsert(&s, "t0"), 0, 3);
+    ok &= s.count == 1 && shape_store_find(&s, "t0") == &s.items[0] && shape_store_find(&s, "t1") == NULL;
+    check(ok, "a clear that wraps the generation stamp still empties the index");
+
+    shape_store_clear(&s);
+    Shape* a = shape_store_upsert(&s, "");
+    Shape* b = shape_store_upsert(&s, "");
+    check(a && b && a != b && s.count == 2, "unlabelled (CSV) shapes are always new");
+    shape_store_free(&s);
+
+    // Random sets and clears over a pool of labels, against the linear scan
+    LinearStore ref = { 0 };
+    ok = 1;
+    int clears = 0;
+    for (int op = 0; op < 200000 && ok; op++) {
+        if (rand_below(1000) == 0) {
+            shape_store_clear(&s);
+            ref.count = 0;
+            clears++;
+            continue;
+        }
+        int k = rand_below(3000);
+        snprintf(label, sizeof(label), "p%d", k);
+        Shape *x = shape_store_upsert(&s, label), *y = linear_upsert(&ref, label);
+        set_shape(x, k, op);
+        set_shape(y, k, op);
+        ok = s.count == ref.count && x - s.items == y - ref.items;
+    }
+    ok &= s.count == ref.count && memcmp(s.items, ref.items, (size_t)s.count * sizeof(Shape)) == 0;
+    snprintf(what, sizeof(what), "200000 random updates and %d clears over 3000 labels match a linear-scan store exactly", clears);
+    check(ok, what);
+    shape_store_free(&s);
+    free(ref.items);
+
+    VariableStore vars = { 0 };
+    ok = 1;
+    for (int k = 0; k < 10000; k++) {
+        snprintf(label, sizeof(label), "v%d", k);
+        ModelVariable* v = variable_store_upsert(&vars, label);
+        v->type = 1;
+        v->value.int_val = k;
+    }
+    for (int k = 0; k < 10000; k++) {
+        snprintf(label, sizeof(label), "v%d", k);
+        ModelVariable* v = variable_store_upsert(&vars, label);
+        ok &= v == &vars.items[k] && v->active && v->type == 1 && v->value.int_val == k && variable_store_find(&vars, label) == v;
+    }
+    ok &= vars.count == 10000;
+    check(ok, "10000 variables keep their value across re-sends and are found by label");
+    variable_store_free(&vars);
+
+    ArrayStore arrs = { 0 };
+    ModelArray* arr = array_store_upsert(&arrs, "hist");
+    arr->data.int_array = malloc(4 * sizeof(int));
+    arr->count = 4;
+    arr = array_store_upsert(&arrs, "hist");
+    check(arrs.count == 1 && arr->count == 0 && arr->data.int_array == NULL && arr->active && array_store_find(&arrs, "hist") == arr,
+          "a re-sent array starts empty with its old data freed");
+    array_store_free(&arrs);
+
+    // The model itself, through the text protocol, past the old caps
+    size_t cap = 16 << 20, len = 0;
+    unsigned char* text = malloc(cap);
+    for (int k = 0; k < n; k++) len += snprintf((char*)text + len, cap - len, "SHAPE;RECT;s%d;%d;1;0;4;4;0;1;0;0;1\n", k, k);
+    for (int k = 0; k < 200; k++) len += snprintf((char*)text + len, cap - len, "VAR;v%d;int;%d\n", k, k * 3);
+    for (int k = 0; k < 50; k++) len += snprintf((char*)text + len, cap - len, "ARRAY;a%d;float;2;%d,0.5\n", k, k);
+    ipc_protocol = 0;
+    size_t used = model_apply_bytes(text, len);
+    int count;
+    Shape* shapes = model_get_shapes(&count);
+    ok = used == len && count == n && shapes[n - 1].x == n - 1 && strcmp(shapes[n - 1].label, "s99999") == 0;
+    ModelVariable* v = model_get_variable("v199");
+    ModelArray* a49 = model_get_array("a49");
+    ok &= v && v->value.int_val == 597 && a49 && a49->count == 2 && a49->data.float_array[0] == 49 && !model_get_variable("v200");
+    len = snprintf((char*)text, cap, "CLEAR_SHAPES\nSHAPE;CIRCLE;s7;1;2;3;4;5;6;1;1;1;1\n");
+    model_apply_bytes(text, len);
+    shapes = model_get_shapes(&count);
+    ok &= count == 1 && strcmp(shapes[0].label, "s7") == 0 && shapes[0].id == 0;
+    check(ok, "2.model.c applies 100000 shapes, 200 variables and 50 arrays, then a CLEAR_SHAPES");
+    free(text);
+    return failures != 0;
+}
+
+static void run_bench(void) {
+    char label[64];
+    printf("%-8s %16s %16s %16s\n", "shapes", "hash upd/sec", "linear upd/sec", "model msgs/sec");
+    for (int n = 1000; n <= 100000; n *= 10) {
+        // Frames re-sending every shape by label, as a module animating a scene does
+        int frames = 2000000 / n;
+        ShapeStore s = { 0 };
+        double t0 = now();
+        for (int f = 0; f < frames; f++) {
+            for (int k = 0; k < n; k++) {
+                snprintf(label, sizeof(label), "s%d", k);
+                set_shape(shape_store_upsert(&s, label), k, f);
+            }
+        }
+        double hash = (double)frames * n / (now() - t0);
+        shape_store_free(&s);
+
+        // The scan is quadratic per frame; 100k would take minutes
+        char linear[32] = "-";
+        if (n <= 10000) {
+            LinearStore ref = { 0 };
+            int lf = n == 1000 ? 20 : 1;
+            t0 = now();
+            for (int f = 0; f < lf; f++) {
+                for (int k = 0; k < n; k++) {
+                    snprintf(label, sizeof(label), "s%d", k);
+                    set_shape(linear_upsert(&ref, label), k, f);
+                }
+            }
+            snprintf(linear, sizeof(linear), "%.0f", (double)lf * n / (now() - t0));
+            free(ref.items);
+        }
+
+        // CLEAR_SHAPES plus every shape, through the text protocol
+        size_t cap = (size_t)n * 64 + 64, len = 0;
+        unsigned char* text = malloc(cap);
+        unsigned char* work = malloc(cap);
+        len += snprintf((char*)text, cap, "CLEAR_SHAPES\n");
+        for (int k = 0; k < n; k++) len += snprintf((char*)text + len, cap - len, "SHAPE;RECT;s%d;%d;1;0;4;4;0;1;0;0;1\n", k, k);
+        int mframes = frames / 4 + 1;
+        double spent = 0;
+        for (int f = 0; f < mframes; f++) {
+            memcpy(work, text, len); // model_apply_bytes() cuts lines in place
+            ipc_protocol = 0;
+            t0 = now();
+            model_apply_bytes(work, len);
+            spent += now() - t0;
+        }
+        free(text);
+        free(work);
+        printf("%-8d %16.0f %16s %16.0f\n", n, hash, linear, (double)mframes * (n + 1) / spent);
+    }
+    printf("(updates: every shape re-sent by label each frame; model: CLEAR_SHAPES and the frame as text)\n");
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) { run_bench(); return 0; }
+    return run_test();
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Headless tests of the emoji glyph atlas (glyph_atlas.h, used by
+# 3.view.c), no window or GL needed:
+#  - shelf packing across pages, lookups by codepoint, least-recently-used
+#    eviction into holes, and pages that empty starting over
+#  - 300k random lookups and inserts checked against a reference model
+#  - glyph lookups/sec vs the old linear emoji cache, and while evicting
+#    (pass "quick" to skip)
+# Run from the project root: ./test/test_atlas.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 -Wall "$ROOT/test/atlas_check.c" -o "$WORK/atlas_check.+x" || { echo "Compilation of atlas_check.c failed!"; exit 1; }
+
+cd "$WORK"
+status=0
+"$WORK/atlas_check.+x" test || status=1
+
+if [ "$1" != "quick" ]; then
+    echo "Throughput:"
+    "$WORK/atlas_check.+x" bench
+fi
+
+if [ $status -eq 0 ]; then
+    echo "Atlas checks passed."
+else
+    echo "Atlas checks FAILED."
+fi
+exit $status
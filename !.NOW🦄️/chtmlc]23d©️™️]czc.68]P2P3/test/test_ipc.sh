@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# Headless tests of the module protocol (chtml_ipc.h, update_model in
+# 2.model.c), no window or GL needed:
+#  - test/ipc_pump, a module, streams shapes, variables and arrays through
+#    the real pipe from init_model(); the host must end with every record
+#    of the last frame exactly, in the binary protocol, the text fallback
+#    and from a module that ignores the offer, also with tiny writes
+#  - the same output replayed in pieces of 1 to 4096 bytes, so records
+#    straddle every possible read boundary
+#  - ints, floats and arrays are little-endian on the wire, both from the
+#    writer and into the host
+#  - messages/sec for text and binary (pass "quick" to skip)
+# Run from the project root: ./test/test_ipc.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/test/ipc_pump.c" -o "$WORK/ipc_pump.+x" || { echo "Compilation of ipc_pump.c failed!"; exit 1; }
+gcc -O2 "$ROOT/test/ipc_check.c" "$ROOT/2.model.c" -o "$WORK/ipc_check.+x" || { echo "Compilation of ipc_check.c failed!"; exit 1; }
+
+# init_model() lists the working directory and announces each module
+cd "$WORK"
+status=0
+"$WORK/ipc_check.+x" "$WORK/ipc_pump.+x" test | grep -v '^Initializing model'
+[ "${PIPESTATUS[0]}" -eq 0 ] || status=1
+
+if [ "$1" != "quick" ]; then
+    echo "Throughput:"
+    "$WORK/ipc_check.+x" "$WORK/ipc_pump.+x" bench | grep -v '^Initializing model'
+fi
+
+if [ $status -eq 0 ]; then
+    echo "IPC checks passed."
+else
+    echo "IPC checks FAILED."
+fi
+exit $status
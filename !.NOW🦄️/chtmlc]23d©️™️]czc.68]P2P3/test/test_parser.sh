@@ -0,0 +1,34 @@
+#!/bin/bash
+
+# Headless tests of the C-HTML parser (chtml_parser.h, used by
+# 3.view.c), no window or GL needed:
+#  - the tree, attributes and entities, and errors at exact lines and
+#    columns for malformed markup
+#  - the same result however the input is split, keys across edits, and
+#    diffs that find only the changed elements
+#  - thousands of mutated documents fed in random chunks
+#  - parse speed on a 10k-element document, and an edit re-parsed and
+#    diffed (pass "quick" to skip)
+# Run from the project root: ./test/test_parser.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 -Wall "$ROOT/test/parser_check.c" -o "$WORK/parser_check.+x" || { echo "Compilation of parser_check.c failed!"; exit 1; }
+
+cd "$WORK"
+status=0
+"$WORK/parser_check.+x" test || status=1
+
+if [ "$1" != "quick" ]; then
+    echo "Throughput:"
+    "$WORK/parser_check.+x" bench
+fi
+
+if [ $status -eq 0 ]; then
+    echo "Parser checks passed."
+else
+    echo "Parser checks FAILED."
+fi
+exit $status
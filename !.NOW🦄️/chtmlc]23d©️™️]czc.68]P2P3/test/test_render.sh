@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Headless tests of the retained render list (render_list.h, drawn by
+# 3.view.c), no window or GL needed:
+#  - the quads, lines, text runs and emoji quads each element type builds,
+#    at the coordinates the old immediate-mode draw_element used
+#  - batching by layer, kind and texture, and rebuilding only the elements
+#    that changed
+#  - build and per-frame cost and draw calls for 250 to 4000 elements
+#    (pass "quick" to skip)
+# Run from the project root: ./test/test_render.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 -Wall "$ROOT/test/render_check.c" -o "$WORK/render_check.+x" || { echo "Compilation of render_check.c failed!"; exit 1; }
+
+cd "$WORK"
+status=0
+"$WORK/render_check.+x" test || status=1
+
+if [ "$1" != "quick" ]; then
+    echo "Frame cost:"
+    "$WORK/render_check.+x" bench
+fi
+
+if [ $status -eq 0 ]; then
+    echo "Render checks passed."
+else
+    echo "Render checks FAILED."
+fi
+exit $status
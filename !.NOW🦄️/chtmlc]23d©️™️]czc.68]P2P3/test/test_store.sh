@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Headless tests of the model store (model_store.h, used by 2.model.c), no
+# window, GL or module needed:
+#  - 100k shapes found by label, updated in place, cleared without
+#    reallocating, and a random mix of updates and clears checked against
+#    a linear-scan store
+#  - 2.model.c applying a scene far past the old fixed caps
+#  - updates/sec of the hash store vs a linear scan (pass "quick" to skip)
+# Run from the project root: ./test/test_store.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/test/store_check.c" "$ROOT/2.model.c" -o "$WORK/store_check.+x" || { echo "Compilation of store_check.c failed!"; exit 1; }
+
+cd "$WORK"
+status=0
+"$WORK/store_check.+x" test || status=1
+
+if [ "$1" != "quick" ]; then
+    echo "Throughput:"
+    "$WORK/store_check.+x" bench
+fi
+
+if [ $status -eq 0 ]; then
+    echo "Store checks passed."
+else
+    echo "Store checks FAILED."
+fi
+exit $status
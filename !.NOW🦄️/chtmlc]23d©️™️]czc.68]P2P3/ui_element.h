@@ -0,0 +1,96 @@
+#ifndef UI_ELEMENT_H
+#define UI_ELEMENT_H
+
+// One parsed C-HTML element, shared by the view (3.view.c), the controller
+// (4.controller.c) and the render list (render_list.h).
+//
+// Text lines and the clipboard live out of line: only textfields and
+// textareas hold lines, allocated as they grow, and the clipboard is
+// allocated on the first copy. An element is a few hundred bytes, so a
+// document of thousands of elements costs what it shows.
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TEXT_LINES 1000
+#define MAX_LINE_LENGTH 512
+
+#define CLIPBOARD_SIZE 10000
+
+typedef struct {
+    char type[20];
+    int x, y, width, height;
+    char id[50]; // Unique identifier for UI elements
+    char label[50]; // Used for button label, text element value, and checkbox label
+    // Multi-line text support: text_lines lines allocated, num_lines in use
+    char (*text_content)[MAX_LINE_LENGTH];
+    int text_lines;
+    int num_lines; // Number of lines in the text
+    int cursor_x; // X position of cursor (column)
+    int cursor_y; // Y position of cursor (line number)
+    int is_active; // For textfield active state
+    int is_checked; // For checkbox checked state
+    int slider_value; // For slider current value
+    int slider_min; // For slider minimum value
+    int slider_max; // For slider maximum value
+    int slider_step; // For slider step increment
+    float color[3];
+    int parent;
+    // Canvas-specific properties
+    int canvas_initialized; // Flag to track if canvas has been initialized
+    void (*canvas_render_func)(int x, int y, int width, int height); // Render function for canvas
+    char view_mode[10]; // View mode: "2d" or "3d"
+    // Camera properties for 3D view
+    float camera_pos[3]; // Camera position (x, y, z)
+    float camera_target[3]; // Camera target (x, y, z)
+    float camera_up[3]; // Camera up vector (x, y, z)
+    float fov; // Field of view for 3D perspective
+    // Event handling
+    char onClick[50]; // Store the onClick handler function name
+    // Menu-specific properties
+    int menu_items_count; // Number of submenu items
+    int is_open; // For menus - whether they are currently open
+    // Text selection properties
+    int selection_start_x; // X position of selection start
+    int selection_start_y; // Y position of selection start
+    int selection_end_x;   // X position of selection end
+    int selection_end_y;   // Y position of selection end
+    int has_selection;     // Whether there is an active selection
+    // Clipboard for this element, CLIPBOARD_SIZE bytes once allocated
+    char* clipboard;
+    // Directory listing properties
+    char dir_path[512]; // Directory path for directory listing elements
+    int dir_entry_count; // Number of directory entries
+    int dir_entry_selected; // Index of selected entry
+} UIElement;
+
+// Makes room for n text lines, zeroing new ones. Returns 0 past
+// MAX_TEXT_LINES or when out of memory, leaving the lines as they were.
+static inline int ui_element_reserve_lines(UIElement* el, int n) {
+    if (n <= el->text_lines) return 1;
+    if (n > MAX_TEXT_LINES) return 0;
+    int cap = el->text_lines ? el->text_lines : 4;
+    while (cap < n) cap *= 2;
+    if (cap > MAX_TEXT_LINES) cap = MAX_TEXT_LINES;
+    char (*lines)[MAX_LINE_LENGTH] = realloc(el->text_content, (size_t)cap * MAX_LINE_LENGTH);
+    if (!lines) return 0;
+    memset(lines[el->text_lines], 0, (size_t)(cap - el->text_lines) * MAX_LINE_LENGTH);
+    el->text_content = lines;
+    el->text_lines = cap;
+    return 1;
+}
+
+// The clipboard, allocated empty on first use; NULL when out of memory
+static inline char* ui_element_clipboard(UIElement* el) {
+    if (!el->clipboard) el->clipboard = calloc(1, CLIPBOARD_SIZE);
+    return el->clipboard;
+}
+
+// Frees the element's text and clipboard and zeroes every field
+static inline void ui_element_clear(UIElement* el) {
+    free(el->text_content);
+    free(el->clipboard);
+    memset(el, 0, sizeof(*el));
+}
+
+#endif
@@ -7,6 +7,7 @@
 
 #define MAX_VOCAB_SIZE 100000
 #define EMBEDDING_DIM 7
+#include "layers.h"
 
 // Structure to hold a vocabulary entry
 struct VocabEntry {
@@ -21,24 +22,6 @@ struct VocabEntry {
     float bias4;
 };
 
-// Attention Layer
-typedef struct {
-    float W_q[EMBEDDING_DIM][EMBEDDING_DIM];
-    float W_k[EMBEDDING_DIM][EMBEDDING_DIM];
-    float W_v[EMBEDDING_DIM][EMBEDDING_DIM];
-} AttentionLayer;
-
-// Function to initialize attention layer with random weights
-void initialize_attention(AttentionLayer *attention) {
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        for (int j = 0; j < EMBEDDING_DIM; j++) {
-            attention->W_q[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
-            attention->W_k[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
-            attention->W_v[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
-        }
-    }
-}
-
 // Softmax function
 void softmax(float *x, int size) {
     float max_val = x[0];
@@ -57,27 +40,13 @@ void softmax(float *x, int size) {
     }
 }
 
-// Apply causal mask to attention scores
-void apply_causal_mask(float *attn_scores, int vocab_size, int current_position) {
-    for (int i = current_position + 1; i < vocab_size; i++) {
-        attn_scores[i] = -1e9f; // Set future positions to negative infinity
-    }
-}
-
 // Forward propagation through attention mechanism
 void attention_forward(float *input_vec, AttentionLayer *attention, struct VocabEntry *vocab, int vocab_size, 
                        float *attn_scores, float *context, int causal_attention, int current_position) {
     float q[EMBEDDING_DIM], k[EMBEDDING_DIM], v[EMBEDDING_DIM];
     
     // Compute Q, K, V
-    for(int j=0; j<EMBEDDING_DIM; j++){
-        q[j] = k[j] = v[j] = 0;
-        for(int l=0; l<EMBEDDING_DIM; l++){
-            q[j] += input_vec[l] * attention->W_q[l][j];
-            k[j] += input_vec[l] * attention->W_k[l][j];
-            v[j] += input_vec[l] * attention->W_v[l][j];
-        }
-    }
+    layer_attention_qkv(attention, input_vec, 1, q, k, v);
 
     // Compute attention scores
     for(int j=0; j<vocab_size; j++){
@@ -107,68 +76,6 @@ void attention_forward(float *input_vec, AttentionLayer *attention, struct Vocab
     }
 }
 
-// Function to save attention to file
-void save_attention(const char *filename, AttentionLayer *attention) {
-    FILE *file = fopen(filename, "w");
-    if (!file) {
-        perror("Error opening attention file for writing");
-        return;
-    }
-    
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        for (int j = 0; j < EMBEDDING_DIM; j++) {
-            fprintf(file, "%f ", attention->W_q[i][j]);
-        }
-        fprintf(file, "\n");
-    }
-    
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        for (int j = 0; j < EMBEDDING_DIM; j++) {
-            fprintf(file, "%f ", attention->W_k[i][j]);
-        }
-        fprintf(file, "\n");
-    }
-    
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        for (int j = 0; j < EMBEDDING_DIM; j++) {
-            fprintf(file, "%f ", attention->W_v[i][j]);
-        }
-        fprintf(file, "\n");
-    }
-    
-    fclose(file);
-}
-
-// Function to load attention from file
-void load_attention(const char *filename, AttentionLayer *attention) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        // Initialize with random weights if file doesn't exist
-        initialize_attention(attention);
-        return;
-    }
-    
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        for (int j = 0; j < EMBEDDING_DIM; j++) {
-            fscanf(file, "%f", &attention->W_q[i][j]);
-        }
-    }
-    
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        for (int j = 0; j < EMBEDDING_DIM; j++) {
-            fscanf(file, "%f", &attention->W_k[i][j]);
-        }
-    }
-    
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        for (int j = 0; j < EMBEDDING_DIM; j++) {
-            fscanf(file, "%f", &attention->W_v[i][j]);
-        }
-    }
-    
-    fclose(file);
-}
-
 int main(int argc, char *argv[]) {
     if (argc < 2) {
         fprintf(stderr, "Usage: %s <operation> [args...]\n", argv[0]);
@@ -189,7 +96,10 @@ int main(int argc, char *argv[]) {
         
         srand(time(NULL));
         initialize_attention(&attention);
-        save_attention(argv[2], &attention);
+        if (!save_attention(argv[2], &attention)) {
+            perror("Error opening attention file for writing");
+            return 1;
+        }
         printf("Attention initialized and saved to %s\n", argv[2]);
         
     } else if (strcmp(operation, "forward") == 0) {
@@ -198,7 +108,8 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         
-        load_attention(argv[2], &attention);
+        // Initialize with random weights if the file doesn't exist
+        if (!load_attention(argv[2], &attention)) initialize_attention(&attention);
         
         // Path generation logic
         char *vocab_path = argv[3];
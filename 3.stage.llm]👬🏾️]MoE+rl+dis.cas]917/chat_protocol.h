@@ -0,0 +1,130 @@
+#ifndef CHAT_PROTOCOL_H
+#define CHAT_PROTOCOL_H
+
+// Request/response protocol of the resident chatbot (chatbot_moe_v1 -serve).
+//
+// A client connects to the server's Unix domain socket and sends any number
+// of requests on the same connection, each answered in order:
+//
+//   GEN <length> <temperature> <seed> <n>\n    length -1 for no limit,
+//   <curriculum path>\n   (n lines)           seed 0 keeps the current RNG
+//   <prompt>\n
+//
+//   QUIT\n                                    stop the server
+//
+// Responses:
+//
+//   OK <tokens>\n<response>\n
+//   ERR <message>\n
+//
+// Everything is line based, so a prompt may not contain a newline;
+// chat_request_write turns any into spaces. The server keeps the merged
+// vocabulary of each recent curriculum set mapped between requests.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define CHAT_SOCKET_DEFAULT "chatbot_moe.sock"
+#define CHAT_MAX_CURRICULA 64
+#define CHAT_MAX_PATH 1024
+#define CHAT_MAX_PROMPT 1024
+#define CHAT_MAX_RESPONSE 10000
+
+enum { CHAT_GEN = 1, CHAT_QUIT = 2 };
+
+struct ChatRequest {
+    int type;
+    int length;
+    float temperature;
+    unsigned int seed;
+    int num_curricula;
+    char paths[CHAT_MAX_CURRICULA][CHAT_MAX_PATH];
+    char prompt[CHAT_MAX_PROMPT];
+};
+
+// Read one line without its newline; 0 at EOF or if it does not fit
+static inline int chat_read_line(FILE *in, char *buf, size_t n) {
+    if (!fgets(buf, n, in)) return 0;
+    size_t len = strcspn(buf, "\n");
+    if (buf[len] != '\n' && !feof(in)) return 0;
+    buf[len] = 0;
+    return 1;
+}
+
+// Returns 1 for a well-formed request, 0 at EOF, -1 for a malformed one
+static inline int chat_request_read(FILE *in, struct ChatRequest *req) {
+    char line[CHAT_MAX_PATH + 2];
+    if (!chat_read_line(in, line, sizeof(line))) return 0;
+    memset(req, 0, sizeof(*req));
+    if (strcmp(line, "QUIT") == 0) { req->type = CHAT_QUIT; return 1; }
+    if (sscanf(line, "GEN %d %f %u %d", &req->length, &req->temperature, &req->seed, &req->num_curricula) != 4 ||
+        req->num_curricula < 1 || req->num_curricula > CHAT_MAX_CURRICULA) return -1;
+    req->type = CHAT_GEN;
+    for (int i = 0; i < req->num_curricula; i++) {
+        if (!chat_read_line(in, req->paths[i], sizeof(req->paths[i]))) return -1;
+    }
+    if (!chat_read_line(in, req->prompt, sizeof(req->prompt))) return -1;
+    return 1;
+}
+
+static inline int chat_request_write(FILE *out, const struct ChatRequest *req) {
+    if (req->type == CHAT_QUIT) {
+        fprintf(out, "QUIT\n");
+    } else {
+        fprintf(out, "GEN %d %f %u %d\n", req->length, req->temperature, req->seed, req->num_curricula);
+        for (int i = 0; i < req->num_curricula; i++) fprintf(out, "%s\n", req->paths[i]);
+        for (const char *p = req->prompt; *p; p++) fputc(*p == '\n' || *p == '\r' ? ' ' : *p, out);
+        fputc('\n', out);
+    }
+    return fflush(out) == 0;
+}
+
+static inline int chat_response_write(FILE *out, int ok, int tokens, const char *text) {
+    if (ok) fprintf(out, "OK %d\n%s\n", tokens, text);
+    else fprintf(out, "ERR %s\n", text);
+    return fflush(out) == 0;
+}
+
+// Fills text with the response or the server's error message. Returns the
+// token count, -1 for an ERR reply and -2 if the connection failed.
+static inline int chat_response_read(FILE *in, char *text, size_t n) {
+    char line[CHAT_MAX_PATH];
+    int tokens;
+    if (!chat_read_line(in, line, sizeof(line))) return -2;
+    if (strncmp(line, "ERR ", 4) == 0) {
+        snprintf(text, n, "%s", line + 4);
+        return -1;
+    }
+    if (sscanf(line, "OK %d", &tokens) != 1 || !chat_read_line(in, text, n)) return -2;
+    return tokens;
+}
+
+static inline int chat_socket_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return 0;
+    }
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+// Connected socket, or -1 if nothing is listening at path
+static inline int chat_connect(const char *path) {
+    struct sockaddr_un addr;
+    if (!chat_socket_address(path, &addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+#endif
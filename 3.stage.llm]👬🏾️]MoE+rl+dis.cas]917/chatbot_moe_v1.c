@@ -3,11 +3,13 @@
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <signal.h>
 
 #define MAX_LINE_LENGTH 1024
-#define MAX_VOCAB_SIZE 100000
 #define MAX_RESPONSE_TOKENS 100
-#define MAX_CURRICULA 10
+#define MAX_CURRICULA 64
+#define MAX_TOP_N 20
+#define MAX_SERVED_VOCABS 8
 
 // Structure to hold a vocabulary entry
 struct VocabEntry {
@@ -22,21 +24,11 @@ struct VocabEntry {
     float bias4;
 };
 
-// Structure to hold a complete vocabulary
-struct Vocabulary {
-    struct VocabEntry *entries;
-    int size;
-};
-
-// Function to find a word in the vocabulary
-int find_word(struct VocabEntry *vocab, int vocab_size, const char *word) {
-    for (int i = 0; i < vocab_size; i++) {
-        if (strcmp(vocab[i].word, word) == 0) {
-            return i;
-        }
-    }
-    return -1;
-}
+#include "vocab_index.h"
+#include "topk_index.h"
+#include "moe_router.h"
+#include "trace.h"
+#include "chat_protocol.h"
 
 // Function to apply softmax to a set of scores
 void softmax(float *scores, int size, float temperature) {
@@ -58,76 +50,177 @@ void softmax(float *scores, int size, float temperature) {
     }
 }
 
-// Function to load vocabulary from file
-int load_vocabulary(struct VocabEntry *vocab, const char *filename) {
-    FILE *infile = fopen(filename, "r");
-    if (!infile) {
-        perror("Error opening vocab file");
+// Map the merged vocabulary for these curricula, rebuilding index_file
+// first when it is missing or any curriculum changed. Duplicate words across
+// experts are merged into one entry that records which experts hold it.
+int load_merged_vocabulary(VocabIndex *vi, const char *index_file, char paths[][MAX_LINE_LENGTH], int num_curricula) {
+    if (vocab_index_open(index_file, vi, paths, num_curricula)) return 1;
+
+    fprintf(stderr, "Building vocabulary index %s\n", index_file);
+    if (!vocab_index_build(index_file, paths, num_curricula)) {
+        fprintf(stderr, "Failed to build vocabulary index %s\n", index_file);
+        return 0;
+    }
+    if (!vocab_index_open(index_file, vi, paths, num_curricula)) {
+        fprintf(stderr, "Failed to open vocabulary index %s\n", index_file);
         return 0;
     }
+    return 1;
+}
 
-    char line[MAX_LINE_LENGTH];
-    int vocab_size = 0;
-
-    // Skip header line
-    fgets(line, sizeof(line), infile);
-
-    while (fgets(line, sizeof(line), infile) && vocab_size < MAX_VOCAB_SIZE) {
-        sscanf(line, "%d %s %f %f %f %f %f %f %f",
-               &vocab[vocab_size].number,
-               vocab[vocab_size].word,
-               &vocab[vocab_size].embedding,
-               &vocab[vocab_size].pe,
-               &vocab[vocab_size].weight,
-               &vocab[vocab_size].bias1,
-               &vocab[vocab_size].bias2,
-               &vocab[vocab_size].bias3,
-               &vocab[vocab_size].bias4);
-        vocab_size++;
-    }
-
-    fclose(infile);
-    return vocab_size;
+// Candidate search state, built once and reused for every generated token
+struct Predictor {
+    const VocabIndex *vi;
+    Tracer *trace;
+    TopkIndex tree;             // every word, when routing is off
+    MoeRouter moe;              // one tree per curriculum, when on
+    int sparse;
+    int max_leaves;             // 0 for exact search, see TOPK_MAX_LEAVES
+    int top_indices[MAX_TOP_N];
+    float top_scores[MAX_TOP_N];
+    float top_probs[MAX_TOP_N];
+};
+
+static void entry_vector(const struct VocabEntry *e, float *vec) {
+    vec[0] = e->embedding; vec[1] = e->pe; vec[2] = e->weight;
+    vec[3] = e->bias1; vec[4] = e->bias2; vec[5] = e->bias3; vec[6] = e->bias4;
 }
 
-// Function to merge multiple vocabularies (MOE approach)
-// Simply concatenate all vocabularies without deduplication to preserve unique positional encodings
-int merge_vocabularies(struct VocabEntry *merged_vocab, struct Vocabulary *vocabularies, int num_vocabularies) {
-    int total_size = 0;
-    
-    // For MOE, we'll combine all vocabularies without deduplication
-    // This preserves unique positional encodings which can be very helpful
-    for (int v = 0; v < num_vocabularies && total_size < MAX_VOCAB_SIZE; v++) {
-        for (int i = 0; i < vocabularies[v].size && total_size < MAX_VOCAB_SIZE; i++) {
-            merged_vocab[total_size] = vocabularies[v].entries[i];
-            total_size++;
+// One expert per curriculum, holding the merged words that curriculum lists
+static int predictor_experts(struct Predictor *p, const float *vecs, int k, int dtype) {
+    const VocabIndex *vi = p->vi;
+    int n = (int)vi->header->nsources, total = 0, np;
+    for (int id = 0; id < vi->count; id++) {
+        vocab_index_provenance(vi, id, &np);
+        total += np;
+    }
+    int *members = malloc((size_t)(total ? total : 1) * sizeof(int));
+    int *starts = calloc(n + 2, sizeof(int));
+    if (!members || !starts) { free(members); free(starts); return 0; }
+    // Count each expert's words into starts[e + 2], sum them so starts[e + 1]
+    // is where expert e begins, then place ids in order, bumping starts[e + 1]
+    // to its end
+    for (int pass = 0; pass < 2; pass++) {
+        for (int id = 0; id < vi->count; id++) {
+            const VocabIndexProvenance *prov = vocab_index_provenance(vi, id, &np);
+            for (int i = 0; i < np; i++) {
+                int e = (int)prov[i].source, dup = 0;
+                for (int j = 0; j < i; j++) dup |= (int)prov[j].source == e;
+                if (e < 0 || e >= n || dup) continue;
+                if (pass == 0) starts[e + 2]++;
+                else members[starts[e + 1]++] = id;
+            }
         }
+        if (pass == 0) for (int e = 1; e <= n; e++) starts[e + 1] += starts[e];
     }
-    
-    return total_size;
+    int ok = moe_build(&p->moe, vecs, members, starts, n, k, dtype);
+    free(members);
+    free(starts);
+    return ok;
 }
 
-// Function to predict the next word using temperature sampling
-const char* predict_next_word(struct VocabEntry *vocab, int vocab_size, int current_word_index, float temperature) {
-    float *scores = malloc(vocab_size * sizeof(float));
-    if (!scores) {
-        return "end-token";
-    }
+int predictor_init(struct Predictor *p, const VocabIndex *vi, Tracer *trace) {
+    memset(p, 0, sizeof(*p));
+    p->vi = vi;
+    p->trace = trace;
+    const char *leaves = getenv("TOPK_MAX_LEAVES");
+    if (leaves) p->max_leaves = atoi(leaves);
+    float *vecs = malloc((size_t)vi->count * TOPK_DIM * sizeof(float));
+    if (!vecs) return 0;
+    for (int i = 0; i < vi->count; i++) entry_vector(&vi->entries[i], vecs + (size_t)i * TOPK_DIM);
+    // CHATBOT_QUANT=int8|fp16 keeps the tree's word vectors at that precision
+    const char *quant = getenv("CHATBOT_QUANT");
+    int dtype = quant_parse(quant);
+    if (quant && dtype < 0) fprintf(stderr, "Ignoring CHATBOT_QUANT=%s (expected int8, fp16 or f32)\n", quant);
+    // CHATBOT_MOE_TOPK=k searches only the k curricula the gate picks for
+    // each word (moe_router.h); 0, or k at least the number of curricula,
+    // searches one tree over the whole merged vocabulary
+    const char *topk = getenv("CHATBOT_MOE_TOPK");
+    int k = topk ? atoi(topk) : 2;
+    p->sparse = k > 0 && k < (int)vi->header->nsources;
+    int ok = p->sparse ? predictor_experts(p, vecs, k, dtype > 0 ? dtype : QUANT_F32)
+                       : topk_build(&p->tree, vecs, vi->count);
+    free(vecs);
+    if (ok && !p->sparse && dtype > 0) ok = topk_quantize(&p->tree, dtype);
+    return ok;
+}
 
-    // Get the vector of the current word
-    float current_word_vec[] = {vocab[current_word_index].embedding, vocab[current_word_index].pe, vocab[current_word_index].weight, vocab[current_word_index].bias1, vocab[current_word_index].bias2, vocab[current_word_index].bias3, vocab[current_word_index].bias4};
+void predictor_free(struct Predictor *p) {
+    topk_free(&p->tree);
+    moe_free(&p->moe);
+}
 
-    for (int i = 0; i < vocab_size; i++) {
-        float next_word_vec[] = {vocab[i].embedding, vocab[i].pe, vocab[i].weight, vocab[i].bias1, vocab[i].bias2, vocab[i].bias3, vocab[i].bias4};
-        // Simple dot product to influence the score
-        float dot_product = 0.0f;
-        for(int j=0; j<7; j++){
-            dot_product += current_word_vec[j] * next_word_vec[j];
+// Expert load since the last moe_reset_stats(), for the trace and, when
+// out is set, as a table
+void report_experts(struct Predictor *p, FILE *out, char paths[][MAX_LINE_LENGTH]) {
+    if (!p->sparse) return;
+    const MoeRouter *m = &p->moe;
+    float loss, busiest;
+    moe_balance(m, &loss, &busiest);
+    if (out) {
+        fprintf(out, "Experts: top %d of %d for %llu tokens, balance loss %.3f, busiest at %.2fx the even load\n",
+                m->k, m->n, (unsigned long long)m->tokens, loss, busiest);
+        for (int e = 0; e < m->n; e++) {
+            fprintf(out, "  %d. %u routed, mean gate %.3f, %d words: %s\n", e + 1, m->routed[e],
+                    m->tokens ? m->importance[e] / m->tokens : 0.0f, m->trees[e].n, paths[e]);
         }
-        scores[i] = dot_product;
     }
+    if (p->trace->level < TRACE_SUMMARY) return;
+    TraceRecord r;
+    trace_begin(&r, TRACE_EXPERTS);
+    trace_put_u32(&r, (uint32_t)m->tokens);
+    trace_put_u32(&r, m->k);
+    trace_put_u32(&r, m->n);
+    for (int e = 0; e < m->n; e++) {
+        trace_put_u32(&r, m->routed[e]);
+        trace_put_f32(&r, m->importance[e]);
+    }
+    trace_emit(p->trace, &r);
+}
 
-    softmax(scores, vocab_size, temperature);
+// Record one generation step: the current word, at TRACE_CANDIDATES the
+// top N with their scores and probabilities at this temperature among them,
+// and the chosen word with the experts that hold it
+void trace_step(struct Predictor *p, int current_word_index, float temperature, int top_n, int next_word_index) {
+    const struct VocabEntry *vocab = p->vi->entries;
+    TraceRecord r;
+    trace_begin(&r, TRACE_STEP);
+    trace_put_str(&r, vocab[current_word_index].word);
+    trace_put_i32(&r, current_word_index);
+    trace_put_f32(&r, temperature);
+    trace_put_u32(&r, top_n);
+    if (p->trace->level >= TRACE_CANDIDATES) {
+        memcpy(p->top_probs, p->top_scores, top_n * sizeof(float));
+        softmax(p->top_probs, top_n, temperature);
+        trace_put_u32(&r, top_n);
+        for (int i = 0; i < top_n; i++) {
+            trace_put_str(&r, vocab[p->top_indices[i]].word);
+            trace_put_i32(&r, p->top_indices[i]);
+            trace_put_f32(&r, p->top_scores[i]);
+            trace_put_f32(&r, p->top_probs[i]);
+        }
+    } else {
+        trace_put_u32(&r, 0);
+    }
+    trace_put_str(&r, vocab[next_word_index].word);
+    trace_put_i32(&r, next_word_index);
+    int n;
+    const VocabIndexProvenance *prov = vocab_index_provenance(p->vi, next_word_index, &n);
+    trace_put_u32(&r, n);
+    for (int i = 0; i < n; i++) {
+        trace_put_u32(&r, prov[i].source);
+        trace_put_u32(&r, prov[i].number);
+        trace_put_u32(&r, prov[i].occurrences);
+    }
+    trace_emit(p->trace, &r);
+}
+
+// Function to predict the next word using temperature sampling.
+// The top N candidates by dot product come from the k-d tree, so only the
+// entries in leaves that could beat the current N-th score are scored; with
+// routing on, only the trees of the experts the gate picks are searched.
+const char* predict_next_word(struct Predictor *p, int current_word_index, float temperature) {
+    const struct VocabEntry *vocab = p->vi->entries;
 
     // Determine how many top scores to consider based on temperature
     int top_n = 10;
@@ -136,108 +229,250 @@ const char* predict_next_word(struct VocabEntry *vocab, int vocab_size, int curr
     } else if (temperature > 2.0) {
         top_n = 20; // Less restrictive
     }
-    
-    // Make sure top_n doesn't exceed vocab_size
-    if (top_n > vocab_size) {
-        top_n = vocab_size;
-    }
-
-    // Save debug information to file
-    FILE *debug_file = fopen("debug_chain.txt", "a");
-    if (debug_file) {
-        fprintf(debug_file, "\nDebug: Current word: %s (index: %d)\n", vocab[current_word_index].word, current_word_index);
-        fprintf(debug_file, "Temperature: %f\n", temperature);
-        fprintf(debug_file, "Considering top %d scores:\n", top_n);
-        fclose(debug_file);
-    }
-
-    // Create array to store indices of top N scores
-    int *top_indices = malloc(top_n * sizeof(int));
-    float *top_scores = malloc(top_n * sizeof(float));
-    
-    // Initialize with first top_n elements
-    for (int i = 0; i < top_n; i++) {
-        top_indices[i] = i;
-        top_scores[i] = scores[i];
-    }
-    
-    // Find the actual top N scores using a simple selection sort approach
-    for (int i = 0; i < top_n; i++) {
-        int max_idx = i;
-        for (int j = i + 1; j < top_n; j++) {
-            if (top_scores[j] > top_scores[max_idx]) {
-                max_idx = j;
-            }
-        }
-        // Swap scores
-        float temp_score = top_scores[i];
-        top_scores[i] = top_scores[max_idx];
-        top_scores[max_idx] = temp_score;
-        // Swap indices
-        int temp_idx = top_indices[i];
-        top_indices[i] = top_indices[max_idx];
-        top_indices[max_idx] = temp_idx;
-    }
-    
-    // Now check the rest of the vocabulary to see if any scores are higher
-    for (int i = top_n; i < vocab_size; i++) {
-        for (int j = 0; j < top_n; j++) {
-            if (scores[i] > top_scores[j]) {
-                // Shift elements down
-                for (int k = top_n - 1; k > j; k--) {
-                    top_scores[k] = top_scores[k-1];
-                    top_indices[k] = top_indices[k-1];
-                }
-                // Insert new element
-                top_scores[j] = scores[i];
-                top_indices[j] = i;
-                break;
-            }
-        }
-    }
 
-    // Log top scores to debug file
-    debug_file = fopen("debug_chain.txt", "a");
-    if (debug_file) {
-        for (int i = 0; i < top_n; i++) {
-            fprintf(debug_file, "  %d. %s (index: %d): %f\n", i+1, vocab[top_indices[i]].word, top_indices[i], top_scores[i]);
-        }
-        fclose(debug_file);
+    float current_word_vec[TOPK_DIM];
+    entry_vector(&vocab[current_word_index], current_word_vec);
+    top_n = p->sparse ? moe_query(&p->moe, current_word_vec, top_n, p->max_leaves, p->top_indices, p->top_scores, NULL)
+                      : topk_query(&p->tree, current_word_vec, top_n, p->max_leaves, p->top_indices, p->top_scores);
+    if (top_n == 0) {
+        return "end-token";
     }
 
     // Randomly select from the top N indices
-    int next_word_index = top_indices[0]; // Default to top score
+    int next_word_index = p->top_indices[0]; // Default to top score
     
     if (top_n > 1) {
         // Use temperature to influence selection from top N
         float r = (float)rand() / (float)RAND_MAX;
         int selected_idx = (int)(r * top_n);
         if (selected_idx >= top_n) selected_idx = top_n - 1;
-        next_word_index = top_indices[selected_idx];
+        next_word_index = p->top_indices[selected_idx];
     }
 
-    // Log the chosen word
-    debug_file = fopen("debug_chain.txt", "a");
-    if (debug_file) {
-        fprintf(debug_file, "Chosen word: %s (index: %d)\n", vocab[next_word_index].word, next_word_index);
-        fclose(debug_file);
+    if (p->trace->level >= TRACE_STEPS) {
+        trace_step(p, current_word_index, temperature, top_n, next_word_index);
     }
 
-    free(scores);
-    free(top_indices);
-    free(top_scores);
-
     return vocab[next_word_index].word;
 }
 
+void trace_session(Tracer *tracer, const char *prompt, int desired_length, float temperature, char paths[][MAX_LINE_LENGTH], int num_curricula) {
+    if (tracer->level < TRACE_SUMMARY) return;
+    TraceRecord r;
+    trace_begin(&r, TRACE_SESSION);
+    trace_put_str(&r, prompt);
+    trace_put_i32(&r, desired_length);
+    trace_put_f32(&r, temperature);
+    trace_put_u32(&r, num_curricula);
+    for (int i = 0; i < num_curricula; i++) {
+        trace_put_str(&r, paths[i]);
+    }
+    trace_emit(tracer, &r);
+}
+
+void trace_response(Tracer *tracer, const char *response) {
+    if (tracer->level < TRACE_SUMMARY) return;
+    TraceRecord r;
+    trace_begin(&r, TRACE_RESPONSE);
+    trace_put_str(&r, response);
+    trace_emit(tracer, &r);
+}
+
+// Continue the prompt (split in place) into response, returning the number
+// of words generated. progress, when set, gets a running token counter.
+int generate_response(struct Predictor *p, char *prompt, int desired_length, float temperature, char *response, size_t response_size, FILE *progress) {
+    const VocabIndex *vi = p->vi;
+    char *token = strtok(prompt, " ");
+    int last_word_index = -1;
+
+    while (token != NULL) {
+        last_word_index = vocab_index_find(vi, token);
+        token = strtok(NULL, " ");
+    }
+
+    if (last_word_index == -1) {
+        last_word_index = vocab_index_find(vi, "start-token");
+    }
+    if (last_word_index == -1) {
+        last_word_index = 0;
+    }
+
+    int length_count = 0;
+    response[0] = '\0'; // Initialize empty string
+
+    // Ensure we have a minimum temperature for variety
+    float min_temperature = 0.1f;
+    if (temperature < min_temperature) temperature = min_temperature;
+
+    const char* next_word = predict_next_word(p, last_word_index, temperature);
+
+    // Generate at least one word
+    if (strcmp(next_word, "end-token") == 0) {
+        // Try once more with higher temperature
+        next_word = predict_next_word(p, last_word_index, temperature * 2.0f);
+    }
+
+    size_t used = 0;
+    while (strcmp(next_word, "end-token") != 0 && (desired_length == -1 || length_count < desired_length) && length_count < MAX_RESPONSE_TOKENS) {
+        int n = snprintf(response + used, response_size - used, "%s ", next_word);
+        if (n > 0) used = used + n < response_size ? used + n : response_size - 1;
+        if (progress) {
+            fprintf(progress, "\rGenerating response: %d/%d tokens", length_count + 1, desired_length == -1 ? MAX_RESPONSE_TOKENS : desired_length);
+            fflush(progress);
+        }
+
+        last_word_index = vocab_index_find(vi, next_word);
+        if (last_word_index == -1) {
+            // If word not found, use start-token
+            last_word_index = vocab_index_find(vi, "start-token");
+            if (last_word_index == -1) last_word_index = 0;
+        }
+        
+        next_word = predict_next_word(p, last_word_index, temperature);
+        length_count++;
+    }
+    return length_count;
+}
+
+// --- Server mode ---
+
+// A merged vocabulary kept mapped between requests, keyed by its curricula
+struct ServedVocab {
+    int loaded;
+    int num_curricula;
+    char paths[MAX_CURRICULA][MAX_LINE_LENGTH];
+    unsigned long last_used;
+    VocabIndex vi;
+    struct Predictor predictor;
+};
+
+static void served_vocab_free(struct ServedVocab *v) {
+    if (!v->loaded) return;
+    predictor_free(&v->predictor);
+    vocab_index_close(&v->vi);
+    v->loaded = 0;
+}
+
+// The vocabulary for this request's curricula, reusing a mapped one when
+// the set is unchanged on disk. The index file sits next to the socket,
+// named by a hash of the curriculum list.
+static struct ServedVocab *serve_vocab(struct ServedVocab *cache, const char *socket_path, const struct ChatRequest *req, Tracer *tracer, unsigned long now) {
+    char paths[MAX_CURRICULA][MAX_LINE_LENGTH];
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < req->num_curricula; i++) {
+        snprintf(paths[i], MAX_LINE_LENGTH, "%s", req->paths[i]);
+        h = (h ^ vocab_index_hash(paths[i])) * 16777619u;
+    }
+
+    struct ServedVocab *slot = &cache[0];
+    for (int i = 0; i < MAX_SERVED_VOCABS; i++) {
+        struct ServedVocab *v = &cache[i];
+        if (v->loaded && v->num_curricula == req->num_curricula && vocab_index_fresh(&v->vi, paths, req->num_curricula)) {
+            v->last_used = now;
+            return v;
+        }
+        if (!v->loaded || (slot->loaded && v->last_used < slot->last_used)) slot = v;
+    }
+
+    served_vocab_free(slot);
+    char index_file[MAX_LINE_LENGTH + 16];
+    snprintf(index_file, sizeof(index_file), "%s.%08x.vidx", socket_path, h);
+    if (!load_merged_vocabulary(&slot->vi, index_file, paths, req->num_curricula)) return NULL;
+    if (slot->vi.count == 0 || !predictor_init(&slot->predictor, &slot->vi, tracer)) {
+        vocab_index_close(&slot->vi);
+        return NULL;
+    }
+    memcpy(slot->paths, paths, sizeof(paths));
+    slot->num_curricula = req->num_curricula;
+    slot->last_used = now;
+    slot->loaded = 1;
+    return slot;
+}
+
+// Answer requests on a Unix domain socket until a QUIT request arrives.
+// One client is served at a time; each may send any number of requests.
+int serve(const char *socket_path) {
+    struct sockaddr_un addr;
+    if (!chat_socket_address(socket_path, &addr)) return 1;
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("Error creating socket");
+        return 1;
+    }
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 16) != 0) {
+        perror("Error listening on socket");
+        close(listen_fd);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);  // a client hanging up must not end the server
+
+    Tracer tracer;
+    const char *trace_file = getenv("CHATBOT_TRACE_FILE");
+    trace_open(&tracer, trace_file ? trace_file : TRACE_DEFAULT_FILE, trace_level_from_env());
+    fprintf(stderr, "Serving on %s\n", socket_path);
+
+    static struct ServedVocab cache[MAX_SERVED_VOCABS];
+    static struct ChatRequest req;
+    static char response[CHAT_MAX_RESPONSE];
+    unsigned long requests = 0;
+    int quit = 0;
+    while (!quit) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        FILE *in = fdopen(fd, "r");
+        FILE *out = fdopen(dup(fd), "w");
+        if (!in || !out) {
+            if (in) fclose(in); else close(fd);
+            if (out) fclose(out);
+            continue;
+        }
+        int status;
+        while (!quit && (status = chat_request_read(in, &req)) != 0) {
+            if (status < 0) {
+                chat_response_write(out, 0, 0, "malformed request");
+                break;
+            }
+            if (req.type == CHAT_QUIT) {
+                chat_response_write(out, 1, 0, "");
+                quit = 1;
+                break;
+            }
+            struct ServedVocab *v = serve_vocab(cache, socket_path, &req, &tracer, ++requests);
+            if (!v) {
+                chat_response_write(out, 0, 0, "could not load the requested curricula");
+                continue;
+            }
+            if (req.seed) srand(req.seed);
+            moe_reset_stats(&v->predictor.moe);
+            trace_session(&tracer, req.prompt, req.length, req.temperature, v->paths, v->num_curricula);
+            int tokens = generate_response(&v->predictor, req.prompt, req.length, req.temperature, response, sizeof(response), NULL);
+            trace_response(&tracer, response);
+            report_experts(&v->predictor, NULL, v->paths);
+            if (!chat_response_write(out, 1, tokens, response)) break;
+        }
+        fclose(in);
+        fclose(out);
+    }
+
+    for (int i = 0; i < MAX_SERVED_VOCABS; i++) served_vocab_free(&cache[i]);
+    trace_close(&tracer);
+    close(listen_fd);
+    unlink(socket_path);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "-serve") == 0) {
+        srand(time(NULL));
+        return serve(argc >= 3 ? argv[2] : CHAT_SOCKET_DEFAULT);
+    }
     if (argc < 3) {
-        fprintf(stderr, "Usage: %s <curriculum_bank.txt> \"<prompt>\" [length] [temperature]\n", argv[0]);
+        fprintf(stderr, "Usage: %s <curriculum_bank.txt> \"<prompt>\" [length] [temperature] [seed]\n", argv[0]);
+        fprintf(stderr, "       %s -serve [socket]   (default %s)\n", argv[0], CHAT_SOCKET_DEFAULT);
         return 1;
     }
 
-    srand(time(NULL));
-
     char *curriculum_bank_file = argv[1];
     char *prompt = argv[2];
     int desired_length = -1;
@@ -249,6 +484,7 @@ int main(int argc, char *argv[]) {
     if (argc >= 5) {
         temperature = atof(argv[4]);
     }
+    srand(argc >= 6 ? (unsigned int)strtoul(argv[5], NULL, 10) : (unsigned int)time(NULL));
 
     // Read curriculum paths from the bank file
     FILE *bank_file = fopen(curriculum_bank_file, "r");
@@ -276,114 +512,48 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // Load vocabularies from all curriculum files
-    struct Vocabulary vocabularies[MAX_CURRICULA];
+    VocabIndex merged_vocab;
+    char index_file[MAX_LINE_LENGTH + 8];
+    vocab_index_path(curriculum_bank_file, index_file, sizeof(index_file));
+    if (!load_merged_vocabulary(&merged_vocab, index_file, curriculum_paths, num_curricula)) {
+        return 1;
+    }
     for (int i = 0; i < num_curricula; i++) {
-        vocabularies[i].entries = malloc(MAX_VOCAB_SIZE * sizeof(struct VocabEntry));
-        if (!vocabularies[i].entries) {
-            perror("Failed to allocate memory for vocabulary");
-            // Free previously allocated vocabularies
-            for (int j = 0; j < i; j++) {
-                free(vocabularies[j].entries);
-            }
-            return 1;
-        }
-        vocabularies[i].size = load_vocabulary(vocabularies[i].entries, curriculum_paths[i]);
-        fprintf(stderr, "Loaded %d words from %s\n", vocabularies[i].size, curriculum_paths[i]);
+        fprintf(stderr, "Loaded %u words (%u distinct) from %s\n", merged_vocab.sources[i].rows, merged_vocab.sources[i].words, curriculum_paths[i]);
+    }
+    fprintf(stderr, "Merged vocabulary size: %d\n", merged_vocab.count);
+    if (merged_vocab.count == 0) {
+        fprintf(stderr, "No words found in any curriculum\n");
+        vocab_index_close(&merged_vocab);
+        return 1;
     }
+    Tracer tracer;
+    const char *trace_file = getenv("CHATBOT_TRACE_FILE");
+    trace_open(&tracer, trace_file ? trace_file : TRACE_DEFAULT_FILE, trace_level_from_env());
 
-    // Merge vocabularies (for MOE implementation, this would be more sophisticated)
-    struct VocabEntry *merged_vocab = malloc(MAX_VOCAB_SIZE * sizeof(struct VocabEntry));
-    if (!merged_vocab) {
-        perror("Failed to allocate memory for merged vocabulary");
-        // Free allocated vocabularies
-        for (int i = 0; i < num_curricula; i++) {
-            free(vocabularies[i].entries);
-        }
+    struct Predictor predictor;
+    if (!predictor_init(&predictor, &merged_vocab, &tracer)) {
+        fprintf(stderr, "Failed to build the candidate index\n");
+        trace_close(&tracer);
+        vocab_index_close(&merged_vocab);
         return 1;
     }
-    
-    int merged_vocab_size = merge_vocabularies(merged_vocab, vocabularies, num_curricula);
-    fprintf(stderr, "Merged vocabulary size: %d\n", merged_vocab_size);
 
     printf("Prompt: %s\n", prompt);
-    
-    // Create debug file and write prompt
-    FILE *debug_file = fopen("debug_chain.txt", "w");
-    if (debug_file) {
-        fprintf(debug_file, "=== Chatbot MOE Debug Log ===\n");
-        fprintf(debug_file, "Prompt: %s\n", prompt);
-        fprintf(debug_file, "Desired length: %d\n", desired_length);
-        fprintf(debug_file, "Temperature: %f\n", temperature);
-        fprintf(debug_file, "Using %d training sets:\n", num_curricula);
-        for (int i = 0; i < num_curricula; i++) {
-            fprintf(debug_file, "  %d. %s\n", i+1, curriculum_paths[i]);
-        }
-        fprintf(debug_file, "========================\n\n");
-        fclose(debug_file);
-    }
+    trace_session(&tracer, prompt, desired_length, temperature, curriculum_paths, num_curricula);
     
     printf("Generating response: ");
-
-    char *token = strtok(prompt, " ");
-    int last_word_index = -1;
-
-    while (token != NULL) {
-        last_word_index = find_word(merged_vocab, merged_vocab_size, token);
-        token = strtok(NULL, " ");
-    }
-
-    if (last_word_index == -1) {
-        last_word_index = find_word(merged_vocab, merged_vocab_size, "start-token");
-    }
-
-    int length_count = 0;
     char response_buffer[MAX_RESPONSE_TOKENS * 100]; // Max 100 tokens, each max 100 chars
-    response_buffer[0] = '\0'; // Initialize empty string
-
-    // Ensure we have a minimum temperature for variety
-    float min_temperature = 0.1f;
-    if (temperature < min_temperature) temperature = min_temperature;
-
-    const char* next_word = predict_next_word(merged_vocab, merged_vocab_size, last_word_index, temperature);
-
-    // Generate at least one word
-    if (strcmp(next_word, "end-token") == 0) {
-        // Try once more with higher temperature
-        next_word = predict_next_word(merged_vocab, merged_vocab_size, last_word_index, temperature * 2.0f);
-    }
-
-    while (strcmp(next_word, "end-token") != 0 && (desired_length == -1 || length_count < desired_length) && length_count < MAX_RESPONSE_TOKENS) {
-        snprintf(response_buffer + strlen(response_buffer), sizeof(response_buffer) - strlen(response_buffer), "%s ", next_word);
-        printf("\rGenerating response: %d/%d tokens", length_count + 1, desired_length == -1 ? MAX_RESPONSE_TOKENS : desired_length);
-        fflush(stdout);
-
-        last_word_index = find_word(merged_vocab, merged_vocab_size, next_word);
-        if (last_word_index == -1) {
-            // If word not found, use start-token
-            last_word_index = find_word(merged_vocab, merged_vocab_size, "start-token");
-        }
-        
-        next_word = predict_next_word(merged_vocab, merged_vocab_size, last_word_index, temperature);
-        length_count++;
-    }
+    generate_response(&predictor, prompt, desired_length, temperature, response_buffer, sizeof(response_buffer), stdout);
 
     printf("\rResponse: %s\n", response_buffer);
-    
-    // Write final response to debug file
-    debug_file = fopen("debug_chain.txt", "a");
-    if (debug_file) {
-        fprintf(debug_file, "\n=== Final Response ===\n");
-        fprintf(debug_file, "%s\n", response_buffer);
-        fprintf(debug_file, "======================\n");
-        fclose(debug_file);
-    }
+    trace_response(&tracer, response_buffer);
+    fflush(stdout);
+    report_experts(&predictor, stderr, curriculum_paths);
 
-    // Free allocated memory
-    free(merged_vocab);
-    for (int i = 0; i < num_curricula; i++) {
-        free(vocabularies[i].entries);
-    }
+    trace_close(&tracer);
+    predictor_free(&predictor);
+    vocab_index_close(&merged_vocab);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,356 @@
+#ifndef CORPUS_LOADER_H
+#define CORPUS_LOADER_H
+
+// Token stream for training on a text corpus (config.txt: corpus=<file>).
+//
+// The corpus is tokenized once into a binary file of vocabulary ids, split
+// exactly as vocab_model.c splits it (start-token at the start of the file,
+// end-token after . ? !). Words missing from the vocabulary are skipped and
+// counted. The file is rebuilt when the corpus changes size or modification
+// time, or when the vocabulary's words change.
+//
+// Layout:
+//   CorpusTokensHeader                    64 bytes
+//   uint32_t ids[count]
+//
+// Training walks the stream in windows of `window` next-word pairs; a
+// window reads window + 1 ids, so pairs across a window boundary are kept.
+// With a nonzero seed the window order is shuffled every epoch by a
+// Fisher-Yates pass seeded from (seed, epoch) alone, so a run reproduces
+// exactly whatever the timing. A background thread reads the next window
+// into the second half of a double buffer while the trainer works on the
+// first, so a slow disk costs nothing as long as reading a window is faster
+// than training on one.
+//
+// Environment:
+//   CORPUS_PREFETCH=0           read each window on the training thread
+//   CORPUS_READ_DELAY_US=N      sleep N microseconds per window read, to
+//                               measure the loader against slow storage
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define CORPUS_TOKENS_MAGIC "RDTK"
+#define CORPUS_TOKENS_VERSION 1
+#define CORPUS_TOKENS_FILE "corpus.tok"
+#define CORPUS_READ_CHUNK (1 << 16)
+#define CORPUS_MAX_WORD 100
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t count;         // ids in the stream
+    int64_t corpus_size;
+    int64_t corpus_mtime;   // nanoseconds
+    uint32_t vocab_hash;    // FNV-1a over the vocabulary words in order
+    uint32_t vocab_size;
+    uint64_t unknown;       // corpus words not in the vocabulary
+    uint8_t reserved[16];
+} CorpusTokensHeader;
+
+// --- Tokenizing ---
+
+static inline uint32_t corpus_hash(const char *word, uint32_t h) {
+    for (const unsigned char *p = (const unsigned char *)word; *p; p++) { h ^= *p; h *= 16777619u; }
+    return h;
+}
+
+static inline int64_t corpus_mtime(const struct stat *st) { return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec; }
+
+// The delimiters of vocab_model.c's is_word_delimiter()
+static inline int corpus_delimiter(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',' || c == ';' || c == ':' ||
+           c == '!' || c == '?' || c == '.' || c == '(' || c == ')' || c == '[' || c == ']' ||
+           c == '{' || c == '}' || c == '"' || c == '\'';
+}
+
+// Word -> first vocabulary row holding it, open addressing
+typedef struct {
+    const struct VocabEntry *vocab;
+    int *slots;
+    uint32_t mask;
+} CorpusWordTable;
+
+static inline int corpus_table_init(CorpusWordTable *t, const struct VocabEntry *vocab, int vs) {
+    uint32_t size = 16;
+    while (size < 2 * (uint32_t)vs) size *= 2;
+    t->vocab = vocab;
+    t->mask = size - 1;
+    t->slots = malloc(size * sizeof(int));
+    if (!t->slots) return 0;
+    memset(t->slots, -1, size * sizeof(int));
+    for (int i = 0; i < vs; i++) {
+        uint32_t s = corpus_hash(vocab[i].word, 2166136261u) & t->mask;
+        while (t->slots[s] >= 0 && strcmp(vocab[t->slots[s]].word, vocab[i].word) != 0) s = (s + 1) & t->mask;
+        if (t->slots[s] < 0) t->slots[s] = i;
+    }
+    return 1;
+}
+
+static inline int corpus_table_find(const CorpusWordTable *t, const char *word) {
+    for (uint32_t s = corpus_hash(word, 2166136261u) & t->mask; t->slots[s] >= 0; s = (s + 1) & t->mask)
+        if (strcmp(t->vocab[t->slots[s]].word, word) == 0) return t->slots[s];
+    return -1;
+}
+
+static inline uint32_t corpus_vocab_hash(const struct VocabEntry *vocab, int vs) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < vs; i++) h = corpus_hash(vocab[i].word, h) * 16777619u;
+    return h;
+}
+
+// Is tok_path the stream of this corpus under this vocabulary?
+static inline int corpus_tokens_fresh(const char *tok_path, const char *corpus_path, const struct VocabEntry *vocab, int vs) {
+    CorpusTokensHeader h;
+    struct stat st;
+    FILE *f = fopen(tok_path, "rb");
+    if (!f) return 0;
+    int ok = fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, CORPUS_TOKENS_MAGIC, 4) == 0 && h.version == CORPUS_TOKENS_VERSION &&
+             stat(corpus_path, &st) == 0 && h.corpus_size == (int64_t)st.st_size && h.corpus_mtime == corpus_mtime(&st) &&
+             h.vocab_size == (uint32_t)vs && h.vocab_hash == corpus_vocab_hash(vocab, vs);
+    fclose(f);
+    return ok;
+}
+
+typedef struct {
+    FILE *out;
+    uint32_t buf[4096];
+    int n;
+    uint64_t count, unknown;
+    const CorpusWordTable *table;
+} CorpusWriter;
+
+static inline void corpus_emit(CorpusWriter *w, const char *word) {
+    int id = corpus_table_find(w->table, word);
+    if (id < 0) { w->unknown++; return; }
+    w->buf[w->n++] = (uint32_t)id;
+    w->count++;
+    if (w->n == (int)(sizeof(w->buf) / sizeof(w->buf[0]))) { fwrite(w->buf, sizeof(uint32_t), w->n, w->out); w->n = 0; }
+}
+
+// Tokenize corpus_path into tok_path (written beside it and renamed over it)
+static inline int corpus_tokenize(const char *tok_path, const char *corpus_path, const struct VocabEntry *vocab, int vs) {
+    FILE *in = fopen(corpus_path, "rb");
+    if (!in) { fprintf(stderr, "Failed to open corpus %s\n", corpus_path); return 0; }
+    struct stat st;
+    CorpusWordTable table;
+    char *chunk = malloc(CORPUS_READ_CHUNK);
+    if (fstat(fileno(in), &st) != 0 || !chunk || !corpus_table_init(&table, vocab, vs)) { fclose(in); free(chunk); return 0; }
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", tok_path, (int)getpid());
+    CorpusWriter w;
+    memset(&w, 0, sizeof(w));
+    w.table = &table;
+    w.out = fopen(tmp, "wb");
+    if (!w.out) { fprintf(stderr, "Failed to open %s for writing\n", tmp); fclose(in); free(chunk); free(table.slots); return 0; }
+    CorpusTokensHeader h;
+    memset(&h, 0, sizeof(h));
+    fwrite(&h, sizeof(h), 1, w.out);
+
+    corpus_emit(&w, "start-token");
+    char word[CORPUS_MAX_WORD];
+    int len = 0, too_long = 0;
+    size_t n;
+    while ((n = fread(chunk, 1, CORPUS_READ_CHUNK, in)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            char c = chunk[i];
+            if (!corpus_delimiter(c)) {
+                if (len < CORPUS_MAX_WORD - 2) word[len++] = c; else too_long = 1;
+                continue;
+            }
+            if (len > 0 && !too_long) { word[len] = 0; corpus_emit(&w, word); }
+            len = too_long = 0;
+            if (c == '.' || c == '?' || c == '!') corpus_emit(&w, "end-token");
+        }
+    }
+    if (len > 0 && !too_long) { word[len] = 0; corpus_emit(&w, word); }
+    if (w.n) fwrite(w.buf, sizeof(uint32_t), w.n, w.out);
+
+    memcpy(h.magic, CORPUS_TOKENS_MAGIC, 4);
+    h.version = CORPUS_TOKENS_VERSION;
+    h.count = w.count;
+    h.corpus_size = st.st_size;
+    h.corpus_mtime = corpus_mtime(&st);
+    h.vocab_hash = corpus_vocab_hash(vocab, vs);
+    h.vocab_size = vs;
+    h.unknown = w.unknown;
+    fseek(w.out, 0, SEEK_SET);
+    fwrite(&h, sizeof(h), 1, w.out);
+    int ok = !ferror(w.out) && !ferror(in);
+    ok = fclose(w.out) == 0 && ok;
+    fclose(in);
+    free(chunk);
+    free(table.slots);
+    if (ok && rename(tmp, tok_path) != 0) { perror("Error renaming token stream"); ok = 0; }
+    if (!ok) unlink(tmp);
+    else fprintf(stderr, "Tokenized %s: %llu tokens, %llu words not in the vocabulary skipped\n", corpus_path,
+                 (unsigned long long)h.count, (unsigned long long)h.unknown);
+    return ok;
+}
+
+// --- Loading ---
+
+typedef struct {
+    int fd;
+    uint64_t count;
+    int window, nwindows, epochs;
+    uint32_t seed;
+    int prefetch;
+    long delay_us;
+    uint32_t *order;            // window order of the epoch being read
+    int order_epoch;
+    // Double buffer: window k (counted over all epochs) is read into slot
+    // k % 2; `next` is the next window to read, `taken` the next to train on
+    uint32_t *buf[2];
+    int len[2];
+    long next, taken, total;
+    double wait_sec;            // time the trainer spent waiting for data
+    int stop;
+    pthread_t thread;
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+} CorpusLoader;
+
+static inline uint32_t corpus_rng(uint64_t *s) {
+    // splitmix64
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+// Window order for an epoch: in stream order without a seed, otherwise a
+// shuffle that depends only on (seed, epoch)
+static inline void corpus_window_order(uint32_t *order, int n, uint32_t seed, int epoch) {
+    for (int i = 0; i < n; i++) order[i] = i;
+    if (!seed) return;
+    uint64_t s = ((uint64_t)seed << 32) ^ (uint64_t)(uint32_t)epoch;
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)(((uint64_t)corpus_rng(&s) * (uint64_t)(i + 1)) >> 32);
+        uint32_t t = order[i]; order[i] = order[j]; order[j] = t;
+    }
+}
+
+static inline double corpus_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Read window number k (over all epochs) into slot; returns its id count
+static inline int corpus_read_window(CorpusLoader *l, long k, uint32_t *dst) {
+    int epoch = (int)(k / l->nwindows);
+    if (epoch != l->order_epoch) { corpus_window_order(l->order, l->nwindows, l->seed, epoch); l->order_epoch = epoch; }
+    uint64_t first = (uint64_t)l->order[k % l->nwindows] * l->window;
+    uint64_t end = first + l->window + 1;
+    if (end > l->count) end = l->count;
+    size_t bytes = (size_t)(end - first) * sizeof(uint32_t), got = 0;
+    off_t off = (off_t)(sizeof(CorpusTokensHeader) + first * sizeof(uint32_t));
+    if (l->delay_us > 0) usleep(l->delay_us);
+    while (got < bytes) {
+        ssize_t r = pread(l->fd, (char*)dst + got, bytes - got, off + got);
+        if (r <= 0) { fprintf(stderr, "Failed to read the token stream\n"); return 0; }
+        got += r;
+    }
+    return (int)(end - first);
+}
+
+static inline void *corpus_prefetcher(void *arg) {
+    CorpusLoader *l = (CorpusLoader*)arg;
+    pthread_mutex_lock(&l->mu);
+    while (!l->stop && l->next < l->total) {
+        // The trainer holds window taken - 1, so slot next % 2 is free for
+        // window next = taken and no further
+        if (l->next > l->taken) { pthread_cond_wait(&l->cv, &l->mu); continue; }
+        long k = l->next;
+        pthread_mutex_unlock(&l->mu);
+        int n = corpus_read_window(l, k, l->buf[k % 2]);
+        pthread_mutex_lock(&l->mu);
+        l->len[k % 2] = n;
+        l->next++;
+        pthread_cond_broadcast(&l->cv);
+    }
+    pthread_mutex_unlock(&l->mu);
+    return NULL;
+}
+
+static inline void corpus_loader_close(CorpusLoader *l) {
+    if (l->prefetch && l->thread) {
+        pthread_mutex_lock(&l->mu);
+        l->stop = 1;
+        pthread_cond_broadcast(&l->cv);
+        pthread_mutex_unlock(&l->mu);
+        pthread_join(l->thread, NULL);
+    }
+    if (l->fd >= 0) close(l->fd);
+    free(l->order); free(l->buf[0]); free(l->buf[1]);
+    memset(l, 0, sizeof(*l));
+    l->fd = -1;
+}
+
+// Open a token stream for `epochs` passes of windows of `window` pairs
+static inline int corpus_loader_open(CorpusLoader *l, const char *tok_path, int window, uint32_t seed, int epochs) {
+    memset(l, 0, sizeof(*l));
+    l->fd = open(tok_path, O_RDONLY);
+    CorpusTokensHeader h;
+    if (l->fd < 0 || pread(l->fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || memcmp(h.magic, CORPUS_TOKENS_MAGIC, 4) != 0) {
+        fprintf(stderr, "Failed to open token stream %s\n", tok_path);
+        if (l->fd >= 0) close(l->fd);
+        l->fd = -1;
+        return 0;
+    }
+    l->count = h.count;
+    l->window = window > 0 ? window : 1;
+    l->nwindows = h.count > 1 ? (int)((h.count - 2) / l->window + 1) : 0;
+    l->epochs = epochs;
+    l->seed = seed;
+    l->total = (long)l->nwindows * epochs;
+    l->order_epoch = -1;
+    const char *s = getenv("CORPUS_PREFETCH");
+    l->prefetch = !s || atoi(s) != 0;
+    s = getenv("CORPUS_READ_DELAY_US");
+    l->delay_us = s ? atol(s) : 0;
+    l->order = malloc((l->nwindows ? l->nwindows : 1) * sizeof(uint32_t));
+    l->buf[0] = malloc((l->window + 1) * sizeof(uint32_t));
+    l->buf[1] = malloc((l->window + 1) * sizeof(uint32_t));
+    if (!l->order || !l->buf[0] || !l->buf[1]) { l->prefetch = 0; corpus_loader_close(l); return 0; }
+    pthread_mutex_init(&l->mu, NULL);
+    pthread_cond_init(&l->cv, NULL);
+    if (l->prefetch && pthread_create(&l->thread, NULL, corpus_prefetcher, l) != 0) l->prefetch = 0;
+    return 1;
+}
+
+// The next window's ids (pairs are ids[t], ids[t + 1]), or 0 after the
+// last window of the last epoch; each epoch is nwindows calls. The ids stay
+// valid until the following call.
+static inline int corpus_loader_next(CorpusLoader *l, const uint32_t **ids) {
+    if (l->taken >= l->total) return 0;
+    long k = l->taken;
+    double t = corpus_now();
+    int n;
+    if (!l->prefetch) {
+        n = corpus_read_window(l, k, l->buf[0]);
+        l->taken++;
+        *ids = l->buf[0];
+    } else {
+        pthread_mutex_lock(&l->mu);
+        while (l->next <= k) pthread_cond_wait(&l->cv, &l->mu);
+        // Taking window k releases the slot of window k - 1
+        l->taken = k + 1;
+        n = l->len[k % 2];
+        pthread_cond_broadcast(&l->cv);
+        pthread_mutex_unlock(&l->mu);
+        *ids = l->buf[k % 2];
+    }
+    l->wait_sec += corpus_now() - t;
+    return n;
+}
+
+#endif
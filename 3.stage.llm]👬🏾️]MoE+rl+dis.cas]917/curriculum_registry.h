@@ -0,0 +1,351 @@
+#ifndef CURRICULUM_REGISTRY_H
+#define CURRICULUM_REGISTRY_H
+
+// Curriculum registry and router for meta_rl.
+//
+// Every curriculum/<name>/<name>.txt vocabulary is an expert. Discovery
+// scans the curriculum directory and summarizes each vocabulary once:
+//   centroid   mean of the 7 word features (embedding, pe, weight, bias1-4)
+//   sketch     REGISTRY_SKETCH_BITS-bit set of word hashes, so the share of
+//              prompt words an expert knows is a few bit tests
+//   rows/words vocabulary size
+// Summaries are cached in a binary file keyed by path, size and mtime, so a
+// later run only re-reads curricula that changed.
+//
+// Cache layout: "RDCR", uint32 version, uint32 record size, uint32 count,
+// then CurriculumSummary[count].
+//
+// Routing scores all N experts in one pass over structure-of-arrays
+// parameters (one contiguous float array per feature, N long) and keeps the
+// best k:
+//   score[i] = weight[i] + bias[i]
+//            + sum_j feature_weight[j][i] * prompt_feature[j]
+//            + sum_j summary_weight[j] * summary[j][i]
+//            + overlap_weight * share of prompt words in sketch[i]
+// The per-expert terms learn what each curriculum is good for; the shared
+// summary and overlap weights let a newly discovered curriculum be ranked
+// before it has any history.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define REGISTRY_MAGIC "RDCR"
+#define REGISTRY_VERSION 1
+#define REGISTRY_PATH_LEN 1024
+#define REGISTRY_NAME_LEN 256
+#define REGISTRY_DIM 7
+#define REGISTRY_SKETCH_BITS 8192
+#define REGISTRY_SKETCH_WORDS (REGISTRY_SKETCH_BITS / 64)
+#define REGISTRY_DEFAULT_WEIGHT 0.5f
+
+#define ROUTE_PROMPT_FEATURES 7
+#define ROUTE_SUMMARY_FEATURES (REGISTRY_DIM + 1)   // centroid, log vocabulary size
+#define ROUTE_MAX_K 20
+#define ROUTE_MAX_PROMPT_WORDS 64
+
+typedef struct {
+    char path[REGISTRY_PATH_LEN];
+    char name[REGISTRY_NAME_LEN];   // directory name with [^A-Za-z0-9] -> '_'
+    int64_t size;
+    int64_t mtime;                  // nanoseconds
+    uint32_t rows;
+    uint32_t words;                 // distinct words
+    float centroid[REGISTRY_DIM];
+    float reserved;
+    uint64_t sketch[REGISTRY_SKETCH_WORDS];
+} CurriculumSummary;
+
+typedef struct {
+    int count, capacity;
+    CurriculumSummary *summaries;
+    // Routing parameters, [feature][capacity] so each feature is one run
+    float *weight, *bias;
+    float *feature_weight;          // ROUTE_PROMPT_FEATURES x capacity
+    float *summary;                 // ROUTE_SUMMARY_FEATURES x capacity, from the summaries
+    float summary_weight[ROUTE_SUMMARY_FEATURES];
+    float overlap_weight;
+    // Scratch of the last registry_route call
+    float *scores, *overlap;
+} CurriculumRegistry;
+
+static inline uint32_t registry_hash(const char *word) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)word; *p; p++) { h ^= *p; h *= 16777619u; }
+    return h;
+}
+
+static inline int64_t registry_mtime(const struct stat *st) { return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec; }
+
+static inline void registry_name(const char *dir_name, char *out) {
+    snprintf(out, REGISTRY_NAME_LEN, "%s", dir_name);
+    for (char *p = out; *p; p++) {
+        if (!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9'))) *p = '_';
+    }
+}
+
+// Read a vocabulary file (vocab_model.c layout) into s. Returns 0 if it
+// cannot be read or holds no rows.
+static inline int registry_summarize(const char *path, const struct stat *st, CurriculumSummary *s) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char line[1024], word[100];
+    int number;
+    float v[REGISTRY_DIM];
+    double sum[REGISTRY_DIM] = {0};
+    memset(s->sketch, 0, sizeof(s->sketch));
+    s->rows = s->words = 0;
+    if (!fgets(line, sizeof(line), f)) line[0] = 0;  // header
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%d %99s %f %f %f %f %f %f %f", &number, word, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]) != 9) continue;
+        uint32_t bit = registry_hash(word) % REGISTRY_SKETCH_BITS;
+        uint64_t mask = (uint64_t)1 << (bit % 64);
+        if (!(s->sketch[bit / 64] & mask)) s->words++;  // distinct up to sketch collisions
+        s->sketch[bit / 64] |= mask;
+        for (int j = 0; j < REGISTRY_DIM; j++) sum[j] += v[j];
+        s->rows++;
+    }
+    fclose(f);
+    if (s->rows == 0) return 0;
+    for (int j = 0; j < REGISTRY_DIM; j++) s->centroid[j] = sum[j] / s->rows;
+    s->size = st->st_size;
+    s->mtime = registry_mtime(st);
+    s->reserved = 0;
+    return 1;
+}
+
+static inline int registry_grow(CurriculumRegistry *r) {
+    int cap = r->capacity ? r->capacity * 2 : 64;
+    CurriculumSummary *s = realloc(r->summaries, cap * sizeof(*s));
+    if (!s) return 0;
+    r->summaries = s;
+    float *weight = calloc(cap, sizeof(float)), *bias = calloc(cap, sizeof(float));
+    float *fw = calloc((size_t)ROUTE_PROMPT_FEATURES * cap, sizeof(float));
+    float *sum = calloc((size_t)ROUTE_SUMMARY_FEATURES * cap, sizeof(float));
+    float *scores = calloc(cap, sizeof(float)), *overlap = calloc(cap, sizeof(float));
+    if (!weight || !bias || !fw || !sum || !scores || !overlap) {
+        free(weight); free(bias); free(fw); free(sum); free(scores); free(overlap);
+        return 0;
+    }
+    if (r->count) {
+        memcpy(weight, r->weight, r->count * sizeof(float));
+        memcpy(bias, r->bias, r->count * sizeof(float));
+        for (int j = 0; j < ROUTE_PROMPT_FEATURES; j++) memcpy(fw + (size_t)j * cap, r->feature_weight + (size_t)j * r->capacity, r->count * sizeof(float));
+        for (int j = 0; j < ROUTE_SUMMARY_FEATURES; j++) memcpy(sum + (size_t)j * cap, r->summary + (size_t)j * r->capacity, r->count * sizeof(float));
+    }
+    free(r->weight); free(r->bias); free(r->feature_weight); free(r->summary); free(r->scores); free(r->overlap);
+    r->weight = weight; r->bias = bias; r->feature_weight = fw; r->summary = sum;
+    r->scores = scores; r->overlap = overlap;
+    r->capacity = cap;
+    return 1;
+}
+
+// Append an expert with default routing parameters
+static inline int registry_add(CurriculumRegistry *r, const CurriculumSummary *s) {
+    if (r->count == r->capacity && !registry_grow(r)) return 0;
+    int i = r->count++;
+    r->summaries[i] = *s;
+    r->weight[i] = REGISTRY_DEFAULT_WEIGHT;
+    r->bias[i] = 0.0f;
+    for (int j = 0; j < ROUTE_PROMPT_FEATURES; j++) r->feature_weight[(size_t)j * r->capacity + i] = 0.0f;
+    for (int j = 0; j < REGISTRY_DIM; j++) r->summary[(size_t)j * r->capacity + i] = s->centroid[j];
+    r->summary[(size_t)REGISTRY_DIM * r->capacity + i] = log1pf((float)s->words) / 10.0f;
+    return 1;
+}
+
+static inline void registry_init(CurriculumRegistry *r) {
+    memset(r, 0, sizeof(*r));
+    r->overlap_weight = 1.0f;   // prefer experts that know the prompt's words
+}
+
+static inline void registry_free(CurriculumRegistry *r) {
+    free(r->summaries);
+    free(r->weight); free(r->bias); free(r->feature_weight); free(r->summary);
+    free(r->scores); free(r->overlap);
+    registry_init(r);
+}
+
+// Index of the expert called name, or -1
+static inline int registry_find(const CurriculumRegistry *r, const char *name) {
+    for (int i = 0; i < r->count; i++) {
+        if (strcmp(r->summaries[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+// --- Summary cache ---
+
+static inline CurriculumSummary *registry_cache_read(const char *path, int *count) {
+    *count = 0;
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    char magic[4];
+    uint32_t version, record, n;
+    CurriculumSummary *s = NULL;
+    if (fread(magic, 1, 4, f) == 4 && memcmp(magic, REGISTRY_MAGIC, 4) == 0 &&
+        fread(&version, 4, 1, f) == 1 && version == REGISTRY_VERSION &&
+        fread(&record, 4, 1, f) == 1 && record == sizeof(CurriculumSummary) &&
+        fread(&n, 4, 1, f) == 1 && n > 0 && (s = malloc((size_t)n * sizeof(*s)))) {
+        if (fread(s, sizeof(*s), n, f) == n) {
+            *count = n;
+        } else {
+            free(s);
+            s = NULL;
+        }
+    }
+    fclose(f);
+    return s;
+}
+
+static inline int registry_cache_write(const char *path, const CurriculumRegistry *r) {
+    char tmp[REGISTRY_PATH_LEN + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return 0;
+    uint32_t version = REGISTRY_VERSION, record = sizeof(CurriculumSummary), n = r->count;
+    int ok = fwrite(REGISTRY_MAGIC, 1, 4, f) == 4 && fwrite(&version, 4, 1, f) == 1 &&
+             fwrite(&record, 4, 1, f) == 1 && fwrite(&n, 4, 1, f) == 1 &&
+             fwrite(r->summaries, sizeof(CurriculumSummary), n, f) == n;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return 0;
+    }
+    return 1;
+}
+
+static inline int registry_compare_names(const void *a, const void *b) { return strcmp(*(char *const *)a, *(char *const *)b); }
+
+// Register every dir/<name>/<name>.txt in name order, taking unchanged
+// summaries from cache_path (NULL for no cache) and rewriting it when
+// anything was summarized or dropped. Returns the number of vocabularies
+// read, or -1 if dir cannot be opened.
+static inline int registry_discover(CurriculumRegistry *r, const char *dir, const char *cache_path) {
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+    char **names = NULL;
+    int n = 0, cap = 0;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        if (de->d_name[0] == '.') continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            char **grown = realloc(names, cap * sizeof(*names));
+            if (!grown) break;
+            names = grown;
+        }
+        if (!(names[n] = strdup(de->d_name))) break;
+        n++;
+    }
+    closedir(d);
+    qsort(names, n, sizeof(*names), registry_compare_names);
+
+    int cached = 0, summarized = 0;
+    CurriculumSummary *cache = cache_path ? registry_cache_read(cache_path, &cached) : NULL;
+    int reused = 0;
+    CurriculumSummary s;
+    for (int i = 0; i < n; i++) {
+        struct stat st;
+        memset(&s, 0, sizeof(s));
+        snprintf(s.path, sizeof(s.path), "%s/%s/%s.txt", dir, names[i], names[i]);
+        registry_name(names[i], s.name);
+        free(names[i]);
+        if (stat(s.path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        // The cache is in the same name order, so the match is usually at i
+        const CurriculumSummary *hit = NULL;
+        for (int k = 0; k < cached && !hit; k++) {
+            const CurriculumSummary *c = &cache[(i + k) % cached];
+            if (strcmp(c->path, s.path) == 0 && c->size == st.st_size && c->mtime == registry_mtime(&st)) hit = c;
+        }
+        if (hit) {
+            s = *hit;
+            reused++;
+        } else {
+            if (!registry_summarize(s.path, &st, &s)) continue;
+            summarized++;
+        }
+        if (!registry_add(r, &s)) break;
+    }
+    free(names);
+    free(cache);
+    if (cache_path && (summarized || reused != cached)) registry_cache_write(cache_path, r);
+    return summarized;
+}
+
+// --- Routing ---
+
+// Sketch bits of the prompt's words, as chatbot_moe_v1 splits them
+static inline int registry_prompt_bits(const char *prompt, uint32_t *bits, int max_bits) {
+    char word[100];
+    int n = 0;
+    const char *p = prompt;
+    while (*p && n < max_bits) {
+        while (*p == ' ') p++;
+        int len = 0;
+        while (p[len] && p[len] != ' ') len++;
+        if (len == 0) break;
+        snprintf(word, sizeof(word), "%.*s", len, p);
+        bits[n++] = registry_hash(word) % REGISTRY_SKETCH_BITS;
+        p += len;
+    }
+    return n;
+}
+
+// Score every expert for this prompt and return the best k (ids and scores
+// in descending order, ties to the lower id). Scores and word overlaps of
+// all experts stay in r->scores and r->overlap for the update.
+static inline int registry_route(CurriculumRegistry *r, const float *features, const uint32_t *bits, int nbits, int k, int *ids, float *top) {
+    int n = r->count;
+    size_t stride = r->capacity;
+    float *restrict score = r->scores, *restrict overlap = r->overlap;
+    const float *restrict weight = r->weight, *restrict bias = r->bias;
+    for (int i = 0; i < n; i++) {
+        score[i] = weight[i] + bias[i];
+        overlap[i] = 0.0f;
+    }
+    for (int j = 0; j < ROUTE_PROMPT_FEATURES; j++) {
+        const float *restrict w = r->feature_weight + j * stride;
+        float f = features[j];
+        if (f == 0.0f) continue;
+        for (int i = 0; i < n; i++) score[i] += w[i] * f;
+    }
+    for (int j = 0; j < ROUTE_SUMMARY_FEATURES; j++) {
+        const float *restrict s = r->summary + j * stride;
+        float u = r->summary_weight[j];
+        if (u == 0.0f) continue;
+        for (int i = 0; i < n; i++) score[i] += s[i] * u;
+    }
+    if (nbits > 0) {
+        for (int b = 0; b < nbits; b++) {
+            uint32_t word = bits[b] / 64, shift = bits[b] % 64;
+            for (int i = 0; i < n; i++) overlap[i] += (float)((r->summaries[i].sketch[word] >> shift) & 1);
+        }
+        float scale = 1.0f / nbits;
+        for (int i = 0; i < n; i++) {
+            overlap[i] *= scale;
+            score[i] += overlap[i] * r->overlap_weight;
+        }
+    }
+
+    if (k > ROUTE_MAX_K) k = ROUTE_MAX_K;
+    if (k > n) k = n;
+    int found = 0;
+    for (int i = 0; i < n; i++) {
+        if (found == k && score[i] <= top[k - 1]) continue;
+        int at = found < k ? found++ : k - 1;
+        while (at > 0 && score[i] > top[at - 1]) {
+            top[at] = top[at - 1];
+            ids[at] = ids[at - 1];
+            at--;
+        }
+        top[at] = score[i];
+        ids[at] = i;
+    }
+    return found;
+}
+
+#endif
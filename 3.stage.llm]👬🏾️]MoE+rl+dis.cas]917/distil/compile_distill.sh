@@ -1,11 +1,11 @@
 #!/bin/bash
 
 # Compile the knowledge distillation framework
-gcc -o distill distill.c -lm
+gcc -o distill distill.c -pthread -lm
 
 if [ $? -eq 0 ]; then
     echo "Knowledge distillation framework compiled successfully."
-    echo "Usage: ./distill <teacher_model_dir> <student_model_dir> <vocab_file> [distill_weight]"
+    echo "Usage: ./distill <teacher_model_dir> <student_model_dir> <vocab_file> [distill_weight] [-epochs N] [-batch N] [-threads N] [-topk K]"
 else
     echo "Error compiling knowledge distillation framework."
 fi
\ No newline at end of file
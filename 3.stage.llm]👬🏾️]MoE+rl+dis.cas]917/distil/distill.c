@@ -2,12 +2,36 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 
 #define MAX_VOCAB_SIZE 100000
 #define EMBEDDING_DIM 7
 #define HIDDEN_DIM 16
 #define TEMPERATURE 3.0f  // Temperature for softening probability distributions
 
+#define DEFAULT_EPOCHS 10
+#define DEFAULT_BATCH 32
+#define DEFAULT_TOPK 32
+#define DEFAULT_LEARNING_RATE 0.001f
+#define DEFAULT_SEED 42
+#define MAX_THREADS 16
+
+// Teacher logit cache, written once per teacher/corpus:
+//   TeacherCacheHeader
+//   uint32_t ids[tokens][k]       top-k columns of each token's teacher logits
+//   float logits[tokens][k]       their raw logits
+//   float tail[tokens]            teacher probability (at the temperature)
+//                                 outside the top k
+// The header records size and mtime of the vocabulary and the three teacher
+// model files; any change, or a different k or temperature, rebuilds it.
+#define TEACHER_CACHE_MAGIC "RDKD"
+#define TEACHER_CACHE_VERSION 1
+#define TEACHER_CACHE_FILE "teacher_topk.kdc"
+
 // Structure to hold a vocabulary entry
 struct VocabEntry {
     int number;
@@ -21,16 +45,7 @@ struct VocabEntry {
     float bias4;
 };
 
-// Structure for model parameters
-typedef struct {
-    float W_q[EMBEDDING_DIM][EMBEDDING_DIM];
-    float W_k[EMBEDDING_DIM][EMBEDDING_DIM];
-    float W_v[EMBEDDING_DIM][EMBEDDING_DIM];
-    float mlp_weights[EMBEDDING_DIM][HIDDEN_DIM];
-    float mlp_biases[HIDDEN_DIM];
-    float output_weights[HIDDEN_DIM][MAX_VOCAB_SIZE];
-    float output_biases[MAX_VOCAB_SIZE];
-} ModelParams;
+#include "../train_engine.h"
 
 // Function to load vocabulary
 int load_vocabulary(struct VocabEntry *vocab, const char *filename) {
@@ -99,13 +114,13 @@ void softmax_with_temperature(float *x, int size, float temperature) {
             max_val = x[i];
         }
     }
-    
+
     float sum = 0.0f;
     for (int i = 0; i < size; i++) {
         x[i] = expf((x[i] - max_val) / temperature);
         sum += x[i];
     }
-    
+
     for (int i = 0; i < size; i++) {
         x[i] /= sum;
     }
@@ -116,15 +131,15 @@ float compute_distillation_loss(float *teacher_logits, float *student_logits, in
     // Apply softmax with temperature to both teacher and student logits
     float *teacher_probs = malloc(size * sizeof(float));
     float *student_probs = malloc(size * sizeof(float));
-    
+
     for (int i = 0; i < size; i++) {
         teacher_probs[i] = teacher_logits[i];
         student_probs[i] = student_logits[i];
     }
-    
+
     softmax_with_temperature(teacher_probs, size, temperature);
     softmax_with_temperature(student_probs, size, temperature);
-    
+
     // Compute KL divergence
     float loss = 0.0f;
     for (int i = 0; i < size; i++) {
@@ -132,181 +147,634 @@ float compute_distillation_loss(float *teacher_logits, float *student_logits, in
             loss += teacher_probs[i] * logf(teacher_probs[i] / student_probs[i]);
         }
     }
-    
+
     free(teacher_probs);
     free(student_probs);
-    
+
     return loss;
 }
 
-// Function to load model parameters
-int load_model_params(ModelParams *params, const char *model_dir) {
-    char filepath[1024];
-    
-    // Load attention parameters
-    sprintf(filepath, "%s/attention_model.txt", model_dir);
-    FILE *file = fopen(filepath, "rb");
-    if (!file) {
-        printf("Warning: Could not load attention model from %s\n", filepath);
-        return 0;
+// Gradient of the distillation objective for one token with respect to the
+// student logits z:
+//   distill_weight * T^2 * KL(teacher || softmax(z / T))
+//     + (1 - distill_weight) * cross entropy of softmax(z) for target
+// The teacher distribution is n (column, probability) pairs; ids NULL means
+// all columns in order. The KL uses the same 1e-10 guard as
+// compute_distillation_loss. Returns the KL; the cross entropy goes to *ce.
+float distillation_gradient(const float *z, int vs, const uint32_t *ids, const float *teacher_probs, int n,
+                            int target, float temperature, float distill_weight, float *grad, float *scratch, float *ce) {
+    memcpy(grad, z, vs * sizeof(float));
+    softmax_with_temperature(grad, vs, 1.0f);
+    memcpy(scratch, z, vs * sizeof(float));
+    softmax_with_temperature(scratch, vs, temperature);
+
+    float kl = 0.0f;
+    for (int t = 0; t < n; t++) {
+        float p = teacher_probs[t], q = scratch[ids ? ids[t] : (uint32_t)t];
+        if (p > 1e-10f && q > 1e-10f) kl += p * logf(p / q);
     }
-    fread(params->W_q, sizeof(float), EMBEDDING_DIM * EMBEDDING_DIM, file);
-    fread(params->W_k, sizeof(float), EMBEDDING_DIM * EMBEDDING_DIM, file);
-    fread(params->W_v, sizeof(float), EMBEDDING_DIM * EMBEDDING_DIM, file);
-    fclose(file);
-    
-    // Load MLP parameters
-    sprintf(filepath, "%s/mlp_model.txt", model_dir);
-    file = fopen(filepath, "rb");
-    if (!file) {
-        printf("Warning: Could not load MLP model from %s\n", filepath);
-        return 0;
+    *ce = -logf(grad[target] + EPSILON);
+
+    // d(T^2 KL)/dz = T * (student - teacher), d(CE)/dz = softmax(z) - onehot
+    float hard = 1.0f - distill_weight, soft = distill_weight * temperature;
+    for (int j = 0; j < vs; j++) grad[j] = hard * grad[j] + soft * scratch[j];
+    grad[target] -= hard;
+    for (int t = 0; t < n; t++) grad[ids ? ids[t] : (uint32_t)t] -= soft * teacher_probs[t];
+    return kl;
+}
+
+// --- Model files ---
+
+typedef struct {
+    char attn[1024], mlp[1024], out[1024], optim[1024];
+} ModelPaths;
+
+// Model files of dir: the .bin tensor files if the directory has them,
+// the text files otherwise
+void model_paths(const char *dir, ModelPaths *p) {
+    struct stat st;
+    char probe[1024];
+    snprintf(probe, sizeof(probe), "%s/attention_model.bin", dir);
+    const char *ext = stat(probe, &st) == 0 ? ".bin" : ".txt";
+    snprintf(p->attn, sizeof(p->attn), "%s/attention_model%s", dir, ext);
+    snprintf(p->mlp, sizeof(p->mlp), "%s/mlp_model%s", dir, ext);
+    snprintf(p->out, sizeof(p->out), "%s/output_layer%s", dir, ext);
+    snprintf(p->optim, sizeof(p->optim), "%s/optimizer_state.txt", dir);
+}
+
+// --- Teacher logit cache ---
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t vocab_size, tokens, k;
+    float temperature;
+    int64_t source_size[4];     // vocabulary, attention, MLP, output layer
+    int64_t source_mtime[4];    // nanoseconds
+} TeacherCacheHeader;
+
+typedef struct {
+    TeacherCacheHeader header;
+    uint32_t *ids;
+    float *logits;
+    float *tail;
+} TeacherCache;
+
+void teacher_cache_key(TeacherCacheHeader *h, const char *vocab_file, const ModelPaths *teacher, int vs, int k, float temperature) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, TEACHER_CACHE_MAGIC, 4);
+    h->version = TEACHER_CACHE_VERSION;
+    h->vocab_size = vs;
+    h->tokens = vs - 1;
+    h->k = k;
+    h->temperature = temperature;
+    const char *sources[4] = { vocab_file, teacher->attn, teacher->mlp, teacher->out };
+    for (int i = 0; i < 4; i++) {
+        struct stat st;
+        h->source_size[i] = -1;
+        if (stat(sources[i], &st) == 0) {
+            h->source_size[i] = st.st_size;
+            h->source_mtime[i] = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        }
+    }
+}
+
+int teacher_cache_alloc(TeacherCache *c) {
+    size_t n = (size_t)c->header.tokens * c->header.k;
+    c->ids = malloc(n * sizeof(uint32_t));
+    c->logits = malloc(n * sizeof(float));
+    c->tail = malloc(c->header.tokens * sizeof(float));
+    return c->ids && c->logits && c->tail;
+}
+
+void teacher_cache_free(TeacherCache *c) {
+    free(c->ids);
+    free(c->logits);
+    free(c->tail);
+    c->ids = NULL;
+    c->logits = c->tail = NULL;
+}
+
+// Load the cache at path if it was built from exactly this key
+int teacher_cache_read(TeacherCache *c, const char *path, const TeacherCacheHeader *key) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return 0;
+    int ok = fread(&c->header, sizeof(c->header), 1, file) == 1 && memcmp(&c->header, key, sizeof(*key)) == 0;
+    if (ok) {
+        size_t n = (size_t)key->tokens * key->k;
+        ok = teacher_cache_alloc(c) &&
+             fread(c->ids, sizeof(uint32_t), n, file) == n &&
+             fread(c->logits, sizeof(float), n, file) == n &&
+             fread(c->tail, sizeof(float), key->tokens, file) == key->tokens;
+        if (!ok) teacher_cache_free(c);
     }
-    fread(params->mlp_weights, sizeof(float), EMBEDDING_DIM * HIDDEN_DIM, file);
-    fread(params->mlp_biases, sizeof(float), HIDDEN_DIM, file);
     fclose(file);
-    
-    // Load output parameters
-    sprintf(filepath, "%s/output_layer.txt", model_dir);
-    file = fopen(filepath, "rb");
-    if (!file) {
-        printf("Warning: Could not load output model from %s\n", filepath);
+    return ok;
+}
+
+int teacher_cache_write(const TeacherCache *c, const char *path) {
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *file = fopen(tmp, "wb");
+    if (!file) return 0;
+    size_t n = (size_t)c->header.tokens * c->header.k;
+    int ok = fwrite(&c->header, sizeof(c->header), 1, file) == 1 &&
+             fwrite(c->ids, sizeof(uint32_t), n, file) == n &&
+             fwrite(c->logits, sizeof(float), n, file) == n &&
+             fwrite(c->tail, sizeof(float), c->header.tokens, file) == c->header.tokens;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
         return 0;
     }
-    fread(params->output_weights, sizeof(float), HIDDEN_DIM * MAX_VOCAB_SIZE, file);
-    fread(params->output_biases, sizeof(float), MAX_VOCAB_SIZE, file);
-    fclose(file);
-    
     return 1;
 }
 
-// Function to save model parameters
-void save_model_params(ModelParams *params, const char *model_dir) {
-    char filepath[1024];
-    
-    // Save attention parameters
-    sprintf(filepath, "%s/attention_model.txt", model_dir);
-    FILE *file = fopen(filepath, "wb");
-    if (file) {
-        fwrite(params->W_q, sizeof(float), EMBEDDING_DIM * EMBEDDING_DIM, file);
-        fwrite(params->W_k, sizeof(float), EMBEDDING_DIM * EMBEDDING_DIM, file);
-        fwrite(params->W_v, sizeof(float), EMBEDDING_DIM * EMBEDDING_DIM, file);
-        fclose(file);
-    }
-    
-    // Save MLP parameters
-    sprintf(filepath, "%s/mlp_model.txt", model_dir);
-    file = fopen(filepath, "wb");
-    if (file) {
-        fwrite(params->mlp_weights, sizeof(float), EMBEDDING_DIM * HIDDEN_DIM, file);
-        fwrite(params->mlp_biases, sizeof(float), HIDDEN_DIM, file);
-        fclose(file);
-    }
-    
-    // Save output parameters
-    sprintf(filepath, "%s/output_layer.txt", model_dir);
-    file = fopen(filepath, "wb");
-    if (file) {
-        fwrite(params->output_weights, sizeof(float), HIDDEN_DIM * MAX_VOCAB_SIZE, file);
-        fwrite(params->output_biases, sizeof(float), MAX_VOCAB_SIZE, file);
-        fclose(file);
+// Keep the k largest logits of z (all of them, in column order, when k
+// equals the vocabulary size) and the teacher mass left outside them
+void teacher_topk(const float *z, int vs, int k, float temperature, uint32_t *ids, float *vals, float *tail) {
+    if (k >= vs) {
+        for (int j = 0; j < vs; j++) { ids[j] = j; vals[j] = z[j]; }
+        *tail = 0.0f;
+        return;
+    }
+    int found = 0;
+    for (int j = 0; j < vs; j++) {
+        if (found == k && z[j] <= vals[k - 1]) continue;
+        int at = found < k ? found++ : k - 1;
+        while (at > 0 && z[j] > vals[at - 1]) {
+            vals[at] = vals[at - 1];
+            ids[at] = ids[at - 1];
+            at--;
+        }
+        vals[at] = z[j];
+        ids[at] = j;
     }
+    double sum = 0.0, kept = 0.0;
+    for (int j = 0; j < vs; j++) sum += exp((z[j] - vals[0]) / temperature);
+    for (int t = 0; t < k; t++) kept += exp((vals[t] - vals[0]) / temperature);
+    *tail = (float)(1.0 - kept / sum);
 }
 
-// Function to distill knowledge from teacher to student
-void distill_knowledge(const char *teacher_model_dir, const char *student_model_dir, 
-                      const char *vocab_file, float distill_weight) {
-    struct VocabEntry vocab[MAX_VOCAB_SIZE];
-    int vocab_size = load_vocabulary(vocab, vocab_file);
-    
-    if (vocab_size == 0) {
-        printf("Failed to load vocabulary\n");
-        return;
+// Teacher distribution over the cached top k of a token, renormalized
+void teacher_probs(const TeacherCache *c, int token, float *probs) {
+    int k = c->header.k;
+    memcpy(probs, c->logits + (size_t)token * k, k * sizeof(float));
+    softmax_with_temperature(probs, k, c->header.temperature);
+}
+
+// --- Workers ---
+//
+// A minibatch is split into one contiguous token slice per worker. Each
+// worker runs forward and backward on its own TrainEngine scratch, reading
+// the shared model, and sums its tokens' gradients. The main thread then
+// adds the sums in worker order and takes one Adam step.
+
+typedef struct DistillPool DistillPool;
+
+typedef struct {
+    DistillPool *pool;
+    int id;
+    TrainEngine e;              // activations only; parameters are the shared model's
+    AttentionLayer g_attn;      // gradient sums over the worker's tokens
+    MlpLayer g_mlp;
+    OutputLayer g_out;
+    float *scratch, *probs;
+    double kl, ce;
+    pthread_t thread;
+} DistillWorker;
+
+struct DistillPool {
+    int n;
+    DistillWorker *workers;
+    pthread_mutex_t mu;
+    pthread_cond_t work_cv, done_cv;
+    int generation, pending, quit;
+    void (*task)(DistillWorker *w, int token);
+    int begin, end;
+    // Shared state of the current job
+    struct VocabEntry *vocab;
+    const TrainEngine *model;
+    TeacherCache *cache;
+    float temperature, distill_weight;
+};
+
+int worker_init(DistillWorker *w, int vs, int k) {
+    memset(w, 0, sizeof(*w));
+    w->e.vs = vs;
+    w->e.as = malloc(vs * sizeof(float));
+    w->e.preds = malloc(vs * sizeof(float));
+    w->e.grad_loss = malloc(vs * sizeof(float));
+    w->e.g_as = malloc(vs * sizeof(float));
+    w->scratch = malloc(vs * sizeof(float));
+    w->probs = malloc((k > vs ? k : vs) * sizeof(float));
+    return w->e.as && w->e.preds && w->e.grad_loss && w->e.g_as && w->scratch && w->probs &&
+           alloc_output(&w->e.g_out, vs) && alloc_output(&w->g_out, vs);
+}
+
+void worker_free(DistillWorker *w) {
+    free(w->e.as); free(w->e.preds); free(w->e.grad_loss); free(w->e.g_as);
+    free(w->e.feat_cols); free(w->e.feat_sums);
+    free_output(&w->e.g_out); free_output(&w->g_out);
+    free(w->scratch); free(w->probs);
+}
+
+// Point the worker's engine at a model's parameters
+void worker_bind(DistillWorker *w, const TrainEngine *model) {
+    w->e.attn = model->attn;
+    w->e.mlp = model->mlp;
+    w->e.out = model->out;
+}
+
+void worker_clear(DistillWorker *w) {
+    memset(&w->g_attn, 0, sizeof(w->g_attn));
+    memset(&w->g_mlp, 0, sizeof(w->g_mlp));
+    memset(output_flat(&w->g_out), 0, (size_t)(HIDDEN_DIM + 1) * w->e.vs * sizeof(float));
+    w->kl = w->ce = 0.0;
+}
+
+// Add the token gradients the engine's backward pass left in e.g_*
+void worker_accumulate(DistillWorker *w) {
+    float *g = (float*)&w->g_attn, *d = (float*)&w->e.g_attn;
+    for (size_t i = 0; i < sizeof(AttentionLayer) / sizeof(float); i++) g[i] += d[i];
+    g = (float*)&w->g_mlp; d = (float*)&w->e.g_mlp;
+    for (size_t i = 0; i < sizeof(MlpLayer) / sizeof(float); i++) g[i] += d[i];
+    g = output_flat(&w->g_out); d = output_flat(&w->e.g_out);
+    size_t n = (size_t)(HIDDEN_DIM + 1) * w->e.vs;
+    for (size_t i = 0; i < n; i++) g[i] += d[i];
+}
+
+void worker_run_slice(DistillWorker *w) {
+    DistillPool *p = w->pool;
+    int count = p->end - p->begin;
+    int begin = p->begin + (int)((long)count * w->id / p->n);
+    int end = p->begin + (int)((long)count * (w->id + 1) / p->n);
+    for (int token = begin; token < end; token++) p->task(w, token);
+}
+
+void *worker_main(void *arg) {
+    DistillWorker *w = arg;
+    DistillPool *p = w->pool;
+    int seen = 0;
+    pthread_mutex_lock(&p->mu);
+    for (;;) {
+        while (p->generation == seen && !p->quit) pthread_cond_wait(&p->work_cv, &p->mu);
+        if (p->quit) break;
+        seen = p->generation;
+        pthread_mutex_unlock(&p->mu);
+        worker_run_slice(w);
+        pthread_mutex_lock(&p->mu);
+        if (--p->pending == 0) pthread_cond_signal(&p->done_cv);
+    }
+    pthread_mutex_unlock(&p->mu);
+    return NULL;
+}
+
+int pool_start(DistillPool *p, int n, int vs, int k) {
+    p->n = n;
+    p->workers = calloc(n, sizeof(DistillWorker));
+    if (!p->workers) return 0;
+    pthread_mutex_init(&p->mu, NULL);
+    pthread_cond_init(&p->work_cv, NULL);
+    pthread_cond_init(&p->done_cv, NULL);
+    p->generation = p->pending = p->quit = 0;
+    for (int i = 0; i < n; i++) {
+        if (!worker_init(&p->workers[i], vs, k)) return 0;
+        p->workers[i].pool = p;
+        p->workers[i].id = i;
+    }
+    // Worker 0 is the calling thread
+    for (int i = 1; i < n; i++) {
+        if (pthread_create(&p->workers[i].thread, NULL, worker_main, &p->workers[i]) != 0) {
+            fprintf(stderr, "Failed to start distillation thread %d\n", i);
+            p->n = i;
+            break;
+        }
     }
-    
-    ModelParams teacher_params, student_params;
-    
-    // Load teacher model
-    if (!load_model_params(&teacher_params, teacher_model_dir)) {
+    return 1;
+}
+
+void pool_stop(DistillPool *p) {
+    pthread_mutex_lock(&p->mu);
+    p->quit = 1;
+    pthread_cond_broadcast(&p->work_cv);
+    pthread_mutex_unlock(&p->mu);
+    for (int i = 1; i < p->n; i++) pthread_join(p->workers[i].thread, NULL);
+    for (int i = 0; i < p->n; i++) worker_free(&p->workers[i]);
+    free(p->workers);
+    pthread_mutex_destroy(&p->mu);
+    pthread_cond_destroy(&p->work_cv);
+    pthread_cond_destroy(&p->done_cv);
+}
+
+// Run task on every token of [begin, end) and wait for all workers
+void pool_run(DistillPool *p, void (*task)(DistillWorker *, int), int begin, int end) {
+    pthread_mutex_lock(&p->mu);
+    p->task = task;
+    p->begin = begin;
+    p->end = end;
+    p->pending = p->n - 1;
+    p->generation++;
+    pthread_cond_broadcast(&p->work_cv);
+    pthread_mutex_unlock(&p->mu);
+    worker_run_slice(&p->workers[0]);
+    pthread_mutex_lock(&p->mu);
+    while (p->pending > 0) pthread_cond_wait(&p->done_cv, &p->mu);
+    pthread_mutex_unlock(&p->mu);
+}
+
+// Teacher inference for one token into the cache
+void teacher_task(DistillWorker *w, int token) {
+    DistillPool *p = w->pool;
+    TeacherCache *c = p->cache;
+    int k = c->header.k;
+    if (!train_engine_forward(&w->e, p->vocab, token, 0)) memset(w->e.preds, 0, w->e.vs * sizeof(float));
+    teacher_topk(w->e.preds, w->e.vs, k, c->header.temperature,
+                 c->ids + (size_t)token * k, c->logits + (size_t)token * k, c->tail + token);
+}
+
+// Student forward, distillation gradient and backward for one token
+void student_task(DistillWorker *w, int token) {
+    DistillPool *p = w->pool;
+    TeacherCache *c = p->cache;
+    int k = c->header.k;
+    if (!train_engine_forward(&w->e, p->vocab, token, 0)) return;
+    teacher_probs(c, token, w->probs);
+    float ce;
+    float kl = distillation_gradient(w->e.preds, w->e.vs, c->ids + (size_t)token * k, w->probs, k, token + 1,
+                                     p->temperature, p->distill_weight, w->e.grad_loss, w->scratch, &ce);
+    w->kl += kl;
+    w->ce += ce;
+    train_engine_backward(&w->e, p->vocab, token);
+    worker_accumulate(w);
+}
+
+// Average the workers' gradient sums over count tokens into the model's
+// gradient and take one Adam step
+void apply_batch(TrainEngine *model, DistillWorker *workers, int n, int count) {
+    float scale = 1.0f / count;
+    float *g = (float*)&model->g_attn;
+    for (size_t i = 0; i < sizeof(AttentionLayer) / sizeof(float); i++) {
+        float s = 0.0f;
+        for (int w = 0; w < n; w++) s += ((float*)&workers[w].g_attn)[i];
+        g[i] = s * scale;
+    }
+    g = (float*)&model->g_mlp;
+    for (size_t i = 0; i < sizeof(MlpLayer) / sizeof(float); i++) {
+        float s = 0.0f;
+        for (int w = 0; w < n; w++) s += ((float*)&workers[w].g_mlp)[i];
+        g[i] = s * scale;
+    }
+    g = output_flat(&model->g_out);
+    size_t size = (size_t)(HIDDEN_DIM + 1) * model->vs;
+    for (size_t i = 0; i < size; i++) {
+        float s = 0.0f;
+        for (int w = 0; w < n; w++) s += output_flat(&workers[w].g_out)[i];
+        g[i] = s * scale;
+    }
+    train_engine_step(model);
+}
+
+// --- Runner ---
+
+typedef struct {
+    int epochs;
+    int batch;
+    int threads;
+    int topk;
+    float learning_rate;
+    unsigned int seed;
+    int reference;              // per-token full-vocabulary teacher pass every epoch
+    const char *cache_path;
+} DistillOptions;
+
+double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// Load the teacher engine; NULL paths leave it uninitialized
+int load_teacher(TrainEngine *teacher, const ModelPaths *paths, int vs) {
+    if (!train_engine_init(teacher, vs, 0.0f, 0.0f, 0.0f, 0)) return 0;
+    return train_engine_load(teacher, paths->attn, paths->mlp, paths->out);
+}
+
+// Teacher logits from the cache file, or from one pass of the teacher over
+// the corpus (then written to the cache)
+int prepare_teacher_cache(DistillPool *pool, TeacherCache *cache, const char *cache_path,
+                          const char *vocab_file, const ModelPaths *teacher_paths, int vs, int k) {
+    TeacherCacheHeader key;
+    teacher_cache_key(&key, vocab_file, teacher_paths, vs, k, TEMPERATURE);
+    pool->cache = cache;
+    if (teacher_cache_read(cache, cache_path, &key)) {
+        printf("Teacher logits: cached in %s\n", cache_path);
+        return 1;
+    }
+
+    TrainEngine teacher;
+    if (!load_teacher(&teacher, teacher_paths, vs)) {
         printf("Failed to load teacher model\n");
-        return;
+        train_engine_free(&teacher);
+        return 0;
+    }
+    cache->header = key;
+    if (!teacher_cache_alloc(cache)) {
+        train_engine_free(&teacher);
+        return 0;
+    }
+    double start = now_seconds();
+    for (int i = 0; i < pool->n; i++) worker_bind(&pool->workers[i], &teacher);
+    pool_run(pool, teacher_task, 0, vs - 1);
+    train_engine_free(&teacher);
+
+    double tail = 0.0;
+    for (int t = 0; t < vs - 1; t++) tail += cache->tail[t];
+    printf("Teacher logits: %d tokens in %.2f s, top %d keep %.1f%% of the teacher mass\n",
+           vs - 1, now_seconds() - start, k, 100.0 * (1.0 - tail / (vs - 1)));
+    if (!teacher_cache_write(cache, cache_path)) fprintf(stderr, "Could not write teacher cache %s\n", cache_path);
+    return 1;
+}
+
+// Function to distill knowledge from teacher to student. Returns 0 on failure.
+int distill_knowledge(const char *teacher_model_dir, const char *student_model_dir,
+                      const char *vocab_file, float distill_weight, const DistillOptions *opt) {
+    struct VocabEntry *vocab = malloc(MAX_VOCAB_SIZE * sizeof(struct VocabEntry));
+    int vocab_size = vocab ? load_vocabulary(vocab, vocab_file) : 0;
+
+    if (vocab_size < 2) {
+        printf("Failed to load vocabulary\n");
+        free(vocab);
+        return 0;
     }
-    
+
+    ModelPaths teacher_paths, student_paths;
+    model_paths(teacher_model_dir, &teacher_paths);
+    mkdir(student_model_dir, 0755);
+    model_paths(student_model_dir, &student_paths);
+
     // Load student model (or initialize randomly if not exists)
-    if (!load_model_params(&student_params, student_model_dir)) {
-        printf("Initializing student model with random weights\n");
-        // Initialize with small random weights
-        for (int i = 0; i < EMBEDDING_DIM; i++) {
-            for (int j = 0; j < EMBEDDING_DIM; j++) {
-                student_params.W_q[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
-                student_params.W_k[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
-                student_params.W_v[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
+    srand(opt->seed);
+    ensure_model_files(student_paths.attn, student_paths.mlp, student_paths.out, vocab_size);
+    TrainEngine student;
+    if (!train_engine_init(&student, vocab_size, opt->learning_rate, 0.9f, 0.999f, 0) ||
+        !train_engine_load(&student, student_paths.attn, student_paths.mlp, student_paths.out)) {
+        printf("Failed to load student model\n");
+        train_engine_free(&student);
+        free(vocab);
+        return 0;
+    }
+
+    int tokens = vocab_size - 1;
+    int k = opt->topk < 1 || opt->topk > vocab_size ? vocab_size : opt->topk;
+    int threads = opt->reference ? 1 : opt->threads;
+    if (threads > tokens) threads = tokens;
+    printf("Starting knowledge distillation...\n");
+    printf("Vocabulary size: %d\n", vocab_size);
+    printf("Distillation weight: %f\n", distill_weight);
+    printf("Temperature: %f\n", TEMPERATURE);
+    if (opt->reference) {
+        printf("Reference mode: full teacher pass per token, batch %d\n", opt->batch);
+    } else {
+        printf("Top-k: %d, batch: %d, threads: %d\n", k, opt->batch, threads);
+    }
+
+    DistillPool pool;
+    memset(&pool, 0, sizeof(pool));
+    TeacherCache cache;
+    memset(&cache, 0, sizeof(cache));
+    TrainEngine teacher;
+    memset(&teacher, 0, sizeof(teacher));
+    int ok = pool_start(&pool, threads, vocab_size, k);
+    pool.vocab = vocab;
+    pool.temperature = TEMPERATURE;
+    pool.distill_weight = distill_weight;
+
+    char cache_path[1024];
+    if (opt->cache_path) snprintf(cache_path, sizeof(cache_path), "%s", opt->cache_path);
+    else snprintf(cache_path, sizeof(cache_path), "%s/%s", student_model_dir, TEACHER_CACHE_FILE);
+    if (ok && opt->reference) {
+        ok = load_teacher(&teacher, &teacher_paths, vocab_size);
+        if (!ok) printf("Failed to load teacher model\n");
+    } else if (ok) {
+        ok = prepare_teacher_cache(&pool, &cache, cache_path, vocab_file, &teacher_paths, vocab_size, k);
+    }
+
+    char loss_path[1024];
+    snprintf(loss_path, sizeof(loss_path), "%s/distill_loss.txt", student_model_dir);
+    double start = now_seconds();
+    int teacher_passes = 0;
+    for (int epoch = 0; ok && epoch < opt->epochs; epoch++) {
+        double kl = 0.0, ce = 0.0;
+        for (int begin = 0; begin < tokens; begin += opt->batch) {
+            int end = begin + opt->batch < tokens ? begin + opt->batch : tokens;
+            for (int i = 0; i < pool.n; i++) {
+                worker_clear(&pool.workers[i]);
+                worker_bind(&pool.workers[i], &student);
             }
-        }
-        
-        for (int i = 0; i < EMBEDDING_DIM; i++) {
-            for (int j = 0; j < HIDDEN_DIM; j++) {
-                student_params.mlp_weights[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
+            if (opt->reference) {
+                // What distill_knowledge did per token: teacher and student
+                // over the full vocabulary, KL from compute_distillation_loss
+                DistillWorker *w = &pool.workers[0];
+                float *teacher_logits = w->probs;
+                for (int token = begin; token < end; token++) {
+                    if (!train_engine_forward(&teacher, vocab, token, 0)) continue;
+                    memcpy(teacher_logits, teacher.preds, vocab_size * sizeof(float));
+                    if (!train_engine_forward(&w->e, vocab, token, 0)) continue;
+                    w->kl += compute_distillation_loss(teacher_logits, w->e.preds, vocab_size, TEMPERATURE);
+                    softmax_with_temperature(teacher_logits, vocab_size, TEMPERATURE);
+                    float token_ce;
+                    distillation_gradient(w->e.preds, vocab_size, NULL, teacher_logits, vocab_size, token + 1,
+                                          TEMPERATURE, distill_weight, w->e.grad_loss, w->scratch, &token_ce);
+                    w->ce += token_ce;
+                    train_engine_backward(&w->e, vocab, token);
+                    worker_accumulate(w);
+                }
+            } else {
+                pool_run(&pool, student_task, begin, end);
             }
-        }
-        
-        for (int i = 0; i < HIDDEN_DIM; i++) {
-            student_params.mlp_biases[i] = 0.0f;
-        }
-        
-        for (int i = 0; i < HIDDEN_DIM; i++) {
-            for (int j = 0; j < MAX_VOCAB_SIZE && j < vocab_size; j++) {
-                student_params.output_weights[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
+            for (int i = 0; i < pool.n; i++) {
+                kl += pool.workers[i].kl;
+                ce += pool.workers[i].ce;
             }
+            apply_batch(&student, pool.workers, pool.n, end - begin);
         }
-        
-        for (int i = 0; i < MAX_VOCAB_SIZE && i < vocab_size; i++) {
-            student_params.output_biases[i] = 0.0f;
+        if (opt->reference) teacher_passes++;
+        kl /= tokens;
+        ce /= tokens;
+        float loss = distill_weight * TEMPERATURE * TEMPERATURE * kl + (1.0f - distill_weight) * ce;
+        fprintf(stderr, "Epoch %d/%d, Loss: %f, KL: %f, CE: %f\n", epoch + 1, opt->epochs, loss, kl, ce);
+        FILE *lf = fopen(loss_path, epoch == 0 ? "w" : "a");
+        if (lf) {
+            fprintf(lf, "%d %f %f %f\n", epoch + 1, loss, kl, ce);
+            fclose(lf);
         }
     }
-    
-    printf("Starting knowledge distillation...\n");
-    printf("Vocabulary size: %d\n", vocab_size);
-    printf("Distillation weight: %f\n", distill_weight);
-    printf("Temperature: %f\n", TEMPERATURE);
-    
-    // In a real implementation, we would:
-    // 1. Run the teacher model on a dataset to get teacher logits
-    // 2. Run the student model on the same dataset to get student logits
-    // 3. Compute distillation loss using KL divergence
-    // 4. Update student model parameters using gradient descent
-    // 5. Repeat for multiple epochs
-    
-    printf("Knowledge distillation framework initialized.\n");
-    printf("In a full implementation, this would:\n");
-    printf("1. Load teacher and student models\n");
-    printf("2. Generate predictions from both models\n");
-    printf("3. Compute distillation loss using KL divergence\n");
-    printf("4. Update student model to mimic teacher\n");
-    
-    // Save the (possibly modified) student model
-    save_model_params(&student_params, student_model_dir);
-    
-    printf("Student model saved to %s\n", student_model_dir);
+    double elapsed = now_seconds() - start;
+
+    if (ok) {
+        train_engine_checkpoint(&student, student_model_dir, student_paths.attn, student_paths.mlp, student_paths.out, student_paths.optim);
+        printf("Distilled %d epochs in %.2f s (%.0f tokens/sec, %d teacher passes)\n", opt->epochs, elapsed,
+               elapsed > 0 ? (double)opt->epochs * tokens / elapsed : 0.0, opt->reference ? teacher_passes : 0);
+        printf("Student model saved to %s\n", student_model_dir);
+    }
+
+    if (pool.workers) pool_stop(&pool);
+    teacher_cache_free(&cache);
+    if (teacher.vs) train_engine_free(&teacher);
+    train_engine_free(&student);
+    free(vocab);
+    return ok;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 4) {
+    DistillOptions opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.epochs = DEFAULT_EPOCHS;
+    opt.batch = DEFAULT_BATCH;
+    opt.topk = DEFAULT_TOPK;
+    opt.learning_rate = DEFAULT_LEARNING_RATE;
+    opt.seed = DEFAULT_SEED;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    opt.threads = cpus < 1 ? 1 : cpus > MAX_THREADS ? MAX_THREADS : (int)cpus;
+
+    char *positional[4];
+    int num_positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-reference") == 0) {
+            opt.reference = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0' && !(argv[i][1] >= '0' && argv[i][1] <= '9') && i + 1 < argc) {
+            const char *name = argv[i] + 1, *value = argv[++i];
+            if (strcmp(name, "epochs") == 0) opt.epochs = atoi(value);
+            else if (strcmp(name, "batch") == 0) opt.batch = atoi(value);
+            else if (strcmp(name, "threads") == 0) opt.threads = atoi(value);
+            else if (strcmp(name, "topk") == 0) opt.topk = atoi(value);
+            else if (strcmp(name, "lr") == 0) opt.learning_rate = atof(value);
+            else if (strcmp(name, "seed") == 0) opt.seed = (unsigned int)strtoul(value, NULL, 10);
+            else if (strcmp(name, "cache") == 0) opt.cache_path = value;
+            else { fprintf(stderr, "Unknown option -%s\n", name); return 1; }
+        } else if (num_positional < 4) {
+            positional[num_positional++] = argv[i];
+        }
+    }
+    if (num_positional < 3) {
         fprintf(stderr, "Usage: %s <teacher_model_dir> <student_model_dir> <vocab_file> [distill_weight]\n", argv[0]);
+        fprintf(stderr, "         [-epochs N] [-batch N] [-threads N] [-topk K] [-lr X] [-seed N] [-cache file] [-reference]\n");
         fprintf(stderr, "Example: %s ./teacher_models ./student_models ./vocab_model.txt 0.7\n", argv[0]);
         return 1;
     }
-    
-    char *teacher_model_dir = argv[1];
-    char *student_model_dir = argv[2];
-    char *vocab_file = argv[3];
+    if (opt.batch < 1) opt.batch = 1;
+    if (opt.threads < 1) opt.threads = 1;
+    if (opt.threads > MAX_THREADS) opt.threads = MAX_THREADS;
+
+    char *teacher_model_dir = positional[0];
+    char *student_model_dir = positional[1];
+    char *vocab_file = positional[2];
     float distill_weight = 0.7f;  // Default distillation weight
-    
-    if (argc >= 5) {
-        distill_weight = atof(argv[4]);
-    }
-    
-    distill_knowledge(teacher_model_dir, student_model_dir, vocab_file, distill_weight);
-    
-    return 0;
-}
\ No newline at end of file
+
+    if (num_positional >= 4) {
+        distill_weight = atof(positional[3]);
+    }
+
+    return distill_knowledge(teacher_model_dir, student_model_dir, vocab_file, distill_weight, &opt) ? 0 : 1;
+}
@@ -0,0 +1,531 @@
+#ifndef FORCE_LAYOUT_H
+#define FORCE_LAYOUT_H
+
+// Force-directed graph layout for the association visualizers, with no GL
+// in it so it can run and be measured headless.
+//
+// The physics are the ones the visualizers had in update_physics():
+// velocities are damped, springs along the association edges pull towards
+// SPRING_LENGTH * (2 - strength), every pair of nodes further apart than
+// 0.1 repels with REPULSION_CONSTANT / distance, and positions move by
+// velocity * TIME_STEP. The all-pairs repulsion is approximated with a
+// Barnes-Hut tree (a quadtree in 2D, an octree in 3D) rebuilt every step:
+// a cell whose size over its distance is below theta acts as one body at
+// its centre of mass. theta = 0 opens every cell, which is the exact sum;
+// the default 0.7 stays within a few percent of it. Leaves hold up to
+// LAYOUT_LEAF_SIZE nodes, summed exactly, and nodes are visited leaf by leaf
+// so neighbours walk the same cells. A step costs O(n log n + edges)
+// instead of O(n^2).
+//
+// Nodes and edges live in growable arrays, so graphs can grow while the
+// layout runs. Cells are one flat array; the 2^dim children of a cell are
+// allocated together, always after their parent, so centres of mass are
+// summed in one reverse pass.
+//
+// layout_load_associations() reads either the dense matrix CSV or the
+// "source,target,similarity" edge list written by export_associations.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define LAYOUT_MAX_DIM 3
+#define LAYOUT_SPRING_LENGTH 0.5f
+#define LAYOUT_SPRING_CONSTANT 0.1f
+#define LAYOUT_REPULSION 0.5f
+#define LAYOUT_DAMPING 0.8f
+#define LAYOUT_TIME_STEP 0.1f
+#define LAYOUT_MIN_DIST_SQ 0.01f
+#define LAYOUT_THETA 0.7f
+// Nodes a leaf holds before it splits; they interact with each other exactly
+#define LAYOUT_LEAF_SIZE 8
+// Coincident nodes share a leaf below this depth instead of splitting forever
+#define LAYOUT_MAX_DEPTH 24
+// Dense CSV cells above this become edges, as the visualizers always did
+#define LAYOUT_CSV_THRESHOLD 0.7f
+
+typedef struct {
+    int from, to;
+    float strength;
+} LayoutEdge;
+
+typedef struct {
+    float center[LAYOUT_MAX_DIM], half;
+    float mass, com[LAYOUT_MAX_DIM];
+    int child;                  // first of 2^dim children, or -1 for a leaf
+    int body;                   // first node in a leaf, chained through next
+    int bodies;                 // nodes in the leaf
+} LayoutCell;
+
+typedef struct {
+    int dim;
+    int count, capacity;
+    float *pos, *vel, *force;   // count x dim
+    int *next;                  // leaf chains
+    int *order;                 // nodes leaf by leaf, depth first
+    LayoutEdge *edges;
+    int edge_count, edge_capacity;
+    LayoutCell *cells;
+    int cell_count, cell_capacity;
+    float theta;
+    float spring_length, spring_constant, repulsion, damping, time_step;
+} ForceLayout;
+
+static inline void layout_init(ForceLayout *l, int dim) {
+    memset(l, 0, sizeof(*l));
+    l->dim = dim < 2 ? 2 : dim > LAYOUT_MAX_DIM ? LAYOUT_MAX_DIM : dim;
+    l->theta = LAYOUT_THETA;
+    l->spring_length = LAYOUT_SPRING_LENGTH;
+    l->spring_constant = LAYOUT_SPRING_CONSTANT;
+    l->repulsion = LAYOUT_REPULSION;
+    l->damping = LAYOUT_DAMPING;
+    l->time_step = LAYOUT_TIME_STEP;
+}
+
+static inline void layout_free(ForceLayout *l) {
+    free(l->pos);
+    free(l->vel);
+    free(l->force);
+    free(l->next);
+    free(l->order);
+    free(l->edges);
+    free(l->cells);
+    memset(l, 0, sizeof(*l));
+}
+
+static inline float *layout_position(ForceLayout *l, int i) {
+    return l->pos + (size_t)i * l->dim;
+}
+
+// Move node i to p (dim floats) and stop it
+static inline void layout_place(ForceLayout *l, int i, const float *p) {
+    memcpy(l->pos + (size_t)i * l->dim, p, l->dim * sizeof(float));
+    memset(l->vel + (size_t)i * l->dim, 0, l->dim * sizeof(float));
+}
+
+// Returns the new node's index, or -1 when out of memory
+static inline int layout_add_node(ForceLayout *l, const float *p) {
+    if (l->count == l->capacity) {
+        int cap = l->capacity ? l->capacity * 2 : 64;
+        size_t bytes = (size_t)cap * l->dim * sizeof(float);
+        float *pos = realloc(l->pos, bytes);
+        if (pos) l->pos = pos;
+        float *vel = realloc(l->vel, bytes);
+        if (vel) l->vel = vel;
+        float *force = realloc(l->force, bytes);
+        if (force) l->force = force;
+        int *next = realloc(l->next, cap * sizeof(int));
+        if (next) l->next = next;
+        int *order = realloc(l->order, cap * sizeof(int));
+        if (order) l->order = order;
+        if (!pos || !vel || !force || !next || !order) return -1;
+        l->capacity = cap;
+    }
+    layout_place(l, l->count, p);
+    return l->count++;
+}
+
+static inline int layout_add_edge(ForceLayout *l, int from, int to, float strength) {
+    if (l->edge_count == l->edge_capacity) {
+        int cap = l->edge_capacity ? l->edge_capacity * 2 : 256;
+        LayoutEdge *edges = realloc(l->edges, cap * sizeof(LayoutEdge));
+        if (!edges) return -1;
+        l->edges = edges;
+        l->edge_capacity = cap;
+    }
+    l->edges[l->edge_count] = (LayoutEdge){ from, to, strength };
+    return l->edge_count++;
+}
+
+// --- Barnes-Hut tree ---
+
+static inline int layout_new_cells(ForceLayout *l, int n) {
+    if (l->cell_count + n > l->cell_capacity) {
+        int cap = l->cell_capacity ? l->cell_capacity : 256;
+        while (cap < l->cell_count + n) cap *= 2;
+        LayoutCell *cells = realloc(l->cells, cap * sizeof(LayoutCell));
+        if (!cells) return -1;
+        l->cells = cells;
+        l->cell_capacity = cap;
+    }
+    int first = l->cell_count;
+    l->cell_count += n;
+    return first;
+}
+
+static inline int layout_octant(const LayoutCell *c, const float *p, int dim) {
+    int o = 0;
+    for (int d = 0; d < dim; d++) if (p[d] >= c->center[d]) o |= 1 << d;
+    return o;
+}
+
+static inline int layout_split(ForceLayout *l, int c) {
+    int n = 1 << l->dim;
+    int first = layout_new_cells(l, n);
+    if (first < 0) return -1;
+    LayoutCell *parent = &l->cells[c];
+    float h = parent->half * 0.5f;
+    for (int o = 0; o < n; o++) {
+        LayoutCell *k = &l->cells[first + o];
+        for (int d = 0; d < l->dim; d++) k->center[d] = parent->center[d] + ((o >> d) & 1 ? h : -h);
+        k->half = h;
+        k->child = -1;
+        k->body = -1;
+        k->bodies = 0;
+    }
+    // The leaf's nodes move down to the children
+    int b = parent->body;
+    parent->child = first;
+    parent->body = -1;
+    parent->bodies = 0;
+    while (b >= 0) {
+        int next = l->next[b];
+        LayoutCell *k = &l->cells[first + layout_octant(parent, l->pos + (size_t)b * l->dim, l->dim)];
+        l->next[b] = k->body;
+        k->body = b;
+        k->bodies++;
+        b = next;
+    }
+    return 0;
+}
+
+static inline int layout_build_tree(ForceLayout *l) {
+    int dim = l->dim;
+    l->cell_count = 0;
+    if (layout_new_cells(l, 1) < 0) return -1;
+    float lo[LAYOUT_MAX_DIM], hi[LAYOUT_MAX_DIM];
+    for (int d = 0; d < dim; d++) { lo[d] = INFINITY; hi[d] = -INFINITY; }
+    for (int i = 0; i < l->count; i++) {
+        const float *p = l->pos + (size_t)i * dim;
+        for (int d = 0; d < dim; d++) {
+            if (p[d] < lo[d]) lo[d] = p[d];
+            if (p[d] > hi[d]) hi[d] = p[d];
+        }
+    }
+    LayoutCell *root = &l->cells[0];
+    float half = 0.0f;
+    for (int d = 0; d < dim; d++) {
+        root->center[d] = l->count ? 0.5f * (lo[d] + hi[d]) : 0.0f;
+        if (l->count && 0.5f * (hi[d] - lo[d]) > half) half = 0.5f * (hi[d] - lo[d]);
+    }
+    root->half = half * 1.001f + 1e-6f;
+    root->child = -1;
+    root->body = -1;
+    root->bodies = 0;
+
+    for (int i = 0; i < l->count; i++) {
+        const float *p = l->pos + (size_t)i * dim;
+        int c = 0, depth = 0;
+        for (;;) {
+            LayoutCell *cell = &l->cells[c];
+            if (cell->child >= 0) {
+                c = cell->child + layout_octant(cell, p, dim);
+                depth++;
+            } else if (cell->bodies < LAYOUT_LEAF_SIZE || depth >= LAYOUT_MAX_DEPTH) {
+                l->next[i] = cell->body;
+                cell->body = i;
+                cell->bodies++;
+                break;
+            } else if (layout_split(l, c) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    // Children always come after their parent
+    for (int c = l->cell_count - 1; c >= 0; c--) {
+        LayoutCell *cell = &l->cells[c];
+        float mass = 0.0f, com[LAYOUT_MAX_DIM] = {0};
+        if (cell->child < 0) {
+            for (int b = cell->body; b >= 0; b = l->next[b]) {
+                const float *p = l->pos + (size_t)b * dim;
+                for (int d = 0; d < dim; d++) com[d] += p[d];
+                mass += 1.0f;
+            }
+        } else {
+            for (int o = 0; o < (1 << dim); o++) {
+                const LayoutCell *k = &l->cells[cell->child + o];
+                for (int d = 0; d < dim; d++) com[d] += k->com[d] * k->mass;
+                mass += k->mass;
+            }
+        }
+        cell->mass = mass;
+        for (int d = 0; d < dim; d++) cell->com[d] = mass > 0.0f ? com[d] / mass : cell->center[d];
+    }
+    return 0;
+}
+
+// Repulsion on node i, without REPULSION_CONSTANT: the sum over other nodes
+// (or cells standing in for them) of (p_i - p_j) / |p_i - p_j|^2
+static inline void layout_node_repulsion(const ForceLayout *l, int i, float *f, int *stack) {
+    int dim = l->dim, children = 1 << dim;
+    const float *p = l->pos + (size_t)i * dim;
+    float theta_sq = l->theta * l->theta;
+    float acc[LAYOUT_MAX_DIM] = {0};
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const LayoutCell *cell = &l->cells[stack[--top]];
+        if (cell->child < 0) {
+            for (int b = cell->body; b >= 0; b = l->next[b]) {
+                if (b == i) continue;
+                const float *q = l->pos + (size_t)b * dim;
+                float delta[LAYOUT_MAX_DIM], dist_sq = 0.0f;
+                for (int d = 0; d < dim; d++) { delta[d] = p[d] - q[d]; dist_sq += delta[d] * delta[d]; }
+                if (dist_sq > LAYOUT_MIN_DIST_SQ) {
+                    float inv = 1.0f / dist_sq;
+                    for (int d = 0; d < dim; d++) acc[d] += delta[d] * inv;
+                }
+            }
+            continue;
+        }
+        float delta[LAYOUT_MAX_DIM], dist_sq = 0.0f;
+        int inside = 1;
+        for (int d = 0; d < dim; d++) {
+            delta[d] = p[d] - cell->com[d];
+            dist_sq += delta[d] * delta[d];
+            if (fabsf(p[d] - cell->center[d]) > cell->half) inside = 0;
+        }
+        float size = 2.0f * cell->half;
+        if (!inside && size * size < theta_sq * dist_sq) {
+            if (dist_sq > LAYOUT_MIN_DIST_SQ) {
+                float inv = cell->mass / dist_sq;
+                for (int d = 0; d < dim; d++) acc[d] += delta[d] * inv;
+            }
+        } else {
+            for (int o = 0; o < children; o++) if (l->cells[cell->child + o].mass > 0.0f) stack[top++] = cell->child + o;
+        }
+    }
+    for (int d = 0; d < dim; d++) f[d] = acc[d];
+}
+
+// Nodes leaf by leaf in depth-first order, so consecutive nodes walk nearly
+// the same cells
+static inline void layout_tree_order(ForceLayout *l, int *stack) {
+    int n = 0, top = 0, children = 1 << l->dim;
+    stack[top++] = 0;
+    while (top > 0) {
+        const LayoutCell *cell = &l->cells[stack[--top]];
+        if (cell->child < 0) {
+            for (int b = cell->body; b >= 0; b = l->next[b]) l->order[n++] = b;
+            continue;
+        }
+        for (int o = children - 1; o >= 0; o--) if (l->cells[cell->child + o].mass > 0.0f) stack[top++] = cell->child + o;
+    }
+}
+
+// Repulsion on every node into out (count x dim, REPULSION_CONSTANT applied)
+static inline int layout_repulsion(ForceLayout *l, float *out) {
+    if (layout_build_tree(l) < 0) return -1;
+    // Depth-first: at most 2^dim pending cells per level
+    int stack[(LAYOUT_MAX_DEPTH + 2) * (1 << LAYOUT_MAX_DIM)];
+    layout_tree_order(l, stack);
+    for (int k = 0; k < l->count; k++) {
+        int i = l->order[k];
+        float *f = out + (size_t)i * l->dim;
+        layout_node_repulsion(l, i, f, stack);
+        for (int d = 0; d < l->dim; d++) f[d] *= l->repulsion;
+    }
+    return 0;
+}
+
+// One step of the visualizers' update_physics(). Returns the kinetic energy
+// afterwards (sum of |v|^2 / 2), or -1 when the tree could not be built.
+static inline float layout_step(ForceLayout *l) {
+    int dim = l->dim;
+    size_t n = (size_t)l->count * dim;
+    float dt = l->time_step;
+    for (size_t k = 0; k < n; k++) l->vel[k] *= l->damping;
+
+    for (int e = 0; e < l->edge_count; e++) {
+        const LayoutEdge *edge = &l->edges[e];
+        float *a = l->pos + (size_t)edge->from * dim, *b = l->pos + (size_t)edge->to * dim;
+        float delta[LAYOUT_MAX_DIM], dist_sq = 0.0f;
+        for (int d = 0; d < dim; d++) { delta[d] = b[d] - a[d]; dist_sq += delta[d] * delta[d]; }
+        float distance = sqrtf(dist_sq);
+        if (distance > 0) {
+            float force = (distance - l->spring_length * (2.0f - edge->strength)) * l->spring_constant;
+            float *va = l->vel + (size_t)edge->from * dim, *vb = l->vel + (size_t)edge->to * dim;
+            for (int d = 0; d < dim; d++) {
+                float fd = force * delta[d] / distance;
+                va[d] += fd * dt;
+                vb[d] -= fd * dt;
+            }
+        }
+    }
+
+    if (layout_repulsion(l, l->force) < 0) return -1.0f;
+    float kinetic = 0.0f;
+    for (size_t k = 0; k < n; k++) {
+        l->vel[k] += l->force[k] * dt;
+        l->pos[k] += l->vel[k] * dt;
+        kinetic += 0.5f * l->vel[k] * l->vel[k];
+    }
+    return kinetic;
+}
+
+// Kinetic plus potential energy, with every pair counted exactly: springs
+// k/2 (d - rest)^2, repulsion -R ln d (d held at 0.1 below the cutoff).
+// O(n^2); for tests and small graphs.
+static inline double layout_energy(const ForceLayout *l) {
+    int dim = l->dim;
+    double energy = 0.0;
+    for (size_t k = 0; k < (size_t)l->count * dim; k++) energy += 0.5 * l->vel[k] * l->vel[k];
+    for (int e = 0; e < l->edge_count; e++) {
+        const LayoutEdge *edge = &l->edges[e];
+        const float *a = l->pos + (size_t)edge->from * dim, *b = l->pos + (size_t)edge->to * dim;
+        double dist_sq = 0.0;
+        for (int d = 0; d < dim; d++) dist_sq += (double)(b[d] - a[d]) * (b[d] - a[d]);
+        double stretch = sqrt(dist_sq) - l->spring_length * (2.0 - edge->strength);
+        energy += 0.5 * l->spring_constant * stretch * stretch;
+    }
+    for (int i = 0; i < l->count; i++) {
+        for (int j = i + 1; j < l->count; j++) {
+            const float *a = l->pos + (size_t)i * dim, *b = l->pos + (size_t)j * dim;
+            double dist_sq = 0.0;
+            for (int d = 0; d < dim; d++) dist_sq += (double)(b[d] - a[d]) * (b[d] - a[d]);
+            if (dist_sq < LAYOUT_MIN_DIST_SQ) dist_sq = LAYOUT_MIN_DIST_SQ;
+            energy -= l->repulsion * 0.5 * log(dist_sq);
+        }
+    }
+    return energy;
+}
+
+// --- Loading associations ---
+
+// Word -> node lookup while loading, open addressing on an FNV-1a hash
+typedef struct {
+    char **words;
+    int *slots;
+    int count, capacity, mask;
+} LayoutNames;
+
+static inline unsigned layout_hash(const char *s) {
+    unsigned h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+static inline int layout_names_find(const LayoutNames *names, const char *word) {
+    if (!names->slots) return -1;
+    for (unsigned s = layout_hash(word) & names->mask;; s = (s + 1) & names->mask) {
+        int i = names->slots[s];
+        if (i < 0 || strcmp(names->words[i], word) == 0) return i;
+    }
+}
+
+static inline int layout_names_add(LayoutNames *names, const char *word) {
+    if (2 * (names->count + 1) > names->mask + 1) {
+        int size = names->slots ? 2 * (names->mask + 1) : 1024;
+        int *slots = malloc(size * sizeof(int));
+        if (!slots) return -1;
+        for (int s = 0; s < size; s++) slots[s] = -1;
+        for (int i = 0; i < names->count; i++) {
+            unsigned s = layout_hash(names->words[i]) & (size - 1);
+            while (slots[s] >= 0) s = (s + 1) & (size - 1);
+            slots[s] = i;
+        }
+        free(names->slots);
+        names->slots = slots;
+        names->mask = size - 1;
+    }
+    if (names->count == names->capacity) {
+        int cap = names->capacity ? names->capacity * 2 : 256;
+        char **words = realloc(names->words, cap * sizeof(char*));
+        if (!words) return -1;
+        names->words = words;
+        names->capacity = cap;
+    }
+    unsigned s = layout_hash(word) & names->mask;
+    while (names->slots[s] >= 0) s = (s + 1) & names->mask;
+    size_t len = strlen(word) + 1;
+    names->words[names->count] = malloc(len);
+    if (!names->words[names->count]) return -1;
+    memcpy(names->words[names->count], word, len);
+    names->slots[s] = names->count;
+    return names->count++;
+}
+
+// Whole line of any length into *line (fgets, so it builds with -std=c99)
+static inline int layout_read_line(FILE *file, char **line, size_t *size) {
+    size_t len = 0;
+    for (;;) {
+        if (*size - len < 2) {
+            size_t cap = *size ? *size * 2 : 4096;
+            char *grown = realloc(*line, cap);
+            if (!grown) return 0;
+            *line = grown;
+            *size = cap;
+        }
+        if (!fgets(*line + len, (int)(*size - len), file)) return len > 0;
+        len += strlen(*line + len);
+        if ((*line)[len - 1] == '\n') return 1;
+    }
+}
+
+// Node for word, added at a random spot in [-1, 1)^dim while fewer than
+// max_nodes exist; -1 once the graph is full
+static inline int layout_node_for(ForceLayout *l, LayoutNames *names, const char *word, int max_nodes) {
+    int i = layout_names_find(names, word);
+    if (i >= 0 || names->count >= max_nodes) return i;
+    float p[LAYOUT_MAX_DIM];
+    for (int d = 0; d < l->dim; d++) p[d] = (float)(rand() % 100) / 50.0f - 1.0f;
+    if (layout_add_node(l, p) < 0) return -1;
+    return layout_names_add(names, word);
+}
+
+// Read a dense CSV matrix (cells above LAYOUT_CSV_THRESHOLD off the diagonal
+// become edges) or an export_associations edge list into an empty layout.
+// At most max_nodes words are kept, in file order. Returns the node words
+// (free each, then the array), or NULL on error.
+static inline char **layout_load_associations(ForceLayout *l, const char *filename, int max_nodes) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror("Error opening associations file");
+        return NULL;
+    }
+    LayoutNames names = {0};
+    char *line = NULL;
+    size_t size = 0;
+    if (!layout_read_line(file, &line, &size)) {
+        fclose(file);
+        return NULL;
+    }
+
+    if (strncmp(line, "source,target,", 14) == 0) {
+        while (layout_read_line(file, &line, &size)) {
+            char *source = strtok(line, ",");
+            char *target = strtok(NULL, ",");
+            char *strength = strtok(NULL, ",\n");
+            if (!source || !target || !strength) continue;
+            int from = layout_node_for(l, &names, source, max_nodes);
+            int to = layout_node_for(l, &names, target, max_nodes);
+            if (from >= 0 && to >= 0 && from != to) layout_add_edge(l, from, to, atof(strength));
+        }
+    } else {
+        // Header: ",word1,word2,..."; the first max_nodes columns are nodes
+        int columns = 0;
+        for (char *token = strtok(line, ",\n"); token; token = strtok(NULL, ",\n")) {
+            if (columns < max_nodes) layout_node_for(l, &names, token, max_nodes);
+            columns++;
+        }
+        int row = 0;
+        while (layout_read_line(file, &line, &size) && row < names.count) {
+            strtok(line, ","); // row label
+            int col = 0;
+            for (char *token = strtok(NULL, ",\n"); token && col < names.count; token = strtok(NULL, ",\n"), col++) {
+                float assoc = atof(token);
+                if (assoc > LAYOUT_CSV_THRESHOLD && row != col) layout_add_edge(l, row, col, assoc);
+            }
+            row++;
+        }
+    }
+    free(line);
+    fclose(file);
+    free(names.slots);
+    if (!names.words) names.words = calloc(1, sizeof(char*));
+    return names.words;
+}
+
+#endif
@@ -4,122 +4,157 @@
 #include <string.h>
 #include <time.h>
 #include <libgen.h>
+#include "layers.h"
+#include "generator.h"
+#include "output_softmax.h"
 
 #define MAX_LINE_LENGTH 1024
 #define MAX_VOCAB_SIZE 100000
-#define EMBEDDING_DIM 7
-#define HIDDEN_DIM 16
 
 // --- Data Structures ---
 struct VocabEntry { int number; char word[100]; float embedding, pe, weight, bias1, bias2, bias3, bias4; };
-typedef struct { float weights[EMBEDDING_DIM][HIDDEN_DIM]; float biases[HIDDEN_DIM]; } MlpLayer;
-typedef struct { float W_q[EMBEDDING_DIM][EMBEDDING_DIM], W_k[EMBEDDING_DIM][EMBEDDING_DIM], W_v[EMBEDDING_DIM][EMBEDDING_DIM]; } AttentionLayer;
-typedef struct { float **weights; float *biases; } OutputLayer;
+// Layers, file I/O and the per-position math are layers.h
 
-// --- File I/O ---
-void save_matrix(const char *fn, float *m, int rows, int cols) { FILE *f=fopen(fn,"w"); if(f){ for(int i=0;i<rows;i++){ for(int j=0;j<cols;j++) fprintf(f, "%f ", m[i*cols+j]); fprintf(f, "\n"); } fclose(f); fprintf(stderr, "Saved matrix to %s\n", fn); } }
+// --- Batched Forward Pass ---
+// The score and output products are vocabulary-wide and run through
+// kernels.h, which tiles the vocabulary so a 16 x 1024 slice of the output
+// layer stays in cache while every position in the batch uses it, and
+// splits the tiles over its thread pool.
 
-// --- Utility Functions ---
-// Simple dropout implementation
-void apply_dropout(float *x, int size, float dropout_rate) {
-    // Skip dropout if rate is invalid or zero
-    if (dropout_rate <= 0.0f || dropout_rate >= 1.0f) return;
-    
-    // For reproducibility, we'll use a simple linear congruential generator
-    static unsigned int seed = 12345;
-    
-    for (int i = 0; i < size; i++) {
-        // Generate pseudo-random number between 0 and 1
-        seed = (seed * 1103515245 + 12345) & 0x7fffffff;
-        float rand_val = (float)seed / (float)0x7fffffff;
-        
-        // Apply dropout
-        if (rand_val < dropout_rate) {
-            x[i] = 0.0f;  // Zero out
-        } else {
-            x[i] /= (1.0f - dropout_rate);  // Scale remaining values
-        }
-    }
+// Per-position activations, one row per token in the batch
+typedef struct {
+    int n, vs;
+    float *x;            // n x EMBEDDING_DIM input vectors
+    float *q, *k, *val;  // n x EMBEDDING_DIM
+    float *as_raw;       // n x vs scaled, clipped scores before masking
+    float *as;           // n x vs attention weights after softmax/layer_norm
+    float *ctx;          // n x EMBEDDING_DIM
+    float *h;            // n x HIDDEN_DIM
+    float *p;            // n x vs logits
+} ForwardBatch;
+
+int forward_batch_alloc(ForwardBatch *b, int n, int vs) {
+    b->n = n; b->vs = vs;
+    b->x = calloc((size_t)n * EMBEDDING_DIM, sizeof(float));
+    b->q = calloc((size_t)n * EMBEDDING_DIM, sizeof(float));
+    b->k = calloc((size_t)n * EMBEDDING_DIM, sizeof(float));
+    b->val = calloc((size_t)n * EMBEDDING_DIM, sizeof(float));
+    b->as_raw = calloc((size_t)n * vs, sizeof(float));
+    b->as = calloc((size_t)n * vs, sizeof(float));
+    b->ctx = calloc((size_t)n * EMBEDDING_DIM, sizeof(float));
+    b->h = calloc((size_t)n * HIDDEN_DIM, sizeof(float));
+    b->p = calloc((size_t)n * vs, sizeof(float));
+    return b->x && b->q && b->k && b->val && b->as_raw && b->as && b->ctx && b->h && b->p;
 }
 
-// Apply causal mask to attention scores
-void apply_causal_mask(float *attn_scores, int vocab_size, int current_position) {
-    for (int i = current_position + 1; i < vocab_size; i++) {
-        attn_scores[i] = -1e9f; // Set future positions to negative infinity
-    }
+void forward_batch_free(ForwardBatch *b) {
+    free(b->x); free(b->q); free(b->k); free(b->val); free(b->as_raw); free(b->as); free(b->ctx); free(b->h); free(b->p);
 }
 
-// Layer normalization
-void layer_norm(float *x, int size) {
-    // Calculate mean
-    float mean = 0.0f;
-    for (int i = 0; i < size; i++) {
-        // Check for valid values
-        if (x[i] != x[i] || x[i] > 1e10f || x[i] < -1e10f) {
-            x[i] = 0.0f;
-        }
-        mean += x[i];
-    }
-    mean /= size;
-    
-    // Calculate variance
-    float variance = 0.0f;
-    for (int i = 0; i < size; i++) {
-        float diff = x[i] - mean;
-        variance += diff * diff;
-    }
-    variance /= size;
-    
-    // Prevent division by zero
-    float std_dev = sqrtf(variance + 1e-8f);
-    
-    // Normalize
-    for (int i = 0; i < size; i++) {
-        x[i] = (x[i] - mean) / std_dev;
-    }
+static void vocab_features(const struct VocabEntry *e, float *f) {
+    f[0]=e->embedding; f[1]=e->pe; f[2]=e->weight; f[3]=e->bias1; f[4]=e->bias2; f[5]=e->bias3; f[6]=e->bias4;
+}
+
+// A quantized file written with its word vectors replaces the vocab
+// features with their dequantized values
+void quantized_features(TensorFile *tf, int dtype, float *feats, int vs) {
+    int r = 0, c = 0;
+    const unsigned char *e = tensor_file_get_typed(tf, "embeddings", dtype, &r, &c);
+    const float *s = dtype == TENSOR_I8 ? tensor_file_get(tf, "emb_scales", NULL, NULL) : NULL;
+    if (!e || r != vs || c != EMBEDDING_DIM || (dtype == TENSOR_I8 && !s)) return;
+    for (int j = 0; j < vs; j++)
+        quant_dequant_row(dtype, e + (size_t)j * EMBEDDING_DIM * quant_size(dtype), s ? s[j] : 1.0f, EMBEDDING_DIM, feats + (size_t)j * EMBEDDING_DIM);
 }
 
-// --- Forward Pass Functions ---
-void relu(float *x, int s){for(int i=0;i<s;i++)if(x[i]<0)x[i]=0;}
-void softmax(float *x, int s){
-    // Improve numerical stability with better max finding and overflow protection
-    float max = x[0];
-    for(int i = 1; i < s; i++) {
-        if(x[i] > max) max = x[i];
+// Forward pass for the tokens idx[0..n) of the vocabulary sequence.
+// feats is the vs x EMBEDDING_DIM matrix of vocab features (the keys and
+// values every position attends over), cols and sums its transpose and row
+// sums from layer_feature_columns(). Each row of the result is what the
+// one-token path computes for that index.
+void forward_batch(ForwardBatch *b, const int *idx, const float *feats, const float *cols, const float *sums,
+                   const AttentionLayer *a, const MlpLayer *m, const OutputLayer *o, int causal_attention) {
+    int n = b->n, vs = b->vs;
+
+    for (int r = 0; r < n; r++) memcpy(b->x + r * EMBEDDING_DIM, feats + (size_t)idx[r] * EMBEDDING_DIM, EMBEDDING_DIM * sizeof(float));
+    layer_attention_qkv(a, b->x, n, b->q, b->k, b->val);
+    layer_attention_scores(b->q, n, cols, b->as_raw, vs);
+    memcpy(b->as, b->as_raw, (size_t)n * vs * sizeof(float));
+
+    for (int r = 0; r < n; r++) {
+        unsigned int seed = LAYER_DROPOUT_SEED;
+        layer_attention_forward(b->as + (size_t)r * vs, vs, sums, b->x + r * EMBEDDING_DIM, causal_attention ? idx[r] : -1, &seed, b->ctx + r * EMBEDDING_DIM);
+        layer_mlp_forward(m, b->ctx + r * EMBEDDING_DIM, b->h + r * HIDDEN_DIM, &seed);
     }
-    
-    float sum = 0.0f;
-    for(int i = 0; i < s; i++) {
-        // Calculate exponent with numerical stability
-        float val = x[i] - max;
-        // Prevent extreme values that cause overflow/underflow
-        if (val > 88.0f) val = 88.0f;    // Prevent overflow (exp(88) is near float max)
-        if (val < -88.0f) val = -88.0f;  // Prevent underflow
-        x[i] = expf(val);
-        sum += x[i];
+    layer_output_forward(o, b->h, n, b->p, vs);
+}
+
+// --- Generation ---
+// Greedy continuation of idx[0..n) by gen tokens, one generator_step per
+// position: a prompt position takes the next prompt token, a later one the
+// highest-scoring word of its logits (tree log-probabilities after
+// hierarchical training, lowest index on ties). Every position but the last
+// runs, so seq[0..n + gen) is the sequence and the rows of p (logits), q, k
+// and v are what forward_batch() gives for seq[0..rows). Returns rows.
+static int generate_sequence(Generator *g, const int *idx, int n, int gen, const SoftmaxTree *tree, int *seq, float *p, float *q, float *k, float *v) {
+    int rows = n + gen - 1, vs = g->vs;
+    float *logp = tree ? malloc(vs * sizeof(float)) : NULL;
+    if (tree && !logp) return 0;
+    seq[0] = idx[0];
+    for (int r = 0; r < rows; r++) {
+        float *row = p + (size_t)r * vs;
+        generator_step(g, seq[r], row, q + r * EMBEDDING_DIM, k + r * EMBEDDING_DIM, v + r * EMBEDDING_DIM);
+        if (tree) { softmax_tree_log_probs(tree, row, logp); memcpy(row, logp, vs * sizeof(float)); }
+        if (r + 1 < n) { seq[r + 1] = idx[r + 1]; continue; }
+        int best = 0;
+        for (int j = 1; j < vs; j++) if (row[j] > row[best]) best = j;
+        seq[r + 1] = best;
     }
-    
-    // Handle case where sum is zero, very small, or NaN/Inf
-    if (sum != sum || sum < 1e-15f || sum > 1e15f) {  // Check for NaN or extreme values
-        // Use uniform distribution
-        for(int i = 0; i < s; i++) {
-            x[i] = 1.0f / s;
+    free(logp);
+    return rows;
+}
+
+// Parses "5", "0-99" or "1,4,9-12" into a list of word indexes
+int parse_indices(const char *spec, int vs, int **out) {
+    int n = 0, cap = 64;
+    int *idx = malloc(cap * sizeof(int));
+    const char *s = spec;
+    while (idx && *s) {
+        char *end;
+        long first = strtol(s, &end, 10), last = first;
+        if (end == s) break;
+        if (*end == '-') { s = end + 1; last = strtol(s, &end, 10); if (end == s) break; }
+        if (first < 0 || last >= vs || last < first) {
+            fprintf(stderr, "Invalid word index range: %ld-%ld (vocab size: %d)\n", first, last, vs);
+            free(idx);
+            return 0;
         }
-    } else {
-        // Normalize
-        for(int i = 0; i < s; i++) {
-            x[i] /= sum;
-            // Final safety check for NaN/Inf
-            if (x[i] != x[i] || x[i] > 1e10f || x[i] < -1e10f) {
-                x[i] = 1.0f / s;  // Replace with uniform value
-            }
+        for (long i = first; i <= last; i++) {
+            if (n == cap) { cap *= 2; int *tmp = realloc(idx, cap * sizeof(int)); if (!tmp) { free(idx); return 0; } idx = tmp; }
+            idx[n++] = (int)i;
         }
+        s = end;
+        if (*s == ',') s++;
+        else break;
     }
+    if (!idx || *s || n == 0) {
+        fprintf(stderr, "Invalid word index: %s (vocab size: %d)\n", spec, vs);
+        free(idx);
+        return 0;
+    }
+    *out = idx;
+    return n;
 }
 
 // --- Main ---
 int main(int argc, char *argv[]) {
-    if (argc < 6) { fprintf(stderr, "Usage: %s <vocab> <word_idx> <attn_model> <mlp_model> <out_model> [causal_attention]\n", argv[0]); return 1; }
+    if (argc < 6) {
+        fprintf(stderr, "Usage: %s <vocab> <word_idx> <attn_model> <mlp_model> <out_model> [causal_attention]\n", argv[0]);
+        fprintf(stderr, "  word_idx may be a range or list (\"0-99\", \"1,4,9-12\") to run a batch in one call;\n");
+        fprintf(stderr, "  the stage files then hold one row per position\n");
+        fprintf(stderr, "  out_model may be a quantized file from quantize (int8 or fp16)\n");
+        fprintf(stderr, "  FORWARD_GENERATE=N continues word_idx greedily by N tokens into generated.txt\n");
+        return 1;
+    }
     char *od=dirname(strdup(argv[1])); 
     
     // Check if causal attention is enabled (default is 0/disabled)
@@ -171,134 +206,96 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    int wi=atoi(argv[2]); 
-    if(wi<0||wi>=vs){
-        fprintf(stderr,"Invalid word index: %d (vocab size: %d)\n", wi, vs);
+    int *idx = NULL;
+    int n = parse_indices(argv[2], vs, &idx);
+    if (n == 0) {
         free(v);
         return 1;
     }
 
     AttentionLayer a; MlpLayer m; OutputLayer o;
-    FILE *af=fopen(argv[3],"r"); if(af){fread(&a,sizeof(a),1,af); fclose(af);}
-    FILE *mf=fopen(argv[4],"r"); if(mf){fread(&m,sizeof(m),1,mf); fclose(mf);}
-    o.weights=malloc(HIDDEN_DIM*sizeof(float*)); for(int i=0;i<HIDDEN_DIM;i++)o.weights[i]=malloc(vs*sizeof(float)); o.biases=malloc(vs*sizeof(float));
-    FILE *of=fopen(argv[5],"r"); if(of){for(int i=0;i<HIDDEN_DIM;i++)fread(o.weights[i],sizeof(float),vs,of); fread(o.biases,sizeof(float),vs,of); fclose(of);}
+    load_attention(argv[3], &a); load_mlp(argv[4], &m);
+    TensorFile o_map;
+    int o_mapped = open_output(argv[5], &o, vs, &o_map, OUTPUT_QUANTIZED);
+    // Stage files follow the model format: .bin next to .bin models
+    const char *ext = tensor_ext(argv[3]);
 
-    // Dynamically allocate all buffers
-float *iv=malloc(EMBEDDING_DIM*sizeof(float));
-float *q=malloc(EMBEDDING_DIM*sizeof(float));
-float *k=malloc(EMBEDDING_DIM*sizeof(float));
-float *val=malloc(EMBEDDING_DIM*sizeof(float));
-float *ctx=malloc(EMBEDDING_DIM*sizeof(float));
-float *h=malloc(HIDDEN_DIM*sizeof(float));
-float *as=malloc(vs*sizeof(float));
-float *p=malloc(vs*sizeof(float));
-
-// Initialize input vector
-iv[0]=v[wi].embedding; iv[1]=v[wi].pe; iv[2]=v[wi].weight; iv[3]=v[wi].bias1; 
-iv[4]=v[wi].bias2; iv[5]=v[wi].bias3; iv[6]=v[wi].bias4;
+    float *feats = malloc((size_t)vs * EMBEDDING_DIM * sizeof(float));
+    float *cols = malloc((size_t)vs * EMBEDDING_DIM * sizeof(float));
+    float *sums = malloc((size_t)vs * sizeof(float));
+    const char *gen_env = getenv("FORWARD_GENERATE");
+    int generate = gen_env ? atoi(gen_env) : 0;
+    if (o_mapped < 0 || !feats || !cols || !sums) {
+        fprintf(stderr, "Failed to allocate forward buffers for %d tokens\n", n);
+        return 1;
+    }
+    for (int j = 0; j < vs; j++) vocab_features(&v[j], feats + (size_t)j * EMBEDDING_DIM);
+    if (o.dtype != TENSOR_F32) quantized_features(&o_map, o.dtype, feats, vs);
+    layer_feature_columns(feats, vs, cols, sums);
 
-// Initialize arrays to zero
-for(int j=0;j<EMBEDDING_DIM;j++) q[j]=k[j]=val[j]=ctx[j]=0;
-for(int j=0;j<HIDDEN_DIM;j++) h[j]=0;
-for(int j=0;j<vs;j++) as[j]=p[j]=0;
+    // After softmax=hierarchical training the output columns are tree nodes;
+    // predictions become each word's log-probability along its path
+    SoftmaxTree tree;
+    char tree_path[1024], pth[1024];
+    sprintf(tree_path, "%s/%s", od, SOFTMAX_TREE_FILE);
+    int have_tree = softmax_tree_load(&tree, tree_path, vs);
 
-for(int j=0;j<EMBEDDING_DIM;j++){
-    for(int l=0;l<EMBEDDING_DIM;l++){
-        // Check for valid values before computation
-        if (iv[l] != iv[l] || a.W_q[l][j] != a.W_q[l][j] || 
-            iv[l] > 1e10f || iv[l] < -1e10f || 
-            a.W_q[l][j] > 1e10f || a.W_q[l][j] < -1e10f) {
-            continue;  // Skip invalid values
+    if (generate > 0) {
+        int rows = n + generate - 1;
+        int *seq = malloc((size_t)(rows + 1) * sizeof(int));
+        float *p = malloc((size_t)rows * vs * sizeof(float)), *q = malloc((size_t)rows * EMBEDDING_DIM * sizeof(float));
+        float *k = malloc((size_t)rows * EMBEDDING_DIM * sizeof(float)), *val = malloc((size_t)rows * EMBEDDING_DIM * sizeof(float));
+        Generator g;
+        if (!seq || !p || !q || !k || !val || !generator_init(&g, &a, &m, &o, feats, cols, sums, vs, causal_attention) ||
+            !generate_sequence(&g, idx, n, generate, have_tree ? &tree : NULL, seq, p, q, k, val)) {
+            fprintf(stderr, "Failed to allocate generation buffers for %d tokens\n", rows + 1);
+            return 1;
         }
-        q[j]+=iv[l]*a.W_q[l][j];
-        
-        if (iv[l] != iv[l] || a.W_k[l][j] != a.W_k[l][j] || 
-            iv[l] > 1e10f || iv[l] < -1e10f || 
-            a.W_k[l][j] > 1e10f || a.W_k[l][j] < -1e10f) {
-            continue;  // Skip invalid values
+        sprintf(pth,"%s/q%s",od,ext); save_matrix(pth,q,rows,EMBEDDING_DIM);
+        sprintf(pth,"%s/k%s",od,ext); save_matrix(pth,k,rows,EMBEDDING_DIM);
+        sprintf(pth,"%s/v%s",od,ext); save_matrix(pth,val,rows,EMBEDDING_DIM);
+        sprintf(pth,"%s/predictions%s",od,ext); save_matrix(pth,p,rows,vs);
+        sprintf(pth,"%s/generated.txt",od);
+        FILE *gf = fopen(pth, "w");
+        for (int r = 0; gf && r <= rows; r++) fprintf(gf, "%d %s\n", seq[r], v[seq[r]].word);
+        if (gf) fclose(gf);
+        generator_free(&g);
+        free(seq); free(p); free(q); free(k); free(val);
+        fprintf(stderr, "Generated %d tokens after %d.\n", generate, n);
+    } else {
+        ForwardBatch b;
+        if (!forward_batch_alloc(&b, n, vs)) {
+            fprintf(stderr, "Failed to allocate forward buffers for %d tokens\n", n);
+            return 1;
         }
-        k[j]+=iv[l]*a.W_k[l][j];
-        
-        if (iv[l] != iv[l] || a.W_v[l][j] != a.W_v[l][j] || 
-            iv[l] > 1e10f || iv[l] < -1e10f || 
-            a.W_v[l][j] > 1e10f || a.W_v[l][j] < -1e10f) {
-            continue;  // Skip invalid values
+        forward_batch(&b, idx, feats, cols, sums, &a, &m, &o, causal_attention);
+
+        float *logp = have_tree ? malloc(vs * sizeof(float)) : NULL;
+        for (int r = 0; logp && r < n; r++) {
+            softmax_tree_log_probs(&tree, b.p + (size_t)r * vs, logp);
+            memcpy(b.p + (size_t)r * vs, logp, vs * sizeof(float));
         }
-        val[j]+=iv[l]*a.W_v[l][j];
-    }
-}
-    float scale = 1.0f / sqrt(EMBEDDING_DIM);
-    for(int j=0;j<vs;j++){
-        float nk[EMBEDDING_DIM]={v[j].embedding,v[j].pe,v[j].weight,v[j].bias1,v[j].bias2,v[j].bias3,v[j].bias4}; 
-        as[j]=0; 
-        for(int l=0;l<EMBEDDING_DIM;l++)as[j]+=q[l]*nk[l]; 
-        as[j]*=scale;
-        // Additional clipping to prevent large values
-        if (as[j] > 10.0f) as[j] = 10.0f;
-        if (as[j] < -10.0f) as[j] = -10.0f;
-    }
-    char pth[1024]; sprintf(pth,"%s/attn_scores_raw.txt",od); save_matrix(pth,as,1,vs);
-    
-    // Apply causal mask if enabled
-    if (causal_attention) {
-        apply_causal_mask(as, vs, wi);
-    }
-    
-    // Apply dropout to attention scores for regularization (10% dropout rate)
-    apply_dropout(as, vs, 0.1f);
-    
-    softmax(as,vs);
-    
-    // Apply layer normalization to attention weights
-    layer_norm(as, vs);
-    
-    for(int l=0;l<EMBEDDING_DIM;l++){ctx[l]=0; for(int j=0;j<vs;j++){float nv[EMBEDDING_DIM]={v[j].embedding,v[j].pe,v[j].weight,v[j].bias1,v[j].bias2,v[j].bias3,v[j].bias4}; for(int i=0;i<EMBEDDING_DIM;i++)ctx[l]+=as[j]*nv[i];}}
-    
-    // Apply residual connection (add input to context)
-    for(int l=0;l<EMBEDDING_DIM;l++) {
-        ctx[l] += iv[l];  // Residual connection
-    }
-    
-    // Apply layer normalization to context
-    layer_norm(ctx, EMBEDDING_DIM);
-    
-    for(int j=0;j<HIDDEN_DIM;j++){h[j]=0; for(int l=0;l<EMBEDDING_DIM;l++)h[j]+=ctx[l]*m.weights[l][j]; h[j]+=m.biases[j];} 
-    
-    // Apply layer normalization before ReLU
-    layer_norm(h, HIDDEN_DIM);
-    
-    relu(h,HIDDEN_DIM);
-    
-    // Apply dropout after ReLU (20% dropout rate)
-    apply_dropout(h, HIDDEN_DIM, 0.2f);
-    
-    for(int j=0;j<vs;j++){p[j]=0; for(int l=0;l<HIDDEN_DIM;l++)p[j]+=h[l]*o.weights[l][j]; p[j]+=o.biases[j];}
+        free(logp);
 
-    sprintf(pth,"%s/q.txt",od); save_matrix(pth,q,1,EMBEDDING_DIM);
-    sprintf(pth,"%s/k.txt",od); save_matrix(pth,k,1,EMBEDDING_DIM);
-    sprintf(pth,"%s/v.txt",od); save_matrix(pth,val,1,EMBEDDING_DIM);
-    sprintf(pth,"%s/attn_scores.txt",od); save_matrix(pth,as,1,vs);
-    sprintf(pth,"%s/context.txt",od); save_matrix(pth,ctx,1,EMBEDDING_DIM);
-    sprintf(pth,"%s/hidden_state.txt",od); save_matrix(pth,h,1,HIDDEN_DIM);
-    sprintf(pth,"%s/predictions.txt",od); save_matrix(pth,p,1,vs);
+        sprintf(pth,"%s/attn_scores_raw%s",od,ext); save_matrix(pth,b.as_raw,n,vs);
+        sprintf(pth,"%s/q%s",od,ext); save_matrix(pth,b.q,n,EMBEDDING_DIM);
+        sprintf(pth,"%s/k%s",od,ext); save_matrix(pth,b.k,n,EMBEDDING_DIM);
+        sprintf(pth,"%s/v%s",od,ext); save_matrix(pth,b.val,n,EMBEDDING_DIM);
+        sprintf(pth,"%s/attn_scores%s",od,ext); save_matrix(pth,b.as,n,vs);
+        sprintf(pth,"%s/context%s",od,ext); save_matrix(pth,b.ctx,n,EMBEDDING_DIM);
+        sprintf(pth,"%s/hidden_state%s",od,ext); save_matrix(pth,b.h,n,HIDDEN_DIM);
+        sprintf(pth,"%s/predictions%s",od,ext); save_matrix(pth,b.p,n,vs);
+        forward_batch_free(&b);
 
-    // Cleanup allocated memory
-    free(iv);
-    free(q);
-    free(k);
-    free(val);
-    free(ctx);
-    free(h);
-    free(as);
-    free(p);
-    for(int i=0; i<HIDDEN_DIM; i++) {
-        free(o.weights[i]);
+        if (n > 1) fprintf(stderr, "Forward propagation completed for %d tokens.\n", n);
+        else fprintf(stderr, "Forward propagation completed.\n");
     }
-    free(o.weights);
-    free(o.biases);
-    free(v);
+    if (have_tree) softmax_tree_free(&tree);
 
-    fprintf(stderr, "Forward propagation completed.\n");
+    // Cleanup allocated memory
+    free(feats); free(cols); free(sums);
+    free(idx);
+    close_output(&o, &o_map, o_mapped);
+    free(v);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,71 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+// Incremental forward pass for autoregressive generation.
+//
+// Without it, producing token t means running forward_prop over the whole
+// sequence 0..t and keeping the last row: the vocabulary side of attention
+// (feature columns and row sums, layer_feature_columns()) and every
+// earlier row are rebuilt each step. A Generator builds the vocabulary side
+// once and runs one row per step:
+//
+//   generator_step()    Q/K/V of the new token only, its scores over the
+//                       vocabulary, context, MLP and logits
+//
+// Attention in this model scores a position's query against the
+// vocabulary features, not against earlier positions' keys and values, and
+// each row's dropout is seeded per row, so a row depends on its own token
+// alone and a step's logits are exactly forward_prop's row for that token.
+// There is nothing to cache across positions beyond the vocabulary side;
+// a step's K and V are handed back only for the k and v stage files.
+// test/generator_check.c compares incremental and whole-prefix generation
+// bit for bit.
+
+#include "layers.h"
+
+typedef struct {
+    // Model and vocabulary side, built once by the caller
+    const AttentionLayer *a;
+    const MlpLayer *m;
+    const OutputLayer *o;
+    const float *feats, *cols, *sums;  // from layer_feature_columns()
+    int vs, causal;
+    long next;                         // position of the next token
+    float *as;                         // vs scores of the current step
+} Generator;
+
+static inline void generator_free(Generator *g) {
+    free(g->as);
+    g->as = NULL;
+}
+
+// Returns 0 on allocation failure. The layers and vocabulary buffers must
+// outlive the generator.
+static inline int generator_init(Generator *g, const AttentionLayer *a, const MlpLayer *m, const OutputLayer *o,
+                                 const float *feats, const float *cols, const float *sums, int vs, int causal) {
+    memset(g, 0, sizeof(*g));
+    g->a = a; g->m = m; g->o = o;
+    g->feats = feats; g->cols = cols; g->sums = sums;
+    g->vs = vs; g->causal = causal;
+    g->as = malloc((size_t)vs * sizeof(float));
+    return g->as != NULL;
+}
+
+// Runs token (a vocabulary index) as the next position and writes its vs
+// logits. q, k and v (EMBEDDING_DIM each) may be NULL. Returns the position.
+static inline long generator_step(Generator *g, int token, float *logits, float *q, float *k, float *v) {
+    float x[EMBEDDING_DIM], qb[EMBEDDING_DIM], kb[EMBEDDING_DIM], vb[EMBEDDING_DIM], ctx[EMBEDDING_DIM], h[HIDDEN_DIM];
+    unsigned int seed = LAYER_DROPOUT_SEED;
+    memcpy(x, g->feats + (size_t)token * EMBEDDING_DIM, sizeof(x));
+    layer_attention_qkv(g->a, x, 1, qb, kb, vb);
+    if (q) memcpy(q, qb, sizeof(qb));
+    if (k) memcpy(k, kb, sizeof(kb));
+    if (v) memcpy(v, vb, sizeof(vb));
+    layer_attention_scores(qb, 1, g->cols, g->as, g->vs);
+    layer_attention_forward(g->as, g->vs, g->sums, x, g->causal ? token : -1, &seed, ctx);
+    layer_mlp_forward(g->m, ctx, h, &seed);
+    layer_output_forward(g->o, h, 1, logits, g->vs);
+    return g->next++;
+}
+
+#endif
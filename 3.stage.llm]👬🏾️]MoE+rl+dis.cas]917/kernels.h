@@ -0,0 +1,723 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+// Vectorized and threaded kernels for the forward pass.
+//
+// Each kernel has an AVX2, an SSE and a portable scalar version. The level
+// is picked at run time from the CPU, so the stage programs keep compiling
+// with plain gcc and no -m flags. Products are written as multiply then add
+// (never FMA) in the same order as the scalar loops, so kern_scores() and
+// kern_output_projection() give the same bits at every level; the
+// reductions in softmax, layer_norm and kern_dot reassociate and only agree
+// to rounding.
+//
+// The vocabulary-wide kernels split the vocab dimension over a small pthread
+// pool. Every element is still computed by one thread in one fixed order,
+// so results do not depend on the thread count.
+//
+// Environment:
+//   KERNELS_SIMD=scalar|sse|avx2   force a level (default: best supported)
+//   KERNELS_THREADS=N              pool size (default: online CPUs, max 16)
+//   KERNELS_DEBUG=1                kern_check_finite() scans outputs, reports
+//                                  and zeroes NaN/Inf instead of being a no-op
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "quant.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86 1
+#define KERN_AVX2_FN __attribute__((target("avx2")))
+#define KERN_SSE_FN __attribute__((target("sse2")))
+#endif
+
+enum { KERN_SCALAR = 0, KERN_SSE = 1, KERN_AVX2 = 2 };
+
+#define KERN_MAX_THREADS 16
+// Multiply-adds below which a call stays on the calling thread
+#define KERN_MIN_PARALLEL_WORK (1 << 16)
+// Vocabulary columns per cache tile when several rows share a slice
+#define KERN_TILE 1024
+
+static struct {
+    int ready;
+    int level;
+    int threads;
+    int debug;
+} kern_cfg;
+
+static inline const char *kern_level_name(int level) {
+    return level == KERN_AVX2 ? "avx2" : level == KERN_SSE ? "sse" : "scalar";
+}
+
+static inline void kernels_init(void) {
+    if (kern_cfg.ready) return;
+    kern_cfg.ready = 1;
+
+    int best = KERN_SCALAR;
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) best = KERN_SSE;
+    if (__builtin_cpu_supports("avx2")) best = KERN_AVX2;
+#endif
+    kern_cfg.level = best;
+    const char *s = getenv("KERNELS_SIMD");
+    if (s) {
+        int want = strcmp(s, "avx2") == 0 ? KERN_AVX2 : strcmp(s, "sse") == 0 ? KERN_SSE : KERN_SCALAR;
+        kern_cfg.level = want < best ? want : best;
+    }
+
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    s = getenv("KERNELS_THREADS");
+    if (s) n = atol(s);
+    kern_cfg.threads = n < 1 ? 1 : n > KERN_MAX_THREADS ? KERN_MAX_THREADS : (int)n;
+
+    s = getenv("KERNELS_DEBUG");
+    kern_cfg.debug = s && atoi(s) != 0;
+}
+
+// Force a level (for tests and benchmarks); clamped to what the CPU has
+static inline void kernels_set_level(int level) {
+    kernels_init();
+    int best = KERN_SCALAR;
+#ifdef KERNELS_X86
+    if (__builtin_cpu_supports("sse2")) best = KERN_SSE;
+    if (__builtin_cpu_supports("avx2")) best = KERN_AVX2;
+#endif
+    kern_cfg.level = level < best ? level : best;
+}
+
+// --- Primitives ---
+
+#ifdef KERNELS_X86
+KERN_AVX2_FN static float kern_hsum256(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+KERN_SSE_FN static float kern_hsum128(__m128 s) {
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+KERN_AVX2_FN static float kern_dot_avx2(const float *a, const float *b, int n) {
+    __m256 acc = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    float s = kern_hsum256(acc);
+    for (; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+KERN_SSE_FN static float kern_dot_sse(const float *a, const float *b, int n) {
+    __m128 acc = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    float s = kern_hsum128(acc);
+    for (; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+
+// y += a * x
+KERN_AVX2_FN static void kern_axpy_avx2(float a, const float *x, float *y, int n) {
+    __m256 va = _mm256_set1_ps(a);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(va, _mm256_loadu_ps(x + i))));
+    for (; i < n; i++) y[i] += a * x[i];
+}
+KERN_SSE_FN static void kern_axpy_sse(float a, const float *x, float *y, int n) {
+    __m128 va = _mm_set1_ps(a);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+    for (; i < n; i++) y[i] += a * x[i];
+}
+
+// Returns NaN if any element is NaN, like a scan that never skips one
+KERN_AVX2_FN static float kern_max_avx2(const float *x, int n) {
+    __m256 m = _mm256_set1_ps(-INFINITY), nan = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(x + i);
+        m = _mm256_max_ps(m, v);
+        nan = _mm256_or_ps(nan, _mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, m);
+    float r = lanes[0];
+    for (int j = 1; j < 8; j++) if (lanes[j] > r) r = lanes[j];
+    int has_nan = _mm256_movemask_ps(nan) != 0;
+    for (; i < n; i++) { if (x[i] != x[i]) has_nan = 1; else if (x[i] > r) r = x[i]; }
+    return has_nan ? NAN : r;
+}
+KERN_SSE_FN static float kern_max_sse(const float *x, int n) {
+    __m128 m = _mm_set1_ps(-INFINITY), nan = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(x + i);
+        m = _mm_max_ps(m, v);
+        nan = _mm_or_ps(nan, _mm_cmpunord_ps(v, v));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, m);
+    float r = lanes[0];
+    for (int j = 1; j < 4; j++) if (lanes[j] > r) r = lanes[j];
+    int has_nan = _mm_movemask_ps(nan) != 0;
+    for (; i < n; i++) { if (x[i] != x[i]) has_nan = 1; else if (x[i] > r) r = x[i]; }
+    return has_nan ? NAN : r;
+}
+
+// Cephes-style expf for 8 lanes; inputs are already clamped to [-88, 88]
+KERN_AVX2_FN static __m256 kern_exp256(__m256 x) {
+    const __m256 log2e = _mm256_set1_ps(1.44269504088896341f), half = _mm256_set1_ps(0.5f), one = _mm256_set1_ps(1.0f);
+    const __m256 c1 = _mm256_set1_ps(0.693359375f), c2 = _mm256_set1_ps(-2.12194440e-4f);
+    __m256 fx = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(x, log2e), half));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(fx, c1));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(fx, c2));
+    __m256 z = _mm256_mul_ps(x, x);
+    __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.3981999507e-3f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(8.3334519073e-3f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(4.1665795894e-2f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.6666665459e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), half);
+    y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(y, z), x), one);
+    __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(e));
+}
+
+// x[i] = exp(clamp(x[i] - max, -88, 88)); returns the sum
+KERN_AVX2_FN static float kern_exp_sum_avx2(float *x, int n, float max) {
+    __m256 vm = _mm256_set1_ps(max), lo = _mm256_set1_ps(-88.0f), hi = _mm256_set1_ps(88.0f), acc = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_sub_ps(_mm256_loadu_ps(x + i), vm);
+        v = _mm256_max_ps(_mm256_min_ps(v, hi), lo);
+        v = kern_exp256(v);
+        _mm256_storeu_ps(x + i, v);
+        acc = _mm256_add_ps(acc, v);
+    }
+    float s = kern_hsum256(acc);
+    for (; i < n; i++) {
+        float v = x[i] - max;
+        if (v > 88.0f) v = 88.0f;
+        if (v < -88.0f) v = -88.0f;
+        x[i] = expf(v);
+        s += x[i];
+    }
+    return s;
+}
+KERN_SSE_FN static float kern_exp_sum_sse(float *x, int n, float max) {
+    // No vector exp below AVX2; the sum still runs four lanes wide
+    __m128 acc = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            float v = x[i + j] - max;
+            if (v > 88.0f) v = 88.0f;
+            if (v < -88.0f) v = -88.0f;
+            x[i + j] = expf(v);
+        }
+        acc = _mm_add_ps(acc, _mm_loadu_ps(x + i));
+    }
+    float s = kern_hsum128(acc);
+    for (; i < n; i++) {
+        float v = x[i] - max;
+        if (v > 88.0f) v = 88.0f;
+        if (v < -88.0f) v = -88.0f;
+        x[i] = expf(v);
+        s += x[i];
+    }
+    return s;
+}
+
+// x[i] = (x[i] - sub) / div
+KERN_AVX2_FN static void kern_sub_div_avx2(float *x, int n, float sub, float div) {
+    __m256 vs = _mm256_set1_ps(sub), vd = _mm256_set1_ps(div);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(x + i, _mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), vs), vd));
+    for (; i < n; i++) x[i] = (x[i] - sub) / div;
+}
+KERN_SSE_FN static void kern_sub_div_sse(float *x, int n, float sub, float div) {
+    __m128 vs = _mm_set1_ps(sub), vd = _mm_set1_ps(div);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(x + i, _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(x + i), vs), vd));
+    for (; i < n; i++) x[i] = (x[i] - sub) / div;
+}
+
+// Sum and largest |x| in one pass; NaN makes max_abs NaN
+KERN_AVX2_FN static float kern_sum_maxabs_avx2(const float *x, int n, float *max_abs) {
+    const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 acc = _mm256_setzero_ps(), m = _mm256_setzero_ps(), nan = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(x + i);
+        acc = _mm256_add_ps(acc, v);
+        m = _mm256_max_ps(m, _mm256_and_ps(v, absmask));
+        nan = _mm256_or_ps(nan, _mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, m);
+    float r = lanes[0];
+    for (int j = 1; j < 8; j++) if (lanes[j] > r) r = lanes[j];
+    float s = kern_hsum256(acc);
+    int has_nan = _mm256_movemask_ps(nan) != 0;
+    for (; i < n; i++) { s += x[i]; if (x[i] != x[i]) has_nan = 1; else if (fabsf(x[i]) > r) r = fabsf(x[i]); }
+    *max_abs = has_nan ? NAN : r;
+    return s;
+}
+KERN_SSE_FN static float kern_sum_maxabs_sse(const float *x, int n, float *max_abs) {
+    const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 acc = _mm_setzero_ps(), m = _mm_setzero_ps(), nan = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(x + i);
+        acc = _mm_add_ps(acc, v);
+        m = _mm_max_ps(m, _mm_and_ps(v, absmask));
+        nan = _mm_or_ps(nan, _mm_cmpunord_ps(v, v));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, m);
+    float r = lanes[0];
+    for (int j = 1; j < 4; j++) if (lanes[j] > r) r = lanes[j];
+    float s = kern_hsum128(acc);
+    int has_nan = _mm_movemask_ps(nan) != 0;
+    for (; i < n; i++) { s += x[i]; if (x[i] != x[i]) has_nan = 1; else if (fabsf(x[i]) > r) r = fabsf(x[i]); }
+    *max_abs = has_nan ? NAN : r;
+    return s;
+}
+
+// sum((x - mean)^2)
+KERN_AVX2_FN static float kern_sqdev_avx2(const float *x, int n, float mean) {
+    __m256 vm = _mm256_set1_ps(mean), acc = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) { __m256 d = _mm256_sub_ps(_mm256_loadu_ps(x + i), vm); acc = _mm256_add_ps(acc, _mm256_mul_ps(d, d)); }
+    float s = kern_hsum256(acc);
+    for (; i < n; i++) { float d = x[i] - mean; s += d * d; }
+    return s;
+}
+KERN_SSE_FN static float kern_sqdev_sse(const float *x, int n, float mean) {
+    __m128 vm = _mm_set1_ps(mean), acc = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) { __m128 d = _mm_sub_ps(_mm_loadu_ps(x + i), vm); acc = _mm_add_ps(acc, _mm_mul_ps(d, d)); }
+    float s = kern_hsum128(acc);
+    for (; i < n; i++) { float d = x[i] - mean; s += d * d; }
+    return s;
+}
+
+// x = clamp(x * scale, lo, hi), keeping NaN as NaN like the scalar ifs
+KERN_AVX2_FN static void kern_scale_clip_avx2(float *x, int n, float scale, float lo, float hi) {
+    __m256 vs = _mm256_set1_ps(scale), vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(x + i), vs);
+        // min/max return the second operand on NaN
+        v = _mm256_max_ps(vlo, _mm256_min_ps(vhi, v));
+        _mm256_storeu_ps(x + i, v);
+    }
+    for (; i < n; i++) { float v = x[i] * scale; if (v > hi) v = hi; if (v < lo) v = lo; x[i] = v; }
+}
+KERN_SSE_FN static void kern_scale_clip_sse(float *x, int n, float scale, float lo, float hi) {
+    __m128 vs = _mm_set1_ps(scale), vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(hi);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(x + i), vs);
+        v = _mm_max_ps(vlo, _mm_min_ps(vhi, v));
+        _mm_storeu_ps(x + i, v);
+    }
+    for (; i < n; i++) { float v = x[i] * scale; if (v > hi) v = hi; if (v < lo) v = lo; x[i] = v; }
+}
+
+// y += x
+KERN_AVX2_FN static void kern_add_avx2(const float *x, float *y, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_loadu_ps(x + i)));
+    for (; i < n; i++) y[i] += x[i];
+}
+KERN_SSE_FN static void kern_add_sse(const float *x, float *y, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_loadu_ps(x + i)));
+    for (; i < n; i++) y[i] += x[i];
+}
+
+// out = scales * int8 codes (scales NULL for 1), or fp16 -> float
+KERN_AVX2_FN static void kern_dequant_avx2(int dtype, const void *codes, const float *scales, float *out, int n) {
+    int i = 0;
+    if (dtype == QUANT_I8) {
+        const int8_t *c = (const int8_t*)codes;
+        for (; i + 8 <= n; i += 8) {
+            __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(c + i))));
+            _mm256_storeu_ps(out + i, scales ? _mm256_mul_ps(_mm256_loadu_ps(scales + i), v) : v);
+        }
+        for (; i < n; i++) out[i] = scales ? scales[i] * (float)c[i] : (float)c[i];
+        return;
+    }
+    const uint16_t *h = (const uint16_t*)codes;
+    const __m256i mask = _mm256_set1_epi32(0x7fff), inf = _mm256_set1_epi32(0x7f800000), max_finite = _mm256_set1_epi32(0x7bff);
+    const __m256 rebias = _mm256_set1_ps(0x1p112f);
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(h + i)));
+        __m256i em = _mm256_and_si256(x, mask), u = _mm256_slli_epi32(em, 13);
+        __m256 f = _mm256_mul_ps(_mm256_castsi256_ps(u), rebias);
+        __m256 special = _mm256_castsi256_ps(_mm256_cmpgt_epi32(em, max_finite));
+        f = _mm256_blendv_ps(f, _mm256_castsi256_ps(_mm256_or_si256(u, inf)), special);
+        __m256i sign = _mm256_slli_epi32(_mm256_andnot_si256(mask, x), 16);
+        _mm256_storeu_ps(out + i, _mm256_or_ps(f, _mm256_castsi256_ps(sign)));
+    }
+    for (; i < n; i++) out[i] = quant_f16_to_float(h[i]);
+}
+KERN_SSE_FN static void kern_dequant_sse(int dtype, const void *codes, const float *scales, float *out, int n) {
+    int i = 0;
+    const __m128i zero = _mm_setzero_si128();
+    if (dtype == QUANT_I8) {
+        const int8_t *c = (const int8_t*)codes;
+        for (; i + 8 <= n; i += 8) {
+            // Sign extend by unpacking each byte into the top of a wider lane
+            __m128i w = _mm_unpacklo_epi8(zero, _mm_loadl_epi64((const __m128i*)(c + i)));
+            __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(zero, w), 24));
+            __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(zero, w), 24));
+            if (scales) { lo = _mm_mul_ps(_mm_loadu_ps(scales + i), lo); hi = _mm_mul_ps(_mm_loadu_ps(scales + i + 4), hi); }
+            _mm_storeu_ps(out + i, lo);
+            _mm_storeu_ps(out + i + 4, hi);
+        }
+        for (; i < n; i++) out[i] = scales ? scales[i] * (float)c[i] : (float)c[i];
+        return;
+    }
+    const uint16_t *h = (const uint16_t*)codes;
+    const __m128i mask = _mm_set1_epi32(0x7fff), inf = _mm_set1_epi32(0x7f800000), max_finite = _mm_set1_epi32(0x7bff);
+    const __m128 rebias = _mm_set1_ps(0x1p112f);
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(h + i)), zero);
+        __m128i em = _mm_and_si128(x, mask), u = _mm_slli_epi32(em, 13);
+        __m128 f = _mm_mul_ps(_mm_castsi128_ps(u), rebias);
+        __m128 special = _mm_castsi128_ps(_mm_cmpgt_epi32(em, max_finite));
+        f = _mm_or_ps(_mm_andnot_ps(special, f), _mm_and_ps(special, _mm_castsi128_ps(_mm_or_si128(u, inf))));
+        __m128i sign = _mm_slli_epi32(_mm_andnot_si128(mask, x), 16);
+        _mm_storeu_ps(out + i, _mm_or_ps(f, _mm_castsi128_ps(sign)));
+    }
+    for (; i < n; i++) out[i] = quant_f16_to_float(h[i]);
+}
+#endif
+
+static inline float kern_dot(const float *a, const float *b, int n) {
+#ifdef KERNELS_X86
+    if (kern_cfg.level == KERN_AVX2) return kern_dot_avx2(a, b, n);
+    if (kern_cfg.level == KERN_SSE) return kern_dot_sse(a, b, n);
+#endif
+    float s = 0;
+    for (int i = 0; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+
+static inline void kern_axpy(float a, const float *x, float *y, int n) {
+#ifdef KERNELS_X86
+    if (kern_cfg.level == KERN_AVX2) { kern_axpy_avx2(a, x, y, n); return; }
+    if (kern_cfg.level == KERN_SSE) { kern_axpy_sse(a, x, y, n); return; }
+#endif
+    for (int i = 0; i < n; i++) y[i] += a * x[i];
+}
+
+static inline void kern_add(const float *x, float *y, int n) {
+#ifdef KERNELS_X86
+    if (kern_cfg.level == KERN_AVX2) { kern_add_avx2(x, y, n); return; }
+    if (kern_cfg.level == KERN_SSE) { kern_add_sse(x, y, n); return; }
+#endif
+    for (int i = 0; i < n; i++) y[i] += x[i];
+}
+
+static inline void kern_scale_clip(float *x, int n, float scale, float lo, float hi) {
+#ifdef KERNELS_X86
+    if (kern_cfg.level == KERN_AVX2) { kern_scale_clip_avx2(x, n, scale, lo, hi); return; }
+    if (kern_cfg.level == KERN_SSE) { kern_scale_clip_sse(x, n, scale, lo, hi); return; }
+#endif
+    for (int i = 0; i < n; i++) { float v = x[i] * scale; if (v > hi) v = hi; if (v < lo) v = lo; x[i] = v; }
+}
+
+// Widen n int8 (times scales[i], when given) or fp16 values to float
+static inline void kern_dequant(int dtype, const void *codes, const float *scales, float *out, int n) {
+#ifdef KERNELS_X86
+    if (kern_cfg.level == KERN_AVX2) { kern_dequant_avx2(dtype, codes, scales, out, n); return; }
+    if (kern_cfg.level == KERN_SSE) { kern_dequant_sse(dtype, codes, scales, out, n); return; }
+#endif
+    if (dtype == QUANT_I8) {
+        const int8_t *c = (const int8_t*)codes;
+        for (int i = 0; i < n; i++) out[i] = scales ? scales[i] * (float)c[i] : (float)c[i];
+    } else {
+        for (int i = 0; i < n; i++) out[i] = quant_f16_to_float(((const uint16_t*)codes)[i]);
+    }
+}
+
+static inline float kern_max(const float *x, int n) {
+#ifdef KERNELS_X86
+    if (kern_cfg.level == KERN_AVX2) return kern_max_avx2(x, n);
+    if (kern_cfg.level == KERN_SSE) return kern_max_sse(x, n);
+#endif
+    float r = -INFINITY;
+    for (int i = 0; i < n; i++) { if (x[i] != x[i]) return NAN; if (x[i] > r) r = x[i]; }
+    return r;
+}
+
+// --- Softmax and layer norm ---
+
+// Same contract as the scalar softmax in forward_prop.c: max subtraction,
+// exponent clamped to +-88, and a uniform distribution if the input holds
+// NaN/Inf or the sum degenerates.
+static inline void kern_softmax(float *x, int n) {
+    kernels_init();
+    float max = kern_max(x, n);
+    float sum;
+    if (!isfinite(max)) sum = NAN;
+#ifdef KERNELS_X86
+    else if (kern_cfg.level == KERN_AVX2) sum = kern_exp_sum_avx2(x, n, max);
+    else if (kern_cfg.level == KERN_SSE) sum = kern_exp_sum_sse(x, n, max);
+#endif
+    else {
+        sum = 0.0f;
+        for (int i = 0; i < n; i++) {
+            float v = x[i] - max;
+            if (v > 88.0f) v = 88.0f;
+            if (v < -88.0f) v = -88.0f;
+            x[i] = expf(v);
+            sum += x[i];
+        }
+    }
+    if (sum != sum || sum < 1e-15f || sum > 1e15f) {
+        for (int i = 0; i < n; i++) x[i] = 1.0f / n;
+        return;
+    }
+#ifdef KERNELS_X86
+    if (kern_cfg.level == KERN_AVX2) { kern_sub_div_avx2(x, n, 0.0f, sum); return; }
+    if (kern_cfg.level == KERN_SSE) { kern_sub_div_sse(x, n, 0.0f, sum); return; }
+#endif
+    for (int i = 0; i < n; i++) x[i] /= sum;
+}
+
+// Same contract as the scalar layer_norm: NaN and |x| > 1e10 count as 0.
+// The check is one max|x| folded into the mean pass; the zeroing pass only
+// runs when it finds something.
+static inline void kern_layer_norm(float *x, int n) {
+    kernels_init();
+    float sum, max_abs;
+#ifdef KERNELS_X86
+    if (kern_cfg.level == KERN_AVX2) sum = kern_sum_maxabs_avx2(x, n, &max_abs);
+    else if (kern_cfg.level == KERN_SSE) sum = kern_sum_maxabs_sse(x, n, &max_abs);
+    else
+#endif
+    {
+        sum = 0.0f; max_abs = 0.0f;
+        for (int i = 0; i < n; i++) { sum += x[i]; if (x[i] != x[i]) max_abs = NAN; else if (fabsf(x[i]) > max_abs && max_abs == max_abs) max_abs = fabsf(x[i]); }
+    }
+    if (!(max_abs <= 1e10f)) {
+        sum = 0.0f;
+        for (int i = 0; i < n; i++) {
+            if (x[i] != x[i] || x[i] > 1e10f || x[i] < -1e10f) x[i] = 0.0f;
+            sum += x[i];
+        }
+    }
+    float mean = sum / n, variance;
+#ifdef KERNELS_X86
+    if (kern_cfg.level == KERN_AVX2) variance = kern_sqdev_avx2(x, n, mean);
+    else if (kern_cfg.level == KERN_SSE) variance = kern_sqdev_sse(x, n, mean);
+    else
+#endif
+    {
+        variance = 0.0f;
+        for (int i = 0; i < n; i++) { float d = x[i] - mean; variance += d * d; }
+    }
+    variance /= n;
+    float std_dev = sqrtf(variance + 1e-8f);
+#ifdef KERNELS_X86
+    if (kern_cfg.level == KERN_AVX2) { kern_sub_div_avx2(x, n, mean, std_dev); return; }
+    if (kern_cfg.level == KERN_SSE) { kern_sub_div_sse(x, n, mean, std_dev); return; }
+#endif
+    for (int i = 0; i < n; i++) x[i] = (x[i] - mean) / std_dev;
+}
+
+// --- Thread pool ---
+// Workers sleep on a condition variable and split [0, n) into one chunk per
+// thread (rounded to 16 floats); the calling thread takes a chunk as well.
+// The pool runs one job at a time. A caller that finds it busy, whether
+// another thread or a task calling back into the kernels, runs its job on
+// its own thread, which gives the same results.
+
+typedef void (*KernTask)(void *arg, int begin, int end);
+
+static struct {
+    int started, workers;
+    pthread_t tid[KERN_MAX_THREADS];
+    pthread_mutex_t submit;  // held by the caller whose job the pool runs
+    pthread_mutex_t mu;
+    pthread_cond_t work_cv, done_cv;
+    unsigned long generation;
+    KernTask task;
+    void *arg;
+    int n, chunk, next, pending;
+} kern_pool = { .submit = PTHREAD_MUTEX_INITIALIZER, .mu = PTHREAD_MUTEX_INITIALIZER,
+                .work_cv = PTHREAD_COND_INITIALIZER, .done_cv = PTHREAD_COND_INITIALIZER };
+
+// Take chunks of the current job until none are left; called with mu held
+static inline void kern_pool_drain(void) {
+    while (kern_pool.next < kern_pool.n) {
+        int begin = kern_pool.next, end = begin + kern_pool.chunk;
+        if (end > kern_pool.n) end = kern_pool.n;
+        kern_pool.next = end;
+        KernTask task = kern_pool.task;
+        void *arg = kern_pool.arg;
+        pthread_mutex_unlock(&kern_pool.mu);
+        task(arg, begin, end);
+        pthread_mutex_lock(&kern_pool.mu);
+        if (--kern_pool.pending == 0) pthread_cond_signal(&kern_pool.done_cv);
+    }
+}
+
+static inline void *kern_pool_worker(void *unused) {
+    (void)unused;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&kern_pool.mu);
+    for (;;) {
+        while (kern_pool.generation == seen) pthread_cond_wait(&kern_pool.work_cv, &kern_pool.mu);
+        seen = kern_pool.generation;
+        kern_pool_drain();
+    }
+    return NULL;
+}
+
+static inline void kern_pool_start(void) {
+    kern_pool.started = 1;
+    for (int i = 0; i < kern_cfg.threads - 1; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&kern_pool.tid[i], &attr, kern_pool_worker, NULL) == 0) kern_pool.workers++;
+        pthread_attr_destroy(&attr);
+    }
+}
+
+// Run task over [0, n); work is the multiply-adds per index, used to keep
+// small calls on the calling thread
+static inline void kern_parallel_for(KernTask task, void *arg, int n, long work) {
+    kernels_init();
+    if (kern_cfg.threads <= 1 || (long)n * work < KERN_MIN_PARALLEL_WORK) { task(arg, 0, n); return; }
+    if (pthread_mutex_trylock(&kern_pool.submit) != 0) { task(arg, 0, n); return; }
+    pthread_mutex_lock(&kern_pool.mu);
+    if (!kern_pool.started) kern_pool_start();
+    int parts = kern_pool.workers + 1;
+    int chunk = ((n + parts - 1) / parts + 15) & ~15;
+    kern_pool.task = task;
+    kern_pool.arg = arg;
+    kern_pool.n = n;
+    kern_pool.chunk = chunk;
+    kern_pool.next = 0;
+    kern_pool.pending = (n + chunk - 1) / chunk;
+    kern_pool.generation++;
+    pthread_cond_broadcast(&kern_pool.work_cv);
+    kern_pool_drain();
+    while (kern_pool.pending > 0) pthread_cond_wait(&kern_pool.done_cv, &kern_pool.mu);
+    pthread_mutex_unlock(&kern_pool.mu);
+    pthread_mutex_unlock(&kern_pool.submit);
+}
+
+// --- Vocabulary-wide products ---
+
+typedef struct {
+    const float *a;            // rows x k, row-major
+    const float *const *b;     // k rows of vs floats
+    const float *bias;         // vs floats, or NULL
+    float *out;                // rows x vs
+    int rows, k, vs;
+    float scale, lo, hi;       // scores only
+    int clip;
+} KernProductJob;
+
+// out[r][j] = sum_l a[r][l] * b[l][j] (+ bias[j]) for j in [begin, end),
+// accumulated in l order like the scalar loops
+static inline void kern_product_task(void *arg, int begin, int end) {
+    KernProductJob *job = (KernProductJob*)arg;
+    for (int j0 = begin; j0 < end; j0 += KERN_TILE) {
+        int len = (j0 + KERN_TILE < end ? j0 + KERN_TILE : end) - j0;
+        for (int r = 0; r < job->rows; r++) {
+            const float *ar = job->a + (size_t)r * job->k;
+            float *o = job->out + (size_t)r * job->vs + j0;
+            memset(o, 0, len * sizeof(float));
+            for (int l = 0; l < job->k; l++) kern_axpy(ar[l], job->b[l] + j0, o, len);
+            if (job->bias) kern_add(job->bias + j0, o, len);
+            if (job->clip) kern_scale_clip(o, len, job->scale, job->lo, job->hi);
+        }
+    }
+}
+
+// Attention scores for `rows` queries: clamp(scale * q . key_j, -10, 10).
+// keys_t holds the keys transposed, dim rows of vs floats.
+static inline void kern_scores(const float *q, int rows, int dim, const float *keys_t, float *scores, int vs, float scale) {
+    const float *cols[64];
+    for (int l = 0; l < dim && l < 64; l++) cols[l] = keys_t + (size_t)l * vs;
+    KernProductJob job = { q, cols, NULL, scores, rows, dim, vs, scale, -10.0f, 10.0f, 1 };
+    kern_parallel_for(kern_product_task, &job, vs, (long)rows * dim);
+}
+
+// Output layer logits for `rows` hidden vectors: h . W + b, with W given as
+// hidden rows of vs floats (OutputLayer.weights)
+static inline void kern_output_projection(const float *h, int rows, int hidden, float *const *weights, const float *biases, float *out, int vs) {
+    KernProductJob job = { h, (const float *const *)weights, biases, out, rows, hidden, vs, 1.0f, 0.0f, 0.0f, 0 };
+    kern_parallel_for(kern_product_task, &job, vs, (long)rows * hidden);
+}
+
+typedef struct {
+    const float *h;            // rows x hidden
+    int dtype;                 // QUANT_I8 or QUANT_F16
+    const void *const *codes;  // hidden rows of vs values
+    const float *scales;       // vs int8 column scales, NULL for fp16
+    const float *biases;       // vs floats
+    float *out;                // rows x vs
+    int rows, hidden, vs;
+} KernQuantJob;
+
+// Dequantize a hidden x KERN_TILE slice of the layer once, then accumulate
+// every row from it in l order as kern_product_task() does
+static inline void kern_quant_projection_task(void *arg, int begin, int end) {
+    KernQuantJob *job = (KernQuantJob*)arg;
+    float *tile = malloc((size_t)job->hidden * KERN_TILE * sizeof(float));
+    if (!tile) { fprintf(stderr, "Failed to allocate a dequantization tile\n"); exit(1); }
+    int size = quant_size(job->dtype);
+    for (int j0 = begin; j0 < end; j0 += KERN_TILE) {
+        int len = (j0 + KERN_TILE < end ? j0 + KERN_TILE : end) - j0;
+        for (int l = 0; l < job->hidden; l++)
+            kern_dequant(job->dtype, (const char*)job->codes[l] + (size_t)j0 * size, job->scales ? job->scales + j0 : NULL, tile + (size_t)l * KERN_TILE, len);
+        for (int r = 0; r < job->rows; r++) {
+            const float *hr = job->h + (size_t)r * job->hidden;
+            float *o = job->out + (size_t)r * job->vs + j0;
+            memset(o, 0, len * sizeof(float));
+            for (int l = 0; l < job->hidden; l++) kern_axpy(hr[l], tile + (size_t)l * KERN_TILE, o, len);
+            if (job->biases) kern_add(job->biases + j0, o, len);
+        }
+    }
+    free(tile);
+}
+
+// kern_output_projection() for a layer stored as int8 codes with one scale
+// per word, or as fp16 (quant.h). Equal to kern_output_projection() on the
+// dequantized weights.
+static inline void kern_output_projection_quant(const float *h, int rows, int hidden, int dtype, const void *const *codes, const float *scales,
+                                                const float *biases, float *out, int vs) {
+    KernQuantJob job = { h, dtype, codes, scales, biases, out, rows, hidden, vs };
+    kern_parallel_for(kern_quant_projection_task, &job, vs, (long)(rows + 1) * hidden);
+}
+
+// --- Debug validation ---
+// With KERNELS_DEBUG=1, scan an output once, report and zero NaN/Inf. Off by
+// default: the kernels themselves carry no per-element checks.
+static inline int kern_check_finite(const char *what, float *x, int n) {
+    kernels_init();
+    if (!kern_cfg.debug) return 0;
+    int bad = 0;
+    for (int i = 0; i < n; i++) if (!isfinite(x[i])) { x[i] = 0.0f; bad++; }
+    if (bad) fprintf(stderr, "KERNELS_DEBUG: %d non-finite values in %s zeroed\n", bad, what);
+    return bad;
+}
+
+#endif
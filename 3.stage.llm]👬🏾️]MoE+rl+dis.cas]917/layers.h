@@ -0,0 +1,543 @@
+#ifndef LAYERS_H
+#define LAYERS_H
+
+// The model's three layers, shared by every program that runs them:
+// forward_prop.c, backward_prop.c and optimizer.c (one stage per process),
+// train_engine.h (trainer.c and distil/distill.c, in process), and
+// attention.c / mlp_layer.c (initialization).
+//
+// Parameters are plain row-major floats. AttentionLayer and MlpLayer are
+// fixed-size structs that can be walked as flat arrays; an OutputLayer is
+// HIDDEN_DIM rows of vs floats plus vs biases, one contiguous block from
+// alloc_output() or the rows of a mapped tensor file from open_output().
+// Every layer has
+//
+//   layer_*_forward    activations for one position (Q/K/V and logits for
+//                      n positions at once)
+//   layer_*_backward   parameter gradients, and the gradient of the input
+//   layer_*_adam       one Adam step over the parameters
+//
+// keeping the NaN/Inf guards, clamps, clipping and seeded dropout and noise
+// of the stage programs in their original order, so every caller gets the
+// same floats from the same inputs. test/layers_check.c compares them with
+// the stage math as it was before this header existed. Vocabulary-wide
+// products go through kernels.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tensor_file.h"
+#include "kernels.h"
+
+#ifndef EMBEDDING_DIM
+#define EMBEDDING_DIM 7
+#endif
+#ifndef HIDDEN_DIM
+#define HIDDEN_DIM 16
+#endif
+#ifndef EPSILON
+#define EPSILON 1e-8
+#endif
+#ifndef MAX_GRAD_NORM
+#define MAX_GRAD_NORM 0.5f
+#endif
+
+// Each stage process started its LCGs from these; a forward pass restarts
+// dropout per position and a backward pass restarts the noise per token
+#define LAYER_DROPOUT_SEED 12345
+#define LAYER_NOISE_SEED 54321
+
+// --- Data Structures ---
+typedef struct { float weights[EMBEDDING_DIM][HIDDEN_DIM]; float biases[HIDDEN_DIM]; } MlpLayer;
+typedef struct { float W_q[EMBEDDING_DIM][EMBEDDING_DIM], W_k[EMBEDDING_DIM][EMBEDDING_DIM], W_v[EMBEDDING_DIM][EMBEDDING_DIM]; } AttentionLayer;
+// A quantized layer (quantize.c) keeps its int8/fp16 codes in place of weights
+typedef struct { float **weights; float *biases; int dtype; const void *codes[HIDDEN_DIM]; const float *scales; } OutputLayer;
+
+static inline int layer_invalid(float x) { return x != x || x > 1e10f || x < -1e10f; }
+
+// --- Output layer storage ---
+static inline int alloc_output(OutputLayer *l, int vs) {
+    l->dtype = TENSOR_F32; l->scales = NULL;
+    l->weights = malloc(HIDDEN_DIM * sizeof(float*));
+    float *block = calloc((size_t)(HIDDEN_DIM + 1) * vs, sizeof(float));
+    if (!l->weights || !block) { free(l->weights); free(block); l->weights = NULL; l->biases = NULL; return 0; }
+    for (int i = 0; i < HIDDEN_DIM; i++) l->weights[i] = block + (size_t)i * vs;
+    l->biases = block + (size_t)HIDDEN_DIM * vs;
+    return 1;
+}
+static inline void free_output(OutputLayer *l) { if (l->weights) { free(l->weights[0]); free(l->weights); } l->weights = NULL; l->biases = NULL; }
+// Rows and biases share one block, so the whole layer is one flat array.
+static inline float *output_flat(OutputLayer *l) { return l->weights[0]; }
+
+// --- File I/O ---
+// Paths ending in .bin are tensor files (see tensor_file.h); anything else
+// is the text layout optimizer.c has always written. Loads return 0 when
+// the file cannot be read.
+static inline int load_matrix(const char *fn, float *m, int r, int c) { if(tensor_file_is_binary(fn)) return tensor_load_matrix(fn,m,r,c); FILE *f=fopen(fn,"r"); if(!f) return 0; for(int i=0;i<r;i++) for(int j=0;j<c;j++) fscanf(f, "%f", &m[i*c+j]); fclose(f); return 1; }
+static inline int save_matrix(const char *fn, const float *m, int r, int c) { if(tensor_path_is_bin(fn)) return tensor_save_matrix(fn,m,r,c); FILE *f=fopen(fn,"w"); if(!f) return 0; for(int i=0;i<r;i++){ for(int j=0;j<c;j++) fprintf(f, "%f ", m[i*c+j]); fprintf(f, "\n"); } fclose(f); return 1; }
+static inline int load_attention(const char *fn, AttentionLayer *l) { if(tensor_file_is_binary(fn)) return tensor_load_attention(fn,&l->W_q[0][0],&l->W_k[0][0],&l->W_v[0][0],EMBEDDING_DIM); FILE *f=fopen(fn,"r"); if(!f) return 0; for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) fscanf(f, "%f", &l->W_q[i][j]); for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) fscanf(f, "%f", &l->W_k[i][j]); for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) fscanf(f, "%f", &l->W_v[i][j]); fclose(f); return 1; }
+static inline int save_attention(const char *fn, AttentionLayer *l) { if(tensor_path_is_bin(fn)) return tensor_save_attention(fn,&l->W_q[0][0],&l->W_k[0][0],&l->W_v[0][0],EMBEDDING_DIM); FILE *f=fopen(fn,"w"); if(!f) return 0; for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) fprintf(f, "%f ", l->W_q[i][j]); fprintf(f, "\n"); for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) fprintf(f, "%f ", l->W_k[i][j]); fprintf(f, "\n"); for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) fprintf(f, "%f ", l->W_v[i][j]); fprintf(f, "\n"); fclose(f); return 1; }
+static inline int load_mlp(const char *fn, MlpLayer *l) { if(tensor_file_is_binary(fn)) return tensor_load_mlp(fn,&l->weights[0][0],EMBEDDING_DIM,HIDDEN_DIM,l->biases); FILE *f=fopen(fn,"r"); if(!f) return 0; for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) fscanf(f, "%f", &l->weights[i][j]); for(int i=0;i<HIDDEN_DIM;i++) fscanf(f, "%f", &l->biases[i]); fclose(f); return 1; }
+static inline int save_mlp(const char *fn, MlpLayer *l) { if(tensor_path_is_bin(fn)) return tensor_save_mlp(fn,&l->weights[0][0],EMBEDDING_DIM,HIDDEN_DIM,l->biases); FILE *f=fopen(fn,"w"); if(!f) return 0; for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) fprintf(f, "%f ", l->weights[i][j]); fprintf(f, "\n"); for(int i=0;i<HIDDEN_DIM;i++) fprintf(f, "%f ", l->biases[i]); fprintf(f, "\n"); fclose(f); return 1; }
+// Into a layer from alloc_output()
+static inline int load_output(const char *fn, OutputLayer *l, int vs) {
+    if (tensor_file_is_binary(fn)) {
+        TensorFile tf; float *rows[HIDDEN_DIM], *b;
+        if (!tensor_map_output(fn, &tf, 0, rows, HIDDEN_DIM, vs, &b)) return 0;
+        for (int i = 0; i < HIDDEN_DIM; i++) memcpy(l->weights[i], rows[i], vs * sizeof(float));
+        memcpy(l->biases, b, vs * sizeof(float));
+        tensor_file_close(&tf);
+        return 1;
+    }
+    FILE *f=fopen(fn,"r"); if(!f) return 0; for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<vs;j++) fscanf(f, "%f", &l->weights[i][j]); for(int i=0;i<vs;i++) fscanf(f, "%f", &l->biases[i]); fclose(f); return 1; }
+static inline int save_output(const char *fn, OutputLayer *l, int vs) { if(tensor_path_is_bin(fn)) return tensor_save_output(fn,l->weights,HIDDEN_DIM,vs,l->biases); FILE *f=fopen(fn,"w"); if(!f) return 0; for(int i=0;i<HIDDEN_DIM;i++){ for(int j=0;j<vs;j++) fprintf(f, "%f ", l->weights[i][j]); fprintf(f, "\n"); } for(int i=0;i<vs;i++) fprintf(f, "%f ", l->biases[i]); fprintf(f, "\n"); fclose(f); return 1; }
+
+// open_output() flags
+#define OUTPUT_WRITABLE 1   // map read-write: updates land in the file, no save needed
+#define OUTPUT_QUANTIZED 2  // accept quantized files; their codes replace weights
+
+// Binary output layers are used in place from the mapping instead of
+// copied; text files are read into alloc_output(). Returns 1 if mapped, 0
+// if read, -1 if out of memory. A layer that cannot be read stays zero.
+static inline int open_output(const char *fn, OutputLayer *l, int vs, TensorFile *map, int flags) {
+    memset(l, 0, sizeof(*l));
+    if (tensor_file_is_binary(fn)) {
+        if (flags & OUTPUT_QUANTIZED) {
+            int dtype = tensor_map_quantized(fn, map, l->codes, HIDDEN_DIM, vs, &l->scales, &l->biases);
+            if (dtype > 0) { l->dtype = dtype; return 1; }
+        }
+        l->weights = malloc(HIDDEN_DIM * sizeof(float*));
+        if (!l->weights) return -1;
+        if (tensor_map_output(fn, map, flags & OUTPUT_WRITABLE, l->weights, HIDDEN_DIM, vs, &l->biases)) return 1;
+        free(l->weights);
+        l->weights = NULL;
+    }
+    if (!alloc_output(l, vs)) return -1;
+    load_output(fn, l, vs);
+    return 0;
+}
+
+// Counterpart of open_output(): unmap (flushing a writable mapping) or free
+static inline void close_output(OutputLayer *l, TensorFile *map, int mapped) {
+    if (mapped > 0) {
+        tensor_file_close(map);
+        free(l->weights);
+        l->weights = NULL;
+        l->biases = NULL;
+        return;
+    }
+    free_output(l);
+}
+
+// --- Initialization ---
+static inline void initialize_attention(AttentionLayer *a) {
+    for (int i = 0; i < EMBEDDING_DIM; i++) {
+        for (int j = 0; j < EMBEDDING_DIM; j++) {
+            a->W_q[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
+            a->W_k[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
+            a->W_v[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
+        }
+    }
+}
+static inline void initialize_mlp(MlpLayer *m) {
+    for (int i = 0; i < EMBEDDING_DIM; i++) for (int j = 0; j < HIDDEN_DIM; j++) m->weights[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
+    for (int i = 0; i < HIDDEN_DIM; i++) m->biases[i] = 0.0f;
+}
+static inline void initialize_output(OutputLayer *o, int vs) {
+    for (int i = 0; i < HIDDEN_DIM; i++) for (int j = 0; j < vs; j++) o->weights[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
+    for (int j = 0; j < vs; j++) o->biases[j] = 0.0f;
+}
+
+// --- Forward helpers ---
+// Dropout with a linear congruential generator, for reproducibility
+static inline void apply_dropout(float *x, int size, float dropout_rate, unsigned int *seed) {
+    if (dropout_rate <= 0.0f || dropout_rate >= 1.0f) return;
+    for (int i = 0; i < size; i++) {
+        *seed = (*seed * 1103515245 + 12345) & 0x7fffffff;
+        float rand_val = (float)*seed / (float)0x7fffffff;
+        if (rand_val < dropout_rate) x[i] = 0.0f;
+        else x[i] /= (1.0f - dropout_rate);
+    }
+}
+static inline void apply_causal_mask(float *attn_scores, int vocab_size, int current_position) {
+    for (int i = current_position + 1; i < vocab_size; i++) attn_scores[i] = -1e9f;
+}
+static inline void relu(float *x, int s){for(int i=0;i<s;i++)if(x[i]<0)x[i]=0;}
+// softmax and layer_norm are kern_softmax/kern_layer_norm (kernels.h)
+
+// --- Backward helpers ---
+static inline void relu_derivative(const float *x, float *d, int s){
+    for(int i=0;i<s;i++) {
+        if (x[i] != x[i] || x[i] > 1e10f || x[i] < -1e10f) d[i] = 0;
+        else d[i] = (x[i] > 0) ? 1 : 0;
+    }
+}
+// L2 norm; NaN/Inf entries are zeroed on the way
+static inline float gradient_norm(float *grad, int size) {
+    float sum = 0.0f;
+    for (int i = 0; i < size; i++) {
+        if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) { grad[i] = 0.0f; continue; }
+        sum += grad[i] * grad[i];
+    }
+    if (sum < 0) sum = 0;
+    return sqrtf(sum);
+}
+static inline void clip_gradients(float *grad, int size, float max_norm) {
+    for (int i = 0; i < size; i++) if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) grad[i] = 0.0f;
+    float norm = gradient_norm(grad, size);
+    if (norm > max_norm && norm > 1e-12f) {
+        float scale = max_norm / norm;
+        if (scale != scale || scale > 1e10f || scale < -1e10f) scale = 1.0f;
+        for (int i = 0; i < size; i++) {
+            grad[i] *= scale;
+            if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) grad[i] = 0.0f;
+        }
+    }
+}
+static inline void clip_gradients_2d(float *grad, int rows, int cols, float max_norm) {
+    int size = rows * cols;
+    for (int i = 0; i < size; i++) if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) grad[i] = 0.0f;
+    float norm = 0.0f;
+    for (int i = 0; i < size; i++) norm += grad[i] * grad[i];
+    norm = sqrtf(norm);
+    if (norm > max_norm && norm > 1e-12f) {
+        float scale = max_norm / norm;
+        if (scale != scale || scale > 1e10f || scale < -1e10f) scale = 1.0f;
+        for (int i = 0; i < size; i++) {
+            grad[i] *= scale;
+            if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) grad[i] = 0.0f;
+        }
+    }
+}
+// Gaussian noise (Box-Muller over the LCG); invalid entries become noise
+static inline void add_gradient_noise(float *grad, int size, float noise_scale, unsigned int *seed) {
+    if (noise_scale <= 0.0f) return;
+    for (int i = 0; i < size; i++) {
+        *seed = (*seed * 1103515245 + 12345) & 0x7fffffff;
+        float u1 = (float)*seed / (float)0x7fffffff;
+        *seed = (*seed * 1103515245 + 12345) & 0x7fffffff;
+        float u2 = (float)*seed / (float)0x7fffffff;
+        if (u1 < 1e-10f) u1 = 1e-10f;
+        float noise = sqrtf(-2.0f * logf(u1)) * cosf(2.0f * M_PI * u2);
+        noise *= noise_scale;
+        if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) grad[i] = noise;
+        else grad[i] += noise;
+    }
+}
+
+// --- Optimizer helpers ---
+// Normalizes each layer's gradient to unit norm, then scales all of them
+// by MAX_GRAD_NORM over the global norm taken before normalizing. Only W_q
+// of the attention layer carries a gradient. g_o holds vs columns.
+static inline void clip_layer_gradients(AttentionLayer *g_a, MlpLayer *g_m, OutputLayer *g_o, int vs) {
+    float total_norm = 0;
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) {
+        if (g_a->W_q[i][j] != g_a->W_q[i][j] || g_a->W_q[i][j] > 1e10f || g_a->W_q[i][j] < -1e10f) g_a->W_q[i][j] = 0.0f;
+        total_norm += g_a->W_q[i][j] * g_a->W_q[i][j];
+    }
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) {
+        if (g_m->weights[i][j] != g_m->weights[i][j] || g_m->weights[i][j] > 1e10f || g_m->weights[i][j] < -1e10f) g_m->weights[i][j] = 0.0f;
+        total_norm += g_m->weights[i][j] * g_m->weights[i][j];
+    }
+    for(int i=0;i<HIDDEN_DIM;i++) {
+        if (g_m->biases[i] != g_m->biases[i] || g_m->biases[i] > 1e10f || g_m->biases[i] < -1e10f) g_m->biases[i] = 0.0f;
+        total_norm += g_m->biases[i] * g_m->biases[i];
+    }
+    for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<vs;j++) {
+        if (g_o->weights[i][j] != g_o->weights[i][j] || g_o->weights[i][j] > 1e10f || g_o->weights[i][j] < -1e10f) g_o->weights[i][j] = 0.0f;
+        total_norm += g_o->weights[i][j] * g_o->weights[i][j];
+    }
+    for(int i=0;i<vs;i++) {
+        if (g_o->biases[i] != g_o->biases[i] || g_o->biases[i] > 1e10f || g_o->biases[i] < -1e10f) g_o->biases[i] = 0.0f;
+        total_norm += g_o->biases[i] * g_o->biases[i];
+    }
+    if (total_norm < 0) total_norm = 0;
+    total_norm = sqrt(total_norm);
+
+    float attn_norm = 0;
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) attn_norm += g_a->W_q[i][j] * g_a->W_q[i][j];
+    attn_norm = sqrt(attn_norm);
+    float mlp_norm = 0;
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) mlp_norm += g_m->weights[i][j] * g_m->weights[i][j];
+    for(int i=0;i<HIDDEN_DIM;i++) mlp_norm += g_m->biases[i] * g_m->biases[i];
+    mlp_norm = sqrt(mlp_norm);
+    float output_norm = 0;
+    for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<vs;j++) output_norm += g_o->weights[i][j] * g_o->weights[i][j];
+    for(int i=0;i<vs;i++) output_norm += g_o->biases[i] * g_o->biases[i];
+    output_norm = sqrt(output_norm);
+
+    if (attn_norm > 1e-12f && attn_norm < 1e10f) {
+        float attn_scale = 1.0f / attn_norm;
+        for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) {
+            g_a->W_q[i][j] *= attn_scale;
+            if (g_a->W_q[i][j] != g_a->W_q[i][j] || g_a->W_q[i][j] > 1e10f || g_a->W_q[i][j] < -1e10f) g_a->W_q[i][j] = 0.0f;
+        }
+    }
+    if (mlp_norm > 1e-12f && mlp_norm < 1e10f) {
+        float mlp_scale = 1.0f / mlp_norm;
+        for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) {
+            g_m->weights[i][j] *= mlp_scale;
+            if (g_m->weights[i][j] != g_m->weights[i][j] || g_m->weights[i][j] > 1e10f || g_m->weights[i][j] < -1e10f) g_m->weights[i][j] = 0.0f;
+        }
+        for(int i=0;i<HIDDEN_DIM;i++) {
+            g_m->biases[i] *= mlp_scale;
+            if (g_m->biases[i] != g_m->biases[i] || g_m->biases[i] > 1e10f || g_m->biases[i] < -1e10f) g_m->biases[i] = 0.0f;
+        }
+    }
+    if (output_norm > 1e-12f && output_norm < 1e10f) {
+        float output_scale = 1.0f / output_norm;
+        for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<vs;j++) {
+            g_o->weights[i][j] *= output_scale;
+            if (g_o->weights[i][j] != g_o->weights[i][j] || g_o->weights[i][j] > 1e10f || g_o->weights[i][j] < -1e10f) g_o->weights[i][j] = 0.0f;
+        }
+        for(int i=0;i<vs;i++) {
+            g_o->biases[i] *= output_scale;
+            if (g_o->biases[i] != g_o->biases[i] || g_o->biases[i] > 1e10f || g_o->biases[i] < -1e10f) g_o->biases[i] = 0.0f;
+        }
+    }
+    if (total_norm > MAX_GRAD_NORM && total_norm > 1e-12f) {
+        float scale = MAX_GRAD_NORM / total_norm;
+        if (scale != scale || scale > 1e10f || scale < -1e10f) scale = 1.0f;
+        for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) {
+            g_a->W_q[i][j] *= scale;
+            if (g_a->W_q[i][j] != g_a->W_q[i][j] || g_a->W_q[i][j] > 1e10f || g_a->W_q[i][j] < -1e10f) g_a->W_q[i][j] = 0.0f;
+        }
+        for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) {
+            g_m->weights[i][j] *= scale;
+            if (g_m->weights[i][j] != g_m->weights[i][j] || g_m->weights[i][j] > 1e10f || g_m->weights[i][j] < -1e10f) g_m->weights[i][j] = 0.0f;
+        }
+        for(int i=0;i<HIDDEN_DIM;i++) {
+            g_m->biases[i] *= scale;
+            if (g_m->biases[i] != g_m->biases[i] || g_m->biases[i] > 1e10f || g_m->biases[i] < -1e10f) g_m->biases[i] = 0.0f;
+        }
+        for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<vs;j++) {
+            g_o->weights[i][j] *= scale;
+            if (g_o->weights[i][j] != g_o->weights[i][j] || g_o->weights[i][j] > 1e10f || g_o->weights[i][j] < -1e10f) g_o->weights[i][j] = 0.0f;
+        }
+        for(int i=0;i<vs;i++) {
+            g_o->biases[i] *= scale;
+            if (g_o->biases[i] != g_o->biases[i] || g_o->biases[i] > 1e10f || g_o->biases[i] < -1e10f) g_o->biases[i] = 0.0f;
+        }
+    }
+}
+
+static inline void adam_update(float *p, float *m, float *v, float g, float lr, float b1, float b2, int t) {
+    if (g != g || g > 1e10f || g < -1e10f) g = 0.0f;
+    if (*m != *m || *m > 1e10f || *m < -1e10f) *m = 0.0f;
+    if (*v != *v || *v > 1e10f || *v < -1e10f) *v = 0.0f;
+    *m = b1 * *m + (1-b1) * g;
+    *v = b2 * *v + (1-b2) * g * g;
+    if (*m != *m || *m > 1e10f || *m < -1e10f) *m = 0.0f;
+    if (*v != *v || *v > 1e10f || *v < -1e10f) *v = 0.0f;
+    float b1t = powf(b1, t);
+    float b2t = powf(b2, t);
+    float mh = 0.0f, vh = 0.0f;
+    if (fabsf(1.0f - b1t) > 1e-12f) mh = *m / (1.0f - b1t);
+    if (fabsf(1.0f - b2t) > 1e-12f) vh = *v / (1.0f - b2t);
+    if (mh != mh || mh > 1e10f || mh < -1e10f) mh = 0.0f;
+    if (vh != vh || vh > 1e10f || vh < -1e10f) vh = 0.0f;
+    float denom = sqrtf(vh) + EPSILON;
+    if (denom != denom || denom > 1e10f || denom < -1e10f) denom = EPSILON;
+    float update = lr * mh / denom;
+    if (update != update || update > 1e10f || update < -1e10f) update = 0.0f;
+    *p -= update;
+    if (*p != *p || *p > 1e10f || *p < -1e10f) *p = 0.0f;
+}
+
+// --- Attention layer ---
+// Keys transposed to EMBEDDING_DIM rows of vs floats for kern_scores(), and
+// each word's feature sum, which is all the context vector needs. feats is
+// vs x EMBEDDING_DIM; row 0 of cols is then every word's embedding.
+static inline void layer_feature_columns(const float *feats, int vs, float *cols, float *sums) {
+    for (int j = 0; j < vs; j++) {
+        const float *f = feats + (size_t)j * EMBEDDING_DIM;
+        sums[j] = 0;
+        for (int l = 0; l < EMBEDDING_DIM; l++) { cols[(size_t)l * vs + j] = f[l]; sums[j] += f[l]; }
+    }
+}
+
+// Q, K and V for n input rows: (n x 7) * (7 x 7). A non-finite term skips
+// the rest of that (j,l) step, as the single-token loop always did.
+static inline void layer_attention_qkv(const AttentionLayer *a, const float *x, int n, float *q, float *k, float *val) {
+    memset(q, 0, (size_t)n * EMBEDDING_DIM * sizeof(float));
+    memset(k, 0, (size_t)n * EMBEDDING_DIM * sizeof(float));
+    memset(val, 0, (size_t)n * EMBEDDING_DIM * sizeof(float));
+    for (int b = 0; b < n; b++) {
+        const float *iv = x + b * EMBEDDING_DIM;
+        float *qb = q + b * EMBEDDING_DIM, *kb = k + b * EMBEDDING_DIM, *vb = val + b * EMBEDDING_DIM;
+        for (int j = 0; j < EMBEDDING_DIM; j++) {
+            for (int l = 0; l < EMBEDDING_DIM; l++) {
+                if (layer_invalid(iv[l]) || layer_invalid(a->W_q[l][j])) continue;
+                qb[j] += iv[l] * a->W_q[l][j];
+                if (layer_invalid(a->W_k[l][j])) continue;
+                kb[j] += iv[l] * a->W_k[l][j];
+                if (layer_invalid(a->W_v[l][j])) continue;
+                vb[j] += iv[l] * a->W_v[l][j];
+            }
+        }
+    }
+}
+
+// Scores of n queries against every word's features: (n x 7) * (7 x vs),
+// scaled by 1/sqrt(EMBEDDING_DIM) and clipped to [-10, 10]
+static inline void layer_attention_scores(const float *q, int n, const float *cols, float *scores, int vs) {
+    kern_scores(q, n, EMBEDDING_DIM, cols, scores, vs, 1.0f / sqrt(EMBEDDING_DIM));
+    kern_check_finite("attention scores", scores, n * vs);
+}
+
+// One position: its scores in as become attention weights (causal mask
+// past causal_pos unless it is negative, 10% dropout, softmax, layer norm)
+// and ctx the context vector: the weights dotted with the feature sums,
+// plus the input x as a residual, layer-normed. seed drives the dropout.
+static inline void layer_attention_forward(float *as, int vs, const float *sums, const float *x, int causal_pos, unsigned int *seed, float *ctx) {
+    if (causal_pos >= 0) apply_causal_mask(as, vs, causal_pos);
+    apply_dropout(as, vs, 0.1f, seed);
+    kern_softmax(as, vs);
+    kern_layer_norm(as, vs);
+    // Every context component is the same sum over the vocabulary of
+    // weight * feature, i.e. the weights dotted with the feature sums
+    float c = kern_dot(as, sums, vs);
+    for (int l = 0; l < EMBEDDING_DIM; l++) ctx[l] = c + x[l];
+    kern_layer_norm(ctx, EMBEDDING_DIM);
+}
+
+// W_q gradient from g_c, the gradient of the context vector. Through the
+// scores, g_as[i] = (g_c . val) / sqrt(EMBEDDING_DIM) for every word,
+// clamped to [-10, 10], clipped to norm 1 and noised; W_q[i][j] then gets
+// sum_w emb[w] * g_as[w] times x_emb, the input word's own embedding. W_k
+// and W_v get noise only, after the whole layer is clipped to norm 1. emb
+// holds the vs word embeddings, g_as vs floats of scratch; the noise draws
+// from seed.
+static inline void layer_attention_backward(const float *g_c, const float *val, const float *emb, float x_emb, int vs, float *g_as, unsigned int *seed, AttentionLayer *g_a) {
+    memset(g_a, 0, sizeof(*g_a));
+    float scale = 1.0f / sqrt(EMBEDDING_DIM);
+    for (int i = 0; i < vs; i++) {
+        g_as[i] = 0;
+        for (int j = 0; j < EMBEDDING_DIM; j++) {
+            if (layer_invalid(g_c[j]) || layer_invalid(val[j])) continue;
+            g_as[i] += g_c[j] * val[j];
+        }
+        if (layer_invalid(scale)) scale = 1.0f;
+        g_as[i] *= scale;
+        if (g_as[i] > 10.0f) g_as[i] = 10.0f;
+        if (g_as[i] < -10.0f) g_as[i] = -10.0f;
+    }
+    clip_gradients(g_as, vs, 1.0f);
+    add_gradient_noise(g_as, vs, 0.01f, seed);
+
+    float g_q[EMBEDDING_DIM] = { 0 };
+    for (int i = 0; i < vs; i++) for (int j = 0; j < EMBEDDING_DIM; j++) {
+        if (layer_invalid(emb[i]) || layer_invalid(g_as[i])) continue;
+        g_q[j] += emb[i] * g_as[i];
+    }
+    for (int i = 0; i < EMBEDDING_DIM; i++) for (int j = 0; j < EMBEDDING_DIM; j++) {
+        if (layer_invalid(g_q[j]) || layer_invalid(x_emb)) g_a->W_q[i][j] = 0;
+        else g_a->W_q[i][j] = g_q[j] * x_emb;
+    }
+    clip_gradients_2d((float*)g_a, sizeof(*g_a)/sizeof(float), 1, 1.0f);
+    add_gradient_noise((float*)g_a, sizeof(*g_a)/sizeof(float), 0.005f, seed);
+    gradient_norm((float*)g_a, sizeof(*g_a)/sizeof(float));
+}
+
+// Only W_q is trained; W_k and W_v keep their initial values
+static inline void layer_attention_adam(AttentionLayer *p, AttentionLayer *m, AttentionLayer *v, const AttentionLayer *g, float lr, float b1, float b2, int t) {
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) adam_update(&p->W_q[i][j],&m->W_q[i][j],&v->W_q[i][j],g->W_q[i][j],lr,b1,b2,t);
+}
+
+// --- MLP layer ---
+// Hidden state for one position: (1 x 7) * (7 x 16) + biases, layer norm,
+// ReLU, then 20% dropout continuing from the attention's seed
+static inline void layer_mlp_forward(const MlpLayer *m, const float *ctx, float *h, unsigned int *seed) {
+    for (int j = 0; j < HIDDEN_DIM; j++) {
+        h[j] = 0;
+        for (int l = 0; l < EMBEDDING_DIM; l++) h[j] += ctx[l] * m->weights[l][j];
+        h[j] += m->biases[j];
+    }
+    kern_layer_norm(h, HIDDEN_DIM);
+    relu(h, HIDDEN_DIM);
+    apply_dropout(h, HIDDEN_DIM, 0.2f, seed);
+}
+
+// Gradients from g_h, the gradient of the hidden state h, which is masked
+// by the ReLU derivative in place; ctx is the layer's input. Leaves the
+// gradient of ctx in g_c.
+static inline void layer_mlp_backward(const MlpLayer *m, const float *ctx, const float *h, float *g_h, MlpLayer *g_m, float *g_c) {
+    float d_r[HIDDEN_DIM];
+    relu_derivative(h, d_r, HIDDEN_DIM);
+    for (int j = 0; j < HIDDEN_DIM; j++) {
+        if (layer_invalid(g_h[j]) || d_r[j] != d_r[j]) g_h[j] = 0;
+        else g_h[j] *= d_r[j];
+    }
+    for (int i = 0; i < EMBEDDING_DIM; i++) for (int j = 0; j < HIDDEN_DIM; j++) {
+        if (layer_invalid(g_h[j]) || layer_invalid(ctx[i])) g_m->weights[i][j] = 0;
+        else g_m->weights[i][j] = g_h[j] * ctx[i];
+    }
+    for (int j = 0; j < HIDDEN_DIM; j++) {
+        if (layer_invalid(g_h[j])) g_m->biases[j] = 0;
+        else g_m->biases[j] = g_h[j];
+    }
+    for (int i = 0; i < EMBEDDING_DIM; i++) {
+        g_c[i] = 0;
+        for (int j = 0; j < HIDDEN_DIM; j++) {
+            if (layer_invalid(g_h[j]) || layer_invalid(m->weights[i][j])) continue;
+            g_c[i] += g_h[j] * m->weights[i][j];
+        }
+    }
+    gradient_norm((float*)g_m, sizeof(*g_m)/sizeof(float));
+}
+
+static inline void layer_mlp_adam(MlpLayer *p, MlpLayer *m, MlpLayer *v, const MlpLayer *g, float lr, float b1, float b2, int t) {
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) adam_update(&p->weights[i][j],&m->weights[i][j],&v->weights[i][j],g->weights[i][j],lr,b1,b2,t);
+    for(int i=0;i<HIDDEN_DIM;i++) adam_update(&p->biases[i],&m->biases[i],&v->biases[i],g->biases[i],lr,b1,b2,t);
+}
+
+// --- Output layer ---
+// Logits for n hidden rows: (n x 16) * (16 x vs) + biases
+static inline void layer_output_forward(const OutputLayer *o, const float *h, int n, float *p, int vs) {
+    if (o->dtype != TENSOR_F32) kern_output_projection_quant(h, n, HIDDEN_DIM, o->dtype, o->codes, o->scales, o->biases, p, vs);
+    else kern_output_projection(h, n, HIDDEN_DIM, o->weights, o->biases, p, vs);
+    kern_check_finite("logits", p, n * vs);
+}
+
+// Gradients from g_p, the gradient of the logits, over nc columns: column
+// j of g_o and g_p is output column cols[j], or j when cols is NULL and
+// nc is vs. Entries are clamped to [-10, 10], then each weight row and the
+// biases clipped to norm 1. Leaves the gradient of the hidden state h in g_h.
+static inline void layer_output_backward(const OutputLayer *o, const float *g_p, const int *cols, int nc, const float *h, OutputLayer *g_o, float *g_h) {
+    for (int i = 0; i < HIDDEN_DIM; i++) {
+        for (int j = 0; j < nc; j++) {
+            if (layer_invalid(g_p[j]) || layer_invalid(h[i])) g_o->weights[i][j] = 0;
+            else g_o->weights[i][j] = g_p[j] * h[i];
+            if (g_o->weights[i][j] > 10.0f) g_o->weights[i][j] = 10.0f;
+            if (g_o->weights[i][j] < -10.0f) g_o->weights[i][j] = -10.0f;
+        }
+    }
+    for (int j = 0; j < nc; j++) {
+        if (layer_invalid(g_p[j])) g_o->biases[j] = 0;
+        else g_o->biases[j] = g_p[j];
+        if (g_o->biases[j] > 10.0f) g_o->biases[j] = 10.0f;
+        if (g_o->biases[j] < -10.0f) g_o->biases[j] = -10.0f;
+    }
+    for (int i = 0; i < HIDDEN_DIM; i++) {
+        g_h[i] = 0;
+        for (int j = 0; j < nc; j++) {
+            float w = o->weights[i][cols ? cols[j] : j];
+            if (layer_invalid(g_p[j]) || layer_invalid(w)) continue;
+            g_h[i] += g_p[j] * w;
+        }
+    }
+    for (int i = 0; i < HIDDEN_DIM; i++) clip_gradients(g_o->weights[i], nc, 1.0f);
+    clip_gradients(g_o->biases, nc, 1.0f);
+    for (int i = 0; i < HIDDEN_DIM; i++) for (int j = 0; j < nc; j++) if (layer_invalid(g_o->weights[i][j])) g_o->weights[i][j] = 0.0f;
+    for (int i = 0; i < nc; i++) if (layer_invalid(g_o->biases[i])) g_o->biases[i] = 0.0f;
+}
+
+// Adam over the columns in g: all vs when cols is NULL, otherwise lazily
+// over cols[0..nc) only, so the other columns keep their moments
+static inline void layer_output_adam(OutputLayer *p, OutputLayer *m, OutputLayer *v, const OutputLayer *g, const int *cols, int nc, float lr, float b1, float b2, int t) {
+    for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<nc;j++) { int c = cols ? cols[j] : j; adam_update(&p->weights[i][c],&m->weights[i][c],&v->weights[i][c],g->weights[i][j],lr,b1,b2,t); }
+    for(int j=0;j<nc;j++) { int c = cols ? cols[j] : j; adam_update(&p->biases[c],&m->biases[c],&v->biases[c],g->biases[j],lr,b1,b2,t); }
+}
+
+#endif
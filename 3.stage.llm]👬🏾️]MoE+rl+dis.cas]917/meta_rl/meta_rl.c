@@ -3,19 +3,22 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "../chat_protocol.h"
+#include "../curriculum_registry.h"
 
 #define MAX_CURRICULA 20
 #define MAX_PROMPT_LENGTH 1024
 #define MAX_FEATURES 50
+#define MAX_SELECTED 3
 #define LEARNING_RATE 0.1f
-
-// Structure to hold curriculum information
-struct Curriculum {
-    char path[1024];
-    char name[256];
-    float weight;  // RL weight for selection
-    float bias;    // RL bias for selection
-};
+#define EXPLORE_RATE 0.1f
+#define CHATBOT_BIN "./+x/chatbot_moe_v1.+x"
+#define CURRICULUM_DIR "./curriculum"
+#define REGISTRY_CACHE "meta_rl_registry.cache"
+#define WEIGHTS_FILE "meta_rl_weights.txt"
+#define SERVER_START_TIMEOUT_MS 5000
 
 // Structure to hold prompt features
 struct PromptFeatures {
@@ -30,33 +33,43 @@ struct PromptFeatures {
 };
 
 // Global variables
-struct Curriculum available_curricula[MAX_CURRICULA];
-int num_available_curricula = 0;
+CurriculumRegistry registry;
 struct PromptFeatures current_features;
+float route_features[ROUTE_PROMPT_FEATURES];
+uint32_t prompt_bits[ROUTE_MAX_PROMPT_WORDS];
+int num_prompt_bits;
 float rl_weights[MAX_FEATURES];
 float rl_bias;
 
-// Function to initialize available curricula
-void initialize_curricula() {
-    // Add available curricula with initial weights and biases
-    // Only use proper curriculum directories, not corpuses
-    strcpy(available_curricula[0].path, "./curriculum/corpus]similarity10/corpus]similarity10.txt");
-    strcpy(available_curricula[0].name, "corpus_similarity10");
-    available_curricula[0].weight = 0.5f;
-    available_curricula[0].bias = 0.0f;
-    
-    strcpy(available_curricula[1].path, "./curriculum/test_emoji/test_emoji.txt");
-    strcpy(available_curricula[1].name, "test_emoji");
-    available_curricula[1].weight = 0.5f;
-    available_curricula[1].bias = 0.0f;
-    
-    num_available_curricula = 2;
+// Weight file lines of curricula that are no longer on disk, written back
+// unchanged so their history survives a curriculum being moved away
+char **retired_weights;
+int num_retired_weights;
+
+// Function to initialize available curricula: every <dir>/<name>/<name>.txt
+// under META_RL_CURRICULA (default ./curriculum), with summaries cached in
+// meta_rl_registry.cache
+int initialize_curricula(int verbose) {
+    const char *dir = getenv("META_RL_CURRICULA");
+    if (!dir) dir = CURRICULUM_DIR;
+    registry_init(&registry);
+    int summarized = registry_discover(&registry, dir, REGISTRY_CACHE);
+    if (summarized < 0) {
+        fprintf(stderr, "Cannot open curriculum directory %s\n", dir);
+        return 0;
+    }
+    if (registry.count == 0) {
+        fprintf(stderr, "No curricula found in %s\n", dir);
+        return 0;
+    }
+    if (verbose) printf("Found %d curricula in %s (%d summarized, %d cached)\n", registry.count, dir, summarized, registry.count - summarized);
     
     // Initialize RL weights and bias
     for (int i = 0; i < MAX_FEATURES; i++) {
         rl_weights[i] = 0.0f;
     }
     rl_bias = 0.0f;
+    return 1;
 }
 
 // Function to extract features from prompt
@@ -103,10 +116,22 @@ void extract_prompt_features(const char* prompt) {
         strstr(prompt, "excited") || strstr(prompt, "love") || strstr(prompt, "hate")) {
         current_features.has_emotion = 1;
     }
+
+    // Router inputs: the same features on a comparable scale, and the
+    // prompt's words as vocabulary sketch bits
+    route_features[0] = log1pf(current_features.word_count);
+    route_features[1] = current_features.has_question;
+    route_features[2] = current_features.has_exclamation;
+    route_features[3] = current_features.has_emoji;
+    route_features[4] = current_features.has_greeting;
+    route_features[5] = current_features.has_emotion;
+    route_features[6] = log1pf(current_features.length) / 4.0f;
+    num_prompt_bits = registry_prompt_bits(prompt, prompt_bits, ROUTE_MAX_PROMPT_WORDS);
 }
 
-// Function to calculate selection score for a curriculum
-float calculate_selection_score(int curriculum_index) {
+// Function to calculate the global part of the selection score, shared by
+// all curricula; it decides how many of the routed curricula are used
+float calculate_selection_score() {
     float score = 0.0f;
     
     // Simple linear combination of features and weights
@@ -118,40 +143,43 @@ float calculate_selection_score(int curriculum_index) {
     score += current_features.has_emotion * rl_weights[5];
     score += current_features.length * rl_weights[6];
     
-    // Add curriculum-specific weight and bias
-    score += available_curricula[curriculum_index].weight + available_curricula[curriculum_index].bias;
-    
     // Add global bias
     score += rl_bias;
     
     return score;
 }
 
-// Function to select curricula based on scores
-int select_curricula(char selected_paths[MAX_CURRICULA][1024], int max_selections) {
-    float scores[MAX_CURRICULA];
+// Function to select curricula: the router's top max_selections, keeping
+// those with a positive total score (at least one). Now and then the last
+// slot goes to a random other curriculum so unpromising ones still get
+// feedback. Registry ids of the selection go to selected_ids.
+int select_curricula(char selected_paths[MAX_CURRICULA][1024], int selected_ids[MAX_CURRICULA], int max_selections) {
+    float scores[ROUTE_MAX_K];
+    int ids[ROUTE_MAX_K];
+    int found = registry_route(&registry, route_features, prompt_bits, num_prompt_bits, max_selections, ids, scores);
+    float global = calculate_selection_score();
     
-    // Calculate scores for all curricula
-    for (int i = 0; i < num_available_curricula; i++) {
-        scores[i] = calculate_selection_score(i);
-    }
-    
-    // Simple selection: select top N curricula
     int num_selected = 0;
-    for (int i = 0; i < num_available_curricula && num_selected < max_selections; i++) {
-        // Select curricula with positive scores or randomly with some probability
-        if (scores[i] > 0.0f || ((float)rand() / RAND_MAX) < 0.3f) {
-            strcpy(selected_paths[num_selected], available_curricula[i].path);
-            num_selected++;
+    for (int i = 0; i < found; i++) {
+        if (scores[i] + global > 0.0f || num_selected == 0) {
+            selected_ids[num_selected++] = ids[i];
         }
     }
     
-    // Always select at least one curriculum
-    if (num_selected == 0) {
-        strcpy(selected_paths[0], available_curricula[0].path);
-        num_selected = 1;
+    if (registry.count > num_selected && ((float)rand() / RAND_MAX) < EXPLORE_RATE) {
+        int pick, taken;
+        do {
+            pick = rand() % registry.count;
+            taken = 0;
+            for (int i = 0; i < num_selected; i++) taken |= selected_ids[i] == pick;
+        } while (taken);
+        if (num_selected < max_selections) num_selected++;
+        selected_ids[num_selected - 1] = pick;
     }
     
+    for (int i = 0; i < num_selected; i++) {
+        strcpy(selected_paths[i], registry.summaries[selected_ids[i]].path);
+    }
     return num_selected;
 }
 
@@ -170,12 +198,16 @@ void create_curriculum_bank(const char* bank_file_path, char selected_paths[MAX_
     fclose(bank_file);
 }
 
-// Function to get user feedback
+// Function to get user feedback. Scores can also be piped in, one per line,
+// for unattended episodes; the questions are only shown on a terminal.
 float get_user_feedback() {
     char feedback[10];
-    printf("\n--- Chatbot response completed ---\n");
-    printf("Please provide feedback on the response quality (1-10): ");
-    fflush(stdout);
+    int interactive = isatty(STDIN_FILENO);
+    if (interactive) {
+        printf("\n--- Chatbot response completed ---\n");
+        printf("Please provide feedback on the response quality (1-10): ");
+        fflush(stdout);
+    }
     
     if (fgets(feedback, sizeof(feedback), stdin)) {
         int score = atoi(feedback);
@@ -184,12 +216,12 @@ float get_user_feedback() {
         }
     }
     
-    printf("Invalid input, assuming neutral feedback (0)\n");
+    if (interactive) printf("Invalid input, assuming neutral feedback (0)\n");
     return 0.0f;
 }
 
 // Function to update RL weights based on feedback
-void update_rl_weights(float feedback) {
+void update_rl_weights(float feedback, const int *selected_ids, int num_selected) {
     // Simple gradient ascent update
     rl_weights[0] += LEARNING_RATE * feedback * current_features.word_count;
     rl_weights[1] += LEARNING_RATE * feedback * current_features.has_question;
@@ -200,17 +232,28 @@ void update_rl_weights(float feedback) {
     rl_weights[6] += LEARNING_RATE * feedback * current_features.length;
     rl_bias += LEARNING_RATE * feedback;
     
-    // Update curriculum weights (simplified)
-    // In a more sophisticated implementation, we would track which curricula were selected
-    // and update their weights accordingly
-    for (int i = 0; i < num_available_curricula; i++) {
-        available_curricula[i].weight += LEARNING_RATE * feedback * 0.1f;
+    // Only the curricula that produced the response get the credit; the
+    // shared router weights move by their average summary and overlap
+    float step = LEARNING_RATE * feedback * 0.1f;
+    size_t stride = registry.capacity;
+    for (int s = 0; s < num_selected; s++) {
+        int i = selected_ids[s];
+        registry.weight[i] += step;
+        for (int j = 0; j < ROUTE_PROMPT_FEATURES; j++) {
+            registry.feature_weight[j * stride + i] += step * route_features[j];
+        }
+        for (int j = 0; j < ROUTE_SUMMARY_FEATURES; j++) {
+            registry.summary_weight[j] += step * registry.summary[j * stride + i] / num_selected;
+        }
+        registry.overlap_weight += step * registry.overlap[i] / num_selected;
     }
 }
 
 // Function to save RL weights to file
 void save_rl_weights(const char* weights_file) {
-    FILE* file = fopen(weights_file, "w");
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", weights_file);
+    FILE* file = fopen(tmp, "w");
     if (!file) {
         perror("Error saving RL weights");
         return;
@@ -220,16 +263,55 @@ void save_rl_weights(const char* weights_file) {
     for (int i = 0; i < MAX_FEATURES; i++) {
         fprintf(file, "rl_weight_%d %f\n", i, rl_weights[i]);
     }
+    fprintf(file, "route_overlap %f\n", registry.overlap_weight);
+    for (int j = 0; j < ROUTE_SUMMARY_FEATURES; j++) {
+        fprintf(file, "route_summary_%d %f\n", j, registry.summary_weight[j]);
+    }
     
-    for (int i = 0; i < num_available_curricula; i++) {
-        fprintf(file, "curriculum_%s_weight %f\n", available_curricula[i].name, available_curricula[i].weight);
-        fprintf(file, "curriculum_%s_bias %f\n", available_curricula[i].name, available_curricula[i].bias);
+    size_t stride = registry.capacity;
+    for (int i = 0; i < registry.count; i++) {
+        const char *name = registry.summaries[i].name;
+        fprintf(file, "curriculum_%s_weight %f\n", name, registry.weight[i]);
+        fprintf(file, "curriculum_%s_bias %f\n", name, registry.bias[i]);
+        for (int j = 0; j < ROUTE_PROMPT_FEATURES; j++) {
+            fprintf(file, "curriculum_%s_feature_%d %f\n", name, j, registry.feature_weight[j * stride + i]);
+        }
+    }
+    for (int i = 0; i < num_retired_weights; i++) {
+        fputs(retired_weights[i], file);
     }
     
-    fclose(file);
+    if (fclose(file) != 0 || rename(tmp, weights_file) != 0) {
+        perror("Error saving RL weights");
+        remove(tmp);
+    }
 }
 
-// Function to load RL weights from file
+// Apply one curriculum_<name>_<field> line; 0 if no such curriculum is
+// registered
+int load_curriculum_weight(const char *key, float value) {
+    char name[REGISTRY_NAME_LEN];
+    const char *field = strstr(key + 11, "_feature_");
+    if (!field) {
+        field = strrchr(key + 11, '_');
+        if (!field) return 1;  // malformed, drop it
+    }
+    snprintf(name, sizeof(name), "%.*s", (int)(field - key - 11), key + 11);
+    int i = registry_find(&registry, name);
+    if (i < 0) return 0;
+    if (strcmp(field, "_weight") == 0) {
+        registry.weight[i] = value;
+    } else if (strcmp(field, "_bias") == 0) {
+        registry.bias[i] = value;
+    } else if (strncmp(field, "_feature_", 9) == 0) {
+        int j = atoi(field + 9);
+        if (j >= 0 && j < ROUTE_PROMPT_FEATURES) registry.feature_weight[(size_t)j * registry.capacity + i] = value;
+    }
+    return 1;
+}
+
+// Function to load RL weights from file. Curricula missing from the file
+// keep their defaults, so the weights grow with the registry.
 void load_rl_weights(const char* weights_file) {
     FILE* file = fopen(weights_file, "r");
     if (!file) {
@@ -239,9 +321,9 @@ void load_rl_weights(const char* weights_file) {
     
     char line[1024];
     while (fgets(line, sizeof(line), file)) {
-        char key[256];
+        char key[512];
         float value;
-        if (sscanf(line, "%s %f", key, &value) == 2) {
+        if (sscanf(line, "%511s %f", key, &value) == 2) {
             if (strcmp(key, "rl_bias") == 0) {
                 rl_bias = value;
             } else if (strncmp(key, "rl_weight_", 10) == 0) {
@@ -249,9 +331,19 @@ void load_rl_weights(const char* weights_file) {
                 if (index >= 0 && index < MAX_FEATURES) {
                     rl_weights[index] = value;
                 }
-            } else if (strncmp(key, "curriculum_", 11) == 0) {
-                // Parse curriculum weights and biases
-                // This is a simplified implementation
+            } else if (strcmp(key, "route_overlap") == 0) {
+                registry.overlap_weight = value;
+            } else if (strncmp(key, "route_summary_", 14) == 0) {
+                int index = atoi(key + 14);
+                if (index >= 0 && index < ROUTE_SUMMARY_FEATURES) {
+                    registry.summary_weight[index] = value;
+                }
+            } else if (strncmp(key, "curriculum_", 11) == 0 && !load_curriculum_weight(key, value)) {
+                char **grown = realloc(retired_weights, (num_retired_weights + 1) * sizeof(*grown));
+                if (grown) {
+                    retired_weights = grown;
+                    retired_weights[num_retired_weights++] = strdup(line);
+                }
             }
         }
     }
@@ -259,66 +351,247 @@ void load_rl_weights(const char* weights_file) {
     fclose(file);
 }
 
+// --- Resident chatbot ---
+
+// Connection to a chatbot_moe_v1 -serve process, which keeps the merged
+// vocabularies loaded across prompts instead of re-reading them per run
+struct ChatClient {
+    FILE *in, *out;
+};
+
+static int chat_client_attach(struct ChatClient *c, int fd) {
+    c->in = fdopen(fd, "r");
+    c->out = fdopen(dup(fd), "w");
+    if (!c->in || !c->out) {
+        if (c->in) fclose(c->in); else close(fd);
+        if (c->out) fclose(c->out);
+        c->in = c->out = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+static void chat_client_close(struct ChatClient *c) {
+    if (c->in) fclose(c->in);
+    if (c->out) fclose(c->out);
+    c->in = c->out = NULL;
+}
+
+// Connect to the server at socket_path, starting one in the background if
+// none is listening (its messages go to <socket>.log). It keeps running
+// after meta_rl exits, so later runs find the vocabularies already loaded;
+// meta_rl -stop-server ends it.
+int chat_client_open(struct ChatClient *c, const char *socket_path) {
+    c->in = c->out = NULL;
+    int fd = chat_connect(socket_path);
+    if (fd < 0) {
+        const char *bin = getenv("CHATBOT_BIN");
+        if (!bin) bin = CHATBOT_BIN;
+        char log_path[1100];
+        snprintf(log_path, sizeof(log_path), "%s.log", socket_path);
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) return 0;
+        if (pid == 0) {
+            setsid();
+            freopen("/dev/null", "r", stdin);
+            freopen("/dev/null", "w", stdout);
+            freopen(log_path, "a", stderr);
+            execl(bin, bin, "-serve", socket_path, (char*)NULL);
+            _exit(127);
+        }
+        for (int waited = 0; fd < 0 && waited < SERVER_START_TIMEOUT_MS; waited += 10) {
+            if (waitpid(pid, NULL, WNOHANG) == pid) break;  // exec failed or server exited
+            usleep(10000);
+            fd = chat_connect(socket_path);
+        }
+        if (fd < 0) {
+            fprintf(stderr, "Could not start %s -serve %s\n", bin, socket_path);
+            return 0;
+        }
+    }
+    return chat_client_attach(c, fd);
+}
+
+// Generate a response with the selected curricula. Returns the token count,
+// or -1 with the reason in response.
+int chat_generate(struct ChatClient *c, char selected_paths[MAX_CURRICULA][1024], int num_selected, const char *prompt, int desired_length, float temperature, char *response, size_t response_size) {
+    static struct ChatRequest req;
+    memset(&req, 0, sizeof(req));
+    req.type = CHAT_GEN;
+    req.length = desired_length;
+    req.temperature = temperature;
+    req.seed = (unsigned int)rand() + 1;
+    req.num_curricula = num_selected < CHAT_MAX_CURRICULA ? num_selected : CHAT_MAX_CURRICULA;
+    for (int i = 0; i < req.num_curricula; i++) snprintf(req.paths[i], CHAT_MAX_PATH, "%s", selected_paths[i]);
+    snprintf(req.prompt, CHAT_MAX_PROMPT, "%s", prompt);
+    if (!chat_request_write(c->out, &req)) {
+        snprintf(response, response_size, "connection to the chatbot server lost");
+        return -1;
+    }
+    int tokens = chat_response_read(c->in, response, response_size);
+    if (tokens == -2) snprintf(response, response_size, "connection to the chatbot server lost");
+    return tokens < 0 ? -1 : tokens;
+}
+
+int stop_server(const char *socket_path) {
+    int fd = chat_connect(socket_path);
+    if (fd < 0) {
+        printf("No chatbot server on %s\n", socket_path);
+        return 0;
+    }
+    struct ChatClient c;
+    if (!chat_client_attach(&c, fd)) return 1;
+    static struct ChatRequest req;
+    char reply[64];
+    req.type = CHAT_QUIT;
+    chat_request_write(c.out, &req);
+    chat_response_read(c.in, reply, sizeof(reply));
+    chat_client_close(&c);
+    printf("Stopped chatbot server on %s\n", socket_path);
+    return 0;
+}
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s \"<prompt>\" [length] [temperature]\n", argv[0]);
+    const char *socket_path = getenv("CHATBOT_SOCKET");
+    if (!socket_path) socket_path = CHAT_SOCKET_DEFAULT;
+    int episodes = 1;
+    const char *prompts_file = NULL;
+
+    int arg = 1;
+    while (arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0') {
+        if (strcmp(argv[arg], "-stop-server") == 0) {
+            return stop_server(socket_path);
+        } else if (strcmp(argv[arg], "-episodes") == 0 && arg + 1 < argc) {
+            episodes = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-prompts") == 0 && arg + 1 < argc) {
+            prompts_file = argv[++arg];
+        } else {
+            break;
+        }
+        arg++;
+    }
+    if (arg >= argc && !prompts_file) {
+        fprintf(stderr, "Usage: %s [-episodes N] [-prompts file] \"<prompt>\" [length] [temperature]\n", argv[0]);
+        fprintf(stderr, "       %s -stop-server\n", argv[0]);
         return 1;
     }
+    if (episodes < 1) episodes = 1;
     
     srand(time(NULL));
     
-    char *prompt = argv[1];
+    char *prompt = arg < argc ? argv[arg++] : "";
     int desired_length = 20;  // Default
     float temperature = 1.0f; // Default
     
-    if (argc >= 3) {
-        desired_length = atoi(argv[2]);
+    if (arg < argc) {
+        desired_length = atoi(argv[arg++]);
     }
-    if (argc >= 4) {
-        temperature = atof(argv[3]);
+    if (arg < argc) {
+        temperature = atof(argv[arg++]);
+    }
+
+    // With -prompts, episodes cycle through the file's lines
+    FILE *prompts = NULL;
+    char prompt_line[MAX_PROMPT_LENGTH];
+    if (prompts_file && !(prompts = fopen(prompts_file, "r"))) {
+        perror("Error opening prompts file");
+        return 1;
     }
     
     // Initialize
-    initialize_curricula();
-    load_rl_weights("meta_rl_weights.txt");
-    extract_prompt_features(prompt);
-    
-    // Select curricula
-    char selected_paths[MAX_CURRICULA][1024];
-    int num_selected = select_curricula(selected_paths, 3); // Select up to 3 curricula
-    
-    printf("Selected %d curricula:\n", num_selected);
-    for (int i = 0; i < num_selected; i++) {
-        printf("  %d. %s\n", i+1, selected_paths[i]);
+    int verbose = episodes == 1;
+    if (!initialize_curricula(verbose)) {
+        if (prompts) fclose(prompts);
+        return 1;
     }
+    load_rl_weights(WEIGHTS_FILE);
+
+    struct ChatClient chat;
+    int resident = chat_client_open(&chat, socket_path);
+    if (!resident) {
+        fprintf(stderr, "Falling back to one chatbot process per prompt\n");
+    }
+
+    static char response[CHAT_MAX_RESPONSE];
+    double start = now_seconds();
+    int completed = 0;
+    for (int episode = 0; episode < episodes; episode++) {
+        if (prompts) {
+            if (!fgets(prompt_line, sizeof(prompt_line), prompts)) {
+                rewind(prompts);
+                if (!fgets(prompt_line, sizeof(prompt_line), prompts)) break;
+            }
+            prompt_line[strcspn(prompt_line, "\n")] = 0;
+            prompt = prompt_line;
+        }
+        extract_prompt_features(prompt);
     
-    // Create curriculum bank
-    create_curriculum_bank("meta_curriculum_bank.txt", selected_paths, num_selected);
-    
-    // Run chatbot with selected curricula
-    char command[2048];
-    snprintf(command, sizeof(command), 
-             "./+x/chatbot_moe_v1.+x meta_curriculum_bank.txt \"%s\" %d %f", 
-             prompt, desired_length, temperature);
+        // Select curricula
+        char selected_paths[MAX_CURRICULA][1024];
+        int selected_ids[MAX_CURRICULA];
+        int num_selected = select_curricula(selected_paths, selected_ids, MAX_SELECTED);
     
-    printf("\nRunning chatbot with selected curricula...\n");
-    int result = system(command);
+        if (verbose) {
+            printf("Selected %d curricula:\n", num_selected);
+            for (int i = 0; i < num_selected; i++) {
+                printf("  %d. %s\n", i+1, selected_paths[i]);
+            }
+        }
     
-    if (result != 0) {
-        fprintf(stderr, "Error running chatbot\n");
-        return 1;
-    }
+        if (resident) {
+            if (verbose) printf("\nRunning chatbot with selected curricula...\n");
+            int tokens = chat_generate(&chat, selected_paths, num_selected, prompt, desired_length, temperature, response, sizeof(response));
+            if (tokens < 0) {
+                fprintf(stderr, "Error running chatbot: %s\n", response);
+                break;
+            }
+            if (verbose) printf("Prompt: %s\nResponse: %s\n", prompt, response);
+        } else {
+            // Create curriculum bank
+            create_curriculum_bank("meta_curriculum_bank.txt", selected_paths, num_selected);
+    
+            // Run chatbot with selected curricula
+            char command[2048];
+            snprintf(command, sizeof(command), 
+                     CHATBOT_BIN " meta_curriculum_bank.txt \"%s\" %d %f", 
+                     prompt, desired_length, temperature);
+    
+            printf("\nRunning chatbot with selected curricula...\n");
+            int result = system(command);
+    
+            if (result != 0) {
+                fprintf(stderr, "Error running chatbot\n");
+                break;
+            }
+        }
     
-    // Get user feedback
-    float feedback = get_user_feedback();
+        // Get user feedback
+        float feedback = get_user_feedback();
     
-    // Update RL weights
-    update_rl_weights(feedback);
+        // Update RL weights
+        update_rl_weights(feedback, selected_ids, num_selected);
+        completed++;
+        if (verbose) printf("RL weights updated based on feedback: %f\n", feedback);
+    }
+    double elapsed = now_seconds() - start;
+
+    if (prompts) fclose(prompts);
+    chat_client_close(&chat);
     
     // Save updated weights
-    save_rl_weights("meta_rl_weights.txt");
+    save_rl_weights(WEIGHTS_FILE);
+    registry_free(&registry);
     
-    printf("RL weights updated based on feedback: %f\n", feedback);
+    if (!verbose) {
+        printf("%d episodes in %.2f s (%.0f episodes/min)\n", completed, elapsed, elapsed > 0 ? completed * 60.0 / elapsed : 0.0);
+    }
     
-    return 0;
-}
\ No newline at end of file
+    return completed == episodes ? 0 : 1;
+}
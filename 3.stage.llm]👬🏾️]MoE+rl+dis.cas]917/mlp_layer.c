@@ -7,33 +7,7 @@
 
 #define EMBEDDING_DIM 7
 #define HIDDEN_DIM 16
-
-// MLP Layer
-typedef struct {
-    float weights[EMBEDDING_DIM][HIDDEN_DIM];
-    float biases[HIDDEN_DIM];
-} MlpLayer;
-
-// Function to initialize MLP layer with random weights
-void initialize_mlp(MlpLayer *mlp) {
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        for (int j = 0; j < HIDDEN_DIM; j++) {
-            mlp->weights[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
-        }
-    }
-    for (int i = 0; i < HIDDEN_DIM; i++) {
-        mlp->biases[i] = 0.0f;
-    }
-}
-
-// ReLU activation function
-void relu(float *x, int size) {
-    for (int i = 0; i < size; i++) {
-        if (x[i] < 0) {
-            x[i] = 0;
-        }
-    }
-}
+#include "layers.h"
 
 // Forward propagation through MLP
 void mlp_forward(float *input, MlpLayer *mlp, float *output) {
@@ -63,51 +37,6 @@ void mlp_backward(float *input, float *grad_output, MlpLayer *mlp, float learnin
     }
 }
 
-// Function to save MLP to file
-void save_mlp(const char *filename, MlpLayer *mlp) {
-    FILE *file = fopen(filename, "w");
-    if (!file) {
-        perror("Error opening MLP file for writing");
-        return;
-    }
-    
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        for (int j = 0; j < HIDDEN_DIM; j++) {
-            fprintf(file, "%f ", mlp->weights[i][j]);
-        }
-        fprintf(file, "\n");
-    }
-    
-    for (int i = 0; i < HIDDEN_DIM; i++) {
-        fprintf(file, "%f ", mlp->biases[i]);
-    }
-    fprintf(file, "\n");
-    
-    fclose(file);
-}
-
-// Function to load MLP from file
-void load_mlp(const char *filename, MlpLayer *mlp) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        // Initialize with random weights if file doesn't exist
-        initialize_mlp(mlp);
-        return;
-    }
-    
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        for (int j = 0; j < HIDDEN_DIM; j++) {
-            fscanf(file, "%f", &mlp->weights[i][j]);
-        }
-    }
-    
-    for (int i = 0; i < HIDDEN_DIM; i++) {
-        fscanf(file, "%f", &mlp->biases[i]);
-    }
-    
-    fclose(file);
-}
-
 int main(int argc, char *argv[]) {
     if (argc < 2) {
         fprintf(stderr, "Usage: %s <operation> [args...]\n", argv[0]);
@@ -129,7 +58,10 @@ int main(int argc, char *argv[]) {
         
         srand(time(NULL));
         initialize_mlp(&mlp);
-        save_mlp(argv[2], &mlp);
+        if (!save_mlp(argv[2], &mlp)) {
+            perror("Error opening MLP file for writing");
+            return 1;
+        }
         printf("MLP initialized and saved to %s\n", argv[2]);
         
     } else if (strcmp(operation, "forward") == 0) {
@@ -138,7 +70,8 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         
-        load_mlp(argv[2], &mlp);
+        // Initialize with random weights if the file doesn't exist
+        if (!load_mlp(argv[2], &mlp)) initialize_mlp(&mlp);
 
         // Path generation logic
         char *model_path = argv[2];
@@ -185,7 +118,8 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         
-        load_mlp(argv[2], &mlp);
+        // Initialize with random weights if the file doesn't exist
+        if (!load_mlp(argv[2], &mlp)) initialize_mlp(&mlp);
         
         // Load gradients from file
         FILE *grad_file = fopen(argv[3], "r");
@@ -0,0 +1,166 @@
+#ifndef MOE_ROUTER_H
+#define MOE_ROUTER_H
+
+// Sparse mixture of experts for the chatbot's candidate search.
+//
+// Every curriculum in the bank is an expert: the words its file lists
+// (VocabIndexProvenance in vocab_index.h). Each expert gets its own k-d tree
+// over its words' vectors, with the merged vocabulary ids as tree ids. A
+// linear gate over the current word's 7 features scores the experts,
+//
+//   gate_e(x) = c_e . x - |c_e|^2 / 2     c_e = mean vector of expert e
+//
+// i.e. a nearest-centroid router, and a token searches only the k experts
+// with the highest gate. The k trees feed one shared top-N query, so the
+// bound of the N-th best so far prunes across experts, and a word held by
+// several of them is offered once. Choosing every expert gives exactly the
+// top N of a single tree over the merged vocabulary; with k fixed, the cost
+// per token follows the size of k experts instead of all of them.
+//
+// Load balance is tracked per expert since the last moe_reset_stats():
+// tokens routed to it and the sum of its softmax gate probability. The
+// balance loss of Switch Transformer, E * sum_e f_e * P_e with f_e the
+// share of routed slots and P_e the mean gate probability, is 1 when the
+// load is even and reaches E when one expert takes everything.
+//
+// The per-expert arrays are sized by moe_build(), so a bank has as many
+// experts as it has curricula.
+
+#include <stdint.h>
+#include <math.h>
+#include "topk_index.h"
+
+typedef struct {
+    int n;                      // experts
+    int k;                      // experts per token
+    float (*gate_w)[TOPK_DIM];  // n of each
+    float *gate_b;
+    TopkIndex *trees;
+    // Load since the last reset
+    uint64_t tokens;
+    uint32_t *routed;
+    float *importance;
+    // Scratch for moe_route() and moe_query()
+    float *gate, *p;
+    int *chosen;
+} MoeRouter;
+
+static inline void moe_free(MoeRouter *m) {
+    for (int e = 0; m->trees && e < m->n; e++) topk_free(&m->trees[e]);
+    free(m->gate_w); free(m->gate_b); free(m->trees);
+    free(m->routed); free(m->importance);
+    free(m->gate); free(m->p); free(m->chosen);
+    memset(m, 0, sizeof(*m));
+}
+
+static inline void moe_reset_stats(MoeRouter *m) {
+    m->tokens = 0;
+    // A router that was never built has no arrays
+    if (!m->routed) return;
+    memset(m->routed, 0, (size_t)m->n * sizeof(*m->routed));
+    memset(m->importance, 0, (size_t)m->n * sizeof(*m->importance));
+}
+
+// Expert e holds the words members[starts[e] .. starts[e + 1]), ids into
+// vecs (TOPK_DIM floats per word). dtype other than QUANT_F32 quantizes the
+// trees (topk_quantize). Returns 0 on allocation failure.
+static inline int moe_build(MoeRouter *m, const float *vecs, const int *members, const int *starts, int n, int k, int dtype) {
+    memset(m, 0, sizeof(*m));
+    m->n = n;
+    m->k = k < 1 ? 1 : k > n ? n : k;
+    size_t e_n = n > 0 ? (size_t)n : 1;
+    m->gate_w = malloc(e_n * sizeof(*m->gate_w));
+    m->gate_b = malloc(e_n * sizeof(float));
+    m->trees = calloc(e_n, sizeof(TopkIndex));
+    m->routed = calloc(e_n, sizeof(uint32_t));
+    m->importance = calloc(e_n, sizeof(float));
+    m->gate = malloc(e_n * sizeof(float));
+    m->p = malloc(e_n * sizeof(float));
+    m->chosen = malloc(e_n * sizeof(int));
+    if (!m->gate_w || !m->gate_b || !m->trees || !m->routed || !m->importance || !m->gate || !m->p || !m->chosen) {
+        moe_free(m);
+        return 0;
+    }
+    int most = 1;
+    for (int e = 0; e < n; e++) if (starts[e + 1] - starts[e] > most) most = starts[e + 1] - starts[e];
+    float *rows = malloc((size_t)most * TOPK_DIM * sizeof(float));
+    if (!rows) { moe_free(m); return 0; }
+    int ok = 1;
+    for (int e = 0; e < n && ok; e++) {
+        const int *ids = members + starts[e];
+        int count = starts[e + 1] - starts[e];
+        double c[TOPK_DIM] = { 0 };
+        for (int i = 0; i < count; i++) {
+            memcpy(rows + (size_t)i * TOPK_DIM, vecs + (size_t)ids[i] * TOPK_DIM, TOPK_DIM * sizeof(float));
+            for (int j = 0; j < TOPK_DIM; j++) c[j] += rows[(size_t)i * TOPK_DIM + j];
+        }
+        float sq = 0.0f;
+        for (int j = 0; j < TOPK_DIM; j++) {
+            m->gate_w[e][j] = count ? (float)(c[j] / count) : 0.0f;
+            sq += m->gate_w[e][j] * m->gate_w[e][j];
+        }
+        // An expert with no words never wins the gate
+        m->gate_b[e] = count ? -0.5f * sq : -INFINITY;
+        ok = topk_build(&m->trees[e], rows, count);
+        // Tree ids become the caller's ids, so ties across experts break
+        // the way they do in one tree over every word
+        for (int i = 0; ok && i < count; i++) m->trees[e].ids[i] = ids[m->trees[e].ids[i]];
+        if (ok && dtype > 0) ok = topk_quantize(&m->trees[e], dtype);
+    }
+    free(rows);
+    if (!ok) moe_free(m);
+    return ok;
+}
+
+// Pick the k experts with the highest gate for x (ties to the lower
+// expert) into experts[] (room for k), best first, and record the load.
+// Returns k.
+static inline int moe_route(MoeRouter *m, const float *x, int *experts) {
+    float *gate = m->gate, *p = m->p, max = -INFINITY, sum = 0.0f;
+    for (int e = 0; e < m->n; e++) {
+        gate[e] = m->gate_b[e] + topk_dot(m->gate_w[e], x);
+        if (gate[e] > max) max = gate[e];
+    }
+    for (int e = 0; e < m->n; e++) { p[e] = gate[e] == -INFINITY ? 0.0f : expf(gate[e] - max); sum += p[e]; }
+    int chosen = 0;
+    for (int e = 0; e < m->n; e++) {
+        m->importance[e] += sum > 0.0f ? p[e] / sum : 0.0f;
+        // Insertion into the running top k
+        if (chosen == m->k && gate[e] <= gate[experts[chosen - 1]]) continue;
+        int i = chosen < m->k ? chosen++ : m->k - 1;
+        while (i > 0 && gate[e] > gate[experts[i - 1]]) { experts[i] = experts[i - 1]; i--; }
+        experts[i] = e;
+    }
+    for (int i = 0; i < chosen; i++) m->routed[experts[i]]++;
+    m->tokens++;
+    return chosen;
+}
+
+// The best top_n words by dot product with q among the experts routed for
+// q, best first, as topk_query(). experts (room for k) may be NULL.
+static inline int moe_query(MoeRouter *m, const float *q, int top_n, int max_leaves, int *ids, float *scores, int *experts) {
+    if (!experts) experts = m->chosen;
+    int k = moe_route(m, q, experts);
+    if (top_n <= 0) return 0;
+    TopkQuery r = { top_n, 0, ids, scores, max_leaves > 0 ? max_leaves : -1, 1 };
+    for (int i = 0; i < k; i++) {
+        const TopkIndex *t = &m->trees[experts[i]];
+        if (t->n) topk_search(t, 0, q, topk_bound(&t->nodes[0], q), &r);
+    }
+    return r.count;
+}
+
+// Balance loss E * sum_e f_e * P_e (1 when even) and the busiest expert's
+// share of routed slots over the even share
+static inline void moe_balance(const MoeRouter *m, float *loss, float *max_over_mean) {
+    double l = 0.0, top = 0.0, slots = (double)m->tokens * m->k;
+    for (int e = 0; e < m->n && m->tokens; e++) {
+        double f = m->routed[e] / slots, p = m->importance[e] / (double)m->tokens;
+        l += f * p;
+        if (f > top) top = f;
+    }
+    *loss = m->tokens ? (float)(m->n * l) : 0.0f;
+    *max_over_mean = m->tokens ? (float)(top * m->n) : 0.0f;
+}
+
+#endif
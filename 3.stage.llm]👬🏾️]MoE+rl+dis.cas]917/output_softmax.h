@@ -0,0 +1,296 @@
+#ifndef OUTPUT_SOFTMAX_H
+#define OUTPUT_SOFTMAX_H
+
+// Cheaper output losses for large vocabularies, selected in config.txt with
+// softmax=full|sampled|hierarchical and used by train_engine.h. forward_prop.c
+// uses the tree to decode a hierarchically trained output layer.
+//
+// sampled: each token scores its target plus softmax_samples negatives drawn
+//   from the unigram^0.75 distribution. The logits are shifted by
+//   -log(k * Q(w)) (sampled softmax), so the loss estimates the full cross
+//   entropy. Only those output columns get gradients and Adam updates.
+// hierarchical: a Huffman tree built from the word counts. A word's
+//   probability is the product of the sigmoid decisions on its root-to-leaf
+//   path. Internal node n uses output layer column n (weights[.][n] and
+//   biases[n]), so the model files keep their shape. The tree is saved to
+//   softmax_tree.txt next to the models for forward_prop.
+//
+// Word counts come from the <vocab>.counts.txt file that vocab_model writes.
+// Without it, each row counts the rows that share its word.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+enum { SOFTMAX_FULL = 0, SOFTMAX_SAMPLED = 1, SOFTMAX_HIERARCHICAL = 2 };
+
+#define SOFTMAX_TREE_FILE "softmax_tree.txt"
+#define SOFTMAX_MAX_CODE 64
+#define SOFTMAX_SAMPLE_SEED 24680
+
+static inline int softmax_mode_parse(const char *s) {
+    if (strcmp(s, "full") == 0) return SOFTMAX_FULL;
+    if (strcmp(s, "sampled") == 0) return SOFTMAX_SAMPLED;
+    if (strcmp(s, "hierarchical") == 0) return SOFTMAX_HIERARCHICAL;
+    return -1;
+}
+
+static inline const char *softmax_mode_name(int mode) {
+    return mode == SOFTMAX_SAMPLED ? "sampled" : mode == SOFTMAX_HIERARCHICAL ? "hierarchical" : "full";
+}
+
+// --- Word counts ---
+
+typedef struct { const char *word; int index; double count; } SoftmaxWordCount;
+
+static inline int softmax_count_cmp(const void *a, const void *b) {
+    const SoftmaxWordCount *x = a, *y = b;
+    int c = strcmp(x->word, y->word);
+    return c ? c : x->index - y->index;
+}
+
+// Count for each of the vs rows. Rows whose word is missing from the counts
+// file, or every row when there is no counts file, get the number of rows
+// that share their word.
+static inline double *softmax_load_counts(const char *vocab_path, const char *const *words, int vs) {
+    double *counts = malloc(vs * sizeof(double));
+    SoftmaxWordCount *rows = malloc(vs * sizeof(SoftmaxWordCount));
+    if (!counts || !rows) { free(counts); free(rows); return NULL; }
+    for (int i = 0; i < vs; i++) { rows[i].word = words[i]; rows[i].index = i; rows[i].count = 0; }
+    qsort(rows, vs, sizeof(SoftmaxWordCount), softmax_count_cmp);
+    for (int i = 0; i < vs;) {
+        int j = i;
+        while (j < vs && strcmp(rows[j].word, rows[i].word) == 0) j++;
+        for (int k = i; k < j; k++) counts[rows[k].index] = j - i;
+        i = j;
+    }
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s", vocab_path);
+    char *dot = strrchr(path, '.');
+    if (dot && strcmp(dot, ".txt") == 0) *dot = '\0';
+    strncat(path, ".counts.txt", sizeof(path) - strlen(path) - 1);
+    FILE *f = fopen(path, "r");
+    if (f) {
+        char line[1024], word[100];
+        int number, found = 0;
+        double c;
+        fgets(line, sizeof(line), f);  // Skip header
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "%d %99s %lf", &number, word, &c) != 3) continue;
+            SoftmaxWordCount key = { word, -1, 0 };
+            // Land on the first row with this word, then walk the group
+            int lo = 0, hi = vs;
+            while (lo < hi) { int mid = (lo + hi) / 2; if (softmax_count_cmp(&rows[mid], &key) < 0) lo = mid + 1; else hi = mid; }
+            for (; lo < vs && strcmp(rows[lo].word, word) == 0; lo++) { counts[rows[lo].index] = c; found++; }
+        }
+        fclose(f);
+        fprintf(stderr, "Word counts from %s (%d of %d rows)\n", path, found, vs);
+    }
+    free(rows);
+    for (int i = 0; i < vs; i++) if (!(counts[i] > 0)) counts[i] = 1;
+    return counts;
+}
+
+// --- Negative sampler ---
+// Vose alias table over count^0.75; two LCG draws per sample.
+
+typedef struct {
+    int n;
+    float *prob;    // acceptance threshold per bucket
+    int *alias;
+    float *q;       // sampling probability of each row
+} SoftmaxSampler;
+
+static inline int softmax_sampler_init(SoftmaxSampler *s, const double *counts, int n) {
+    s->n = n;
+    s->prob = malloc(n * sizeof(float));
+    s->alias = malloc(n * sizeof(int));
+    s->q = malloc(n * sizeof(float));
+    double *scaled = malloc(n * sizeof(double));
+    int *small = malloc(n * sizeof(int)), *large = malloc(n * sizeof(int));
+    if (!s->prob || !s->alias || !s->q || !scaled || !small || !large) { free(scaled); free(small); free(large); return 0; }
+
+    double total = 0;
+    for (int i = 0; i < n; i++) total += pow(counts[i], 0.75);
+    int ns = 0, nl = 0;
+    for (int i = 0; i < n; i++) {
+        double p = pow(counts[i], 0.75) / total;
+        s->q[i] = (float)p;
+        scaled[i] = p * n;
+        if (scaled[i] < 1.0) small[ns++] = i; else large[nl++] = i;
+    }
+    while (ns > 0 && nl > 0) {
+        int a = small[--ns], b = large[--nl];
+        s->prob[a] = (float)scaled[a];
+        s->alias[a] = b;
+        scaled[b] -= 1.0 - scaled[a];
+        if (scaled[b] < 1.0) small[ns++] = b; else large[nl++] = b;
+    }
+    while (nl > 0) { int b = large[--nl]; s->prob[b] = 1.0f; s->alias[b] = b; }
+    while (ns > 0) { int a = small[--ns]; s->prob[a] = 1.0f; s->alias[a] = a; }
+    free(scaled); free(small); free(large);
+    return 1;
+}
+
+static inline void softmax_sampler_free(SoftmaxSampler *s) { free(s->prob); free(s->alias); free(s->q); memset(s, 0, sizeof(*s)); }
+
+static inline int softmax_sample(const SoftmaxSampler *s, unsigned int *seed) {
+    *seed = (*seed * 1103515245 + 12345) & 0x7fffffff;
+    int bucket = (int)((double)*seed / 0x80000000u * s->n);
+    *seed = (*seed * 1103515245 + 12345) & 0x7fffffff;
+    float coin = (float)*seed / (float)0x7fffffff;
+    return coin < s->prob[bucket] ? bucket : s->alias[bucket];
+}
+
+// --- Huffman tree ---
+// Word w's path is len[w] internal nodes from the root down; at node
+// node[off[w] + d] it goes to the side bit[off[w] + d]. P(bit 1) = sigmoid(s).
+
+typedef struct {
+    int vs;
+    int *off;               // vs + 1 offsets into node/bit
+    int *node;
+    unsigned char *bit;
+} SoftmaxTree;
+
+static inline void softmax_tree_free(SoftmaxTree *t) { free(t->off); free(t->node); free(t->bit); memset(t, 0, sizeof(*t)); }
+
+static const double *softmax_sort_counts;
+static inline int softmax_by_count_desc(const void *a, const void *b) {
+    double x = softmax_sort_counts[*(const int*)a], y = softmax_sort_counts[*(const int*)b];
+    if (x != y) return x > y ? -1 : 1;
+    return *(const int*)a - *(const int*)b;
+}
+
+// Builds the tree the way word2vec does: leaves sorted by count, then two
+// cursors merge the two lightest subtrees vs - 1 times
+static inline int softmax_tree_build(SoftmaxTree *t, const double *counts, int vs) {
+    memset(t, 0, sizeof(*t));
+    t->vs = vs;
+    int n = vs, total = 0;
+    int *order = malloc(n * sizeof(int)), *parent = malloc(2 * n * sizeof(int));
+    double *weight = malloc(2 * n * sizeof(double));
+    unsigned char *side = calloc(2 * n, 1);
+    int *depth = malloc(n * sizeof(int));
+    t->off = malloc((vs + 1) * sizeof(int));
+    if (!order || !parent || !weight || !side || !depth || !t->off) goto fail;
+
+    for (int i = 0; i < n; i++) order[i] = i;
+    softmax_sort_counts = counts;
+    qsort(order, n, sizeof(int), softmax_by_count_desc);
+    for (int i = 0; i < n; i++) weight[i] = counts[order[i]];
+    for (int i = n; i < 2 * n; i++) weight[i] = 1e300;
+    int pos1 = n - 1, pos2 = n;
+    for (int a = 0; a < n - 1; a++) {
+        int m[2];
+        for (int k = 0; k < 2; k++) {
+            if (pos1 >= 0 && weight[pos1] < weight[pos2]) m[k] = pos1--;
+            else m[k] = pos2++;
+        }
+        weight[n + a] = weight[m[0]] + weight[m[1]];
+        parent[m[0]] = n + a; parent[m[1]] = n + a;
+        side[m[1]] = 1;
+    }
+
+    // Root is 2n - 2, internal node n + a is output column a
+    for (int i = 0; i < n; i++) {
+        int d = 0;
+        for (int p = i; p != 2 * n - 2 && n > 1; p = parent[p]) d++;
+        if (d > SOFTMAX_MAX_CODE) { fprintf(stderr, "Huffman code longer than %d for word %d\n", SOFTMAX_MAX_CODE, order[i]); goto fail; }
+        depth[order[i]] = d;
+    }
+    t->off[0] = 0;
+    for (int w = 0; w < vs; w++) t->off[w + 1] = t->off[w] + depth[w];
+    total = t->off[vs];
+    t->node = malloc((total ? total : 1) * sizeof(int));
+    t->bit = malloc(total ? total : 1);
+    if (!t->node || !t->bit) goto fail;
+    for (int i = 0; i < n; i++) {
+        int w = order[i], d = depth[w];
+        for (int p = i; d > 0; p = parent[p]) {
+            d--;
+            t->node[t->off[w] + d] = parent[p] - n;
+            t->bit[t->off[w] + d] = side[p];
+        }
+    }
+    free(order); free(parent); free(weight); free(side); free(depth);
+    return 1;
+fail:
+    free(order); free(parent); free(weight); free(side); free(depth);
+    softmax_tree_free(t);
+    return 0;
+}
+
+// One line per word: path length, then node/bit pairs
+static inline int softmax_tree_save(const SoftmaxTree *t, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return 0;
+    fprintf(f, "softmax_tree %d\n", t->vs);
+    for (int w = 0; w < t->vs; w++) {
+        fprintf(f, "%d", t->off[w + 1] - t->off[w]);
+        for (int d = t->off[w]; d < t->off[w + 1]; d++) fprintf(f, " %d %d", t->node[d], t->bit[d]);
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return 1;
+}
+
+// Returns 0 if the file is missing or was built for another vocabulary size
+static inline int softmax_tree_load(SoftmaxTree *t, const char *path, int vs) {
+    memset(t, 0, sizeof(*t));
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int n;
+    if (fscanf(f, "softmax_tree %d", &n) != 1 || n != vs) {
+        fprintf(stderr, "%s does not match the vocabulary (%d words); ignoring it\n", path, vs);
+        fclose(f);
+        return 0;
+    }
+    t->vs = vs;
+    t->off = malloc((vs + 1) * sizeof(int));
+    int cap = vs * 16 + 16;
+    t->node = malloc(cap * sizeof(int));
+    t->bit = malloc(cap);
+    if (!t->off || !t->node || !t->bit) { fclose(f); softmax_tree_free(t); return 0; }
+    t->off[0] = 0;
+    for (int w = 0; w < vs; w++) {
+        int len, node, bit;
+        if (fscanf(f, "%d", &len) != 1 || len < 0 || len > SOFTMAX_MAX_CODE) { fclose(f); softmax_tree_free(t); return 0; }
+        if (t->off[w] + len > cap) {
+            cap = cap * 2 + len;
+            int *nn = realloc(t->node, cap * sizeof(int));
+            unsigned char *nb = nn ? realloc(t->bit, cap) : NULL;
+            if (nn) t->node = nn;
+            if (!nb) { fclose(f); softmax_tree_free(t); return 0; }
+            t->bit = nb;
+        }
+        for (int d = 0; d < len; d++) {
+            if (fscanf(f, "%d %d", &node, &bit) != 2 || node < 0 || node >= vs - 1) { fclose(f); softmax_tree_free(t); return 0; }
+            t->node[t->off[w] + d] = node;
+            t->bit[t->off[w] + d] = (unsigned char)bit;
+        }
+        t->off[w + 1] = t->off[w] + len;
+    }
+    fclose(f);
+    return 1;
+}
+
+// log(sigmoid(x)) without overflow
+static inline float softmax_log_sigmoid(float x) { return x >= 0 ? -log1pf(expf(-x)) : x - log1pf(expf(x)); }
+static inline float softmax_sigmoid(float x) { return x >= 0 ? 1.0f / (1.0f + expf(-x)) : expf(x) / (1.0f + expf(x)); }
+
+// Node scores (one per output column) to log-probabilities of every word
+static inline void softmax_tree_log_probs(const SoftmaxTree *t, const float *scores, float *logp) {
+    for (int w = 0; w < t->vs; w++) {
+        float lp = 0;
+        for (int d = t->off[w]; d < t->off[w + 1]; d++) {
+            float s = scores[t->node[d]];
+            lp += softmax_log_sigmoid(t->bit[d] ? s : -s);
+        }
+        logp[w] = lp;
+    }
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef QUANT_H
+#define QUANT_H
+
+// Reduced-precision storage for the inference-only tables: the 7-float word
+// vectors and the HIDDEN_DIM x vs output layer.
+//
+//   int8   symmetric, one float scale per word: scale = max|x| / 127 and
+//          code = round(x / scale), so the largest value of a word is kept
+//          and every other one is within scale / 2. For the word vectors a
+//          word is a row; for the output layer it is a column (the HIDDEN_DIM
+//          weights that produce its logit).
+//   fp16   IEEE half precision, round to nearest even, no scales. Finite
+//          values past the largest half, 65504, saturate to it instead of
+//          becoming Inf; export counts them and warns.
+//
+// Values are always dequantized to float before they are used, so the
+// arithmetic downstream is the float code path on slightly different
+// inputs. The conversions are portable C (no F16C), so everything still
+// builds with plain gcc. The dtype numbers match the tensor file dtypes
+// (tensor_file.h) that store these tables on disk.
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+enum { QUANT_F32 = 0, QUANT_I8 = 1, QUANT_F16 = 2 };
+
+#define QUANT_F16_MAX 65504.0f
+
+static inline const char *quant_name(int dtype) {
+    return dtype == QUANT_I8 ? "int8" : dtype == QUANT_F16 ? "fp16" : "f32";
+}
+
+// "int8", "fp16" or "f32"; -1 for anything else
+static inline int quant_parse(const char *s) {
+    if (!s) return -1;
+    if (strcmp(s, "int8") == 0) return QUANT_I8;
+    if (strcmp(s, "fp16") == 0) return QUANT_F16;
+    if (strcmp(s, "f32") == 0) return QUANT_F32;
+    return -1;
+}
+
+// Bytes per stored value
+static inline int quant_size(int dtype) { return dtype == QUANT_I8 ? 1 : dtype == QUANT_F16 ? 2 : 4; }
+
+static inline uint16_t quant_f16_from_float(float f) {
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    uint32_t sign = (x >> 16) & 0x8000, ax = x & 0x7fffffff;
+    if (ax >= 0x7f800000) return sign | 0x7c00 | (ax > 0x7f800000 ? 0x200 : 0);  // Inf, NaN
+    if (ax >= 0x477ff000) return sign | 0x7bff;  // would round past 65504: saturate
+    if (ax < 0x38800000) {
+        // Subnormal half: a multiple of 2^-24, scaling by 2^24 is exact
+        float a;
+        memcpy(&a, &ax, 4);
+        return sign | (uint16_t)lrintf(a * 16777216.0f);
+    }
+    // Rebias the exponent from 127 to 15 and round the dropped 13 bits to
+    // nearest even; a carry into the exponent is the correct result
+    return sign | (uint16_t)((ax + 0xc8000fffu + ((ax >> 13) & 1)) >> 13);
+}
+
+// How many of n finite values fp16 has to saturate
+static inline long quant_f16_saturated(const float *x, size_t n) {
+    long count = 0;
+    for (size_t i = 0; i < n; i++) count += fabsf(x[i]) > QUANT_F16_MAX && isfinite(x[i]);
+    return count;
+}
+
+static inline float quant_f16_to_float(uint16_t h) {
+    uint32_t em = h & 0x7fff, u = em << 13;
+    float f;
+    memcpy(&f, &u, 4);
+    f *= 0x1p112f;  // rebias; exact, and turns half subnormals into normals
+    memcpy(&u, &f, 4);
+    if (em >= 0x7c00) u = (em << 13) | 0x7f800000;
+    u |= (uint32_t)(h & 0x8000) << 16;
+    memcpy(&f, &u, 4);
+    return f;
+}
+
+static inline int8_t quant_i8_code(float x, float scale) {
+    if (!(scale > 0.0f)) return 0;
+    long c = lrintf(x / scale);
+    return (int8_t)(c > 127 ? 127 : c < -127 ? -127 : c);
+}
+
+// Store n floats as dtype into codes; returns the int8 scale (1 otherwise)
+static inline float quant_row(int dtype, const float *x, int n, void *codes) {
+    if (dtype == QUANT_F16) {
+        for (int i = 0; i < n; i++) ((uint16_t*)codes)[i] = quant_f16_from_float(x[i]);
+        return 1.0f;
+    }
+    if (dtype == QUANT_F32) { memcpy(codes, x, n * sizeof(float)); return 1.0f; }
+    float m = 0.0f;
+    for (int i = 0; i < n; i++) { float a = fabsf(x[i]); if (a > m) m = a; }
+    float scale = m / 127.0f;
+    for (int i = 0; i < n; i++) ((int8_t*)codes)[i] = quant_i8_code(x[i], scale);
+    return scale;
+}
+
+// The floats a quant_row() call stored
+static inline void quant_dequant_row(int dtype, const void *codes, float scale, int n, float *out) {
+    if (dtype == QUANT_I8) for (int i = 0; i < n; i++) out[i] = scale * (float)((const int8_t*)codes)[i];
+    else if (dtype == QUANT_F16) for (int i = 0; i < n; i++) out[i] = quant_f16_to_float(((const uint16_t*)codes)[i]);
+    else memcpy(out, codes, n * sizeof(float));
+}
+
+// Output layer: rows[l] holds vs weights; codes[l] gets vs values and, for
+// int8, scales[j] is column j's scale
+static inline void quant_columns(int dtype, const float *const *rows, int nrows, int vs, void *const *codes, float *scales) {
+    for (int l = 0; l < nrows; l++) {
+        if (dtype == QUANT_F16) for (int j = 0; j < vs; j++) ((uint16_t*)codes[l])[j] = quant_f16_from_float(rows[l][j]);
+        else if (dtype == QUANT_F32) memcpy(codes[l], rows[l], vs * sizeof(float));
+    }
+    if (dtype != QUANT_I8) return;
+    for (int j = 0; j < vs; j++) scales[j] = 0.0f;
+    for (int l = 0; l < nrows; l++)
+        for (int j = 0; j < vs; j++) { float a = fabsf(rows[l][j]); if (a > scales[j]) scales[j] = a; }
+    for (int j = 0; j < vs; j++) scales[j] /= 127.0f;
+    for (int l = 0; l < nrows; l++)
+        for (int j = 0; j < vs; j++) ((int8_t*)codes[l])[j] = quant_i8_code(rows[l][j], scales[j]);
+}
+
+#endif
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "tensor_file.h"
+#include "kernels.h"
+#include "topk_index.h"
+
+#define MAX_LINE_LENGTH 1024
+#define EMBEDDING_DIM 7
+#define HIDDEN_DIM 16
+#define REPORT_TOKENS 4000
+#define REPORT_BATCH 64
+#define REPORT_TOP_N 10
+
+// Inference-only int8 / fp16 copies of the word vectors and output layer
+// (formats in quant.h and tensor_file.h).
+//
+//   quantize export <int8|fp16> <vocab.txt> <output_layer> <out.bin>
+//   quantize report <vocab.txt> <output_layer> [tokens]
+//
+// export writes a "quantized" tensor file that forward_prop takes in place
+// of the output model. report quantizes both tables in memory and compares
+// each storage with float32: memory, tokens/sec of the chatbot's candidate
+// search and of the output projection, and how often the top-1 word agrees.
+
+typedef struct {
+    int vs;
+    float *vecs;                   // vs x EMBEDDING_DIM
+    float *weights[HIDDEN_DIM];    // HIDDEN_DIM rows of vs
+    float *biases;
+} FloatModel;
+
+// Word vectors in vocab file order: "number word embedding pe weight bias1..4"
+static float *read_vocab_vectors(const char *fn, int *vs) {
+    FILE *f = fopen(fn, "r");
+    if (!f) { fprintf(stderr, "Failed to open vocab file: %s\n", fn); return NULL; }
+    int cap = 1024, n = 0;
+    float *v = malloc((size_t)cap * EMBEDDING_DIM * sizeof(float));
+    char line[MAX_LINE_LENGTH], word[100];
+    if (!fgets(line, sizeof(line), f)) line[0] = 0;  // header
+    while (v && fgets(line, sizeof(line), f)) {
+        if (n == cap) { cap *= 2; float *tmp = realloc(v, (size_t)cap * EMBEDDING_DIM * sizeof(float)); if (!tmp) { free(v); v = NULL; break; } v = tmp; }
+        float *x = v + (size_t)n * EMBEDDING_DIM;
+        int number;
+        if (sscanf(line, "%d %99s %f %f %f %f %f %f %f", &number, word, &x[0], &x[1], &x[2], &x[3], &x[4], &x[5], &x[6]) == 9) n++;
+    }
+    fclose(f);
+    *vs = n;
+    return v;
+}
+
+static int load_model(FloatModel *m, const char *vocab, const char *output) {
+    memset(m, 0, sizeof(*m));
+    m->vecs = read_vocab_vectors(vocab, &m->vs);
+    if (!m->vecs || m->vs == 0) { fprintf(stderr, "No words in %s\n", vocab); return 0; }
+    int vs = m->vs;
+    float *w = malloc((size_t)HIDDEN_DIM * vs * sizeof(float));
+    m->biases = malloc(vs * sizeof(float));
+    if (!w || !m->biases) { fprintf(stderr, "Failed to allocate a %dx%d output layer\n", HIDDEN_DIM, vs); return 0; }
+    for (int i = 0; i < HIDDEN_DIM; i++) m->weights[i] = w + (size_t)i * vs;
+    if (tensor_file_is_binary(output)) {
+        TensorFile tf;
+        float *rows[HIDDEN_DIM], *b;
+        if (!tensor_map_output(output, &tf, 0, rows, HIDDEN_DIM, vs, &b)) return 0;
+        for (int i = 0; i < HIDDEN_DIM; i++) memcpy(m->weights[i], rows[i], vs * sizeof(float));
+        memcpy(m->biases, b, vs * sizeof(float));
+        tensor_file_close(&tf);
+        return 1;
+    }
+    FILE *f = fopen(output, "r");
+    if (!f) { fprintf(stderr, "Failed to open output layer: %s\n", output); return 0; }
+    int ok = 1;
+    for (size_t i = 0; ok && i < (size_t)HIDDEN_DIM * vs; i++) ok = fscanf(f, "%f", &w[i]) == 1;
+    for (int i = 0; ok && i < vs; i++) ok = fscanf(f, "%f", &m->biases[i]) == 1;
+    fclose(f);
+    if (!ok) fprintf(stderr, "%s does not hold a %dx%d output layer\n", output, HIDDEN_DIM, vs);
+    return ok;
+}
+
+static void free_model(FloatModel *m) {
+    free(m->vecs);
+    free(m->weights[0]);
+    free(m->biases);
+}
+
+// Both tables at one precision, laid out as in the exported file
+typedef struct {
+    int dtype;
+    void *weights;       // HIDDEN_DIM x vs
+    const void *rows[HIDDEN_DIM];
+    float *scales;       // vs, int8 only
+    void *vecs;          // vs x EMBEDDING_DIM
+    float *vec_scales;   // vs, int8 only
+} QuantModel;
+
+static int quantize_model(QuantModel *q, const FloatModel *m, int dtype) {
+    int vs = m->vs, size = quant_size(dtype);
+    memset(q, 0, sizeof(*q));
+    q->dtype = dtype;
+    q->weights = malloc((size_t)HIDDEN_DIM * vs * size);
+    q->vecs = malloc((size_t)vs * EMBEDDING_DIM * size);
+    if (dtype == QUANT_I8) { q->scales = malloc(vs * sizeof(float)); q->vec_scales = malloc(vs * sizeof(float)); }
+    if (!q->weights || !q->vecs || (dtype == QUANT_I8 && (!q->scales || !q->vec_scales))) { fprintf(stderr, "Failed to allocate quantized tables\n"); return 0; }
+    if (dtype == QUANT_F16) {
+        long clipped = quant_f16_saturated(m->vecs, (size_t)vs * EMBEDDING_DIM);
+        for (int i = 0; i < HIDDEN_DIM; i++) clipped += quant_f16_saturated(m->weights[i], vs);
+        if (clipped) fprintf(stderr, "Warning: %ld values are beyond the fp16 range and saturate at +-65504; int8 keeps their scale\n", clipped);
+    }
+    void *codes[HIDDEN_DIM];
+    for (int i = 0; i < HIDDEN_DIM; i++) q->rows[i] = codes[i] = (char*)q->weights + (size_t)i * vs * size;
+    quant_columns(dtype, (const float *const *)m->weights, HIDDEN_DIM, vs, codes, q->scales);
+    for (int j = 0; j < vs; j++) {
+        float s = quant_row(dtype, m->vecs + (size_t)j * EMBEDDING_DIM, EMBEDDING_DIM, (char*)q->vecs + (size_t)j * EMBEDDING_DIM * size);
+        if (q->vec_scales) q->vec_scales[j] = s;
+    }
+    return 1;
+}
+
+static void free_quant_model(QuantModel *q) {
+    free(q->weights); free(q->scales); free(q->vecs); free(q->vec_scales);
+}
+
+static int export_model(const char *type, const char *vocab, const char *output, const char *out) {
+    int dtype = quant_parse(type);
+    if (dtype <= 0) { fprintf(stderr, "Unknown storage: %s (expected int8 or fp16)\n", type); return 1; }
+    FloatModel m;
+    QuantModel q;
+    if (!load_model(&m, vocab, output) || !quantize_model(&q, &m, dtype)) return 1;
+    int ok = tensor_save_quantized(out, dtype, q.weights, q.scales, m.biases, HIDDEN_DIM, m.vs, q.vecs, q.vec_scales, EMBEDDING_DIM);
+    if (ok) {
+        size_t f32 = (size_t)m.vs * (HIDDEN_DIM + 1 + EMBEDDING_DIM) * sizeof(float);
+        size_t bytes = (size_t)m.vs * (HIDDEN_DIM + EMBEDDING_DIM) * quant_size(dtype) + (size_t)m.vs * sizeof(float) * (dtype == QUANT_I8 ? 3 : 1);
+        fprintf(stderr, "Wrote %s (%s, %d words): %zu bytes of tables, %.1fx smaller than float32\n", out, quant_name(dtype), m.vs, bytes, (double)f32 / bytes);
+    }
+    free_quant_model(&q);
+    free_model(&m);
+    return !ok;
+}
+
+// --- Report ---
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t report_rng = 1;
+static float report_gauss(void) {
+    report_rng = report_rng * 1103515245u + 12345u;
+    float u1 = ((report_rng >> 8) + 0.5f) / 16777216.0f;
+    report_rng = report_rng * 1103515245u + 12345u;
+    float u2 = ((report_rng >> 8) + 0.5f) / 16777216.0f;
+    return sqrtf(-2.0f * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+// Hidden states shaped like the forward pass leaves them: layer norm, ReLU
+static void hidden_states(float *h, int n) {
+    for (int r = 0; r < n; r++) {
+        float *x = h + (size_t)r * HIDDEN_DIM;
+        for (int l = 0; l < HIDDEN_DIM; l++) x[l] = report_gauss();
+        kern_layer_norm(x, HIDDEN_DIM);
+        for (int l = 0; l < HIDDEN_DIM; l++) if (x[l] < 0) x[l] = 0;
+    }
+}
+
+static int argmax(const float *x, int n) {
+    int best = 0;
+    for (int j = 1; j < n; j++) if (x[j] > x[best]) best = j;
+    return best;
+}
+
+typedef struct {
+    size_t vec_bytes, layer_bytes;
+    double cand_rate, proj_rate;
+    int cand_top1, proj_top1;      // agreements with float32
+    float max_logit_error;         // over the first batch, relative to its largest |logit|
+} StorageReport;
+
+// Candidate search: one top-10 query per token, the current word cycling
+// through the vocabulary as the chatbot's would. top1 gets each query's best id.
+static void report_candidates(const FloatModel *m, int dtype, int tokens, int *top1, StorageReport *r) {
+    TopkIndex t;
+    if (!topk_build(&t, m->vecs, m->vs) || !topk_quantize(&t, dtype)) { fprintf(stderr, "Failed to build the candidate index\n"); exit(1); }
+    int ids[REPORT_TOP_N];
+    float scores[REPORT_TOP_N];
+    double start = now_sec();
+    for (int i = 0; i < tokens; i++) {
+        topk_query(&t, m->vecs + (size_t)(i % m->vs) * EMBEDDING_DIM, REPORT_TOP_N, 0, ids, scores);
+        if (dtype == QUANT_F32) top1[i] = ids[0];
+        else r->cand_top1 += ids[0] == top1[i];
+    }
+    r->cand_rate = tokens / (now_sec() - start);
+    r->vec_bytes = topk_bytes(&t);
+    topk_free(&t);
+}
+
+// Output projection in batches of REPORT_BATCH hidden states
+static void report_projection(const FloatModel *m, const QuantModel *q, const float *h, int tokens, float *ref, int *top1, StorageReport *r) {
+    int vs = m->vs;
+    float *out = malloc((size_t)REPORT_BATCH * vs * sizeof(float));
+    if (!out) { fprintf(stderr, "Failed to allocate logits\n"); exit(1); }
+    double start = now_sec();
+    for (int b = 0; b < tokens; b += REPORT_BATCH) {
+        int n = tokens - b < REPORT_BATCH ? tokens - b : REPORT_BATCH;
+        if (q) kern_output_projection_quant(h + (size_t)b * HIDDEN_DIM, n, HIDDEN_DIM, q->dtype, q->rows, q->scales, m->biases, out, vs);
+        else kern_output_projection(h + (size_t)b * HIDDEN_DIM, n, HIDDEN_DIM, (float *const *)m->weights, m->biases, out, vs);
+        for (int i = 0; i < n; i++) {
+            const float *o = out + (size_t)i * vs;
+            int best = argmax(o, vs);
+            if (!q) { top1[b + i] = best; if (b == 0) memcpy(ref + (size_t)i * vs, o, vs * sizeof(float)); continue; }
+            r->proj_top1 += best == top1[b + i];
+            // Logit error over the first batch, against the float logits kept from it
+            for (int j = 0; b == 0 && j < vs; j++) { float d = fabsf(o[j] - ref[(size_t)i * vs + j]); if (d > r->max_logit_error) r->max_logit_error = d; }
+        }
+    }
+    float max_logit = 0.0f;
+    for (size_t i = 0; q && i < (size_t)(tokens < REPORT_BATCH ? tokens : REPORT_BATCH) * vs; i++) if (fabsf(ref[i]) > max_logit) max_logit = fabsf(ref[i]);
+    if (max_logit > 0.0f) r->max_logit_error /= max_logit;
+    r->proj_rate = tokens / (now_sec() - start);
+    r->layer_bytes = (size_t)HIDDEN_DIM * vs * (q ? (size_t)quant_size(q->dtype) : sizeof(float)) + (size_t)vs * sizeof(float) * (q && q->scales ? 2 : 1);
+    free(out);
+}
+
+static int report(const char *vocab, const char *output, int tokens) {
+    FloatModel m;
+    if (!load_model(&m, vocab, output)) return 1;
+    kernels_init();
+    int vs = m.vs;
+    float *h = malloc((size_t)tokens * HIDDEN_DIM * sizeof(float));
+    float *ref = malloc((size_t)REPORT_BATCH * vs * sizeof(float));
+    int *cand_top1 = malloc(tokens * sizeof(int)), *proj_top1 = malloc(tokens * sizeof(int));
+    if (!h || !ref || !cand_top1 || !proj_top1) { fprintf(stderr, "Failed to allocate report buffers\n"); return 1; }
+    hidden_states(h, tokens);
+
+    printf("Vocabulary: %d words, %d tokens, %s kernels, %d threads\n", vs, tokens, kern_level_name(kern_cfg.level), kern_cfg.threads);
+    printf("%-8s %12s %12s %8s %14s %8s %14s %8s %12s\n", "storage", "vectors", "layer", "saving",
+           "cand tok/s", "top-1", "proj tok/s", "top-1", "logit err");
+    const int dtypes[3] = { QUANT_F32, QUANT_I8, QUANT_F16 };
+    size_t f32_bytes = 0;
+    for (int d = 0; d < 3; d++) {
+        StorageReport r;
+        memset(&r, 0, sizeof(r));
+        QuantModel q;
+        if (dtypes[d] != QUANT_F32 && !quantize_model(&q, &m, dtypes[d])) return 1;
+        report_candidates(&m, dtypes[d], tokens, cand_top1, &r);
+        report_projection(&m, dtypes[d] == QUANT_F32 ? NULL : &q, h, tokens, ref, proj_top1, &r);
+        size_t bytes = r.vec_bytes + r.layer_bytes;
+        if (dtypes[d] == QUANT_F32) {
+            f32_bytes = bytes;
+            r.cand_top1 = r.proj_top1 = tokens;
+        } else {
+            free_quant_model(&q);
+        }
+        printf("%-8s %12zu %12zu %7.2fx %14.0f %7.2f%% %14.0f %7.2f%% %12.6f\n", quant_name(dtypes[d]), r.vec_bytes, r.layer_bytes,
+               (double)f32_bytes / bytes, r.cand_rate, 100.0 * r.cand_top1 / tokens, r.proj_rate, 100.0 * r.proj_top1 / tokens, r.max_logit_error);
+    }
+    printf("vectors: candidate index bytes; layer: output weights, scales and biases;\n");
+    printf("top-1: share of tokens whose best candidate / highest logit matches float32;\n");
+    printf("logit err: largest logit difference over the largest float32 logit\n");
+    free(h); free(ref); free(cand_top1); free(proj_top1);
+    free_model(&m);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 6 && strcmp(argv[1], "export") == 0) return export_model(argv[2], argv[3], argv[4], argv[5]);
+    if (argc >= 4 && strcmp(argv[1], "report") == 0) {
+        int tokens = argc >= 5 ? atoi(argv[4]) : REPORT_TOKENS;
+        return report(argv[2], argv[3], tokens > 0 ? tokens : REPORT_TOKENS);
+    }
+    fprintf(stderr, "Usage: %s export <int8|fp16> <vocab.txt> <output_layer> <out.bin>\n", argv[0]);
+    fprintf(stderr, "       %s report <vocab.txt> <output_layer> [tokens]\n", argv[0]);
+    return 1;
+}
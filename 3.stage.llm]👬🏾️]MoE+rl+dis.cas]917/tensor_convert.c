@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tensor_file.h"
+#include "quant.h"
+
+#define EMBEDDING_DIM 7
+#define HIDDEN_DIM 16
+
+// Converts model, moment, gradient and stage files between the text layout
+// and the binary tensor format (tensor_file.h).
+//
+//   tensor_convert to-bin <attention|mlp|output|matrix> <in.txt> <out.bin>
+//   tensor_convert to-text <in.bin> <out.txt>
+//   tensor_convert info <in.bin>
+//
+// to-text picks the text layout from the kind stored in the header, so the
+// result can be diffed against files the stages wrote in text mode. A
+// quantized file from quantize.c comes out as its dequantized output layer.
+
+// Reads every float in a text file; the layouts are whitespace separated
+static float *read_text_floats(const char *fn, int *count) {
+    FILE *f = fopen(fn, "r");
+    if (!f) { fprintf(stderr, "Failed to open %s\n", fn); return NULL; }
+    int cap = 1024, n = 0;
+    float *x = malloc(cap * sizeof(float)), val;
+    while (x && fscanf(f, "%f", &val) == 1) {
+        if (n == cap) { cap *= 2; float *tmp = realloc(x, cap * sizeof(float)); if (!tmp) { free(x); x = NULL; break; } x = tmp; }
+        x[n++] = val;
+    }
+    fclose(f);
+    *count = n;
+    return x;
+}
+
+static void write_row(FILE *f, const float *x, int n) { for (int i = 0; i < n; i++) fprintf(f, "%f ", x[i]); fprintf(f, "\n"); }
+
+static int to_bin(const char *kind, const char *in, const char *out) {
+    int n;
+    float *x = read_text_floats(in, &n);
+    if (!x) return 1;
+    int ok = 0;
+    if (strcmp(kind, "attention") == 0) {
+        int sz = EMBEDDING_DIM * EMBEDDING_DIM;
+        if (n != 3 * sz) fprintf(stderr, "%s: expected %d floats for an attention layer, found %d\n", in, 3 * sz, n);
+        else ok = tensor_save_attention(out, x, x + sz, x + 2 * sz, EMBEDDING_DIM);
+    } else if (strcmp(kind, "mlp") == 0) {
+        int sz = EMBEDDING_DIM * HIDDEN_DIM;
+        if (n != sz + HIDDEN_DIM) fprintf(stderr, "%s: expected %d floats for an MLP layer, found %d\n", in, sz + HIDDEN_DIM, n);
+        else ok = tensor_save_mlp(out, x, EMBEDDING_DIM, HIDDEN_DIM, x + sz);
+    } else if (strcmp(kind, "output") == 0) {
+        // HIDDEN_DIM rows of vs weights followed by vs biases
+        if (n % (HIDDEN_DIM + 1) != 0) fprintf(stderr, "%s: %d floats is not a %d-row output layer plus biases\n", in, n, HIDDEN_DIM);
+        else {
+            int vs = n / (HIDDEN_DIM + 1);
+            float *rows[HIDDEN_DIM];
+            for (int i = 0; i < HIDDEN_DIM; i++) rows[i] = x + i * vs;
+            ok = tensor_save_output(out, rows, HIDDEN_DIM, vs, x + HIDDEN_DIM * vs);
+        }
+    } else if (strcmp(kind, "matrix") == 0) {
+        ok = tensor_save_matrix(out, x, 1, n);
+    } else {
+        fprintf(stderr, "Unknown kind: %s\n", kind);
+    }
+    free(x);
+    if (ok) fprintf(stderr, "Wrote %s (%s)\n", out, kind);
+    return !ok;
+}
+
+static int to_text(const char *in, const char *out) {
+    TensorFile tf;
+    if (!tensor_file_open(in, &tf, 0)) { fprintf(stderr, "Failed to open tensor file %s\n", in); return 1; }
+    FILE *f = fopen(out, "w");
+    if (!f) { fprintf(stderr, "Failed to open %s for writing\n", out); tensor_file_close(&tf); return 1; }
+    char kind[sizeof(tf.header->kind) + 1] = {0};
+    memcpy(kind, tf.header->kind, sizeof(tf.header->kind));
+    int ok = 1, r = 0, c = 0;
+    if (strcmp(kind, "attention") == 0) {
+        // One line per matrix, as save_attention() writes them
+        const char *names[3] = { "W_q", "W_k", "W_v" };
+        for (int i = 0; i < 3 && ok; i++) {
+            float *w = tensor_file_get(&tf, names[i], &r, &c);
+            if (w) write_row(f, w, r * c); else ok = 0;
+        }
+    } else if (strcmp(kind, "mlp") == 0) {
+        float *w = tensor_file_get(&tf, "weights", &r, &c);
+        float *b = tensor_file_get(&tf, "biases", NULL, NULL);
+        if (w && b) { write_row(f, w, r * c); write_row(f, b, c); } else ok = 0;
+    } else if (strcmp(kind, "output") == 0) {
+        float *w = tensor_file_get(&tf, "weights", &r, &c);
+        float *b = tensor_file_get(&tf, "biases", NULL, NULL);
+        if (w && b) { for (int i = 0; i < r; i++) write_row(f, w + (size_t)i * c, c); write_row(f, b, c); } else ok = 0;
+    } else if (strcmp(kind, "quantized") == 0) {
+        // The dequantized output layer, in the text layout of "output"
+        const void *rows[HIDDEN_DIM];
+        const float *scales = NULL;
+        float *b = NULL;
+        TensorFile q;
+        c = tf.header->count > 0 ? (int)tf.entries[0].shape[1] : 0;
+        int dtype = tensor_map_quantized(in, &q, rows, HIDDEN_DIM, c, &scales, &b);
+        float *row = malloc(c * sizeof(float));
+        ok = dtype > 0 && row;
+        for (int i = 0; ok && i < HIDDEN_DIM; i++) {
+            for (int j = 0; j < c; j++) quant_dequant_row(dtype, (const char*)rows[i] + (size_t)j * quant_size(dtype), scales ? scales[j] : 1.0f, 1, row + j);
+            write_row(f, row, c);
+        }
+        if (ok) write_row(f, b, c);
+        if (dtype > 0) tensor_file_close(&q);
+        free(row);
+    } else {
+        // matrix and anything newer: one line per row of every tensor
+        for (uint32_t i = 0; i < tf.header->count; i++) {
+            TensorEntry *e = &tf.entries[i];
+            float *w = (float*)(tf.base + e->offset);
+            for (uint32_t row = 0; row < e->shape[0]; row++) write_row(f, w + (size_t)row * e->shape[1], e->shape[1]);
+        }
+    }
+    fclose(f);
+    tensor_file_close(&tf);
+    if (!ok) { fprintf(stderr, "%s is missing tensors for kind %s\n", in, kind); return 1; }
+    fprintf(stderr, "Wrote %s (%s)\n", out, kind);
+    return 0;
+}
+
+static int info(const char *in) {
+    TensorFile tf;
+    if (!tensor_file_open(in, &tf, 0)) { fprintf(stderr, "Failed to open tensor file %s\n", in); return 1; }
+    printf("%s: kind=%s version=%u tensors=%u bytes=%zu\n", in, tf.header->kind, tf.header->version, tf.header->count, tf.size);
+    for (uint32_t i = 0; i < tf.header->count; i++) {
+        TensorEntry *e = &tf.entries[i];
+        printf("  %-10s %-3s %ux%u offset=%llu bytes=%llu\n", e->name, tensor_dtype_name(e->dtype), e->shape[0], e->shape[1], (unsigned long long)e->offset, (unsigned long long)e->nbytes);
+    }
+    tensor_file_close(&tf);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 5 && strcmp(argv[1], "to-bin") == 0) return to_bin(argv[2], argv[3], argv[4]);
+    if (argc >= 4 && strcmp(argv[1], "to-text") == 0) return to_text(argv[2], argv[3]);
+    if (argc >= 3 && strcmp(argv[1], "info") == 0) return info(argv[2]);
+    fprintf(stderr, "Usage: %s to-bin <attention|mlp|output|matrix> <in.txt> <out.bin>\n", argv[0]);
+    fprintf(stderr, "       %s to-text <in.bin> <out.txt>\n", argv[0]);
+    fprintf(stderr, "       %s info <in.bin>\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,337 @@
+#ifndef TENSOR_FILE_H
+#define TENSOR_FILE_H
+
+// Versioned binary tensor container shared by the training stages.
+//
+// Layout:
+//   TensorFileHeader                      32 bytes
+//   TensorEntry[count]                    56 bytes each
+//   raw tensor data, each blob starting on a TENSOR_FILE_ALIGN boundary
+//
+// Files are opened with mmap, so loading a model costs a page fault instead
+// of an fscanf per float. A path ending in ".bin" selects this format when
+// writing; readers check the magic and fall back to the old text layout.
+//
+// Tensors are float32 except in "quantized" files from quantize.c, which
+// hold int8 or fp16 tables (dtypes as in quant.h) with float32 scales.
+//
+// Readers use the mapped floats in place, so header, entries and data are
+// all in the writer's byte order. The header's byte_order field holds
+// TENSOR_BYTE_ORDER as written, and a host of the other order refuses the
+// file instead of misreading it. Files from before the marker have 0 there.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TENSOR_FILE_MAGIC "RDTF"
+#define TENSOR_FILE_VERSION 1
+#define TENSOR_FILE_ALIGN 64
+#define TENSOR_MAX_ENTRIES 16
+#define TENSOR_BYTE_ORDER 0x01020304u
+
+enum { TENSOR_F32 = 0, TENSOR_I8 = 1, TENSOR_F16 = 2 };
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    char kind[16];      // "attention", "mlp", "output", "matrix" or "quantized"
+    uint32_t count;
+    uint32_t byte_order; // TENSOR_BYTE_ORDER in the writer's byte order
+} TensorFileHeader;
+
+typedef struct {
+    char name[24];
+    uint32_t dtype;
+    uint32_t ndim;      // 1 or 2
+    uint32_t shape[2];  // rows, cols (cols = 1 for vectors)
+    uint64_t offset;    // from the start of the file
+    uint64_t nbytes;
+} TensorEntry;
+
+// One tensor to write
+typedef struct {
+    const char *name;
+    int ndim;
+    int rows, cols;
+    const float *data;
+    const float *const *row_ptrs;  // used instead of data when rows are separate allocations
+    int dtype;                     // TENSOR_I8 and TENSOR_F16 take their values from codes
+    const void *codes;
+} TensorDesc;
+
+static inline int tensor_dtype_size(uint32_t dtype) { return dtype == TENSOR_I8 ? 1 : dtype == TENSOR_F16 ? 2 : 4; }
+static inline const char *tensor_dtype_name(uint32_t dtype) { return dtype == TENSOR_I8 ? "i8" : dtype == TENSOR_F16 ? "f16" : "f32"; }
+
+// A mapped file
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    int writable;
+    TensorFileHeader *header;
+    TensorEntry *entries;
+} TensorFile;
+
+static inline int tensor_path_is_bin(const char *path) {
+    size_t n = strlen(path);
+    return n >= 4 && strcmp(path + n - 4, ".bin") == 0;
+}
+
+// Extension the stage files use alongside a given model path
+static inline const char *tensor_ext(const char *path) { return tensor_path_is_bin(path) ? ".bin" : ".txt"; }
+
+static inline int tensor_file_is_binary(const char *path) {
+    char magic[4];
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    int ok = fread(magic, 1, 4, f) == 4 && memcmp(magic, TENSOR_FILE_MAGIC, 4) == 0;
+    fclose(f);
+    return ok;
+}
+
+static inline uint64_t tensor_align(uint64_t x) { return (x + TENSOR_FILE_ALIGN - 1) & ~(uint64_t)(TENSOR_FILE_ALIGN - 1); }
+
+static inline int tensor_file_write(const char *path, const char *kind, const TensorDesc *t, int count) {
+    if (count <= 0 || count > TENSOR_MAX_ENTRIES) return 0;
+    TensorFileHeader h;
+    TensorEntry e[TENSOR_MAX_ENTRIES];
+    memset(&h, 0, sizeof(h));
+    memset(e, 0, sizeof(e));
+    memcpy(h.magic, TENSOR_FILE_MAGIC, 4);
+    h.version = TENSOR_FILE_VERSION;
+    strncpy(h.kind, kind, sizeof(h.kind) - 1);
+    h.count = count;
+    h.byte_order = TENSOR_BYTE_ORDER;
+
+    uint64_t off = tensor_align(sizeof(h) + count * sizeof(TensorEntry));
+    for (int i = 0; i < count; i++) {
+        strncpy(e[i].name, t[i].name, sizeof(e[i].name) - 1);
+        e[i].dtype = t[i].dtype;
+        e[i].ndim = t[i].ndim;
+        e[i].shape[0] = t[i].rows;
+        e[i].shape[1] = t[i].ndim == 1 ? 1 : t[i].cols;
+        e[i].offset = off;
+        e[i].nbytes = (uint64_t)e[i].shape[0] * e[i].shape[1] * tensor_dtype_size(t[i].dtype);
+        off = tensor_align(off + e[i].nbytes);
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) { fprintf(stderr, "Failed to open %s for writing\n", path); return 0; }
+    static const unsigned char zeros[TENSOR_FILE_ALIGN] = {0};
+    uint64_t pos = 0;
+    fwrite(&h, sizeof(h), 1, f); pos += sizeof(h);
+    fwrite(e, sizeof(TensorEntry), count, f); pos += count * sizeof(TensorEntry);
+    for (int i = 0; i < count; i++) {
+        fwrite(zeros, 1, e[i].offset - pos, f); pos = e[i].offset;
+        if (t[i].dtype != TENSOR_F32) fwrite(t[i].codes, 1, e[i].nbytes, f);
+        else if (t[i].row_ptrs) for (uint32_t r = 0; r < e[i].shape[0]; r++) fwrite(t[i].row_ptrs[r], sizeof(float), e[i].shape[1], f);
+        else if (t[i].data) fwrite(t[i].data, 1, e[i].nbytes, f);
+        else for (uint64_t b = 0; b < e[i].nbytes; b += sizeof(zeros)) fwrite(zeros, 1, e[i].nbytes - b < sizeof(zeros) ? e[i].nbytes - b : sizeof(zeros), f);
+        pos += e[i].nbytes;
+    }
+    fwrite(zeros, 1, off - pos, f);
+    int ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+static inline int tensor_file_open(const char *path, TensorFile *tf, int writable) {
+    memset(tf, 0, sizeof(*tf));
+    int fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TensorFileHeader)) { close(fd); return 0; }
+    void *base = mmap(NULL, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return 0;
+    tf->base = base;
+    tf->size = st.st_size;
+    tf->writable = writable;
+    tf->header = (TensorFileHeader*)base;
+    tf->entries = (TensorEntry*)(tf->base + sizeof(TensorFileHeader));
+
+    TensorFileHeader *h = tf->header;
+    if (memcmp(h->magic, TENSOR_FILE_MAGIC, 4) == 0 && h->byte_order != TENSOR_BYTE_ORDER && h->byte_order != 0) {
+        fprintf(stderr, "%s was written on a host of the other byte order\n", path);
+        munmap(base, st.st_size);
+        memset(tf, 0, sizeof(*tf));
+        return 0;
+    }
+    int ok = memcmp(h->magic, TENSOR_FILE_MAGIC, 4) == 0 && h->version == TENSOR_FILE_VERSION &&
+             h->count <= TENSOR_MAX_ENTRIES && sizeof(TensorFileHeader) + h->count * sizeof(TensorEntry) <= tf->size;
+    // Readers trust each entry's shape, so it must describe exactly the
+    // bytes it points at, and those must lie inside the mapping
+    for (uint32_t i = 0; ok && i < h->count; i++) {
+        TensorEntry *e = &tf->entries[i];
+        ok = (e->dtype == TENSOR_F32 || e->dtype == TENSOR_I8 || e->dtype == TENSOR_F16) &&
+             (e->ndim == 2 || (e->ndim == 1 && e->shape[1] == 1)) && e->shape[0] <= INT_MAX && e->shape[1] <= INT_MAX &&
+             e->nbytes == (uint64_t)e->shape[0] * e->shape[1] * tensor_dtype_size(e->dtype) &&
+             e->offset % TENSOR_FILE_ALIGN == 0 && e->nbytes <= tf->size && e->offset <= tf->size - e->nbytes;
+    }
+    if (!ok) {
+        fprintf(stderr, "%s is not a valid tensor file\n", path);
+        munmap(base, st.st_size);
+        memset(tf, 0, sizeof(*tf));
+        return 0;
+    }
+    return 1;
+}
+
+static inline void tensor_file_close(TensorFile *tf) {
+    if (tf->base) {
+        if (tf->writable) msync(tf->base, tf->size, MS_SYNC);
+        munmap(tf->base, tf->size);
+    }
+    memset(tf, 0, sizeof(*tf));
+}
+
+// Data of a named tensor of the given dtype, or NULL. rows/cols may be NULL.
+static inline void *tensor_file_get_typed(TensorFile *tf, const char *name, uint32_t dtype, int *rows, int *cols) {
+    for (uint32_t i = 0; i < tf->header->count; i++) {
+        TensorEntry *e = &tf->entries[i];
+        if (strncmp(e->name, name, sizeof(e->name)) == 0 && e->dtype == dtype) {
+            if (rows) *rows = e->shape[0];
+            if (cols) *cols = e->shape[1];
+            return tf->base + e->offset;
+        }
+    }
+    return NULL;
+}
+
+// Data of a named float32 tensor, or NULL. rows/cols may be NULL.
+static inline float *tensor_file_get(TensorFile *tf, const char *name, int *rows, int *cols) {
+    return (float*)tensor_file_get_typed(tf, name, TENSOR_F32, rows, cols);
+}
+
+static inline int tensor_file_kind_is(const TensorFile *tf, const char *kind) {
+    return strncmp(tf->header->kind, kind, sizeof(tf->header->kind)) == 0;
+}
+
+// Copy a named tensor of exactly n floats out of a mapped file
+static inline int tensor_file_read(TensorFile *tf, const char *name, float *dst, int n) {
+    int r = 0, c = 0;
+    float *src = tensor_file_get(tf, name, &r, &c);
+    if (!src || (size_t)r * c != (size_t)n) return 0;
+    memcpy(dst, src, (size_t)n * sizeof(float));
+    return 1;
+}
+
+// Convenience for single-matrix files (q, k, v, predictions, gradients...)
+static inline int tensor_save_matrix(const char *path, const float *m, int rows, int cols) {
+    TensorDesc d = { .name = "data", .ndim = 2, .rows = rows, .cols = cols, .data = m };
+    return tensor_file_write(path, "matrix", &d, 1);
+}
+
+static inline int tensor_load_matrix(const char *path, float *m, int rows, int cols) {
+    TensorFile tf;
+    if (!tensor_file_open(path, &tf, 0)) return 0;
+    int ok = tensor_file_read(&tf, "data", m, rows * cols);
+    tensor_file_close(&tf);
+    return ok;
+}
+
+// --- Layer files ---
+// Tensor names and shapes for the three model files. The stage programs keep
+// their own struct definitions, so these take plain float pointers.
+
+static inline int tensor_save_attention(const char *path, const float *W_q, const float *W_k, const float *W_v, int dim) {
+    TensorDesc d[3] = { { .name = "W_q", .ndim = 2, .rows = dim, .cols = dim, .data = W_q },
+                        { .name = "W_k", .ndim = 2, .rows = dim, .cols = dim, .data = W_k },
+                        { .name = "W_v", .ndim = 2, .rows = dim, .cols = dim, .data = W_v } };
+    return tensor_file_write(path, "attention", d, 3);
+}
+
+static inline int tensor_load_attention(const char *path, float *W_q, float *W_k, float *W_v, int dim) {
+    TensorFile tf;
+    if (!tensor_file_open(path, &tf, 0)) return 0;
+    int ok = tensor_file_read(&tf, "W_q", W_q, dim * dim) && tensor_file_read(&tf, "W_k", W_k, dim * dim) && tensor_file_read(&tf, "W_v", W_v, dim * dim);
+    tensor_file_close(&tf);
+    return ok;
+}
+
+static inline int tensor_save_mlp(const char *path, const float *weights, int in_dim, int out_dim, const float *biases) {
+    TensorDesc d[2] = { { .name = "weights", .ndim = 2, .rows = in_dim, .cols = out_dim, .data = weights }, { .name = "biases", .ndim = 1, .rows = out_dim, .cols = 1, .data = biases } };
+    return tensor_file_write(path, "mlp", d, 2);
+}
+
+static inline int tensor_load_mlp(const char *path, float *weights, int in_dim, int out_dim, float *biases) {
+    TensorFile tf;
+    if (!tensor_file_open(path, &tf, 0)) return 0;
+    int ok = tensor_file_read(&tf, "weights", weights, in_dim * out_dim) && tensor_file_read(&tf, "biases", biases, out_dim);
+    tensor_file_close(&tf);
+    return ok;
+}
+
+static inline int tensor_save_output(const char *path, float *const *rows, int hidden_dim, int vs, const float *biases) {
+    TensorDesc d[2] = { { .name = "weights", .ndim = 2, .rows = hidden_dim, .cols = vs, .row_ptrs = (const float *const *)rows }, { .name = "biases", .ndim = 1, .rows = vs, .cols = 1, .data = biases } };
+    return tensor_file_write(path, "output", d, 2);
+}
+
+// Point rows[] and *biases straight into the mapping instead of copying.
+// With writable set, updates through those pointers land in the file.
+static inline int tensor_map_output(const char *path, TensorFile *tf, int writable, float **rows, int hidden_dim, int vs, float **biases) {
+    if (!tensor_file_open(path, tf, writable)) return 0;
+    int r = 0, c = 0, n = 0;
+    float *w = tensor_file_get(tf, "weights", &r, &c);
+    float *b = tensor_file_get(tf, "biases", &n, NULL);
+    if (!w || !b || r != hidden_dim || c != vs || n != vs) {
+        fprintf(stderr, "%s does not hold a %dx%d output layer\n", path, hidden_dim, vs);
+        tensor_file_close(tf);
+        return 0;
+    }
+    for (int i = 0; i < hidden_dim; i++) rows[i] = w + (size_t)i * vs;
+    *biases = b;
+    return 1;
+}
+
+// --- Quantized files ---
+// Written by quantize.c for inference only:
+//   "weights"      hidden_dim x vs, int8 or fp16
+//   "scales"       vs float32, one per word (int8 only)
+//   "biases"       vs float32
+//   "embeddings"   vs x dim word vectors, same dtype (optional)
+//   "emb_scales"   vs float32, one per word (int8 only)
+
+static inline int tensor_save_quantized(const char *path, int dtype, const void *weights, const float *scales, const float *biases, int hidden_dim, int vs,
+                                        const void *embeddings, const float *emb_scales, int dim) {
+    TensorDesc d[5];
+    int n = 0;
+    d[n++] = (TensorDesc){ .name = "weights", .ndim = 2, .rows = hidden_dim, .cols = vs, .dtype = dtype, .codes = weights };
+    if (dtype == TENSOR_I8) d[n++] = (TensorDesc){ .name = "scales", .ndim = 1, .rows = vs, .cols = 1, .data = scales };
+    d[n++] = (TensorDesc){ .name = "biases", .ndim = 1, .rows = vs, .cols = 1, .data = biases };
+    if (embeddings) {
+        d[n++] = (TensorDesc){ .name = "embeddings", .ndim = 2, .rows = vs, .cols = dim, .dtype = dtype, .codes = embeddings };
+        if (dtype == TENSOR_I8) d[n++] = (TensorDesc){ .name = "emb_scales", .ndim = 1, .rows = vs, .cols = 1, .data = emb_scales };
+    }
+    return tensor_file_write(path, "quantized", d, n);
+}
+
+// Point rows[] at the hidden_dim rows of codes in a quantized file, with
+// *scales (NULL for fp16) and *biases into the mapping. Returns the dtype,
+// or -1 when the file is not a quantized layer of this shape.
+static inline int tensor_map_quantized(const char *path, TensorFile *tf, const void **rows, int hidden_dim, int vs, const float **scales, float **biases) {
+    if (!tensor_file_open(path, tf, 0)) return -1;
+    if (!tensor_file_kind_is(tf, "quantized")) { tensor_file_close(tf); return -1; }
+    int dtype = TENSOR_I8, r = 0, c = 0, n = 0, ns = vs;
+    unsigned char *w = tensor_file_get_typed(tf, "weights", TENSOR_I8, &r, &c);
+    if (!w) { dtype = TENSOR_F16; w = tensor_file_get_typed(tf, "weights", TENSOR_F16, &r, &c); }
+    float *s = dtype == TENSOR_I8 ? tensor_file_get(tf, "scales", &ns, NULL) : NULL;
+    float *b = tensor_file_get(tf, "biases", &n, NULL);
+    if (!w || !b || (dtype == TENSOR_I8 && !s) || r != hidden_dim || c != vs || n != vs || ns != vs) {
+        fprintf(stderr, "%s does not hold a quantized %dx%d output layer\n", path, hidden_dim, vs);
+        tensor_file_close(tf);
+        return -1;
+    }
+    for (int i = 0; i < hidden_dim; i++) rows[i] = w + (size_t)i * vs * tensor_dtype_size(dtype);
+    *scales = s;
+    *biases = b;
+    return dtype;
+}
+
+#endif
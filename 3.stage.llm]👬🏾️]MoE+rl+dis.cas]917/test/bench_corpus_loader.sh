@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# Training tokens/sec on a corpus token stream (corpus= in config.txt) when
+# every window read is slow, with and without the prefetch thread. The
+# vocabulary is built from corpuses/iching.txt and the model trains one
+# shuffled epoch on its first 20 kB; CORPUS_READ_DELAY_US stands in for slow
+# storage. With prefetching the delay hides behind training as long as a
+# window trains for longer than it takes to read.
+# Run from the project root: ./test/bench_corpus_loader.sh [delay_us] [window]
+
+ROOT=$(pwd)
+DELAY=${1:-50000}
+WINDOW=${2:-64}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/vocab_model.c" -o "$WORK/vocab_model.+x" -lm || { echo "Compilation of vocab_model.c failed!"; exit 1; }
+gcc -O2 "$ROOT/trainer.c" -o "$WORK/trainer.+x" -pthread -lm || { echo "Compilation of trainer.c failed!"; exit 1; }
+cd "$WORK"
+
+cp "$ROOT/corpuses/iching.txt" iching.txt
+./vocab_model.+x -min-count 3 iching.txt > /dev/null 2>&1 || { echo "Vocabulary build failed!"; exit 1; }
+V=curriculum/iching
+head -c 20000 iching.txt > $V/corpus.txt
+printf "epochs=0\n" > $V/config.txt
+./trainer.+x $V/iching.txt > /dev/null 2>&1 || { echo "Model initialization failed!"; exit 1; }
+printf "epochs=1\nlearning_rate=0.01\ntext_compat=0\ncorpus=corpus.txt\ncorpus_window=$WINDOW\nshuffle_seed=1\n" > $V/config.txt
+# Each run starts from the same model; the first one writes corpus.tok for the rest
+mkdir -p init && cp $V/*_model.txt $V/output_layer.txt init/
+
+echo "vocabulary $(($(wc -l < $V/iching.txt) - 1)) words, windows of $WINDOW pairs, read delay ${DELAY}us"
+printf "%-28s %12s %14s\n" "loader" "tokens/sec" "data wait (s)"
+run() {
+    cp init/* $V/
+    line=$(env "$@" ./trainer.+x $V/iching.txt 2>&1 | tr '\r' '\n' | grep "tokens/sec" | tail -1)
+    echo "$line" | sed -E 's/.* ([0-9]+) tokens\/sec, ([0-9.]+) s waiting.*/\1 \2/'
+}
+for mode in "no delay:CORPUS_READ_DELAY_US=0" "delay, synchronous:CORPUS_READ_DELAY_US=$DELAY CORPUS_PREFETCH=0" \
+            "delay, prefetch:CORPUS_READ_DELAY_US=$DELAY CORPUS_PREFETCH=1"; do
+    read -r tps wait <<< "$(run ${mode#*:})"
+    printf "%-28s %12s %14s\n" "${mode%%:*}" "$tps" "$wait"
+done
@@ -0,0 +1,60 @@
+#!/bin/bash
+
+# Throughput of forward_prop: one process per token (what trainer -spawn
+# does) against a single batched call over the same tokens. Also checks
+# that every batched row equals the matching one-token run.
+# Run from the project root:
+#   ./test/bench_forward_batch.sh [vocab_file] [tokens]
+# Defaults to vocab_model.txt and 200 tokens.
+
+ROOT=$(pwd)
+VOCAB=${1:-vocab_model.txt}
+TOKENS=${2:-200}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+echo "Compiling trainer and forward_prop into $WORK/+x..."
+mkdir -p "$WORK/+x" "$WORK/single" "$WORK/batch"
+for m in trainer forward_prop; do
+    gcc -O2 "$ROOT/$m.c" -o "$WORK/+x/$m.+x" -pthread -lm || { echo "Compilation of $m.c failed!"; exit 1; }
+done
+
+cp "$ROOT/$VOCAB" "$WORK/vocab.txt" || exit 1
+cd "$WORK"
+printf "epochs=0\n" > config.txt
+./+x/trainer.+x vocab.txt 2>/dev/null || { echo "Model initialization failed!"; exit 1; }
+cp vocab.txt single/; cp vocab.txt batch/
+VS=$(($(wc -l < vocab.txt) - 1))
+[ "$TOKENS" -gt "$VS" ] && TOKENS=$VS
+LAST=$((TOKENS - 1))
+echo "Vocabulary: $VS words, $TOKENS tokens"
+
+now() { date +%s.%N; }
+elapsed() { awk -v a="$1" -v b="$(now)" 'BEGIN { print b - a }'; }
+
+status=0
+start=$(now)
+for i in $(seq 0 $LAST); do
+    ./+x/forward_prop.+x single/vocab.txt $i attention_model.txt mlp_model.txt output_layer.txt 1 2>/dev/null || { echo "forward_prop failed at $i"; exit 1; }
+    # Keep every row so the batched output can be compared
+    cat single/predictions.txt >> single/all_predictions.txt
+done
+single_time=$(elapsed $start)
+
+start=$(now)
+./+x/forward_prop.+x batch/vocab.txt 0-$LAST attention_model.txt mlp_model.txt output_layer.txt 1 2>/dev/null || { echo "Batched forward_prop failed"; exit 1; }
+batch_time=$(elapsed $start)
+
+awk -v n="$TOKENS" -v s="$single_time" -v b="$batch_time" 'BEGIN {
+    printf "One process per token: %8.3fs  %10.1f tokens/sec\n", s, n / s
+    printf "Batched (one call):    %8.3fs  %10.1f tokens/sec\n", b, n / b
+    printf "Speedup: %.1fx\n", s / b
+}'
+
+if cmp -s single/all_predictions.txt batch/predictions.txt; then
+    echo "✓ batched predictions match the one-token path row for row"
+else
+    echo "✗ batched predictions differ from the one-token path"
+    status=1
+fi
+exit $status
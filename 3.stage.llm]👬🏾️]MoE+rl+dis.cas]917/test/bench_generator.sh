@@ -0,0 +1,14 @@
+#!/bin/bash
+
+# Generation throughput with and without incremental generation
+# (generator.h): tokens per second by sequence length, one forward_prop
+# call per token over just that token (which rebuilds the vocabulary side
+# of attention each time) against one generator_step per token.
+# Run from the project root: ./test/bench_generator.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/test/generator_check.c" -o "$WORK/generator_check.+x" -pthread -lm || { echo "Compilation of generator_check.c failed!"; exit 1; }
+"$WORK/generator_check.+x" bench
@@ -0,0 +1,14 @@
+#!/bin/bash
+
+# Milliseconds per layout step for random association graphs of 1000, 10000
+# and 100000 nodes (three edges each), in 2D and 3D: the visualizers' old
+# O(n^2) update_physics() ("old", up to 10000 nodes) and the Barnes-Hut
+# step in force_layout.h ("tree"). Headless; no GL needed.
+# Run from the project root: ./test/bench_layout.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/test/layout_check.c" -o "$WORK/layout_check.+x" -lm || { echo "Compilation of layout_check.c failed!"; exit 1; }
+"$WORK/layout_check.+x" bench
@@ -0,0 +1,15 @@
+#!/bin/bash
+
+# Tokens/sec of predict_next_word's candidate search by expert count (2 to
+# 64 experts of 2000 words each, clustered around random centers): one
+# k-d tree over every word, every expert's tree, and the top 1 and top 2
+# experts by the gate (CHATBOT_MOE_TOPK), with the balance loss and the
+# busiest expert's share over the even load for the sparse runs.
+# Run from the project root: ./test/bench_moe.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/test/moe_check.c" -o "$WORK/moe_check.+x" -lm || { echo "Compilation of moe_check.c failed!"; exit 1; }
+"$WORK/moe_check.+x" bench
@@ -0,0 +1,29 @@
+#!/bin/bash
+
+# Memory, tokens/sec and top-1 agreement of the int8 and fp16 storage
+# against float32 (quantize report): the candidate search on the word
+# vectors and the output projection in batches of 64, on vocab_model.txt
+# with a fresh output layer and on random vocabularies of 10k and 100k words.
+# Run from the project root: ./test/bench_quantize.sh [tokens]
+
+ROOT=$(pwd)
+TOKENS=${1:-4000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/quantize.c" -o "$WORK/quantize.+x" -pthread -lm || { echo "Compilation of quantize.c failed!"; exit 1; }
+gcc -O2 "$ROOT/trainer.c" -o "$WORK/trainer.+x" -pthread -lm || { echo "Compilation of trainer.c failed!"; exit 1; }
+cd "$WORK"
+
+cp "$ROOT/vocab_model.txt" vocab.txt
+printf "epochs=0\n" > config.txt
+./trainer.+x vocab.txt > /dev/null 2>&1 || { echo "Model initialization failed!"; exit 1; }
+./quantize.+x report vocab.txt output_layer.txt "$TOKENS"
+
+for n in 10000 100000; do
+    awk -v n=$n 'BEGIN { srand(3); print "number word embedding pe weight bias1 bias2 bias3 bias4"
+        for (i = 1; i <= n; i++) printf "%d w%d %f %f %f %f %f %f %f\n", i, i, rand() * 2 - 1, rand() * 2 - 1, rand() * 2 - 1, rand() * 2 - 1, rand() * 2 - 1, rand() * 2 - 1, rand() * 2 - 1 }' > big.txt
+    awk -v n=$n 'BEGIN { srand(5); for (l = 0; l < 17; l++) { for (j = 0; j < n; j++) printf "%f ", (rand() - 0.5) * 0.2; printf "\n" } }' > big_out.txt
+    echo
+    ./quantize.+x report big.txt big_out.txt "$TOKENS"
+done
@@ -0,0 +1,84 @@
+#!/bin/bash
+
+# Training performance regression check. Trains a fixed-seed model on a
+# -sequence vocabulary of the first 4 kB of corpuses/iching.txt with the
+# in-process trainer, PERF_RUNS times from the same initial weights, and
+# appends the best tokens/sec, the peak RSS and the final loss to a results
+# file. Fails when tokens/sec falls more than PERF_THRESHOLD below the median
+# of the last 5 passing results of the same workload on the same host; the
+# first run on a host only records its baseline. The final loss must be the
+# same in every run (it is printed, not compared with older results, since
+# intended changes to the math move it).
+#
+# Environment:
+#   PERF_RESULTS     results file (default test/perf_results.tsv, git-ignored)
+#   PERF_THRESHOLD   allowed slowdown as a fraction (default 0.15)
+#   PERF_RUNS        runs to take the best of (default 3)
+#   PERF_EPOCHS      epochs per run (default 2)
+# Run from the project root: ./test/bench_train.sh
+
+ROOT=$(pwd)
+RESULTS=${PERF_RESULTS:-$ROOT/test/perf_results.tsv}
+THRESHOLD=${PERF_THRESHOLD:-0.15}
+RUNS=${PERF_RUNS:-3}
+EPOCHS=${PERF_EPOCHS:-2}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/vocab_model.c" -o "$WORK/vocab_model.+x" -lm || { echo "Compilation of vocab_model.c failed!"; exit 1; }
+gcc -O2 "$ROOT/trainer.c" -o "$WORK/trainer.+x" -pthread -lm || { echo "Compilation of trainer.c failed!"; exit 1; }
+COMMIT=$(git -C "$ROOT" rev-parse --short HEAD 2>/dev/null || echo "-")
+cd "$WORK"
+
+head -c 4000 "$ROOT/corpuses/iching.txt" > bench.txt
+./vocab_model.+x -sequence bench.txt > /dev/null 2>&1 || { echo "Vocabulary build failed!"; exit 1; }
+V=curriculum/bench
+printf "epochs=0\n" > $V/config.txt
+TRAINER_SEED=1 ./trainer.+x $V/bench.txt > /dev/null 2>&1 || { echo "Model initialization failed!"; exit 1; }
+printf "epochs=$EPOCHS\nlearning_rate=0.01\ntext_compat=0\n" > $V/config.txt
+mkdir -p init && cp $V/bench.txt $V/*_model.txt $V/output_layer.txt init/
+ROWS=$(($(wc -l < init/bench.txt) - 1))
+WORKLOAD="sequence-${ROWS}x${EPOCHS}"
+
+best=0; rss=0; loss=""; same_loss=1
+for r in $(seq "$RUNS"); do
+    rm -f $V/loss.txt $V/*.m.txt $V/*.v.txt $V/optimizer_state.txt; cp init/* $V/
+    line=$(./trainer.+x $V/bench.txt 2>&1 | tr '\r' '\n' | grep "^Trained ")
+    [ -n "$line" ] || { echo "Training failed!"; exit 1; }
+    tps=$(echo "$line" | sed -E 's/.*s, ([0-9.]+) tokens\/sec.*/\1/')
+    kb=$(echo "$line" | sed -E 's/.*peak RSS ([0-9]+) KB.*/\1/')
+    l=$(tail -1 $V/loss.txt)
+    [ -z "$loss" ] || [ "$l" = "$loss" ] || same_loss=0
+    loss=$l
+    echo "run $r: $tps tokens/sec, peak RSS $kb KB, final loss $l"
+    best=$(awk -v a="$best" -v b="$tps" 'BEGIN { print (b > a ? b : a) }')
+    [ "$kb" -gt "$rss" ] && rss=$kb
+done
+
+status=0
+HOST=$(hostname)
+baseline=$([ -f "$RESULTS" ] && awk -F'\t' -v h="$HOST" -v w="$WORKLOAD" '$3 == h && $4 == w && $8 == "pass" { v[n++] = $5 } END {
+    if (!n) exit; k = 0; for (i = (n > 5 ? n - 5 : 0); i < n; i++) s[k++] = v[i]
+    for (i = 0; i < k; i++) for (j = i + 1; j < k; j++) if (s[j] < s[i]) { t = s[i]; s[i] = s[j]; s[j] = t }
+    print (k % 2 ? s[int(k / 2)] : (s[k / 2 - 1] + s[k / 2]) / 2) }' "$RESULTS")
+
+echo "$WORKLOAD ($ROWS rows, $EPOCHS epochs): best $best tokens/sec, peak RSS $rss KB, final loss $loss"
+result=pass
+if [ $same_loss -ne 1 ]; then
+    echo "✗ the final loss differs between runs with the same seed"
+    status=1; result=fail
+fi
+if [ -n "$baseline" ]; then
+    if awk -v b="$best" -v base="$baseline" -v t="$THRESHOLD" 'BEGIN { exit !(b < base * (1 - t)) }'; then
+        echo "✗ tokens/sec regressed: $best against a baseline of $baseline (threshold $THRESHOLD)"
+        status=1; result=fail
+    else
+        echo "✓ tokens/sec within $THRESHOLD of the baseline $baseline"
+    fi
+else
+    echo "No earlier result for $WORKLOAD on $HOST; recording the baseline"
+fi
+[ -f "$RESULTS" ] || printf "date\tcommit\thost\tworkload\ttokens_per_sec\tpeak_rss_kb\tfinal_loss\tstatus\n" > "$RESULTS"
+printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$COMMIT" "$HOST" "$WORKLOAD" "$best" "$rss" "$loss" "$result" >> "$RESULTS"
+echo "Results appended to $RESULTS"
+exit $status
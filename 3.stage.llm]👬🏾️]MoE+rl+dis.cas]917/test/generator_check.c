@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../generator.h"
+
+// Checks and times generator.h, the incremental forward pass behind
+// forward_prop's FORWARD_GENERATE.
+//
+//   generator_check test    greedy generation through a Generator gives the
+//                           same tokens, logits, K and V, bit for bit, as
+//                           running the whole prefix through forward_prop's
+//                           batch math at every step, causal or not
+//   generator_check bench   tokens/sec by sequence length against one
+//                           forward_prop call per token over just that
+//                           token, which rebuilds the vocabulary side
+
+static unsigned int rng = 7;
+static float frand(float lo, float hi) {
+    rng = rng * 1103515245 + 12345;
+    return lo + (hi - lo) * ((rng >> 8) & 0xffffff) / (float)0xffffff;
+}
+static void fill(float *x, int n, float lo, float hi) { for (int i = 0; i < n; i++) x[i] = frand(lo, hi); }
+
+static int failures = 0;
+static void check(int ok, const char *what) {
+    printf("%s %s\n", ok ? "✓" : "✗", what);
+    if (!ok) failures++;
+}
+
+typedef struct { AttentionLayer a; MlpLayer m; OutputLayer o; float *feats; int vs; } Model;
+
+static int make_model(Model *x, int vs) {
+    x->vs = vs;
+    x->feats = malloc((size_t)vs * EMBEDDING_DIM * sizeof(float));
+    if (!x->feats || !alloc_output(&x->o, vs)) return 0;
+    fill(x->feats, vs * EMBEDDING_DIM, -1, 1);
+    fill(&x->a.W_q[0][0], 3 * EMBEDDING_DIM * EMBEDDING_DIM, -0.5f, 0.5f);
+    fill(&x->m.weights[0][0], EMBEDDING_DIM * HIDDEN_DIM + HIDDEN_DIM, -0.5f, 0.5f);
+    fill(output_flat(&x->o), (HIDDEN_DIM + 1) * vs, -0.5f, 0.5f);
+    return 1;
+}
+static void free_model(Model *x) { free(x->feats); free_output(&x->o); }
+
+static int argmax(const float *p, int vs) {
+    int best = 0;
+    for (int j = 1; j < vs; j++) if (p[j] > p[best]) best = j;
+    return best;
+}
+
+// The reference: every step is a forward_prop call over seq[0..t], which
+// rebuilds the vocabulary side and every row, and keeps the last row.
+// p gets one row per step, k and v the projections of the last call.
+static void generate_prefix(const Model *x, int first, int steps, int causal, int *seq, float *p, float *k, float *v) {
+    int vs = x->vs;
+    float *cols = malloc((size_t)vs * EMBEDDING_DIM * sizeof(float)), *sums = malloc(vs * sizeof(float));
+    float *xs = malloc((size_t)steps * EMBEDDING_DIM * sizeof(float)), *q = malloc((size_t)steps * EMBEDDING_DIM * sizeof(float));
+    float *as = malloc((size_t)steps * vs * sizeof(float)), *ctx = malloc((size_t)steps * EMBEDDING_DIM * sizeof(float));
+    float *h = malloc((size_t)steps * HIDDEN_DIM * sizeof(float)), *rows = malloc((size_t)steps * vs * sizeof(float));
+    seq[0] = first;
+    for (int t = 0; t < steps; t++) {
+        int n = t + 1;
+        layer_feature_columns(x->feats, vs, cols, sums);
+        for (int r = 0; r < n; r++) memcpy(xs + r * EMBEDDING_DIM, x->feats + (size_t)seq[r] * EMBEDDING_DIM, EMBEDDING_DIM * sizeof(float));
+        layer_attention_qkv(&x->a, xs, n, q, k, v);
+        layer_attention_scores(q, n, cols, as, vs);
+        for (int r = 0; r < n; r++) {
+            unsigned int seed = LAYER_DROPOUT_SEED;
+            layer_attention_forward(as + (size_t)r * vs, vs, sums, xs + r * EMBEDDING_DIM, causal ? seq[r] : -1, &seed, ctx + r * EMBEDDING_DIM);
+            layer_mlp_forward(&x->m, ctx + r * EMBEDDING_DIM, h + r * HIDDEN_DIM, &seed);
+        }
+        layer_output_forward(&x->o, h, n, rows, vs);
+        memcpy(p + (size_t)t * vs, rows + (size_t)t * vs, vs * sizeof(float));
+        seq[t + 1] = argmax(p + (size_t)t * vs, vs);
+    }
+    free(cols); free(sums); free(xs); free(q); free(as); free(ctx); free(h); free(rows);
+}
+
+static void generate_incremental(Generator *g, int first, int steps, int *seq, float *p, float *k, float *v) {
+    seq[0] = first;
+    for (int t = 0; t < steps; t++) {
+        generator_step(g, seq[t], p + (size_t)t * g->vs, NULL, k ? k + t * EMBEDDING_DIM : NULL, v ? v + t * EMBEDDING_DIM : NULL);
+        seq[t + 1] = argmax(p + (size_t)t * g->vs, g->vs);
+    }
+}
+
+static int run_test(void) {
+    static const int sizes[] = { 1, 9, 300, 2000 };
+    char what[200];
+    for (int causal = 0; causal < 2; causal++) {
+        int logits_bad = 0, tokens_bad = 0, kv_bad = 0, runs = 0;
+        for (int s = 0; s < 4; s++) {
+            int vs = sizes[s], steps = 40;
+            Model x;
+            if (!make_model(&x, vs)) { check(0, "allocation"); return 1; }
+            float *cols = malloc((size_t)vs * EMBEDDING_DIM * sizeof(float)), *sums = malloc(vs * sizeof(float));
+            float *pu = malloc((size_t)steps * vs * sizeof(float)), *pi = malloc((size_t)steps * vs * sizeof(float));
+            float ku[40 * EMBEDDING_DIM], vu[40 * EMBEDDING_DIM], ki[40 * EMBEDDING_DIM], vi[40 * EMBEDDING_DIM];
+            int su[41], si[41];
+            layer_feature_columns(x.feats, vs, cols, sums);
+            int first = (int)(frand(0, 1) * (vs - 1));
+            generate_prefix(&x, first, steps, causal, su, pu, ku, vu);
+            Generator g;
+            if (!generator_init(&g, &x.a, &x.m, &x.o, x.feats, cols, sums, vs, causal)) { check(0, "allocation"); return 1; }
+            generate_incremental(&g, first, steps, si, pi, ki, vi);
+            logits_bad += memcmp(pu, pi, (size_t)steps * vs * sizeof(float)) != 0;
+            tokens_bad += memcmp(su, si, sizeof(su)) != 0;
+            kv_bad += memcmp(ku, ki, sizeof(ku)) != 0 || memcmp(vu, vi, sizeof(vu)) != 0 || g.next != steps;
+            generator_free(&g);
+            runs++;
+            free(cols); free(sums); free(pu); free(pi);
+            free_model(&x);
+        }
+        const char *name = causal ? "causal" : "full";
+        snprintf(what, sizeof(what), "%s attention: incremental logits match whole-prefix generation bit for bit (%d runs of 40 tokens, %d differ)", name, runs, logits_bad);
+        check(logits_bad == 0, what);
+        snprintf(what, sizeof(what), "%s attention: greedy token sequences match", name);
+        check(tokens_bad == 0, what);
+        snprintf(what, sizeof(what), "%s attention: each step's K and V are the whole-prefix rows", name);
+        check(kv_bad == 0, what);
+    }
+    return failures != 0;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The fair baseline for the benchmark: rows depend on their own token
+// only, so a step without the generator is one forward_prop call over the
+// new token, which rebuilds the vocabulary side before its single row.
+static void generate_rebuilt(const Model *x, int first, int steps, int causal, int *seq, float *p) {
+    int vs = x->vs;
+    float *cols = malloc((size_t)vs * EMBEDDING_DIM * sizeof(float)), *sums = malloc(vs * sizeof(float));
+    seq[0] = first;
+    for (int t = 0; t < steps; t++) {
+        Generator g;
+        layer_feature_columns(x->feats, vs, cols, sums);
+        if (!generator_init(&g, &x->a, &x->m, &x->o, x->feats, cols, sums, vs, causal)) break;
+        generator_step(&g, seq[t], p + (size_t)t * vs, NULL, NULL, NULL);
+        generator_free(&g);
+        seq[t + 1] = argmax(p + (size_t)t * vs, vs);
+    }
+    free(cols); free(sums);
+}
+
+static void run_bench(void) {
+    const int vs = 2000;
+    Model x;
+    if (!make_model(&x, vs)) return;
+    float *cols = malloc((size_t)vs * EMBEDDING_DIM * sizeof(float)), *sums = malloc(vs * sizeof(float));
+    layer_feature_columns(x.feats, vs, cols, sums);
+    printf("%-8s %14s %14s %9s\n", "tokens", "per call", "incremental", "speedup");
+    for (int steps = 32; steps <= 512; steps *= 2) {
+        int *seq = malloc((steps + 1) * sizeof(int));
+        float *p = malloc((size_t)steps * vs * sizeof(float));
+        double t0 = now();
+        generate_rebuilt(&x, 0, steps, 1, seq, p);
+        double t_r = steps / (now() - t0);
+        Generator g;
+        generator_init(&g, &x.a, &x.m, &x.o, x.feats, cols, sums, vs, 1);
+        t0 = now();
+        generate_incremental(&g, 0, steps, seq, p, NULL, NULL);
+        double t_i = steps / (now() - t0);
+        printf("%-8d %14.0f %14.0f %8.1fx\n", steps, t_r, t_i, t_i / t_r);
+        generator_free(&g);
+        free(seq); free(p);
+    }
+    printf("(tokens/sec over a %d-word vocabulary, causal, greedy)\n", vs);
+    free(cols); free(sums);
+    free_model(&x);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) { run_bench(); return 0; }
+    return run_test();
+}
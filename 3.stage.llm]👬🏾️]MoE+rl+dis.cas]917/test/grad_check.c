@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Finite-difference gradient checks of the training step in train_engine.h
+// (the same math as forward_prop.c and backward_prop.c, which
+// test_train_engine.sh ties together) on tiny random models. For each token
+// the loss is the cross entropy of the full softmax; every weight is moved
+// by +-eps and the central difference is compared with what
+// train_engine_backward() produced:
+//
+//   output layer   exact: dL/dW[i][j] = (p_j - y_j) h_i. backward_prop clips
+//                  each row (and the biases) to norm 1, so every row must
+//                  point the same way as the difference quotients and have
+//                  their length, or length 1 where it was clipped
+//   MLP            backward_prop leaves out the hidden layer norm and the
+//                  dropout scale, so the gradient is approximate; it must
+//                  still be a descent direction for every token
+//   attention      the attention term is added to every context element
+//                  and then removed by the context layer norm, so the loss
+//                  does not depend on W_q, W_k or W_v: moving any of them
+//                  by +-ATTN_STEP may only change it by float rounding (the
+//                  backward's attention gradient is a heuristic and is only
+//                  reported)
+//
+// Dropout reseeds on every forward, so each token sees a fixed mask and the
+// loss is a deterministic function of the weights.
+
+#define EMBEDDING_DIM 7
+#define HIDDEN_DIM 16
+struct VocabEntry { int number; char word[100]; float embedding, pe, weight, bias1, bias2, bias3, bias4; };
+#include "../train_engine.h"
+
+#define EPS 1e-3f
+#define ATTN_STEP 0.1f
+
+static unsigned int rng = 1;
+static float frand(float lo, float hi) {
+    rng = rng * 1103515245 + 12345;
+    return lo + (hi - lo) * ((rng >> 8) & 0xffffff) / (float)0xffffff;
+}
+static void fill(float *x, int n, float lo, float hi) { for (int i = 0; i < n; i++) x[i] = frand(lo, hi); }
+
+static int failures = 0;
+static void check(int ok, const char *what) {
+    printf("%s %s\n", ok ? "✓" : "✗", what);
+    if (!ok) failures++;
+}
+
+// Cross entropy of the full softmax over the engine's logits, in double
+static double loss_of(TrainEngine *e, struct VocabEntry *v, int wi, int target, int causal) {
+    train_engine_forward(e, v, wi, causal);
+    double m = e->preds[0], s = 0.0;
+    for (int j = 1; j < e->vs; j++) if (e->preds[j] > m) m = e->preds[j];
+    for (int j = 0; j < e->vs; j++) s += exp(e->preds[j] - m);
+    return -(e->preds[target] - m - log(s));
+}
+
+// Loss difference between w + step and w - step
+static double loss_change(TrainEngine *e, struct VocabEntry *v, int wi, int target, int causal, float *w, float step) {
+    float saved = *w;
+    *w = saved + step; double up = loss_of(e, v, wi, target, causal);
+    *w = saved - step; double down = loss_of(e, v, wi, target, causal);
+    *w = saved;
+    return up - down;
+}
+static double central_difference(TrainEngine *e, struct VocabEntry *v, int wi, int target, int causal, float *w) {
+    return loss_change(e, v, wi, target, causal, w, EPS) / (2.0 * EPS);
+}
+
+static double dot(const float *a, const double *b, int n) { double s = 0; for (int i = 0; i < n; i++) s += a[i] * b[i]; return s; }
+static double norm_f(const float *a, int n) { double s = 0; for (int i = 0; i < n; i++) s += (double)a[i] * a[i]; return sqrt(s); }
+static double norm_d(const double *a, int n) { double s = 0; for (int i = 0; i < n; i++) s += a[i] * a[i]; return sqrt(s); }
+
+typedef struct {
+    int tokens;
+    int out_bad, mlp_bad, attn_bad;
+    double out_worst_cos, out_worst_rel, mlp_cos_sum, mlp_worst_cos, attn_change_max, attn_bp_norm;
+} Stats;
+
+// One token: backward at the current weights, then difference quotients
+static void check_token(TrainEngine *e, struct VocabEntry *v, int wi, int target, int causal, Stats *st) {
+    int vs = e->vs;
+    loss_of(e, v, wi, target, causal);
+    // grad_loss = softmax - onehot, as compute_cross_entropy_loss_and_gradient in trainer.c
+    float m = e->preds[0], s = 0.0f;
+    for (int j = 1; j < vs; j++) if (e->preds[j] > m) m = e->preds[j];
+    for (int j = 0; j < vs; j++) { e->grad_loss[j] = expf(e->preds[j] - m); s += e->grad_loss[j]; }
+    for (int j = 0; j < vs; j++) e->grad_loss[j] /= s;
+    e->grad_loss[target] -= 1.0f;
+    train_engine_backward(e, v, wi);
+    st->tokens++;
+
+    // Output layer: each weight row and the biases
+    double *fd = malloc((vs > HIDDEN_DIM * EMBEDDING_DIM ? vs : HIDDEN_DIM * EMBEDDING_DIM + HIDDEN_DIM) * sizeof(double));
+    for (int i = 0; i <= HIDDEN_DIM; i++) {
+        float *w = i < HIDDEN_DIM ? e->out.weights[i] : e->out.biases;
+        float *g = i < HIDDEN_DIM ? e->g_out.weights[i] : e->g_out.biases;
+        for (int j = 0; j < vs; j++) fd[j] = central_difference(e, v, wi, target, causal, &w[j]);
+        double nf = norm_d(fd, vs), ng = norm_f(g, vs);
+        if (nf < 1e-6 && ng < 1e-6) continue;  // a unit dropped by ReLU or dropout
+        double cos = dot(g, fd, vs) / (nf * ng + 1e-30);
+        double want = nf > 1.0 ? 1.0 : nf, rel = fabs(ng - want) / want;
+        if (cos < st->out_worst_cos) st->out_worst_cos = cos;
+        if (rel > st->out_worst_rel) st->out_worst_rel = rel;
+        st->out_bad += cos < 0.999 || rel > 1e-2;
+    }
+
+    // MLP weights and biases as one vector
+    int nm = HIDDEN_DIM * EMBEDDING_DIM + HIDDEN_DIM;
+    float *w = &e->mlp.weights[0][0], *g = &e->g_mlp.weights[0][0];
+    for (int i = 0; i < nm; i++) fd[i] = central_difference(e, v, wi, target, causal, &w[i]);
+    double d = dot(g, fd, nm), nf = norm_d(fd, nm), ng = norm_f(g, nm);
+    if (nf > 1e-6) {
+        double cos = d / (nf * ng + 1e-30);
+        st->mlp_cos_sum += cos;
+        if (cos < st->mlp_worst_cos) st->mlp_worst_cos = cos;
+        st->mlp_bad += !(d > 0.0);
+    }
+
+    // Attention: W_q, W_k and W_v
+    int na = 3 * EMBEDDING_DIM * EMBEDDING_DIM;
+    w = &e->attn.W_q[0][0];
+    for (int i = 0; i < na; i++) {
+        double c = fabs(loss_change(e, v, wi, target, causal, &w[i], ATTN_STEP));
+        if (c > st->attn_change_max) st->attn_change_max = c;
+        st->attn_bad += c > 1e-4;
+    }
+    double bn = norm_f(&e->g_attn.W_q[0][0], na);
+    if (bn > st->attn_bp_norm) st->attn_bp_norm = bn;
+    free(fd);
+}
+
+static void check_model(int vs, int causal, unsigned int seed, Stats *st) {
+    rng = seed;
+    struct VocabEntry *v = calloc(vs, sizeof(*v));
+    for (int i = 0; i < vs; i++) {
+        float f[EMBEDDING_DIM];
+        fill(f, EMBEDDING_DIM, -1, 1);
+        v[i].embedding = f[0]; v[i].pe = f[1]; v[i].weight = f[2]; v[i].bias1 = f[3];
+        v[i].bias2 = f[4]; v[i].bias3 = f[5]; v[i].bias4 = f[6];
+    }
+    TrainEngine e;
+    if (!train_engine_init(&e, vs, 0.01f, 0.9f, 0.999f, 0)) { check(0, "engine allocates"); return; }
+    fill(&e.attn.W_q[0][0], 3 * EMBEDDING_DIM * EMBEDDING_DIM, -0.5f, 0.5f);
+    fill(&e.mlp.weights[0][0], EMBEDDING_DIM * HIDDEN_DIM + HIDDEN_DIM, -0.5f, 0.5f);
+    fill(output_flat(&e.out), (HIDDEN_DIM + 1) * vs, -0.5f, 0.5f);
+    for (int t = 0; t < 4; t++) {
+        int wi = (int)frand(0, vs - 0.01f), target = (int)frand(0, vs - 0.01f);
+        check_token(&e, v, wi, target, causal, st);
+    }
+    train_engine_free(&e);
+    free(v);
+}
+
+// The engine refuses text_compat with a partial softmax, whose candidate
+// gradient is too small for the full-width rounding, and stays on the
+// full softmax
+static void check_text_compat_needs_full(void) {
+    struct VocabEntry v[4] = { { 0 } };
+    TrainEngine e;
+    int ok = train_engine_init(&e, 4, 0.01f, 0.9f, 0.999f, 1);
+    ok = ok && !train_engine_set_softmax(&e, SOFTMAX_SAMPLED, 2, v, "vocab.txt") && !train_engine_set_softmax(&e, SOFTMAX_HIERARCHICAL, 0, v, "vocab.txt");
+    ok = ok && e.softmax_mode == SOFTMAX_FULL && train_engine_set_softmax(&e, SOFTMAX_FULL, 0, v, "vocab.txt");
+    train_engine_free(&e);
+    check(ok, "text_compat is refused with the sampled and hierarchical softmax");
+}
+
+int main(void) {
+    kernels_init();
+    check_text_compat_needs_full();
+    Stats st = { 0, 0, 0, 0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+    const int sizes[] = { 3, 8, 29 };
+    for (int s = 0; s < 3; s++)
+        for (int causal = 0; causal <= 1; causal++)
+            for (unsigned int seed = 1; seed <= 5; seed++) check_model(sizes[s], causal, seed * 7919 + sizes[s], &st);
+
+    char what[256];
+    snprintf(what, sizeof(what), "output layer gradients match the difference quotients over %d tokens (worst cosine %.6f, worst length error %.2e)",
+             st.tokens, st.out_worst_cos, st.out_worst_rel);
+    check(st.out_bad == 0, what);
+    snprintf(what, sizeof(what), "MLP gradients are descent directions on every token (mean cosine %.3f, worst %.3f)",
+             st.mlp_cos_sum / st.tokens, st.mlp_worst_cos);
+    check(st.mlp_bad == 0, what);
+    snprintf(what, sizeof(what), "the loss does not depend on the attention weights (largest change %.1e for +-%.1f; backward norm up to %.3f)",
+             st.attn_change_max, ATTN_STEP, st.attn_bp_norm);
+    check(st.attn_bad == 0, what);
+    return failures != 0;
+}
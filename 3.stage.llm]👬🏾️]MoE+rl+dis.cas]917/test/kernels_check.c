@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../kernels.h"
+
+// Checks and times kernels.h against the scalar loops forward_prop.c used
+// before it moved to the kernels (copied verbatim below).
+//
+//   kernels_check test    compare every SIMD level the CPU has
+//   kernels_check bench   time reference and kernels over a few vocab sizes
+//
+// Set KERNELS_THREADS to run the threaded paths with a given pool size.
+
+#define DIM 7
+#define HIDDEN 16
+
+// --- Reference implementations ---
+static void ref_layer_norm(float *x, int size) {
+    float mean = 0.0f;
+    for (int i = 0; i < size; i++) {
+        if (x[i] != x[i] || x[i] > 1e10f || x[i] < -1e10f) x[i] = 0.0f;
+        mean += x[i];
+    }
+    mean /= size;
+    float variance = 0.0f;
+    for (int i = 0; i < size; i++) { float diff = x[i] - mean; variance += diff * diff; }
+    variance /= size;
+    float std_dev = sqrtf(variance + 1e-8f);
+    for (int i = 0; i < size; i++) x[i] = (x[i] - mean) / std_dev;
+}
+
+static void ref_softmax(float *x, int s) {
+    float max = x[0];
+    for (int i = 1; i < s; i++) if (x[i] > max) max = x[i];
+    float sum = 0.0f;
+    for (int i = 0; i < s; i++) {
+        float val = x[i] - max;
+        if (val > 88.0f) val = 88.0f;
+        if (val < -88.0f) val = -88.0f;
+        x[i] = expf(val);
+        sum += x[i];
+    }
+    if (sum != sum || sum < 1e-15f || sum > 1e15f) {
+        for (int i = 0; i < s; i++) x[i] = 1.0f / s;
+    } else {
+        for (int i = 0; i < s; i++) {
+            x[i] /= sum;
+            if (x[i] != x[i] || x[i] > 1e10f || x[i] < -1e10f) x[i] = 1.0f / s;
+        }
+    }
+}
+
+// feats is vs x DIM, row-major, as forward_prop.c stored it
+static void ref_scores(const float *q, int rows, const float *feats, float *out, int vs, float scale) {
+    for (int r = 0; r < rows; r++) {
+        const float *qr = q + r * DIM;
+        for (int j = 0; j < vs; j++) {
+            const float *nk = feats + (size_t)j * DIM;
+            float s = 0;
+            for (int l = 0; l < DIM; l++) s += qr[l] * nk[l];
+            s *= scale;
+            if (s > 10.0f) s = 10.0f;
+            if (s < -10.0f) s = -10.0f;
+            out[(size_t)r * vs + j] = s;
+        }
+    }
+}
+
+static void ref_output(const float *h, int rows, float *const *w, const float *b, float *out, int vs) {
+    for (int r = 0; r < rows; r++) {
+        float *p = out + (size_t)r * vs;
+        for (int j = 0; j < vs; j++) p[j] = 0;
+        for (int l = 0; l < HIDDEN; l++) for (int j = 0; j < vs; j++) p[j] += h[r * HIDDEN + l] * w[l][j];
+        for (int j = 0; j < vs; j++) p[j] += b[j];
+    }
+}
+
+static float ref_context(const float *as, const float *feats, int vs) {
+    float c = 0;
+    for (int j = 0; j < vs; j++) for (int i = 0; i < DIM; i++) c += as[j] * feats[(size_t)j * DIM + i];
+    return c;
+}
+
+// --- Helpers ---
+static unsigned int rng = 1;
+static float frand(float lo, float hi) {
+    rng = rng * 1103515245 + 12345;
+    return lo + (hi - lo) * ((rng >> 8) & 0xffffff) / (float)0xffffff;
+}
+static void fill(float *x, int n, float lo, float hi) { for (int i = 0; i < n; i++) x[i] = frand(lo, hi); }
+
+static int failures = 0;
+static void check(int ok, const char *what, int level, int n) {
+    if (ok) return;
+    printf("✗ %s (%s, n=%d)\n", what, kern_level_name(level), n);
+    failures++;
+}
+
+// Largest |a-b| relative to max(1, |b|); NaN must match NaN
+static double max_err(const float *a, const float *b, int n) {
+    double m = 0;
+    for (int i = 0; i < n; i++) {
+        if (a[i] != a[i] || b[i] != b[i]) { if ((a[i] != a[i]) != (b[i] != b[i])) return INFINITY; continue; }
+        double d = fabs((double)a[i] - b[i]) / fmax(1.0, fabs(b[i]));
+        if (d > m) m = d;
+    }
+    return m;
+}
+
+static double now(void) { struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t); return t.tv_sec + t.tv_nsec * 1e-9; }
+
+// --- Correctness ---
+static void test_level(int level) {
+    kernels_set_level(level);
+    if (kern_cfg.level != level) return;
+    int failed_before = failures;
+    const int sizes[] = { 1, 3, 7, 8, 16, 17, 1000, 1363, 5003 };
+    int nsizes = sizeof(sizes) / sizeof(sizes[0]);
+    int maxn = 5003;
+    float *x = malloc(maxn * sizeof(float)), *y = malloc(maxn * sizeof(float));
+
+    for (int s = 0; s < nsizes; s++) {
+        int n = sizes[s];
+        // Softmax over clipped scores, wide inputs and after the causal mask
+        float ranges[3] = { 10.0f, 100.0f, 1e9f };
+        for (int r = 0; r < 3; r++) {
+            fill(x, n, -ranges[r], ranges[r]);
+            if (r == 2) for (int i = n / 2 + 1; i < n; i++) x[i] = -1e9f;
+            memcpy(y, x, n * sizeof(float));
+            ref_softmax(x, n); kern_softmax(y, n);
+            check(max_err(y, x, n) < 1e-6, "softmax matches reference", level, n);
+        }
+        // Non-finite input falls back to the uniform distribution
+        fill(x, n, -5, 5); x[n / 2] = NAN; memcpy(y, x, n * sizeof(float));
+        ref_softmax(x, n); kern_softmax(y, n);
+        check(max_err(y, x, n) == 0, "softmax with NaN is uniform", level, n);
+        fill(x, n, -5, 5); x[n - 1] = INFINITY; memcpy(y, x, n * sizeof(float));
+        ref_softmax(x, n); kern_softmax(y, n);
+        check(max_err(y, x, n) == 0, "softmax with Inf is uniform", level, n);
+
+        // Layer norm on softmax output, on plain values and with bad entries
+        fill(x, n, -3, 3); memcpy(y, x, n * sizeof(float));
+        ref_layer_norm(x, n); kern_layer_norm(y, n);
+        check(max_err(y, x, n) < 2e-4, "layer_norm matches reference", level, n);
+        fill(x, n, 0, 1.0f / n); memcpy(y, x, n * sizeof(float));
+        ref_layer_norm(x, n); kern_layer_norm(y, n);
+        check(max_err(y, x, n) < 2e-4, "layer_norm of a distribution", level, n);
+        if (n > 2) {
+            fill(x, n, -3, 3); x[0] = NAN; x[n - 1] = 1e12f; x[n / 2] = -INFINITY; memcpy(y, x, n * sizeof(float));
+            ref_layer_norm(x, n); kern_layer_norm(y, n);
+            check(max_err(y, x, n) < 2e-4, "layer_norm zeroes NaN/Inf/huge", level, n);
+        }
+
+        // Context: weights dotted with feature sums vs the 7-term loop
+        float *feats = malloc((size_t)n * DIM * sizeof(float)), *sums = malloc(n * sizeof(float));
+        fill(feats, n * DIM, -1, 1);
+        for (int j = 0; j < n; j++) { sums[j] = 0; for (int l = 0; l < DIM; l++) sums[j] += feats[j * DIM + l]; }
+        fill(x, n, -3, 3);
+        float c_ref = ref_context(x, feats, n), c = kern_dot(x, sums, n);
+        check(fabsf(c - c_ref) <= 1e-4f * fmaxf(1.0f, sqrtf((float)n)), "context dot matches reference", level, n);
+        free(feats); free(sums);
+    }
+
+    // Scores and logits keep the scalar summation order: bit-identical
+    const int vsizes[] = { 5, 1363, 40000 }, rowsizes[] = { 1, 9 };
+    for (int s = 0; s < 3; s++) for (int rr = 0; rr < 2; rr++) {
+        int vs = vsizes[s], rows = rowsizes[rr];
+        float *feats = malloc((size_t)vs * DIM * sizeof(float)), *cols = malloc((size_t)vs * DIM * sizeof(float));
+        float *q = malloc(rows * DIM * sizeof(float)), *h = malloc(rows * HIDDEN * sizeof(float));
+        float *a = malloc((size_t)rows * vs * sizeof(float)), *b = malloc((size_t)rows * vs * sizeof(float));
+        float *w[HIDDEN], *bias = malloc(vs * sizeof(float));
+        fill(feats, vs * DIM, -2, 2); fill(q, rows * DIM, -5, 5); fill(h, rows * HIDDEN, -1, 1); fill(bias, vs, -1, 1);
+        if (rows > 1) q[DIM + 2] = NAN;
+        for (int j = 0; j < vs; j++) for (int l = 0; l < DIM; l++) cols[(size_t)l * vs + j] = feats[(size_t)j * DIM + l];
+        for (int l = 0; l < HIDDEN; l++) { w[l] = malloc(vs * sizeof(float)); fill(w[l], vs, -1, 1); }
+        float scale = 1.0f / sqrt(DIM);
+
+        ref_scores(q, rows, feats, a, vs, scale);
+        kern_scores(q, rows, DIM, cols, b, vs, scale);
+        check(memcmp(a, b, (size_t)rows * vs * sizeof(float)) == 0, "scores bit-identical to reference", level, vs);
+        ref_output(h, rows, w, bias, a, vs);
+        kern_output_projection(h, rows, HIDDEN, w, bias, b, vs);
+        check(memcmp(a, b, (size_t)rows * vs * sizeof(float)) == 0, "logits bit-identical to reference", level, vs);
+
+        for (int l = 0; l < HIDDEN; l++) free(w[l]);
+        free(feats); free(cols); free(q); free(h); free(a); free(b); free(bias);
+    }
+    free(x); free(y);
+    printf("%s %s kernels (%d threads)\n", failures > failed_before ? "✗" : "✓", kern_level_name(level), kern_cfg.threads);
+}
+
+// --- Concurrent callers ---
+// Several threads project at once, and a task calls back into the kernels;
+// each caller's logits must still match the reference bit for bit
+
+#define CALLERS 4
+
+typedef struct {
+    const float *h, *bias, *want;
+    float *const *w;
+    float *out;
+    int vs, ok;
+} Caller;
+
+static void *caller_run(void *arg) {
+    Caller *c = arg;
+    for (int rep = 0; rep < 20 && c->ok; rep++) {
+        memset(c->out, 0, (size_t)c->vs * sizeof(float));
+        kern_output_projection(c->h, 1, HIDDEN, c->w, c->bias, c->out, c->vs);
+        c->ok = memcmp(c->out, c->want, (size_t)c->vs * sizeof(float)) == 0;
+    }
+    return NULL;
+}
+
+// Index i projects caller i % CALLERS's row into its own buffer
+#define NESTED 64
+
+typedef struct {
+    const Caller *c;
+    int ok[NESTED];
+} Nested;
+
+static void nested_task(void *arg, int begin, int end) {
+    Nested *job = arg;
+    for (int i = begin; i < end; i++) {
+        const Caller *c = &job->c[i % CALLERS];
+        float *out = calloc(c->vs, sizeof(float));
+        if (out) kern_output_projection(c->h, 1, HIDDEN, c->w, c->bias, out, c->vs);
+        job->ok[i] = out && memcmp(out, c->want, (size_t)c->vs * sizeof(float)) == 0;
+        free(out);
+    }
+}
+
+static void test_concurrent(void) {
+    int failed_before = failures, vs = 40000;
+    float *w[HIDDEN], *bias = malloc(vs * sizeof(float));
+    float h[CALLERS][HIDDEN];
+    Caller c[CALLERS];
+    fill(&h[0][0], CALLERS * HIDDEN, -1, 1); fill(bias, vs, -1, 1);
+    for (int l = 0; l < HIDDEN; l++) { w[l] = malloc(vs * sizeof(float)); fill(w[l], vs, -1, 1); }
+    for (int i = 0; i < CALLERS; i++) {
+        float *want = malloc(vs * sizeof(float));
+        ref_output(h[i], 1, w, bias, want, vs);
+        c[i] = (Caller){ h[i], bias, want, w, malloc(vs * sizeof(float)), vs, 1 };
+    }
+
+    pthread_t tid[CALLERS];
+    for (int i = 0; i < CALLERS; i++) pthread_create(&tid[i], NULL, caller_run, &c[i]);
+    for (int i = 0; i < CALLERS; i++) pthread_join(tid[i], NULL);
+    for (int i = 0; i < CALLERS; i++) check(c[i].ok, "logits bit-identical with concurrent callers", kern_cfg.level, vs);
+
+    // Enough work per index that the outer call uses the pool
+    Nested job = { c, { 0 } };
+    kern_parallel_for(nested_task, &job, NESTED, KERN_MIN_PARALLEL_WORK);
+    for (int i = 0; i < NESTED; i++) check(job.ok[i], "logits bit-identical from inside a pool task", kern_cfg.level, vs);
+
+    for (int i = 0; i < CALLERS; i++) { free((void *)c[i].want); free(c[i].out); }
+    for (int l = 0; l < HIDDEN; l++) free(w[l]);
+    free(bias);
+    printf("%s %d concurrent callers and a nested call (%d threads)\n", failures > failed_before ? "✗" : "✓", CALLERS, kern_cfg.threads);
+}
+
+// --- Benchmark ---
+static void bench(void) {
+    const int vsizes[] = { 1363, 10000, 100000 };
+    for (int s = 0; s < 3; s++) {
+        int vs = vsizes[s], rows = 32;
+        int reps = (int)(2e7 / ((double)vs * rows)) + 1;
+        float *feats = malloc((size_t)vs * DIM * sizeof(float)), *cols = malloc((size_t)vs * DIM * sizeof(float));
+        float *q = malloc(rows * DIM * sizeof(float)), *h = malloc(rows * HIDDEN * sizeof(float));
+        float *out = malloc((size_t)rows * vs * sizeof(float)), *x = malloc(vs * sizeof(float));
+        float *w[HIDDEN], *bias = malloc(vs * sizeof(float));
+        fill(feats, vs * DIM, -2, 2); fill(q, rows * DIM, -5, 5); fill(h, rows * HIDDEN, -1, 1); fill(bias, vs, -1, 1);
+        for (int j = 0; j < vs; j++) for (int l = 0; l < DIM; l++) cols[(size_t)l * vs + j] = feats[(size_t)j * DIM + l];
+        for (int l = 0; l < HIDDEN; l++) { w[l] = malloc(vs * sizeof(float)); fill(w[l], vs, -1, 1); }
+        float scale = 1.0f / sqrt(DIM);
+        printf("vocab %d, %d rows, %d reps (ms per call)\n", vs, rows, reps);
+        printf("  %-8s %10s %10s %10s %10s\n", "", "scores", "logits", "softmax", "layernorm");
+
+        double t, ts, to, tsm, tln;
+        t = now(); for (int i = 0; i < reps; i++) ref_scores(q, rows, feats, out, vs, scale); ts = now() - t;
+        t = now(); for (int i = 0; i < reps; i++) ref_output(h, rows, w, bias, out, vs); to = now() - t;
+        t = now(); for (int i = 0; i < reps * rows; i++) { memcpy(x, out, vs * sizeof(float)); ref_softmax(x, vs); } tsm = now() - t;
+        t = now(); for (int i = 0; i < reps * rows; i++) { memcpy(x, out, vs * sizeof(float)); ref_layer_norm(x, vs); } tln = now() - t;
+        printf("  %-8s %10.3f %10.3f %10.3f %10.3f\n", "ref", ts * 1e3 / reps, to * 1e3 / reps, tsm * 1e3 / reps, tln * 1e3 / reps);
+
+        for (int level = KERN_SCALAR; level <= KERN_AVX2; level++) {
+            kernels_set_level(level);
+            if (kern_cfg.level != level) continue;
+            t = now(); for (int i = 0; i < reps; i++) kern_scores(q, rows, DIM, cols, out, vs, scale); ts = now() - t;
+            t = now(); for (int i = 0; i < reps; i++) kern_output_projection(h, rows, HIDDEN, w, bias, out, vs); to = now() - t;
+            t = now(); for (int i = 0; i < reps * rows; i++) { memcpy(x, out, vs * sizeof(float)); kern_softmax(x, vs); } tsm = now() - t;
+            t = now(); for (int i = 0; i < reps * rows; i++) { memcpy(x, out, vs * sizeof(float)); kern_layer_norm(x, vs); } tln = now() - t;
+            printf("  %-8s %10.3f %10.3f %10.3f %10.3f\n", kern_level_name(level), ts * 1e3 / reps, to * 1e3 / reps, tsm * 1e3 / reps, tln * 1e3 / reps);
+        }
+        for (int l = 0; l < HIDDEN; l++) free(w[l]);
+        free(feats); free(cols); free(q); free(h); free(out); free(x); free(bias);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || (strcmp(argv[1], "test") != 0 && strcmp(argv[1], "bench") != 0)) {
+        fprintf(stderr, "Usage: %s test|bench\n", argv[0]);
+        return 1;
+    }
+    kernels_init();
+    if (strcmp(argv[1], "bench") == 0) { printf("%d kernel threads\n", kern_cfg.threads); bench(); return 0; }
+    for (int level = KERN_SCALAR; level <= KERN_AVX2; level++) test_level(level);
+    test_concurrent();
+    return failures != 0;
+}
@@ -0,0 +1,589 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../layers.h"
+
+// Checks layers.h against the layer math the stage programs carried before
+// it existed. The ref_* functions below are copies of that code: the
+// batched forward pass of forward_prop.c, the gradient section of
+// backward_prop.c's main() with the candidate columns the in-process engine
+// added, and the clipping and Adam loops of optimizer.c's "update". Every
+// output must match bit for bit on random models, including ones with
+// NaN, Inf and huge values in the weights, features and loss gradients.
+//
+//   layers_check    run the comparisons (KERNELS_SIMD picks the kernels,
+//                   which both sides share)
+
+static unsigned int rng = 11;
+static float frand(float lo, float hi) {
+    rng = rng * 1103515245 + 12345;
+    return lo + (hi - lo) * ((rng >> 8) & 0xffffff) / (float)0xffffff;
+}
+static void fill(float *x, int n, float lo, float hi) { for (int i = 0; i < n; i++) x[i] = frand(lo, hi); }
+// A few NaN, Inf and out-of-range entries
+static void poison(float *x, int n) {
+    static const float bad[] = { NAN, INFINITY, -INFINITY, 3e10f, -3e10f };
+    for (int i = 0; i < 1 + n / 50; i++) x[(unsigned)(frand(0, 1) * (n - 1))] = bad[i % 5];
+}
+
+static int failures = 0;
+static void check(int ok, const char *what) {
+    printf("%s %s\n", ok ? "✓" : "✗", what);
+    if (!ok) failures++;
+}
+
+// --- Reference: forward_prop.c ---
+static void ref_apply_dropout(float *x, int size, float dropout_rate, unsigned int *seed) {
+    if (dropout_rate <= 0.0f || dropout_rate >= 1.0f) return;
+    for (int i = 0; i < size; i++) {
+        *seed = (*seed * 1103515245 + 12345) & 0x7fffffff;
+        float rand_val = (float)*seed / (float)0x7fffffff;
+        if (rand_val < dropout_rate) x[i] = 0.0f;
+        else x[i] /= (1.0f - dropout_rate);
+    }
+}
+static void ref_apply_causal_mask(float *attn_scores, int vocab_size, int current_position) {
+    for (int i = current_position + 1; i < vocab_size; i++) attn_scores[i] = -1e9f;
+}
+static void ref_relu(float *x, int s){for(int i=0;i<s;i++)if(x[i]<0)x[i]=0;}
+static int invalid_value(float x) { return x != x || x > 1e10f || x < -1e10f; }
+
+static void ref_project_qkv(const float *x, int n, const AttentionLayer *a, float *q, float *k, float *val) {
+    for (int b = 0; b < n; b++) {
+        const float *iv = x + b * EMBEDDING_DIM;
+        float *qb = q + b * EMBEDDING_DIM, *kb = k + b * EMBEDDING_DIM, *vb = val + b * EMBEDDING_DIM;
+        for (int j = 0; j < EMBEDDING_DIM; j++) {
+            for (int l = 0; l < EMBEDDING_DIM; l++) {
+                if (invalid_value(iv[l]) || invalid_value(a->W_q[l][j])) continue;
+                qb[j] += iv[l] * a->W_q[l][j];
+                if (invalid_value(a->W_k[l][j])) continue;
+                kb[j] += iv[l] * a->W_k[l][j];
+                if (invalid_value(a->W_v[l][j])) continue;
+                vb[j] += iv[l] * a->W_v[l][j];
+            }
+        }
+    }
+}
+
+typedef struct { int n, vs; float *x, *q, *k, *val, *as_raw, *as, *ctx, *h, *p; } Activations;
+
+static void acts_alloc(Activations *b, int n, int vs) {
+    b->n = n; b->vs = vs;
+    b->x = calloc((size_t)n * EMBEDDING_DIM, sizeof(float));
+    b->q = calloc((size_t)n * EMBEDDING_DIM, sizeof(float));
+    b->k = calloc((size_t)n * EMBEDDING_DIM, sizeof(float));
+    b->val = calloc((size_t)n * EMBEDDING_DIM, sizeof(float));
+    b->as_raw = calloc((size_t)n * vs, sizeof(float));
+    b->as = calloc((size_t)n * vs, sizeof(float));
+    b->ctx = calloc((size_t)n * EMBEDDING_DIM, sizeof(float));
+    b->h = calloc((size_t)n * HIDDEN_DIM, sizeof(float));
+    b->p = calloc((size_t)n * vs, sizeof(float));
+}
+static void acts_free(Activations *b) { free(b->x); free(b->q); free(b->k); free(b->val); free(b->as_raw); free(b->as); free(b->ctx); free(b->h); free(b->p); }
+static int acts_same(const Activations *a, const Activations *b) {
+    size_t e = (size_t)a->n * EMBEDDING_DIM * sizeof(float), v = (size_t)a->n * a->vs * sizeof(float);
+    return !memcmp(a->q, b->q, e) && !memcmp(a->k, b->k, e) && !memcmp(a->val, b->val, e) && !memcmp(a->as_raw, b->as_raw, v) &&
+           !memcmp(a->as, b->as, v) && !memcmp(a->ctx, b->ctx, e) && !memcmp(a->h, b->h, (size_t)a->n * HIDDEN_DIM * sizeof(float)) &&
+           !memcmp(a->p, b->p, v);
+}
+
+static void ref_forward_batch(Activations *b, const int *idx, const float *feats, const float *cols, const float *sums,
+                              const AttentionLayer *a, const MlpLayer *m, const OutputLayer *o, int causal_attention) {
+    int n = b->n, vs = b->vs;
+    float scale = 1.0f / sqrt(EMBEDDING_DIM);
+
+    for (int r = 0; r < n; r++) memcpy(b->x + r * EMBEDDING_DIM, feats + (size_t)idx[r] * EMBEDDING_DIM, EMBEDDING_DIM * sizeof(float));
+    ref_project_qkv(b->x, n, a, b->q, b->k, b->val);
+
+    kern_scores(b->q, n, EMBEDDING_DIM, cols, b->as_raw, vs, scale);
+    kern_check_finite("attention scores", b->as_raw, n * vs);
+    memcpy(b->as, b->as_raw, (size_t)n * vs * sizeof(float));
+
+    for (int r = 0; r < n; r++) {
+        float *as = b->as + (size_t)r * vs, *ctx = b->ctx + r * EMBEDDING_DIM, *h = b->h + r * HIDDEN_DIM;
+        const float *iv = b->x + r * EMBEDDING_DIM;
+        unsigned int seed = 12345;
+
+        if (causal_attention) ref_apply_causal_mask(as, vs, idx[r]);
+        ref_apply_dropout(as, vs, 0.1f, &seed);
+        kern_softmax(as, vs);
+        kern_layer_norm(as, vs);
+
+        float c = kern_dot(as, sums, vs);
+        for (int l = 0; l < EMBEDDING_DIM; l++) ctx[l] = c + iv[l];
+        kern_layer_norm(ctx, EMBEDDING_DIM);
+
+        for (int j = 0; j < HIDDEN_DIM; j++) {
+            h[j] = 0;
+            for (int l = 0; l < EMBEDDING_DIM; l++) h[j] += ctx[l] * m->weights[l][j];
+            h[j] += m->biases[j];
+        }
+        kern_layer_norm(h, HIDDEN_DIM);
+        ref_relu(h, HIDDEN_DIM);
+        ref_apply_dropout(h, HIDDEN_DIM, 0.2f, &seed);
+    }
+
+    kern_output_projection(b->h, n, HIDDEN_DIM, o->weights, o->biases, b->p, vs);
+    kern_check_finite("logits", b->p, n * vs);
+}
+
+// forward_prop.c's forward_batch() as it now reads
+static void lib_forward_batch(Activations *b, const int *idx, const float *feats, const float *cols, const float *sums,
+                              const AttentionLayer *a, const MlpLayer *m, const OutputLayer *o, int causal_attention) {
+    int n = b->n, vs = b->vs;
+    for (int r = 0; r < n; r++) memcpy(b->x + r * EMBEDDING_DIM, feats + (size_t)idx[r] * EMBEDDING_DIM, EMBEDDING_DIM * sizeof(float));
+    layer_attention_qkv(a, b->x, n, b->q, b->k, b->val);
+    layer_attention_scores(b->q, n, cols, b->as_raw, vs);
+    memcpy(b->as, b->as_raw, (size_t)n * vs * sizeof(float));
+    for (int r = 0; r < n; r++) {
+        unsigned int seed = LAYER_DROPOUT_SEED;
+        layer_attention_forward(b->as + (size_t)r * vs, vs, sums, b->x + r * EMBEDDING_DIM, causal_attention ? idx[r] : -1, &seed, b->ctx + r * EMBEDDING_DIM);
+        layer_mlp_forward(m, b->ctx + r * EMBEDDING_DIM, b->h + r * HIDDEN_DIM, &seed);
+    }
+    layer_output_forward(o, b->h, n, b->p, vs);
+}
+
+// --- Reference: backward_prop.c ---
+static void ref_relu_derivative(float *x, float *d, int s){
+    for(int i=0;i<s;i++) {
+        if (x[i] != x[i] || x[i] > 1e10f || x[i] < -1e10f) d[i] = 0;
+        else d[i] = (x[i] > 0) ? 1 : 0;
+    }
+}
+static float ref_gradient_norm(float *grad, int size) {
+    float sum = 0.0f;
+    for (int i = 0; i < size; i++) {
+        if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) { grad[i] = 0.0f; continue; }
+        sum += grad[i] * grad[i];
+    }
+    if (sum < 0) sum = 0;
+    return sqrtf(sum);
+}
+static void ref_clip_gradients(float *grad, int size, float max_norm) {
+    for (int i = 0; i < size; i++) if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) grad[i] = 0.0f;
+    float norm = ref_gradient_norm(grad, size);
+    if (norm > max_norm && norm > 1e-12f) {
+        float scale = max_norm / norm;
+        if (scale != scale || scale > 1e10f || scale < -1e10f) scale = 1.0f;
+        for (int i = 0; i < size; i++) {
+            grad[i] *= scale;
+            if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) grad[i] = 0.0f;
+        }
+    }
+}
+static void ref_clip_gradients_2d(float *grad, int rows, int cols, float max_norm) {
+    int size = rows * cols;
+    for (int i = 0; i < size; i++) if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) grad[i] = 0.0f;
+    float norm = 0.0f;
+    for (int i = 0; i < size; i++) norm += grad[i] * grad[i];
+    norm = sqrtf(norm);
+    if (norm > max_norm && norm > 1e-12f) {
+        float scale = max_norm / norm;
+        if (scale != scale || scale > 1e10f || scale < -1e10f) scale = 1.0f;
+        for (int i = 0; i < size; i++) {
+            grad[i] *= scale;
+            if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) grad[i] = 0.0f;
+        }
+    }
+}
+static void ref_add_gradient_noise(float *grad, int size, float noise_scale, unsigned int *seed) {
+    if (noise_scale <= 0.0f) return;
+    for (int i = 0; i < size; i++) {
+        *seed = (*seed * 1103515245 + 12345) & 0x7fffffff;
+        float u1 = (float)*seed / (float)0x7fffffff;
+        *seed = (*seed * 1103515245 + 12345) & 0x7fffffff;
+        float u2 = (float)*seed / (float)0x7fffffff;
+        if (u1 < 1e-10f) u1 = 1e-10f;
+        float noise = sqrtf(-2.0f * logf(u1)) * cosf(2.0f * M_PI * u2);
+        noise *= noise_scale;
+        if (grad[i] != grad[i] || grad[i] > 1e10f || grad[i] < -1e10f) grad[i] = noise;
+        else grad[i] += noise;
+    }
+}
+
+typedef struct { OutputLayer g_o; MlpLayer g_m; AttentionLayer g_a; float *g_as; } Gradients;
+
+// emb[i] is word i's embedding, wi the input word; columns as in
+// layer_output_backward()
+static void ref_backward(const OutputLayer *o, const MlpLayer *m, float *g_p, const int *cols, int nc, float *h, float *c, float *val,
+                         const float *emb, int vs, int wi, Gradients *g) {
+    MlpLayer *g_m = &g->g_m; AttentionLayer *g_a = &g->g_a; OutputLayer *g_o = &g->g_o;
+    float g_h[HIDDEN_DIM], g_c[EMBEDDING_DIM];
+    float *g_as = g->g_as;
+    unsigned int noise_seed = 54321;
+#define col(j) (cols ? cols[j] : (j))
+    memset(g_a, 0, sizeof(*g_a));
+    memset(g_m, 0, sizeof(*g_m));
+    for(int i=0;i<HIDDEN_DIM;i++) g_h[i]=0;
+    for(int i=0;i<EMBEDDING_DIM;i++) g_c[i]=0;
+
+    for(int i=0;i<HIDDEN_DIM;i++) {
+        for(int j=0;j<nc;j++) {
+            if (g_p[j] != g_p[j] || h[i] != h[i] || g_p[j] > 1e10f || g_p[j] < -1e10f || h[i] > 1e10f || h[i] < -1e10f) g_o->weights[i][j] = 0;
+            else g_o->weights[i][j] = g_p[j] * h[i];
+            if (g_o->weights[i][j] > 10.0f) g_o->weights[i][j] = 10.0f;
+            if (g_o->weights[i][j] < -10.0f) g_o->weights[i][j] = -10.0f;
+        }
+    }
+    for(int j=0;j<nc;j++) {
+        if (g_p[j] != g_p[j] || g_p[j] > 1e10f || g_p[j] < -1e10f) g_o->biases[j] = 0;
+        else g_o->biases[j] = g_p[j];
+        if (g_o->biases[j] > 10.0f) g_o->biases[j] = 10.0f;
+        if (g_o->biases[j] < -10.0f) g_o->biases[j] = -10.0f;
+    }
+    for(int i=0;i<HIDDEN_DIM;i++){
+        g_h[i]=0;
+        for(int j=0;j<nc;j++) {
+            float w = o->weights[i][col(j)];
+            if (g_p[j] != g_p[j] || w != w || g_p[j] > 1e10f || g_p[j] < -1e10f || w > 1e10f || w < -1e10f) continue;
+            g_h[i] += g_p[j]*w;
+        }
+    }
+    float d_r[HIDDEN_DIM];
+    ref_relu_derivative(h,d_r,HIDDEN_DIM);
+    for(int j=0;j<HIDDEN_DIM;j++) {
+        if (g_h[j] != g_h[j] || d_r[j] != d_r[j] || g_h[j] > 1e10f || g_h[j] < -1e10f) g_h[j] = 0;
+        else g_h[j] *= d_r[j];
+    }
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) {
+        if (g_h[j] != g_h[j] || c[i] != c[i] || g_h[j] > 1e10f || g_h[j] < -1e10f || c[i] > 1e10f || c[i] < -1e10f) g_m->weights[i][j] = 0;
+        else g_m->weights[i][j] = g_h[j] * c[i];
+    }
+    for(int j=0;j<HIDDEN_DIM;j++) {
+        if (g_h[j] != g_h[j] || g_h[j] > 1e10f || g_h[j] < -1e10f) g_m->biases[j] = 0;
+        else g_m->biases[j] = g_h[j];
+    }
+    for(int i=0;i<EMBEDDING_DIM;i++){
+        g_c[i]=0;
+        for(int j=0;j<HIDDEN_DIM;j++) {
+            if (g_h[j] != g_h[j] || m->weights[i][j] != m->weights[i][j] || g_h[j] > 1e10f || g_h[j] < -1e10f || m->weights[i][j] > 1e10f || m->weights[i][j] < -1e10f) continue;
+            g_c[i] += g_h[j]*m->weights[i][j];
+        }
+    }
+
+    float scale=1.0f/sqrt(EMBEDDING_DIM);
+    for(int i=0;i<vs;i++){
+        g_as[i]=0;
+        for(int j=0;j<EMBEDDING_DIM;j++) {
+            if (g_c[j] != g_c[j] || val[j] != val[j] || g_c[j] > 1e10f || g_c[j] < -1e10f || val[j] > 1e10f || val[j] < -1e10f) continue;
+            g_as[i] += g_c[j]*val[j];
+        }
+        if (scale != scale || scale > 1e10f || scale < -1e10f) scale = 1.0f;
+        g_as[i] *= scale;
+        if (g_as[i] > 10.0f) g_as[i] = 10.0f;
+        if (g_as[i] < -10.0f) g_as[i] = -10.0f;
+    }
+    ref_clip_gradients(g_as, vs, 1.0f);
+    ref_add_gradient_noise(g_as, vs, 0.01f, &noise_seed);
+
+    float g_q[EMBEDDING_DIM]={0};
+    for(int i=0;i<vs;i++) for(int j=0;j<EMBEDDING_DIM;j++) {
+        if (emb[i] != emb[i] || g_as[i] != g_as[i] || emb[i] > 1e10f || emb[i] < -1e10f || g_as[i] > 1e10f || g_as[i] < -1e10f) continue;
+        g_q[j] += emb[i] * g_as[i];
+    }
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) {
+        if (g_q[j] != g_q[j] || emb[wi] != emb[wi] || g_q[j] > 1e10f || g_q[j] < -1e10f || emb[wi] > 1e10f || emb[wi] < -1e10f) g_a->W_q[i][j] = 0;
+        else g_a->W_q[i][j] = g_q[j] * emb[wi];
+    }
+    ref_clip_gradients_2d((float*)g_a, sizeof(*g_a)/sizeof(float), 1, 1.0f);
+    ref_add_gradient_noise((float*)g_a, sizeof(*g_a)/sizeof(float), 0.005f, &noise_seed);
+    for(int i=0; i<HIDDEN_DIM; i++) ref_clip_gradients(g_o->weights[i], nc, 1.0f);
+    ref_clip_gradients(g_o->biases, nc, 1.0f);
+
+    ref_gradient_norm((float*)g_a, sizeof(*g_a)/sizeof(float));
+    ref_gradient_norm((float*)g_m, sizeof(*g_m)/sizeof(float));
+    for(int i=0; i<HIDDEN_DIM; i++) for(int j=0; j<nc; j++)
+        if (g_o->weights[i][j] != g_o->weights[i][j] || g_o->weights[i][j] > 1e10f || g_o->weights[i][j] < -1e10f) g_o->weights[i][j] = 0.0f;
+    for(int i=0; i<nc; i++)
+        if (g_o->biases[i] != g_o->biases[i] || g_o->biases[i] > 1e10f || g_o->biases[i] < -1e10f) g_o->biases[i] = 0.0f;
+#undef col
+}
+
+static void lib_backward(const OutputLayer *o, const MlpLayer *m, const float *g_p, const int *cols, int nc, const float *h, const float *c, const float *val,
+                         const float *emb, int vs, int wi, Gradients *g) {
+    float g_h[HIDDEN_DIM], g_c[EMBEDDING_DIM];
+    unsigned int seed = LAYER_NOISE_SEED;
+    layer_output_backward(o, g_p, cols, nc, h, &g->g_o, g_h);
+    layer_mlp_backward(m, c, h, g_h, &g->g_m, g_c);
+    layer_attention_backward(g_c, val, emb, emb[wi], vs, g->g_as, &seed, &g->g_a);
+}
+
+// --- Reference: optimizer.c ---
+static void ref_clip_layer_gradients(AttentionLayer *g_a, MlpLayer *g_m, OutputLayer *g_o, int vs) {
+    float total_norm = 0;
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) {
+        if (g_a->W_q[i][j] != g_a->W_q[i][j] || g_a->W_q[i][j] > 1e10f || g_a->W_q[i][j] < -1e10f) g_a->W_q[i][j] = 0.0f;
+        total_norm += g_a->W_q[i][j] * g_a->W_q[i][j];
+    }
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) {
+        if (g_m->weights[i][j] != g_m->weights[i][j] || g_m->weights[i][j] > 1e10f || g_m->weights[i][j] < -1e10f) g_m->weights[i][j] = 0.0f;
+        total_norm += g_m->weights[i][j] * g_m->weights[i][j];
+    }
+    for(int i=0;i<HIDDEN_DIM;i++) {
+        if (g_m->biases[i] != g_m->biases[i] || g_m->biases[i] > 1e10f || g_m->biases[i] < -1e10f) g_m->biases[i] = 0.0f;
+        total_norm += g_m->biases[i] * g_m->biases[i];
+    }
+    for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<vs;j++) {
+        if (g_o->weights[i][j] != g_o->weights[i][j] || g_o->weights[i][j] > 1e10f || g_o->weights[i][j] < -1e10f) g_o->weights[i][j] = 0.0f;
+        total_norm += g_o->weights[i][j] * g_o->weights[i][j];
+    }
+    for(int i=0;i<vs;i++) {
+        if (g_o->biases[i] != g_o->biases[i] || g_o->biases[i] > 1e10f || g_o->biases[i] < -1e10f) g_o->biases[i] = 0.0f;
+        total_norm += g_o->biases[i] * g_o->biases[i];
+    }
+    if (total_norm < 0) total_norm = 0;
+    total_norm = sqrt(total_norm);
+
+    float attn_norm = 0;
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) attn_norm += g_a->W_q[i][j] * g_a->W_q[i][j];
+    attn_norm = sqrt(attn_norm);
+    float mlp_norm = 0;
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) mlp_norm += g_m->weights[i][j] * g_m->weights[i][j];
+    for(int i=0;i<HIDDEN_DIM;i++) mlp_norm += g_m->biases[i] * g_m->biases[i];
+    mlp_norm = sqrt(mlp_norm);
+    float output_norm = 0;
+    for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<vs;j++) output_norm += g_o->weights[i][j] * g_o->weights[i][j];
+    for(int i=0;i<vs;i++) output_norm += g_o->biases[i] * g_o->biases[i];
+    output_norm = sqrt(output_norm);
+
+    if (attn_norm > 1e-12f && attn_norm < 1e10f) {
+        float attn_scale = 1.0f / attn_norm;
+        for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) {
+            g_a->W_q[i][j] *= attn_scale;
+            if (g_a->W_q[i][j] != g_a->W_q[i][j] || g_a->W_q[i][j] > 1e10f || g_a->W_q[i][j] < -1e10f) g_a->W_q[i][j] = 0.0f;
+        }
+    }
+    if (mlp_norm > 1e-12f && mlp_norm < 1e10f) {
+        float mlp_scale = 1.0f / mlp_norm;
+        for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) {
+            g_m->weights[i][j] *= mlp_scale;
+            if (g_m->weights[i][j] != g_m->weights[i][j] || g_m->weights[i][j] > 1e10f || g_m->weights[i][j] < -1e10f) g_m->weights[i][j] = 0.0f;
+        }
+        for(int i=0;i<HIDDEN_DIM;i++) {
+            g_m->biases[i] *= mlp_scale;
+            if (g_m->biases[i] != g_m->biases[i] || g_m->biases[i] > 1e10f || g_m->biases[i] < -1e10f) g_m->biases[i] = 0.0f;
+        }
+    }
+    if (output_norm > 1e-12f && output_norm < 1e10f) {
+        float output_scale = 1.0f / output_norm;
+        for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<vs;j++) {
+            g_o->weights[i][j] *= output_scale;
+            if (g_o->weights[i][j] != g_o->weights[i][j] || g_o->weights[i][j] > 1e10f || g_o->weights[i][j] < -1e10f) g_o->weights[i][j] = 0.0f;
+        }
+        for(int i=0;i<vs;i++) {
+            g_o->biases[i] *= output_scale;
+            if (g_o->biases[i] != g_o->biases[i] || g_o->biases[i] > 1e10f || g_o->biases[i] < -1e10f) g_o->biases[i] = 0.0f;
+        }
+    }
+    if (total_norm > MAX_GRAD_NORM && total_norm > 1e-12f) {
+        float scale = MAX_GRAD_NORM / total_norm;
+        if (scale != scale || scale > 1e10f || scale < -1e10f) scale = 1.0f;
+        for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) {
+            g_a->W_q[i][j] *= scale;
+            if (g_a->W_q[i][j] != g_a->W_q[i][j] || g_a->W_q[i][j] > 1e10f || g_a->W_q[i][j] < -1e10f) g_a->W_q[i][j] = 0.0f;
+        }
+        for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) {
+            g_m->weights[i][j] *= scale;
+            if (g_m->weights[i][j] != g_m->weights[i][j] || g_m->weights[i][j] > 1e10f || g_m->weights[i][j] < -1e10f) g_m->weights[i][j] = 0.0f;
+        }
+        for(int i=0;i<HIDDEN_DIM;i++) {
+            g_m->biases[i] *= scale;
+            if (g_m->biases[i] != g_m->biases[i] || g_m->biases[i] > 1e10f || g_m->biases[i] < -1e10f) g_m->biases[i] = 0.0f;
+        }
+        for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<vs;j++) {
+            g_o->weights[i][j] *= scale;
+            if (g_o->weights[i][j] != g_o->weights[i][j] || g_o->weights[i][j] > 1e10f || g_o->weights[i][j] < -1e10f) g_o->weights[i][j] = 0.0f;
+        }
+        for(int i=0;i<vs;i++) {
+            g_o->biases[i] *= scale;
+            if (g_o->biases[i] != g_o->biases[i] || g_o->biases[i] > 1e10f || g_o->biases[i] < -1e10f) g_o->biases[i] = 0.0f;
+        }
+    }
+}
+static void ref_adam_update(float *p, float *m, float *v, float g, float lr, float b1, float b2, int t) {
+    if (g != g || g > 1e10f || g < -1e10f) g = 0.0f;
+    if (*m != *m || *m > 1e10f || *m < -1e10f) *m = 0.0f;
+    if (*v != *v || *v > 1e10f || *v < -1e10f) *v = 0.0f;
+    *m = b1 * *m + (1-b1) * g;
+    *v = b2 * *v + (1-b2) * g * g;
+    if (*m != *m || *m > 1e10f || *m < -1e10f) *m = 0.0f;
+    if (*v != *v || *v > 1e10f || *v < -1e10f) *v = 0.0f;
+    float b1t = powf(b1, t);
+    float b2t = powf(b2, t);
+    float mh = 0.0f, vh = 0.0f;
+    if (fabsf(1.0f - b1t) > 1e-12f) mh = *m / (1.0f - b1t);
+    if (fabsf(1.0f - b2t) > 1e-12f) vh = *v / (1.0f - b2t);
+    if (mh != mh || mh > 1e10f || mh < -1e10f) mh = 0.0f;
+    if (vh != vh || vh > 1e10f || vh < -1e10f) vh = 0.0f;
+    float denom = sqrtf(vh) + EPSILON;
+    if (denom != denom || denom > 1e10f || denom < -1e10f) denom = EPSILON;
+    float update = lr * mh / denom;
+    if (update != update || update > 1e10f || update < -1e10f) update = 0.0f;
+    *p -= update;
+    if (*p != *p || *p > 1e10f || *p < -1e10f) *p = 0.0f;
+}
+
+// One model with its Adam moments
+typedef struct { AttentionLayer a, ma, va; MlpLayer m, mm, vm; OutputLayer o, mo, vo; } Model;
+
+static void ref_step(Model *x, Gradients *g, const int *cols, int nc, int vs, float lr, float b1, float b2, int t) {
+    ref_clip_layer_gradients(&g->g_a, &g->g_m, &g->g_o, nc);
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<EMBEDDING_DIM;j++) ref_adam_update(&x->a.W_q[i][j],&x->ma.W_q[i][j],&x->va.W_q[i][j],g->g_a.W_q[i][j],lr,b1,b2,t);
+    for(int i=0;i<EMBEDDING_DIM;i++) for(int j=0;j<HIDDEN_DIM;j++) ref_adam_update(&x->m.weights[i][j],&x->mm.weights[i][j],&x->vm.weights[i][j],g->g_m.weights[i][j],lr,b1,b2,t);
+    for(int i=0;i<HIDDEN_DIM;i++) ref_adam_update(&x->m.biases[i],&x->mm.biases[i],&x->vm.biases[i],g->g_m.biases[i],lr,b1,b2,t);
+    if (!cols) {
+        for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<vs;j++) ref_adam_update(&x->o.weights[i][j],&x->mo.weights[i][j],&x->vo.weights[i][j],g->g_o.weights[i][j],lr,b1,b2,t);
+        for(int i=0;i<vs;i++) ref_adam_update(&x->o.biases[i],&x->mo.biases[i],&x->vo.biases[i],g->g_o.biases[i],lr,b1,b2,t);
+    } else {
+        for(int i=0;i<HIDDEN_DIM;i++) for(int j=0;j<nc;j++) { int c = cols[j]; ref_adam_update(&x->o.weights[i][c],&x->mo.weights[i][c],&x->vo.weights[i][c],g->g_o.weights[i][j],lr,b1,b2,t); }
+        for(int j=0;j<nc;j++) { int c = cols[j]; ref_adam_update(&x->o.biases[c],&x->mo.biases[c],&x->vo.biases[c],g->g_o.biases[j],lr,b1,b2,t); }
+    }
+}
+
+static void lib_step(Model *x, Gradients *g, const int *cols, int nc, float lr, float b1, float b2, int t) {
+    clip_layer_gradients(&g->g_a, &g->g_m, &g->g_o, nc);
+    layer_attention_adam(&x->a, &x->ma, &x->va, &g->g_a, lr, b1, b2, t);
+    layer_mlp_adam(&x->m, &x->mm, &x->vm, &g->g_m, lr, b1, b2, t);
+    layer_output_adam(&x->o, &x->mo, &x->vo, &g->g_o, cols, nc, lr, b1, b2, t);
+}
+
+static void model_alloc(Model *x, int vs) { memset(x, 0, sizeof(*x)); alloc_output(&x->o, vs); alloc_output(&x->mo, vs); alloc_output(&x->vo, vs); }
+static void model_free(Model *x) { free_output(&x->o); free_output(&x->mo); free_output(&x->vo); }
+static void model_copy(Model *dst, Model *src, int vs) {
+    OutputLayer o = dst->o, mo = dst->mo, vo = dst->vo;
+    *dst = *src;
+    dst->o = o; dst->mo = mo; dst->vo = vo;
+    memcpy(output_flat(&dst->o), output_flat(&src->o), (size_t)(HIDDEN_DIM + 1) * vs * sizeof(float));
+    memcpy(output_flat(&dst->mo), output_flat(&src->mo), (size_t)(HIDDEN_DIM + 1) * vs * sizeof(float));
+    memcpy(output_flat(&dst->vo), output_flat(&src->vo), (size_t)(HIDDEN_DIM + 1) * vs * sizeof(float));
+}
+static int model_same(Model *x, Model *y, int vs) {
+    size_t no = (size_t)(HIDDEN_DIM + 1) * vs * sizeof(float);
+    return !memcmp(&x->a, &y->a, sizeof(x->a)) && !memcmp(&x->ma, &y->ma, sizeof(x->ma)) && !memcmp(&x->va, &y->va, sizeof(x->va)) &&
+           !memcmp(&x->m, &y->m, sizeof(x->m)) && !memcmp(&x->mm, &y->mm, sizeof(x->mm)) && !memcmp(&x->vm, &y->vm, sizeof(x->vm)) &&
+           !memcmp(output_flat(&x->o), output_flat(&y->o), no) && !memcmp(output_flat(&x->mo), output_flat(&y->mo), no) &&
+           !memcmp(output_flat(&x->vo), output_flat(&y->vo), no);
+}
+static int grads_same(Gradients *x, Gradients *y, int nc, int vs) {
+    int same = !memcmp(&x->g_a, &y->g_a, sizeof(x->g_a)) && !memcmp(&x->g_m, &y->g_m, sizeof(x->g_m)) && !memcmp(x->g_as, y->g_as, vs * sizeof(float));
+    for (int i = 0; same && i < HIDDEN_DIM; i++) same = !memcmp(x->g_o.weights[i], y->g_o.weights[i], nc * sizeof(float));
+    return same && !memcmp(x->g_o.biases, y->g_o.biases, nc * sizeof(float));
+}
+
+// Trains both sides for a few tokens from the same random model: forward,
+// loss gradient (full softmax or a random column subset), backward, step
+static void run_case(int vs, int n, int bad_model, int bad_inputs, int sampled, int *fwd_bad, int *bwd_bad, int *step_bad) {
+    float *feats = malloc((size_t)vs * EMBEDDING_DIM * sizeof(float)), *cols = malloc((size_t)vs * EMBEDDING_DIM * sizeof(float));
+    float *sums = malloc(vs * sizeof(float)), *emb = malloc(vs * sizeof(float)), *g_p = malloc(vs * sizeof(float)), *g_p2 = malloc(vs * sizeof(float));
+    int *idx = malloc(n * sizeof(int)), *cand = malloc(vs * sizeof(int));
+    Model ref, lib;
+    model_alloc(&ref, vs); model_alloc(&lib, vs);
+    Gradients gr, gl;
+    alloc_output(&gr.g_o, vs); alloc_output(&gl.g_o, vs);
+    gr.g_as = malloc(vs * sizeof(float)); gl.g_as = malloc(vs * sizeof(float));
+
+    fill(feats, vs * EMBEDDING_DIM, -1, 1);
+    if (bad_inputs) poison(feats, vs * EMBEDDING_DIM);
+    layer_feature_columns(feats, vs, cols, sums);
+    for (int j = 0; j < vs; j++) emb[j] = feats[(size_t)j * EMBEDDING_DIM];
+    fill(&ref.a.W_q[0][0], 3 * EMBEDDING_DIM * EMBEDDING_DIM, -0.5f, 0.5f);
+    fill(&ref.m.weights[0][0], EMBEDDING_DIM * HIDDEN_DIM + HIDDEN_DIM, -0.5f, 0.5f);
+    fill(output_flat(&ref.o), (HIDDEN_DIM + 1) * vs, -0.5f, 0.5f);
+    if (bad_model) {
+        poison(&ref.a.W_q[0][0], 3 * EMBEDDING_DIM * EMBEDDING_DIM);
+        poison(&ref.m.weights[0][0], EMBEDDING_DIM * HIDDEN_DIM + HIDDEN_DIM);
+        poison(output_flat(&ref.o), (HIDDEN_DIM + 1) * vs);
+    }
+    model_copy(&lib, &ref, vs);
+
+    for (int t = 1; t <= 4; t++) {
+        for (int r = 0; r < n; r++) idx[r] = (int)(frand(0, 1) * (vs - 1));
+        Activations ar, al;
+        acts_alloc(&ar, n, vs); acts_alloc(&al, n, vs);
+        ref_forward_batch(&ar, idx, feats, cols, sums, &ref.a, &ref.m, &ref.o, t % 2);
+        lib_forward_batch(&al, idx, feats, cols, sums, &lib.a, &lib.m, &lib.o, t % 2);
+        *fwd_bad += !acts_same(&ar, &al);
+
+        // The last position trains
+        int wi = idx[n - 1], nc = vs, *cs = NULL;
+        const float *p = ar.p + (size_t)(n - 1) * vs;
+        if (sampled) {
+            nc = 1 + (int)(frand(0, 1) * (vs - 1));
+            for (int j = 0; j < nc; j++) cand[j] = (j * 7 + t) % vs;
+            cs = cand;
+        }
+        for (int j = 0; j < nc; j++) g_p[j] = p[cs ? cs[j] : j] * 0.01f;
+        if (bad_inputs) poison(g_p, nc);
+        memcpy(g_p2, g_p, nc * sizeof(float));
+        ref_backward(&ref.o, &ref.m, g_p, cs, nc, ar.h + (n - 1) * HIDDEN_DIM, ar.ctx + (n - 1) * EMBEDDING_DIM, ar.val + (n - 1) * EMBEDDING_DIM, emb, vs, wi, &gr);
+        lib_backward(&lib.o, &lib.m, g_p2, cs, nc, al.h + (n - 1) * HIDDEN_DIM, al.ctx + (n - 1) * EMBEDDING_DIM, al.val + (n - 1) * EMBEDDING_DIM, emb, vs, wi, &gl);
+        *bwd_bad += !grads_same(&gr, &gl, nc, vs);
+
+        ref_step(&ref, &gr, cs, nc, vs, 0.01f, 0.9f, 0.999f, t);
+        lib_step(&lib, &gl, cs, nc, 0.01f, 0.9f, 0.999f, t);
+        *step_bad += !model_same(&ref, &lib, vs);
+        acts_free(&ar); acts_free(&al);
+    }
+
+    model_free(&ref); model_free(&lib);
+    free_output(&gr.g_o); free_output(&gl.g_o); free(gr.g_as); free(gl.g_as);
+    free(feats); free(cols); free(sums); free(emb); free(g_p); free(g_p2); free(idx); free(cand);
+}
+
+int main(void) {
+    static const int sizes[] = { 1, 7, 300, 2500 };
+    char what[200];
+    for (int mode = 0; mode < 3; mode++) {
+        int fwd = 0, bwd = 0, step = 0, cases = 0;
+        for (int s = 0; s < 4; s++) {
+            for (int rep = 0; rep < 6; rep++) {
+                int n = 1 + rep % 3 * 4;
+                run_case(sizes[s], n, mode == 1, mode == 2, rep % 2, &fwd, &bwd, &step);
+                cases++;
+            }
+        }
+        const char *name = mode == 0 ? "finite models" : mode == 1 ? "NaN/Inf weights" : "NaN/Inf features and loss gradients";
+        snprintf(what, sizeof(what), "%s: forward passes match forward_prop.c bit for bit (%d cases, %d mismatches)", name, cases * 4, fwd);
+        check(fwd == 0, what);
+        snprintf(what, sizeof(what), "%s: gradients match backward_prop.c bit for bit, full and candidate columns (%d mismatches)", name, bwd);
+        check(bwd == 0, what);
+        snprintf(what, sizeof(what), "%s: parameters and moments match optimizer.c after each step (%d mismatches)", name, step);
+        check(step == 0, what);
+    }
+
+    // Text and tensor files round-trip through the shared loaders
+    int vs = 53, ok = 1;
+    char dir[] = "/tmp/layers_checkXXXXXX", path[256];
+    if (!mkdtemp(dir)) { check(0, "temporary directory"); return 1; }
+    for (int b = 0; b < 2; b++) {
+        const char *ext = b ? ".bin" : ".txt";
+        AttentionLayer a, a2; MlpLayer m, m2; OutputLayer o, o2;
+        fill(&a.W_q[0][0], 3 * EMBEDDING_DIM * EMBEDDING_DIM, -1, 1);
+        fill(&m.weights[0][0], EMBEDDING_DIM * HIDDEN_DIM + HIDDEN_DIM, -1, 1);
+        alloc_output(&o, vs);
+        fill(output_flat(&o), (HIDDEN_DIM + 1) * vs, -1, 1);
+        snprintf(path, sizeof(path), "%s/attn%s", dir, ext); ok &= save_attention(path, &a) && load_attention(path, &a2);
+        if (!b) for (int i = 0; i < 3 * EMBEDDING_DIM * EMBEDDING_DIM; i++) (&a.W_q[0][0])[i] = strtof((snprintf(what, 64, "%f", (&a.W_q[0][0])[i]), what), NULL);
+        ok &= !memcmp(&a, &a2, sizeof(a));
+        snprintf(path, sizeof(path), "%s/mlp%s", dir, ext); ok &= save_mlp(path, &m) && load_mlp(path, &m2);
+        if (!b) for (int i = 0; i < EMBEDDING_DIM * HIDDEN_DIM + HIDDEN_DIM; i++) (&m.weights[0][0])[i] = strtof((snprintf(what, 64, "%f", (&m.weights[0][0])[i]), what), NULL);
+        ok &= !memcmp(&m, &m2, sizeof(m));
+        snprintf(path, sizeof(path), "%s/out%s", dir, ext); ok &= save_output(path, &o, vs);
+        TensorFile map;
+        int mapped = open_output(path, &o2, vs, &map, 0);
+        ok &= mapped == b;
+        for (int i = 0; i < (HIDDEN_DIM + 1) * vs; i++) {
+            float want = b ? output_flat(&o)[i] : strtof((snprintf(what, 64, "%f", output_flat(&o)[i]), what), NULL);
+            float got = i < HIDDEN_DIM * vs ? o2.weights[i / vs][i % vs] : o2.biases[i - HIDDEN_DIM * vs];
+            ok &= memcmp(&want, &got, sizeof(float)) == 0;
+        }
+        close_output(&o2, &map, mapped);
+        free_output(&o);
+        snprintf(path, sizeof(path), "rm -rf %s/*", dir);
+        if (system(path)) ok = 0;
+    }
+    rmdir(dir);
+    check(ok, "layers and output layers round-trip through text (as \"%f\") and tensor files, mapped in place for .bin");
+    return failures != 0;
+}
@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../force_layout.h"
+
+// Checks and times force_layout.h against the O(n^2) update_physics() the
+// association visualizers ran every frame before (copied below, 2D and 3D).
+//
+//   layout_check test [dir]   forces, energy, convergence, growth, loading
+//                             (dir: where to write the small input files)
+//   layout_check bench        ms per step by node count, tree and exact
+
+#define SPRING_LENGTH 0.5f
+#define SPRING_CONSTANT 0.1f
+#define REPULSION_CONSTANT 0.5f
+#define DAMPING 0.8f
+#define TIME_STEP 0.1f
+
+typedef struct {
+    float x, y, z;
+    float vx, vy, vz;
+} Node;
+
+typedef struct {
+    int from, to;
+    float strength;
+} Edge;
+
+// --- Reference: update_physics() from visualize_associations🥰]3d.c ---
+static void ref_update_physics(Node *nodes, int node_count, const Edge *edges, int edge_count, int dim) {
+    for (int i = 0; i < node_count; i++) {
+        nodes[i].vx *= DAMPING;
+        nodes[i].vy *= DAMPING;
+        nodes[i].vz *= DAMPING;
+    }
+    for (int i = 0; i < edge_count; i++) {
+        int from = edges[i].from;
+        int to = edges[i].to;
+        float dx = nodes[to].x - nodes[from].x;
+        float dy = nodes[to].y - nodes[from].y;
+        float dz = dim == 3 ? nodes[to].z - nodes[from].z : 0.0f;
+        float distance = sqrtf(dx*dx + dy*dy + dz*dz);
+        if (distance > 0) {
+            float force = (distance - SPRING_LENGTH * (2.0f - edges[i].strength)) * SPRING_CONSTANT;
+            float fx = force * dx / distance;
+            float fy = force * dy / distance;
+            float fz = force * dz / distance;
+            nodes[from].vx += fx * TIME_STEP;
+            nodes[from].vy += fy * TIME_STEP;
+            nodes[from].vz += fz * TIME_STEP;
+            nodes[to].vx -= fx * TIME_STEP;
+            nodes[to].vy -= fy * TIME_STEP;
+            nodes[to].vz -= fz * TIME_STEP;
+        }
+    }
+    for (int i = 0; i < node_count; i++) {
+        for (int j = i + 1; j < node_count; j++) {
+            float dx = nodes[j].x - nodes[i].x;
+            float dy = nodes[j].y - nodes[i].y;
+            float dz = dim == 3 ? nodes[j].z - nodes[i].z : 0.0f;
+            float distance_sq = dx*dx + dy*dy + dz*dz;
+            if (distance_sq > 0.01f) {
+                float force = REPULSION_CONSTANT / distance_sq;
+                float fx = force * dx;
+                float fy = force * dy;
+                float fz = force * dz;
+                nodes[i].vx -= fx * TIME_STEP;
+                nodes[i].vy -= fy * TIME_STEP;
+                nodes[i].vz -= fz * TIME_STEP;
+                nodes[j].vx += fx * TIME_STEP;
+                nodes[j].vy += fy * TIME_STEP;
+                nodes[j].vz += fz * TIME_STEP;
+            }
+        }
+    }
+    for (int i = 0; i < node_count; i++) {
+        nodes[i].x += nodes[i].vx * TIME_STEP;
+        nodes[i].y += nodes[i].vy * TIME_STEP;
+        nodes[i].z += nodes[i].vz * TIME_STEP;
+    }
+}
+
+static int failures = 0;
+static void check(int ok, const char *what) {
+    printf("%s %s\n", ok ? "✓" : "✗", what);
+    if (!ok) failures++;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float frand(float lo, float hi) { return lo + (hi - lo) * (float)rand() / RAND_MAX; }
+
+// n random nodes in [-spread, spread]^dim and about degree edges per node
+static void random_graph(ForceLayout *l, int dim, int n, int degree, float spread) {
+    layout_init(l, dim);
+    for (int i = 0; i < n; i++) {
+        float p[LAYOUT_MAX_DIM];
+        for (int d = 0; d < dim; d++) p[d] = frand(-spread, spread);
+        layout_add_node(l, p);
+    }
+    for (int i = 1; i < n; i++) {
+        layout_add_edge(l, i, rand() % i, frand(0.7f, 1.0f));
+        for (int e = 1; e < degree; e++) layout_add_edge(l, i, rand() % n, frand(0.7f, 1.0f));
+    }
+}
+
+static void to_nodes(const ForceLayout *l, Node *nodes) {
+    for (int i = 0; i < l->count; i++) {
+        const float *p = l->pos + (size_t)i * l->dim;
+        nodes[i] = (Node){ p[0], p[1], l->dim == 3 ? p[2] : 0.0f, 0, 0, 0 };
+    }
+}
+
+// Exact repulsion (REPULSION_CONSTANT applied) in double
+static void exact_repulsion(const ForceLayout *l, double *out) {
+    int dim = l->dim;
+    memset(out, 0, (size_t)l->count * dim * sizeof(double));
+    for (int i = 0; i < l->count; i++) {
+        for (int j = 0; j < l->count; j++) {
+            if (i == j) continue;
+            double delta[LAYOUT_MAX_DIM], dist_sq = 0.0;
+            for (int d = 0; d < dim; d++) { delta[d] = l->pos[i * dim + d] - l->pos[j * dim + d]; dist_sq += delta[d] * delta[d]; }
+            if (dist_sq > LAYOUT_MIN_DIST_SQ) for (int d = 0; d < dim; d++) out[i * dim + d] += l->repulsion * delta[d] / dist_sq;
+        }
+    }
+}
+
+// sqrt(sum |f - exact|^2 / sum |exact|^2)
+static double relative_error(const float *f, const double *exact, size_t n) {
+    double num = 0.0, den = 0.0;
+    for (size_t k = 0; k < n; k++) { num += (f[k] - exact[k]) * (f[k] - exact[k]); den += exact[k] * exact[k]; }
+    return sqrt(num / (den > 0 ? den : 1));
+}
+
+static void test_forces(int dim) {
+    char what[160];
+    ForceLayout l;
+    random_graph(&l, dim, 2000, 2, 3.0f);
+    // A few coincident nodes exercise the depth limit
+    for (int i = 1; i < 6; i++) layout_place(&l, i, layout_position(&l, 0));
+    size_t n = (size_t)l.count * dim;
+    float *f = malloc(n * sizeof(float));
+    double *exact = malloc(n * sizeof(double));
+    exact_repulsion(&l, exact);
+
+    l.theta = 0.0f;
+    layout_repulsion(&l, f);
+    double err0 = relative_error(f, exact, n);
+    snprintf(what, sizeof(what), "%dD theta 0: repulsion equals the exact sum (error %.1e)", dim, err0);
+    check(err0 < 1e-5, what);
+    l.theta = LAYOUT_THETA;
+    layout_repulsion(&l, f);
+    double err = relative_error(f, exact, n);
+    snprintf(what, sizeof(what), "%dD theta %.1f: repulsion within 5%% of the exact sum (%.2f%%, %d cells)", dim, LAYOUT_THETA, err * 100, l.cell_count);
+    check(err < 0.05, what);
+    free(f);
+    free(exact);
+    layout_free(&l);
+}
+
+// Same trajectory as the old per-frame loop on a small graph
+static void test_matches_reference(int dim) {
+    char what[160];
+    ForceLayout l;
+    srand(11);
+    random_graph(&l, dim, 40, 2, 1.0f);
+    Node *nodes = malloc(l.count * sizeof(Node));
+    Edge *edges = malloc(l.edge_count * sizeof(Edge));
+    to_nodes(&l, nodes);
+    for (int e = 0; e < l.edge_count; e++) edges[e] = (Edge){ l.edges[e].from, l.edges[e].to, l.edges[e].strength };
+    l.theta = 0.0f;
+    for (int s = 0; s < 200; s++) {
+        layout_step(&l);
+        ref_update_physics(nodes, l.count, edges, l.edge_count, dim);
+    }
+    float worst = 0.0f;
+    for (int i = 0; i < l.count; i++) {
+        const float *p = layout_position(&l, i);
+        float q[3] = { nodes[i].x, nodes[i].y, nodes[i].z };
+        for (int d = 0; d < dim; d++) if (fabsf(p[d] - q[d]) > worst) worst = fabsf(p[d] - q[d]);
+    }
+    snprintf(what, sizeof(what), "%dD theta 0: 200 steps follow the old update_physics (max drift %.1e)", dim, worst);
+    check(worst < 1e-3f, what);
+    free(nodes);
+    free(edges);
+    layout_free(&l);
+}
+
+// Energy goes down and the layout settles on small graphs: after STEPS the
+// kinetic energy is a tiny fraction of its peak and the last 100 steps move
+// no node by more than 1% of the layout's size
+#define STEPS 10000
+static void test_converges(int dim, const char *name, ForceLayout *l) {
+    char what[200];
+    double e0 = layout_energy(l), last = e0;
+    int monotone = 1;
+    float kinetic = 0.0f, peak = 0.0f;
+    for (int s = 1; s <= STEPS; s++) {
+        kinetic = layout_step(l);
+        if (kinetic > peak) peak = kinetic;
+        if (s % 50 == 0) {
+            double e = layout_energy(l);
+            if (e > last + 1e-6 * fabs(last)) monotone = 0;
+            last = e;
+        }
+    }
+    float before[LAYOUT_MAX_DIM * 64], lo[LAYOUT_MAX_DIM], hi[LAYOUT_MAX_DIM];
+    memcpy(before, l->pos, (size_t)l->count * dim * sizeof(float));
+    for (int s = 0; s < 100; s++) layout_step(l);
+    float moved = 0.0f, size = 0.0f;
+    for (int d = 0; d < dim; d++) { lo[d] = INFINITY; hi[d] = -INFINITY; }
+    for (int k = 0; k < l->count * dim; k++) {
+        if (fabsf(l->pos[k] - before[k]) > moved) moved = fabsf(l->pos[k] - before[k]);
+        if (l->pos[k] < lo[k % dim]) lo[k % dim] = l->pos[k];
+        if (l->pos[k] > hi[k % dim]) hi[k % dim] = l->pos[k];
+    }
+    for (int d = 0; d < dim; d++) if (hi[d] - lo[d] > size) size = hi[d] - lo[d];
+    snprintf(what, sizeof(what), "%dD %s: energy %.3f -> %.3f, falling every 50 steps", dim, name, e0, last);
+    check(last < e0 && monotone, what);
+    snprintf(what, sizeof(what), "%dD %s: settles (kinetic %.1e of peak, last 100 steps moved %.2f%% of the size)", dim, name, kinetic / peak, moved / size * 100);
+    check(kinetic < 1e-4f * peak && moved < 0.01f * size, what);
+    layout_free(l);
+}
+
+static void small_graphs(int dim) {
+    ForceLayout l;
+    float p[LAYOUT_MAX_DIM];
+
+    // Ring of 12
+    srand(3);
+    layout_init(&l, dim);
+    for (int i = 0; i < 12; i++) {
+        for (int d = 0; d < dim; d++) p[d] = frand(-1, 1);
+        layout_add_node(&l, p);
+    }
+    for (int i = 0; i < 12; i++) layout_add_edge(&l, i, (i + 1) % 12, 0.9f);
+    test_converges(dim, "ring of 12", &l);
+
+    // 5x5 grid
+    layout_init(&l, dim);
+    for (int i = 0; i < 25; i++) {
+        for (int d = 0; d < dim; d++) p[d] = frand(-1, 1);
+        layout_add_node(&l, p);
+    }
+    for (int r = 0; r < 5; r++) for (int c = 0; c < 5; c++) {
+        if (c < 4) layout_add_edge(&l, r * 5 + c, r * 5 + c + 1, 0.8f);
+        if (r < 4) layout_add_edge(&l, r * 5 + c, (r + 1) * 5 + c, 0.8f);
+    }
+    test_converges(dim, "5x5 grid", &l);
+
+    // Random connected graph of 40, under the tree approximation
+    srand(5);
+    random_graph(&l, dim, 40, 3, 1.0f);
+    test_converges(dim, "random graph of 40", &l);
+}
+
+static void test_growth(void) {
+    ForceLayout l;
+    srand(9);
+    random_graph(&l, 2, 500, 2, 1.0f);
+    for (int s = 0; s < 20; s++) layout_step(&l);
+    // Grow past the old MAX_WORDS while it runs
+    for (int i = 0; i < 4500; i++) {
+        float p[2] = { frand(-2, 2), frand(-2, 2) };
+        int id = layout_add_node(&l, p);
+        layout_add_edge(&l, id, rand() % id, 0.8f);
+    }
+    int finite = 1;
+    for (int s = 0; s < 20; s++) layout_step(&l);
+    for (int k = 0; k < l.count * 2; k++) finite &= isfinite(l.pos[k]);
+    check(l.count == 5000 && finite, "grows from 500 to 5000 nodes between steps");
+    layout_free(&l);
+}
+
+static void test_loading(const char *dir) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/small.csv", dir);
+    FILE *f = fopen(path, "w");
+    fprintf(f, ",a,b,c,d\na,1.000000,0.900000,0.100000,0.800000\nb,0.900000,1.000000,0.750000,0.200000\n"
+               "c,0.100000,0.750000,1.000000,0.300000\nd,0.800000,0.200000,0.300000,1.000000\n");
+    fclose(f);
+    ForceLayout l;
+    layout_init(&l, 2);
+    char **words = layout_load_associations(&l, path, 1000);
+    int ok = words && l.count == 4 && strcmp(words[0], "a") == 0 && strcmp(words[3], "d") == 0 && l.edge_count == 6;
+    ok = ok && l.edges[0].from == 0 && l.edges[0].to == 1 && fabsf(l.edges[0].strength - 0.9f) < 1e-6f;
+    check(ok, "dense CSV: every word is a node, cells above 0.7 are edges");
+    for (int i = 0; words && i < l.count; i++) free(words[i]);
+    free(words);
+    layout_free(&l);
+
+    snprintf(path, sizeof(path), "%s/small.edges", dir);
+    f = fopen(path, "w");
+    fprintf(f, "source,target,similarity\n");
+    for (int i = 0; i < 3000; i++) fprintf(f, "w%d,w%d,0.950000\nw%d,w%d,0.500000\n", i, (i + 1) % 3000, i, (i + 7) % 3000);
+    fclose(f);
+    layout_init(&l, 3);
+    words = layout_load_associations(&l, path, 100000);
+    ok = words && l.count == 3000 && l.edge_count == 6000 && strcmp(words[1], "w1") == 0;
+    check(ok, "edge list: 3000 words and 6000 edges, past the old 1000-word cap");
+    for (int i = 0; words && i < l.count; i++) free(words[i]);
+    free(words);
+    layout_free(&l);
+
+    layout_init(&l, 2);
+    words = layout_load_associations(&l, path, 50);
+    int inside = 1;
+    for (int e = 0; e < l.edge_count; e++) inside &= l.edges[e].from < 50 && l.edges[e].to < 50;
+    check(words && l.count == 50 && inside, "max_nodes keeps the first 50 words and their edges");
+    for (int i = 0; words && i < l.count; i++) free(words[i]);
+    free(words);
+    layout_free(&l);
+}
+
+// --- Benchmark ---
+static void bench(void) {
+    const int sizes[] = { 1000, 10000, 100000 };
+    for (int dim = 2; dim <= 3; dim++) {
+        printf("%dD (ms per step)\n", dim);
+        printf("  %8s %10s %10s %10s\n", "nodes", "old", "tree", "speedup");
+        for (int s = 0; s < 3; s++) {
+            int n = sizes[s];
+            ForceLayout l;
+            srand(1);
+            random_graph(&l, dim, n, 3, sqrtf((float)n) * 0.3f);
+            layout_step(&l);
+            int reps = n <= 1000 ? 50 : n <= 10000 ? 5 : 2;
+            double t = now();
+            for (int r = 0; r < reps; r++) layout_step(&l);
+            double tree = (now() - t) / reps;
+
+            double old = -1.0;
+            if (n <= 10000) {
+                Node *nodes = malloc(n * sizeof(Node));
+                Edge *edges = malloc(l.edge_count * sizeof(Edge));
+                to_nodes(&l, nodes);
+                for (int e = 0; e < l.edge_count; e++) edges[e] = (Edge){ l.edges[e].from, l.edges[e].to, l.edges[e].strength };
+                int ref_reps = n <= 1000 ? 20 : 1;
+                t = now();
+                for (int r = 0; r < ref_reps; r++) ref_update_physics(nodes, n, edges, l.edge_count, dim);
+                old = (now() - t) / ref_reps;
+                free(nodes);
+                free(edges);
+            }
+            if (old > 0) printf("  %8d %10.2f %10.2f %9.1fx\n", n, old * 1e3, tree * 1e3, old / tree);
+            else printf("  %8d %10s %10.2f %10s\n", n, "-", tree * 1e3, "-");
+            layout_free(&l);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || (strcmp(argv[1], "test") != 0 && strcmp(argv[1], "bench") != 0)) {
+        fprintf(stderr, "Usage: %s test [dir]|bench\n", argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "bench") == 0) { bench(); return 0; }
+    srand(1);
+    for (int dim = 2; dim <= 3; dim++) {
+        test_forces(dim);
+        test_matches_reference(dim);
+        small_graphs(dim);
+    }
+    test_growth();
+    test_loading(argc > 2 ? argv[2] : ".");
+    return failures != 0;
+}
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../moe_router.h"
+
+// Checks and times moe_router.h, the sparse expert search behind
+// predict_next_word when CHATBOT_MOE_TOPK is set.
+//
+//   moe_check test    routing to every expert gives the top N of one tree
+//                     over all words; routing to k gives the top N of a
+//                     scan over those experts' words; the load statistics
+//                     add up
+//   moe_check bench   tokens/sec by expert count (2 to 64, 2000 words
+//                     each): one tree over every word, every expert, and
+//                     the top 1 and top 2 experts, with the balance of each
+
+#define DIM TOPK_DIM
+
+static float frand(void) { return (float)rand() / (float)RAND_MAX; }
+
+// n experts of size words around random centers; every tenth word is also
+// listed by the next expert, as a word shared by two curricula
+typedef struct {
+    int n, count;
+    float *vecs;
+    int *members, *starts;
+} Experts;
+
+static void make_experts(Experts *x, int n, int size, float spread) {
+    x->n = n;
+    x->count = n * size;
+    x->vecs = malloc((size_t)x->count * DIM * sizeof(float));
+    x->members = malloc((size_t)(x->count + x->count / 10 + n) * sizeof(int));
+    x->starts = malloc((n + 1) * sizeof(int));
+    for (int e = 0; e < n; e++) {
+        float center[DIM];
+        for (int j = 0; j < DIM; j++) center[j] = 2.0f * frand() - 1.0f;
+        for (int i = 0; i < size; i++) {
+            float *v = x->vecs + ((size_t)e * size + i) * DIM;
+            for (int j = 0; j < DIM; j++) v[j] = center[j] + spread * (2.0f * frand() - 1.0f);
+        }
+    }
+    int m = 0;
+    for (int e = 0; e < n; e++) {
+        x->starts[e] = m;
+        for (int i = 0; i < size; i++) x->members[m++] = e * size + i;
+        int prev = (e + n - 1) % n;
+        for (int i = 0; n > 1 && i < size; i += 10) x->members[m++] = prev * size + i;
+    }
+    x->starts[n] = m;
+}
+
+static void free_experts(Experts *x) { free(x->vecs); free(x->members); free(x->starts); }
+
+// Top N by (score, lower id) over the words of the given experts, each once
+static int scan_top_n(const Experts *x, const int *experts, int k, const float *q, int top_n, int *ids, float *scores) {
+    char *seen = calloc(x->count, 1);
+    TopkQuery r = { top_n, 0, ids, scores, -1, 0 };
+    for (int i = 0; i < k; i++) {
+        for (int m = x->starts[experts[i]]; m < x->starts[experts[i] + 1]; m++) {
+            int id = x->members[m];
+            if (seen[id]) continue;
+            seen[id] = 1;
+            topk_offer(&r, id, topk_dot(q, x->vecs + (size_t)id * DIM));
+        }
+    }
+    free(seen);
+    return r.count;
+}
+
+static int failures = 0;
+static void check(int ok, const char *what) {
+    printf("%s %s\n", ok ? "✓" : "✗", what);
+    if (!ok) failures++;
+}
+
+static int run_test(void) {
+    static const int top_ns[] = { 5, 10, 20 };
+    static const int dtypes[] = { QUANT_F32, QUANT_I8, QUANT_F16 };
+    char what[160];
+    for (int d = 0; d < 3; d++) {
+        Experts x;
+        make_experts(&x, 8, 700, 0.4f);
+        TopkIndex all;
+        MoeRouter every, one, two;
+        int ok = topk_build(&all, x.vecs, x.count) && moe_build(&every, x.vecs, x.members, x.starts, x.n, x.n, dtypes[d]) &&
+                 moe_build(&one, x.vecs, x.members, x.starts, x.n, 1, dtypes[d]) && moe_build(&two, x.vecs, x.members, x.starts, x.n, 2, dtypes[d]);
+        if (ok) ok = topk_quantize(&all, dtypes[d]);
+        if (!ok) { check(0, "build"); return 1; }
+        int dense_bad = 0, sparse_bad = 0, outside = 0;
+        for (int t = 0; t < 600; t++) {
+            const float *q = x.vecs + (size_t)(rand() % x.count) * DIM;
+            int top_n = top_ns[t % 3], want[20], got[20], chosen[8];
+            float want_scores[20], got_scores[20];
+            int nw = topk_query(&all, q, top_n, 0, want, want_scores);
+            int ng = moe_query(&every, q, top_n, 0, got, got_scores, NULL);
+            dense_bad += nw != ng || memcmp(want, got, nw * sizeof(int)) || memcmp(want_scores, got_scores, nw * sizeof(float));
+
+            MoeRouter *m = t % 2 ? &two : &one;
+            ng = moe_query(m, q, top_n, 0, got, got_scores, chosen);
+            // The trees hold dequantized points, so the scan uses the
+            // scores the tree reports for the same ids
+            nw = scan_top_n(&x, chosen, m->k, q, top_n, want, want_scores);
+            int same = nw == ng;
+            for (int i = 0; same && i < nw; i++) same = want[i] == got[i];
+            sparse_bad += dtypes[d] == QUANT_F32 ? !same || memcmp(want_scores, got_scores, nw * sizeof(float)) : 0;
+            for (int i = 0; i < ng; i++) {
+                int held = 0;
+                for (int c = 0; c < m->k; c++)
+                    for (int j = x.starts[chosen[c]]; j < x.starts[chosen[c] + 1]; j++) held |= x.members[j] == got[i];
+                outside += !held;
+                for (int j = 0; j < i; j++) outside += got[j] == got[i];
+            }
+        }
+        const char *name = dtypes[d] == QUANT_F32 ? "f32" : dtypes[d] == QUANT_I8 ? "int8" : "fp16";
+        snprintf(what, sizeof(what), "%s: routing to all 8 experts gives the same ids and scores as one tree over every word", name);
+        check(dense_bad == 0, what);
+        if (dtypes[d] == QUANT_F32) check(sparse_bad == 0, "f32: top 1 and top 2 routing give the top N of a scan over the chosen experts' words");
+        snprintf(what, sizeof(what), "%s: sparse results come only from the chosen experts, each word once", name);
+        check(outside == 0, what);
+        topk_free(&all);
+        moe_free(&every); moe_free(&one); moe_free(&two);
+        free_experts(&x);
+    }
+
+    // Load statistics
+    Experts x;
+    make_experts(&x, 16, 300, 0.2f);
+    MoeRouter m;
+    moe_build(&m, x.vecs, x.members, x.starts, x.n, 2, QUANT_F32);
+    int ids[10], chosen[16], home = 0;
+    float scores[10], loss, busiest;
+    for (int t = 0; t < 4000; t++) {
+        int w = rand() % x.count;
+        moe_query(&m, x.vecs + (size_t)w * DIM, 10, 0, ids, scores, chosen);
+        home += chosen[0] == w / 300;
+    }
+    uint64_t routed = 0;
+    double importance = 0;
+    for (int e = 0; e < m.n; e++) { routed += m.routed[e]; importance += m.importance[e]; }
+    check(m.tokens == 4000 && routed == 2 * m.tokens && fabs(importance - m.tokens) < 1e-2 * m.tokens,
+          "every token is routed to k experts and its gate probabilities sum to 1");
+    snprintf(what, sizeof(what), "the gate sends %.1f%% of words to their own expert first", 100.0 * home / 4000);
+    check(home > 0.9 * 4000, what);
+    moe_balance(&m, &loss, &busiest);
+    snprintf(what, sizeof(what), "uniform traffic balances: loss %.3f, busiest %.2fx the even load", loss, busiest);
+    check(loss < 1.2f && busiest < 2.0f, what);
+    float even = loss;
+    moe_reset_stats(&m);
+    for (int t = 0; t < 1000; t++) moe_query(&m, x.vecs + (size_t)(rand() % 300) * DIM, 10, 0, ids, scores, NULL);
+    moe_balance(&m, &loss, &busiest);
+    snprintf(what, sizeof(what), "traffic to one expert after a reset: loss %.2f, busiest %.2fx the even load", loss, busiest);
+    // Every token's first choice is the same expert: half of the k = 2 slots
+    check(m.tokens == 1000 && loss > 2.0f * even && busiest > 0.99f * m.n / m.k, what);
+    moe_free(&m);
+
+    // Ties and empty experts
+    float same[4 * DIM] = { 0 };
+    for (int i = 0; i < 4 * DIM; i++) same[i] = 0.1f * (i % DIM);
+    int members[] = { 0, 1, 2, 3 }, starts[] = { 0, 0, 2, 4 };
+    moe_build(&m, same, members, starts, 3, 1, QUANT_F32);
+    int n = moe_query(&m, same, 4, 0, ids, scores, chosen);
+    check(chosen[0] == 1 && n == 2 && ids[0] == 0 && ids[1] == 1, "an empty expert is never chosen and gate ties go to the lower expert");
+    moe_free(&m);
+    free_experts(&x);
+
+    // A bank with more curricula than the old fixed limit of 64 keeps them all
+    make_experts(&x, 100, 40, 0.3f);
+    TopkIndex all;
+    int bad = !topk_build(&all, x.vecs, x.count) || !moe_build(&m, x.vecs, x.members, x.starts, x.n, x.n, QUANT_F32) || m.n != 100;
+    for (int t = 0; !bad && t < 200; t++) {
+        const float *q = x.vecs + (size_t)(rand() % x.count) * DIM;
+        int want[10], got[10];
+        float want_scores[10], got_scores[10];
+        int nw = topk_query(&all, q, 10, 0, want, want_scores), ng = moe_query(&m, q, 10, 0, got, got_scores, NULL);
+        bad = nw != ng || memcmp(want, got, nw * sizeof(int)) || memcmp(want_scores, got_scores, nw * sizeof(float));
+    }
+    check(!bad, "100 experts are all built, and routing to every one gives the top N of one tree");
+    topk_free(&all);
+    moe_free(&m);
+    free_experts(&x);
+    return failures != 0;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Generation chains as predict_next_word runs them: the next query is a
+// random pick among the top N, and every 20 tokens a chain starts over from
+// a random word
+static double chain(MoeRouter *m, TopkIndex *all, const float *vecs, int count, int tokens) {
+    int ids[10], current = 0;
+    float scores[10];
+    srand(99);
+    double t0 = now();
+    for (int i = 0; i < tokens; i++) {
+        if (i % 20 == 0) current = rand() % count;
+        int n = m ? moe_query(m, vecs + (size_t)current * DIM, 10, 0, ids, scores, NULL)
+                  : topk_query(all, vecs + (size_t)current * DIM, 10, 0, ids, scores);
+        current = ids[rand() % n];
+    }
+    return tokens / (now() - t0);
+}
+
+static void run_bench(void) {
+    const int size = 2000, tokens = 50000;
+    printf("%-8s %-7s %12s %12s %12s %12s %14s %14s\n", "experts", "words", "one tree", "all experts", "top 1", "top 2", "top 1 balance", "top 2 balance");
+    for (int n = 2; n <= 64; n *= 2) {
+        Experts x;
+        make_experts(&x, n, size, 0.3f);
+        TopkIndex all;
+        MoeRouter every, one, two;
+        topk_build(&all, x.vecs, x.count);
+        moe_build(&every, x.vecs, x.members, x.starts, n, n, QUANT_F32);
+        moe_build(&one, x.vecs, x.members, x.starts, n, 1, QUANT_F32);
+        moe_build(&two, x.vecs, x.members, x.starts, n, 2, QUANT_F32);
+        double t_all = chain(NULL, &all, x.vecs, x.count, tokens), t_every = chain(&every, NULL, x.vecs, x.count, tokens);
+        double t_one = chain(&one, NULL, x.vecs, x.count, tokens), t_two = chain(&two, NULL, x.vecs, x.count, tokens);
+        float l1, b1, l2, b2;
+        moe_balance(&one, &l1, &b1);
+        moe_balance(&two, &l2, &b2);
+        char s1[32], s2[32];
+        snprintf(s1, sizeof(s1), "%.2f/%.1fx", l1, b1);
+        snprintf(s2, sizeof(s2), "%.2f/%.1fx", l2, b2);
+        printf("%-8d %-7d %12.0f %12.0f %12.0f %12.0f %14s %14s\n", n, x.count, t_all, t_every, t_one, t_two, s1, s2);
+        topk_free(&all);
+        moe_free(&every); moe_free(&one); moe_free(&two);
+        free_experts(&x);
+    }
+    printf("(tokens/sec; balance is the loss E * sum f_e * P_e, 1 when even, and the busiest expert over the even load)\n");
+}
+
+int main(int argc, char **argv) {
+    srand(1234);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) { run_bench(); return 0; }
+    return run_test();
+}
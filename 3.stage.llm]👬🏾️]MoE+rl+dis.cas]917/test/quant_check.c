@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../kernels.h"
+#include "../topk_index.h"
+
+// Checks the int8 / fp16 storage in quant.h and the code that runs on it:
+//  - fp16 conversion rounds to the nearest half (ties to even) and every
+//    half survives half -> float -> half
+//  - int8 rows keep their largest value and stay within half a scale step
+//  - kern_dequant() gives the same bits at every SIMD level
+//  - kern_output_projection_quant() equals kern_output_projection() on the
+//    dequantized layer, bit for bit, at every level
+//  - a quantized k-d tree returns the top k of a scan over the dequantized
+//    vectors
+//
+// Set KERNELS_THREADS to run the threaded paths with a given pool size.
+
+#define HIDDEN 16
+
+static unsigned int rng = 1;
+static float frand(float lo, float hi) {
+    rng = rng * 1103515245 + 12345;
+    return lo + (hi - lo) * ((rng >> 8) & 0xffffff) / (float)0xffffff;
+}
+static void fill(float *x, int n, float lo, float hi) { for (int i = 0; i < n; i++) x[i] = frand(lo, hi); }
+
+static int failures = 0;
+static void check(int ok, const char *what) {
+    if (ok) return;
+    printf("✗ %s\n", what);
+    failures++;
+}
+
+static int same_bits(float a, float b) { return memcmp(&a, &b, sizeof(float)) == 0; }
+
+// --- fp16 ---
+static void test_f16(void) {
+    int bad = 0;
+    for (uint32_t h = 0; h < 0x10000; h++) {
+        float f = quant_f16_to_float((uint16_t)h);
+        if (f != f) { bad += !(((h >> 10) & 0x1f) == 0x1f && (h & 0x3ff)); continue; }
+        bad += quant_f16_from_float(f) != h;
+    }
+    check(bad == 0, "every half survives half -> float -> half");
+    check(quant_f16_to_float(0x3c00) == 1.0f && quant_f16_to_float(0xc000) == -2.0f && quant_f16_to_float(0x7bff) == 65504.0f &&
+          quant_f16_to_float(0x0001) == ldexpf(1.0f, -24), "known halves decode to 1, -2, 65504 and 2^-24");
+
+    // Nearest half, ties to the even code, over normal, subnormal and
+    // overflowing magnitudes
+    bad = 0;
+    for (int i = 0; i < 200000; i++) {
+        float x = ldexpf(frand(-1.0f, 1.0f), (int)frand(-27.0f, 17.0f));
+        uint16_t h = quant_f16_from_float(x);
+        float y = quant_f16_to_float(h);
+        if (fabsf(x) >= 65520.0f) { bad += fabsf(y) != QUANT_F16_MAX || (y < 0) != (x < 0); continue; }
+        float e = fabsf(x - y);
+        for (int d = -1; d <= 1; d += 2) {
+            uint16_t n = (uint16_t)(h + d);
+            if ((n & 0x7c00) == 0x7c00 || (h & 0x7fff) == 0 || ((n ^ h) & 0x8000)) continue;
+            float ne = fabsf(x - quant_f16_to_float(n));
+            if (ne < e || (ne == e && (h & 1))) bad++;
+        }
+    }
+    check(bad == 0, "float -> half rounds to nearest, ties to even, saturating past 65504");
+    float big[4] = { 65504.0f, 65520.0f, -76473.0f, INFINITY };
+    check(quant_f16_to_float(quant_f16_from_float(76473.0f)) == 65504.0f && quant_f16_to_float(quant_f16_from_float(-1e30f)) == -65504.0f &&
+              quant_f16_saturated(big, 4) == 2,
+          "out-of-range finite values saturate at +-65504 and are counted");
+    check(isinf(quant_f16_to_float(quant_f16_from_float(INFINITY))) && quant_f16_to_float(quant_f16_from_float(NAN)) != quant_f16_to_float(quant_f16_from_float(NAN)),
+          "Inf and NaN survive the round trip");
+}
+
+// --- int8 ---
+static void test_i8(void) {
+    int bad = 0;
+    float x[64], y[64];
+    int8_t c[64];
+    for (int t = 0; t < 2000; t++) {
+        int n = 1 + t % 64;
+        float range = ldexpf(1.0f, t % 20 - 10);
+        fill(x, n, -range, range);
+        float s = quant_row(QUANT_I8, x, n, c);
+        quant_dequant_row(QUANT_I8, c, s, n, y);
+        float m = 0.0f;
+        for (int i = 0; i < n; i++) if (fabsf(x[i]) > m) m = fabsf(x[i]);
+        for (int i = 0; i < n; i++) {
+            bad += fabsf(x[i] - y[i]) > 0.5f * s * (1.0f + 1e-5f);
+            if (fabsf(x[i]) == m) bad += fabsf(y[i] - x[i]) > 1e-6f * m;
+        }
+    }
+    check(bad == 0, "int8 rows are within half a step and keep their largest value");
+    memset(x, 0, sizeof(x));
+    float s = quant_row(QUANT_I8, x, 7, c);
+    quant_dequant_row(QUANT_I8, c, s, 7, y);
+    check(s == 0.0f && y[0] == 0.0f && y[6] == 0.0f, "an all-zero row stays zero");
+}
+
+// --- Kernels ---
+static void test_kernels(int level) {
+    kernels_set_level(level);
+    if (kern_cfg.level != level) return;
+    int failed_before = failures;
+
+    // Dequantization, including the fp16 specials and odd tails
+    const int sizes[] = { 1, 7, 8, 9, 31, 1024, 1363 };
+    for (int s = 0; s < 7; s++) {
+        int n = sizes[s];
+        int8_t *c8 = malloc(n);
+        uint16_t *c16 = malloc(n * sizeof(uint16_t));
+        float *scales = malloc(n * sizeof(float)), *a = malloc(n * sizeof(float)), *b = malloc(n * sizeof(float));
+        for (int i = 0; i < n; i++) {
+            rng = rng * 1103515245 + 12345;
+            c8[i] = (int8_t)(rng >> 16);
+            c16[i] = (uint16_t)(rng >> 8);
+            scales[i] = frand(0.0f, 0.1f);
+        }
+        c16[0] = 0x7c00; if (n > 3) { c16[1] = 0xfe01; c16[2] = 0x8001; c16[3] = 0x03ff; }
+        int bad = 0;
+        kern_dequant(QUANT_I8, c8, scales, a, n);
+        for (int i = 0; i < n; i++) bad += !same_bits(a[i], scales[i] * (float)c8[i]);
+        kern_dequant(QUANT_F16, c16, NULL, a, n);
+        for (int i = 0; i < n; i++) { b[i] = quant_f16_to_float(c16[i]); bad += !same_bits(a[i], b[i]) && !(a[i] != a[i] && b[i] != b[i]); }
+        check(bad == 0, level == KERN_AVX2 ? "avx2 dequantization matches the scalar conversion" : level == KERN_SSE ? "sse dequantization matches the scalar conversion" : "scalar dequantization matches the conversion");
+        free(c8); free(c16); free(scales); free(a); free(b);
+    }
+
+    // Projection from codes against the float kernel on dequantized weights
+    const int vsizes[] = { 5, 1363, 40000 }, rowsizes[] = { 1, 9 };
+    for (int s = 0; s < 3; s++) for (int rr = 0; rr < 2; rr++) for (int dtype = QUANT_I8; dtype <= QUANT_F16; dtype++) {
+        int vs = vsizes[s], rows = rowsizes[rr], size = quant_size(dtype);
+        float *h = malloc(rows * HIDDEN * sizeof(float)), *bias = malloc(vs * sizeof(float)), *scales = malloc(vs * sizeof(float));
+        float *a = malloc((size_t)rows * vs * sizeof(float)), *b = malloc((size_t)rows * vs * sizeof(float));
+        float *w[HIDDEN], *deq[HIDDEN];
+        void *codes[HIDDEN];
+        fill(h, rows * HIDDEN, 0, 2); fill(bias, vs, -1, 1);
+        for (int l = 0; l < HIDDEN; l++) {
+            w[l] = malloc(vs * sizeof(float)); deq[l] = malloc(vs * sizeof(float)); codes[l] = malloc((size_t)vs * size);
+            fill(w[l], vs, -1, 1);
+        }
+        quant_columns(dtype, (const float *const *)w, HIDDEN, vs, codes, scales);
+        for (int l = 0; l < HIDDEN; l++)
+            for (int j = 0; j < vs; j++) quant_dequant_row(dtype, (char*)codes[l] + (size_t)j * size, dtype == QUANT_I8 ? scales[j] : 1.0f, 1, deq[l] + j);
+        kern_output_projection(h, rows, HIDDEN, deq, bias, a, vs);
+        kern_output_projection_quant(h, rows, HIDDEN, dtype, (const void *const *)codes, dtype == QUANT_I8 ? scales : NULL, bias, b, vs);
+        check(memcmp(a, b, (size_t)rows * vs * sizeof(float)) == 0, dtype == QUANT_I8 ? "int8 logits bit-identical to the dequantized layer" : "fp16 logits bit-identical to the dequantized layer");
+        for (int l = 0; l < HIDDEN; l++) { free(w[l]); free(deq[l]); free(codes[l]); }
+        free(h); free(bias); free(scales); free(a); free(b);
+    }
+    printf("%s %s quantized kernels (%d threads)\n", failures > failed_before ? "✗" : "✓", kern_level_name(level), kern_cfg.threads);
+}
+
+// --- k-d tree ---
+static void test_topk(int dtype) {
+    int n = 5000, k = 10, bad = 0;
+    float *vecs = malloc((size_t)n * TOPK_DIM * sizeof(float)), *deq = malloc((size_t)n * TOPK_DIM * sizeof(float));
+    fill(vecs, n * TOPK_DIM, -1, 1);
+    // Duplicated rows give exactly tied scores
+    memcpy(vecs + 7 * TOPK_DIM, vecs + 3 * TOPK_DIM, TOPK_DIM * sizeof(float));
+    TopkIndex t;
+    if (!topk_build(&t, vecs, n) || !topk_quantize(&t, dtype)) { check(0, "quantized tree builds"); return; }
+    unsigned char codes[TOPK_DIM * 4];
+    for (int i = 0; i < n; i++) {
+        float s = quant_row(dtype, vecs + (size_t)i * TOPK_DIM, TOPK_DIM, codes);
+        quant_dequant_row(dtype, codes, s, TOPK_DIM, deq + (size_t)i * TOPK_DIM);
+    }
+    int ids[10], ref_ids[10];
+    float scores[10], ref_scores[10];
+    for (int qi = 0; qi < 300; qi++) {
+        const float *q = vecs + (size_t)(qi * 13 % n) * TOPK_DIM;
+        int got = topk_query(&t, q, k, 0, ids, scores);
+        // Scan the dequantized vectors in the same summation order
+        TopkQuery r = { k, 0, ref_ids, ref_scores, -1 };
+        for (int i = 0; i < n; i++) topk_offer(&r, i, topk_dot(q, deq + (size_t)i * TOPK_DIM));
+        bad += got != k || memcmp(ids, ref_ids, sizeof(ids)) != 0 || memcmp(scores, ref_scores, sizeof(scores)) != 0;
+    }
+    check(bad == 0, dtype == QUANT_I8 ? "int8 tree returns the scan's top 10 over the dequantized vectors" : "fp16 tree returns the scan's top 10 over the dequantized vectors");
+    size_t f32 = (size_t)n * TOPK_DIM * sizeof(float) + (size_t)n * sizeof(int) + (size_t)t.node_count * sizeof(TopkNode);
+    check(topk_bytes(&t) < f32, "the quantized tree is smaller than the float one");
+    printf("%s %s k-d tree: %zu bytes against %zu\n", bad ? "✗" : "✓", quant_name(dtype), topk_bytes(&t), f32);
+    topk_free(&t);
+    free(vecs); free(deq);
+}
+
+int main(void) {
+    kernels_init();
+    int failed_before = failures;
+    test_f16();
+    test_i8();
+    printf("%s fp16 and int8 conversions\n", failures > failed_before ? "✗" : "✓");
+    for (int level = KERN_SCALAR; level <= KERN_AVX2; level++) test_kernels(level);
+    test_topk(QUANT_I8);
+    test_topk(QUANT_F16);
+    return failures != 0;
+}
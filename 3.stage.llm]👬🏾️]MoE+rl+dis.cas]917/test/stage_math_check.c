@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Checks the gradient helpers of the stage programs themselves: the file is
+// built once per program with that program's source included (its main()
+// renamed), so a change to either one, or to the layers.h helpers they
+// use, is tested as built.
+//
+//   -DSTAGE_BACKWARD_PROP   clip_gradients(), clip_gradients_2d() and
+//                           add_gradient_noise() as backward_prop.c builds them
+//   -DSTAGE_OPTIMIZER       adam_update() against Adam in double precision,
+//                           and clip_layer_gradients() as optimizer.c builds them
+
+#define main stage_main
+#if defined(STAGE_BACKWARD_PROP)
+#include "../backward_prop.c"
+#elif defined(STAGE_OPTIMIZER)
+#include "../optimizer.c"
+#else
+#error "build with -DSTAGE_BACKWARD_PROP or -DSTAGE_OPTIMIZER"
+#endif
+#undef main
+
+static unsigned int rng = 7;
+static float frand(float lo, float hi) {
+    rng = rng * 1103515245 + 12345;
+    return lo + (hi - lo) * ((rng >> 8) & 0xffffff) / (float)0xffffff;
+}
+static void fill(float *x, int n, float lo, float hi) { for (int i = 0; i < n; i++) x[i] = frand(lo, hi); }
+static double norm(const float *x, int n) { double s = 0; for (int i = 0; i < n; i++) s += (double)x[i] * x[i]; return sqrt(s); }
+static double cosine(const float *a, const float *b, int n) {
+    double d = 0;
+    for (int i = 0; i < n; i++) d += (double)a[i] * b[i];
+    return d / (norm(a, n) * norm(b, n) + 1e-30);
+}
+
+static int failures = 0;
+static void check(int ok, const char *what) {
+    printf("%s %s\n", ok ? "✓" : "✗", what);
+    if (!ok) failures++;
+}
+
+#if defined(STAGE_BACKWARD_PROP)
+// Norm min(|g|, max_norm), same direction, invalid entries zeroed
+static int clipped_ok(const float *before, const float *after, int n, float max_norm) {
+    float *valid = malloc(n * sizeof(float));
+    for (int i = 0; i < n; i++) valid[i] = before[i] != before[i] || fabsf(before[i]) > 1e10f ? 0.0f : before[i];
+    double nb = norm(valid, n), na = norm(after, n), want = nb > max_norm ? max_norm : nb;
+    int ok = fabs(na - want) <= 1e-5 * (want + 1e-12) && (nb < 1e-12 || cosine(valid, after, n) > 1.0 - 1e-6);
+    for (int i = 0; i < n; i++) ok &= valid[i] != 0.0f || after[i] == 0.0f;
+    free(valid);
+    return ok;
+}
+
+static void test_clip(void) {
+    int bad = 0, bad2d = 0;
+    float g[512], before[512];
+    for (int t = 0; t < 2000; t++) {
+        int n = 1 + t % 512;
+        float range = ldexpf(1.0f, t % 16 - 10), max_norm = t % 3 ? 1.0f : 0.25f;
+        fill(g, n, -range, range);
+        if (t % 5 == 0) g[t % n] = NAN;
+        if (t % 7 == 0) g[(t / 7) % n] = t % 2 ? INFINITY : -3e10f;
+        memcpy(before, g, n * sizeof(float));
+        clip_gradients(g, n, max_norm);
+        bad += !clipped_ok(before, g, n, max_norm);
+        memcpy(g, before, n * sizeof(float));
+        int rows = n % 7 == 0 ? 7 : 1;
+        clip_gradients_2d(g, rows, n / rows, max_norm);
+        bad2d += !clipped_ok(before, g, n, max_norm);
+    }
+    check(bad == 0, "clip_gradients caps the norm, keeps the direction and zeroes NaN/Inf");
+    check(bad2d == 0, "clip_gradients_2d caps the norm, keeps the direction and zeroes NaN/Inf");
+}
+
+static void test_noise(void) {
+    int n = 200000;
+    float *g = calloc(n, sizeof(float));
+    unsigned int seed = LAYER_NOISE_SEED;
+    add_gradient_noise(g, n, 0.01f, &seed);
+    double mean = 0, var = 0;
+    for (int i = 0; i < n; i++) mean += g[i];
+    mean /= n;
+    for (int i = 0; i < n; i++) var += (g[i] - mean) * (g[i] - mean);
+    double sd = sqrt(var / (n - 1));
+    char what[160];
+    snprintf(what, sizeof(what), "add_gradient_noise adds N(0, scale^2) noise (mean %.2e, sd %.5f for scale 0.01)", mean, sd);
+    check(fabs(mean) < 4 * 0.01 / sqrt(n) && fabs(sd - 0.01) < 2e-4, what);
+
+    float x[4] = { 1.0f, NAN, -2.0f, INFINITY }, y[4];
+    memcpy(y, x, sizeof(x));
+    add_gradient_noise(y, 4, 0.0f, &seed);
+    int same = y[0] == 1.0f && y[1] != y[1] && y[2] == -2.0f && isinf(y[3]);
+    add_gradient_noise(x, 4, 0.01f, &seed);
+    check(same && fabsf(x[1]) < 0.1f && fabsf(x[3]) < 0.1f && fabsf(x[0] - 1.0f) < 0.1f,
+          "a zero scale leaves gradients alone and NaN/Inf are replaced by noise");
+    free(g);
+}
+#endif
+
+#if defined(STAGE_OPTIMIZER)
+static void test_adam(void) {
+    // Random gradient sequences, including the first steps where the bias
+    // correction matters most
+    double worst = 0;
+    for (int run = 0; run < 200; run++) {
+        float p = frand(-1, 1), m = 0, v = 0, lr = run % 2 ? 0.01f : 0.001f, b1 = 0.9f, b2 = 0.999f;
+        double pd = p, md = 0, vd = 0;
+        float scale = ldexpf(1.0f, run % 12 - 6);
+        for (int t = 1; t <= 300; t++) {
+            float g = frand(-scale, scale);
+            adam_update(&p, &m, &v, g, lr, b1, b2, t);
+            md = b1 * md + (1.0 - b1) * g;
+            vd = b2 * vd + (1.0 - b2) * (double)g * g;
+            double mh = md / (1.0 - pow(b1, t)), vh = vd / (1.0 - pow(b2, t));
+            pd -= lr * mh / (sqrt(vh) + EPSILON);
+        }
+        double err = fabs(p - pd) / (300 * lr);
+        if (err > worst) worst = err;
+    }
+    char what[160];
+    snprintf(what, sizeof(what), "adam_update follows Adam in double precision over 300 steps (worst drift %.1e of the step budget)", worst);
+    check(worst < 1e-4, what);
+
+    // Minimizes (p - 3)^2
+    float p = 0, m = 0, v = 0;
+    for (int t = 1; t <= 2000; t++) adam_update(&p, &m, &v, 2.0f * (p - 3.0f), 0.05f, 0.9f, 0.999f, t);
+    check(fabsf(p - 3.0f) < 0.01f, "adam_update converges on a quadratic");
+
+    // Invalid gradients and moments are treated as zero
+    p = 1.0f; m = NAN; v = INFINITY;
+    adam_update(&p, &m, &v, NAN, 0.01f, 0.9f, 0.999f, 1);
+    check(p == 1.0f && m == 0.0f && v == 0.0f, "adam_update ignores NaN/Inf gradients and moments");
+}
+
+static void test_layer_clip(void) {
+    int vs = 37, bad = 0;
+    OutputLayer g_o;
+    g_o.weights = malloc(HIDDEN_DIM * sizeof(float*));
+    float *block = malloc((HIDDEN_DIM + 1) * vs * sizeof(float)), *before = malloc((HIDDEN_DIM + 1) * vs * sizeof(float));
+    for (int i = 0; i < HIDDEN_DIM; i++) g_o.weights[i] = block + i * vs;
+    g_o.biases = block + HIDDEN_DIM * vs;
+    for (int t = 0; t < 300; t++) {
+        AttentionLayer g_a, a0;
+        MlpLayer g_m, m0;
+        float range = ldexpf(1.0f, t % 12 - 8);
+        fill(&g_a.W_q[0][0], 3 * EMBEDDING_DIM * EMBEDDING_DIM, -range, range);
+        fill(&g_m.weights[0][0], EMBEDDING_DIM * HIDDEN_DIM + HIDDEN_DIM, -range, range);
+        fill(block, (HIDDEN_DIM + 1) * vs, -range, range);
+        a0 = g_a; m0 = g_m;
+        memcpy(before, block, (HIDDEN_DIM + 1) * vs * sizeof(float));
+        int nq = EMBEDDING_DIM * EMBEDDING_DIM, nm = EMBEDDING_DIM * HIDDEN_DIM + HIDDEN_DIM, no = (HIDDEN_DIM + 1) * vs;
+        double total = sqrt(norm(&a0.W_q[0][0], nq) * norm(&a0.W_q[0][0], nq) + norm(&m0.weights[0][0], nm) * norm(&m0.weights[0][0], nm) +
+                            norm(before, no) * norm(before, no));
+        clip_layer_gradients(&g_a, &g_m, &g_o, vs);
+        // Every layer is scaled to unit norm, then all of them by
+        // MAX_GRAD_NORM / total when the total norm was above it
+        double want = total > MAX_GRAD_NORM ? MAX_GRAD_NORM / total : 1.0;
+        bad += fabs(norm(&g_a.W_q[0][0], nq) - want) > 1e-4 * want || cosine(&a0.W_q[0][0], &g_a.W_q[0][0], nq) < 1.0 - 1e-6;
+        bad += fabs(norm(&g_m.weights[0][0], nm) - want) > 1e-4 * want || cosine(&m0.weights[0][0], &g_m.weights[0][0], nm) < 1.0 - 1e-6;
+        bad += fabs(norm(block, no) - want) > 1e-4 * want || cosine(before, block, no) < 1.0 - 1e-6;
+        bad += memcmp(&g_a.W_k, &a0.W_k, sizeof(a0.W_k) + sizeof(a0.W_v)) != 0;
+    }
+    check(bad == 0, "clip_layer_gradients normalizes each layer and scales by the global norm, keeping directions");
+    free(g_o.weights); free(block); free(before);
+}
+#endif
+
+int main(void) {
+#if defined(STAGE_BACKWARD_PROP)
+    test_clip();
+    test_noise();
+#else
+    test_adam();
+    test_layer_clip();
+#endif
+    return failures != 0;
+}
@@ -0,0 +1,89 @@
+#!/bin/bash
+
+# Checks the tiled all-pairs cosine similarity in tools/export_associations]a0.c:
+#  - for small vocabularies the dense CSV keeps the old layout and values
+#  - <prefix>.edges holds each word's true top-k neighbours, best first,
+#    and -threshold drops the weaker ones
+#  - the output does not depend on the thread count
+#  - a vocabulary too large for the dense matrix only gets the edge list
+# Run from the project root: ./test/test_associations.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/tools/export_associations]a0.c" -o "$WORK/export_associations.+x" -pthread -lm || { echo "Compilation of export_associations]a0.c failed!"; exit 1; }
+cd "$WORK"
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+cp "$ROOT/curriculum/corpus]similarity10/corpus]similarity10.txt" vocab.txt
+
+# reference <vocab>: "i j similarity" for every pair, in double precision
+reference() {
+    awk 'NR > 1 {
+        n++; w[n] = $2; s = 0
+        for (d = 3; d <= 9; d++) { v[n, d] = $d; s += $d * $d }
+        s = sqrt(s); for (d = 3; d <= 9; d++) v[n, d] = s > 0 ? v[n, d] / s : 0
+    } END {
+        for (i = 1; i <= n; i++) for (j = 1; j <= n; j++) {
+            s = 0; for (d = 3; d <= 9; d++) s += v[i, d] * v[j, d]
+            printf "%s %s %.6f\n", w[i], w[j], s
+        }
+    }' "$1"
+}
+reference vocab.txt > ref.txt
+words=$(($(wc -l < vocab.txt) - 1))
+
+./export_associations.+x vocab.txt small > small.out
+awk -F, -v n="$words" 'NR == 1 { ok = $1 == "" && NF == n + 1 } NR > 1 { ok = ok && NF == n + 1 } END { exit !(ok && NR == n + 1) }' small.csv
+check $? "small vocabulary: dense ${words}x${words} CSV in the old layout"
+awk -F, 'NR == 1 { for (j = 2; j <= NF; j++) col[j] = $j; next } { for (j = 2; j <= NF; j++) print $1, col[j], $j }' small.csv |
+    paste -d' ' - ref.txt | awk '{ d = $3 - $6; if (d < 0) d = -d; if ($1 != $4 || $2 != $5 || d > 2e-6) bad++ } END { exit bad > 0 || NR == 0 }'
+check $? "every CSV cell is the cosine similarity of its row and column"
+
+# Edges are named by word, so the neighbour checks use each word once
+awk '!seen[$2]++' vocab.txt > unique.txt
+reference unique.txt > ref.txt
+words=$(($(wc -l < unique.txt) - 1))
+
+# top <k> [threshold]: each word's expected neighbour similarities
+top() {
+    awk '$1 != $2' ref.txt | sort -k1,1 -s -k3,3gr | awk -v k="$1" -v t="${2:--2}" '$3 >= t && c[$1]++ < k { print $1 "," $3 }' | sort -t, -k1,1 -k2,2g
+}
+# same_top <edges> <k> [threshold]: the edge list has those similarities,
+# up to float rounding
+same_top() {
+    paste -d, <(top "$2" "$3") <(tail -n +2 "$1" | cut -d, -f1,3 | sort -t, -k1,1 -k2,2g) |
+        awk -F, '{ d = $2 - $4; if (d < 0) d = -d; if ($1 != $3 || d > 2e-6) bad++ } END { exit bad > 0 || NR == 0 }' &&
+        [ "$(top "$2" "$3" | wc -l)" -eq "$(($(wc -l < "$1") - 1))" ]
+}
+./export_associations.+x unique.txt k5 -topk 5 > /dev/null
+[ "$(head -1 k5.edges)" = "source,target,similarity" ] && [ "$(tail -n +2 k5.edges | wc -l)" -eq $((words * 5)) ] && same_top k5.edges 5
+check $? "the edge list holds each word's 5 best neighbours"
+awk -F, 'NR > 1 { if ($1 == $2 || ($1 == last && $3 > prev)) bad++; last = $1; prev = $3 } END { exit bad > 0 }' k5.edges
+check $? "neighbours come best first and never include the word itself"
+
+./export_associations.+x unique.txt t -topk 50 -threshold 0.95 > /dev/null
+same_top t.edges 50 0.95 && grep -q "^Threshold: 0.950000" t_stats.txt
+check $? "-threshold 0.95 keeps only the neighbours at or above it"
+
+awk 'BEGIN { srand(7); print "number word embedding pe weight bias1 bias2 bias3 bias4"
+    for (i = 1; i <= 5000; i++) printf "%d w%d %f %f %f %f %f %f %f\n", i, i, rand() - .5, rand() - .5, rand() - .5, rand() - .5, rand() - .5, rand() - .5, rand() - .5 }' > big.txt
+./export_associations.+x big.txt one -threads 1 > one.out
+./export_associations.+x big.txt four -threads 4 > four.out
+cmp -s one.edges four.edges && cmp -s one_stats.txt four_stats.txt
+check $? "1 and 4 threads write the same edges and statistics"
+rate=$(sed -n 's/.*(\(.*\) M pairs\/sec)/\1/p' one.out)
+[ ! -e one.csv ] && [ "$(tail -n +2 one.edges | wc -l)" -eq 80000 ] && grep -q "^Matrix shape: 5000x5000" one_stats.txt
+check $? "5000 words: no dense CSV, 16 neighbours each ($rate M pairs/sec on one thread)"
+
+if [ $status -eq 0 ]; then
+    echo "Association checks passed."
+else
+    echo "Association checks FAILED."
+fi
+exit $status
@@ -0,0 +1,90 @@
+#!/bin/bash
+
+# Checks the resident chatbot (chatbot_moe_v1 -serve, chat_protocol.h) and
+# meta_rl talking to it:
+#  - a served response equals the command-line chatbot's for the same seed
+#  - several requests share a connection and the loaded vocabulary
+#  - malformed requests get an ERR reply and the server keeps serving
+#  - meta_rl starts the server itself, runs >1000 episodes/min with piped
+#    feedback, saves its weights, and -stop-server shuts the server down
+# Run from the project root: ./test/test_chat_server.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap '[ -S "$WORK/chat.sock" ] && (cd "$WORK" && CHATBOT_SOCKET=chat.sock ./meta_rl.+x -stop-server > /dev/null); rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/+x"
+gcc "$ROOT/chatbot_moe_v1.c" -o "$WORK/+x/chatbot_moe_v1.+x" -pthread -lm || { echo "Compilation of chatbot_moe_v1.c failed!"; exit 1; }
+gcc "$ROOT/meta_rl/meta_rl.c" -o "$WORK/meta_rl.+x" -lm || { echo "Compilation of meta_rl.c failed!"; exit 1; }
+
+# Sends the raw request on stdin and prints the raw replies
+cat > "$WORK/chat_send.c" <<'EOF'
+#include "chat_protocol.h"
+
+int main(int argc, char **argv) {
+    int fd = chat_connect(argv[1]);
+    if (fd < 0) return 1;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0) write(fd, buf, n);
+    shutdown(fd, SHUT_WR);
+    while ((n = read(fd, buf, sizeof(buf))) > 0) fwrite(buf, 1, n, stdout);
+    close(fd);
+    return 0;
+}
+EOF
+gcc -I"$ROOT" "$WORK/chat_send.c" -o "$WORK/chat_send.+x" || { echo "Compilation of the test client failed!"; exit 1; }
+cd "$WORK"
+ln -s "$ROOT/curriculum" curriculum
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+EMOJI="$ROOT/curriculum/test_emoji/test_emoji.txt"
+SIM="$ROOT/curriculum/corpus]similarity10/corpus]similarity10.txt"
+printf "%s\n%s\n" "$SIM" "$EMOJI" > bank.txt
+export CHATBOT_TRACE=0
+
+CHATBOT_SOCKET=chat.sock ./+x/chatbot_moe_v1.+x -serve chat.sock 2> server.log &
+for i in $(seq 100); do [ -S chat.sock ] && break; sleep 0.05; done
+
+cli=$(./+x/chatbot_moe_v1.+x bank.txt "hello world" 8 1.0 42 2> /dev/null | tr '\r' '\n' | sed -n 's/^Response: //p')
+printf "GEN 8 1.0 42 2\n%s\n%s\nhello world\nGEN 8 1.0 42 2\n%s\n%s\nhello world\n" "$SIM" "$EMOJI" "$SIM" "$EMOJI" | ./chat_send.+x chat.sock > replies.txt
+[ -n "$cli" ] && [ "$(sed -n 2p replies.txt)" = "$cli" ]
+check $? "served response equals the command-line one for the same seed"
+[ "$(grep -c "^OK 8$" replies.txt)" -eq 2 ] && [ "$(sed -n 2p replies.txt)" = "$(sed -n 4p replies.txt)" ]
+check $? "two requests on one connection get two replies"
+[ "$(grep -c "Building vocabulary index" server.log)" -eq 1 ]
+check $? "the merged vocabulary is built once and kept loaded"
+
+printf "GEN nonsense\n" | ./chat_send.+x chat.sock | grep -q "^ERR "
+check $? "a malformed request gets ERR"
+printf "GEN 3 1.0 0 1\n/no/such/curriculum.txt\nhi\n" | ./chat_send.+x chat.sock | grep -q "^ERR "
+check $? "missing curricula get ERR"
+printf "GEN 3 1.0 7 1\n%s\nhi\n" "$EMOJI" | ./chat_send.+x chat.sock | grep -q "^OK [0-9]"
+check $? "the server keeps serving after errors"
+printf "QUIT\n" | ./chat_send.+x chat.sock > /dev/null
+wait
+[ ! -e chat.sock ]
+check $? "QUIT stops the server and removes the socket"
+
+out=$(yes 7 | CHATBOT_SOCKET=chat.sock ./meta_rl.+x -episodes 2000 "hello world" 10 1.0)
+rate=$(echo "$out" | sed -n 's/.*(\([0-9]*\) episodes\/min).*/\1/p')
+[ -S chat.sock ] && echo "$out" | grep -q "^2000 episodes" && [ "${rate:-0}" -gt 1000 ]
+check $? "meta_rl starts the server and runs 2000 episodes ($rate episodes/min)"
+# feedback 7 -> 0.4, so 2000 episodes move rl_bias by 2000 * 0.1 * 0.4
+awk '$1=="rl_bias" { exit !($2 > 79.5 && $2 < 80.5) }' meta_rl_weights.txt
+check $? "every episode's feedback reaches the saved weights"
+CHATBOT_SOCKET=chat.sock ./meta_rl.+x -stop-server > /dev/null
+for i in $(seq 100); do [ -e chat.sock ] || break; sleep 0.05; done
+[ ! -e chat.sock ]
+check $? "meta_rl -stop-server shuts the server down"
+
+if [ $status -eq 0 ]; then
+    echo "Chat server checks passed."
+else
+    echo "Chat server checks FAILED."
+fi
+exit $status
@@ -0,0 +1,96 @@
+#!/bin/bash
+
+# Checks training on a corpus token stream (corpus= in config.txt,
+# corpus_loader.h):
+#  - a corpus spelling out the vocabulary rows, read in order in several
+#    windows, trains exactly like the default run over the vocab sequence
+#  - a shuffled run gives the same weights with the prefetch thread, without
+#    it and with a slow read, and a different seed gives different weights
+#  - corpus.tok is reused while the corpus and vocabulary are unchanged and
+#    rebuilt when either changes; words not in the vocabulary are counted
+# Run from the project root: ./test/test_corpus_loader.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+echo "Compiling trainer into $WORK/+x..."
+mkdir -p "$WORK/+x"
+gcc "$ROOT/trainer.c" -o "$WORK/+x/trainer.+x" -pthread -lm || { echo "Compilation of trainer.c failed!"; exit 1; }
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+same_model() {
+    for f in attention_model.txt mlp_model.txt output_layer.txt output_layer.m.txt vocab.txt loss.txt; do
+        cmp -s "$1/$f" "$2/$f" || return 1
+    done
+}
+
+cd "$WORK"
+mkdir -p base
+cp "$ROOT/curriculum/test_emoji/test_emoji.txt" base/vocab.txt
+printf "epochs=0\n" > base/config.txt
+./+x/trainer.+x base/vocab.txt 2>/dev/null || { echo "Model initialization failed!"; exit 1; }
+# The tokenizer starts the stream with start-token, row 0
+awk 'NR > 2 { printf "%s ", $2 }' base/vocab.txt > base/words.txt
+for i in $(seq 20); do cat base/words.txt; done > base/long.txt
+for d in default ordered seeded noprefetch slow reseeded; do
+    mkdir -p $d
+    cp base/vocab.txt base/attention_model.txt base/mlp_model.txt base/output_layer.txt base/words.txt base/long.txt $d/
+done
+COMMON="epochs=2\nlearning_rate=0.01\ncausal_attention=1\n"
+printf "$COMMON" > default/config.txt
+printf "${COMMON}corpus=words.txt\ncorpus_window=3\n" > ordered/config.txt
+for d in seeded noprefetch slow; do printf "${COMMON}corpus=long.txt\ncorpus_window=7\nshuffle_seed=7\n" > $d/config.txt; done
+printf "${COMMON}corpus=long.txt\ncorpus_window=7\nshuffle_seed=8\n" > reseeded/config.txt
+
+./+x/trainer.+x default/vocab.txt 2>/dev/null
+./+x/trainer.+x ordered/vocab.txt 2>ordered/log.txt
+grep -q "Window 4/4" ordered/log.txt
+check $? "the 10-pair corpus is read in 4 windows of 3"
+same_model default ordered
+check $? "the vocab sequence as an unshuffled corpus trains exactly like the default run"
+
+./+x/trainer.+x seeded/vocab.txt 2>seeded/log.txt
+CORPUS_PREFETCH=0 ./+x/trainer.+x noprefetch/vocab.txt 2>/dev/null
+CORPUS_READ_DELAY_US=2000 ./+x/trainer.+x slow/vocab.txt 2>/dev/null
+./+x/trainer.+x reseeded/vocab.txt 2>/dev/null
+grep -q "Epoch 2/2: 200 tokens" seeded/log.txt
+check $? "every one of the 200 pairs is trained on each epoch"
+same_model seeded noprefetch && same_model seeded slow
+check $? "a seeded shuffle gives the same model with and without prefetching and on slow reads"
+! cmp -s seeded/output_layer.txt reseeded/output_layer.txt
+check $? "another shuffle seed gives a different model"
+
+./+x/trainer.+x seeded/vocab.txt 2>seeded/log2.txt
+! grep -q "Tokenized" seeded/log2.txt && grep -q "Tokenized" seeded/log.txt
+check $? "corpus.tok is written once and reused while nothing changed"
+
+sleep 0.01; touch seeded/long.txt
+./+x/trainer.+x seeded/vocab.txt 2>seeded/log3.txt
+grep -q "Tokenized" seeded/log3.txt
+check $? "a modified corpus is tokenized again"
+
+word=$(awk 'NR == 4 { print $2 }' seeded/vocab.txt)
+awk -v w="$word" 'NR == 4 { $2 = w "x" } { print }' seeded/vocab.txt > seeded/vocab.tmp && mv seeded/vocab.tmp seeded/vocab.txt
+./+x/trainer.+x seeded/vocab.txt 2>seeded/log4.txt
+grep -q "181 tokens, 20 words not in the vocabulary" seeded/log4.txt
+check $? "a changed vocabulary re-tokenizes and counts the words it lost"
+
+mkdir -p short
+cp base/vocab.txt base/attention_model.txt base/mlp_model.txt base/output_layer.txt short/
+: > short/one.txt  # just the start token: no pairs
+printf "${COMMON}corpus=one.txt\n" > short/config.txt
+./+x/trainer.+x short/vocab.txt 2>short/log.txt
+grep -q "no next-word pairs" short/log.txt && [ ! -f short/loss.txt ]
+check $? "a corpus with no pairs is refused, and no loss is written"
+
+if [ $status -eq 0 ]; then
+    echo "Corpus loader checks passed."
+else
+    echo "Corpus loader checks FAILED."
+fi
+exit $status
@@ -0,0 +1,145 @@
+#!/bin/bash
+
+# Checks the curriculum registry and router (curriculum_registry.h) and
+# meta_rl's use of it:
+#  - every curriculum/<name>/<name>.txt is found; summaries are cached and
+#    only changed vocabularies are read again
+#  - routing returns the same top-k as a full sort, prefers the expert that
+#    knows the prompt's words, and takes under a millisecond with 400 experts
+#  - meta_rl_weights.txt grows with the registry and keeps the weights of
+#    curricula that were removed
+# Run from the project root: ./test/test_curriculum_registry.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap '[ -S "$WORK/chat.sock" ] && (cd "$WORK" && CHATBOT_SOCKET=chat.sock ./meta_rl.+x -stop-server > /dev/null); rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/+x"
+gcc "$ROOT/chatbot_moe_v1.c" -o "$WORK/+x/chatbot_moe_v1.+x" -pthread -lm || { echo "Compilation of chatbot_moe_v1.c failed!"; exit 1; }
+gcc "$ROOT/meta_rl/meta_rl.c" -o "$WORK/meta_rl.+x" -lm || { echo "Compilation of meta_rl.c failed!"; exit 1; }
+
+# registry_check <dir> <cache> [prompt]: prints "<count> <summarized>", then
+# with a prompt "<top id> <top name> <agrees with full sort> <us per route>"
+cat > "$WORK/registry_check.c" <<'EOF'
+#include <time.h>
+#include "curriculum_registry.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    CurriculumRegistry r;
+    registry_init(&r);
+    int summarized = registry_discover(&r, argv[1], argv[2]);
+    printf("%d %d\n", r.count, summarized);
+    if (argc < 4) return 0;
+
+    // Some learned state, so every term of the score matters
+    srand(1);
+    for (int i = 0; i < r.count; i++) {
+        r.weight[i] = (float)rand() / RAND_MAX * 0.1f;
+        for (int j = 0; j < ROUTE_PROMPT_FEATURES; j++) r.feature_weight[j * r.capacity + i] = (float)rand() / RAND_MAX * 0.01f;
+    }
+    for (int j = 0; j < ROUTE_SUMMARY_FEATURES; j++) r.summary_weight[j] = 0.01f;
+    float features[ROUTE_PROMPT_FEATURES] = {1.1f, 0, 0, 0, 1, 0, 0.8f};
+    uint32_t bits[ROUTE_MAX_PROMPT_WORDS];
+    int nbits = registry_prompt_bits(argv[3], bits, ROUTE_MAX_PROMPT_WORDS);
+    int ids[ROUTE_MAX_K];
+    float top[ROUTE_MAX_K];
+    int found = registry_route(&r, features, bits, nbits, 5, ids, top);
+
+    // Full sort of the same scores
+    int agrees = found == 5;
+    for (int k = 0; k < found; k++) {
+        int best = -1;
+        for (int i = 0; i < r.count; i++) {
+            int taken = 0;
+            for (int m = 0; m < k; m++) taken |= ids[m] == i;
+            if (!taken && (best < 0 || r.scores[i] > r.scores[best])) best = i;
+        }
+        agrees &= ids[k] == best;
+    }
+
+    int rounds = 20000;
+    double start = now();
+    for (int n = 0; n < rounds; n++) {
+        features[0] = n % 7;
+        registry_route(&r, features, bits, nbits, 3, ids, top);
+    }
+    double us = (now() - start) * 1e6 / rounds;
+    registry_route(&r, features, bits, nbits, 5, ids, top);
+    printf("%d %s %d %.1f\n", ids[0], r.summaries[ids[0]].name, agrees, us);
+    registry_free(&r);
+    return 0;
+}
+EOF
+gcc -O2 -I"$ROOT" "$WORK/registry_check.c" -o "$WORK/registry_check.+x" -lm || { echo "Compilation of the registry check failed!"; exit 1; }
+cd "$WORK"
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+# make_curriculum <dir> <name>: 40 words of its own plus a few shared ones
+make_curriculum() {
+    mkdir -p "$1/$2"
+    awk -v c="$2" 'BEGIN {
+        srand(length(c) * 7919 + substr(c, 2) * 31);
+        print "number word embedding pe weight bias1 bias2 bias3 bias4"
+        n = split("start-token hello world end-token", shared, " ")
+        for (i = 1; i <= n; i++) printf "%d %s %f %f %f 0 0 0 0\n", i, shared[i], rand(), rand(), rand()
+        for (i = 1; i <= 40; i++) printf "%d %s_w%d %f %f %f 0 0 0 0\n", n + i, c, i, rand(), rand(), rand()
+    }' > "$1/$2/$2.txt"
+}
+
+for i in $(seq -w 1 400); do make_curriculum big c$i; done
+mkdir big/not_a_curriculum
+read count summarized < <(./registry_check.+x big big.cache)
+[ "$count" -eq 400 ] && [ "$summarized" -eq 400 ]
+check $? "400 curricula found and summarized"
+read count summarized < <(./registry_check.+x big big.cache)
+[ "$count" -eq 400 ] && [ "$summarized" -eq 0 ]
+check $? "second discovery takes every summary from the cache"
+echo "999 c123_w41 0.5 0.5 0.5 0 0 0 0" >> big/c123/c123.txt
+make_curriculum big c401
+read count summarized < <(./registry_check.+x big big.cache)
+[ "$count" -eq 401 ] && [ "$summarized" -eq 2 ]
+check $? "a changed and a new curriculum are the only ones read again"
+
+{ read count summarized; read top name agrees us; } < <(./registry_check.+x big big.cache "hello c277_w3 c277_w9")
+[ "$name" = "c277" ]
+check $? "the expert holding the prompt's words ranks first"
+[ "$agrees" -eq 1 ]
+check $? "top-k equals a full sort of the scores"
+awk -v us="$us" 'BEGIN { exit !(us < 1000) }'
+check $? "routing over 401 curricula takes ${us} us (< 1 ms)"
+
+# meta_rl against a small registry that grows and shrinks
+export CHATBOT_SOCKET=chat.sock CHATBOT_TRACE=0
+for c in alpha beta gamma; do make_curriculum curriculum $c; done
+yes 8 | ./meta_rl.+x -episodes 50 "hello world" 5 1.0 > /dev/null
+[ "$(grep -c "^curriculum_.*_weight " meta_rl_weights.txt)" -eq 3 ] && [ "$(grep -c "^curriculum_alpha_feature_" meta_rl_weights.txt)" -eq 7 ] && grep -q "^route_overlap " meta_rl_weights.txt
+check $? "weights hold one row set per discovered curriculum"
+beta=$(awk '$1=="curriculum_beta_weight" {print $2}' meta_rl_weights.txt)
+make_curriculum curriculum delta
+yes 8 | ./meta_rl.+x -episodes 1 "hello world" 5 1.0 > out.txt
+grep -q "^Found 4 curricula in ./curriculum (1 summarized, 3 cached)" out.txt && grep -q "^curriculum_delta_weight 0.5" meta_rl_weights.txt
+check $? "a new curriculum is summarized once and its weights are added"
+awk -v b="$beta" '$1=="curriculum_beta_weight" { exit !($2 >= b) }' meta_rl_weights.txt && awk '$1=="curriculum_beta_weight" { exit !($2 > 0.5) }' meta_rl_weights.txt
+check $? "learned weights survive the registry growing"
+beta=$(awk '$1=="curriculum_beta_weight" {print $2}' meta_rl_weights.txt)
+rm -r curriculum/beta
+yes 8 | ./meta_rl.+x -episodes 1 "hello world" 5 1.0 > /dev/null
+grep -q "^curriculum_beta_weight $beta" meta_rl_weights.txt
+check $? "a removed curriculum's weights are kept for when it returns"
+
+if [ $status -eq 0 ]; then
+    echo "Curriculum registry checks passed."
+else
+    echo "Curriculum registry checks FAILED."
+fi
+exit $status
@@ -0,0 +1,76 @@
+#!/bin/bash
+
+# Checks the batched distillation runner (distil/distill.c) against its
+# -reference mode, which runs the teacher and the full-vocabulary
+# softmax/KL per token every epoch as distill_knowledge was written to:
+#  - with every teacher logit cached the loss curve matches the reference,
+#    one token per step and in minibatches split over threads
+#  - the teacher runs once per corpus: later runs read the cache, and a
+#    changed teacher model rebuilds it
+#  - a sparse top-k cache still trains the student
+# Run from the project root: ./test/test_distill.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc "$ROOT/distil/distill.c" -o "$WORK/distill.+x" -pthread -lm || { echo "Compilation of distill.c failed!"; exit 1; }
+cd "$WORK"
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+# Small fixed corpus: the similarity10 curriculum and its trained model
+mkdir teacher
+for f in attention_model.txt mlp_model.txt output_layer.txt; do
+    cp "$ROOT/curriculum/corpus]similarity10/$f" teacher/
+done
+cp "$ROOT/curriculum/corpus]similarity10/corpus]similarity10.txt" vocab.txt
+
+# curve <student dir>: "loss kl ce" per epoch
+curve() { awk '{print $2, $3, $4}' "$1/distill_loss.txt"; }
+
+# same_curve <a> <b> <relative tolerance>
+same_curve() {
+    paste -d' ' <(curve "$1") <(curve "$2") | awk -v tol="$3" '
+        { for (i = 1; i <= 3; i++) { d = $i - $(i + 3); if (d < 0) d = -d; m = $i < 0 ? -$i : $i; if (d > tol * (m > 1 ? m : 1)) bad = 1 } n++ }
+        END { exit bad || n == 0 }'
+}
+
+./distill.+x teacher ref1 vocab.txt -epochs 6 -batch 1 -reference > ref1.out 2>&1
+./distill.+x teacher fast1 vocab.txt -epochs 6 -batch 1 -threads 1 -topk 0 > fast1.out 2>&1
+same_curve ref1 fast1 1e-5 && [ "$(wc -l < fast1/distill_loss.txt)" -eq 6 ]
+check $? "one token per step: cached loss curve matches the reference"
+
+./distill.+x teacher ref8 vocab.txt -epochs 6 -batch 8 -reference > ref8.out 2>&1
+./distill.+x teacher fast8 vocab.txt -epochs 6 -batch 8 -threads 4 -topk 0 > fast8.out 2>&1
+same_curve ref8 fast8 1e-4
+check $? "minibatches of 8 over 4 threads: loss curve matches the reference"
+awk 'NR == 1 { first = $2 } END { exit !($2 < first) }' fast8/distill_loss.txt
+check $? "the loss goes down ($(head -1 fast8/distill_loss.txt | cut -d' ' -f2) -> $(tail -1 fast8/distill_loss.txt | cut -d' ' -f2))"
+
+grep -q "6 teacher passes" ref8.out && grep -q "^Teacher logits: 117 tokens" fast8.out && grep -q "0 teacher passes" fast8.out
+check $? "the reference runs the teacher every epoch, the runner once"
+./distill.+x teacher fast8 vocab.txt -epochs 2 -batch 8 -threads 4 -topk 0 > again.out 2>&1
+grep -q "^Teacher logits: cached" again.out
+check $? "a second run reads the teacher logits from the cache"
+sleep 0.01
+touch teacher/output_layer.txt
+./distill.+x teacher fast8 vocab.txt -epochs 1 -batch 8 -threads 4 -topk 0 > changed.out 2>&1
+grep -q "^Teacher logits: 117 tokens" changed.out
+check $? "a changed teacher model rebuilds the cache"
+
+./distill.+x teacher sparse vocab.txt -epochs 6 -batch 8 -threads 2 -topk 8 > sparse.out 2>&1
+[ "$(stat -c %s sparse/teacher_topk.kdc)" -lt "$(stat -c %s fast8/teacher_topk.kdc)" ] && awk 'NR == 1 { first = $2 } END { exit !(NR == 6 && $2 < first) }' sparse/distill_loss.txt
+check $? "a top-8 cache is smaller and still trains the student"
+[ -s sparse/output_layer.txt ] && [ -s sparse/attention_model.m.txt ] && [ -s sparse/optimizer_state.txt ]
+check $? "the student is saved with its Adam state"
+
+if [ $status -eq 0 ]; then
+    echo "Distillation checks passed."
+else
+    echo "Distillation checks FAILED."
+fi
+exit $status
@@ -4,7 +4,7 @@ echo "Testing fixes for NaN/Inf issues..."
 
 # Compile the updated code
 echo "Compiling updated code..."
-gcc -o forward_prop forward_prop.c -lm
+gcc -o forward_prop forward_prop.c -pthread -lm
 gcc -o backward_prop backward_prop.c -lm
 gcc -o optimizer optimizer.c -lm
 
@@ -0,0 +1,68 @@
+#!/bin/bash
+
+# Checks incremental generation (generator.h):
+#  - incremental and whole-prefix greedy generation give identical tokens,
+#    logits, K and V (test/generator_check.c), at every SIMD level of
+#    kernels.h
+#  - forward_prop with FORWARD_GENERATE writes the same predictions, q, k
+#    and v as a batched forward_prop over the sequence it generated, for
+#    the float and an int8 output layer
+#  - without FORWARD_GENERATE forward_prop's stage files are unchanged
+# For tokens/sec: ./test/bench_generator.sh
+# Run from the project root: ./test/test_generator.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/test/generator_check.c" -o "$WORK/generator_check.+x" -pthread -lm || { echo "Compilation of generator_check.c failed!"; exit 1; }
+for m in forward_prop quantize; do
+    gcc "$ROOT/$m.c" -o "$WORK/$m.+x" -pthread -lm || { echo "Compilation of $m.c failed!"; exit 1; }
+done
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+for level in scalar sse avx2; do
+    echo "generator_check ($level):"
+    KERNELS_SIMD=$level "$WORK/generator_check.+x" || status=1
+done
+
+cd "$WORK"
+# The similarity10 curriculum and its trained model
+C="$ROOT/curriculum/corpus]similarity10"
+cp "$C/corpus]similarity10.txt" vocab.txt
+cp "$C/attention_model.txt" "$C/mlp_model.txt" "$C/output_layer.txt" .
+./quantize.+x export int8 vocab.txt output_layer.txt q8.bin 2> /dev/null
+
+# generate <dir> <out model>: 3 prompt tokens, 30 generated
+generate() {
+    mkdir -p "$1" && cp vocab.txt "$1/"
+    FORWARD_GENERATE=30 ./forward_prop.+x "$1/vocab.txt" 2,5,1 attention_model.txt mlp_model.txt "$2" 1 2> /dev/null
+}
+for model in output_layer.txt q8.bin; do
+    generate gen $model || { check 1 "forward_prop generates with $model"; continue; }
+    # The generated sequence less its last token, as one batch
+    mkdir -p batch && cp vocab.txt batch/
+    ./forward_prop.+x batch/vocab.txt "$(head -n -1 gen/generated.txt | cut -d' ' -f1 | paste -sd,)" attention_model.txt mlp_model.txt $model 1 2> /dev/null
+    [ "$(wc -l < gen/generated.txt)" -eq 33 ] && [ "$(head -3 gen/generated.txt | cut -d' ' -f1 | paste -sd,)" = "2,5,1" ] &&
+        cmp -s gen/predictions.txt batch/predictions.txt && cmp -s gen/q.txt batch/q.txt
+    check $? "$model: generated predictions match a batched forward_prop over the sequence"
+    [ "$(wc -l < gen/k.txt)" -eq 32 ] && cmp -s gen/k.txt batch/k.txt && cmp -s gen/v.txt batch/v.txt
+    check $? "$model: k and v hold every position's projections"
+done
+
+# Without FORWARD_GENERATE the stage files are what they were
+mkdir -p plain && cp vocab.txt plain/
+./forward_prop.+x plain/vocab.txt 0-9 attention_model.txt mlp_model.txt output_layer.txt 1 2> /dev/null
+[ -f plain/attn_scores.txt ] && [ -f plain/hidden_state.txt ] && [ ! -f plain/generated.txt ] && [ "$(wc -l < plain/predictions.txt)" -eq 10 ]
+check $? "forward_prop without FORWARD_GENERATE writes the usual stage files"
+
+if [ $status -eq 0 ]; then
+    echo "Generator checks passed."
+else
+    echo "Generator checks FAILED."
+fi
+exit $status
@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# Gradient checks for the training stages:
+#  - grad_check: finite differences against the attention, MLP and output
+#    layer gradients of the training step on tiny random models, at every
+#    SIMD level of kernels.h
+#  - stage_math_check: clip_gradients, clip_gradients_2d and
+#    add_gradient_noise in backward_prop.c, adam_update and the layer
+#    clipping in optimizer.c, built from the stage sources themselves
+# For training throughput see ./test/bench_train.sh.
+# Run from the project root: ./test/test_gradients.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/test/grad_check.c" -o "$WORK/grad_check.+x" -pthread -lm || { echo "Compilation of grad_check.c failed!"; exit 1; }
+for s in backward_prop optimizer; do
+    S=$(echo $s | tr a-z A-Z)
+    gcc -O2 -DSTAGE_$S "$ROOT/test/stage_math_check.c" -o "$WORK/stage_math_$s.+x" -lm || { echo "Compilation of stage_math_check.c for $s.c failed!"; exit 1; }
+done
+
+status=0
+for level in scalar sse avx2; do
+    echo "grad_check ($level):"
+    KERNELS_SIMD=$level "$WORK/grad_check.+x" || status=1
+done
+for s in backward_prop optimizer; do
+    echo "$s.c:"
+    "$WORK/stage_math_$s.+x" || status=1
+done
+
+if [ $status -eq 0 ]; then
+    echo "Gradient checks passed."
+else
+    echo "Gradient checks FAILED."
+fi
+exit $status
@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# Checks kernels.h against the scalar softmax, layer_norm, score and logit
+# loops it replaced, at every SIMD level the CPU supports, on one thread and
+# on a pool of four. Scores and logits must match bit for bit.
+# Run from the project root: ./test/test_kernels.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/test/kernels_check.c" -o "$WORK/kernels_check.+x" -pthread -lm || { echo "Compilation of kernels_check.c failed!"; exit 1; }
+
+status=0
+for threads in 1 4; do
+    KERNELS_THREADS=$threads "$WORK/kernels_check.+x" test || status=1
+done
+
+if [ $status -eq 0 ]; then
+    echo "Kernel checks passed."
+else
+    echo "Kernel checks FAILED."
+fi
+exit $status
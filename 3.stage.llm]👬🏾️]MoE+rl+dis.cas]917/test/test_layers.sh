@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Tests for layers.h, the attention, MLP and output layer library:
+#  - layers_check: forward passes, gradients and Adam steps against copies
+#    of the math forward_prop.c, backward_prop.c and optimizer.c carried
+#    before the library, bit for bit, at every SIMD level of kernels.h
+#  - every program that includes layers.h still builds
+# The stages against the in-process trainer: ./test/test_train_engine.sh.
+# Run from the project root: ./test/test_layers.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/test/layers_check.c" -o "$WORK/layers_check.+x" -pthread -lm || { echo "Compilation of layers_check.c failed!"; exit 1; }
+
+status=0
+for level in scalar sse avx2; do
+    echo "layers_check ($level):"
+    KERNELS_SIMD=$level "$WORK/layers_check.+x" || status=1
+done
+
+echo "programs using layers.h:"
+for f in $(grep -l '#include "layers.h"' "$ROOT"/*.c); do
+    name=$(basename "$f" .c)
+    if gcc -O2 "$f" -o "$WORK/$name.+x" -pthread -lm 2>"$WORK/$name.log"; then
+        echo "✓ $name.c builds"
+    else
+        echo "✗ $name.c does not build:"; cat "$WORK/$name.log"; status=1
+    fi
+done
+for src in "$ROOT/trainer.c" "$ROOT/test/grad_check.c"; do
+    name=$(basename "$src" .c)
+    if gcc -O2 "$src" -o "$WORK/$name.+x" -pthread -lm 2>"$WORK/$name.log"; then
+        echo "✓ $name.c builds on train_engine.h"
+    else
+        echo "✗ $name.c does not build:"; cat "$WORK/$name.log"; status=1
+    fi
+done
+
+if [ $status -eq 0 ]; then
+    echo "Layer library tests passed."
+else
+    echo "Layer library tests FAILED."
+fi
+exit $status
@@ -0,0 +1,62 @@
+#!/bin/bash
+
+# Checks the sparse expert routing (moe_router.h) behind predict_next_word:
+#  - routing to every expert returns the same top N as one tree over the
+#    merged vocabulary, at f32, int8 and fp16; routing to k experts returns
+#    the top N among their words only; the load statistics add up; a bank
+#    of 100 experts keeps every one
+#  - the chatbot generates with CHATBOT_MOE_TOPK=1 over a three-curriculum
+#    bank, reports the expert load and traces it; with k at least the
+#    number of curricula it answers exactly as with routing off
+# For throughput by expert count see ./test/bench_moe.sh.
+# Run from the project root: ./test/test_moe_router.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/test/moe_check.c" -o "$WORK/moe_check.+x" -lm || { echo "Compilation of moe_check.c failed!"; exit 1; }
+gcc "$ROOT/vocab_model.c" -o "$WORK/vocab_model.+x" -lm || { echo "Compilation of vocab_model.c failed!"; exit 1; }
+gcc "$ROOT/chatbot_moe_v1.c" -o "$WORK/chatbot_moe_v1.+x" -pthread -lm || { echo "Compilation of chatbot_moe_v1.c failed!"; exit 1; }
+gcc "$ROOT/trace_reader.c" -o "$WORK/trace_reader.+x" -pthread || { echo "Compilation of trace_reader.c failed!"; exit 1; }
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+"$WORK/moe_check.+x" test || status=1
+
+cd "$WORK"
+cp "$ROOT/corpuses/corpus_yang.txt" "$ROOT/corpuses/corpus_ying.txt" .
+head -c 6000 "$ROOT/corpuses/iching.txt" > iching.txt
+for c in corpus_yang corpus_ying iching; do
+    ./vocab_model.+x $c.txt > /dev/null 2>&1 || { echo "Vocabulary build for $c failed!"; exit 1; }
+    echo "$WORK/curriculum/$c/$c.txt" >> bank.txt
+done
+
+CHATBOT_MOE_TOPK=1 ./chatbot_moe_v1.+x bank.txt "the" 12 1 7 > out.txt 2> err.txt
+grep -q "Response: [^ ]" out.txt && grep -q "^Experts: top 1 of 3 for [1-9][0-9]* tokens" err.txt
+check $? "chatbot generates from the top expert and reports the load"
+tokens=$(sed -nE 's/^Experts: top 1 of 3 for ([0-9]+) tokens.*/\1/p' err.txt)
+routed=$(grep -E "^  [0-9]+\. [0-9]+ routed" err.txt | awk '{ s += $2 } END { print s }')
+[ "$(grep -cE "^  [0-9]+\. [0-9]+ routed, mean gate" err.txt)" -eq 3 ] && [ "$routed" = "$tokens" ]
+check $? "every token is routed to one of the three experts ($routed of $tokens)"
+./trace_reader.+x | grep -q "^=== Expert Load (top 1 of 3, $tokens tokens) ===$"
+check $? "the trace records the expert load"
+
+for k in 0 3 8; do
+    CHATBOT_MOE_TOPK=$k ./chatbot_moe_v1.+x bank.txt "the" 12 1 7 > out$k.txt 2> err$k.txt
+done
+cmp -s out0.txt out3.txt && cmp -s out0.txt out8.txt && ! grep -q "^Experts:" err0.txt err3.txt err8.txt
+check $? "routing to every expert answers exactly as one tree over the merged vocabulary"
+CHATBOT_MOE_TOPK=2 CHATBOT_QUANT=int8 ./chatbot_moe_v1.+x bank.txt "the" 12 1 7 > out.txt 2> err.txt
+grep -q "Response: [^ ]" out.txt && grep -q "^Experts: top 2 of 3" err.txt
+check $? "chatbot generates from int8 expert trees"
+
+if [ $status -eq 0 ]; then
+    echo "Expert routing checks passed."
+else
+    echo "Expert routing checks FAILED."
+fi
+exit $status
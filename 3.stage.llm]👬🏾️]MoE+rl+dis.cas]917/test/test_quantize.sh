@@ -0,0 +1,88 @@
+#!/bin/bash
+
+# Checks the int8 / fp16 inference storage (quant.h, quantize.c):
+#  - conversions, kernels and the quantized k-d tree (test/quant_check.c)
+#  - quantize export writes smaller tables that forward_prop runs on,
+#    predicting the same top word as the float model for nearly every token,
+#    also when fp16 has to saturate weights past 65504
+#  - the chatbot generates with CHATBOT_QUANT=int8 and fp16
+#  - quantize report compares memory, speed and top-1 agreement
+# Run from the project root: ./test/test_quantize.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 "$ROOT/test/quant_check.c" -o "$WORK/quant_check.+x" -pthread -lm || { echo "Compilation of quant_check.c failed!"; exit 1; }
+for m in quantize forward_prop tensor_convert chatbot_moe_v1; do
+    gcc "$ROOT/$m.c" -o "$WORK/$m.+x" -pthread -lm || { echo "Compilation of $m.c failed!"; exit 1; }
+done
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+for threads in 1 4; do
+    KERNELS_THREADS=$threads "$WORK/quant_check.+x" || status=1
+done
+
+cd "$WORK"
+# A fixed copy of the similarity10 curriculum and its trained model; the
+# one under curriculum/ is retrained by other scripts
+C="$ROOT/test/data/similarity10"
+cp "$C/corpus]similarity10.txt" vocab.txt
+cp "$C/attention_model.txt" "$C/mlp_model.txt" "$C/output_layer.txt" .
+words=$(($(wc -l < vocab.txt) - 1))
+
+./quantize.+x export int8 vocab.txt output_layer.txt q8.bin 2> /dev/null &&
+    ./quantize.+x export fp16 vocab.txt output_layer.txt q16.bin 2> /dev/null &&
+    ./tensor_convert.+x to-bin output output_layer.txt f32.bin 2> /dev/null
+./tensor_convert.+x info q8.bin | grep -q "weights    i8  16x$words" && ./tensor_convert.+x info q16.bin | grep -q "embeddings f16 ${words}x7" &&
+    [ "$(stat -c %s q8.bin)" -lt "$(stat -c %s q16.bin)" ] && [ "$(stat -c %s q16.bin)" -lt "$(stat -c %s f32.bin)" ]
+check $? "export writes int8 and fp16 files smaller than the float output layer alone"
+./tensor_convert.+x to-text q8.bin q8.txt 2> /dev/null
+[ "$(wc -l < q8.txt)" -eq 17 ] && awk -v n="$words" '{ if (NF != n) bad++ } END { exit bad > 0 }' q8.txt
+check $? "to-text turns a quantized file into a dequantized output layer"
+
+# predict <dir> <out model>: forward pass over every word, one argmax per row
+predict() {
+    mkdir -p "$1" && cp vocab.txt "$1/"
+    ./forward_prop.+x "$1/vocab.txt" 0-$((words - 1)) attention_model.txt mlp_model.txt "$2" 1 2> /dev/null &&
+        awk '{ b = 1; for (i = 2; i <= NF; i++) if ($i > $b) b = i; print b }' "$1/predictions.txt"
+}
+predict f32 output_layer.txt > f32.top
+for q in q8 q16; do
+    predict $q $q.bin > $q.top
+    agree=$(paste f32.top $q.top | awk '$1 == $2 { n++ } END { print n + 0 }')
+    [ "$(wc -l < $q.top)" -eq "$words" ] && [ $((agree * 100)) -ge $((words * 95)) ]
+    check $? "forward_prop on $q.bin picks the float model's top word for $agree of $words tokens"
+done
+
+# The same model with its largest weights pushed past the fp16 range
+awk '{ for (i = 1; i <= NF; i++) $i *= 1.25; print }' output_layer.txt > big_layer.txt
+./quantize.+x export fp16 vocab.txt big_layer.txt big16.bin 2> big16.log
+predict fbig big_layer.txt > fbig.top
+predict qbig big16.bin > qbig.top
+agree=$(paste fbig.top qbig.top | awk '$1 == $2 { n++ } END { print n + 0 }')
+grep -q "saturate at +-65504" big16.log && [ $((agree * 100)) -ge $((words * 95)) ]
+check $? "fp16 export warns about weights past 65504 and saturates them: $agree of $words tokens agree"
+
+printf "%s\n" "$ROOT/curriculum/test_emoji/test_emoji.txt" > bank.txt
+for q in int8 fp16; do
+    CHATBOT_QUANT=$q CHATBOT_TRACE=0 ./chatbot_moe_v1.+x bank.txt "hello" 5 1 1 > chat_$q.out 2> /dev/null
+    grep -q "Response: [^ ]" chat_$q.out
+    check $? "chatbot generates with CHATBOT_QUANT=$q"
+done
+
+./quantize.+x report vocab.txt output_layer.txt 2000 > report.txt
+awk '$1 == "int8" || $1 == "fp16" { rows++; if ($4 + 0 <= 1 || $6 + 0 < 90 || $8 + 0 < 90) bad++ } END { exit bad > 0 || rows != 2 }' report.txt
+check $? "report: both storages save memory and agree on at least 90% of top-1 words"
+cat report.txt
+
+if [ $status -eq 0 ]; then
+    echo "Quantization checks passed."
+else
+    echo "Quantization checks FAILED."
+fi
+exit $status
@@ -0,0 +1,82 @@
+#!/bin/bash
+
+# Checks the output softmax modes selected by softmax= in config.txt:
+#  - softmax=full (and no softmax key) trains exactly like the spawned
+#    forward_prop/backward_prop/optimizer chain, i.e. full mode is unchanged
+#  - softmax=sampled and softmax=hierarchical train with finite losses that
+#    go down, and trainer -eval reports a finite perplexity
+#  - after hierarchical training forward_prop's predictions are tree
+#    log-probabilities that sum to 1, and a later full run drops the tree
+# Run from the project root: ./test/test_softmax_modes.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+echo "Compiling trainer and stage programs into $WORK/+x..."
+mkdir -p "$WORK/+x"
+for m in trainer forward_prop backward_prop optimizer; do
+    gcc "$ROOT/$m.c" -o "$WORK/+x/$m.+x" -pthread -lm || { echo "Compilation of $m.c failed!"; exit 1; }
+done
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+cd "$WORK"
+mkdir -p base
+cp "$ROOT/curriculum/test_emoji/test_emoji.txt" base/vocab.txt
+printf "epochs=0\n" > base/config.txt
+./+x/trainer.+x base/vocab.txt 2>/dev/null || { echo "Model initialization failed!"; exit 1; }
+for d in spawn default full sampled hierarchical; do
+    mkdir -p $d
+    cp base/vocab.txt base/attention_model.txt base/mlp_model.txt base/output_layer.txt $d/
+done
+# text_compat=1 so softmax=full can be compared with the spawned chain
+COMMON="epochs=3\nlearning_rate=0.01\ncausal_attention=1\ntext_compat=1\n"
+printf "$COMMON" > spawn/config.txt
+printf "$COMMON" > default/config.txt
+printf "${COMMON}softmax=full\n" > full/config.txt
+printf "${COMMON}softmax=sampled\nsoftmax_samples=8\n" > sampled/config.txt
+printf "${COMMON}softmax=hierarchical\n" > hierarchical/config.txt
+
+./+x/trainer.+x spawn/vocab.txt -spawn 2>/dev/null || { echo "Spawned training failed!"; exit 1; }
+for d in default full sampled hierarchical; do
+    ./+x/trainer.+x $d/vocab.txt 2>/dev/null || { echo "Training with $d softmax failed!"; exit 1; }
+done
+
+same=0
+for f in attention_model.txt mlp_model.txt output_layer.txt output_layer.m.txt output_layer.v.txt loss.txt; do
+    cmp -s spawn/$f full/$f && cmp -s default/$f full/$f || same=1
+done
+check $same "softmax=full matches the default and the spawned stage chain"
+
+for d in sampled hierarchical; do
+    awk 'NR == 1 { first = $1 } { last = $1; if ($1 != $1 + 0 || $1 ~ /nan|inf/) bad = 1 }
+         END { exit !(NR == 3 && !bad && last < first) }' $d/loss.txt
+    check $? "softmax=$d loss is finite and decreasing ($(tr '\n' ' ' < $d/loss.txt))"
+    EVAL=$(./+x/trainer.+x $d/vocab.txt -eval 2>/dev/null)
+    echo "$EVAL" | awk -F'perplexity=' '{ exit !($2 + 0 > 1 && $2 !~ /nan|inf/) }'
+    check $? "trainer -eval after softmax=$d: $EVAL"
+done
+
+[ -f hierarchical/softmax_tree.txt ] && [ ! -f sampled/softmax_tree.txt ]
+check $? "only hierarchical training writes softmax_tree.txt"
+
+VS=$(($(wc -l < hierarchical/vocab.txt) - 1))
+./+x/forward_prop.+x hierarchical/vocab.txt 0-2 hierarchical/attention_model.txt hierarchical/mlp_model.txt hierarchical/output_layer.txt 1 2>/dev/null
+awk '{ s = 0; for (i = 1; i <= NF; i++) s += exp($i); if (s < 0.999 || s > 1.001) bad = 1 } END { exit !(NR == 3 && !bad) }' hierarchical/predictions.txt
+check $? "forward_prop decodes the tree into log-probabilities summing to 1"
+
+sed -i 's/softmax=hierarchical/softmax=full/; s/epochs=3/epochs=1/' hierarchical/config.txt
+./+x/trainer.+x hierarchical/vocab.txt 2>/dev/null
+[ ! -f hierarchical/softmax_tree.txt ]
+check $? "switching back to softmax=full removes the stale tree"
+
+if [ $status -eq 0 ]; then
+    echo "Softmax mode checks passed."
+else
+    echo "Softmax mode checks FAILED."
+fi
+exit $status
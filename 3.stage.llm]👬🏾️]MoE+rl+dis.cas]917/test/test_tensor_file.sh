@@ -0,0 +1,97 @@
+#!/bin/bash
+
+# Checks the binary tensor format (tensor_file.h):
+#  1. text -> .bin -> text round trips the model files exactly
+#  2. the spawned stages with binary_io=1 match the in-process engine
+#     (both skip text rounding, so the weights must be bit identical)
+#  3. the binary model files are smaller than the text ones
+#  4. headers whose shapes don't match their data are refused, and so are
+#     files from a host of the other byte order
+# Run from the project root: ./test/test_tensor_file.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+echo "Compiling trainer, stages and converter into $WORK/+x..."
+mkdir -p "$WORK/+x"
+for m in trainer forward_prop backward_prop optimizer tensor_convert; do
+    gcc "$ROOT/$m.c" -o "$WORK/+x/$m.+x" -pthread -lm || { echo "Compilation of $m.c failed!"; exit 1; }
+done
+
+mkdir -p "$WORK/text" "$WORK/spawn" "$WORK/engine"
+cd "$WORK"
+cp "$ROOT/curriculum/test_emoji/test_emoji.txt" text/vocab.txt
+printf "epochs=0\n" > text/config.txt
+./+x/trainer.+x text/vocab.txt 2>/dev/null || { echo "Model initialization failed!"; exit 1; }
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+# 1. Round trip through the converter
+for pair in attention:attention_model mlp:mlp_model output:output_layer; do
+    kind=${pair%%:*}; name=${pair#*:}
+    ./+x/tensor_convert.+x to-bin $kind text/$name.txt spawn/$name.bin 2>/dev/null &&
+    ./+x/tensor_convert.+x to-text spawn/$name.bin text/$name.back.txt 2>/dev/null &&
+    cmp -s text/$name.txt text/$name.back.txt
+    check $? "$name.txt survives text -> bin -> text"
+done
+
+# 3. Size
+txt_size=$(cat text/output_layer.txt | wc -c)
+bin_size=$(cat spawn/output_layer.bin | wc -c)
+echo "  output_layer: $txt_size bytes as text, $bin_size bytes as tensor file"
+[ "$bin_size" -lt "$txt_size" ]
+check $? "tensor file is smaller than text"
+
+# 2. Binary spawned pipeline vs in-process engine
+cp text/vocab.txt spawn/
+printf "epochs=2\nlearning_rate=0.01\ncausal_attention=1\nbinary_io=1\n" > spawn/config.txt
+cp spawn/vocab.txt spawn/config.txt spawn/attention_model.bin spawn/mlp_model.bin spawn/output_layer.bin engine/
+
+echo "Training with spawned stages (binary_io=1)..."
+./+x/trainer.+x spawn/vocab.txt -spawn 2>/dev/null || { echo "Spawned training failed!"; exit 1; }
+echo "Training in process (binary_io=1)..."
+./+x/trainer.+x engine/vocab.txt 2>/dev/null || { echo "In-process training failed!"; exit 1; }
+
+[ -f spawn/predictions.bin ] && [ ! -f spawn/predictions.txt ]
+check $? "stage files are written as tensor files"
+for f in attention_model.bin mlp_model.bin output_layer.bin \
+         attention_model.m.bin attention_model.v.bin mlp_model.m.bin mlp_model.v.bin \
+         output_layer.m.bin output_layer.v.bin optimizer_state.txt loss.txt; do
+    cmp -s "spawn/$f" "engine/$f"
+    check $? "$f identical"
+done
+
+# 4. Corrupt headers. The first entry starts at byte 32: ndim at 60,
+# shape at 64 and 68. Each must be refused before anything reads the data.
+./+x/tensor_convert.+x info spawn/output_layer.bin >/dev/null 2>&1
+check $? "an intact tensor file opens"
+corrupt() {
+    cp spawn/output_layer.bin bad.bin
+    printf "$2" | dd of=bad.bin bs=1 seek=$1 conv=notrunc 2>/dev/null
+    ! ./+x/tensor_convert.+x to-text bad.bin bad.txt 2>/dev/null
+    check $? "$3"
+}
+corrupt 64 '\xff\xff\x00\x00' "a shape larger than the bytes it claims is refused"
+corrupt 68 '\x01\x00\x00\x00' "a shape smaller than the bytes it claims is refused"
+corrupt 60 '\x03\x00\x00\x00' "ndim other than 1 or 2 is refused"
+
+# The byte order marker is the header's last field, at byte 28
+od -An -tx1 -j28 -N4 spawn/output_layer.bin | tr -d ' \n' | grep -qx 04030201
+check $? "the header stores the byte order marker (host order, little-endian here)"
+corrupt 28 '\x01\x02\x03\x04' "a file written on a host of the other byte order is refused"
+cp spawn/output_layer.bin old.bin
+printf '\x00\x00\x00\x00' | dd of=old.bin bs=1 seek=28 conv=notrunc 2>/dev/null
+./+x/tensor_convert.+x to-text spawn/output_layer.bin new.txt 2>/dev/null &&
+./+x/tensor_convert.+x to-text old.bin old.txt 2>/dev/null && cmp -s old.txt new.txt
+check $? "a file from before the marker still opens"
+
+if [ $status -eq 0 ]; then
+    echo "Tensor file format checks passed."
+else
+    echo "Tensor file format checks FAILED."
+fi
+exit $status
@@ -0,0 +1,107 @@
+#!/bin/bash
+
+# Checks the buffered chatbot trace (trace.h) and trace_reader:
+#  - the rendered chain has the old debug_chain.txt layout: header, one
+#    block per generated word with candidates and experts, final response
+#  - CHATBOT_TRACE levels 0-2 leave out what they should
+#  - under a burst of events every record is either written in order or
+#    counted as dropped, and nothing is lost at close
+# Run from the project root: ./test/test_trace.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc "$ROOT/chatbot_moe_v1.c" -o "$WORK/chatbot_moe_v1.+x" -pthread -lm || { echo "Compilation of chatbot_moe_v1.c failed!"; exit 1; }
+gcc "$ROOT/trace_reader.c" -o "$WORK/trace_reader.+x" -pthread || { echo "Compilation of trace_reader.c failed!"; exit 1; }
+
+# Emits argv[2] numbered records as fast as it can, then reads the file
+# back and prints "<records> <dropped> <in order>"
+cat > "$WORK/trace_burst.c" <<'EOF'
+#include "trace.h"
+
+int main(int argc, char **argv) {
+    Tracer t;
+    int n = atoi(argv[2]);
+    if (!trace_open(&t, argv[1], TRACE_CANDIDATES)) return 1;
+    TraceRecord r;
+    for (int i = 0; i < n; i++) {
+        trace_begin(&r, TRACE_RESPONSE);
+        trace_put_str(&r, "padding padding padding padding padding padding padding padding");
+        trace_put_i32(&r, i);
+        trace_emit(&t, &r);
+    }
+    trace_close(&t);
+
+    FILE *f = fopen(argv[1], "rb");
+    static unsigned char buf[TRACE_MAX_RECORD];
+    char s[128];
+    TraceCursor c;
+    long records = 0, dropped = 0, last = -1, ordered = trace_read_header(f);
+    while (trace_read_record(f, &c, buf)) {
+        if (c.type == TRACE_DROPPED) { uint64_t d; trace_get(&c, &d, 8); dropped += d; continue; }
+        trace_get_str(&c, s, sizeof(s));
+        int id = trace_get_i32(&c);
+        ordered &= id > last;
+        last = id;
+        records++;
+    }
+    fclose(f);
+    printf("%ld %ld %ld\n", records, dropped, ordered);
+    return 0;
+}
+EOF
+gcc -O2 -I"$ROOT" "$WORK/trace_burst.c" -o "$WORK/trace_burst.+x" -pthread || { echo "Compilation of the burst check failed!"; exit 1; }
+cd "$WORK"
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+printf "%s\n" "$ROOT/curriculum/test_emoji/test_emoji.txt" > bank.txt
+
+./chatbot_moe_v1.+x bank.txt "hello" 4 1 > out.txt 2> /dev/null
+./trace_reader.+x debug_chain.trace chain.txt
+[ "$(head -1 chain.txt)" = "=== Chatbot MOE Debug Log ===" ] && grep -q "^Prompt: hello$" chain.txt && grep -q "^Using 1 training sets:$" chain.txt
+check $? "chain starts with the session header"
+# Every response word was predicted in its own step, plus the last
+# prediction (end-token or past the length limit)
+response=$(sed -n '/^=== Final Response ===$/{n;p}' chain.txt)
+words=$(echo $response | wc -w)
+steps=$(grep -c "^Chosen word:" chain.txt)
+[ "$steps" -ge $((words + 1)) ] && [ "$(grep -c "^Debug: Current word:" chain.txt)" -eq "$steps" ] && [ "$(grep -c "^  [0-9]*\. .*(p=" chain.txt)" -eq $((steps * 10)) ] && [ "$(grep -c "^    experts: 1(#" chain.txt)" -eq "$steps" ]
+check $? "one block per predicted word with 10 candidates and the chosen word's experts"
+grep -q "Response: $response" out.txt
+check $? "final response matches what the chatbot printed"
+
+CHATBOT_TRACE=2 ./chatbot_moe_v1.+x bank.txt "hello" 4 1 > /dev/null 2>&1
+./trace_reader.+x > chain2.txt
+[ "$(grep -c "^Chosen word:" chain2.txt)" -ge 1 ] && ! grep -q "(p=" chain2.txt
+check $? "level 2 keeps chosen words but no candidates"
+CHATBOT_TRACE=1 ./chatbot_moe_v1.+x bank.txt "hello" 4 1 > /dev/null 2>&1
+./trace_reader.+x > chain1.txt
+! grep -q "Chosen word" chain1.txt && grep -q "=== Final Response ===" chain1.txt
+check $? "level 1 keeps only the prompt and the response"
+rm -f debug_chain.trace
+CHATBOT_TRACE=0 ./chatbot_moe_v1.+x bank.txt "hello" 4 1 > out.txt 2>&1
+[ ! -e debug_chain.trace ] && grep -q "Response:" out.txt
+check $? "level 0 writes no trace"
+CHATBOT_TRACE_FILE=other.trace ./chatbot_moe_v1.+x bank.txt "hello" 4 1 > /dev/null 2>&1
+[ ! -e debug_chain.trace ] && ./trace_reader.+x other.trace | grep -q "Final Response"
+check $? "CHATBOT_TRACE_FILE redirects the trace"
+
+printf "not a trace" > bogus.trace
+! ./trace_reader.+x bogus.trace > /dev/null 2>&1
+check $? "reader rejects a file that is not a trace"
+
+read records dropped ordered < <(./trace_burst.+x burst.trace 200000)
+[ $((records + dropped)) -eq 200000 ] && [ "$ordered" -eq 1 ]
+check $? "burst of 200000 events: $records written in order, $dropped counted as dropped"
+
+if [ $status -eq 0 ]; then
+    echo "Trace checks passed."
+else
+    echo "Trace checks FAILED."
+fi
+exit $status
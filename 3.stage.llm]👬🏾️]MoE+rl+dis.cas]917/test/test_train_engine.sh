@@ -0,0 +1,52 @@
+#!/bin/bash
+
+# Compares the in-process training engine against the spawned
+# forward_prop/backward_prop/optimizer chain on a small curriculum.
+# Both runs start from the same model files and must write identical
+# weights, Adam moments and loss values.
+# Run from the project root: ./test/test_train_engine.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+echo "Compiling trainer and stage programs into $WORK/+x..."
+mkdir -p "$WORK/+x"
+for m in trainer forward_prop backward_prop optimizer; do
+    gcc "$ROOT/$m.c" -o "$WORK/+x/$m.+x" -pthread -lm || { echo "Compilation of $m.c failed!"; exit 1; }
+done
+
+# Small vocabulary from the test corpus
+mkdir -p "$WORK/spawn" "$WORK/engine"
+cd "$WORK"
+cp "$ROOT/curriculum/test_emoji/test_emoji.txt" spawn/vocab.txt
+printf "epochs=0\n" > spawn/config.txt
+./+x/trainer.+x spawn/vocab.txt 2>/dev/null || { echo "Model initialization failed!"; exit 1; }
+rm -f spawn/loss.txt
+
+printf "epochs=3\nlearning_rate=0.01\ncausal_attention=1\ncheckpoint_interval=1\ntext_compat=1\n" > spawn/config.txt
+cp spawn/vocab.txt spawn/config.txt spawn/attention_model.txt spawn/mlp_model.txt spawn/output_layer.txt engine/
+
+echo "Training with spawned stages..."
+./+x/trainer.+x spawn/vocab.txt -spawn 2>/dev/null || { echo "Spawned training failed!"; exit 1; }
+echo "Training in process..."
+./+x/trainer.+x engine/vocab.txt 2>/dev/null || { echo "In-process training failed!"; exit 1; }
+
+status=0
+for f in attention_model.txt mlp_model.txt output_layer.txt \
+         attention_model.m.txt attention_model.v.txt mlp_model.m.txt mlp_model.v.txt \
+         output_layer.m.txt output_layer.v.txt optimizer_state.txt loss.txt vocab.txt; do
+    if cmp -s "spawn/$f" "engine/$f"; then
+        echo "✓ $f identical"
+    else
+        echo "✗ $f differs"
+        status=1
+    fi
+done
+
+if [ $status -eq 0 ]; then
+    echo "In-process engine matches the spawned pipeline."
+else
+    echo "In-process engine does NOT match the spawned pipeline."
+fi
+exit $status
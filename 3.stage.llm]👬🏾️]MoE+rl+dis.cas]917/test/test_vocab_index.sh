@@ -0,0 +1,114 @@
+#!/bin/bash
+
+# Checks the merged vocabulary index (vocab_index.h) used by chatbot_moe_v1:
+#  - words shared by several curricula become one entry, keeping the values
+#    of their first occurrence in bank order
+#  - each entry lists every expert holding it, with row number and count
+#  - every word resolves to its own id through the hash table
+#  - the index is reused while the curricula are unchanged and rebuilt when
+#    one of them or the bank changes, and a missing curriculum doesn't
+#    force a rebuild until it appears
+#  - rows missing any of the nine fields are skipped
+# Run from the project root: ./test/test_vocab_index.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc "$ROOT/chatbot_moe_v1.c" -o "$WORK/chatbot_moe_v1.+x" -pthread -lm || { echo "Compilation of chatbot_moe_v1.c failed!"; exit 1; }
+gcc "$ROOT/trace_reader.c" -o "$WORK/trace_reader.+x" -pthread || { echo "Compilation of trace_reader.c failed!"; exit 1; }
+
+# Prints "id word embedding expert:number:occurrences..." for every entry,
+# and "lookup ok" if each word hashes back to its own id
+cat > "$WORK/dump_index.c" <<'EOF'
+#include <stdio.h>
+struct VocabEntry {
+    int number;
+    char word[100];
+    float embedding, pe, weight, bias1, bias2, bias3, bias4;
+};
+#include "vocab_index.h"
+
+int main(int argc, char **argv) {
+    static char paths[8][VOCAB_INDEX_PATH_LEN];
+    for (int i = 2; i < argc; i++) strncpy(paths[i - 2], argv[i], VOCAB_INDEX_PATH_LEN - 1);
+    VocabIndex vi;
+    if (!vocab_index_open(argv[1], &vi, paths, argc - 2)) { printf("stale\n"); return 1; }
+    int lookup_ok = vocab_index_find(&vi, "not-a-word") == -1;
+    for (int i = 0; i < vi.count; i++) {
+        int n;
+        const VocabIndexProvenance *p = vocab_index_provenance(&vi, i, &n);
+        printf("%d %s %f", i, vi.entries[i].word, vi.entries[i].embedding);
+        for (int j = 0; j < n; j++) printf(" %u:%u:%u", p[j].source, p[j].number, p[j].occurrences);
+        printf("\n");
+        lookup_ok &= vocab_index_find(&vi, vi.entries[i].word) == i;
+    }
+    if (lookup_ok) printf("lookup ok\n");
+    vocab_index_close(&vi);
+    return 0;
+}
+EOF
+gcc -I"$ROOT" "$WORK/dump_index.c" -o "$WORK/dump_index.+x" || { echo "Compilation of the index dump failed!"; exit 1; }
+cd "$WORK"
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+
+HEADER="number word embedding pe weight bias1 bias2 bias3 bias4"
+printf "%s\n1 start-token 0.1 0 0 0 0 0 0\n2 hello 0.2 0 0 0 0 0 0\n3 world 0.3 0 0 0 0 0 0\n4 end-token 0.4 0 0 0 0 0 0\n" "$HEADER" > a.txt
+printf "%s\n1 start-token 0.5 0 0 0 0 0 0\n2 world 0.6 0 0 0 0 0 0\n3 moon 0.7 0 0 0 0 0 0\n4 world 0.6 0 0 0 0 0 0\n5 end-token 0.8 0 0 0 0 0 0\n" "$HEADER" > b.txt
+printf "%s\n%s\n" "$WORK/a.txt" "$WORK/b.txt" > bank.txt
+
+./chatbot_moe_v1.+x bank.txt "moon" 3 1 > /dev/null 2> first.log
+[ -f bank.vidx ] && grep -q "Building vocabulary index" first.log
+check $? "index is built next to the bank file"
+grep -q "Merged vocabulary size: 5" first.log
+check $? "9 rows over two curricula merge into 5 distinct words"
+./trace_reader.+x | grep -q "Current word: moon"
+check $? "a prompt word only one expert knows is resolved"
+
+./dump_index.+x bank.vidx "$WORK/a.txt" "$WORK/b.txt" > dump.txt
+[ "$(awk '$2=="world"{print $3}' dump.txt)" = "0.300000" ] && [ "$(awk '$2=="start-token"{print $3}' dump.txt)" = "0.100000" ]
+check $? "shared words keep their first-seen values"
+[ "$(awk '$2=="world"{print $4, $5}' dump.txt)" = "0:3:1 1:2:2" ] && [ "$(awk '$2=="moon"{print $4, $5}' dump.txt)" = "1:3:1 " ]
+check $? "provenance lists each expert with row number and occurrences"
+grep -q "lookup ok" dump.txt
+check $? "every word hashes back to its own id"
+
+./chatbot_moe_v1.+x bank.txt "hello" 3 1 > /dev/null 2> second.log
+! grep -q "Building vocabulary index" second.log && grep -q "Merged vocabulary size: 5" second.log
+check $? "unchanged curricula reuse the mapped index"
+
+printf "6 comet 0.9 0 0 0 0 0 0\n" >> b.txt
+./chatbot_moe_v1.+x bank.txt "hello" 3 1 > /dev/null 2> third.log
+grep -q "Building vocabulary index" third.log && grep -q "Merged vocabulary size: 6" third.log
+check $? "a changed curriculum triggers a rebuild"
+
+printf "%s\n" "$WORK/b.txt" > bank.txt
+./chatbot_moe_v1.+x bank.txt "hello" 3 1 > /dev/null 2> fourth.log
+grep -q "Building vocabulary index" fourth.log && grep -q "Merged vocabulary size: 5" fourth.log
+check $? "a different bank triggers a rebuild"
+
+printf "%s\n%s\n" "$WORK/b.txt" "$WORK/missing.txt" > bank.txt
+./chatbot_moe_v1.+x bank.txt "hello" 3 1 > /dev/null 2> fifth.log
+./chatbot_moe_v1.+x bank.txt "hello" 3 1 > /dev/null 2> sixth.log
+grep -q "Building vocabulary index" fifth.log && ! grep -q "Building vocabulary index" sixth.log
+check $? "a curriculum that is still missing doesn't force a rebuild"
+printf "%s\n1 comet 0.9 0 0 0 0 0 0\n2 star 1.0 0 0 0 0 0 0\n" "$HEADER" > missing.txt
+./chatbot_moe_v1.+x bank.txt "hello" 3 1 > /dev/null 2> seventh.log
+grep -q "Building vocabulary index" seventh.log && grep -q "Merged vocabulary size: 6" seventh.log
+check $? "and one that appears does"
+
+printf "7 partial 0.5 0.1\n" >> missing.txt
+./chatbot_moe_v1.+x bank.txt "hello" 3 1 > /dev/null 2> eighth.log
+grep -q "missing.txt:4: skipping a row with 4 of 9 fields" eighth.log && grep -q "Merged vocabulary size: 6" eighth.log
+check $? "a row missing fields is skipped, not merged with stale values"
+
+if [ $status -eq 0 ]; then
+    echo "Vocabulary index checks passed."
+else
+    echo "Vocabulary index checks FAILED."
+fi
+exit $status
@@ -0,0 +1,61 @@
+#!/bin/bash
+
+# Checks the hashed vocabulary builder in vocab_model.c:
+#  - every word appears once, with its true frequency in the counts file
+#  - token ids are stable (first-seen order) however often the corpus repeats
+#  - words are not cut at READ_CHUNK_SIZE boundaries
+#  - -min-count prunes rare words, -sequence keeps one row per occurrence
+# Run from the project root: ./test/test_vocab_model.sh
+
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc "$ROOT/vocab_model.c" -o "$WORK/vocab_model.+x" || { echo "Compilation of vocab_model.c failed!"; exit 1; }
+cd "$WORK"
+
+status=0
+check() {
+    if [ "$1" -eq 0 ]; then echo "✓ $2"; else echo "✗ $2"; status=1; fi
+}
+words() { tail -n +2 "$1" | awk '{print $2}'; }
+
+printf "the cat sat. the cat ran! a dog sat\n" > small.txt
+VOCAB=$(./vocab_model.+x small.txt 2>/dev/null)
+COUNTS=${VOCAB%.txt}.counts.txt
+
+[ "$(words "$VOCAB" | tr '\n' ' ')" = "start-token the cat sat end-token ran a dog " ]
+check $? "one row per word in first-seen order"
+[ "$(grep -c . "$VOCAB")" -eq 9 ] && [ "$(awk '$2=="cat"{print $3}' "$COUNTS")" = "2" ] && [ "$(awk '$2=="end-token"{print $3}' "$COUNTS")" = "3" ]
+check $? "counts file holds true frequencies"
+
+# The same text 2000 times over (~72KB) spans several read chunks
+for i in $(seq 2000); do cat small.txt; done > repeated.txt
+VOCAB_R=$(./vocab_model.+x repeated.txt 2>/dev/null)
+[ "$(words "$VOCAB_R")" = "$(words "$VOCAB")" ]
+check $? "ids are stable when the corpus repeats"
+[ "$(awk '$2=="cat"{print $3}' "${VOCAB_R%.txt}.counts.txt")" = "4000" ]
+check $? "counts are exact across chunk boundaries"
+
+# A word straddling the 64KB chunk boundary must come out whole
+{ head -c 65530 /dev/zero | tr '\0' ' '; printf "boundaryword tail\n"; } > boundary.txt
+VOCAB_B=$(./vocab_model.+x boundary.txt 2>/dev/null)
+[ "$(words "$VOCAB_B" | tr '\n' ' ')" = "start-token boundaryword tail end-token " ]
+check $? "word split across read chunks is kept whole"
+
+VOCAB_P=$(./vocab_model.+x -min-count 2 small.txt 2>/dev/null)
+[ "$(words "$VOCAB_P" | tr '\n' ' ')" = "start-token the cat sat end-token " ]
+check $? "-min-count drops rare words and renumbers the rest"
+
+VOCAB_S=$(./vocab_model.+x -sequence small.txt 2>/dev/null)
+[ "$(words "$VOCAB_S" | tr '\n' ' ')" = "start-token the cat sat end-token the cat ran end-token a dog sat end-token " ]
+check $? "-sequence writes one row per occurrence"
+[ "$(awk '$2=="cat"{print $3}' "$VOCAB_S" | sort -u | wc -l)" -eq 1 ]
+check $? "repeated words share one embedding in -sequence output"
+
+if [ $status -eq 0 ]; then
+    echo "Vocabulary builder checks passed."
+else
+    echo "Vocabulary builder checks FAILED."
+fi
+exit $status
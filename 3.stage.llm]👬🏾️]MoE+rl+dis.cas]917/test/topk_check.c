@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../topk_index.h"
+
+// Checks and times topk_index.h against the candidate selection
+// predict_next_word in chatbot_moe_v1.c used before the k-d tree (copied
+// verbatim below: full scores, softmax, then top-N insertion).
+//
+//   topk_check test    exact tree search returns the same top N
+//   topk_check bench   tokens/sec of the old scan and the tree by vocab size,
+//                      exact and with an 8-leaf budget (TOPK_MAX_LEAVES=8)
+
+#define DIM TOPK_DIM
+
+// --- Reference implementation ---
+static void ref_softmax(float *scores, int size, float temperature) {
+    float max_score = scores[0];
+    for (int i = 1; i < size; i++) {
+        if (scores[i] > max_score) {
+            max_score = scores[i];
+        }
+    }
+    float sum = 0.0f;
+    for (int i = 0; i < size; i++) {
+        scores[i] = expf((scores[i] - max_score) / temperature);
+        sum += scores[i];
+    }
+    for (int i = 0; i < size; i++) {
+        scores[i] /= sum;
+    }
+}
+
+// Fills top_indices[top_n], allocating per call as the chatbot did
+static void ref_top_n(const float *vecs, int vocab_size, int current, float temperature, int top_n, int *out) {
+    float *scores = malloc(vocab_size * sizeof(float));
+    const float *current_word_vec = vecs + (size_t)current * DIM;
+    for (int i = 0; i < vocab_size; i++) {
+        const float *next_word_vec = vecs + (size_t)i * DIM;
+        float dot_product = 0.0f;
+        for (int j = 0; j < 7; j++) {
+            dot_product += current_word_vec[j] * next_word_vec[j];
+        }
+        scores[i] = dot_product;
+    }
+    ref_softmax(scores, vocab_size, temperature);
+    if (top_n > vocab_size) top_n = vocab_size;
+    int *top_indices = malloc(top_n * sizeof(int));
+    float *top_scores = malloc(top_n * sizeof(float));
+    for (int i = 0; i < top_n; i++) {
+        top_indices[i] = i;
+        top_scores[i] = scores[i];
+    }
+    for (int i = 0; i < top_n; i++) {
+        int max_idx = i;
+        for (int j = i + 1; j < top_n; j++) {
+            if (top_scores[j] > top_scores[max_idx]) max_idx = j;
+        }
+        float temp_score = top_scores[i]; top_scores[i] = top_scores[max_idx]; top_scores[max_idx] = temp_score;
+        int temp_idx = top_indices[i]; top_indices[i] = top_indices[max_idx]; top_indices[max_idx] = temp_idx;
+    }
+    for (int i = top_n; i < vocab_size; i++) {
+        for (int j = 0; j < top_n; j++) {
+            if (scores[i] > top_scores[j]) {
+                for (int k = top_n - 1; k > j; k--) {
+                    top_scores[k] = top_scores[k-1];
+                    top_indices[k] = top_indices[k-1];
+                }
+                top_scores[j] = scores[i];
+                top_indices[j] = i;
+                break;
+            }
+        }
+    }
+    memcpy(out, top_indices, top_n * sizeof(int));
+    free(scores);
+    free(top_indices);
+    free(top_scores);
+}
+
+// --- Data ---
+static float frand(void) { return (float)rand() / (float)RAND_MAX; }
+
+// kind 0: rows as vocab_model.c writes them (random embedding and weight,
+//         pe = position / size, zero biases)
+// kind 1: every feature in [-1, 1], as after training
+// kind 2: kind 1 with each vector repeated three times, so scores tie
+static void fill(float *vecs, int n, int kind) {
+    for (int i = 0; i < n; i++) {
+        float *v = vecs + (size_t)i * DIM;
+        if (kind == 2 && i % 3) { memcpy(v, v - DIM, DIM * sizeof(float)); continue; }
+        if (kind == 0) {
+            v[0] = frand(); v[1] = (float)i / n; v[2] = frand();
+            for (int j = 3; j < DIM; j++) v[j] = 0.0f;
+        } else {
+            for (int j = 0; j < DIM; j++) v[j] = 2.0f * frand() - 1.0f;
+        }
+    }
+}
+
+static int cmp_int(const void *a, const void *b) { return *(const int*)a - *(const int*)b; }
+static int cmp_desc(const void *a, const void *b) { float x = *(const float*)a, y = *(const float*)b; return (x < y) - (x > y); }
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int run_test(void) {
+    static const int sizes[] = { 1, 7, 100, 5000, 40000 };
+    static const int top_ns[] = { 5, 10, 20 };
+    int failures = 0, queries = 0;
+    for (int kind = 0; kind < 3; kind++) {
+        for (int s = 0; s < 5; s++) {
+            int n = sizes[s];
+            float *vecs = malloc((size_t)n * DIM * sizeof(float));
+            fill(vecs, n, kind);
+            TopkIndex tree;
+            if (!topk_build(&tree, vecs, n)) { printf("✗ build failed for %d words\n", n); return 1; }
+            int bad = 0;
+            for (int q = 0; q < 60; q++) {
+                int current = rand() % n, top_n = top_ns[q % 3];
+                int want[20], got[20];
+                float scores[20];
+                int expect = top_n < n ? top_n : n;
+                ref_top_n(vecs, n, current, 1.0f, top_n, want);
+                int count = topk_query(&tree, vecs + (size_t)current * DIM, top_n, 0, got, scores);
+                // The tree's own order is by score, then id
+                int ordered = 1;
+                for (int i = 1; i < count; i++) ordered &= topk_better(scores[i - 1], got[i - 1], scores[i], got[i]);
+                // Same scores. Among exactly tied scores the old selection
+                // kept whichever its swaps left in place, the tree keeps the
+                // lower ids, so ids are compared only without ties.
+                float want_scores[20], got_scores[20];
+                for (int i = 0; i < expect; i++) want_scores[i] = topk_dot(vecs + (size_t)current * DIM, vecs + (size_t)want[i] * DIM);
+                for (int i = 0; i < count; i++) got_scores[i] = scores[i];
+                qsort(want_scores, expect, sizeof(float), cmp_desc);
+                qsort(want, expect, sizeof(int), cmp_int);
+                qsort(got, count, sizeof(int), cmp_int);
+                if (count != expect || !ordered || memcmp(want_scores, got_scores, expect * sizeof(float)) != 0 ||
+                    (kind != 2 && memcmp(want, got, expect * sizeof(int)) != 0)) bad++;
+                queries++;
+            }
+            if (bad) printf("✗ kind %d, %d words: %d of 60 queries differ\n", kind, n, bad);
+            failures += bad;
+            topk_free(&tree);
+            free(vecs);
+        }
+    }
+    if (failures == 0) printf("✓ exact search matches the old top-N selection on %d queries\n", queries);
+    return failures != 0;
+}
+
+static void run_bench(int kind) {
+    static const int sizes[] = { 1363, 10000, 100000, 1000000 };
+    const int top_n = 10;
+    printf("%s\n", kind == 0 ? "Fresh vocab_model.c rows:" : "Features in [-1, 1]:");
+    printf("%-9s %14s %14s %14s %12s\n", "words", "scan tok/s", "exact tok/s", "approx tok/s", "approx hit");
+    for (int s = 0; s < 4; s++) {
+        int n = sizes[s];
+        float *vecs = malloc((size_t)n * DIM * sizeof(float));
+        fill(vecs, n, kind);
+        TopkIndex tree;
+        topk_build(&tree, vecs, n);
+        int ids[20], ref[20];
+        float scores[20];
+
+        // A generation chain: the next query is a random pick among the top N
+        int tokens = n >= 1000000 ? 20 : n >= 100000 ? 100 : 1000;
+        int current = 0;
+        double t0 = now();
+        for (int i = 0; i < tokens; i++) { ref_top_n(vecs, n, current, 1.0f, top_n, ref); current = ref[rand() % top_n]; }
+        double scan = tokens / (now() - t0);
+
+        int exact_tokens = tokens * 50;
+        current = 0;
+        t0 = now();
+        for (int i = 0; i < exact_tokens; i++) { topk_query(&tree, vecs + (size_t)current * DIM, top_n, 0, ids, scores); current = ids[rand() % top_n]; }
+        double exact = exact_tokens / (now() - t0);
+
+        current = 0;
+        t0 = now();
+        for (int i = 0; i < exact_tokens; i++) { topk_query(&tree, vecs + (size_t)current * DIM, top_n, 8, ids, scores); current = ids[rand() % top_n]; }
+        double approx = exact_tokens / (now() - t0);
+
+        // Share of the exact top N the approximate search finds
+        int hit = 0, total = 0;
+        for (int q = 0; q < 200; q++) {
+            int c = rand() % n, got = topk_query(&tree, vecs + (size_t)c * DIM, top_n, 8, ids, scores);
+            int want = topk_query(&tree, vecs + (size_t)c * DIM, top_n, 0, ref, scores);
+            for (int i = 0; i < want; i++) for (int j = 0; j < got; j++) if (ref[i] == ids[j]) { hit++; break; }
+            total += want;
+        }
+        printf("%-9d %14.0f %14.0f %14.0f %11.1f%%\n", n, scan, exact, approx, 100.0 * hit / total);
+        topk_free(&tree);
+        free(vecs);
+    }
+}
+
+int main(int argc, char **argv) {
+    srand(1234);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) { run_bench(0); printf("\n"); run_bench(1); return 0; }
+    return run_test();
+}
@@ -2,10 +2,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <sys/time.h>
+
+#include "../kernels.h"
+
+// All-pairs cosine similarity over the 7-float word vectors.
+//
+// Every vector is normalized once and the columns are stored transposed, so
+// a tile of ASSOC_ROW_BLOCK rows by KERN_TILE columns is seven kern_axpy
+// passes over data that stays in cache. Rows are split over the kernels.h
+// thread pool; each row is computed by one thread in one fixed order, so the
+// output does not depend on the thread count. Products are multiply then add
+// in dimension order, which gives the same floats as the old per-pair loop.
+//
+// Outputs:
+//   <prefix>.edges      each word's top-k neighbours (itself excluded), best
+//                       first: "source,target,similarity" rows
+//   <prefix>.csv        the old dense N x N matrix for the visualizers;
+//                       by default only written when N <= ASSOC_DENSE_MAX
+//   <prefix>_stats.txt  summary statistics over the full matrix
 
 #define MAX_LINE_LENGTH 1024
 #define MAX_VOCAB_SIZE 100000
 #define EMBEDDING_DIM 7
+#define ASSOC_ROW_BLOCK 64
+#define ASSOC_DENSE_MAX 2048
+#define DEFAULT_TOPK 16
 
 // Structure to hold a vocabulary entry
 struct VocabEntry {
@@ -27,13 +49,13 @@ int read_vocab(const char *filename, struct VocabEntry *vocab) {
         perror("Error opening vocab file");
         return -1;
     }
-    
+
     char line[MAX_LINE_LENGTH];
     int vocab_size = 0;
-    
+
     // Skip header line
     fgets(line, sizeof(line), file);
-    
+
     while (fgets(line, sizeof(line), file) && vocab_size < MAX_VOCAB_SIZE) {
         sscanf(line, "%d %s %f %f %f %f %f %f %f",
                &vocab[vocab_size].number,
@@ -47,25 +69,11 @@ int read_vocab(const char *filename, struct VocabEntry *vocab) {
                &vocab[vocab_size].bias4);
         vocab_size++;
     }
-    
+
     fclose(file);
     return vocab_size;
 }
 
-// Function to compute dot product between two word vectors
-float dot_product(struct VocabEntry *word1, struct VocabEntry *word2) {
-    float vec1[EMBEDDING_DIM] = {word1->embedding, word1->pe, word1->weight, 
-                                word1->bias1, word1->bias2, word1->bias3, word1->bias4};
-    float vec2[EMBEDDING_DIM] = {word2->embedding, word2->pe, word2->weight, 
-                                word2->bias1, word2->bias2, word2->bias3, word2->bias4};
-    
-    float dot = 0.0f;
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        dot += vec1[i] * vec2[i];
-    }
-    return dot;
-}
-
 // Function to normalize a vector
 void normalize_vector(float *vec, int size) {
     float norm = 0.0f;
@@ -73,7 +81,7 @@ void normalize_vector(float *vec, int size) {
         norm += vec[i] * vec[i];
     }
     norm = sqrtf(norm);
-    
+
     if (norm > 0.0f) {
         for (int i = 0; i < size; i++) {
             vec[i] /= norm;
@@ -81,123 +89,302 @@ void normalize_vector(float *vec, int size) {
     }
 }
 
-// Function to compute cosine similarity between two word vectors
-float cosine_similarity(struct VocabEntry *word1, struct VocabEntry *word2) {
-    float vec1[EMBEDDING_DIM] = {word1->embedding, word1->pe, word1->weight, 
-                                word1->bias1, word1->bias2, word1->bias3, word1->bias4};
-    float vec2[EMBEDDING_DIM] = {word2->embedding, word2->pe, word2->weight, 
-                                word2->bias1, word2->bias2, word2->bias3, word2->bias4};
-    
-    normalize_vector(vec1, EMBEDDING_DIM);
-    normalize_vector(vec2, EMBEDDING_DIM);
-    
-    float dot = 0.0f;
-    for (int i = 0; i < EMBEDDING_DIM; i++) {
-        dot += vec1[i] * vec2[i];
-    }
-    return dot;
+typedef struct {
+    const float *rows;      // N x EMBEDDING_DIM normalized vectors
+    const float *cols[EMBEDDING_DIM]; // the same, transposed
+    int n, k;
+    float threshold;
+    float *dense;           // N x N, or NULL
+    int *nbr_id;            // N x k, best first
+    float *nbr_sim;
+    int *nbr_count;
+    float *row_max, *row_min;
+    double *row_sum;
+} AssocJob;
+
+// a ranks below b: lower similarity, or equal and a higher index
+static int assoc_worse(float sa, int ia, float sb, int ib) {
+    return sa < sb || (sa == sb && ia > ib);
+}
+
+// Min-heap of a row's k best neighbours, worst at the root
+static void assoc_push(float *sim, int *id, int *count, int k, float s, int j) {
+    int n = *count, i;
+    if (n == k) {
+        if (!assoc_worse(sim[0], id[0], s, j)) return;
+        i = 0;
+        for (;;) {
+            int c = 2 * i + 1;
+            if (c >= n) break;
+            if (c + 1 < n && assoc_worse(sim[c + 1], id[c + 1], sim[c], id[c])) c++;
+            if (!assoc_worse(sim[c], id[c], s, j)) break;
+            sim[i] = sim[c]; id[i] = id[c];
+            i = c;
+        }
+    } else {
+        i = (*count)++;
+        while (i > 0) {
+            int p = (i - 1) / 2;
+            if (!assoc_worse(s, j, sim[p], id[p])) break;
+            sim[i] = sim[p]; id[i] = id[p];
+            i = p;
+        }
+    }
+    sim[i] = s; id[i] = j;
+}
+
+// Heap order to best first
+static void assoc_sort(float *sim, int *id, int n) {
+    for (int a = 1; a < n; a++) {
+        float s = sim[a];
+        int j = id[a], b = a;
+        while (b > 0 && assoc_worse(sim[b - 1], id[b - 1], s, j)) {
+            sim[b] = sim[b - 1]; id[b] = id[b - 1];
+            b--;
+        }
+        sim[b] = s; id[b] = j;
+    }
+}
+
+static void assoc_task(void *arg, int begin, int end) {
+    AssocJob *job = (AssocJob*)arg;
+    int n = job->n, k = job->k;
+    float *tile = malloc((size_t)ASSOC_ROW_BLOCK * KERN_TILE * sizeof(float));
+    if (!tile) { perror("Failed to allocate similarity tile"); exit(1); }
+
+    for (int r0 = begin; r0 < end; r0 += ASSOC_ROW_BLOCK) {
+        int rows = r0 + ASSOC_ROW_BLOCK < end ? ASSOC_ROW_BLOCK : end - r0;
+        for (int r = 0; r < rows; r++) {
+            int i = r0 + r;
+            job->nbr_count[i] = 0;
+            job->row_max[i] = -INFINITY;
+            job->row_min[i] = INFINITY;
+            job->row_sum[i] = 0.0;
+        }
+        for (int j0 = 0; j0 < n; j0 += KERN_TILE) {
+            int len = (j0 + KERN_TILE < n ? j0 + KERN_TILE : n) - j0;
+            for (int r = 0; r < rows; r++) {
+                int i = r0 + r;
+                const float *a = job->rows + (size_t)i * EMBEDDING_DIM;
+                float *o = tile + (size_t)r * KERN_TILE;
+                memset(o, 0, len * sizeof(float));
+                for (int l = 0; l < EMBEDDING_DIM; l++) kern_axpy(a[l], job->cols[l] + j0, o, len);
+
+                if (job->dense) memcpy(job->dense + (size_t)i * n + j0, o, len * sizeof(float));
+                float *sim = job->nbr_sim + (size_t)i * k;
+                int *id = job->nbr_id + (size_t)i * k;
+                float mx = job->row_max[i], mn = job->row_min[i];
+                double sum = 0.0;
+                for (int c = 0; c < len; c++) {
+                    float s = o[c];
+                    if (s > mx) mx = s;
+                    if (s < mn) mn = s;
+                    sum += s;
+                    int j = j0 + c;
+                    if (j == i || s < job->threshold) continue;
+                    if (job->nbr_count[i] == k && !assoc_worse(sim[0], id[0], s, j)) continue;
+                    assoc_push(sim, id, &job->nbr_count[i], k, s, j);
+                }
+                job->row_max[i] = mx;
+                job->row_min[i] = mn;
+                job->row_sum[i] += sum;
+            }
+        }
+        for (int r = 0; r < rows; r++) {
+            int i = r0 + r;
+            assoc_sort(job->nbr_sim + (size_t)i * k, job->nbr_id + (size_t)i * k, job->nbr_count[i]);
+        }
+    }
+    free(tile);
+}
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s <vocab_model.txt> <output_prefix> [-topk K] [-threshold X] [-threads N] [-dense auto|on|off]\n", prog);
+    fprintf(stderr, "Example: %s vocab_model.txt associations\n", prog);
 }
 
 int main(int argc, char *argv[]) {
     if (argc < 3) {
-        fprintf(stderr, "Usage: %s <vocab_model.txt> <output_prefix>\n", argv[0]);
-        fprintf(stderr, "Example: %s vocab_model.txt associations\n", argv[0]);
+        usage(argv[0]);
         return 1;
     }
-    
+
     const char *vocab_file = argv[1];
     const char *output_prefix = argv[2];
-    
+    int topk = DEFAULT_TOPK, threads = 0;
+    float threshold = -INFINITY;
+    const char *dense_mode = "auto";
+    for (int a = 3; a < argc; a++) {
+        if (a + 1 >= argc) { usage(argv[0]); return 1; }
+        if (strcmp(argv[a], "-topk") == 0) topk = atoi(argv[++a]);
+        else if (strcmp(argv[a], "-threshold") == 0) threshold = atof(argv[++a]);
+        else if (strcmp(argv[a], "-threads") == 0) threads = atoi(argv[++a]);
+        else if (strcmp(argv[a], "-dense") == 0) dense_mode = argv[++a];
+        else { usage(argv[0]); return 1; }
+    }
+    if (topk < 1 || (strcmp(dense_mode, "auto") && strcmp(dense_mode, "on") && strcmp(dense_mode, "off"))) {
+        usage(argv[0]);
+        return 1;
+    }
+
     struct VocabEntry *vocab = malloc(MAX_VOCAB_SIZE * sizeof(struct VocabEntry));
     if (!vocab) {
         perror("Failed to allocate memory for vocabulary");
         return 1;
     }
-    
+
     printf("Reading vocabulary from %s...\n", vocab_file);
     int vocab_size = read_vocab(vocab_file, vocab);
-    if (vocab_size < 0) {
+    if (vocab_size <= 0) {
+        if (vocab_size == 0) fprintf(stderr, "Vocabulary is empty\n");
         free(vocab);
         return 1;
     }
-    
+
     printf("Vocabulary size: %d words\n", vocab_size);
-    
-    // Create output filename for CSV
-    char csv_filename[256];
-    snprintf(csv_filename, sizeof(csv_filename), "%s.csv", output_prefix);
-    
-    FILE *csv_file = fopen(csv_filename, "w");
-    if (!csv_file) {
-        perror("Error opening CSV output file");
-        free(vocab);
+    int n = vocab_size;
+    if (topk > n - 1) topk = n - 1 > 0 ? n - 1 : 1;
+    int dense = strcmp(dense_mode, "on") == 0 || (strcmp(dense_mode, "auto") == 0 && n <= ASSOC_DENSE_MAX);
+
+    // Normalize once, row-major for the tile rows and transposed for the columns
+    AssocJob job;
+    memset(&job, 0, sizeof(job));
+    float *rows = malloc((size_t)n * EMBEDDING_DIM * sizeof(float));
+    float *cols = malloc((size_t)n * EMBEDDING_DIM * sizeof(float));
+    job.nbr_id = malloc((size_t)n * topk * sizeof(int));
+    job.nbr_sim = malloc((size_t)n * topk * sizeof(float));
+    job.nbr_count = malloc(n * sizeof(int));
+    job.row_max = malloc(n * sizeof(float));
+    job.row_min = malloc(n * sizeof(float));
+    job.row_sum = malloc(n * sizeof(double));
+    job.dense = dense ? malloc((size_t)n * n * sizeof(float)) : NULL;
+    if (!rows || !cols || !job.nbr_id || !job.nbr_sim || !job.nbr_count || !job.row_max || !job.row_min || !job.row_sum || (dense && !job.dense)) {
+        perror("Failed to allocate memory for associations");
         return 1;
     }
-    
-    // Write CSV header
-    fprintf(csv_file, ",");
-    for (int i = 0; i < vocab_size; i++) {
-        fprintf(csv_file, "%s", vocab[i].word);
-        if (i < vocab_size - 1) {
-            fprintf(csv_file, ",");
-        }
+    for (int i = 0; i < n; i++) {
+        float *v = rows + (size_t)i * EMBEDDING_DIM;
+        v[0] = vocab[i].embedding; v[1] = vocab[i].pe; v[2] = vocab[i].weight;
+        v[3] = vocab[i].bias1; v[4] = vocab[i].bias2; v[5] = vocab[i].bias3; v[6] = vocab[i].bias4;
+        normalize_vector(v, EMBEDDING_DIM);
+        for (int l = 0; l < EMBEDDING_DIM; l++) cols[(size_t)l * n + i] = v[l];
     }
-    fprintf(csv_file, "\n");
-    
-    // Compute and write association matrix
+    job.rows = rows;
+    for (int l = 0; l < EMBEDDING_DIM; l++) job.cols[l] = cols + (size_t)l * n;
+    job.n = n;
+    job.k = topk;
+    job.threshold = threshold;
+
+    kernels_init();
+    if (threads > 0) kern_cfg.threads = threads > KERN_MAX_THREADS ? KERN_MAX_THREADS : threads;
+    printf("Computing associations (%d threads, %s)...\n", kern_cfg.threads, kern_level_name(kern_cfg.level));
+    double start = now_seconds();
+    kern_parallel_for(assoc_task, &job, n, (long)n * EMBEDDING_DIM);
+    double elapsed = now_seconds() - start;
+    printf("Computed %dx%d similarities in %.3f s (%.1f M pairs/sec)\n", n, n, elapsed,
+           (double)n * n / (elapsed > 0 ? elapsed : 1e-9) / 1e6);
+
+    // Row results in row order, so the statistics do not depend on the threads
     float max_assoc = -INFINITY;
     float min_assoc = INFINITY;
-    float sum_assoc = 0.0f;
-    int count = 0;
-    
-    printf("Computing associations...\n");
-    for (int i = 0; i < vocab_size; i++) {
-        fprintf(csv_file, "%s", vocab[i].word);
-        for (int j = 0; j < vocab_size; j++) {
-            float assoc = cosine_similarity(&vocab[i], &vocab[j]);
-            fprintf(csv_file, ",%f", assoc);
-            
-            if (assoc > max_assoc) max_assoc = assoc;
-            if (assoc < min_assoc) min_assoc = assoc;
-            sum_assoc += assoc;
-            count++;
+    double sum_assoc = 0.0;
+    long edge_count = 0;
+    for (int i = 0; i < n; i++) {
+        if (job.row_max[i] > max_assoc) max_assoc = job.row_max[i];
+        if (job.row_min[i] < min_assoc) min_assoc = job.row_min[i];
+        sum_assoc += job.row_sum[i];
+        edge_count += job.nbr_count[i];
+    }
+    double mean_assoc = sum_assoc / ((double)n * n);
+
+    char filename[1024];
+    snprintf(filename, sizeof(filename), "%s.edges", output_prefix);
+    FILE *edges_file = fopen(filename, "w");
+    if (!edges_file) {
+        perror("Error opening edge list output file");
+        return 1;
+    }
+    fprintf(edges_file, "source,target,similarity\n");
+    for (int i = 0; i < n; i++) {
+        for (int c = 0; c < job.nbr_count[i]; c++) {
+            int j = job.nbr_id[(size_t)i * topk + c];
+            fprintf(edges_file, "%s,%s,%f\n", vocab[i].word, vocab[j].word, job.nbr_sim[(size_t)i * topk + c]);
+        }
+    }
+    fclose(edges_file);
+    printf("Top %d neighbours per word saved to %s (%ld edges)\n", topk, filename, edge_count);
+
+    if (dense) {
+        snprintf(filename, sizeof(filename), "%s.csv", output_prefix);
+        FILE *csv_file = fopen(filename, "w");
+        if (!csv_file) {
+            perror("Error opening CSV output file");
+            return 1;
+        }
+
+        // Write CSV header
+        fprintf(csv_file, ",");
+        for (int i = 0; i < n; i++) {
+            fprintf(csv_file, "%s", vocab[i].word);
+            if (i < n - 1) {
+                fprintf(csv_file, ",");
+            }
         }
         fprintf(csv_file, "\n");
-        
-        // Progress indicator
-        if ((i + 1) % 10 == 0 || i == vocab_size - 1) {
-            printf("\rProgress: %d/%d (%.1f%%)", i + 1, vocab_size, 
-                   (float)(i + 1) / vocab_size * 100);
-            fflush(stdout);
+
+        for (int i = 0; i < n; i++) {
+            fprintf(csv_file, "%s", vocab[i].word);
+            const float *row = job.dense + (size_t)i * n;
+            for (int j = 0; j < n; j++) {
+                fprintf(csv_file, ",%f", row[j]);
+            }
+            fprintf(csv_file, "\n");
         }
+        fclose(csv_file);
+        printf("Association matrix saved to %s\n", filename);
+    } else {
+        printf("Dense matrix skipped for %d words (-dense on to force it)\n", n);
     }
-    
-    printf("\n");
-    fclose(csv_file);
-    
+
     // Print statistics
-    printf("Association matrix saved to %s\n", csv_filename);
-    printf("Matrix shape: %dx%d\n", vocab_size, vocab_size);
+    printf("Matrix shape: %dx%d\n", n, n);
     printf("Max association: %.4f\n", max_assoc);
     printf("Min association: %.4f\n", min_assoc);
-    printf("Mean association: %.4f\n", sum_assoc / count);
-    
+    printf("Mean association: %.4f\n", mean_assoc);
+
     // Also save some statistics to a file
-    char stats_filename[256];
-    snprintf(stats_filename, sizeof(stats_filename), "%s_stats.txt", output_prefix);
-    
-    FILE *stats_file = fopen(stats_filename, "w");
+    snprintf(filename, sizeof(filename), "%s_stats.txt", output_prefix);
+
+    FILE *stats_file = fopen(filename, "w");
     if (stats_file) {
-        fprintf(stats_file, "Vocabulary size: %d\n", vocab_size);
-        fprintf(stats_file, "Matrix shape: %dx%d\n", vocab_size, vocab_size);
+        fprintf(stats_file, "Vocabulary size: %d\n", n);
+        fprintf(stats_file, "Matrix shape: %dx%d\n", n, n);
         fprintf(stats_file, "Max association: %.6f\n", max_assoc);
         fprintf(stats_file, "Min association: %.6f\n", min_assoc);
-        fprintf(stats_file, "Mean association: %.6f\n", sum_assoc / count);
+        fprintf(stats_file, "Mean association: %.6f\n", mean_assoc);
+        fprintf(stats_file, "Neighbours per word: %d\n", topk);
+        if (threshold > -INFINITY) fprintf(stats_file, "Threshold: %.6f\n", threshold);
+        fprintf(stats_file, "Edges: %ld\n", edge_count);
         fclose(stats_file);
-        printf("Statistics saved to %s\n", stats_filename);
+        printf("Statistics saved to %s\n", filename);
     }
-    
+
+    free(job.dense);
+    free(job.row_sum);
+    free(job.row_min);
+    free(job.row_max);
+    free(job.nbr_count);
+    free(job.nbr_sim);
+    free(job.nbr_id);
+    free(cols);
+    free(rows);
     free(vocab);
     printf("Done!\n");
     return 0;
-}
\ No newline at end of file
+}
@@ -12,13 +12,10 @@
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
-#define MAX_WORDS 1000
+#include "../force_layout.h"
+
 #define NODE_RADIUS 0.04f  // Much smaller node radius to better fit emojis
-#define SPRING_LENGTH 0.5f
-#define SPRING_CONSTANT 0.1f
-#define REPULSION_CONSTANT 0.5f
-#define DAMPING 0.8f
-#define TIME_STEP 0.1f
+#define DEFAULT_MAX_NODES 50  // Nodes shown unless VIS_MAX_NODES says otherwise
 
 // Font settings
 const char *font_path = "/usr/share/fonts/truetype/noto/NotoColorEmoji.ttf";
@@ -57,21 +54,9 @@ int decode_utf8(const unsigned char* str, unsigned int* codepoint) {
     return 1;
 }
 
-typedef struct {
-    char word[100];
-    float x, y, z;
-    float vx, vy, vz;
-} Node;
-
-typedef struct {
-    int from, to;
-    float strength;
-} Edge;
-
-Node nodes[MAX_WORDS];
-Edge edges[MAX_WORDS * MAX_WORDS];
-int node_count = 0;
-int edge_count = 0;
+// Node positions, velocities and edges live in the layout (force_layout.h)
+ForceLayout layout;
+char **words = NULL;
 
 // Camera and view variables
 float camera_angle_y = 0.0f;
@@ -223,143 +208,23 @@ void render_text(const char *text, float x, float y, float z, float scale) {
     }
 }
 
-// Function to read CSV file and create nodes/edges (modified for 3D)
+// Function to read the associations (dense CSV or edge list) into the layout
 int read_associations(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        perror("Error opening associations file");
-        return 0;
-    }
-    
-    char line[4096];
-    char *words[MAX_WORDS];
-    int word_count = 0;
-    
-    // Read header line to get word list
-    if (!fgets(line, sizeof(line), file)) {
-        fclose(file);
-        return 0;
-    }
-    
-    // Parse header
-    char *token = strtok(line, ",");
-    token = strtok(NULL, ",\n"); // Skip first empty token
-    while (token && word_count < MAX_WORDS) {
-        words[word_count] = malloc(strlen(token) + 1);
-        strcpy(words[word_count], token);
-        word_count++;
-        token = strtok(NULL, ",\n");
-    }
-    
-    printf("Loaded %d words\n", word_count);
-    
-    // Create nodes
-    node_count = word_count > 50 ? 50 : word_count; // Limit to 50 for performance
-    for (int i = 0; i < node_count; i++) {
-        strcpy(nodes[i].word, words[i]);
-        nodes[i].x = (float)(rand() % 100) / 50.0f - 1.0f;
-        nodes[i].y = (float)(rand() % 100) / 50.0f - 1.0f;
-        nodes[i].z = (float)(rand() % 100) / 50.0f - 1.0f;
-        nodes[i].vx = 0.0f;
-        nodes[i].vy = 0.0f;
-        nodes[i].vz = 0.0f;
-    }
-    
-    // Read association data and create edges
-    edge_count = 0;
-    int row = 0;
-    while (fgets(line, sizeof(line), file) && row < node_count) {
-        token = strtok(line, ",");
-        int col = 0;
-        token = strtok(NULL, ",\n"); // Skip row label
-        while (token && col < node_count && edge_count < MAX_WORDS * MAX_WORDS) {
-            float assoc = atof(token);
-            // Create edge if association is strong enough
-            if (assoc > 0.7 && row != col) {
-                edges[edge_count].from = row;
-                edges[edge_count].to = col;
-                edges[edge_count].strength = assoc;
-                edge_count++;
-            }
-            col++;
-            token = strtok(NULL, ",\n");
-        }
-        row++;
-    }
-    
-    fclose(file);
-    
-    // Free allocated memory
-    for (int i = 0; i < word_count; i++) {
-        free(words[i]);
-    }
-    
-    printf("Created %d nodes and %d edges\n", node_count, edge_count);
+    const char *env = getenv("VIS_MAX_NODES");
+    int max_nodes = env ? atoi(env) : DEFAULT_MAX_NODES; // Limit for performance
+    if (max_nodes < 1) max_nodes = DEFAULT_MAX_NODES;
+
+    layout_init(&layout, 3);
+    words = layout_load_associations(&layout, filename, max_nodes);
+    if (!words) return 0;
+
+    printf("Created %d nodes and %d edges\n", layout.count, layout.edge_count);
     return 1;
 }
 
-
-// Physics simulation (modified for 3D)
+// Physics simulation: one Barnes-Hut layout step
 void update_physics() {
-    // Reset forces
-    for (int i = 0; i < node_count; i++) {
-        nodes[i].vx *= DAMPING;
-        nodes[i].vy *= DAMPING;
-        nodes[i].vz *= DAMPING;
-    }
-    
-    // Spring forces between connected nodes
-    for (int i = 0; i < edge_count; i++) {
-        int from = edges[i].from;
-        int to = edges[i].to;
-        float dx = nodes[to].x - nodes[from].x;
-        float dy = nodes[to].y - nodes[from].y;
-        float dz = nodes[to].z - nodes[from].z;
-        float distance = sqrtf(dx*dx + dy*dy + dz*dz);
-        if (distance > 0) {
-            float force = (distance - SPRING_LENGTH * (2.0f - edges[i].strength)) * SPRING_CONSTANT;
-            float fx = force * dx / distance;
-            float fy = force * dy / distance;
-            float fz = force * dz / distance;
-            
-            nodes[from].vx += fx * TIME_STEP;
-            nodes[from].vy += fy * TIME_STEP;
-            nodes[from].vz += fz * TIME_STEP;
-            nodes[to].vx -= fx * TIME_STEP;
-            nodes[to].vy -= fy * TIME_STEP;
-            nodes[to].vz -= fz * TIME_STEP;
-        }
-    }
-    
-    // Repulsive forces between all nodes
-    for (int i = 0; i < node_count; i++) {
-        for (int j = i + 1; j < node_count; j++) {
-            float dx = nodes[j].x - nodes[i].x;
-            float dy = nodes[j].y - nodes[i].y;
-            float dz = nodes[j].z - nodes[i].z;
-            float distance_sq = dx*dx + dy*dy + dz*dz;
-            if (distance_sq > 0.01f) { // Avoid division by zero
-                float force = REPULSION_CONSTANT / distance_sq;
-                float fx = force * dx;
-                float fy = force * dy;
-                float fz = force * dz;
-                
-                nodes[i].vx -= fx * TIME_STEP;
-                nodes[i].vy -= fy * TIME_STEP;
-                nodes[i].vz -= fz * TIME_STEP;
-                nodes[j].vx += fx * TIME_STEP;
-                nodes[j].vy += fy * TIME_STEP;
-                nodes[j].vz += fz * TIME_STEP;
-            }
-        }
-    }
-    
-    // Update positions
-    for (int i = 0; i < node_count; i++) {
-        nodes[i].x += nodes[i].vx * TIME_STEP;
-        nodes[i].y += nodes[i].vy * TIME_STEP;
-        nodes[i].z += nodes[i].vz * TIME_STEP;
-    }
+    layout_step(&layout);
 }
 
 // Rendering (modified for 3D)
@@ -376,20 +241,21 @@ void render() {
     
     // Draw edges
     glBegin(GL_LINES);
-    for (int i = 0; i < edge_count; i++) {
-        int from = edges[i].from;
-        int to = edges[i].to;
-        float strength = edges[i].strength;
+    for (int i = 0; i < layout.edge_count; i++) {
+        int from = layout.edges[i].from;
+        int to = layout.edges[i].to;
+        float strength = layout.edges[i].strength;
         glColor3f(strength, strength * 0.5f, 1.0f - strength);
-        glVertex3f(nodes[from].x, nodes[from].y, nodes[from].z);
-        glVertex3f(nodes[to].x, nodes[to].y, nodes[to].z);
+        glVertex3fv(layout_position(&layout, from));
+        glVertex3fv(layout_position(&layout, to));
     }
     glEnd();
     
     // Draw nodes
-    for (int i = 0; i < node_count; i++) {
+    for (int i = 0; i < layout.count; i++) {
         glPushMatrix();
-        glTranslatef(nodes[i].x, nodes[i].y, nodes[i].z);
+        float *p = layout_position(&layout, i);
+        glTranslatef(p[0], p[1], p[2]);
         
         // Draw sphere
         glColor3f(0.5f, 0.7f, 1.0f);
@@ -403,7 +269,7 @@ void render() {
         glDisable(GL_DEPTH_TEST);
         // Draw emoji (as a flat texture on a quad)
         glColor3f(1.0f, 1.0f, 1.0f);
-        render_emoji(nodes[i].word, 0, 0, 0);
+        render_emoji(words[i], 0, 0, 0);
         glEnable(GL_DEPTH_TEST);
         
         glPopMatrix();
@@ -480,13 +346,10 @@ void keyboard(unsigned char key, int x, int y) {
         case 'r':
         case 'R':
             // Reset node positions
-            for (int i = 0; i < node_count; i++) {
-                nodes[i].x = (float)(rand() % 100) / 50.0f - 1.0f;
-                nodes[i].y = (float)(rand() % 100) / 50.0f - 1.0f;
-                nodes[i].z = (float)(rand() % 100) / 50.0f - 1.0f;
-                nodes[i].vx = 0.0f;
-                nodes[i].vy = 0.0f;
-                nodes[i].vz = 0.0f;
+            for (int i = 0; i < layout.count; i++) {
+                float p[3];
+                for (int d = 0; d < layout.dim; d++) p[d] = (float)(rand() % 100) / 50.0f - 1.0f;
+                layout_place(&layout, i, p);
             }
             break;
     }
@@ -519,7 +382,7 @@ void init() {
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <associations.csv>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <associations.csv|associations.edges>\n", argv[0]);
         fprintf(stderr, "Controls:\n");
         fprintf(stderr, "  Left mouse: Pan view\n");
         fprintf(stderr, "  Right mouse: Reset view\n");
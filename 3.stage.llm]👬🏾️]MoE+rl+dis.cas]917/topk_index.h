@@ -0,0 +1,242 @@
+#ifndef TOPK_INDEX_H
+#define TOPK_INDEX_H
+
+// Top-k maximum dot product search over the 7-float word vectors.
+//
+// A k-d tree split at the median of the widest dimension, with a bounding
+// box per node. The best dot product any point in a box can reach is
+// sum_j max(q_j * lo_j, q_j * hi_j), so a query descends into the more
+// promising child first and skips every subtree whose bound cannot beat the
+// current k-th best. In exact mode the result is the same top k a full scan
+// gives, ordered by score and then by lower id; scores are summed in the
+// same order as the scan, so they are bit-identical too.
+//
+// max_leaves > 0 turns it into an approximate search that stops after
+// visiting that many leaves.
+//
+// topk_quantize() swaps the float points for int8 or fp16 codes (quant.h)
+// after the tree is built and recomputes the boxes from the dequantized
+// values, so the search stays exact with respect to what is stored: the
+// same top k a scan over the dequantized vectors gives.
+
+#include <stdlib.h>
+#include <string.h>
+#include "quant.h"
+
+#define TOPK_DIM 7
+#define TOPK_LEAF_SIZE 16
+
+typedef struct {
+    float lo[TOPK_DIM], hi[TOPK_DIM];
+    int begin, end;         // range of points under this node
+    int left, right;        // child nodes, -1 for a leaf
+} TopkNode;
+
+typedef struct {
+    int n;
+    float *points;          // n x TOPK_DIM, in tree order; NULL once quantized
+    int dtype;              // QUANT_F32, or the storage of codes
+    void *codes;            // n x TOPK_DIM int8 or fp16, in tree order
+    float *scales;          // one per point for int8
+    int *ids;               // tree order -> caller's id
+    TopkNode *nodes;
+    int node_count, node_cap;
+} TopkIndex;
+
+// Running result of one query, best first
+typedef struct {
+    int k, count;
+    int *ids;
+    float *scores;
+    int leaves_left;        // approximate mode budget, < 0 when exact
+    int unique;             // skip ids already in the result, for queries
+                            // over several trees that share ids
+} TopkQuery;
+
+static inline float topk_dot(const float *a, const float *b) {
+    float dot = 0.0f;
+    for (int j = 0; j < TOPK_DIM; j++) dot += a[j] * b[j];
+    return dot;
+}
+
+static inline void topk_swap(TopkIndex *t, int a, int b) {
+    float tmp[TOPK_DIM];
+    memcpy(tmp, t->points + (size_t)a * TOPK_DIM, sizeof(tmp));
+    memcpy(t->points + (size_t)a * TOPK_DIM, t->points + (size_t)b * TOPK_DIM, sizeof(tmp));
+    memcpy(t->points + (size_t)b * TOPK_DIM, tmp, sizeof(tmp));
+    int id = t->ids[a]; t->ids[a] = t->ids[b]; t->ids[b] = id;
+}
+
+// Partially order [begin, end) so position mid holds its median along dim
+static inline void topk_select(TopkIndex *t, int begin, int end, int mid, int dim) {
+    while (end - begin > 1) {
+        float pivot = t->points[(size_t)(begin + (end - begin) / 2) * TOPK_DIM + dim];
+        int i = begin, j = end - 1;
+        while (i <= j) {
+            while (t->points[(size_t)i * TOPK_DIM + dim] < pivot) i++;
+            while (t->points[(size_t)j * TOPK_DIM + dim] > pivot) j--;
+            if (i <= j) { topk_swap(t, i, j); i++; j--; }
+        }
+        if (mid <= j) end = j + 1;
+        else if (mid >= i) begin = i;
+        else return;
+    }
+}
+
+static inline int topk_build_node(TopkIndex *t, int begin, int end) {
+    if (t->node_count == t->node_cap) {
+        int cap = t->node_cap ? t->node_cap * 2 : 64;
+        TopkNode *nodes = realloc(t->nodes, cap * sizeof(TopkNode));
+        if (!nodes) return -1;
+        t->nodes = nodes;
+        t->node_cap = cap;
+    }
+    int id = t->node_count++;
+    TopkNode node;
+    node.begin = begin;
+    node.end = end;
+    node.left = node.right = -1;
+    for (int j = 0; j < TOPK_DIM; j++) node.lo[j] = node.hi[j] = t->points[(size_t)begin * TOPK_DIM + j];
+    for (int i = begin + 1; i < end; i++) {
+        for (int j = 0; j < TOPK_DIM; j++) {
+            float x = t->points[(size_t)i * TOPK_DIM + j];
+            if (x < node.lo[j]) node.lo[j] = x;
+            if (x > node.hi[j]) node.hi[j] = x;
+        }
+    }
+    if (end - begin > TOPK_LEAF_SIZE) {
+        int dim = 0;
+        for (int j = 1; j < TOPK_DIM; j++) if (node.hi[j] - node.lo[j] > node.hi[dim] - node.lo[dim]) dim = j;
+        if (node.hi[dim] > node.lo[dim]) {
+            int mid = begin + (end - begin) / 2;
+            topk_select(t, begin, end, mid, dim);
+            node.left = topk_build_node(t, begin, mid);
+            node.right = node.left < 0 ? -1 : topk_build_node(t, mid, end);
+            if (node.right < 0) return -1;
+        }
+    }
+    t->nodes[id] = node;
+    return id;
+}
+
+static inline void topk_free(TopkIndex *t) {
+    free(t->points);
+    free(t->codes);
+    free(t->scales);
+    free(t->ids);
+    free(t->nodes);
+    memset(t, 0, sizeof(*t));
+}
+
+// vecs holds n rows of TOPK_DIM floats; row i gets id i
+static inline int topk_build(TopkIndex *t, const float *vecs, int n) {
+    memset(t, 0, sizeof(*t));
+    if (n <= 0) return 1;
+    t->n = n;
+    t->points = malloc((size_t)n * TOPK_DIM * sizeof(float));
+    t->ids = malloc((size_t)n * sizeof(int));
+    if (!t->points || !t->ids) { topk_free(t); return 0; }
+    memcpy(t->points, vecs, (size_t)n * TOPK_DIM * sizeof(float));
+    for (int i = 0; i < n; i++) t->ids[i] = i;
+    if (topk_build_node(t, 0, n) < 0) { topk_free(t); return 0; }
+    return 1;
+}
+
+// Does (score, id) belong before the current k-th result?
+static inline int topk_better(float score, int id, float ref_score, int ref_id) {
+    return score > ref_score || (score == ref_score && id < ref_id);
+}
+
+static inline void topk_offer(TopkQuery *r, int id, float score) {
+    if (r->count == r->k && !topk_better(score, id, r->scores[r->k - 1], r->ids[r->k - 1])) return;
+    for (int j = 0; r->unique && j < r->count; j++) if (r->ids[j] == id) return;
+    int i = r->count < r->k ? r->count++ : r->k - 1;
+    while (i > 0 && topk_better(score, id, r->scores[i - 1], r->ids[i - 1])) {
+        r->scores[i] = r->scores[i - 1];
+        r->ids[i] = r->ids[i - 1];
+        i--;
+    }
+    r->scores[i] = score;
+    r->ids[i] = id;
+}
+
+// Upper bound on q . x for x in the node's box, padded by the worst float
+// rounding of a 7-term sum so that pruning never drops a tied score
+static inline float topk_bound(const TopkNode *node, const float *q) {
+    float bound = 0.0f, mag = 0.0f;
+    for (int j = 0; j < TOPK_DIM; j++) {
+        float term = q[j] >= 0.0f ? q[j] * node->hi[j] : q[j] * node->lo[j];
+        bound += term;
+        mag += term < 0.0f ? -term : term;
+    }
+    return bound + 4e-6f * mag;
+}
+
+// Point i in tree order as floats; buf holds it when the tree is quantized
+static inline const float *topk_point(const TopkIndex *t, int i, float *buf) {
+    if (t->dtype == QUANT_F32) return t->points + (size_t)i * TOPK_DIM;
+    quant_dequant_row(t->dtype, (const char*)t->codes + (size_t)i * TOPK_DIM * quant_size(t->dtype), t->scales ? t->scales[i] : 1.0f, TOPK_DIM, buf);
+    return buf;
+}
+
+// Replace the float points with dtype codes and refit every box to the
+// dequantized points. Returns 0 on allocation failure (the tree is unchanged).
+static inline int topk_quantize(TopkIndex *t, int dtype) {
+    if (dtype == QUANT_F32 || t->dtype != QUANT_F32 || t->n == 0) return 1;
+    void *codes = malloc((size_t)t->n * TOPK_DIM * quant_size(dtype));
+    float *scales = dtype == QUANT_I8 ? malloc((size_t)t->n * sizeof(float)) : NULL;
+    if (!codes || (dtype == QUANT_I8 && !scales)) { free(codes); free(scales); return 0; }
+    for (int i = 0; i < t->n; i++) {
+        float s = quant_row(dtype, t->points + (size_t)i * TOPK_DIM, TOPK_DIM, (char*)codes + (size_t)i * TOPK_DIM * quant_size(dtype));
+        if (scales) scales[i] = s;
+    }
+    free(t->points);
+    t->points = NULL;
+    t->dtype = dtype;
+    t->codes = codes;
+    t->scales = scales;
+    float x[TOPK_DIM];
+    for (int id = 0; id < t->node_count; id++) {
+        TopkNode *node = &t->nodes[id];
+        for (int i = node->begin; i < node->end; i++) {
+            const float *p = topk_point(t, i, x);
+            for (int j = 0; j < TOPK_DIM; j++) {
+                if (i == node->begin || p[j] < node->lo[j]) node->lo[j] = p[j];
+                if (i == node->begin || p[j] > node->hi[j]) node->hi[j] = p[j];
+            }
+        }
+    }
+    return 1;
+}
+
+// Heap bytes of the point storage, ids and nodes
+static inline size_t topk_bytes(const TopkIndex *t) {
+    size_t points = (size_t)t->n * TOPK_DIM * quant_size(t->dtype) + (t->scales ? (size_t)t->n * sizeof(float) : 0);
+    return points + (size_t)t->n * sizeof(int) + (size_t)t->node_count * sizeof(TopkNode);
+}
+
+static inline void topk_search(const TopkIndex *t, int id, const float *q, float bound, TopkQuery *r) {
+    if (r->leaves_left == 0) return;
+    if (r->count == r->k && bound < r->scores[r->k - 1]) return;
+    const TopkNode *node = &t->nodes[id];
+    if (node->left < 0) {
+        float x[TOPK_DIM];
+        for (int i = node->begin; i < node->end; i++) topk_offer(r, t->ids[i], topk_dot(q, topk_point(t, i, x)));
+        if (r->leaves_left > 0) r->leaves_left--;
+        return;
+    }
+    float bl = topk_bound(&t->nodes[node->left], q), br = topk_bound(&t->nodes[node->right], q);
+    if (bl >= br) { topk_search(t, node->left, q, bl, r); topk_search(t, node->right, q, br, r); }
+    else { topk_search(t, node->right, q, br, r); topk_search(t, node->left, q, bl, r); }
+}
+
+// Fill ids/scores (room for k each) with the best k dot products against q,
+// best first. Returns how many were found (min(k, n) in exact mode).
+static inline int topk_query(const TopkIndex *t, const float *q, int k, int max_leaves, int *ids, float *scores) {
+    if (t->n == 0 || k <= 0) return 0;
+    TopkQuery r = { k, 0, ids, scores, max_leaves > 0 ? max_leaves : -1, 0 };
+    topk_search(t, 0, q, topk_bound(&t->nodes[0], q), &r);
+    return r.count;
+}
+
+#endif
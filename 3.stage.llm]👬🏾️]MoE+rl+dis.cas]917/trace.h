@@ -0,0 +1,270 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Buffered generation trace for the chatbot.
+//
+// Events are encoded into a small binary record on the caller's stack and
+// copied into an in-memory ring. A background thread writes the ring to the
+// trace file in batches (once TRACE_BATCH bytes are waiting, every
+// TRACE_FLUSH_MS, and on close), so generation never waits on the disk. If
+// the writer falls behind and the ring fills, events are dropped and counted
+// rather than blocking; the count is written as a TRACE_DROPPED record.
+//
+// File layout: "RDTR", uint32 version, then records of
+//   uint8 type, uint8 reserved[3], uint32 payload length, payload
+// Payload fields are native-endian u32/i32/f32 and strings stored as u32
+// length plus bytes. trace_reader.c renders a trace in the old
+// debug_chain.txt layout. Payloads by type:
+//   TRACE_SESSION   str prompt, i32 desired length, f32 temperature,
+//                   u32 n, n x str curriculum path
+//   TRACE_STEP      str current word, i32 its index, f32 temperature,
+//                   u32 top N, u32 c, c x (str word, i32 index, f32 score,
+//                   f32 probability), str chosen word, i32 its index,
+//                   u32 e, e x (u32 expert, u32 row number, u32 occurrences)
+//   TRACE_RESPONSE  str response
+//   TRACE_DROPPED   u64 events lost to a full ring
+//   TRACE_EXPERTS   u32 tokens routed, u32 experts per token, u32 n,
+//                   n x (u32 tokens routed to it, f32 sum of its gate
+//                   probability), after the response when routing is on
+//
+// Levels (CHATBOT_TRACE): 0 off, 1 prompt and final response, 2 adds each
+// chosen word and its experts, 3 adds the top candidates with their scores.
+// At level 0 no file or thread is created and every trace call is a
+// compare and return.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#define TRACE_MAGIC "RDTR"
+#define TRACE_VERSION 1
+#define TRACE_DEFAULT_FILE "debug_chain.trace"
+#define TRACE_DEFAULT_LEVEL 3
+#define TRACE_RING_SIZE (1 << 20)
+#define TRACE_BATCH (64 << 10)
+#define TRACE_FLUSH_MS 200
+#define TRACE_MAX_RECORD 8192
+
+enum { TRACE_OFF = 0, TRACE_SUMMARY = 1, TRACE_STEPS = 2, TRACE_CANDIDATES = 3 };
+enum { TRACE_SESSION = 1, TRACE_STEP = 2, TRACE_RESPONSE = 3, TRACE_DROPPED = 4, TRACE_EXPERTS = 5 };
+
+typedef struct {
+    int level;
+    FILE *out;
+    unsigned char *ring;
+    size_t head, tail;          // bytes ever written / ever flushed; ring index is % TRACE_RING_SIZE
+    uint64_t dropped;           // events lost to a full ring since the last flush
+    int closing;
+    pthread_t writer;
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+} Tracer;
+
+// One record being encoded
+typedef struct {
+    unsigned char buf[TRACE_MAX_RECORD];
+    size_t len;
+    int overflow;
+} TraceRecord;
+
+// --- Encoding ---
+
+static inline void trace_begin(TraceRecord *r, int type) {
+    memset(r->buf, 0, 8);
+    r->buf[0] = (unsigned char)type;
+    r->len = 8;
+    r->overflow = 0;
+}
+
+static inline void trace_put(TraceRecord *r, const void *p, size_t n) {
+    if (r->len + n > sizeof(r->buf)) { r->overflow = 1; return; }
+    memcpy(r->buf + r->len, p, n);
+    r->len += n;
+}
+
+static inline void trace_put_u32(TraceRecord *r, uint32_t v) { trace_put(r, &v, 4); }
+static inline void trace_put_i32(TraceRecord *r, int32_t v) { trace_put(r, &v, 4); }
+static inline void trace_put_f32(TraceRecord *r, float v) { trace_put(r, &v, 4); }
+static inline void trace_put_str(TraceRecord *r, const char *s) {
+    uint32_t n = strlen(s);
+    trace_put_u32(r, n);
+    trace_put(r, s, n);
+}
+
+// --- Writer ---
+
+static inline void trace_write_span(Tracer *t, size_t from, size_t to) {
+    while (from < to) {
+        size_t at = from % TRACE_RING_SIZE, n = to - from;
+        if (n > TRACE_RING_SIZE - at) n = TRACE_RING_SIZE - at;
+        fwrite(t->ring + at, 1, n, t->out);
+        from += n;
+    }
+}
+
+static inline void *trace_writer(void *arg) {
+    Tracer *t = arg;
+    pthread_mutex_lock(&t->mu);
+    for (;;) {
+        if (!t->closing && t->head - t->tail < TRACE_BATCH) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += TRACE_FLUSH_MS * 1000000L;
+            until.tv_sec += until.tv_nsec / 1000000000L;
+            until.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&t->cv, &t->mu, &until);
+        }
+        size_t from = t->tail, to = t->head;
+        uint64_t dropped = t->dropped;
+        int closing = t->closing;
+        t->dropped = 0;
+        pthread_mutex_unlock(&t->mu);
+
+        // The producer only writes past head, so [from, to) is ours to read
+        if (to > from || dropped) {
+            trace_write_span(t, from, to);
+            if (dropped) {
+                TraceRecord r;
+                trace_begin(&r, TRACE_DROPPED);
+                trace_put(&r, &dropped, sizeof(dropped));
+                uint32_t n = r.len - 8;
+                memcpy(r.buf + 4, &n, 4);
+                fwrite(r.buf, 1, r.len, t->out);
+            }
+            fflush(t->out);
+        }
+
+        pthread_mutex_lock(&t->mu);
+        t->tail = to;
+        if (closing && t->head == t->tail) break;
+    }
+    pthread_mutex_unlock(&t->mu);
+    return NULL;
+}
+
+// Queue a finished record. Never blocks on I/O.
+static inline void trace_emit(Tracer *t, TraceRecord *r) {
+    if (t->level == TRACE_OFF || r->overflow) return;
+    uint32_t n = r->len - 8;
+    memcpy(r->buf + 4, &n, 4);
+    pthread_mutex_lock(&t->mu);
+    if (t->head - t->tail + r->len > TRACE_RING_SIZE) {
+        t->dropped++;
+    } else {
+        size_t at = t->head % TRACE_RING_SIZE, first = r->len;
+        if (first > TRACE_RING_SIZE - at) first = TRACE_RING_SIZE - at;
+        memcpy(t->ring + at, r->buf, first);
+        memcpy(t->ring, r->buf + first, r->len - first);
+        t->head += r->len;
+        if (t->head - t->tail >= TRACE_BATCH) pthread_cond_signal(&t->cv);
+    }
+    pthread_mutex_unlock(&t->mu);
+}
+
+// Level from CHATBOT_TRACE, TRACE_DEFAULT_LEVEL when unset
+static inline int trace_level_from_env(void) {
+    const char *s = getenv("CHATBOT_TRACE");
+    if (!s || !*s) return TRACE_DEFAULT_LEVEL;
+    int level = atoi(s);
+    return level < TRACE_OFF ? TRACE_OFF : level > TRACE_CANDIDATES ? TRACE_CANDIDATES : level;
+}
+
+// Start tracing to path at the given level. On failure tracing is turned
+// off and 0 is returned; the caller can carry on without it.
+static inline int trace_open(Tracer *t, const char *path, int level) {
+    memset(t, 0, sizeof(*t));
+    if (level <= TRACE_OFF) return 1;
+    t->out = fopen(path, "wb");
+    t->ring = malloc(TRACE_RING_SIZE);
+    if (!t->out || !t->ring) {
+        fprintf(stderr, "Tracing disabled: cannot open %s\n", path);
+        if (t->out) fclose(t->out);
+        free(t->ring);
+        memset(t, 0, sizeof(*t));
+        return 0;
+    }
+    uint32_t version = TRACE_VERSION;
+    fwrite(TRACE_MAGIC, 1, 4, t->out);
+    fwrite(&version, 4, 1, t->out);
+    pthread_mutex_init(&t->mu, NULL);
+    pthread_cond_init(&t->cv, NULL);
+    if (pthread_create(&t->writer, NULL, trace_writer, t) != 0) {
+        fclose(t->out);
+        free(t->ring);
+        memset(t, 0, sizeof(*t));
+        return 0;
+    }
+    t->level = level;
+    return 1;
+}
+
+// Flush everything queued and stop the writer
+static inline void trace_close(Tracer *t) {
+    if (t->level > TRACE_OFF) {
+        pthread_mutex_lock(&t->mu);
+        t->closing = 1;
+        pthread_cond_signal(&t->cv);
+        pthread_mutex_unlock(&t->mu);
+        pthread_join(t->writer, NULL);
+        fclose(t->out);
+        free(t->ring);
+        pthread_mutex_destroy(&t->mu);
+        pthread_cond_destroy(&t->cv);
+    }
+    memset(t, 0, sizeof(*t));
+}
+
+// --- Reading ---
+
+typedef struct {
+    int type;
+    uint32_t len, pos;
+    unsigned char *data;
+    int bad;                    // set when a field ran past the payload
+} TraceCursor;
+
+// Check the file header; returns 0 if this is not a trace
+static inline int trace_read_header(FILE *f) {
+    char magic[4];
+    uint32_t version;
+    return fread(magic, 1, 4, f) == 4 && memcmp(magic, TRACE_MAGIC, 4) == 0 &&
+           fread(&version, 4, 1, f) == 1 && version == TRACE_VERSION;
+}
+
+// Next record into c (payload in buf, which must hold TRACE_MAX_RECORD bytes)
+static inline int trace_read_record(FILE *f, TraceCursor *c, unsigned char *buf) {
+    unsigned char head[8];
+    if (fread(head, 1, 8, f) != 8) return 0;
+    memset(c, 0, sizeof(*c));
+    c->type = head[0];
+    memcpy(&c->len, head + 4, 4);
+    if (c->len > TRACE_MAX_RECORD || fread(buf, 1, c->len, f) != c->len) return 0;
+    c->data = buf;
+    return 1;
+}
+
+static inline void trace_get(TraceCursor *c, void *p, size_t n) {
+    if (c->pos + n > c->len) { c->bad = 1; memset(p, 0, n); return; }
+    memcpy(p, c->data + c->pos, n);
+    c->pos += n;
+}
+
+static inline uint32_t trace_get_u32(TraceCursor *c) { uint32_t v; trace_get(c, &v, 4); return v; }
+static inline int32_t trace_get_i32(TraceCursor *c) { int32_t v; trace_get(c, &v, 4); return v; }
+static inline float trace_get_f32(TraceCursor *c) { float v; trace_get(c, &v, 4); return v; }
+
+// Copy a string field into out (size n), truncating if needed
+static inline const char *trace_get_str(TraceCursor *c, char *out, size_t n) {
+    uint32_t len = trace_get_u32(c);
+    if (c->pos + len > c->len) { c->bad = 1; len = 0; }
+    size_t keep = len < n - 1 ? len : n - 1;
+    memcpy(out, c->data + c->pos, keep);
+    out[keep] = 0;
+    c->pos += len;
+    return out;
+}
+
+#endif
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+// Renders a chatbot trace (trace.h) in the debug_chain.txt layout the
+// chatbot used to append token by token.
+//
+//   trace_reader [debug_chain.trace] [debug_chain.txt]
+//
+// Without an output path the chain goes to stdout.
+
+#define MAX_FIELD 1024
+
+static void render_session(TraceCursor *c, FILE *out) {
+    char s[MAX_FIELD];
+    fprintf(out, "=== Chatbot MOE Debug Log ===\n");
+    fprintf(out, "Prompt: %s\n", trace_get_str(c, s, sizeof(s)));
+    fprintf(out, "Desired length: %d\n", trace_get_i32(c));
+    fprintf(out, "Temperature: %f\n", trace_get_f32(c));
+    uint32_t n = trace_get_u32(c);
+    fprintf(out, "Using %u training sets:\n", n);
+    for (uint32_t i = 0; i < n && !c->bad; i++) {
+        fprintf(out, "  %u. %s\n", i + 1, trace_get_str(c, s, sizeof(s)));
+    }
+    fprintf(out, "========================\n\n");
+}
+
+static void render_step(TraceCursor *c, FILE *out) {
+    char s[MAX_FIELD];
+    trace_get_str(c, s, sizeof(s));
+    int index = trace_get_i32(c);
+    fprintf(out, "\nDebug: Current word: %s (index: %d)\n", s, index);
+    fprintf(out, "Temperature: %f\n", trace_get_f32(c));
+    uint32_t top_n = trace_get_u32(c), candidates = trace_get_u32(c);
+    fprintf(out, "Considering top %u scores:\n", top_n);
+    for (uint32_t i = 0; i < candidates && !c->bad; i++) {
+        trace_get_str(c, s, sizeof(s));
+        int id = trace_get_i32(c);
+        float score = trace_get_f32(c), p = trace_get_f32(c);
+        fprintf(out, "  %u. %s (index: %d): %f (p=%f)\n", i + 1, s, id, score, p);
+    }
+    trace_get_str(c, s, sizeof(s));
+    index = trace_get_i32(c);
+    fprintf(out, "Chosen word: %s (index: %d)\n", s, index);
+    uint32_t experts = trace_get_u32(c);
+    fprintf(out, "    experts:");
+    for (uint32_t i = 0; i < experts && !c->bad; i++) {
+        uint32_t source = trace_get_u32(c), number = trace_get_u32(c), occurrences = trace_get_u32(c);
+        fprintf(out, " %u(#%u x%u)", source + 1, number, occurrences);
+    }
+    fprintf(out, "\n");
+}
+
+static void render_experts(TraceCursor *c, FILE *out) {
+    uint32_t tokens = trace_get_u32(c), k = trace_get_u32(c), n = trace_get_u32(c);
+    fprintf(out, "\n=== Expert Load (top %u of %u, %u tokens) ===\n", k, n, tokens);
+    for (uint32_t i = 0; i < n && !c->bad; i++) {
+        uint32_t routed = trace_get_u32(c);
+        float importance = trace_get_f32(c);
+        fprintf(out, "  %u. %u routed, mean gate %f\n", i + 1, routed, tokens ? importance / tokens : 0.0f);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *in_path = argc >= 2 ? argv[1] : TRACE_DEFAULT_FILE;
+    FILE *in = fopen(in_path, "rb");
+    if (!in) {
+        perror("Error opening trace file");
+        return 1;
+    }
+    if (!trace_read_header(in)) {
+        fprintf(stderr, "%s is not a chatbot trace\n", in_path);
+        fclose(in);
+        return 1;
+    }
+    FILE *out = stdout;
+    if (argc >= 3 && !(out = fopen(argv[2], "w"))) {
+        perror("Error opening output file");
+        fclose(in);
+        return 1;
+    }
+
+    static unsigned char buf[TRACE_MAX_RECORD];
+    char s[TRACE_MAX_RECORD];
+    TraceCursor c;
+    int status = 0;
+    while (trace_read_record(in, &c, buf)) {
+        switch (c.type) {
+            case TRACE_SESSION: render_session(&c, out); break;
+            case TRACE_STEP: render_step(&c, out); break;
+            case TRACE_RESPONSE:
+                fprintf(out, "\n=== Final Response ===\n");
+                fprintf(out, "%s\n", trace_get_str(&c, s, sizeof(s)));
+                fprintf(out, "======================\n");
+                break;
+            case TRACE_EXPERTS: render_experts(&c, out); break;
+            case TRACE_DROPPED: {
+                uint64_t dropped;
+                trace_get(&c, &dropped, sizeof(dropped));
+                fprintf(out, "\n[%llu trace events dropped]\n", (unsigned long long)dropped);
+                break;
+            }
+            default: break;  // record types from newer writers
+        }
+        if (c.bad) {
+            fprintf(stderr, "Malformed record of type %d in %s\n", c.type, in_path);
+            status = 1;
+            break;
+        }
+    }
+    if (!feof(in) && !status) {
+        fprintf(stderr, "Trace %s ends in a partial record\n", in_path);
+        status = 1;
+    }
+
+    fclose(in);
+    if (out != stdout) fclose(out);
+    return status;
+}
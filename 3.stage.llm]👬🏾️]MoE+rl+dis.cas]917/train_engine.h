@@ -0,0 +1,314 @@
+#ifndef TRAIN_ENGINE_H
+#define TRAIN_ENGINE_H
+
+// In-process training engine used by trainer.c.
+//
+// Holds the attention, MLP and output layer weights plus the Adam moments in
+// memory for the whole epoch loop instead of round-tripping them through
+// forward_prop.+x, backward_prop.+x and optimizer.+x for every token.
+//
+// The layer math is layers.h, the same code the three stage programs run.
+// With text_compat enabled every value that used to cross a stage boundary
+// through a "%f" text file is rounded the same way here, so the weights
+// written at a checkpoint match the spawned pipeline bit for bit.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "layers.h"
+#include "output_softmax.h"
+
+typedef struct {
+    int vs;
+    int text_compat;
+
+    // Parameters and Adam moments
+    AttentionLayer attn, m_attn, v_attn;
+    MlpLayer mlp, m_mlp, v_mlp;
+    OutputLayer out, m_out, v_out;
+    float lr, b1, b2;
+    int t;
+
+    // Forward activations for the current token
+    float iv[EMBEDDING_DIM], q[EMBEDDING_DIM], k[EMBEDDING_DIM], val[EMBEDDING_DIM], ctx[EMBEDDING_DIM];
+    float h[HIDDEN_DIM];
+    float *as, *preds, *grad_loss;
+
+    // Vocabulary features transposed for kern_scores() and their per-word
+    // sums; built on the first forward, the vocab is fixed while training
+    float *feat_cols, *feat_sums;
+
+    // Gradients for the current token
+    AttentionLayer g_attn;
+    MlpLayer g_mlp;
+    OutputLayer g_out;
+    float *g_as;
+
+    // Each stage process used to start its LCG from the same seed
+    unsigned int dropout_seed, noise_seed;
+
+    // Sampled and hierarchical softmax (output_softmax.h). The current
+    // token's loss touches output columns cols[0..ncols); grad_loss and
+    // g_cand hold the gradient for those columns only.
+    int softmax_mode, samples;
+    SoftmaxSampler sampler;
+    SoftmaxTree tree;
+    int *cols, ncols, cols_cap;
+    unsigned int *col_mark, mark_stamp, sample_seed;
+    OutputLayer g_cand;
+} TrainEngine;
+
+// --- Text round trip ---
+// Value a float has after "%f" in one stage and fscanf("%f") in the next.
+static inline float text_round(float x) { char b[64]; snprintf(b, sizeof(b), "%f", x); return strtof(b, NULL); }
+static inline void text_round_all(float *x, int n) { for (int i = 0; i < n; i++) x[i] = text_round(x[i]); }
+
+// Create any missing model file so the engine and the spawned stages start
+// from the same weights on disk.
+static inline void ensure_model_files(const char *attn_path, const char *mlp_path, const char *out_path, int vs) {
+    FILE *f;
+    if ((f = fopen(attn_path, "r"))) fclose(f);
+    else { AttentionLayer a; initialize_attention(&a); save_attention(attn_path, &a); fprintf(stderr, "Initialized %s\n", attn_path); }
+    if ((f = fopen(mlp_path, "r"))) fclose(f);
+    else { MlpLayer m; initialize_mlp(&m); save_mlp(mlp_path, &m); fprintf(stderr, "Initialized %s\n", mlp_path); }
+    if ((f = fopen(out_path, "r"))) fclose(f);
+    else {
+        OutputLayer o;
+        if (!alloc_output(&o, vs)) return;
+        initialize_output(&o, vs); save_output(out_path, &o, vs); free_output(&o);
+        fprintf(stderr, "Initialized %s\n", out_path);
+    }
+}
+
+// --- Engine lifecycle ---
+static inline int train_engine_init(TrainEngine *e, int vs, float lr, float b1, float b2, int text_compat) {
+    memset(e, 0, sizeof(*e));
+    e->vs = vs;
+    e->text_compat = text_compat;
+    // The optimizer state file stores lr/b1/b2 with "%f"
+    e->lr = text_compat ? text_round(lr) : lr;
+    e->b1 = text_compat ? text_round(b1) : b1;
+    e->b2 = text_compat ? text_round(b2) : b2;
+    e->t = 0;
+    if (!alloc_output(&e->out, vs) || !alloc_output(&e->m_out, vs) || !alloc_output(&e->v_out, vs) || !alloc_output(&e->g_out, vs)) return 0;
+    e->as = malloc(vs * sizeof(float));
+    e->preds = malloc(vs * sizeof(float));
+    e->grad_loss = malloc(vs * sizeof(float));
+    e->g_as = malloc(vs * sizeof(float));
+    return e->as && e->preds && e->grad_loss && e->g_as;
+}
+
+static inline void train_engine_free(TrainEngine *e) {
+    free_output(&e->out); free_output(&e->m_out); free_output(&e->v_out); free_output(&e->g_out);
+    free(e->as); free(e->preds); free(e->grad_loss); free(e->g_as);
+    free(e->feat_cols); free(e->feat_sums);
+    free_output(&e->g_cand); free(e->cols); free(e->col_mark);
+    softmax_sampler_free(&e->sampler); softmax_tree_free(&e->tree);
+}
+
+// Switch the output loss to sampled or hierarchical softmax. The tree or
+// sampler is built from the word counts of vocab_path (output_softmax.h).
+// text_compat only applies to the full softmax: its rounding covers all vs
+// output gradient columns, and g_cand holds just the candidates.
+static inline int train_engine_set_softmax(TrainEngine *e, int mode, int samples, struct VocabEntry *v, const char *vocab_path) {
+    int vs = e->vs;
+    if (mode == SOFTMAX_FULL) {
+        e->softmax_mode = mode;
+        return 1;
+    }
+    if (e->text_compat) {
+        fprintf(stderr, "text_compat only works with the full softmax\n");
+        return 0;
+    }
+    e->softmax_mode = mode;
+    const char **words = malloc(vs * sizeof(char*));
+    if (!words) return 0;
+    for (int i = 0; i < vs; i++) words[i] = v[i].word;
+    double *counts = softmax_load_counts(vocab_path, words, vs);
+    free(words);
+    if (!counts) return 0;
+    int ok;
+    if (mode == SOFTMAX_SAMPLED) {
+        if (samples < 1) samples = 1;
+        if (samples > vs - 1) samples = vs - 1 > 0 ? vs - 1 : 1;
+        e->samples = samples;
+        e->cols_cap = samples + 1;
+        ok = softmax_sampler_init(&e->sampler, counts, vs);
+    } else {
+        e->cols_cap = SOFTMAX_MAX_CODE;
+        ok = softmax_tree_build(&e->tree, counts, vs);
+    }
+    free(counts);
+    e->cols = malloc(e->cols_cap * sizeof(int));
+    e->col_mark = calloc(vs, sizeof(unsigned int));
+    e->sample_seed = SOFTMAX_SAMPLE_SEED;
+    return ok && e->cols && e->col_mark && alloc_output(&e->g_cand, e->cols_cap);
+}
+
+static inline float output_logit(const OutputLayer *o, const float *h, int col) {
+    float z = 0;
+    for (int l = 0; l < HIDDEN_DIM; l++) z += h[l] * o->weights[l][col];
+    return z + o->biases[col];
+}
+
+// Loss for predicting `target` under the sampled or hierarchical softmax.
+// Fills cols and the per-column gradient in grad_loss.
+static inline float train_engine_output_loss(TrainEngine *e, int target) {
+    const float *h = e->h;
+    float *g = e->grad_loss, loss = 0;
+    e->ncols = 0;
+    if (e->softmax_mode == SOFTMAX_HIERARCHICAL) {
+        const SoftmaxTree *t = &e->tree;
+        for (int d = t->off[target]; d < t->off[target + 1]; d++) {
+            int col = t->node[d];
+            float s = output_logit(&e->out, h, col);
+            loss -= softmax_log_sigmoid(t->bit[d] ? s : -s);
+            e->cols[e->ncols] = col;
+            g[e->ncols++] = softmax_sigmoid(s) - t->bit[d];
+        }
+        return loss;
+    }
+
+    // Target first, then distinct negatives; accidental hits are redrawn
+    // up to a bound so tiny vocabularies cannot spin
+    if (++e->mark_stamp == 0) { memset(e->col_mark, 0, e->vs * sizeof(unsigned int)); e->mark_stamp = 1; }
+    e->cols[e->ncols++] = target;
+    e->col_mark[target] = e->mark_stamp;
+    for (int tries = 0; e->ncols <= e->samples && tries < 4 * e->samples; tries++) {
+        int w = softmax_sample(&e->sampler, &e->sample_seed);
+        if (e->col_mark[w] == e->mark_stamp) continue;
+        e->col_mark[w] = e->mark_stamp;
+        e->cols[e->ncols++] = w;
+    }
+    float max = -INFINITY;
+    for (int c = 0; c < e->ncols; c++) {
+        int w = e->cols[c];
+        g[c] = output_logit(&e->out, h, w) - logf(e->samples * e->sampler.q[w]);
+        if (g[c] != g[c]) g[c] = 0;
+        if (g[c] > max) max = g[c];
+    }
+    float sum = 0;
+    for (int c = 0; c < e->ncols; c++) { g[c] = expf(g[c] - max); sum += g[c]; }
+    for (int c = 0; c < e->ncols; c++) g[c] /= sum;
+    loss = -logf(g[0] + EPSILON);
+    g[0] -= 1.0f;
+    return loss;
+}
+
+static inline int train_engine_load(TrainEngine *e, const char *attn_path, const char *mlp_path, const char *out_path) {
+    if (!load_attention(attn_path, &e->attn)) { fprintf(stderr, "Failed to load %s\n", attn_path); return 0; }
+    if (!load_mlp(mlp_path, &e->mlp)) { fprintf(stderr, "Failed to load %s\n", mlp_path); return 0; }
+    if (!load_output(out_path, &e->out, e->vs)) { fprintf(stderr, "Failed to load %s\n", out_path); return 0; }
+    return 1;
+}
+
+// Write weights, moments and optimizer state in the formats the stage
+// programs and the chatbot read. Moments follow the model files' format.
+static inline void train_engine_checkpoint(TrainEngine *e, const char *output_dir, const char *attn_path, const char *mlp_path, const char *out_path, const char *optim_path) {
+    char p[1024];
+    const char *ext = tensor_ext(attn_path);
+    save_attention(attn_path, &e->attn); save_mlp(mlp_path, &e->mlp); save_output(out_path, &e->out, e->vs);
+    sprintf(p, "%s/attention_model.m%s", output_dir, ext); save_attention(p, &e->m_attn);
+    sprintf(p, "%s/attention_model.v%s", output_dir, ext); save_attention(p, &e->v_attn);
+    sprintf(p, "%s/mlp_model.m%s", output_dir, ext); save_mlp(p, &e->m_mlp);
+    sprintf(p, "%s/mlp_model.v%s", output_dir, ext); save_mlp(p, &e->v_mlp);
+    sprintf(p, "%s/output_layer.m%s", output_dir, ext); save_output(p, &e->m_out, e->vs);
+    sprintf(p, "%s/output_layer.v%s", output_dir, ext); save_output(p, &e->v_out, e->vs);
+    FILE *sf = fopen(optim_path, "w");
+    if (sf) { fprintf(sf, "%f %f %f %d", e->lr, e->b1, e->b2, e->t); fclose(sf); }
+}
+
+// --- Forward pass for one token (forward_prop.c main) ---
+// Leaves the logits in e->preds (full softmax only).
+static inline int train_engine_forward(TrainEngine *e, struct VocabEntry *v, int wi, int causal_attention) {
+    int vs = e->vs;
+    if (wi < 0 || wi >= vs) { fprintf(stderr, "Invalid word index: %d (vocab size: %d)\n", wi, vs); return 0; }
+    float *iv = e->iv;
+    e->dropout_seed = LAYER_DROPOUT_SEED;
+
+    iv[0]=v[wi].embedding; iv[1]=v[wi].pe; iv[2]=v[wi].weight; iv[3]=v[wi].bias1;
+    iv[4]=v[wi].bias2; iv[5]=v[wi].bias3; iv[6]=v[wi].bias4;
+    if (!e->feat_cols) {
+        float *feats = malloc((size_t)vs * EMBEDDING_DIM * sizeof(float));
+        e->feat_cols = malloc((size_t)vs * EMBEDDING_DIM * sizeof(float));
+        e->feat_sums = malloc(vs * sizeof(float));
+        if (!feats || !e->feat_cols || !e->feat_sums) { free(feats); fprintf(stderr, "Failed to allocate vocabulary features\n"); return 0; }
+        for (int j = 0; j < vs; j++) {
+            float *f = feats + (size_t)j * EMBEDDING_DIM;
+            f[0]=v[j].embedding; f[1]=v[j].pe; f[2]=v[j].weight; f[3]=v[j].bias1; f[4]=v[j].bias2; f[5]=v[j].bias3; f[6]=v[j].bias4;
+        }
+        layer_feature_columns(feats, vs, e->feat_cols, e->feat_sums);
+        free(feats);
+    }
+    layer_attention_qkv(&e->attn, iv, 1, e->q, e->k, e->val);
+    layer_attention_scores(e->q, 1, e->feat_cols, e->as, vs);
+    layer_attention_forward(e->as, vs, e->feat_sums, iv, causal_attention ? wi : -1, &e->dropout_seed, e->ctx);
+    layer_mlp_forward(&e->mlp, e->ctx, e->h, &e->dropout_seed);
+    // Sampled and hierarchical losses score only the columns they need
+    if (e->softmax_mode == SOFTMAX_FULL) layer_output_forward(&e->out, e->h, 1, e->preds, vs);
+
+    if (e->text_compat) {
+        // predictions.txt, context.txt, hidden_state.txt and v.txt
+        text_round_all(e->preds, vs); text_round_all(e->ctx, EMBEDDING_DIM); text_round_all(e->h, HIDDEN_DIM); text_round_all(e->val, EMBEDDING_DIM);
+    }
+    return 1;
+}
+
+// --- Backward pass for one token (backward_prop.c main) ---
+// Consumes e->grad_loss and leaves the layer gradients in e->g_*.
+static inline void train_engine_backward(TrainEngine *e, struct VocabEntry *v, int wi) {
+    int vs = e->vs;
+    float g_h[HIDDEN_DIM], g_c[EMBEDDING_DIM];
+    e->noise_seed = LAYER_NOISE_SEED;
+    // Output gradient column j belongs to output column cols[j]: all vs of
+    // them for the full softmax, the loss's candidate columns otherwise
+    const int *cols = e->softmax_mode == SOFTMAX_FULL ? NULL : e->cols;
+    int nc = cols ? e->ncols : vs;
+    OutputLayer *g_o = cols ? &e->g_cand : &e->g_out;
+
+    if (e->text_compat) text_round_all(e->grad_loss, vs);  // grad_loss.txt
+
+    layer_output_backward(&e->out, e->grad_loss, cols, nc, e->h, g_o, g_h);
+    layer_mlp_backward(&e->mlp, e->ctx, e->h, g_h, &e->g_mlp, g_c);
+    // Row 0 of the feature columns is every word's embedding
+    layer_attention_backward(g_c, e->val, e->feat_cols, v[wi].embedding, vs, e->g_as, &e->noise_seed, &e->g_attn);
+
+    if (e->text_compat) {
+        // grad_attn.txt, grad_mlp.txt and grad_output.txt
+        text_round_all((float*)&e->g_attn, sizeof(AttentionLayer)/sizeof(float));
+        text_round_all((float*)&e->g_mlp, sizeof(MlpLayer)/sizeof(float));
+        text_round_all(output_flat(g_o), (HIDDEN_DIM + 1) * vs);
+    }
+}
+
+// --- Adam step (optimizer.c "update") ---
+static inline void train_engine_step(TrainEngine *e) {
+    int vs = e->vs;
+    float lr = e->lr, b1 = e->b1, b2 = e->b2;
+    int t = ++e->t;
+    const int *cols = e->softmax_mode == SOFTMAX_FULL ? NULL : e->cols;
+    int nc = cols ? e->ncols : vs;
+    OutputLayer *g_o = cols ? &e->g_cand : &e->g_out;
+    clip_layer_gradients(&e->g_attn, &e->g_mlp, g_o, nc);
+    layer_attention_adam(&e->attn, &e->m_attn, &e->v_attn, &e->g_attn, lr, b1, b2, t);
+    layer_mlp_adam(&e->mlp, &e->m_mlp, &e->v_mlp, &e->g_mlp, lr, b1, b2, t);
+    // Lazy Adam for the sampled and hierarchical losses: columns outside
+    // the candidates keep their moments
+    layer_output_adam(&e->out, &e->m_out, &e->v_out, g_o, cols, nc, lr, b1, b2, t);
+
+    if (e->text_compat) {
+        // Every parameter and moment file is rewritten with "%f" after an update
+        text_round_all((float*)&e->attn, sizeof(AttentionLayer)/sizeof(float));
+        text_round_all((float*)&e->m_attn, sizeof(AttentionLayer)/sizeof(float));
+        text_round_all((float*)&e->v_attn, sizeof(AttentionLayer)/sizeof(float));
+        text_round_all((float*)&e->mlp, sizeof(MlpLayer)/sizeof(float));
+        text_round_all((float*)&e->m_mlp, sizeof(MlpLayer)/sizeof(float));
+        text_round_all((float*)&e->v_mlp, sizeof(MlpLayer)/sizeof(float));
+        text_round_all(output_flat(&e->out), (HIDDEN_DIM + 1) * vs);
+        text_round_all(output_flat(&e->m_out), (HIDDEN_DIM + 1) * vs);
+        text_round_all(output_flat(&e->v_out), (HIDDEN_DIM + 1) * vs);
+    }
+}
+
+#endif
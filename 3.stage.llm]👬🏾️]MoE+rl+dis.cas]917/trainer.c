@@ -4,6 +4,8 @@
 #include <time.h>
 #include <math.h>
 #include <libgen.h>
+#include <sys/resource.h>
+#include "output_softmax.h"
 
 #define EPSILON 1e-8
 #define MAX_GRADIENT_NORM 1.0f
@@ -25,24 +27,41 @@ typedef struct {
     float attention_noise;
     float attention_weights_noise;
     int causal_attention;
+    int checkpoint_interval;  // Epochs between checkpoints of the in-process engine (0 = only at the end)
+    int text_compat;          // Round values like the text files between stages did
+    int binary_io;            // Keep models, moments and stage files in the .bin tensor format
+    int softmax_mode;         // SOFTMAX_FULL, SOFTMAX_SAMPLED or SOFTMAX_HIERARCHICAL (output_softmax.h)
+    int softmax_samples;      // Negatives per token for the sampled softmax
+    char corpus[512];         // Text to train on as a token stream (corpus_loader.h), relative to the vocab's directory; empty = the vocab sequence
+    int corpus_window;        // Next-word pairs per shuffled window of the corpus
+    int shuffle_seed;         // Window shuffle seed (0 = stream order)
 } Config;
 
 // --- Configuration Functions ---
 int load_config(Config *config, const char *config_file) {
+    // Set default values; keys missing from the file keep them
+    config->epochs = 10;
+    config->learning_rate = 0.001f;
+    config->beta1 = 0.9f;
+    config->beta2 = 0.999f;
+    config->max_gradient_norm = 1.0f;
+    config->attention_dropout = 0.1f;
+    config->mlp_dropout = 0.2f;
+    config->attention_noise = 0.01f;
+    config->attention_weights_noise = 0.005f;
+    config->causal_attention = 0;
+    config->checkpoint_interval = 0;
+    config->text_compat = 0;
+    config->binary_io = 0;
+    config->softmax_mode = SOFTMAX_FULL;
+    config->softmax_samples = 64;
+    config->corpus[0] = 0;
+    config->corpus_window = 256;
+    config->shuffle_seed = 0;
+
     FILE *file = fopen(config_file, "r");
     if (!file) {
         fprintf(stderr, "Warning: Could not open config file %s, using defaults\n", config_file);
-        // Set default values
-        config->epochs = 10;
-        config->learning_rate = 0.001f;
-        config->beta1 = 0.9f;
-        config->beta2 = 0.999f;
-        config->max_gradient_norm = 1.0f;
-        config->attention_dropout = 0.1f;
-        config->mlp_dropout = 0.2f;
-        config->attention_noise = 0.01f;
-        config->attention_weights_noise = 0.005f;
-        config->causal_attention = 0;
         return 0;
     }
     
@@ -52,9 +71,15 @@ int load_config(Config *config, const char *config_file) {
         if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
         
         // Parse key=value pairs
-        char key[100];
+        char key[100], text[512];
         float value;
-        if (sscanf(line, "%[^=]=%f", key, &value) == 2) {
+        if (sscanf(line, "%99[^=]=%511s", key, text) == 2 && strcmp(key, "softmax") == 0) {
+            int mode = softmax_mode_parse(text);
+            if (mode < 0) fprintf(stderr, "Warning: unknown softmax=%s, using full\n", text);
+            config->softmax_mode = mode < 0 ? SOFTMAX_FULL : mode;
+        } else if (sscanf(line, "%99[^=]=%511s", key, text) == 2 && strcmp(key, "corpus") == 0) {
+            strcpy(config->corpus, text);
+        } else if (sscanf(line, "%[^=]=%f", key, &value) == 2) {
             if (strcmp(key, "epochs") == 0) config->epochs = (int)value;
             else if (strcmp(key, "learning_rate") == 0) config->learning_rate = value;
             else if (strcmp(key, "beta1") == 0) config->beta1 = value;
@@ -65,6 +90,12 @@ int load_config(Config *config, const char *config_file) {
             else if (strcmp(key, "attention_noise") == 0) config->attention_noise = value;
             else if (strcmp(key, "attention_weights_noise") == 0) config->attention_weights_noise = value;
             else if (strcmp(key, "causal_attention") == 0) config->causal_attention = (int)value;
+            else if (strcmp(key, "checkpoint_interval") == 0) config->checkpoint_interval = (int)value;
+            else if (strcmp(key, "text_compat") == 0) config->text_compat = (int)value;
+            else if (strcmp(key, "binary_io") == 0) config->binary_io = (int)value;
+            else if (strcmp(key, "softmax_samples") == 0) config->softmax_samples = (int)value;
+            else if (strcmp(key, "corpus_window") == 0) config->corpus_window = (int)value;
+            else if (strcmp(key, "shuffle_seed") == 0) config->shuffle_seed = (int)value;
         }
     }
     
@@ -84,11 +115,20 @@ void print_config(Config *config) {
     fprintf(stderr, "  Attention noise: %f\n", config->attention_noise);
     fprintf(stderr, "  Attention weights noise: %f\n", config->attention_weights_noise);
     fprintf(stderr, "  Causal attention: %s\n", config->causal_attention ? "enabled" : "disabled");
+    fprintf(stderr, "  Checkpoint interval: %d\n", config->checkpoint_interval);
+    fprintf(stderr, "  Text compat: %s\n", config->text_compat ? "enabled" : "disabled");
+    fprintf(stderr, "  Binary I/O: %s\n", config->binary_io ? "enabled" : "disabled");
+    if (config->softmax_mode == SOFTMAX_SAMPLED) fprintf(stderr, "  Softmax: sampled, %d negatives\n", config->softmax_samples);
+    else fprintf(stderr, "  Softmax: %s\n", softmax_mode_name(config->softmax_mode));
+    if (config->corpus[0]) fprintf(stderr, "  Corpus: %s, windows of %d, shuffle seed %d\n", config->corpus, config->corpus_window, config->shuffle_seed);
 }
 
 // --- Data Structures ---
 struct VocabEntry { int number; char word[100]; float embedding, pe, weight, bias1, bias2, bias3, bias4; };
 
+#include "train_engine.h"
+#include "corpus_loader.h"
+
 // --- Utility Functions ---
 void write_loss(float loss, const char *output_dir) { char loss_path[1024]; sprintf(loss_path, "%s/loss.txt", output_dir); FILE *file = fopen(loss_path, "a"); if (file) { fprintf(file, "%f\n", loss); fclose(file); } }
 int save_vocab(struct VocabEntry *vocab, int vocab_size, const char *filename) { FILE *outfile = fopen(filename, "w"); if (!outfile) { perror("Failed to open output file"); return 0; } fprintf(outfile, "number word embedding pe weight bias1 bias2 bias3 bias4\n"); for (int i = 0; i < vocab_size; i++) { fprintf(outfile, "%d %s %f %f %f %f %f %f %f\n", vocab[i].number, vocab[i].word, vocab[i].embedding, vocab[i].pe, vocab[i].weight, vocab[i].bias1, vocab[i].bias2, vocab[i].bias3, vocab[i].bias4); } fclose(outfile); return 1; }
@@ -156,8 +196,184 @@ float compute_cross_entropy_loss_and_gradient(float *predictions, int target_ind
     return loss; 
 }
 
+// --- In-process Training ---
+// One forward/loss/backward/Adam step predicting word `target` from word wi;
+// returns the loss
+static float train_step(TrainEngine *engine, struct VocabEntry *vocab, int vocab_size, Config *config, int wi, int target) {
+    if (!train_engine_forward(engine, vocab, wi, config->causal_attention)) { fprintf(stderr, "\nForward prop failed\n"); return 0.0f; }
+
+    float loss;
+    int n_grad = vocab_size;
+    if (config->softmax_mode == SOFTMAX_FULL) {
+        loss = compute_cross_entropy_loss_and_gradient(engine->preds, target, vocab_size, engine->grad_loss);
+    } else {
+        loss = train_engine_output_loss(engine, target);
+        n_grad = engine->ncols;
+    }
+    if (isnan(loss) || isinf(loss)) {
+        fprintf(stderr, "\nWarning: NaN or Inf loss detected, setting to 0\n");
+        loss = 0.0f;
+        for (int j = 0; j < n_grad; j++) engine->grad_loss[j] = 0.0f;
+    }
+
+    train_engine_backward(engine, vocab, wi);
+    train_engine_step(engine);
+    return loss;
+}
+
+// Tokenize config->corpus (reusing a fresh corpus.tok) and open it for the
+// run's epochs
+static int open_corpus(CorpusLoader *loader, struct VocabEntry *vocab, int vocab_size, const char *vocab_filename, Config *config, const char *output_dir) {
+    char dir_buf[1024], corpus_path[2048], tok_path[1024];
+    strcpy(dir_buf, vocab_filename);
+    if (config->corpus[0] == '/') snprintf(corpus_path, sizeof(corpus_path), "%s", config->corpus);
+    else snprintf(corpus_path, sizeof(corpus_path), "%s/%s", dirname(dir_buf), config->corpus);
+    sprintf(tok_path, "%s/%s", output_dir, CORPUS_TOKENS_FILE);
+    if (!corpus_tokens_fresh(tok_path, corpus_path, vocab, vocab_size) && !corpus_tokenize(tok_path, corpus_path, vocab, vocab_size)) return 0;
+    if (!corpus_loader_open(loader, tok_path, config->corpus_window, (uint32_t)config->shuffle_seed, config->epochs)) return 0;
+    if (loader->count < 2) { fprintf(stderr, "Corpus %s has no next-word pairs\n", corpus_path); corpus_loader_close(loader); return 0; }
+    return 1;
+}
+
+// Same per-token forward/loss/backward/Adam sequence as the spawned stages,
+// but the weights and moments stay in memory and only hit disk every
+// checkpoint_interval epochs and at the end.
+void train_model_in_process(struct VocabEntry *vocab, int vocab_size, const char *vocab_filename, Config *config, const char *output_dir,
+                            const char *attn_path, const char *mlp_path, const char *out_path, const char *optim_path) {
+    TrainEngine engine;
+    // Binary files carry exact floats, so there is no text rounding to mimic;
+    // the sampled and hierarchical losses have no spawned pipeline to match,
+    // and "%f" rounding would zero the small Adam moments of their columns
+    int text_compat = config->text_compat && !config->binary_io && config->softmax_mode == SOFTMAX_FULL;
+    if (!train_engine_init(&engine, vocab_size, config->learning_rate, config->beta1, config->beta2, text_compat)) {
+        fprintf(stderr, "Failed to allocate training engine\n");
+        train_engine_free(&engine);
+        return;
+    }
+    if (!train_engine_load(&engine, attn_path, mlp_path, out_path)) { train_engine_free(&engine); return; }
+    if (!train_engine_set_softmax(&engine, config->softmax_mode, config->softmax_samples, vocab, vocab_filename)) {
+        fprintf(stderr, "Failed to set up the %s softmax\n", softmax_mode_name(config->softmax_mode));
+        train_engine_free(&engine);
+        return;
+    }
+    if (config->softmax_mode == SOFTMAX_HIERARCHICAL) {
+        // forward_prop decodes the output layer through this tree from now on
+        char tree_path[1024];
+        sprintf(tree_path, "%s/%s", output_dir, SOFTMAX_TREE_FILE);
+        if (!softmax_tree_save(&engine.tree, tree_path)) fprintf(stderr, "Failed to write %s\n", tree_path);
+    }
+
+    // With corpus= the pairs come from the token stream, a window at a time;
+    // otherwise from the vocabulary rows in order
+    CorpusLoader loader;
+    int use_corpus = config->corpus[0] != 0;
+    if (use_corpus && !open_corpus(&loader, vocab, vocab_size, vocab_filename, config, output_dir)) { train_engine_free(&engine); return; }
+
+    struct timespec run_start, run_end;
+    long run_pairs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+    for (int epoch = 0; epoch < config->epochs; epoch++) {
+        float total_loss = 0.0f;
+        long pairs = 0;
+        if (use_corpus) {
+            struct timespec t0, t1;
+            double wait_before = loader.wait_sec;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            for (int w = 0; w < loader.nwindows; w++) {
+                const uint32_t *ids;
+                int n = corpus_loader_next(&loader, &ids);
+                fprintf(stderr, "\rEpoch %d/%d, Window %d/%d", epoch + 1, config->epochs, w + 1, loader.nwindows);
+                for (int t = 0; t + 1 < n; t++) total_loss += train_step(&engine, vocab, vocab_size, config, (int)ids[t], (int)ids[t + 1]);
+                if (n > 1) pairs += n - 1;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+            fprintf(stderr, "\nEpoch %d/%d: %ld tokens, %.0f tokens/sec, %.3f s waiting for data\n", epoch + 1, config->epochs, pairs,
+                    sec > 0 ? pairs / sec : 0.0, loader.wait_sec - wait_before);
+        } else {
+            for (int i = 0; i < vocab_size - 1; i++) {
+                fprintf(stderr, "\rEpoch %d/%d, Word %d/%d", epoch + 1, config->epochs, i + 1, vocab_size - 1);
+                total_loss += train_step(&engine, vocab, vocab_size, config, i, i + 1);
+            }
+            pairs = vocab_size - 1;
+        }
+        run_pairs += pairs;
+        if (pairs == 0) {
+            // A corpus too short for a single pair trains nothing
+            fprintf(stderr, "\nEpoch %d/%d: no training pairs, loss not written\n", epoch + 1, config->epochs);
+        } else {
+            write_loss(total_loss / pairs, output_dir);
+            fprintf(stderr, "\nEpoch %d/%d, Loss: %f\n", epoch + 1, config->epochs, total_loss / pairs);
+        }
+
+        if (config->checkpoint_interval > 0 && (epoch + 1) % config->checkpoint_interval == 0 && epoch + 1 < config->epochs) {
+            train_engine_checkpoint(&engine, output_dir, attn_path, mlp_path, out_path, optim_path);
+            fprintf(stderr, "Checkpoint written after epoch %d\n", epoch + 1);
+        }
+    }
+    if (use_corpus) corpus_loader_close(&loader);
+    clock_gettime(CLOCK_MONOTONIC, &run_end);
+    train_engine_checkpoint(&engine, output_dir, attn_path, mlp_path, out_path, optim_path);
+    // One line for test/bench_train.sh: checkpoint writes are not timed
+    double run_sec = (run_end.tv_sec - run_start.tv_sec) + (run_end.tv_nsec - run_start.tv_nsec) * 1e-9;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr, "Trained %ld tokens in %.3f s, %.1f tokens/sec, peak RSS %ld KB\n", run_pairs, run_sec,
+            run_sec > 0 ? run_pairs / run_sec : 0.0, usage.ru_maxrss);
+    fprintf(stderr, "Training complete.\n");
+    train_engine_free(&engine);
+}
+
+// --- Evaluation ---
+// Mean cross entropy and perplexity of predicting word i+1 from word i over
+// the whole sequence, without training. Uses the Huffman tree when the model
+// was trained with softmax=hierarchical, the full softmax otherwise, so
+// models trained with any softmax mode can be compared.
+int evaluate_model(struct VocabEntry *vocab, int vocab_size, const char *vocab_filename) {
+    Config config;
+    char config_path[1024];
+    strcpy(config_path, vocab_filename);
+    sprintf(config_path, "%s/config.txt", dirname(config_path));
+    load_config(&config, config_path);
+
+    char *output_dir = dirname(strdup(vocab_filename));
+    char attn_path[1024], mlp_path[1024], out_path[1024], tree_path[1024];
+    const char *ext = config.binary_io ? ".bin" : ".txt";
+    sprintf(attn_path, "%s/attention_model%s", output_dir, ext); sprintf(mlp_path, "%s/mlp_model%s", output_dir, ext);
+    sprintf(out_path, "%s/output_layer%s", output_dir, ext); sprintf(tree_path, "%s/%s", output_dir, SOFTMAX_TREE_FILE);
+
+    TrainEngine engine;
+    SoftmaxTree tree;
+    if (!train_engine_init(&engine, vocab_size, config.learning_rate, config.beta1, config.beta2, 0) ||
+        !train_engine_load(&engine, attn_path, mlp_path, out_path)) { train_engine_free(&engine); return 0; }
+    int hierarchical = softmax_tree_load(&tree, tree_path, vocab_size);
+
+    double total = 0;
+    int n = 0;
+    for (int i = 0; i < vocab_size - 1; i++) {
+        if (!train_engine_forward(&engine, vocab, i, config.causal_attention)) continue;
+        float loss = 0;
+        if (hierarchical) {
+            for (int d = tree.off[i + 1]; d < tree.off[i + 2]; d++) {
+                float sc = engine.preds[tree.node[d]];
+                loss -= softmax_log_sigmoid(tree.bit[d] ? sc : -sc);
+            }
+        } else {
+            loss = compute_cross_entropy_loss_and_gradient(engine.preds, i + 1, vocab_size, engine.grad_loss);
+        }
+        if (isnan(loss) || isinf(loss)) continue;
+        total += loss;
+        n++;
+    }
+    printf("tokens=%d softmax=%s cross_entropy=%f perplexity=%f\n", n, hierarchical ? "hierarchical" : "full",
+           n ? total / n : 0.0, n ? exp(total / n) : 0.0);
+    if (hierarchical) softmax_tree_free(&tree);
+    train_engine_free(&engine);
+    return 1;
+}
+
 // --- Main Training Logic ---
-void train_model(struct VocabEntry *vocab, int vocab_size, const char *vocab_filename) {
+void train_model(struct VocabEntry *vocab, int vocab_size, const char *vocab_filename, int spawn_stages) {
     fprintf(stderr, "Training model...\n");
     
     // Load configuration
@@ -174,15 +390,31 @@ void train_model(struct VocabEntry *vocab, int vocab_size, const char *vocab_fil
     int cmd_len;       // For dynamic command string length calculation
     char pth[1024];
     char attn_path[1024], mlp_path[1024], optim_path[1024], out_path[1024];
-    sprintf(attn_path, "%s/attention_model.txt", output_dir); sprintf(mlp_path, "%s/mlp_model.txt", output_dir);
-    sprintf(optim_path, "%s/optimizer_state.txt", output_dir); sprintf(out_path, "%s/output_layer.txt", output_dir);
+    const char *ext = config.binary_io ? ".bin" : ".txt";
+    sprintf(attn_path, "%s/attention_model%s", output_dir, ext); sprintf(mlp_path, "%s/mlp_model%s", output_dir, ext);
+    sprintf(optim_path, "%s/optimizer_state.txt", output_dir); sprintf(out_path, "%s/output_layer%s", output_dir, ext);
+
+    // Both paths start from the model files on disk
+    ensure_model_files(attn_path, mlp_path, out_path, vocab_size);
+    // A tree left by an earlier hierarchical run no longer describes the model
+    sprintf(pth, "%s/%s", output_dir, SOFTMAX_TREE_FILE);
+    if (config.softmax_mode != SOFTMAX_HIERARCHICAL) remove(pth);
+    if (spawn_stages && config.corpus[0]) fprintf(stderr, "Warning: corpus=%s needs the in-process trainer, -spawn trains on the vocab sequence\n", config.corpus);
+    if (!spawn_stages) {
+        train_model_in_process(vocab, vocab_size, vocab_filename, &config, output_dir, attn_path, mlp_path, out_path, optim_path);
+        return;
+    }
+    if (config.softmax_mode != SOFTMAX_FULL) {
+        fprintf(stderr, "Warning: softmax=%s needs the in-process trainer; -spawn uses the full softmax\n", softmax_mode_name(config.softmax_mode));
+        remove(pth);
+    }
 
     // Use dynamic allocation for command string
         free(cmd);
-        cmd_len = snprintf(NULL, 0, "./+x/optimizer.+x adam-init %s %s %d", optim_path, output_dir, vocab_size);
+        cmd_len = snprintf(NULL, 0, "./+x/optimizer.+x adam-init %s %s %d %s", optim_path, output_dir, vocab_size, ext + 1);
         cmd = malloc(cmd_len + 1);
         if (cmd) {
-            snprintf(cmd, cmd_len + 1, "./+x/optimizer.+x adam-init %s %s %d", optim_path, output_dir, vocab_size);
+            snprintf(cmd, cmd_len + 1, "./+x/optimizer.+x adam-init %s %s %d %s", optim_path, output_dir, vocab_size, ext + 1);
         }
     if (system(cmd) != 0) { fprintf(stderr, "Failed to initialize optimizer\n"); return; }
     
@@ -207,13 +439,19 @@ void train_model(struct VocabEntry *vocab, int vocab_size, const char *vocab_fil
             if (system(cmd) != 0) { fprintf(stderr, "\nForward prop failed\n"); continue; }
 
             char pred_path[1024], gloss_path[1024], hidden_path[1024], ctx_path[1024], q_path[1024], k_path[1024], v_path[1024], asr_path[1024];
-            sprintf(pred_path, "%s/predictions.txt", output_dir); sprintf(gloss_path, "%s/grad_loss.txt", output_dir);
-            sprintf(hidden_path, "%s/hidden_state.txt", output_dir); sprintf(ctx_path, "%s/context.txt", output_dir);
-            sprintf(q_path, "%s/q.txt", output_dir); sprintf(k_path, "%s/k.txt", output_dir); sprintf(v_path, "%s/v.txt", output_dir);
-            sprintf(asr_path, "%s/attn_scores_raw.txt", output_dir);
+            sprintf(pred_path, "%s/predictions%s", output_dir, ext); sprintf(gloss_path, "%s/grad_loss%s", output_dir, ext);
+            sprintf(hidden_path, "%s/hidden_state%s", output_dir, ext); sprintf(ctx_path, "%s/context%s", output_dir, ext);
+            sprintf(q_path, "%s/q%s", output_dir, ext); sprintf(k_path, "%s/k%s", output_dir, ext); sprintf(v_path, "%s/v%s", output_dir, ext);
+            sprintf(asr_path, "%s/attn_scores_raw%s", output_dir, ext);
 
-            FILE *pred_f = fopen(pred_path, "r"); if (!pred_f) { fprintf(stderr, "\nNo predictions file.\n"); continue; }
-            float *preds = malloc(vocab_size * sizeof(float)); for(int j=0; j<vocab_size; j++) fscanf(pred_f, "%f", &preds[j]); fclose(pred_f);
+            float *preds = malloc(vocab_size * sizeof(float));
+            if (config.binary_io) {
+                if (!tensor_load_matrix(pred_path, preds, 1, vocab_size)) { fprintf(stderr, "\nNo predictions file.\n"); free(preds); continue; }
+            } else {
+                FILE *pred_f = fopen(pred_path, "r"); if (!pred_f) { fprintf(stderr, "\nNo predictions file.\n"); free(preds); continue; }
+                for(int j=0; j<vocab_size; j++) fscanf(pred_f, "%f", &preds[j]);
+                fclose(pred_f);
+            }
             float *grad = malloc(vocab_size * sizeof(float));
             float loss = compute_cross_entropy_loss_and_gradient(preds, i + 1, vocab_size, grad);
             // Check for NaN loss
@@ -226,7 +464,8 @@ void train_model(struct VocabEntry *vocab, int vocab_size, const char *vocab_fil
                 }
             }
             total_loss += loss;
-            FILE *gloss_f = fopen(gloss_path, "w"); if(gloss_f){ for(int j=0; j<vocab_size; j++) fprintf(gloss_f, "%f ", grad[j]); fclose(gloss_f); }
+            if (config.binary_io) tensor_save_matrix(gloss_path, grad, 1, vocab_size);
+            else { FILE *gloss_f = fopen(gloss_path, "w"); if(gloss_f){ for(int j=0; j<vocab_size; j++) fprintf(gloss_f, "%f ", grad[j]); fclose(gloss_f); } }
 
             // Use dynamic allocation for command string
             free(cmd);
@@ -259,7 +498,15 @@ void train_model(struct VocabEntry *vocab, int vocab_size, const char *vocab_fil
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) { fprintf(stderr, "Usage: %s <vocab_model.txt>\n", argv[0]); return 1; }
+    if (argc < 2) { fprintf(stderr, "Usage: %s <vocab_model.txt> [-spawn|-eval]\n", argv[0]); return 1; }
+
+    // -spawn runs the old forward_prop/backward_prop/optimizer process chain per token
+    // -eval prints the model's cross entropy and perplexity without training
+    int spawn_stages = 0, eval_only = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-spawn") == 0) spawn_stages = 1;
+        if (strcmp(argv[i], "-eval") == 0) eval_only = 1;
+    }
     
     // Dynamically allocate vocab array
     struct VocabEntry *vocab = NULL;
@@ -309,8 +556,12 @@ int main(int argc, char *argv[]) {
     }
     fclose(infile);
     
-    srand(time(NULL));
-    train_model(vocab, vocab_size, argv[1]);
+    if (eval_only) return !evaluate_model(vocab, vocab_size, argv[1]);
+
+    // TRAINER_SEED fixes the initial weights of a new model (benchmarks)
+    const char *seed = getenv("TRAINER_SEED");
+    srand(seed ? (unsigned)atoi(seed) : (unsigned)time(NULL));
+    train_model(vocab, vocab_size, argv[1], spawn_stages);
     
     // Save the updated vocab
     if (!save_vocab(vocab, vocab_size, argv[1])) { 
@@ -0,0 +1,384 @@
+#ifndef VOCAB_INDEX_H
+#define VOCAB_INDEX_H
+
+// Persistent merged vocabulary for the MoE chatbot.
+//
+// Layout:
+//   VocabIndexHeader                          80 bytes
+//   VocabIndexSource[nsources]                one per curriculum, in bank order
+//   struct VocabEntry[count]                  deduplicated, first-seen order
+//   uint32_t hashes[count]                    FNV-1a of each word
+//   uint32_t prov_start[count + 1]            provenance range of entry i
+//   VocabIndexProvenance[prov_count]          which experts hold each word
+//   uint32_t slots[table_size]                entry id + 1, 0 when empty
+//
+// Every section starts on a VOCAB_INDEX_ALIGN boundary. The file is opened
+// with mmap, so startup is one stat per curriculum plus a page fault per
+// touched entry, and a lookup is a hash probe however many experts are
+// merged. The entry rows are struct VocabEntry as defined by the includer;
+// entry_size in the header guards against a layout change.
+//
+// A word seen in several curricula keeps the values of its first occurrence
+// in bank order (what the old linear find_word returned) and lists every
+// expert it appears in, with its first row number and occurrence count there.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define VOCAB_INDEX_MAGIC "RDVI"
+#define VOCAB_INDEX_VERSION 1
+#define VOCAB_INDEX_ALIGN 64
+#define VOCAB_INDEX_PATH_LEN 1024
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_size;    // sizeof(struct VocabEntry) of the writer
+    uint32_t nsources;
+    uint32_t count;         // distinct words
+    uint32_t prov_count;
+    uint32_t table_size;    // power of two, at least 2 * count
+    uint32_t reserved;
+    uint64_t sources_off, entries_off, hashes_off, prov_start_off;
+    uint64_t prov_off, slots_off;
+} VocabIndexHeader;
+
+// A curriculum the index was built from. Size and mtime decide staleness.
+typedef struct {
+    char path[VOCAB_INDEX_PATH_LEN];
+    int64_t size;
+    int64_t mtime;          // nanoseconds
+    uint32_t rows;          // data rows read from the file
+    uint32_t words;         // distinct words among them
+} VocabIndexSource;
+
+typedef struct {
+    uint32_t source;        // index into the source table
+    uint32_t number;        // "number" column of the word's first row there
+    uint32_t occurrences;   // rows holding the word in that curriculum
+    uint32_t reserved;
+} VocabIndexProvenance;
+
+// A mapped index
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    VocabIndexHeader *header;
+    VocabIndexSource *sources;
+    struct VocabEntry *entries;
+    uint32_t *hashes;
+    uint32_t *prov_start;
+    VocabIndexProvenance *prov;
+    uint32_t *slots;
+    int count;
+} VocabIndex;
+
+// FNV-1a, the same hash vocab_model.c uses
+static inline uint32_t vocab_index_hash(const char *word) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)word; *p; p++) { h ^= *p; h *= 16777619u; }
+    return h;
+}
+
+static inline int64_t vocab_index_mtime(const struct stat *st) { return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec; }
+
+static inline uint64_t vocab_index_align(uint64_t x) { return (x + VOCAB_INDEX_ALIGN - 1) & ~(uint64_t)(VOCAB_INDEX_ALIGN - 1); }
+
+// Index file kept next to a bank file: "bank.txt" -> "bank.vidx"
+static inline void vocab_index_path(const char *bank_path, char *out, size_t n) {
+    size_t len = strlen(bank_path);
+    if (len >= 4 && strcmp(bank_path + len - 4, ".txt") == 0) len -= 4;
+    snprintf(out, n, "%.*s.vidx", (int)len, bank_path);
+}
+
+// Id of word, or -1. Constant time in the number of merged curricula.
+static inline int vocab_index_find(const VocabIndex *vi, const char *word) {
+    if (vi->count == 0) return -1;
+    uint32_t h = vocab_index_hash(word);
+    uint32_t mask = vi->header->table_size - 1;
+    for (uint32_t s = h & mask; vi->slots[s]; s = (s + 1) & mask) {
+        uint32_t id = vi->slots[s] - 1;
+        if (vi->hashes[id] == h && strcmp(vi->entries[id].word, word) == 0) return id;
+    }
+    return -1;
+}
+
+// Experts holding entry id: *n records starting at the returned pointer
+static inline const VocabIndexProvenance *vocab_index_provenance(const VocabIndex *vi, int id, int *n) {
+    *n = vi->prov_start[id + 1] - vi->prov_start[id];
+    return vi->prov + vi->prov_start[id];
+}
+
+static inline void vocab_index_close(VocabIndex *vi) {
+    if (vi->base) munmap(vi->base, vi->size);
+    memset(vi, 0, sizeof(*vi));
+}
+
+// Was the mapped index built from exactly these curricula, in this order,
+// with none of them changed since? A curriculum that was missing at build
+// time (size -1) is fresh while it is still missing.
+static inline int vocab_index_fresh(const VocabIndex *vi, char paths[][VOCAB_INDEX_PATH_LEN], int n) {
+    if ((int)vi->header->nsources != n) return 0;
+    for (int i = 0; i < n; i++) {
+        struct stat s;
+        if (strncmp(vi->sources[i].path, paths[i], VOCAB_INDEX_PATH_LEN) != 0) return 0;
+        if (stat(paths[i], &s) != 0) {
+            if (vi->sources[i].size != -1) return 0;
+        } else if (vi->sources[i].size != (int64_t)s.st_size || vi->sources[i].mtime != vocab_index_mtime(&s)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Map an index and check that it was built from exactly these curricula, in
+// this order, and that none of them changed since. Returns 0 on any
+// mismatch; the caller then rebuilds.
+static inline int vocab_index_open(const char *path, VocabIndex *vi, char paths[][VOCAB_INDEX_PATH_LEN], int n) {
+    memset(vi, 0, sizeof(*vi));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(VocabIndexHeader)) { close(fd); return 0; }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return 0;
+    vi->base = base;
+    vi->size = st.st_size;
+
+    VocabIndexHeader *h = (VocabIndexHeader*)base;
+    uint64_t size = st.st_size;
+    int ok = memcmp(h->magic, VOCAB_INDEX_MAGIC, 4) == 0 && h->version == VOCAB_INDEX_VERSION &&
+             h->entry_size == sizeof(struct VocabEntry) && h->nsources == (uint32_t)n &&
+             h->table_size > 0 && (h->table_size & (h->table_size - 1)) == 0 && h->table_size >= 2 * (uint64_t)h->count &&
+             h->sources_off + (uint64_t)h->nsources * sizeof(VocabIndexSource) <= size &&
+             h->entries_off + (uint64_t)h->count * sizeof(struct VocabEntry) <= size &&
+             h->hashes_off + (uint64_t)h->count * sizeof(uint32_t) <= size &&
+             h->prov_start_off + ((uint64_t)h->count + 1) * sizeof(uint32_t) <= size &&
+             h->prov_off + (uint64_t)h->prov_count * sizeof(VocabIndexProvenance) <= size &&
+             h->slots_off + (uint64_t)h->table_size * sizeof(uint32_t) <= size;
+    if (ok) {
+        vi->header = h;
+        vi->sources = (VocabIndexSource*)(vi->base + h->sources_off);
+        vi->entries = (struct VocabEntry*)(vi->base + h->entries_off);
+        vi->hashes = (uint32_t*)(vi->base + h->hashes_off);
+        vi->prov_start = (uint32_t*)(vi->base + h->prov_start_off);
+        vi->prov = (VocabIndexProvenance*)(vi->base + h->prov_off);
+        vi->slots = (uint32_t*)(vi->base + h->slots_off);
+        vi->count = h->count;
+        ok = vi->prov_start[vi->count] == h->prov_count;
+    }
+    if (ok) ok = vocab_index_fresh(vi, paths, n);
+    if (!ok) vocab_index_close(vi);
+    return ok;
+}
+
+// --- Building ---
+
+// Growable merge state: entries in first-seen order with a hash table over
+// them, and per-entry provenance chained through next until it is written
+// out grouped by entry.
+typedef struct {
+    struct VocabEntry *entries;
+    uint32_t *hashes;
+    int32_t *prov_head, *prov_tail;
+    int count, capacity;
+    int32_t *slots;
+    int slot_count;
+    VocabIndexProvenance *prov;
+    int32_t *prov_next;
+    int prov_count, prov_cap;
+} VocabIndexBuilder;
+
+static inline void vocab_index_builder_free(VocabIndexBuilder *b) {
+    free(b->entries); free(b->hashes); free(b->prov_head); free(b->prov_tail);
+    free(b->slots); free(b->prov); free(b->prov_next);
+    memset(b, 0, sizeof(*b));
+}
+
+static inline int vocab_index_builder_slot(const VocabIndexBuilder *b, const char *word, uint32_t h) {
+    int mask = b->slot_count - 1;
+    int s = h & mask;
+    while (b->slots[s] >= 0 && (b->hashes[b->slots[s]] != h || strcmp(b->entries[b->slots[s]].word, word) != 0)) s = (s + 1) & mask;
+    return s;
+}
+
+static inline int vocab_index_builder_grow(VocabIndexBuilder *b) {
+    int cap = b->capacity ? b->capacity * 2 : 1024;
+    struct VocabEntry *e = realloc(b->entries, cap * sizeof(*e));
+    if (e) b->entries = e;
+    uint32_t *hs = realloc(b->hashes, cap * sizeof(*hs));
+    if (hs) b->hashes = hs;
+    int32_t *ph = realloc(b->prov_head, cap * sizeof(*ph));
+    if (ph) b->prov_head = ph;
+    int32_t *pt = realloc(b->prov_tail, cap * sizeof(*pt));
+    if (pt) b->prov_tail = pt;
+    if (!e || !hs || !ph || !pt) return 0;
+    b->capacity = cap;
+
+    free(b->slots);
+    b->slot_count = 2 * cap;
+    b->slots = malloc(b->slot_count * sizeof(int32_t));
+    if (!b->slots) return 0;
+    memset(b->slots, -1, b->slot_count * sizeof(int32_t));
+    for (int i = 0; i < b->count; i++) b->slots[vocab_index_builder_slot(b, b->entries[i].word, b->hashes[i])] = i;
+    return 1;
+}
+
+static inline int vocab_index_builder_add_prov(VocabIndexBuilder *b, int id, uint32_t source, uint32_t number) {
+    int tail = b->prov_tail[id];
+    if (tail >= 0 && b->prov[tail].source == source) { b->prov[tail].occurrences++; return 1; }
+    if (b->prov_count == b->prov_cap) {
+        int cap = b->prov_cap ? b->prov_cap * 2 : 1024;
+        VocabIndexProvenance *p = realloc(b->prov, cap * sizeof(*p));
+        if (p) b->prov = p;
+        int32_t *nx = realloc(b->prov_next, cap * sizeof(*nx));
+        if (nx) b->prov_next = nx;
+        if (!p || !nx) return 0;
+        b->prov_cap = cap;
+    }
+    int p = b->prov_count++;
+    b->prov[p] = (VocabIndexProvenance){ source, number, 1, 0 };
+    b->prov_next[p] = -1;
+    if (tail >= 0) b->prov_next[tail] = p; else b->prov_head[id] = p;
+    b->prov_tail[id] = p;
+    return 1;
+}
+
+// Add one row from curriculum `source`; returns 1 if the word was new
+static inline int vocab_index_builder_add(VocabIndexBuilder *b, const struct VocabEntry *row, uint32_t source) {
+    if (b->count == b->capacity && !vocab_index_builder_grow(b)) return -1;
+    uint32_t h = vocab_index_hash(row->word);
+    int s = vocab_index_builder_slot(b, row->word, h);
+    int id = b->slots[s], added = 0;
+    if (id < 0) {
+        id = b->count++;
+        b->entries[id] = *row;
+        b->hashes[id] = h;
+        b->prov_head[id] = b->prov_tail[id] = -1;
+        b->slots[s] = id;
+        added = 1;
+    }
+    return vocab_index_builder_add_prov(b, id, source, row->number) ? added : -1;
+}
+
+static inline int vocab_index_write(const char *path, const VocabIndexBuilder *b, const VocabIndexSource *sources, int nsources) {
+    VocabIndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, VOCAB_INDEX_MAGIC, 4);
+    h.version = VOCAB_INDEX_VERSION;
+    h.entry_size = sizeof(struct VocabEntry);
+    h.nsources = nsources;
+    h.count = b->count;
+    h.prov_count = b->prov_count;
+    h.table_size = 16;
+    while (h.table_size < 2 * (uint32_t)b->count) h.table_size *= 2;
+
+    h.sources_off = vocab_index_align(sizeof(h));
+    h.entries_off = vocab_index_align(h.sources_off + (uint64_t)nsources * sizeof(VocabIndexSource));
+    h.hashes_off = vocab_index_align(h.entries_off + (uint64_t)b->count * sizeof(struct VocabEntry));
+    h.prov_start_off = vocab_index_align(h.hashes_off + (uint64_t)b->count * sizeof(uint32_t));
+    h.prov_off = vocab_index_align(h.prov_start_off + ((uint64_t)b->count + 1) * sizeof(uint32_t));
+    h.slots_off = vocab_index_align(h.prov_off + (uint64_t)b->prov_count * sizeof(VocabIndexProvenance));
+    uint64_t end = vocab_index_align(h.slots_off + (uint64_t)h.table_size * sizeof(uint32_t));
+
+    uint32_t *prov_start = malloc(((size_t)b->count + 1) * sizeof(uint32_t));
+    VocabIndexProvenance *prov = malloc((b->prov_count ? b->prov_count : 1) * sizeof(VocabIndexProvenance));
+    uint32_t *slots = calloc(h.table_size, sizeof(uint32_t));
+    if (!prov_start || !prov || !slots) { free(prov_start); free(prov); free(slots); return 0; }
+    uint32_t np = 0;
+    for (int i = 0; i < b->count; i++) {
+        prov_start[i] = np;
+        for (int p = b->prov_head[i]; p >= 0; p = b->prov_next[p]) prov[np++] = b->prov[p];
+    }
+    prov_start[b->count] = np;
+    for (int i = 0; i < b->count; i++) {
+        uint32_t s = b->hashes[i] & (h.table_size - 1);
+        while (slots[s]) s = (s + 1) & (h.table_size - 1);
+        slots[s] = i + 1;
+    }
+
+    // Written beside the target and renamed over it, so a chatbot starting
+    // concurrently maps either the old index or the complete new one
+    char tmp[VOCAB_INDEX_PATH_LEN + 16];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (!f) { fprintf(stderr, "Failed to open %s for writing\n", tmp); free(prov_start); free(prov); free(slots); return 0; }
+    static const unsigned char zeros[VOCAB_INDEX_ALIGN] = {0};
+    uint64_t pos = 0;
+#define VOCAB_INDEX_PUT(off, ptr, bytes) do { fwrite(zeros, 1, (off) - pos, f); fwrite((ptr), 1, (bytes), f); pos = (off) + (bytes); } while (0)
+    VOCAB_INDEX_PUT(0, &h, sizeof(h));
+    VOCAB_INDEX_PUT(h.sources_off, sources, (uint64_t)nsources * sizeof(VocabIndexSource));
+    VOCAB_INDEX_PUT(h.entries_off, b->entries, (uint64_t)b->count * sizeof(struct VocabEntry));
+    VOCAB_INDEX_PUT(h.hashes_off, b->hashes, (uint64_t)b->count * sizeof(uint32_t));
+    VOCAB_INDEX_PUT(h.prov_start_off, prov_start, ((uint64_t)b->count + 1) * sizeof(uint32_t));
+    VOCAB_INDEX_PUT(h.prov_off, prov, (uint64_t)b->prov_count * sizeof(VocabIndexProvenance));
+    VOCAB_INDEX_PUT(h.slots_off, slots, (uint64_t)h.table_size * sizeof(uint32_t));
+#undef VOCAB_INDEX_PUT
+    fwrite(zeros, 1, end - pos, f);
+    int ok = !ferror(f);
+    ok = fclose(f) == 0 && ok;
+    free(prov_start); free(prov); free(slots);
+    if (ok && rename(tmp, path) != 0) { perror("Error renaming vocabulary index"); ok = 0; }
+    if (!ok) unlink(tmp);
+    return ok;
+}
+
+// Read every curriculum in bank order, dedupe by word and write the index.
+// Rows are parsed like the vocab files everywhere else: a header line, then
+// "number word embedding pe weight bias1 bias2 bias3 bias4". A row missing
+// any of the nine fields is skipped with a warning.
+static inline int vocab_index_build(const char *path, char paths[][VOCAB_INDEX_PATH_LEN], int n) {
+    VocabIndexBuilder b;
+    memset(&b, 0, sizeof(b));
+    VocabIndexSource *sources = calloc(n, sizeof(VocabIndexSource));
+    if (!sources) return 0;
+    int ok = 1;
+    for (int i = 0; i < n && ok; i++) {
+        VocabIndexSource *src = &sources[i];
+        strncpy(src->path, paths[i], VOCAB_INDEX_PATH_LEN - 1);
+        src->size = -1;  // stays -1 for a missing file, so the index is rebuilt only once it appears
+        FILE *infile = fopen(paths[i], "r");
+        struct stat st;
+        if (!infile || fstat(fileno(infile), &st) != 0) {
+            perror("Error opening vocab file");
+            if (infile) fclose(infile);
+            continue;
+        }
+        src->size = st.st_size;
+        src->mtime = vocab_index_mtime(&st);
+
+        char line[1024];
+        struct VocabEntry row;
+        int line_no = 1;
+        if (!fgets(line, sizeof(line), infile)) line[0] = 0;  // header
+        while (ok && fgets(line, sizeof(line), infile)) {
+            line_no++;
+            memset(&row, 0, sizeof(row));
+            int fields = sscanf(line, "%d %99s %f %f %f %f %f %f %f", &row.number, row.word, &row.embedding, &row.pe,
+                                &row.weight, &row.bias1, &row.bias2, &row.bias3, &row.bias4);
+            if (fields != 9) {
+                if (fields > 0) fprintf(stderr, "%s:%d: skipping a row with %d of 9 fields\n", paths[i], line_no, fields);
+                continue;
+            }
+            int added = vocab_index_builder_add(&b, &row, i);
+            if (added < 0) { fprintf(stderr, "Failed to allocate memory for vocabulary index\n"); ok = 0; break; }
+            src->rows++;
+        }
+        fclose(infile);
+    }
+    // Distinct words per source, for the startup summary
+    for (int i = 0; ok && i < b.prov_count; i++) sources[b.prov[i].source].words++;
+    if (ok) ok = vocab_index_write(path, &b, sources, n);
+    vocab_index_builder_free(&b);
+    free(sources);
+    return ok;
+}
+
+#endif
@@ -2,12 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <libgen.h>
 
 #define MAX_WORD_LENGTH 100
 #define MAX_VOCAB_SIZE 100000
+#define READ_CHUNK_SIZE (1 << 16)
 
 // Structure to hold a vocabulary entry
 struct VocabEntry {
@@ -22,142 +24,268 @@ struct VocabEntry {
     float bias4;
 };
 
-// Function to add a word to the vocabulary
-int add_word(struct VocabEntry *vocab, int vocab_size, const char *word) {
-    if (vocab_size >= MAX_VOCAB_SIZE) {
-        return vocab_size;
+// Vocabulary builder: entries in first-seen order (that order is the token
+// id) plus an open-addressing hash table of indexes into them, so repeated
+// words bump count instead of adding a row.
+typedef struct {
+    struct VocabEntry *entries;
+    int size, capacity;
+    int *slots;          // index into entries, -1 when empty
+    int slot_count;      // power of two
+    int *sequence;       // token ids in corpus order, for -sequence output
+    int sequence_len, sequence_cap;
+    int keep_sequence;
+    int truncated;       // set once MAX_VOCAB_SIZE was reached
+} Vocab;
+
+// FNV-1a
+static uint32_t hash_word(const char *word) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)word; *p; p++) { h ^= *p; h *= 16777619u; }
+    return h;
+}
+
+int vocab_init(Vocab *v, int keep_sequence) {
+    memset(v, 0, sizeof(*v));
+    v->capacity = 1024;
+    v->slot_count = 2048;
+    v->entries = malloc(v->capacity * sizeof(struct VocabEntry));
+    v->slots = malloc(v->slot_count * sizeof(int));
+    v->keep_sequence = keep_sequence;
+    if (!v->entries || !v->slots) return 0;
+    memset(v->slots, -1, v->slot_count * sizeof(int));
+    return 1;
+}
+
+void vocab_free(Vocab *v) {
+    free(v->entries);
+    free(v->slots);
+    free(v->sequence);
+    memset(v, 0, sizeof(*v));
+}
+
+// Slot holding word, or the empty slot where it would go
+static int vocab_find_slot(Vocab *v, const char *word, uint32_t h) {
+    int mask = v->slot_count - 1;
+    int s = h & mask;
+    while (v->slots[s] >= 0 && strcmp(v->entries[v->slots[s]].word, word) != 0) s = (s + 1) & mask;
+    return s;
+}
+
+static int vocab_grow_slots(Vocab *v) {
+    int *old = v->slots, old_count = v->slot_count;
+    v->slot_count *= 2;
+    v->slots = malloc(v->slot_count * sizeof(int));
+    if (!v->slots) { v->slots = old; v->slot_count = old_count; return 0; }
+    memset(v->slots, -1, v->slot_count * sizeof(int));
+    for (int i = 0; i < old_count; i++) {
+        if (old[i] < 0) continue;
+        v->slots[vocab_find_slot(v, v->entries[old[i]].word, hash_word(v->entries[old[i]].word))] = old[i];
     }
+    free(old);
+    return 1;
+}
 
-    // Use strncpy to ensure we don't overflow the buffer, and handle UTF-8 properly
-    strncpy(vocab[vocab_size].word, word, MAX_WORD_LENGTH - 1);
-    vocab[vocab_size].word[MAX_WORD_LENGTH - 1] = '\0';  // Ensure null termination
-    
-    vocab[vocab_size].count = 1;
-    vocab[vocab_size].embedding = (float)rand() / RAND_MAX;
-    vocab[vocab_size].pe = 0.0f;
-    vocab[vocab_size].weight = (float)rand() / RAND_MAX;
-    vocab[vocab_size].bias1 = 0.0f;
-    vocab[vocab_size].bias2 = 0.0f;
-    vocab[vocab_size].bias3 = 0.0f;
-    vocab[vocab_size].bias4 = 0.0f;
-    return vocab_size + 1;
+static void vocab_append_sequence(Vocab *v, int id) {
+    if (!v->keep_sequence) return;
+    if (v->sequence_len == v->sequence_cap) {
+        int cap = v->sequence_cap ? v->sequence_cap * 2 : 4096;
+        int *tmp = realloc(v->sequence, cap * sizeof(int));
+        if (!tmp) return;
+        v->sequence = tmp;
+        v->sequence_cap = cap;
+    }
+    v->sequence[v->sequence_len++] = id;
 }
 
-// Function to count words in a file
-int count_words_in_file(const char *filename) {
-    FILE *file = fopen(filename, "rb");  // Open in binary mode for UTF-8
-    if (!file) {
-        return 0;
-    }
-    int count = 0;
-    char buffer[MAX_WORD_LENGTH * 10];
-    while (fgets(buffer, sizeof(buffer), file)) {
-        char *token = strtok(buffer, ",\n");
-        while (token != NULL) {
-            count++;
-            token = strtok(NULL, ",\n");
-        }
+// Function to add a word to the vocabulary. Returns its token id, or -1 if
+// the vocabulary is full and the word is new.
+int add_word(Vocab *v, const char *word) {
+    char key[MAX_WORD_LENGTH];
+    // Use strncpy to ensure we don't overflow the buffer, and handle UTF-8 properly
+    strncpy(key, word, MAX_WORD_LENGTH - 1);
+    key[MAX_WORD_LENGTH - 1] = '\0';
+
+    uint32_t h = hash_word(key);
+    int s = vocab_find_slot(v, key, h);
+    if (v->slots[s] >= 0) {
+        int id = v->slots[s];
+        v->entries[id].count++;
+        vocab_append_sequence(v, id);
+        return id;
     }
-    fclose(file);
-    return count;
+
+    if (v->size >= MAX_VOCAB_SIZE) {
+        if (!v->truncated) fprintf(stderr, "\nWarning: vocabulary reached %d words, new words are ignored\n", MAX_VOCAB_SIZE);
+        v->truncated = 1;
+        return -1;
+    }
+    if (v->size == v->capacity) {
+        int cap = v->capacity * 2;
+        struct VocabEntry *tmp = realloc(v->entries, cap * sizeof(struct VocabEntry));
+        if (!tmp) { perror("Failed to grow vocabulary"); return -1; }
+        v->entries = tmp;
+        v->capacity = cap;
+    }
+    // Keep the load factor under 0.7
+    if ((v->size + 1) * 10 > v->slot_count * 7) {
+        if (!vocab_grow_slots(v)) { perror("Failed to grow vocabulary index"); return -1; }
+        s = vocab_find_slot(v, key, h);
+    }
+
+    int id = v->size++;
+    struct VocabEntry *e = &v->entries[id];
+    strcpy(e->word, key);
+    e->count = 1;
+    e->embedding = (float)rand() / RAND_MAX;
+    e->pe = 0.0f;
+    e->weight = (float)rand() / RAND_MAX;
+    e->bias1 = 0.0f;
+    e->bias2 = 0.0f;
+    e->bias3 = 0.0f;
+    e->bias4 = 0.0f;
+    v->slots[s] = id;
+    vocab_append_sequence(v, id);
+    return id;
 }
 
 // Function to check if a character is a space or tab (but not part of an emoji)
 int is_word_delimiter(char c) {
-    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',' || c == ';' || c == ':' || 
-           c == '!' || c == '?' || c == '.' || c == '(' || c == ')' || c == '[' || c == ']' || 
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',' || c == ';' || c == ':' ||
+           c == '!' || c == '?' || c == '.' || c == '(' || c == ')' || c == '[' || c == ']' ||
            c == '{' || c == '}' || c == '"' || c == '\'';
 }
 
-// Function to process a file and add its words to the vocabulary
-int process_file(const char *filename, struct VocabEntry *vocab, int vocab_size) {
+// Function to process a file and add its words to the vocabulary.
+// The file is read in READ_CHUNK_SIZE blocks; a word split across two
+// blocks is carried over in `word`, so chunk boundaries never cut tokens.
+void process_file(const char *filename, Vocab *v) {
     fprintf(stderr, "Processing file: %s\n", filename);
-    int total_words_in_file = count_words_in_file(filename);
     FILE *file = fopen(filename, "rb");  // Open in binary mode for UTF-8
 
     if (!file) {
         perror("Error opening file");
-        return vocab_size;
+        return;
     }
 
-    char word[MAX_WORD_LENGTH];
-    int is_new_sentence = 1;
+    struct stat st;
+    long total_bytes = fstat(fileno(file), &st) == 0 ? (long)st.st_size : 0;
+    long bytes_read = 0;
 
     // Add start-token for the beginning of the file
-    vocab_size = add_word(vocab, vocab_size, "start-token");
+    add_word(v, "start-token");
 
-    char buffer[MAX_WORD_LENGTH * 10]; // Larger buffer to handle emojis
+    char *buffer = malloc(READ_CHUNK_SIZE);
+    if (!buffer) {
+        perror("Failed to allocate read buffer");
+        fclose(file);
+        return;
+    }
+    char word[MAX_WORD_LENGTH];
+    int word_len = 0, word_too_long = 0;
     int words_processed_in_file = 0;
+    size_t n;
 
-    while (fgets(buffer, sizeof(buffer), file)) {
-        // Process the buffer character by character to handle emojis properly
-        int i = 0;
-        int len = strlen(buffer);
-        
-        while (i < len) {
-            // Skip whitespace
-            while (i < len && is_word_delimiter(buffer[i])) {
-                if (buffer[i] == '.' || buffer[i] == '?' || buffer[i] == '!') {
-                    vocab_size = add_word(vocab, vocab_size, "end-token");
-                    words_processed_in_file++;
-                    is_new_sentence = 1;
-                }
-                i++;
-            }
-            
-            if (i >= len) break;
-            
-            // Extract word (including potential emojis)
-            int word_start = i;
-            while (i < len && !is_word_delimiter(buffer[i])) {
-                i++;
+    while ((n = fread(buffer, 1, READ_CHUNK_SIZE, file)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            char c = buffer[i];
+            if (!is_word_delimiter(c)) {
+                // Extract word (including potential emojis)
+                if (word_len < MAX_WORD_LENGTH - 2) word[word_len++] = c;
+                else word_too_long = 1;
+                continue;
             }
-            
-            // Copy the word
-            int word_len = i - word_start;
-            if (word_len > 0 && word_len < MAX_WORD_LENGTH - 1) {
-                strncpy(word, &buffer[word_start], word_len);
+            if (word_len > 0 && !word_too_long) {
                 word[word_len] = '\0';
-                
-                // Add word to vocabulary
-                if (strlen(word) > 0) {
-                    vocab_size = add_word(vocab, vocab_size, word);
-                    words_processed_in_file++;
-                    is_new_sentence = 0;
-                }
+                add_word(v, word);
+                words_processed_in_file++;
             }
-            
-            if (words_processed_in_file % 100 == 0 || words_processed_in_file == total_words_in_file) {
-                fprintf(stderr, "\rProcessing %s: Words processed: %d/%d (Current Vocab size: %d)", filename, words_processed_in_file, total_words_in_file, vocab_size);
-                fflush(stderr);
+            word_len = 0;
+            word_too_long = 0;
+            if (c == '.' || c == '?' || c == '!') {
+                add_word(v, "end-token");
+                words_processed_in_file++;
             }
         }
+        bytes_read += n;
+        fprintf(stderr, "\rProcessing %s: %ld/%ld bytes, words processed: %d (Current Vocab size: %d)", filename, bytes_read, total_bytes, words_processed_in_file, v->size);
+        fflush(stderr);
+    }
+    if (word_len > 0 && !word_too_long) {
+        word[word_len] = '\0';
+        add_word(v, word);
+        words_processed_in_file++;
     }
 
     fprintf(stderr, "\n"); // Newline after file processing
 
+    free(buffer);
     fclose(file);
-    return vocab_size;
 }
 
+// Drop words seen fewer than min_count times and renumber the rest, keeping
+// first-seen order. Returns the number of words removed.
+int prune_vocab(Vocab *v, int min_count) {
+    if (min_count <= 1) return 0;
+    int *remap = malloc(v->size * sizeof(int));
+    if (!remap) return 0;
+    int kept = 0;
+    for (int i = 0; i < v->size; i++) {
+        int special = strcmp(v->entries[i].word, "start-token") == 0 || strcmp(v->entries[i].word, "end-token") == 0;
+        if (v->entries[i].count >= min_count || special) {
+            remap[i] = kept;
+            v->entries[kept++] = v->entries[i];
+        } else {
+            remap[i] = -1;
+        }
+    }
+    int removed = v->size - kept;
+    v->size = kept;
+
+    int len = 0;
+    for (int i = 0; i < v->sequence_len; i++) if (remap[v->sequence[i]] >= 0) v->sequence[len++] = remap[v->sequence[i]];
+    v->sequence_len = len;
+
+    // Rebuild the index over the surviving entries
+    memset(v->slots, -1, v->slot_count * sizeof(int));
+    for (int i = 0; i < v->size; i++) v->slots[vocab_find_slot(v, v->entries[i].word, hash_word(v->entries[i].word))] = i;
+    free(remap);
+    return removed;
+}
 
+static void write_entry(FILE *outfile, int number, struct VocabEntry *e, float pe) {
+    fprintf(outfile, "%d %s %f %f %f %f %f %f %f\n",
+            number, e->word, e->embedding, pe, e->weight,
+            e->bias1, e->bias2, e->bias3, e->bias4);
+}
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <file1.txt> [file2.txt] ...\n", argv[0]);
+    int min_count = 1, sequence_output = 0;
+    char **files = malloc(argc * sizeof(char*));
+    int file_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-min-count") == 0 && i + 1 < argc) min_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-sequence") == 0) sequence_output = 1;
+        else files[file_count++] = argv[i];
+    }
+    if (file_count < 1) {
+        fprintf(stderr, "Usage: %s [-min-count N] [-sequence] <file1.txt> [file2.txt] ...\n", argv[0]);
+        fprintf(stderr, "  -min-count N  drop words seen fewer than N times\n");
+        fprintf(stderr, "  -sequence     write one row per token occurrence (the old layout) instead of one per word\n");
+        free(files);
         return 1;
     }
 
     // --- Path generation logic ---
     char curriculum_base_name[256] = "";
-    for (int i = 1; i < argc; i++) {
-        char *path_copy = strdup(argv[i]);
+    for (int i = 0; i < file_count; i++) {
+        char *path_copy = strdup(files[i]);
         char *bname = basename(path_copy);
         char *dot = strrchr(bname, '.');
         if (dot) {
             *dot = '\0';
         }
-        if (i > 1) {
+        if (i > 0) {
             strcat(curriculum_base_name, "_");
         }
         strcat(curriculum_base_name, bname);
@@ -176,55 +304,60 @@ int main(int argc, char *argv[]) {
         mkdir(curriculum_dir, 0700);
     }
 
-    char outfile_path[1024];
+    char outfile_path[1024], counts_path[1024];
     sprintf(outfile_path, "%s/%s.txt", curriculum_dir, curriculum_base_name);
+    sprintf(counts_path, "%s/%s.counts.txt", curriculum_dir, curriculum_base_name);
     // --- End of path generation logic ---
 
-    struct VocabEntry *vocab = malloc(MAX_VOCAB_SIZE * sizeof(struct VocabEntry));
-    if (!vocab) {
+    Vocab vocab;
+    if (!vocab_init(&vocab, sequence_output)) {
         perror("Failed to allocate memory for vocabulary");
+        free(files);
         return 1;
     }
-    int vocab_size = 0;
 
-    for (int i = 1; i < argc; i++) {
-        vocab_size = process_file(argv[i], vocab, vocab_size);
+    for (int i = 0; i < file_count; i++) {
+        process_file(files[i], &vocab);
     }
+    free(files);
 
     // Ensure end-token is always in the vocabulary
-    vocab_size = add_word(vocab, vocab_size, "end-token");
+    add_word(&vocab, "end-token");
 
-    // Calculate positional encoding
-    for (int i = 0; i < vocab_size; i++) {
-        vocab[i].pe = (float)i / (float)vocab_size;
-    }
+    int removed = prune_vocab(&vocab, min_count);
+    if (removed > 0) fprintf(stderr, "Pruned %d words seen fewer than %d times\n", removed, min_count);
+    fprintf(stderr, "Vocabulary: %d unique words\n", vocab.size);
 
     FILE *outfile = fopen(outfile_path, "w");
     if (!outfile) {
         perror("Failed to open output file");
-        free(vocab);
+        vocab_free(&vocab);
         return 1;
     }
 
+    // Positional encoding follows the row position, as before
     fprintf(outfile, "number word embedding pe weight bias1 bias2 bias3 bias4\n");
-    for (int i = 0; i < vocab_size; i++) {
-        fprintf(outfile, "%d %s %f %f %f %f %f %f %f\n",
-                i + 1,
-                vocab[i].word,
-                vocab[i].embedding,
-                vocab[i].pe,
-                vocab[i].weight,
-                vocab[i].bias1,
-                vocab[i].bias2,
-                vocab[i].bias3,
-                vocab[i].bias4);
+    if (sequence_output) {
+        for (int i = 0; i < vocab.sequence_len; i++)
+            write_entry(outfile, i + 1, &vocab.entries[vocab.sequence[i]], (float)i / (float)vocab.sequence_len);
+    } else {
+        for (int i = 0; i < vocab.size; i++)
+            write_entry(outfile, i + 1, &vocab.entries[i], (float)i / (float)vocab.size);
     }
-
     fclose(outfile);
-    free(vocab);
+
+    // Token ids and frequencies; ids match the rows of the deduplicated file
+    FILE *countsfile = fopen(counts_path, "w");
+    if (countsfile) {
+        fprintf(countsfile, "number word count\n");
+        for (int i = 0; i < vocab.size; i++) fprintf(countsfile, "%d %s %d\n", i + 1, vocab.entries[i].word, vocab.entries[i].count);
+        fclose(countsfile);
+    }
+
+    vocab_free(&vocab);
 
     // Print the path for other tools
     printf("%s\n", outfile_path);
 
     return 0;
-}
\ No newline at end of file
+}